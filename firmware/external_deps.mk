@@ -12,3 +12,6 @@ $(platform_build_dir)/firmware/fw_jump.o: $(FW_FDT_PATH)
 $(platform_build_dir)/firmware/fw_payload.o: $(FW_FDT_PATH)
 
 $(platform_build_dir)/firmware/fw_payload.o: $(FW_PAYLOAD_PATH_FINAL)
+
+$(platform_build_dir)/firmware/fw_payload.lz4: $(FW_PAYLOAD_PATH_RAW)
+	$(call compile_lz4,$@,$<)
@@ -44,9 +44,15 @@ endif
 
 firmware-bins-$(FW_PAYLOAD) += fw_payload.bin
 ifdef FW_PAYLOAD_PATH
-FW_PAYLOAD_PATH_FINAL=$(FW_PAYLOAD_PATH)
+FW_PAYLOAD_PATH_RAW=$(FW_PAYLOAD_PATH)
 else
-FW_PAYLOAD_PATH_FINAL=$(platform_build_dir)/firmware/payloads/test.bin
+FW_PAYLOAD_PATH_RAW=$(platform_build_dir)/firmware/payloads/test.bin
+endif
+ifeq ($(FW_PAYLOAD_LZ4),y)
+FW_PAYLOAD_PATH_FINAL=$(platform_build_dir)/firmware/fw_payload.lz4
+firmware-genflags-$(FW_PAYLOAD) += -DFW_PAYLOAD_LZ4
+else
+FW_PAYLOAD_PATH_FINAL=$(FW_PAYLOAD_PATH_RAW)
 endif
 firmware-genflags-$(FW_PAYLOAD) += -DFW_PAYLOAD_PATH=\"$(FW_PAYLOAD_PATH_FINAL)\"
 ifdef FW_PAYLOAD_OFFSET
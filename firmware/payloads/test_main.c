@@ -7,8 +7,28 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_console.h>
 #include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_error.h>
 #include <sbi/sbi_string.h>
+#ifdef CONFIG_LIBFDT
+#include <libfdt.h>
+#endif
+
+/* HART ids must fit in a single hart_mask with hart_mask_base zero */
+#define BENCH_MAX_HARTS		__riscv_xlen
+
+#define BENCH_WARMUP		16
+#define BENCH_ITERS		256
+#define BENCH_SLOW_ITERS	32
+
+/* Used to bound waits when the timebase frequency is unknown */
+#define BENCH_TIMEOUT_TICKS	10000000UL
+
+#define BENCH_MODE_PARK		0
+#define BENCH_MODE_STOP		1
 
 struct sbiret {
 	unsigned long error;
@@ -40,21 +60,574 @@ struct sbiret sbi_ecall(int ext, int fid, unsigned long arg0,
 	return ret;
 }
 
+static bool has_dbcn;
+
 static inline void sbi_ecall_console_puts(const char *str)
 {
-	sbi_ecall(SBI_EXT_DBCN, SBI_EXT_DBCN_CONSOLE_WRITE,
-		  sbi_strlen(str), (unsigned long)str, 0, 0, 0, 0);
+	if (has_dbcn) {
+		sbi_ecall(SBI_EXT_DBCN, SBI_EXT_DBCN_CONSOLE_WRITE,
+			  sbi_strlen(str), (unsigned long)str, 0, 0, 0, 0);
+		return;
+	}
+
+	while (*str)
+		sbi_ecall(SBI_EXT_0_1_CONSOLE_PUTCHAR, 0, *str++,
+			  0, 0, 0, 0, 0);
+}
+
+static bool sbi_probe_extension(unsigned long extid)
+{
+	struct sbiret ret = sbi_ecall(SBI_EXT_BASE, SBI_EXT_BASE_PROBE_EXT,
+				      extid, 0, 0, 0, 0, 0);
+
+	return !ret.error && ret.value;
+}
+
+struct bench_hart {
+	unsigned long hartid;
+	volatile unsigned long online;
+	volatile unsigned long ipi_acks;
+};
+
+typedef int (*bench_fn_t)(void *arg);
+
+struct bench_result {
+	unsigned long iters;
+	unsigned long min;
+	unsigned long max;
+	unsigned long sum;
+	unsigned long ticks;
+};
+
+struct bench_ipi {
+	unsigned long hmask;
+	unsigned long count;
+};
+
+struct bench_rfence {
+	unsigned long fid;
+	unsigned long hmask;
+	unsigned long size;
+};
+
+static struct bench_hart bench_harts[BENCH_MAX_HARTS];
+static unsigned long bench_nharts;
+static unsigned long bench_boot_slot;
+static volatile unsigned long bench_mode;
+static unsigned long bench_timebase;
+static unsigned long bench_timeout;
+static unsigned long bench_overhead;
+static char bench_line[128];
+
+void _start_secondary(void);
+
+static bool bench_timed_out(unsigned long tstart)
+{
+	return csr_read(CSR_TIME) - tstart > bench_timeout;
+}
+
+static void bench_print_header(void)
+{
+	sbi_snprintf(bench_line, sizeof(bench_line),
+		     "%-20s %-6s %5s %6s %9s %9s %9s %11s\n",
+		     "benchmark", "param", "harts", "iters",
+		     "min", "avg", "max", "ops/s");
+	sbi_ecall_console_puts(bench_line);
+}
+
+static void bench_print_skip(const char *name, const char *param,
+			     const char *reason)
+{
+	sbi_snprintf(bench_line, sizeof(bench_line),
+		     "%-20s %-6s skipped (%s)\n", name, param, reason);
+	sbi_ecall_console_puts(bench_line);
 }
 
-#define wfi()                                             \
-	do {                                              \
-		__asm__ __volatile__("wfi" ::: "memory"); \
-	} while (0)
+static void bench_print(const char *name, const char *param,
+			unsigned long nharts, struct bench_result *r, int rc)
+{
+	char ops[16] = "-";
+	unsigned long q, rem;
+
+	if (rc) {
+		sbi_snprintf(bench_line, sizeof(bench_line),
+			     "%-20s %-6s %5lu failed (%s %d)\n", name, param,
+			     nharts, (rc == SBI_ETIMEDOUT) ? "timeout" : "error",
+			     rc);
+		sbi_ecall_console_puts(bench_line);
+		return;
+	}
+
+	/* Avoid 64-bit divisions so that RV32 needs no libgcc helpers */
+	if (bench_timebase && r->ticks) {
+		q = bench_timebase / r->ticks;
+		rem = bench_timebase % r->ticks;
+		sbi_snprintf(ops, sizeof(ops), "%lu",
+			     q * r->iters + (rem * r->iters) / r->ticks);
+	}
+
+	sbi_snprintf(bench_line, sizeof(bench_line),
+		     "%-20s %-6s %5lu %6lu %9lu %9lu %9lu %11s\n",
+		     name, param, nharts, r->iters, r->min,
+		     r->sum / r->iters, r->max, ops);
+	sbi_ecall_console_puts(bench_line);
+}
+
+/*
+ * Run fn() BENCH_WARMUP times untimed, then iters times timed with the
+ * cycle counter. The timer is only read around the whole timed loop and
+ * gives the throughput column.
+ */
+static void bench_run(const char *name, const char *param,
+		      unsigned long nharts, unsigned long iters,
+		      bench_fn_t fn, void *arg)
+{
+	struct bench_result r = { .min = -1UL };
+	unsigned long i, start, delta, tstart;
+	int rc = 0;
+
+	for (i = 0; i < BENCH_WARMUP && !rc; i++)
+		rc = fn(arg);
+
+	tstart = csr_read(CSR_TIME);
+	for (i = 0; i < iters && !rc; i++) {
+		start = csr_read(CSR_CYCLE);
+		rc = fn(arg);
+		delta = csr_read(CSR_CYCLE) - start;
+		delta = (delta > bench_overhead) ? delta - bench_overhead : 0;
+		if (delta < r.min)
+			r.min = delta;
+		if (delta > r.max)
+			r.max = delta;
+		r.sum += delta;
+	}
+	r.ticks = csr_read(CSR_TIME) - tstart;
+	r.iters = i;
+
+	bench_print(name, param, nharts, &r, rc);
+}
+
+static void bench_calibrate(void)
+{
+	unsigned long i, start, delta;
+
+	bench_overhead = -1UL;
+	for (i = 0; i < BENCH_WARMUP; i++) {
+		start = csr_read(CSR_CYCLE);
+		delta = csr_read(CSR_CYCLE) - start;
+		if (delta < bench_overhead)
+			bench_overhead = delta;
+	}
+}
+
+static void bench_parse_timebase(unsigned long fdt_addr)
+{
+#ifdef CONFIG_LIBFDT
+	const void *fdt = (const void *)fdt_addr;
+	const fdt32_t *val;
+	int cpus_offset, len;
+
+	if (!fdt || fdt_check_header(fdt))
+		return;
+
+	cpus_offset = fdt_path_offset(fdt, "/cpus");
+	if (cpus_offset < 0)
+		return;
+
+	val = fdt_getprop(fdt, cpus_offset, "timebase-frequency", &len);
+	if (val && len > 0)
+		bench_timebase = fdt32_to_cpu(*val);
+#endif
+}
+
+static int bench_sbiret(struct sbiret ret)
+{
+	return (long)ret.error;
+}
+
+static int bench_null_ecall(void *arg)
+{
+	return bench_sbiret(sbi_ecall(SBI_EXT_BASE, SBI_EXT_BASE_PROBE_EXT,
+				      SBI_EXT_BASE, 0, 0, 0, 0, 0));
+}
+
+static int bench_set_timer(void *arg)
+{
+	/* Never expires, upper half is only used by RV32 */
+	return bench_sbiret(sbi_ecall(SBI_EXT_TIME, SBI_EXT_TIME_SET_TIMER,
+				      -1UL, -1UL, 0, 0, 0, 0));
+}
+
+static int bench_dbcn_write(void *arg)
+{
+	const char *str = arg;
+
+	return bench_sbiret(sbi_ecall(SBI_EXT_DBCN, SBI_EXT_DBCN_CONSOLE_WRITE,
+				      sbi_strlen(str), (unsigned long)str,
+				      0, 0, 0, 0));
+}
+
+static int bench_pmu_read(void *arg)
+{
+	unsigned long cidx = *(unsigned long *)arg;
+
+	return bench_sbiret(sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_FW_READ,
+				      cidx, 0, 0, 0, 0, 0));
+}
+
+static unsigned long bench_ipi_acks(unsigned long hmask)
+{
+	unsigned long i, acks = 0;
+
+	for (i = 0; i < bench_nharts; i++) {
+		if (hmask & (1UL << bench_harts[i].hartid))
+			acks += bench_harts[i].ipi_acks;
+	}
+
+	return acks;
+}
+
+/* Round trip: the IPI is only complete once every target acknowledged */
+static int bench_ipi(void *arg)
+{
+	struct bench_ipi *ipi = arg;
+	unsigned long acks, tstart;
+	int rc;
+
+	acks = bench_ipi_acks(ipi->hmask) + ipi->count;
+	rc = bench_sbiret(sbi_ecall(SBI_EXT_IPI, SBI_EXT_IPI_SEND_IPI,
+				    ipi->hmask, 0, 0, 0, 0, 0));
+	if (rc)
+		return rc;
+
+	tstart = csr_read(CSR_TIME);
+	while (bench_ipi_acks(ipi->hmask) < acks) {
+		if (bench_timed_out(tstart))
+			return SBI_ETIMEDOUT;
+	}
+
+	return 0;
+}
+
+static int bench_rfence(void *arg)
+{
+	struct bench_rfence *rf = arg;
+
+	/* ASID 1 is never used by this payload, the fence is still real */
+	return bench_sbiret(sbi_ecall(SBI_EXT_RFENCE, rf->fid, rf->hmask, 0,
+				      0, rf->size, 1, 0));
+}
+
+static int bench_hsm_start_stop(void *arg)
+{
+	struct bench_hart *h = arg;
+	unsigned long tstart;
+	struct sbiret ret;
+
+	ret = sbi_ecall(SBI_EXT_HSM, SBI_EXT_HSM_HART_START, h->hartid,
+			(unsigned long)_start_secondary, h - bench_harts,
+			0, 0, 0);
+	if (ret.error)
+		return bench_sbiret(ret);
+
+	tstart = csr_read(CSR_TIME);
+	do {
+		if (bench_timed_out(tstart))
+			return SBI_ETIMEDOUT;
+		ret = sbi_ecall(SBI_EXT_HSM, SBI_EXT_HSM_HART_GET_STATUS,
+				h->hartid, 0, 0, 0, 0, 0);
+	} while (!ret.error && ret.value != SBI_HSM_STATE_STOPPED);
+
+	return bench_sbiret(ret);
+}
+
+/* Mask of the boot HART followed by the first count - 1 parked HARTs */
+static unsigned long bench_hmask(unsigned long count, bool self)
+{
+	unsigned long i, hmask = 0;
+
+	if (self) {
+		hmask = 1UL << bench_harts[bench_boot_slot].hartid;
+		count--;
+	}
+
+	for (i = 0; i < bench_nharts && count; i++) {
+		if (i == bench_boot_slot || !bench_harts[i].online)
+			continue;
+		hmask |= 1UL << bench_harts[i].hartid;
+		count--;
+	}
+
+	return hmask;
+}
+
+static void bench_discover_harts(unsigned long boot_hartid)
+{
+	struct sbiret ret;
+	unsigned long h;
+
+	bench_nharts = 0;
+	for (h = 0; h < BENCH_MAX_HARTS; h++) {
+		if (h != boot_hartid) {
+			ret = sbi_ecall(SBI_EXT_HSM,
+					SBI_EXT_HSM_HART_GET_STATUS,
+					h, 0, 0, 0, 0, 0);
+			if (ret.error)
+				continue;
+		} else
+			bench_boot_slot = bench_nharts;
+
+		bench_harts[bench_nharts].hartid = h;
+		bench_harts[bench_nharts].online = h == boot_hartid;
+		bench_nharts++;
+	}
+}
+
+/* Start every other HART and wait until it idles in test_secondary() */
+static unsigned long bench_park_harts(void)
+{
+	unsigned long i, tstart, online = 1;
+	struct bench_hart *h;
+	struct sbiret ret;
+
+	bench_mode = BENCH_MODE_PARK;
+	for (i = 0; i < bench_nharts; i++) {
+		h = &bench_harts[i];
+		if (i == bench_boot_slot)
+			continue;
+
+		ret = sbi_ecall(SBI_EXT_HSM, SBI_EXT_HSM_HART_START,
+				h->hartid, (unsigned long)_start_secondary, i,
+				0, 0, 0);
+		if (ret.error)
+			continue;
+
+		tstart = csr_read(CSR_TIME);
+		while (!h->online && !bench_timed_out(tstart))
+			;
+		if (h->online)
+			online++;
+	}
+
+	return online;
+}
+
+static void bench_unpark_harts(void)
+{
+	unsigned long i, tstart, hmask = bench_hmask(bench_nharts, false);
+	struct sbiret ret;
+
+	bench_mode = BENCH_MODE_STOP;
+	sbi_ecall(SBI_EXT_IPI, SBI_EXT_IPI_SEND_IPI, hmask, 0, 0, 0, 0, 0);
+
+	for (i = 0; i < bench_nharts; i++) {
+		if (!(hmask & (1UL << bench_harts[i].hartid)))
+			continue;
+
+		tstart = csr_read(CSR_TIME);
+		do {
+			ret = sbi_ecall(SBI_EXT_HSM,
+					SBI_EXT_HSM_HART_GET_STATUS,
+					bench_harts[i].hartid, 0, 0, 0, 0, 0);
+		} while (!ret.error && ret.value != SBI_HSM_STATE_STOPPED &&
+			 !bench_timed_out(tstart));
+		bench_harts[i].online = 0;
+	}
+}
+
+static void bench_single_hart(void)
+{
+	char dbcn_str[33];
+	unsigned long cidx;
+	struct sbiret ret;
+
+	bench_run("null_ecall", "probe", 1, BENCH_ITERS,
+		  bench_null_ecall, NULL);
+
+	if (sbi_probe_extension(SBI_EXT_TIME))
+		bench_run("set_timer", "-", 1, BENCH_ITERS,
+			  bench_set_timer, NULL);
+	else
+		bench_print_skip("set_timer", "-", "no TIME");
+
+	if (has_dbcn) {
+		/* Blanks followed by a carriage return leave no trace */
+		sbi_memset(dbcn_str, ' ', sizeof(dbcn_str) - 2);
+		dbcn_str[sizeof(dbcn_str) - 2] = '\r';
+		dbcn_str[sizeof(dbcn_str) - 1] = '\0';
+		bench_run("dbcn_write", "32B", 1, BENCH_SLOW_ITERS,
+			  bench_dbcn_write, dbcn_str);
+	} else
+		bench_print_skip("dbcn_write", "32B", "no DBCN");
+
+	if (!sbi_probe_extension(SBI_EXT_PMU)) {
+		bench_print_skip("pmu_fw_read", "-", "no PMU");
+		return;
+	}
+
+	ret = sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_NUM_COUNTERS,
+			0, 0, 0, 0, 0, 0);
+	if (ret.error || !ret.value) {
+		bench_print_skip("pmu_fw_read", "-", "no counters");
+		return;
+	}
+
+	ret = sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_CFG_MATCH, 0,
+			(ret.value < __riscv_xlen) ?
+			(1UL << ret.value) - 1 : -1UL,
+			SBI_PMU_CFG_FLAG_CLEAR_VALUE |
+			SBI_PMU_CFG_FLAG_AUTO_START,
+			(SBI_PMU_EVENT_TYPE_FW << SBI_PMU_EVENT_IDX_TYPE_OFFSET) |
+			SBI_PMU_FW_SET_TIMER, 0, 0);
+	if (ret.error) {
+		bench_print_skip("pmu_fw_read", "-", "no FW counter");
+		return;
+	}
+
+	cidx = ret.value;
+	bench_run("pmu_fw_read", "-", 1, BENCH_ITERS, bench_pmu_read, &cidx);
+	sbi_ecall(SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_STOP, cidx, 1,
+		  SBI_PMU_STOP_FLAG_RESET, 0, 0, 0);
+}
+
+static void bench_multi_hart(unsigned long online)
+{
+	static const struct {
+		const char *name;
+		unsigned long size;
+	} sizes[] = {
+		{ "4K", 0x1000 },
+		{ "64K", 0x10000 },
+		{ "2M", 0x200000 },
+		{ "all", -1UL },
+	};
+	struct bench_rfence rf;
+	struct bench_ipi ipi;
+	unsigned long n, s;
+	bool has_ipi = sbi_probe_extension(SBI_EXT_IPI);
+	bool has_rfence = sbi_probe_extension(SBI_EXT_RFENCE);
+
+	if (has_ipi && online > 1) {
+		ipi.hmask = bench_hmask(1, false);
+		ipi.count = 1;
+		bench_run("ipi", "single", 1, BENCH_ITERS, bench_ipi, &ipi);
+
+		ipi.hmask = bench_hmask(online - 1, false);
+		ipi.count = online - 1;
+		bench_run("ipi", "bcast", online - 1, BENCH_ITERS,
+			  bench_ipi, &ipi);
+	} else
+		bench_print_skip("ipi", "-", has_ipi ? "single hart" : "no IPI");
+
+	if (!has_rfence) {
+		bench_print_skip("rfence", "-", "no RFENCE");
+		return;
+	}
+
+	n = 1;
+	while (1) {
+		rf.hmask = bench_hmask(n, true);
+		for (s = 0; s < array_size(sizes); s++) {
+			rf.size = sizes[s].size;
+			rf.fid = SBI_EXT_RFENCE_REMOTE_SFENCE_VMA;
+			bench_run("sfence.vma", sizes[s].name, n,
+				  BENCH_ITERS, bench_rfence, &rf);
+			rf.fid = SBI_EXT_RFENCE_REMOTE_SFENCE_VMA_ASID;
+			bench_run("sfence.vma.asid", sizes[s].name, n,
+				  BENCH_ITERS, bench_rfence, &rf);
+		}
+		if (n == online)
+			break;
+		n = (n * 2 < online) ? n * 2 : online;
+	}
+}
+
+static void bench_hsm(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < bench_nharts; i++) {
+		if (i != bench_boot_slot)
+			break;
+	}
+	if (i == bench_nharts) {
+		bench_print_skip("hsm_start_stop", "-", "single hart");
+		return;
+	}
+
+	bench_mode = BENCH_MODE_STOP;
+	bench_run("hsm_start_stop", "-", 1, BENCH_SLOW_ITERS,
+		  bench_hsm_start_stop, &bench_harts[i]);
+}
+
+/*
+ * HARTs started in BENCH_MODE_PARK acknowledge every supervisor software
+ * interrupt until told to stop, all others stop right away so that the
+ * boot HART can time a full HSM start/stop cycle.
+ */
+void test_secondary(unsigned long hartid, unsigned long slot)
+{
+	struct bench_hart *h = &bench_harts[slot];
+
+	if (bench_mode == BENCH_MODE_PARK) {
+		csr_write(CSR_SIE, SIP_SSIP);
+		h->online = 1;
+		while (bench_mode == BENCH_MODE_PARK) {
+			wfi();
+			if (csr_read(CSR_SIP) & SIP_SSIP) {
+				csr_clear(CSR_SIP, SIP_SSIP);
+				h->ipi_acks++;
+			}
+		}
+		csr_write(CSR_SIE, 0);
+	}
+
+	sbi_ecall(SBI_EXT_HSM, SBI_EXT_HSM_HART_STOP, 0, 0, 0, 0, 0, 0);
+}
 
 void test_main(unsigned long a0, unsigned long a1)
 {
+	bool has_hsm;
+	unsigned long online = 1;
+
+	has_dbcn = sbi_probe_extension(SBI_EXT_DBCN);
 	sbi_ecall_console_puts("\nTest payload running\n");
 
+	bench_parse_timebase(a1);
+	bench_timeout = bench_timebase ? bench_timebase : BENCH_TIMEOUT_TICKS;
+	bench_calibrate();
+
+	has_hsm = sbi_probe_extension(SBI_EXT_HSM);
+	if (has_hsm)
+		bench_discover_harts(a0);
+	else {
+		bench_harts[0].hartid = a0;
+		bench_harts[0].online = 1;
+		bench_nharts = 1;
+		bench_boot_slot = 0;
+	}
+
+	sbi_snprintf(bench_line, sizeof(bench_line),
+		     "SBI benchmarks: %lu harts, timebase %lu Hz, "
+		     "latency in cycles\n", bench_nharts, bench_timebase);
+	sbi_ecall_console_puts(bench_line);
+	bench_print_header();
+
+	bench_single_hart();
+
+	if (has_hsm && bench_nharts > 1)
+		online = bench_park_harts();
+	bench_multi_hart(online);
+	if (has_hsm && bench_nharts > 1)
+		bench_unpark_harts();
+
+	if (has_hsm)
+		bench_hsm();
+	else
+		bench_print_skip("hsm_start_stop", "-", "no HSM");
+
+	sbi_ecall_console_puts("SBI benchmarks done\n");
+
 	while (1)
 		wfi();
 }
@@ -198,6 +198,9 @@ int is_pmp_entry_mapped(unsigned long entry);
 int pmp_set(unsigned int n, unsigned long prot, unsigned long addr,
 	    unsigned long log2len);
 
+/* Set pmp entry config byte and pmpaddr without encoding */
+int pmp_set_raw(unsigned int n, unsigned long cfg, unsigned long pmpaddr);
+
 int pmp_get(unsigned int n, unsigned long *prot_out, unsigned long *addr_out,
 	    unsigned long *log2len);
 
@@ -10,6 +10,8 @@
 #ifndef __RISCV_ATOMIC_H__
 #define __RISCV_ATOMIC_H__
 
+#include <sbi/sbi_types.h>
+
 typedef struct {
 	volatile long counter;
 } atomic_t;
@@ -33,6 +35,16 @@ long atomic_cmpxchg(atomic_t *atom, long oldval, long newval);
 
 long atomic_xchg(atomic_t *atom, long newval);
 
+/**
+ * Stall until an atomic variable may no longer hold a value using the
+ * Zawrs extension. Returns early on interrupts or spurious wake ups so
+ * callers re-check their condition in a loop.
+ * @atom: atomic variable to wait on
+ * @val: value to wait on
+ * @sto: give up after a short implementation defined timeout
+ */
+void atomic_wrs_wait(atomic_t *atom, long val, bool sto);
+
 unsigned int atomic_raw_xchg_uint(volatile unsigned int *ptr,
 				  unsigned int newval);
 
@@ -46,6 +46,13 @@ do {								\
 	__asm__ __volatile__ ("div %0, %0, zero" : "=r" (__t));	\
 } while (0)
 
+/*
+ * Zawrs: stall while the reservation set of a preceding LR is valid and
+ * no interrupt is pending, without (nto) or with (sto) a short timeout.
+ */
+#define wrs_nto()		__asm__ __volatile__ (".4byte 0x00d00073" : : : "memory")
+#define wrs_sto()		__asm__ __volatile__ (".4byte 0x01d00073" : : : "memory")
+
 /* clang-format on */
 
 #define __smp_store_release(p, v)   \
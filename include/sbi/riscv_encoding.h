@@ -258,6 +258,15 @@
 #define CSR_FRM				0x002
 #define CSR_FCSR			0x003
 
+/* User Vector CSRs */
+#define CSR_VSTART			0x008
+#define CSR_VXSAT			0x009
+#define CSR_VXRM			0x00a
+#define CSR_VCSR			0x00f
+#define CSR_VL				0xc20
+#define CSR_VTYPE			0xc21
+#define CSR_VLENB			0xc22
+
 /* User Counters/Timers */
 #define CSR_CYCLE			0xc00
 #define CSR_TIME			0xc01
@@ -989,6 +998,43 @@
 #define SHIFT_FUNCT3			12
 #define SHIFT_CSR			20
 
+/* Vector loads and stores share the FP opcodes with other widths */
+#define INSN_OPCODE_MASK		0x7f
+#define INSN_OPCODE_LOAD_FP		0x07
+#define INSN_OPCODE_STORE_FP		0x27
+
+#define VECTOR_WIDTH(insn)		RV_X(insn, SHIFT_FUNCT3, 3)
+#define VECTOR_IS_WIDTH(w)		((w) == 0 || (w) >= 5)
+/* Element width in bytes for the width encodings 0, 5, 6 and 7 */
+#define VECTOR_WIDTH_BYTES(w)		(1UL << ((w) ? (w) - 4 : 0))
+#define VECTOR_NF(insn)			RV_X(insn, 29, 3)
+#define VECTOR_MEW(insn)		RV_X(insn, 28, 1)
+#define VECTOR_MOP(insn)		RV_X(insn, 26, 2)
+#define VECTOR_VM(insn)			RV_X(insn, 25, 1)
+#define VECTOR_UMOP(insn)		RV_X(insn, SH_RS2, 5)
+
+#define VECTOR_MOP_UNIT_STRIDE		0
+#define VECTOR_MOP_INDEXED_UNORDERED	1
+#define VECTOR_MOP_STRIDED		2
+#define VECTOR_MOP_INDEXED_ORDERED	3
+
+#define VECTOR_UMOP_UNIT_STRIDE		0x00
+#define VECTOR_UMOP_WHOLE_REG		0x08
+#define VECTOR_UMOP_MASK		0x0b
+#define VECTOR_UMOP_FAULT_FIRST		0x10
+
+#define IS_VECTOR_LOAD(insn)		\
+	(((insn) & INSN_OPCODE_MASK) == INSN_OPCODE_LOAD_FP && \
+	 VECTOR_IS_WIDTH(VECTOR_WIDTH(insn)))
+#define IS_VECTOR_STORE(insn)		\
+	(((insn) & INSN_OPCODE_MASK) == INSN_OPCODE_STORE_FP && \
+	 VECTOR_IS_WIDTH(VECTOR_WIDTH(insn)))
+
+#define VTYPE_VLMUL			_UL(0x7)
+#define VTYPE_VSEW_SHIFT		3
+#define VTYPE_VSEW			_UL(0x38)
+#define VTYPE_VILL			(_UL(1) << (__riscv_xlen - 1))
+
 #define CSRRW 1
 #define CSRRS 2
 #define CSRRC 3
@@ -12,6 +12,23 @@
 
 #define TICKET_SHIFT	16
 
+#ifdef CONFIG_SBI_LOCK_STAT
+/**
+ * Contention statistics of a named lock. The counters are only updated
+ * by the HART holding the lock. An acquisition is contended when the
+ * ticket taken is not the one being served and the distance is the
+ * number of tickets ahead of it.
+ */
+struct sbi_lock_stat {
+	const char *name;
+	unsigned long acquired;
+	unsigned long contended;
+	unsigned long max_distance;
+	u64 spin_cycles;
+	u64 max_spin_cycles;
+};
+#endif
+
 typedef struct {
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
        u16 next;
@@ -20,6 +37,9 @@ typedef struct {
        u16 owner;
        u16 next;
 #endif
+#ifdef CONFIG_SBI_LOCK_STAT
+       struct sbi_lock_stat *stat;
+#endif
 } __aligned(4) spinlock_t;
 
 #define __SPIN_LOCK_UNLOCKED	\
@@ -42,4 +62,88 @@ void spin_lock(spinlock_t *lock);
 
 void spin_unlock(spinlock_t *lock);
 
+/** Queue node of a HART waiting for or holding a qspinlock_t */
+struct qspin_node {
+	struct qspin_node *next;
+	unsigned long locked;
+	unsigned long busy;
+};
+
+/** Number of qspinlock_t a HART can hold or wait for at the same time */
+#define QSPIN_NODES		4
+
+/**
+ * Queued (MCS) spinlock. Waiters are queued behind the tail and every
+ * waiter spins on the node of its own HART, so a release only touches
+ * the cache line of the next waiter instead of all of them. The nodes
+ * live in scratch space so these locks cannot be used before
+ * sbi_scratch_init().
+ */
+typedef struct {
+	struct qspin_node *tail;
+	struct qspin_node *owner;
+#ifdef CONFIG_SBI_LOCK_STAT
+	struct sbi_lock_stat *stat;
+#endif
+} qspinlock_t;
+
+#define __QSPIN_LOCK_UNLOCKED	\
+	(qspinlock_t) { NULL, NULL }
+
+#define QSPIN_LOCK_INIT(x)	\
+	x = __QSPIN_LOCK_UNLOCKED
+
+#define QSPIN_LOCK_INITIALIZER	\
+	__QSPIN_LOCK_UNLOCKED
+
+int qspin_lock_init(void);
+
+void qspin_lock(qspinlock_t *lock);
+
+void qspin_unlock(qspinlock_t *lock);
+
+/**
+ * Reader-writer spinlock for read-mostly data. Readers share the lock
+ * while a writer holds it alone. A waiting writer keeps new readers
+ * out so writers are not starved by a stream of readers.
+ */
+typedef struct {
+	u32 count;
+} rwlock_t;
+
+#define __RW_LOCK_UNLOCKED	\
+	(rwlock_t) { 0 }
+
+#define RW_LOCK_INIT(x)		\
+	x = __RW_LOCK_UNLOCKED
+
+#define RW_LOCK_INITIALIZER	\
+	__RW_LOCK_UNLOCKED
+
+void read_lock(rwlock_t *lock);
+
+void read_unlock(rwlock_t *lock);
+
+void write_lock(rwlock_t *lock);
+
+void write_unlock(rwlock_t *lock);
+
+#ifdef CONFIG_SBI_LOCK_STAT
+struct sbi_lock_stat *sbi_lock_stat_alloc(const char *name);
+
+/**
+ * Give a lock a name and start collecting its contention statistics.
+ * Must be called after the lock is initialized and before it is used.
+ */
+void spin_lock_set_name(spinlock_t *lock, const char *name);
+
+/** Same as spin_lock_set_name() for a qspinlock_t */
+void qspin_lock_set_name(qspinlock_t *lock, const char *name);
+#else
+static inline void spin_lock_set_name(spinlock_t *lock, const char *name) { }
+
+static inline void qspin_lock_set_name(qspinlock_t *lock,
+				       const char *name) { }
+#endif
+
 #endif
@@ -0,0 +1,73 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Shared memory ring for batched SBI calls
+ */
+
+#ifndef __SBI_BATCH_H__
+#define __SBI_BATCH_H__
+
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+#define SBI_BATCH_SHMEM_INVALID_ADDR	(-1UL)
+#define SBI_BATCH_SHMEM_ALIGN_MASK	((__riscv_xlen / 8) - 1)
+#define SBI_BATCH_MAX_ENTRIES		256
+
+/* clang-format on */
+
+/** One SBI call of the ring which is completed in place */
+struct sbi_batch_entry {
+	/** Written by the supervisor before advancing tail */
+	unsigned long extid;
+	unsigned long funcid;
+	unsigned long args[6];
+	/** Written by the SBI implementation before advancing head */
+	long error;
+	unsigned long value;
+};
+
+/**
+ * The supervisor fills entries[tail % num_entries] and advances tail
+ * while the SBI implementation completes entries from head to tail on
+ * SBI_EXT_BATCH_SUBMIT and advances head past them.
+ */
+struct sbi_batch_ring {
+	unsigned long head;
+	unsigned long tail;
+	struct sbi_batch_entry entries[];
+};
+
+#define SBI_BATCH_RING_SIZE(__num_entries)				\
+	(sizeof(struct sbi_batch_ring) +				\
+	 (__num_entries) * sizeof(struct sbi_batch_entry))
+
+struct sbi_domain;
+struct sbi_scratch;
+struct sbi_trap_regs;
+
+int sbi_batch_setup_shmem(const struct sbi_domain *dom, unsigned long smode,
+			  unsigned long shmem_phys_lo,
+			  unsigned long shmem_phys_hi,
+			  unsigned long num_entries);
+
+int sbi_batch_submit(struct sbi_trap_regs *regs, unsigned long *out_count);
+
+int sbi_batch_sfence_vma_asid_list(const struct sbi_domain *dom,
+				   unsigned long smode, unsigned long hmask,
+				   unsigned long hbase,
+				   unsigned long list_phys_lo,
+				   unsigned long list_phys_hi,
+				   unsigned long count);
+
+#ifdef CONFIG_SBI_ECALL_BATCH
+/** Forget the submission ring set up on a stopped hart */
+void sbi_batch_reset_hart(struct sbi_scratch *scratch);
+#else
+static inline void sbi_batch_reset_hart(struct sbi_scratch *scratch) { }
+#endif
+
+int sbi_batch_init(void);
+
+#endif
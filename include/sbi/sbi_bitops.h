@@ -37,6 +37,11 @@
 
 #define GENMASK_ULL(h, l) \
 	(((~0ULL) - (1ULL << (l)) + 1) & (~0ULL >> (BITS_PER_LONG_LONG - 1 - (h))))
+#ifndef __riscv_zbb
+/* De Bruijn lookup table used by sbi_ffs() without Zbb */
+extern const unsigned char sbi_ffs_debruijn[BITS_PER_LONG];
+#endif
+
 /**
  * sbi_ffs - find first (less-significant) set bit in a long word.
  * @word: The word to search
@@ -45,33 +50,19 @@
  */
 static inline int sbi_ffs(unsigned long word)
 {
-	int num = 0;
-
+#ifdef __riscv_zbb
+	return __builtin_ctzl(word);
+#else
+	/*
+	 * Isolate the lowest set bit and multiply it with a De Bruijn
+	 * sequence so the top bits of the product index the table.
+	 */
 #if BITS_PER_LONG == 64
-	if ((word & 0xffffffff) == 0) {
-		num += 32;
-		word >>= 32;
-	}
+	return sbi_ffs_debruijn[((word & -word) * 0x03f79d71b4cb0a89UL) >> 58];
+#else
+	return sbi_ffs_debruijn[((word & -word) * 0x077cb531UL) >> 27];
+#endif
 #endif
-	if ((word & 0xffff) == 0) {
-		num += 16;
-		word >>= 16;
-	}
-	if ((word & 0xff) == 0) {
-		num += 8;
-		word >>= 8;
-	}
-	if ((word & 0xf) == 0) {
-		num += 4;
-		word >>= 4;
-	}
-	if ((word & 0x3) == 0) {
-		num += 2;
-		word >>= 2;
-	}
-	if ((word & 0x1) == 0)
-		num += 1;
-	return num;
 }
 
 /*
@@ -90,6 +81,9 @@ static inline int sbi_ffs(unsigned long word)
  */
 static inline unsigned long sbi_fls(unsigned long word)
 {
+#ifdef __riscv_zbb
+	return BITS_PER_LONG - 1 - __builtin_clzl(word);
+#else
 	int num = BITS_PER_LONG - 1;
 
 #if BITS_PER_LONG == 64
@@ -117,6 +111,7 @@ static inline unsigned long sbi_fls(unsigned long word)
 	if (!(word & (~0ul << (BITS_PER_LONG-1))))
 		num -= 1;
 	return num;
+#endif
 }
 
 /**
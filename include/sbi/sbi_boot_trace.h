@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Timestamps of the coldboot init stages and FDT driver probes
+ */
+
+#ifndef __SBI_BOOT_TRACE_H__
+#define __SBI_BOOT_TRACE_H__
+
+#include <sbi/sbi_types.h>
+
+/** One boot trace record taken when the named stage completed */
+struct sbi_boot_trace_entry {
+	const char *name;
+	u64 time;
+	unsigned long cycles;
+};
+
+#ifdef CONFIG_SBI_BOOT_TRACE
+
+/**
+ * Record the completion of a boot stage
+ *
+ * @param name static string naming the stage (not copied)
+ */
+void sbi_boot_trace(const char *name);
+
+/** Get the number of boot trace records */
+u32 sbi_boot_trace_count(void);
+
+/** Get a boot trace record or NULL if the index is out of range */
+const struct sbi_boot_trace_entry *sbi_boot_trace_get(u32 index);
+
+/** Print the boot trace on the console */
+void sbi_boot_trace_print(void);
+
+#else
+
+static inline void sbi_boot_trace(const char *name) { }
+
+static inline u32 sbi_boot_trace_count(void) { return 0; }
+
+static inline const struct sbi_boot_trace_entry *sbi_boot_trace_get(u32 index)
+{
+	return NULL;
+}
+
+static inline void sbi_boot_trace_print(void) { }
+
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Cache maintenance for non-coherent DMA
+ */
+
+#ifndef __SBI_CACHE_H__
+#define __SBI_CACHE_H__
+
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** Write dirty lines of the range back to memory */
+#define SBI_CACHE_OP_CLEAN		0x0
+/** Discard the lines of the range without writing them back */
+#define SBI_CACHE_OP_INVAL		0x1
+/** Write back and then discard the lines of the range */
+#define SBI_CACHE_OP_FLUSH		0x2
+
+/* clang-format on */
+
+/**
+ * One range of a batch passed to SBI_EXT_OPENSBI_CACHE_OPS, the batch
+ * is an array of these in supervisor memory.
+ */
+struct sbi_cache_range {
+	/** Physical address of the range */
+	u64 addr;
+	/** Size of the range in bytes */
+	u64 size;
+	/** SBI_CACHE_OP_xxx */
+	u32 op;
+	u32 reserved;
+};
+
+/** Cache maintenance device, for caches not handled by Zicbom */
+struct sbi_cache_device {
+	/** Name of the cache device */
+	char name[32];
+
+	/** Apply SBI_CACHE_OP_xxx to a physical range */
+	int (*range_op)(u32 op, unsigned long addr, unsigned long size);
+
+	/** Flush the whole cache (optional) */
+	int (*flush_all)(void);
+
+	/** Bytes from which flush_all() is cheaper than range_op() */
+	unsigned long flush_all_threshold;
+};
+
+const struct sbi_cache_device *sbi_cache_get_device(void);
+void sbi_cache_set_device(const struct sbi_cache_device *dev);
+
+#ifdef CONFIG_SBI_CACHE_OPS
+int sbi_cache_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+		     struct sbi_ecall_return *out);
+#else
+static inline int sbi_cache_handle(unsigned long funcid,
+				   struct sbi_trap_regs *regs,
+				   struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+#endif
+
+#endif
@@ -24,6 +24,19 @@ struct sbi_console_device {
 
 	/** Read a character from the console input */
 	int (*console_getc)(void);
+
+	/**
+	 * Write as many characters as the TX FIFO takes without waiting
+	 * and return how many were written (optional, for interrupt
+	 * driven transmit)
+	 */
+	unsigned long (*console_tx_fill)(const char *str, unsigned long len);
+
+	/** Enable or disable the TX empty interrupt (optional) */
+	void (*console_tx_irq)(bool enable);
+
+	/** Enable or disable the RX data interrupt (optional) */
+	void (*console_rx_irq)(bool enable);
 };
 
 #define __printf(a, b) __attribute__((format(printf, a, b)))
@@ -58,6 +71,39 @@ void sbi_console_set_device(const struct sbi_console_device *dev);
 
 struct sbi_scratch;
 
+/** Write out all output buffered by the asynchronous console */
+void sbi_console_flush(void);
+
+/**
+ * Switch the console device to interrupt driven transmit
+ *
+ * Called by a console driver once its TX empty interrupt reaches
+ * M-mode. Output is then queued in a ring and written out from
+ * sbi_console_tx_process().
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int sbi_console_tx_irq_enable(void);
+
+/** Refill the TX FIFO of the console device from its interrupt handler */
+void sbi_console_tx_process(void);
+
+/**
+ * Switch the console device to buffered receive
+ *
+ * Called by a console driver once its RX interrupt reaches M-mode.
+ * Received characters are then moved to a ring by
+ * sbi_console_rx_process() and while console output is written.
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int sbi_console_rx_irq_enable(void);
+
+/** Move received characters from the console device to the RX ring */
+void sbi_console_rx_process(void);
+
+int sbi_console_init(struct sbi_scratch *scratch, bool cold_boot);
+
 #define SBI_ASSERT(cond, args) do { \
 	if (unlikely(!(cond))) \
 		sbi_panic args; \
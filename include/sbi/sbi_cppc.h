@@ -8,8 +8,34 @@
 #ifndef __SBI_CPPC_H__
 #define __SBI_CPPC_H__
 
+#include <sbi/sbi_error.h>
 #include <sbi/sbi_types.h>
 
+struct sbi_ecall_return;
+struct sbi_scratch;
+struct sbi_trap_regs;
+
+/** Size and alignment of the CPPC fast channel of a HART */
+#define SBI_CPPC_FASTCHAN_SIZE		32
+
+/** Address which disables the CPPC fast channel */
+#define SBI_CPPC_FASTCHAN_INVALID_ADDR	-1UL
+
+/**
+ * Layout of the CPPC fast channel of a HART in supervisor memory
+ *
+ * The supervisor writes the performance requests and then increments
+ * seq. The firmware or the CPPC device applies the requests of the
+ * HART and stores the seq it applied in ack.
+ */
+struct sbi_cppc_fastchan {
+	u32 seq;
+	u32 ack;
+	u64 desired_perf;
+	u64 min_perf;
+	u64 max_perf;
+};
+
 /** CPPC device */
 struct sbi_cppc_device {
 	/** Name of the CPPC device */
@@ -23,12 +49,49 @@ struct sbi_cppc_device {
 
 	/** write to the cppc register*/
 	int (*cppc_write)(unsigned long reg, uint64_t val);
+
+	/**
+	 * Let the device consume the fast channel of the current HART
+	 * (optional). Returns 0 if the device takes over the channel at
+	 * the given address, SBI_CPPC_FASTCHAN_INVALID_ADDR stops it.
+	 */
+	int (*cppc_fastchan_setup)(unsigned long addr);
 };
 
 int sbi_cppc_probe(unsigned long reg);
 int sbi_cppc_read(unsigned long reg, uint64_t *val);
 int sbi_cppc_write(unsigned long reg, uint64_t val);
 
+#ifdef CONFIG_SBI_CPPC_FASTCHAN
+
+int sbi_cppc_fastchan_init(void);
+
+/** Stop polling the fast channel set up on a stopped hart */
+void sbi_cppc_fastchan_reset_hart(struct sbi_scratch *scratch);
+
+int sbi_cppc_fastchan_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			     struct sbi_ecall_return *out);
+
+#else
+
+static inline int sbi_cppc_fastchan_init(void)
+{
+	return 0;
+}
+
+static inline void sbi_cppc_fastchan_reset_hart(struct sbi_scratch *scratch)
+{
+}
+
+static inline int sbi_cppc_fastchan_handle(unsigned long funcid,
+					   struct sbi_trap_regs *regs,
+					   struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+#endif
+
 const struct sbi_cppc_device *sbi_cppc_get_device(void);
 void sbi_cppc_set_device(const struct sbi_cppc_device *dev);
 
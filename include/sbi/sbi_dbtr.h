@@ -71,6 +71,8 @@ struct sbi_dbtr_id_msg {
 struct sbi_dbtr_hart_triggers_state {
 	struct sbi_dbtr_trigger triggers[RV_MAX_TRIGGERS];
 	struct sbi_dbtr_shmem shmem;
+	/* Bitmap of the trigger indices which are not installed */
+	unsigned long free_trigs;
 	u32 total_trigs;
 	u32 available_trigs;
 	u32 hartid;
@@ -160,6 +160,16 @@ struct sbi_domain_memregion {
 	unsigned long flags;
 };
 
+/** Address interval governed by a single memory region of a domain */
+struct sbi_domain_interval {
+	/** First address of the interval */
+	unsigned long start;
+	/** Last address of the interval */
+	unsigned long end;
+	/** Highest priority memory region covering the interval */
+	const struct sbi_domain_memregion *reg;
+};
+
 /** Representation of OpenSBI domain */
 struct sbi_domain {
 	/** Node in linked list of domains */
@@ -168,16 +178,28 @@ struct sbi_domain {
 	struct sbi_domain_data_priv data_priv;
 	/** Logical index of this domain */
 	u32 index;
-	/** HARTs assigned to this domain */
+	/** HARTs assigned to this domain (updated with atomic bit ops) */
 	struct sbi_hartmask assigned_harts;
-	/** Spinlock for accessing assigned_harts */
-	spinlock_t assigned_harts_lock;
+	/** Incremented after every update of assigned_harts */
+	unsigned long assigned_gen;
+	/** Reader-writer lock for accessing interruptible_harts */
+	rwlock_t interruptible_harts_lock;
+	/** Cached mask of assigned HARTs which are valid IPI targets */
+	struct sbi_hartmask interruptible_harts;
+	/** HSM generation of interruptible_harts (zero if invalid) */
+	unsigned long interruptible_gen;
+	/** assigned_gen which interruptible_harts was built from */
+	unsigned long interruptible_assigned_gen;
 	/** Name of this domain */
 	char name[64];
 	/** Possible HARTs in this domain */
 	const struct sbi_hartmask *possible_harts;
 	/** Array of memory regions terminated by a region with order zero */
 	struct sbi_domain_memregion *regions;
+	/** Sorted non-overlapping intervals of regions (built on finalize) */
+	struct sbi_domain_interval *intervals;
+	/** Number of entries in intervals */
+	u32 interval_count;
 	/** HART id of the HART booting this domain */
 	u32 boot_hartid;
 	/** Arg1 (or 'a1' register) of next booting stage for this domain */
@@ -190,6 +212,16 @@ struct sbi_domain {
 	bool system_reset_allowed;
 	/** Is domain allowed to suspend the system */
 	bool system_suspend_allowed;
+	/** Power of 2 granule (in timer ticks) for supervisor deadlines */
+	u32 timer_slack;
+	/** Supervisor page the firmware publishes statistics to (or 0) */
+	unsigned long stats_page;
+	/** Size of the statistics page in bytes */
+	unsigned long stats_page_size;
+	/** Shared cache ways the domain may allocate into (zero for all) */
+	u32 cache_way_mask;
+	/** Page faults redirected to the domain while ADUE was off */
+	unsigned long adue_off_page_faults;
 	/** Identifies whether to include the firmware region */
 	bool fw_region_inited;
 };
@@ -203,9 +235,12 @@ struct sbi_domain *sbi_hartindex_to_domain(u32 hartindex);
 /** Update HART local pointer to point to specified domain */
 void sbi_update_hartindex_to_domain(u32 hartindex, struct sbi_domain *dom);
 
+/** Get pointer to sbi_domain from sbi_scratch of a HART */
+struct sbi_domain *sbi_scratch_to_domain(struct sbi_scratch *scratch);
+
 /** Get pointer to sbi_domain for current HART */
 #define sbi_domain_thishart_ptr() \
-	sbi_hartindex_to_domain(current_hartindex())
+	sbi_scratch_to_domain(sbi_scratch_thishart_ptr())
 
 /** Head of linked list of domains */
 extern struct sbi_dlist domain_list;
@@ -277,6 +312,46 @@ bool sbi_domain_check_addr_range(const struct sbi_domain *dom,
 				 unsigned long mode,
 				 unsigned long access_flags);
 
+/**
+ * Check whether the memory regions covering an address range grant
+ * exactly the given access (and nothing more) for a given mode. This
+ * is only answered for finalized domains and is FALSE otherwise.
+ * @param dom pointer to domain
+ * @param addr the start of the address range to be checked
+ * @param size the size of the address range to be checked
+ * @param mode the privilege mode of access
+ * @param access_flags bitmask of domain access types (enum sbi_domain_access)
+ * @return TRUE if the access is granted exactly otherwise FALSE
+ */
+bool sbi_domain_check_addr_range_exact(const struct sbi_domain *dom,
+				       unsigned long addr, unsigned long size,
+				       unsigned long mode,
+				       unsigned long access_flags);
+
+/**
+ * Check a supervisor buffer passed to an SBI call of the current HART
+ * against the domain of the HART and the mode the call was made from
+ * @param addr_lo lower XLEN bits of the buffer address
+ * @param addr_hi upper XLEN bits of the buffer address, must be zero
+ * @param size the size of the buffer
+ * @param access_flags bitmask of domain access types (enum sbi_domain_access)
+ * @return 0 if access allowed otherwise SBI_EINVALID_ADDR
+ */
+int sbi_domain_check_smode_buffer(unsigned long addr_lo, unsigned long addr_hi,
+				  unsigned long size, unsigned long access_flags);
+
+/**
+ * Copy data to a supervisor buffer passed to an SBI call of the current
+ * HART once sbi_domain_check_smode_buffer() allows reading and writing it
+ * @param addr_lo lower XLEN bits of the buffer address
+ * @param addr_hi upper XLEN bits of the buffer address, must be zero
+ * @param src the data to copy
+ * @param size the size of the data
+ * @return 0 on success otherwise SBI_EINVALID_ADDR
+ */
+int sbi_domain_copy_to_smode(unsigned long addr_lo, unsigned long addr_hi,
+			     const void *src, unsigned long size);
+
 /** Dump domain details on the console */
 void sbi_domain_dump(const struct sbi_domain *dom, const char *suffix);
 
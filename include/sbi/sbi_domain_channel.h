@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Shared memory message channels between domains
+ */
+
+#ifndef __SBI_DOMAIN_CHANNEL_H__
+#define __SBI_DOMAIN_CHANNEL_H__
+
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** Maximum number of channels of one domain */
+#define SBI_DOMAIN_CHANNEL_MAX		8
+
+/** Fields returned by SBI_EXT_OPENSBI_CHANNEL_INFO */
+#define SBI_DOMAIN_CHANNEL_INFO_BASE	0x0
+#define SBI_DOMAIN_CHANNEL_INFO_SIZE	0x1
+
+/* clang-format on */
+
+struct sbi_domain;
+
+#ifdef CONFIG_SBI_DOMAIN_CHANNEL
+
+/**
+ * Offer a channel to a peer domain or accept the one offered by it. The
+ * channel is only usable once the peer accepted it with the same ring,
+ * a mismatching ring rejects the offer which the offering domain then
+ * has to set up again. The ring memory must be readable and writable
+ * by both domains and is only validated here, the firmware never
+ * accesses it afterwards.
+ *
+ * @param dom the domain creating the channel
+ * @param peer_index index of the peer domain
+ * @param base base address of the ring
+ * @param size size of the ring in bytes
+ * @param mode privilege mode of dom accessing the ring
+ *
+ * @return 0 on success and SBI_Exxx (< 0) on failure
+ */
+int sbi_domain_channel_setup(struct sbi_domain *dom, u32 peer_index,
+			     unsigned long base, unsigned long size,
+			     unsigned long mode);
+
+/** Get the ring base or size of the channel between dom and a peer */
+int sbi_domain_channel_info(struct sbi_domain *dom, u32 peer_index,
+			    unsigned long field, unsigned long *out_val);
+
+/**
+ * Ring the doorbell of the peer domain. A peer which only runs on
+ * borrowed HARTs of this HART is entered directly, any other peer
+ * gets an S-mode software interrupt on its interruptible HARTs.
+ */
+int sbi_domain_channel_notify(struct sbi_domain *dom, u32 peer_index,
+			      struct sbi_trap_regs *regs,
+			      struct sbi_ecall_return *out);
+
+int sbi_domain_channel_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			      struct sbi_ecall_return *out);
+
+int sbi_domain_channel_init(void);
+
+#else
+
+static inline int sbi_domain_channel_handle(unsigned long funcid,
+					    struct sbi_trap_regs *regs,
+					    struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int sbi_domain_channel_init(void)
+{
+	return 0;
+}
+
+#endif
+
+#endif
@@ -38,4 +38,49 @@ int sbi_domain_context_init(void);
 /* Deinitialize domain context support */
 void sbi_domain_context_deinit(void);
 
+/** Steal-time shared memory of a domain on one hart, little-endian */
+struct sbi_sta_shmem {
+	/** Odd while the SBI implementation updates the structure */
+	u32 sequence;
+	u32 flags;
+	/** Time in nanoseconds the hart spent running other domains */
+	u64 steal;
+	/** Is the domain switched out of the hart */
+	u8 preempted;
+	u8 pad[47];
+};
+
+#define SBI_STA_SHMEM_INVALID_ADDR	(-1UL)
+
+#ifdef CONFIG_SBI_ECALL_STA
+/**
+ * Set up or disable the steal-time shared memory of the current domain
+ * on the current hart
+ *
+ * @param smode privilege mode of the caller
+ * @param shmem_phys_lo lower XLEN bits of the shared memory address
+ * @param shmem_phys_hi upper XLEN bits of the shared memory address
+ * @param flags must be zero
+ *
+ * @return 0 on success and SBI error code on failure
+ */
+int sbi_domain_context_sta_set_shmem(unsigned long smode,
+				     unsigned long shmem_phys_lo,
+				     unsigned long shmem_phys_hi,
+				     unsigned long flags);
+
+/**
+ * Forget the steal-time shared memory of a domain on a stopped hart
+ *
+ * @param dom pointer to the domain
+ * @param hartindex index of the hart
+ */
+void sbi_domain_context_sta_reset(struct sbi_domain *dom, u32 hartindex);
+#else
+static inline void sbi_domain_context_sta_reset(struct sbi_domain *dom,
+						u32 hartindex)
+{
+}
+#endif
+
 #endif // __SBI_DOMAIN_CONTEXT_H__
@@ -17,6 +17,7 @@
 #define SBI_ECALL_VERSION_MINOR		0
 #define SBI_OPENSBI_IMPID		1
 
+struct sbi_domain;
 struct sbi_trap_regs;
 struct sbi_trap_context;
 
@@ -59,9 +60,19 @@ struct sbi_ecall_extension {
 	 * callbacks will be invoked when the extension is not available, then
 	 * probe can never fail. However, an extension may choose to set
 	 * out_val to a nonzero value other than one. In those cases, it should
-	 * implement this callback.
+	 * implement this callback. The result of extensions covering a single
+	 * ID is cached until sbi_ecall_probe_invalidate() is called.
 	 */
 	int (* probe)(unsigned long extid, unsigned long *out_val);
+	/*
+	 * domain_allowed
+	 *
+	 * Optional per-domain policy. Domains for which it returns false
+	 * see the extension as absent, both when probing and calling it.
+	 * The result must only depend on the domain as it is evaluated
+	 * once per domain when the extension table is built.
+	 */
+	bool (* domain_allowed)(const struct sbi_domain *dom);
 	/*
 	 * handle
 	 *
@@ -83,6 +94,19 @@ void sbi_ecall_set_impid(unsigned long impid);
 
 struct sbi_ecall_extension *sbi_ecall_find_extension(unsigned long extid);
 
+struct sbi_ecall_extension *sbi_ecall_domain_find_extension(
+				const struct sbi_domain *dom,
+				unsigned long extid);
+
+int sbi_ecall_domain_probe(const struct sbi_domain *dom, unsigned long extid,
+			   unsigned long *out_val);
+
+/**
+ * Drop the cached probe results. Must be called when something a probe
+ * callback depends on changes after boot, e.g. a late device.
+ */
+void sbi_ecall_probe_invalidate(void);
+
 int sbi_ecall_register_extension(struct sbi_ecall_extension *ext);
 
 void sbi_ecall_unregister_extension(struct sbi_ecall_extension *ext);
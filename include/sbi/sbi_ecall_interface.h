@@ -35,6 +35,9 @@
 #define SBI_EXT_DBTR				0x44425452
 #define SBI_EXT_SSE				0x535345
 #define SBI_EXT_FWFT				0x46574654
+#define SBI_EXT_NACL				0x4E41434C
+#define SBI_EXT_STA				0x535441
+#define SBI_EXT_BATCH				0x08424348
 
 /* SBI function IDs for BASE extension*/
 #define SBI_EXT_BASE_GET_SPEC_VERSION		0x0
@@ -107,6 +110,7 @@
 #define SBI_EXT_PMU_COUNTER_FW_READ	0x5
 #define SBI_EXT_PMU_COUNTER_FW_READ_HI	0x6
 #define SBI_EXT_PMU_SNAPSHOT_SET_SHMEM	0x7
+#define SBI_EXT_PMU_EVENT_GET_INFO	0x8
 
 /* SBI function IDs for DBTR extension */
 #define SBI_EXT_DBTR_NUM_TRIGGERS	0x0
@@ -122,6 +126,27 @@
 #define SBI_EXT_FWFT_SET		0x0
 #define SBI_EXT_FWFT_GET		0x1
 
+/* SBI function IDs for NACL extension */
+#define SBI_EXT_NACL_PROBE_FEATURE	0x0
+#define SBI_EXT_NACL_SET_SHMEM		0x1
+#define SBI_EXT_NACL_SYNC_CSR		0x2
+#define SBI_EXT_NACL_SYNC_HFENCE	0x3
+#define SBI_EXT_NACL_SYNC_SRET		0x4
+
+/* SBI feature IDs for NACL extension */
+#define SBI_NACL_FEAT_SYNC_CSR		0x0
+#define SBI_NACL_FEAT_SYNC_HFENCE	0x1
+#define SBI_NACL_FEAT_SYNC_SRET		0x2
+#define SBI_NACL_FEAT_AUTOSWAP_CSR	0x3
+
+/* SBI function IDs for STA extension */
+#define SBI_EXT_STA_STEAL_TIME_SET_SHMEM	0x0
+
+/* SBI function IDs for the experimental batched call extension */
+#define SBI_EXT_BATCH_SETUP_SHMEM	0x0
+#define SBI_EXT_BATCH_SUBMIT		0x1
+#define SBI_EXT_BATCH_REMOTE_SFENCE_VMA_ASID_LIST	0x2
+
 enum sbi_fwft_feature_t {
 	SBI_FWFT_MISALIGNED_EXC_DELEG		= 0x0,
 	SBI_FWFT_LANDING_PAD			= 0x1,
@@ -361,6 +386,31 @@ enum sbi_sse_attr_id {
 	SBI_SSE_ATTR_MAX		= 0x0000000A
 };
 
+/*
+ * OpenSBI specific read-only SSE event attributes with the delivery
+ * statistics of an event. Latencies are in timer ticks, the inject
+ * latency runs from injection to handler entry and the handle latency
+ * from handler entry to completion.
+ *
+ * The ROUTE_HART_MASK attributes are writable, for global events only,
+ * and select the harts a global event may be delivered to instead of
+ * its preferred hart, with the usual hart_mask / hart_mask_base
+ * encoding. Routing is disabled while both are zero.
+ */
+#define SBI_SSE_ATTR_VENDOR_BASE		0x80000000
+#define SBI_SSE_ATTR_VENDOR_INJECTED		(SBI_SSE_ATTR_VENDOR_BASE + 0)
+#define SBI_SSE_ATTR_VENDOR_DELIVERED		(SBI_SSE_ATTR_VENDOR_BASE + 1)
+#define SBI_SSE_ATTR_VENDOR_COMPLETED		(SBI_SSE_ATTR_VENDOR_BASE + 2)
+#define SBI_SSE_ATTR_VENDOR_INJECT_LAT_MIN	(SBI_SSE_ATTR_VENDOR_BASE + 3)
+#define SBI_SSE_ATTR_VENDOR_INJECT_LAT_AVG	(SBI_SSE_ATTR_VENDOR_BASE + 4)
+#define SBI_SSE_ATTR_VENDOR_INJECT_LAT_MAX	(SBI_SSE_ATTR_VENDOR_BASE + 5)
+#define SBI_SSE_ATTR_VENDOR_HANDLE_LAT_MIN	(SBI_SSE_ATTR_VENDOR_BASE + 6)
+#define SBI_SSE_ATTR_VENDOR_HANDLE_LAT_AVG	(SBI_SSE_ATTR_VENDOR_BASE + 7)
+#define SBI_SSE_ATTR_VENDOR_HANDLE_LAT_MAX	(SBI_SSE_ATTR_VENDOR_BASE + 8)
+#define SBI_SSE_ATTR_VENDOR_ROUTE_HART_MASK	(SBI_SSE_ATTR_VENDOR_BASE + 9)
+#define SBI_SSE_ATTR_VENDOR_ROUTE_HART_MASK_BASE (SBI_SSE_ATTR_VENDOR_BASE + 10)
+#define SBI_SSE_ATTR_VENDOR_MAX			(SBI_SSE_ATTR_VENDOR_BASE + 11)
+
 #define SBI_SSE_ATTR_STATUS_STATE_OFFSET	0
 #define SBI_SSE_ATTR_STATUS_STATE_MASK		0x3
 #define SBI_SSE_ATTR_STATUS_PENDING_OFFSET	2
@@ -414,6 +464,8 @@ enum sbi_sse_state {
 #define SBI_SPEC_VERSION_MAJOR_OFFSET		24
 #define SBI_SPEC_VERSION_MAJOR_MASK		0x7f
 #define SBI_SPEC_VERSION_MINOR_MASK		0xffffff
+#define SBI_EXT_EXPERIMENTAL_START		0x08000000
+#define SBI_EXT_EXPERIMENTAL_END		0x08FFFFFF
 #define SBI_EXT_VENDOR_START			0x09000000
 #define SBI_EXT_VENDOR_END			0x09FFFFFF
 #define SBI_EXT_FIRMWARE_START			0x0A000000
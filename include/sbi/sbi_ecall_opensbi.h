@@ -0,0 +1,40 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * OpenSBI firmware specific SBI extension
+ */
+
+#ifndef __SBI_ECALL_OPENSBI_H__
+#define __SBI_ECALL_OPENSBI_H__
+
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+
+/* clang-format off */
+
+/** OpenSBI firmware specific extension */
+#define SBI_EXT_OPENSBI			(SBI_EXT_FIRMWARE_START + \
+					 SBI_OPENSBI_IMPID)
+
+#define SBI_EXT_OPENSBI_PROFILE_INFO	0x0
+#define SBI_EXT_OPENSBI_PROFILE_READ	0x1
+#define SBI_EXT_OPENSBI_TRACE_DUMP	0x2
+#define SBI_EXT_OPENSBI_MISALIGNED_RATE	0x3
+#define SBI_EXT_OPENSBI_TRAP_STATS	0x4
+#define SBI_EXT_OPENSBI_HART_START_MANY	0x5
+#define SBI_EXT_OPENSBI_SUSPEND_STATS	0x6
+#define SBI_EXT_OPENSBI_CHANNEL_SETUP	0x7
+#define SBI_EXT_OPENSBI_CHANNEL_INFO	0x8
+#define SBI_EXT_OPENSBI_CHANNEL_NOTIFY	0x9
+#define SBI_EXT_OPENSBI_CHANNEL_RETURN	0xa
+#define SBI_EXT_OPENSBI_HEAP_STATS	0xb
+#define SBI_EXT_OPENSBI_LOCK_STATS	0xc
+#define SBI_EXT_OPENSBI_CPPC_FASTCHAN	0xd
+#define SBI_EXT_OPENSBI_PERF_REPORT	0xe
+#define SBI_EXT_OPENSBI_TRACEPOINT_CTL	0xf
+#define SBI_EXT_OPENSBI_TRACEPOINT_READ	0x10
+#define SBI_EXT_OPENSBI_CACHE_OPS	0x11
+
+/* clang-format on */
+
+#endif
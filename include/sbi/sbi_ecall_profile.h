@@ -0,0 +1,82 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Per-extension and per-function ecall latency profiler
+ */
+
+#ifndef __SBI_ECALL_PROFILE_H__
+#define __SBI_ECALL_PROFILE_H__
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** Number of EID/FID pairs tracked on each HART */
+#define SBI_ECALL_PROFILE_SLOTS		16
+
+/** Number of log2(cycles) histogram buckets */
+#define SBI_ECALL_PROFILE_HIST		16
+
+/* clang-format on */
+
+/**
+ * Profile of one EID/FID pair as copied to supervisor memory by
+ * SBI_EXT_OPENSBI_PROFILE_READ. Bucket i of the histogram counts the
+ * calls which took [2^i, 2^(i+1)) cycles and the last bucket also
+ * counts all slower calls.
+ */
+struct sbi_ecall_profile_entry {
+	u32 extid;
+	u32 funcid;
+	u64 count;
+	u64 total_cycles;
+	u64 min_cycles;
+	u64 max_cycles;
+	u32 hist[SBI_ECALL_PROFILE_HIST];
+};
+
+#ifdef CONFIG_SBI_ECALL_PROFILE
+
+static inline unsigned long sbi_ecall_profile_start(void)
+{
+	return csr_read(CSR_MCYCLE);
+}
+
+void sbi_ecall_profile_record(unsigned long extid, unsigned long funcid,
+			      unsigned long start);
+
+void sbi_ecall_profile_dump(void);
+
+/** Returns the SBI_ECALL_PROFILE_SLOTS entries of a HART */
+const struct sbi_ecall_profile_entry *sbi_ecall_profile_get(u32 hartindex);
+
+int sbi_ecall_profile_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			     struct sbi_ecall_return *out);
+
+int sbi_ecall_profile_init(void);
+
+#else
+
+static inline unsigned long sbi_ecall_profile_start(void) { return 0; }
+
+static inline void sbi_ecall_profile_record(unsigned long extid,
+					    unsigned long funcid,
+					    unsigned long start) { }
+
+static inline void sbi_ecall_profile_dump(void) { }
+
+static inline int sbi_ecall_profile_handle(unsigned long funcid,
+					   struct sbi_trap_regs *regs,
+					   struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int sbi_ecall_profile_init(void) { return 0; }
+
+#endif
+
+#endif
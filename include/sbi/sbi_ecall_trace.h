@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Per-hart ecall trace ring buffer
+ */
+
+#ifndef __SBI_ECALL_TRACE_H__
+#define __SBI_ECALL_TRACE_H__
+
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/** One traced ecall with its entry and exit timer values */
+struct sbi_ecall_trace_entry {
+	unsigned long extid;
+	unsigned long funcid;
+	unsigned long args[3];
+	long error;
+	u64 enter_time;
+	u64 exit_time;
+};
+
+#ifdef CONFIG_SBI_ECALL_TRACE
+
+struct sbi_ecall_trace_entry *sbi_ecall_trace_enter(struct sbi_trap_regs *regs);
+
+void sbi_ecall_trace_exit(struct sbi_ecall_trace_entry *ent, int error);
+
+/** Print the trace of a HART, the oldest ecall first */
+void sbi_ecall_trace_dump(u32 hartindex);
+
+int sbi_ecall_trace_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			   struct sbi_ecall_return *out);
+
+int sbi_ecall_trace_init(void);
+
+#else
+
+static inline struct sbi_ecall_trace_entry *sbi_ecall_trace_enter(
+					struct sbi_trap_regs *regs)
+{
+	return NULL;
+}
+
+static inline void sbi_ecall_trace_exit(struct sbi_ecall_trace_entry *ent,
+					int error) { }
+
+static inline void sbi_ecall_trace_dump(u32 hartindex) { }
+
+static inline int sbi_ecall_trace_handle(unsigned long funcid,
+					 struct sbi_trap_regs *regs,
+					 struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int sbi_ecall_trace_init(void) { return 0; }
+
+#endif
+
+#endif
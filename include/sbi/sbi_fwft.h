@@ -12,12 +12,41 @@
 
 #include <sbi/sbi_ecall_interface.h>
 
+/*
+ * OpenSBI specific features in the local platform range
+ *
+ * ASYNC_RFENCE makes the RFENCE extension calls of a domain on a hart
+ * return a completion token in sbiret.value instead of waiting for the
+ * targets. A call fails with SBI_ERR_INVALID_STATE while the hart has
+ * as many tokens in flight as it can track.
+ * ASYNC_RFENCE_DONE is read-only and returns the latest completed token.
+ */
+#define SBI_FWFT_OPENSBI_ASYNC_RFENCE		(SBI_FWFT_LOCAL_PLATFORM_START + 0x0)
+#define SBI_FWFT_OPENSBI_ASYNC_RFENCE_DONE	(SBI_FWFT_LOCAL_PLATFORM_START + 0x1)
+
 struct sbi_scratch;
 
+/** FWFT state of one domain on one HART */
+struct sbi_fwft_context {
+	/** menvcfg bits controlled through FWFT */
+	u64 menvcfg;
+	/** medeleg bits controlled through FWFT */
+	unsigned long medeleg;
+	/** Locked features, one bit per FWFT feature table entry */
+	unsigned long locked;
+	/** Asynchronous remote fences enabled through FWFT */
+	bool async_rfence;
+	/** Does the context hold a captured state */
+	bool valid;
+};
+
 int sbi_fwft_set(enum sbi_fwft_feature_t feature, unsigned long value,
 		 unsigned long flags);
 int sbi_fwft_get(enum sbi_fwft_feature_t feature, unsigned long *out_val);
 
+void sbi_fwft_context_switch(struct sbi_fwft_context *prev,
+			     struct sbi_fwft_context *next);
+
 int sbi_fwft_init(struct sbi_scratch *scratch, bool cold_boot);
 
 #endif
@@ -10,8 +10,10 @@
 #ifndef __SBI_HART_H__
 #define __SBI_HART_H__
 
+#include <sbi/riscv_encoding.h>
 #include <sbi/sbi_types.h>
 #include <sbi/sbi_bitops.h>
+#include <sbi/sbi_scratch.h>
 
 /** Possible privileged specification versions of a hart */
 enum sbi_hart_priv_versions {
@@ -75,6 +77,10 @@ enum sbi_hart_extensions {
 	SBI_HART_EXT_ZICFISS,
 	/** Hart has Ssdbltrp extension */
 	SBI_HART_EXT_SSDBLTRP,
+	/** Hart has Svinval extension */
+	SBI_HART_EXT_SVINVAL,
+	/** Hart has Zawrs extension */
+	SBI_HART_EXT_ZAWRS,
 
 	/** Maximum index of Hart extension */
 	SBI_HART_EXT_MAX,
@@ -111,9 +117,22 @@ struct sbi_hart_features {
 	unsigned int pmp_log2gran;
 	unsigned int mhpm_mask;
 	unsigned int mhpm_bits;
+	/** Zicboz cache block size in bytes, zero if not known */
+	unsigned int cboz_block_size;
+	/** Zicbom cache block size in bytes, zero if not known */
+	unsigned int cbom_block_size;
+};
+
+/** Raw PMP CSR values of a HART */
+struct sbi_hart_pmp_state {
+	/** pmpcfg CSRs, each holding the config of several entries */
+	unsigned long cfg[PMP_COUNT / (__riscv_xlen / 8)];
+	/** pmpaddr CSRs */
+	unsigned long addr[PMP_COUNT];
 };
 
 struct sbi_scratch;
+struct sbi_trap_context;
 
 int sbi_hart_reinit(struct sbi_scratch *scratch);
 int sbi_hart_init(struct sbi_scratch *scratch, bool cold_boot);
@@ -125,6 +144,7 @@ static inline ulong sbi_hart_expected_trap_addr(void)
 }
 
 unsigned int sbi_hart_mhpm_mask(struct sbi_scratch *scratch);
+unsigned int sbi_hart_cbom_block_size(struct sbi_scratch *scratch);
 void sbi_hart_delegation_dump(struct sbi_scratch *scratch,
 			      const char *prefix, const char *suffix);
 unsigned int sbi_hart_pmp_count(struct sbi_scratch *scratch);
@@ -132,6 +152,21 @@ unsigned int sbi_hart_pmp_log2gran(struct sbi_scratch *scratch);
 unsigned int sbi_hart_pmp_addrbits(struct sbi_scratch *scratch);
 unsigned int sbi_hart_mhpm_bits(struct sbi_scratch *scratch);
 int sbi_hart_pmp_configure(struct sbi_scratch *scratch);
+void sbi_hart_pmp_save(struct sbi_scratch *scratch);
+int sbi_hart_pmp_restore(struct sbi_scratch *scratch);
+bool sbi_hart_pmp_snapshot(struct sbi_scratch *scratch,
+			   struct sbi_hart_pmp_state *state);
+void sbi_hart_pmp_switch(struct sbi_scratch *scratch,
+			 const struct sbi_hart_pmp_state *cur,
+			 const struct sbi_hart_pmp_state *next);
+#ifdef CONFIG_SBI_HART_PMP_MULTIPLEX
+bool sbi_hart_pmp_fault(const struct sbi_trap_context *tcntx);
+#else
+static inline bool sbi_hart_pmp_fault(const struct sbi_trap_context *tcntx)
+{
+	return false;
+}
+#endif
 int sbi_hart_map_saddr(unsigned long base, unsigned long size);
 int sbi_hart_unmap_saddr(void);
 int sbi_hart_priv_version(struct sbi_scratch *scratch);
@@ -140,11 +175,37 @@ void sbi_hart_get_priv_version_str(struct sbi_scratch *scratch,
 void sbi_hart_update_extension(struct sbi_scratch *scratch,
 			       enum sbi_hart_extensions ext,
 			       bool enable);
-bool sbi_hart_has_extension(struct sbi_scratch *scratch,
-			    enum sbi_hart_extensions ext);
+bool __sbi_hart_has_extension(struct sbi_scratch *scratch,
+			      enum sbi_hart_extensions ext);
+
+/**
+ * Check whether a particular hart extension is available
+ *
+ * Extensions in the first word of the bitmap are tested with a single
+ * load from the fixed hot_extensions member of the scratch space.
+ *
+ * @param scratch pointer to the HART scratch space
+ * @param ext the extension number to check
+ * @returns true (available) or false (not available)
+ */
+static inline bool sbi_hart_has_extension(struct sbi_scratch *scratch,
+					  enum sbi_hart_extensions ext)
+{
+	if (ext < BITS_PER_LONG)
+		return (scratch->hot_extensions & BIT(ext)) ? true : false;
+
+	return __sbi_hart_has_extension(scratch, ext);
+}
 void sbi_hart_get_extensions_str(struct sbi_scratch *scratch,
 				 char *extension_str, int nestr);
 
+/**
+ * Zero memory with Zicboz cbo.zero for whole cache blocks when the
+ * current HART has Zicboz and its block size is known, or with
+ * sbi_memset() otherwise.
+ */
+void *sbi_hart_memzero(void *addr, size_t size);
+
 void __attribute__((noreturn)) sbi_hart_hang(void);
 
 void __attribute__((noreturn))
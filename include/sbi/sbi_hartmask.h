@@ -16,26 +16,39 @@
 /**
  * Maximum number of bits in a hartmask
  *
- * The hartmask is indexed using physical HART id so this define
- * also represents the maximum number of HART ids generic OpenSBI
- * can handle.
+ * The hartmask is indexed using HART index so this define also
+ * represents the maximum number of HARTs generic OpenSBI can handle.
  */
-#define SBI_HARTMASK_MAX_BITS		128
+#define SBI_HARTMASK_MAX_BITS		CONFIG_SBI_HARTMASK_MAX_BITS
 
 /** Representation of hartmask */
 struct sbi_hartmask {
 	DECLARE_BITMAP(bits, SBI_HARTMASK_MAX_BITS);
 };
 
+/**
+ * Number of hartmask bits in use, which covers every HART index
+ * discovered at boot. Operations on whole hartmasks only touch the
+ * words holding these bits so the cost scales with the HART count
+ * of the platform rather than with SBI_HARTMASK_MAX_BITS.
+ */
+static inline u32 sbi_hartmask_nr_bits(void)
+{
+	return sbi_scratch_last_hartindex() + 1;
+}
+
+/** Number of hartmask words in use */
+#define sbi_hartmask_nr_longs()		BITS_TO_LONGS(sbi_hartmask_nr_bits())
+
 /** Initialize hartmask to zero */
 #define SBI_HARTMASK_INIT(__m)		\
-	bitmap_zero(((__m)->bits), SBI_HARTMASK_MAX_BITS)
+	bitmap_zero(((__m)->bits), sbi_hartmask_nr_bits())
 
 /** Initialize hartmask to zero except a particular HART id */
 #define SBI_HARTMASK_INIT_EXCEPT(__m, __h)	\
 	do { \
 		u32 __i = sbi_hartid_to_hartindex(__h); \
-		bitmap_zero_except(((__m)->bits), __i, SBI_HARTMASK_MAX_BITS); \
+		bitmap_zero_except(((__m)->bits), __i, sbi_hartmask_nr_bits()); \
 	} while(0)
 
 /**
@@ -65,6 +78,14 @@ static inline void sbi_hartmask_set_hartid(u32 h, struct sbi_hartmask *m)
 	sbi_hartmask_set_hartindex(sbi_hartid_to_hartindex(h), m);
 }
 
+/**
+ * Set the HART ids of an SBI hart mask in hartmask
+ * @param hmask bits of the HART ids starting from hbase
+ * @param hbase HART id of bit 0 of hmask
+ * @param m the hartmask pointer
+ */
+void sbi_hartmask_set_hmask(ulong hmask, ulong hbase, struct sbi_hartmask *m);
+
 /**
  * Clear a HART index in hartmask
  * @param i HART index to clear
@@ -115,7 +136,7 @@ static inline int sbi_hartmask_test_hartid(u32 h, const struct sbi_hartmask *m)
  */
 static inline void sbi_hartmask_set_all(struct sbi_hartmask *dstp)
 {
-	bitmap_fill(sbi_hartmask_bits(dstp), SBI_HARTMASK_MAX_BITS);
+	bitmap_fill(sbi_hartmask_bits(dstp), sbi_hartmask_nr_bits());
 }
 
 /**
@@ -124,7 +145,7 @@ static inline void sbi_hartmask_set_all(struct sbi_hartmask *dstp)
  */
 static inline void sbi_hartmask_clear_all(struct sbi_hartmask *dstp)
 {
-	bitmap_zero(sbi_hartmask_bits(dstp), SBI_HARTMASK_MAX_BITS);
+	bitmap_zero(sbi_hartmask_bits(dstp), sbi_hartmask_nr_bits());
 }
 
 /**
@@ -136,7 +157,7 @@ static inline void sbi_hartmask_copy(struct sbi_hartmask *dstp,
 				     const struct sbi_hartmask *srcp)
 {
 	bitmap_copy(sbi_hartmask_bits(dstp), sbi_hartmask_bits(srcp),
-		    SBI_HARTMASK_MAX_BITS);
+		    sbi_hartmask_nr_bits());
 }
 
 /**
@@ -150,7 +171,7 @@ static inline void sbi_hartmask_and(struct sbi_hartmask *dstp,
 				    const struct sbi_hartmask *src2p)
 {
 	bitmap_and(sbi_hartmask_bits(dstp), sbi_hartmask_bits(src1p),
-		   sbi_hartmask_bits(src2p), SBI_HARTMASK_MAX_BITS);
+		   sbi_hartmask_bits(src2p), sbi_hartmask_nr_bits());
 }
 
 /**
@@ -164,7 +185,7 @@ static inline void sbi_hartmask_or(struct sbi_hartmask *dstp,
 				   const struct sbi_hartmask *src2p)
 {
 	bitmap_or(sbi_hartmask_bits(dstp), sbi_hartmask_bits(src1p),
-		  sbi_hartmask_bits(src2p), SBI_HARTMASK_MAX_BITS);
+		  sbi_hartmask_bits(src2p), sbi_hartmask_nr_bits());
 }
 
 /**
@@ -178,7 +199,50 @@ static inline void sbi_hartmask_xor(struct sbi_hartmask *dstp,
 				    const struct sbi_hartmask *src2p)
 {
 	bitmap_xor(sbi_hartmask_bits(dstp), sbi_hartmask_bits(src1p),
-		   sbi_hartmask_bits(src2p), SBI_HARTMASK_MAX_BITS);
+		   sbi_hartmask_bits(src2p), sbi_hartmask_nr_bits());
+}
+
+/**
+ * Count the HARTs set in a hartmask
+ * @param m the hartmask pointer
+ */
+static inline u32 sbi_hartmask_weight(const struct sbi_hartmask *m)
+{
+	u32 i, count = 0;
+
+	for (i = 0; i < sbi_hartmask_nr_longs(); i++)
+		count += sbi_popcount(m->bits[i]);
+
+	return count;
+}
+
+/**
+ * Find the next HART index set in a hartmask
+ * @param m the hartmask pointer
+ * @param i the HART index to start searching at
+ * @return next set HART index or SBI_HARTMASK_MAX_BITS if none
+ *
+ * Whole zero words are skipped and the set bit within a word is
+ * found with sbi_ffs() so sparse masks only cost a few instructions.
+ */
+static inline u32 sbi_hartmask_next_hartindex(const struct sbi_hartmask *m,
+					      u32 i)
+{
+	u32 w = BIT_WORD(i), nbits = sbi_hartmask_nr_bits();
+	unsigned long bits;
+
+	if (i >= nbits)
+		return SBI_HARTMASK_MAX_BITS;
+
+	bits = m->bits[w] & (~0UL << BIT_WORD_OFFSET(i));
+	while (!bits) {
+		if (++w >= BITS_TO_LONGS(nbits))
+			return SBI_HARTMASK_MAX_BITS;
+		bits = m->bits[w];
+	}
+
+	i = w * BITS_PER_LONG + sbi_ffs(bits);
+	return (i < nbits) ? i : SBI_HARTMASK_MAX_BITS;
 }
 
 /**
@@ -187,8 +251,8 @@ static inline void sbi_hartmask_xor(struct sbi_hartmask *dstp,
  * __m hartmask
 */
 #define sbi_hartmask_for_each_hartindex(__i, __m) \
-	for((__i) = find_first_bit((__m)->bits, SBI_HARTMASK_MAX_BITS); \
+	for((__i) = sbi_hartmask_next_hartindex((__m), 0); \
 		(__i) < SBI_HARTMASK_MAX_BITS; \
-		(__i) = find_next_bit((__m)->bits, SBI_HARTMASK_MAX_BITS, (__i) + 1))
+		(__i) = sbi_hartmask_next_hartindex((__m), (__i) + 1))
 
 #endif
@@ -92,6 +92,45 @@ static inline unsigned long sbi_heap_reserved_space(void)
 	return sbi_heap_reserved_space_from(&global_hpctrl);
 }
 
+#ifdef CONFIG_SBI_HEAP_NUMA
+
+/* Maximum number of NUMA nodes with their own heap */
+#define SBI_HEAP_NUMA_NODES_MAX		16
+
+/** Add the heap of a NUMA node */
+int sbi_heap_node_add(u32 node, unsigned long base, unsigned long size);
+
+/** Set the NUMA node of a HART */
+void sbi_heap_set_hart_node(struct sbi_scratch *scratch, u32 node);
+
+/** Allocate from the heap of the NUMA node of the current HART */
+void *sbi_malloc_local(size_t size);
+
+/** Allocate aligned from the heap of the NUMA node of the current HART */
+void *sbi_aligned_alloc_local(size_t alignment, size_t size);
+
+/** Free-up memory allocated by sbi_aligned_alloc_local() */
+void sbi_free_local(void *ptr);
+
+#else
+
+static inline void *sbi_malloc_local(size_t size)
+{
+	return sbi_malloc(size);
+}
+
+static inline void *sbi_aligned_alloc_local(size_t alignment, size_t size)
+{
+	return sbi_aligned_alloc(alignment, size);
+}
+
+static inline void sbi_free_local(void *ptr)
+{
+	sbi_free(ptr);
+}
+
+#endif
+
 /** Initialize heap area */
 int sbi_heap_init(struct sbi_scratch *scratch);
 int sbi_heap_init_new(struct sbi_heap_control *hpctrl, unsigned long base,
@@ -0,0 +1,75 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Heap usage and allocation statistics
+ */
+
+#ifndef __SBI_HEAP_STATS_H__
+#define __SBI_HEAP_STATS_H__
+
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** Number of allocation call sites tracked separately */
+#define SBI_HEAP_STATS_SITES		32
+
+/* clang-format on */
+
+struct sbi_heap_control;
+
+/** Allocations made from one calling address */
+struct sbi_heap_stats_site {
+	u64 addr;
+	u64 allocs;
+	u64 bytes;
+};
+
+/**
+ * Statistics of the firmware heap as copied to supervisor memory by
+ * SBI_EXT_OPENSBI_HEAP_STATS. Sizes are in bytes. Memory of the slab
+ * caches counts as used for the peak usage and the largest free block.
+ * Call sites are only tracked with CONFIG_SBI_HEAP_STATS_SITES and
+ * allocations of call sites beyond the array are not counted there.
+ */
+struct sbi_heap_stats {
+	u64 total;
+	u64 reserved;
+	u64 used;
+	u64 peak_used;
+	u64 free;
+	u64 largest_free;
+	u64 allocs;
+	u64 frees;
+	u64 failed;
+	u64 failed_max_size;
+	u64 nr_sites;
+	struct sbi_heap_stats_site sites[SBI_HEAP_STATS_SITES];
+};
+
+#ifdef CONFIG_SBI_HEAP_STATS
+
+void sbi_heap_stats_from(struct sbi_heap_control *hpctrl,
+			 struct sbi_heap_stats *stats);
+
+void sbi_heap_stats_print(void);
+
+int sbi_heap_stats_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			  struct sbi_ecall_return *out);
+
+#else
+
+static inline void sbi_heap_stats_print(void) { }
+
+static inline int sbi_heap_stats_handle(unsigned long funcid,
+					struct sbi_trap_regs *regs,
+					struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+#endif
+
+#endif
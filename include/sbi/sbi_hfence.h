@@ -36,4 +36,47 @@ void __sbi_hfence_vvma_va(unsigned long va);
 /** Invalidate all possible Stage2 TLBs */
 void __sbi_hfence_vvma_all(void);
 
+/** Svinval: invalidate TLB entries for given ASID and virtual address */
+void __sbi_sinval_vma_asid_va(unsigned long va, unsigned long asid);
+
+/** Svinval: invalidate TLB entries for given ASID */
+void __sbi_sinval_vma_asid(unsigned long asid);
+
+/** Svinval: invalidate TLB entries for given virtual address */
+void __sbi_sinval_vma_va(unsigned long va);
+
+/** Svinval: invalidate all TLB entries */
+void __sbi_sinval_vma_all(void);
+
+/** Svinval: invalidate Stage2 TLBs for given VMID and guest physical address */
+void __sbi_hinval_gvma_vmid_gpa(unsigned long gpa_divby_4,
+				unsigned long vmid);
+
+/** Svinval: invalidate Stage2 TLBs for given VMID */
+void __sbi_hinval_gvma_vmid(unsigned long vmid);
+
+/** Svinval: invalidate Stage2 TLBs for given guest physical address */
+void __sbi_hinval_gvma_gpa(unsigned long gpa_divby_4);
+
+/** Svinval: invalidate all possible Stage2 TLBs */
+void __sbi_hinval_gvma_all(void);
+
+/** Svinval: invalidate guest TLB entries for given ASID and virtual address */
+void __sbi_hinval_vvma_asid_va(unsigned long va, unsigned long asid);
+
+/** Svinval: invalidate guest TLB entries for given ASID */
+void __sbi_hinval_vvma_asid(unsigned long asid);
+
+/** Svinval: invalidate guest TLB entries for given virtual address */
+void __sbi_hinval_vvma_va(unsigned long va);
+
+/** Svinval: invalidate all guest TLB entries */
+void __sbi_hinval_vvma_all(void);
+
+/** Svinval: order prior stores before subsequent invalidations */
+void __sbi_sfence_w_inval(void);
+
+/** Svinval: order prior invalidations before subsequent implicit accesses */
+void __sbi_sfence_inval_ir(void);
+
 #endif
@@ -14,6 +14,18 @@
 #include <sbi/sbi_types.h>
 
 /** Hart state managment device */
+/** Platform suspend state considered by the idle governor */
+struct sbi_hsm_idle_state {
+	/** Suspend type (SBI_HSM_SUSPEND_RET_PLATFORM... or non-retentive) */
+	u32 suspend_type;
+	/** Worst case time to resume from the state */
+	u32 exit_latency_us;
+	/** Minimum time in the state to save more than it costs */
+	u32 min_residency_us;
+	/** Is the local timer stopped in this state */
+	bool local_timer_stop;
+};
+
 struct sbi_hsm_device {
 	/** Name of the hart state managment device */
 	char name[32];
@@ -50,6 +62,15 @@ struct sbi_hsm_device {
 	 * non-retentive suspend.
 	 */
 	void (*hart_resume)(void);
+
+	/**
+	 * Platform suspend states, ordered from shallowest to deepest
+	 * (optional). The idle governor may pick the retentive ones for
+	 * default retentive suspends and stopped HARTs may enter the
+	 * deepest non-retentive one.
+	 */
+	const struct sbi_hsm_idle_state *idle_states;
+	u32 idle_state_count;
 };
 
 struct sbi_domain;
@@ -65,7 +86,13 @@ void __noreturn sbi_hsm_exit(struct sbi_scratch *scratch);
 int sbi_hsm_hart_start(struct sbi_scratch *scratch,
 		       const struct sbi_domain *dom,
 		       u32 hartid, ulong saddr, ulong smode, ulong arg1);
+int sbi_hsm_hart_start_many(struct sbi_scratch *scratch,
+			    const struct sbi_domain *dom,
+			    ulong hmask, ulong hbase, ulong saddr, ulong smode,
+			    const ulong *args);
 int sbi_hsm_hart_stop(struct sbi_scratch *scratch, bool exitnow);
+void __noreturn sbi_hsm_hart_restart(struct sbi_scratch *scratch,
+				     ulong saddr, ulong smode, ulong arg1);
 void sbi_hsm_hart_resume_start(struct sbi_scratch *scratch);
 void __noreturn sbi_hsm_hart_resume_finish(struct sbi_scratch *scratch,
 					   u32 hartid);
@@ -75,6 +102,7 @@ bool sbi_hsm_hart_change_state(struct sbi_scratch *scratch, long oldstate,
 			       long newstate);
 int __sbi_hsm_hart_get_state(u32 hartindex);
 int sbi_hsm_hart_get_state(const struct sbi_domain *dom, u32 hartid);
+bool sbi_hsm_hart_fence_deferrable(struct sbi_scratch *scratch);
 int sbi_hsm_hart_interruptible_mask(const struct sbi_domain *dom,
 				    struct sbi_hartmask *mask);
 void __sbi_hsm_suspend_non_ret_save(struct sbi_scratch *scratch);
@@ -0,0 +1,118 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Per-hart suspend residency and resume latency accounting
+ */
+
+#ifndef __SBI_HSM_STATS_H__
+#define __SBI_HSM_STATS_H__
+
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** Number of suspend types accounted separately per HART */
+#define SBI_HSM_STATS_TYPES		4
+
+/* clang-format on */
+
+struct sbi_scratch;
+
+/**
+ * Suspend statistics of one suspend type in timer ticks. Residency
+ * runs from entering the platform suspend until OpenSBI runs again
+ * and the exit latency from there until the return to the supervisor.
+ * An entry with zero entries is unused.
+ */
+struct sbi_hsm_suspend_stats {
+	u64 type;
+	u64 entries;
+	u64 residency;
+	u64 exit_total;
+	u64 exit_min;
+	u64 exit_max;
+};
+
+/**
+ * Suspend statistics of one HART as copied to supervisor memory by
+ * SBI_EXT_OPENSBI_SUSPEND_STATS. Suspends of types which did not fit
+ * into the array are only counted in dropped.
+ */
+struct sbi_hsm_stats {
+	u64 dropped;
+	struct sbi_hsm_suspend_stats types[SBI_HSM_STATS_TYPES];
+};
+
+/**
+ * HSM start statistics of one HART in timer ticks. The start latency
+ * runs from the HART start call of another HART until the started HART
+ * switches to the supervisor.
+ */
+struct sbi_hsm_start_stats {
+	u64 starts;
+	u64 latency_total;
+	u64 latency_min;
+	u64 latency_max;
+	u64 latency_last;
+};
+
+#ifdef CONFIG_SBI_HSM_STATS
+
+void sbi_hsm_stats_suspend_enter(struct sbi_scratch *scratch,
+				 u32 suspend_type);
+
+void sbi_hsm_stats_suspend_wake(struct sbi_scratch *scratch);
+
+void sbi_hsm_stats_suspend_exit(struct sbi_scratch *scratch);
+
+void sbi_hsm_stats_start_done(struct sbi_scratch *scratch, u64 start_time);
+
+/** Average measured exit latency (timer ticks) or 0 if not measured */
+u64 sbi_hsm_stats_exit_latency(struct sbi_scratch *scratch,
+			       u32 suspend_type);
+
+const struct sbi_hsm_stats *sbi_hsm_stats_get(u32 hartindex);
+
+const struct sbi_hsm_start_stats *sbi_hsm_stats_start_get(u32 hartindex);
+
+int sbi_hsm_stats_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			 struct sbi_ecall_return *out);
+
+int sbi_hsm_stats_init(struct sbi_scratch *scratch, bool cold_boot);
+
+#else
+
+static inline void sbi_hsm_stats_suspend_enter(struct sbi_scratch *scratch,
+					       u32 suspend_type) { }
+
+static inline void sbi_hsm_stats_suspend_wake(struct sbi_scratch *scratch) { }
+
+static inline void sbi_hsm_stats_suspend_exit(struct sbi_scratch *scratch) { }
+
+static inline void sbi_hsm_stats_start_done(struct sbi_scratch *scratch,
+					    u64 start_time) { }
+
+static inline u64 sbi_hsm_stats_exit_latency(struct sbi_scratch *scratch,
+					     u32 suspend_type)
+{
+	return 0;
+}
+
+static inline int sbi_hsm_stats_handle(unsigned long funcid,
+				       struct sbi_trap_regs *regs,
+				       struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int sbi_hsm_stats_init(struct sbi_scratch *scratch,
+				     bool cold_boot)
+{
+	return 0;
+}
+
+#endif
+
+#endif
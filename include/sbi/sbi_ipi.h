@@ -18,6 +18,8 @@
 
 /* clang-format on */
 
+struct sbi_hartmask;
+
 /** IPI hardware device */
 struct sbi_ipi_device {
 	/** Name of the IPI device */
@@ -26,6 +28,9 @@ struct sbi_ipi_device {
 	/** Send IPI to a target HART index */
 	void (*ipi_send)(u32 hart_index);
 
+	/** Send IPI to a set of target HART indices (optional) */
+	void (*ipi_send_mask)(const struct sbi_hartmask *mask);
+
 	/** Clear IPI for the current hart */
 	void (*ipi_clear)(void);
 };
@@ -36,6 +41,7 @@ enum sbi_ipi_update_type {
 	SBI_IPI_UPDATE_RETRY,
 };
 
+struct sbi_domain;
 struct sbi_scratch;
 
 /** IPI event operations or callbacks */
@@ -73,26 +79,55 @@ struct sbi_ipi_event_ops {
 
 int sbi_ipi_send_many(ulong hmask, ulong hbase, u32 event, void *data);
 
+int sbi_ipi_send_mask(const struct sbi_hartmask *mask, u32 event,
+		      void *data);
+
 int sbi_ipi_event_create(const struct sbi_ipi_event_ops *ops);
 
 void sbi_ipi_event_destroy(u32 event);
 
 int sbi_ipi_send_smode(ulong hmask, ulong hbase);
 
+int sbi_ipi_send_smode_domain(const struct sbi_domain *dom);
+
 void sbi_ipi_clear_smode(void);
 
 int sbi_ipi_send_halt(ulong hmask, ulong hbase);
 
+/**
+ * Send a halt IPI and wait until every target took it or the timeout
+ * expired, in which case SBI_ETIMEDOUT is returned
+ */
+int sbi_ipi_send_halt_wait(ulong hmask, ulong hbase, ulong timeout_ms);
+
+int sbi_ipi_call_many(const struct sbi_hartmask *mask,
+		      void (*fn)(void *arg), void *arg, bool wait);
+
 void sbi_ipi_process(void);
 
+/**
+ * Post an IPI event to the current HART again so that the processing
+ * which was cut short continues with the next IPI
+ */
+void sbi_ipi_event_repost(u32 event);
+
 int sbi_ipi_raw_send(u32 hartindex);
 
+int sbi_ipi_raw_send_mask(const struct sbi_hartmask *mask);
+
 void sbi_ipi_raw_clear(void);
 
 const struct sbi_ipi_device *sbi_ipi_get_device(void);
 
 void sbi_ipi_set_device(const struct sbi_ipi_device *dev);
 
+/**
+ * Describe the HART topology to the IPI tree fan-out
+ *
+ * @param harts number of consecutive HART indices in each cluster
+ */
+void sbi_ipi_set_cluster_size(u32 harts);
+
 int sbi_ipi_init(struct sbi_scratch *scratch, bool cold_boot);
 
 void sbi_ipi_exit(struct sbi_scratch *scratch);
@@ -15,6 +15,19 @@
 
 struct sbi_scratch;
 
+/* clang-format off */
+
+/** Number of local interrupts which can have a handler */
+#define SBI_IRQCHIP_LOCAL_IRQS		64
+
+/** Number of external interrupt IDs, enough for IMSIC, APLIC and PLIC */
+#define SBI_IRQCHIP_EXT_IDS		2048
+
+/** Number of external interrupt IDs which can have a handler at once */
+#define SBI_IRQCHIP_EXT_HANDLERS	64
+
+/* clang-format on */
+
 /** irqchip hardware device */
 struct sbi_irqchip_device {
 	/** Node in the list of irqchip devices */
@@ -37,6 +50,54 @@ struct sbi_irqchip_device {
  */
 int sbi_irqchip_process(void);
 
+/**
+ * Process a local interrupt
+ *
+ * This function is called by sbi_trap_handler() for each pending
+ * local interrupt of the current HART.
+ *
+ * @param irq local interrupt number
+ *
+ * @return 0 on success and SBI_ENOENT if the interrupt has no handler
+ */
+int sbi_irqchip_local_process(unsigned long irq);
+
+/**
+ * Attach a handler to a local interrupt
+ *
+ * @param irq local interrupt number
+ * @param handler function called every time the interrupt is taken
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int sbi_irqchip_set_local_handler(unsigned long irq, int (*handler)(void));
+
+/**
+ * Process an external interrupt ID claimed by the irqchip driver
+ *
+ * @param id external interrupt ID
+ *
+ * @return 0 on success and SBI_ENOENT if the ID has no handler
+ */
+int sbi_irqchip_ext_process(unsigned long id);
+
+/**
+ * Attach a handler to an external interrupt ID
+ *
+ * The irqchip driver which owns the M-mode external interrupt claims
+ * the pending ID and dispatches it with sbi_irqchip_ext_process().
+ *
+ * @param id external interrupt ID
+ * @param handler function called with the ID and @p priv every time
+ * the ID is claimed
+ * @param priv opaque pointer passed to @p handler
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int sbi_irqchip_set_ext_handler(unsigned long id,
+				int (*handler)(unsigned long id, void *priv),
+				void *priv);
+
 /** Register an irqchip device to receive callbacks */
 void sbi_irqchip_add_device(struct sbi_irqchip_device *dev);
 
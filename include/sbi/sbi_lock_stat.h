@@ -0,0 +1,71 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Spinlock contention statistics
+ */
+
+#ifndef __SBI_LOCK_STAT_H__
+#define __SBI_LOCK_STAT_H__
+
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** Number of named locks tracked */
+#define SBI_LOCK_STAT_MAX		32
+
+/** Bytes of a lock name including the terminating zero */
+#define SBI_LOCK_STAT_NAME_LEN		16
+
+/** Flags of SBI_EXT_OPENSBI_LOCK_STATS */
+#define SBI_LOCK_STAT_FLAG_PRINT	(1UL << 0)
+#define SBI_LOCK_STAT_FLAG_RESET	(1UL << 1)
+
+/* clang-format on */
+
+/** Statistics of one named lock */
+struct sbi_lock_stat_entry {
+	char name[SBI_LOCK_STAT_NAME_LEN];
+	u64 acquired;
+	u64 contended;
+	u64 max_distance;
+	u64 spin_cycles;
+	u64 max_spin_cycles;
+};
+
+/**
+ * Statistics of the named locks as copied to supervisor memory by
+ * SBI_EXT_OPENSBI_LOCK_STATS. Spin cycles are mcycle counts of the
+ * contended acquisitions. The counters are read without taking the
+ * locks so a snapshot under load may be slightly inconsistent.
+ */
+struct sbi_lock_stats {
+	u64 nr_locks;
+	struct sbi_lock_stat_entry locks[SBI_LOCK_STAT_MAX];
+};
+
+#ifdef CONFIG_SBI_LOCK_STAT
+
+void sbi_lock_stat_print(void);
+
+void sbi_lock_stat_snapshot(struct sbi_lock_stats *stats);
+
+int sbi_lock_stat_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			 struct sbi_ecall_return *out);
+
+#else
+
+static inline void sbi_lock_stat_print(void) { }
+
+static inline int sbi_lock_stat_handle(unsigned long funcid,
+				       struct sbi_trap_regs *regs,
+				       struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * LZ4 frame decompression
+ */
+
+#ifndef __SBI_LZ4_H__
+#define __SBI_LZ4_H__
+
+#include <sbi/sbi_types.h>
+
+/**
+ * Decompress an LZ4 frame as produced by the lz4 command line tool
+ *
+ * Both independent and linked blocks are supported. Block and content
+ * checksums are skipped without being verified and frames which need a
+ * dictionary are rejected. When the frame carries its content size the
+ * output is limited to that size as well.
+ *
+ * @param dst destination buffer
+ * @param dst_size size of the destination buffer
+ * @param src LZ4 frame
+ * @param src_size size of the LZ4 frame
+ *
+ * @return size of the decompressed data on success and negative error
+ * code on failure
+ */
+long sbi_lz4_decompress(void *dst, unsigned long dst_size,
+			const void *src, unsigned long src_size);
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Lock-free multi-producer/single-consumer bounded FIFO
+ */
+
+#ifndef __SBI_MPSC_FIFO_H__
+#define __SBI_MPSC_FIFO_H__
+
+#include <sbi/sbi_fifo.h>
+#include <sbi/sbi_types.h>
+
+/**
+ * Bounded FIFO which can be filled by any number of producers
+ * without taking a lock while exactly one consumer drains it.
+ *
+ * Every slot carries a sequence word which encodes the position
+ * the slot is expected at next and whether it is free, holds a
+ * published entry or is temporarily owned by an in-place update
+ * or by the consumer. Producers only ever contend on the head
+ * index whereas the consumer owns the tail index, so both are on
+ * cache lines of their own.
+ */
+struct sbi_mpsc_fifo {
+	unsigned long *seq;
+	void *queue;
+	u16 entry_size;
+	u16 num_entries;
+	unsigned long head __cacheline_aligned;
+	unsigned long tail __cacheline_aligned;
+};
+
+/** Bytes of memory required for the given entry count and size */
+#define SBI_MPSC_FIFO_MEM_SIZE(__entries, __entry_size)			\
+	((unsigned long)(__entries) *					\
+	 (sizeof(unsigned long) + (__entry_size)))
+
+int sbi_mpsc_fifo_dequeue(struct sbi_mpsc_fifo *fifo, void *data);
+int sbi_mpsc_fifo_enqueue(struct sbi_mpsc_fifo *fifo, void *data);
+int sbi_mpsc_fifo_init(struct sbi_mpsc_fifo *fifo, void *mem, u16 entries,
+		       u16 entry_size);
+int sbi_mpsc_fifo_is_empty(struct sbi_mpsc_fifo *fifo);
+int sbi_mpsc_fifo_inplace_update(struct sbi_mpsc_fifo *fifo, void *in,
+				 int (*fptr)(void *in, void *data));
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Nested acceleration (NACL) shared memory
+ */
+
+#ifndef __SBI_NACL_H__
+#define __SBI_NACL_H__
+
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+#define SBI_NACL_SHMEM_INVALID_ADDR	(-1UL)
+#define SBI_NACL_SHMEM_ALIGN_MASK	(0x1000UL - 1)
+
+/* Layout of the shared memory of a hart */
+#define SBI_NACL_SHMEM_SCRATCH_OFFSET	0x0000
+#define SBI_NACL_SHMEM_SCRATCH_SIZE	0x1000
+#define SBI_NACL_SHMEM_SRET_OFFSET	0x0000
+#define SBI_NACL_SHMEM_SRET_SIZE	0x0200
+#define SBI_NACL_SHMEM_AUTOSWAP_OFFSET	(SBI_NACL_SHMEM_SRET_OFFSET + \
+					 SBI_NACL_SHMEM_SRET_SIZE)
+#define SBI_NACL_SHMEM_AUTOSWAP_SIZE	0x0080
+#define SBI_NACL_SHMEM_UNUSED_OFFSET	(SBI_NACL_SHMEM_AUTOSWAP_OFFSET + \
+					 SBI_NACL_SHMEM_AUTOSWAP_SIZE)
+#define SBI_NACL_SHMEM_UNUSED_SIZE	0x0580
+#define SBI_NACL_SHMEM_HFENCE_OFFSET	(SBI_NACL_SHMEM_UNUSED_OFFSET + \
+					 SBI_NACL_SHMEM_UNUSED_SIZE)
+#define SBI_NACL_SHMEM_HFENCE_SIZE	0x0780
+#define SBI_NACL_SHMEM_DBITMAP_OFFSET	(SBI_NACL_SHMEM_HFENCE_OFFSET + \
+					 SBI_NACL_SHMEM_HFENCE_SIZE)
+#define SBI_NACL_SHMEM_DBITMAP_SIZE	0x0080
+#define SBI_NACL_SHMEM_CSR_OFFSET	(SBI_NACL_SHMEM_DBITMAP_OFFSET + \
+					 SBI_NACL_SHMEM_DBITMAP_SIZE)
+#define SBI_NACL_SHMEM_CSR_SIZE		((__riscv_xlen / 8) * 1024)
+#define SBI_NACL_SHMEM_SIZE		(SBI_NACL_SHMEM_CSR_OFFSET + \
+					 SBI_NACL_SHMEM_CSR_SIZE)
+
+/* Slot of a CSR in the CSR space and bit in the dirty bitmap */
+#define SBI_NACL_SHMEM_CSR_INDEX(__csr_num)	\
+	((((__csr_num) & 0xc00) >> 2) | ((__csr_num) & 0xff))
+
+/* An HFENCE entry is {config, page number, reserved, page count} */
+#define SBI_NACL_SHMEM_HFENCE_ENTRY_SZ	((__riscv_xlen / 8) * 4)
+#define SBI_NACL_SHMEM_HFENCE_ENTRY_MAX	(SBI_NACL_SHMEM_HFENCE_SIZE / \
+					 SBI_NACL_SHMEM_HFENCE_ENTRY_SZ)
+
+#define SBI_NACL_HFENCE_CONFIG_PEND	(1UL << (__riscv_xlen - 1))
+#define SBI_NACL_HFENCE_CONFIG_TYPE_SHIFT	(__riscv_xlen - 8)
+#define SBI_NACL_HFENCE_CONFIG_TYPE_MASK	0xfUL
+#define SBI_NACL_HFENCE_CONFIG_ORDER_SHIFT	(__riscv_xlen - 16)
+#define SBI_NACL_HFENCE_CONFIG_ORDER_MASK	0x7fUL
+#define SBI_NACL_HFENCE_ORDER_BASE	12
+#if __riscv_xlen == 32
+#define SBI_NACL_HFENCE_CONFIG_ASID_BITS	9
+#define SBI_NACL_HFENCE_CONFIG_VMID_BITS	7
+#else
+#define SBI_NACL_HFENCE_CONFIG_ASID_BITS	16
+#define SBI_NACL_HFENCE_CONFIG_VMID_BITS	14
+#endif
+#define SBI_NACL_HFENCE_CONFIG_VMID_SHIFT	SBI_NACL_HFENCE_CONFIG_ASID_BITS
+
+#define SBI_NACL_HFENCE_TYPE_GVMA		0x0
+#define SBI_NACL_HFENCE_TYPE_GVMA_ALL		0x1
+#define SBI_NACL_HFENCE_TYPE_GVMA_VMID		0x2
+#define SBI_NACL_HFENCE_TYPE_GVMA_VMID_ALL	0x3
+#define SBI_NACL_HFENCE_TYPE_VVMA		0x4
+#define SBI_NACL_HFENCE_TYPE_VVMA_ALL		0x5
+#define SBI_NACL_HFENCE_TYPE_VVMA_ASID		0x6
+#define SBI_NACL_HFENCE_TYPE_VVMA_ASID_ALL	0x7
+
+/* clang-format on */
+
+struct sbi_domain;
+struct sbi_scratch;
+
+/** Check whether a feature of the extension is available */
+bool sbi_nacl_feature_available(unsigned long feature_id);
+
+int sbi_nacl_set_shmem(const struct sbi_domain *dom, unsigned long smode,
+		       unsigned long shmem_phys_lo,
+		       unsigned long shmem_phys_hi, unsigned long flags);
+
+/**
+ * Write the CSRs marked dirty in the shared memory of the calling hart
+ * and read back their current values, all of them if csr_num is -1UL
+ */
+int sbi_nacl_sync_csr(unsigned long csr_num);
+
+/**
+ * Perform the pending HFENCE entries in the shared memory of the calling
+ * hart, all of them if entry_index is -1UL
+ */
+int sbi_nacl_sync_hfence(unsigned long entry_index);
+
+#ifdef CONFIG_SBI_ECALL_NACL
+/** Forget the shared memory set up on a stopped hart */
+void sbi_nacl_reset_hart(struct sbi_scratch *scratch);
+#else
+static inline void sbi_nacl_reset_hart(struct sbi_scratch *scratch) { }
+#endif
+
+int sbi_nacl_init(void);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Combined firmware performance report
+ */
+
+#ifndef __SBI_PERF_REPORT_H__
+#define __SBI_PERF_REPORT_H__
+
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** "OSPR" in little endian */
+#define SBI_PERF_REPORT_MAGIC		0x5250534f
+#define SBI_PERF_REPORT_VERSION		1
+
+/** Section hartid of the sections which are not per-HART */
+#define SBI_PERF_REPORT_GLOBAL		(-1U)
+
+/** Section types and their payload */
+enum sbi_perf_report_type {
+	/** struct sbi_trap_stats */
+	SBI_PERF_REPORT_TRAP_STATS	= 1,
+	/** SBI_ECALL_PROFILE_SLOTS x struct sbi_ecall_profile_entry */
+	SBI_PERF_REPORT_ECALL_PROFILE	= 2,
+	/** struct sbi_hsm_stats */
+	SBI_PERF_REPORT_HSM_STATS	= 3,
+	/** struct sbi_heap_stats */
+	SBI_PERF_REPORT_HEAP_STATS	= 4,
+	/** struct sbi_lock_stats */
+	SBI_PERF_REPORT_LOCK_STATS	= 5,
+	/** Array of struct sbi_perf_report_boot_stage */
+	SBI_PERF_REPORT_BOOT_TRACE	= 6,
+	/** struct sbi_hsm_start_stats */
+	SBI_PERF_REPORT_HSM_START_STATS	= 7,
+};
+
+/* clang-format on */
+
+/**
+ * Start of the report. Sections follow the header back to back and
+ * readers skip the section types they do not know.
+ */
+struct sbi_perf_report_header {
+	u32 magic;
+	u32 version;
+	/** Size of the report including this header */
+	u64 size;
+	/** Timer value when the report was taken */
+	u64 time;
+	u32 nr_sections;
+	u32 reserved;
+};
+
+struct sbi_perf_report_section {
+	u32 type;
+	/** HART the section describes or SBI_PERF_REPORT_GLOBAL */
+	u32 hartid;
+	/** Size of the payload following this section header */
+	u64 size;
+};
+
+struct sbi_perf_report_boot_stage {
+	char name[16];
+	u64 time;
+	u64 cycles;
+};
+
+struct sbi_domain;
+
+#ifdef CONFIG_SBI_PERF_REPORT
+/**
+ * Build the report of a domain into buf if it fits into size bytes.
+ * The caller maps buf if it is supervisor memory.
+ *
+ * @return size of the report
+ */
+unsigned long sbi_perf_report_build(const struct sbi_domain *dom, void *buf,
+				    unsigned long size);
+
+int sbi_perf_report_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			   struct sbi_ecall_return *out);
+#else
+static inline int sbi_perf_report_handle(unsigned long funcid,
+					 struct sbi_trap_regs *regs,
+					 struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+#endif
+
+#endif
@@ -50,6 +50,7 @@
 #include <sbi/sbi_version.h>
 #include <sbi/sbi_trap_ldst.h>
 
+struct sbi_domain;
 struct sbi_domain_memregion;
 struct sbi_ecall_return;
 struct sbi_trap_regs;
@@ -87,6 +88,9 @@ struct sbi_platform_operations {
 	/** Platform final exit */
 	void (*final_exit)(void);
 
+	/** Apply platform state of the domain the current HART enters */
+	void (*domain_enter)(const struct sbi_domain *dom);
+
 	/**
 	 * For platforms that do not implement misa, non-standard
 	 * methods are needed to determine cpu extension.
@@ -120,6 +124,9 @@ struct sbi_platform_operations {
 	/** Get tlb flush limit value **/
 	u64 (*get_tlbr_flush_limit)(void);
 
+	/** Get tlb flush limit value of a particular HART **/
+	u64 (*get_hart_tlbr_flush_limit)(u32 hartid);
+
 	/** Get tlb fifo num entries*/
 	u32 (*get_tlb_num_entries)(void);
 
@@ -144,6 +151,15 @@ struct sbi_platform_operations {
 /** Platform default per-HART stack size for exception/interrupt handling */
 #define SBI_PLATFORM_DEFAULT_HART_STACK_SIZE	8192
 
+/**
+ * Platform default number of TLB fifo entries per HART, which is one
+ * entry per HART up to this limit. Requests which do not fit into the
+ * fifo are collapsed into full flushes so the limit keeps the fifo
+ * memory from growing with the square of the HART count.
+ */
+#define SBI_PLATFORM_DEFAULT_TLB_FIFO_ENTRIES(__num_hart)	\
+			(((__num_hart) < 128) ? (__num_hart) : 128)
+
 /** Platform default heap size */
 #define SBI_PLATFORM_DEFAULT_HEAP_SIZE(__num_hart)	\
 					(0x8000 + 0x1000 * (__num_hart))
@@ -317,6 +333,25 @@ static inline u64 sbi_platform_tlbr_flush_limit(const struct sbi_platform *plat)
 	return SBI_PLATFORM_TLB_RANGE_FLUSH_LIMIT_DEFAULT;
 }
 
+/**
+ * Get platform specific tlb range flush maximum value of a HART which
+ * overrides the global value returned by sbi_platform_tlbr_flush_limit().
+ *
+ * @param plat pointer to struct sbi_platform
+ * @param hartid HART ID
+ *
+ * @return tlb range flush limit value of the HART or 0 if not defined
+ * by platform.
+ */
+static inline u64 sbi_platform_hart_tlbr_flush_limit(
+					const struct sbi_platform *plat,
+					u32 hartid)
+{
+	if (plat && sbi_platform_ops(plat)->get_hart_tlbr_flush_limit)
+		return sbi_platform_ops(plat)->get_hart_tlbr_flush_limit(hartid);
+	return 0;
+}
+
 /**
  * Get platform specific tlb fifo num entries.
  *
@@ -328,7 +363,8 @@ static inline u32 sbi_platform_tlb_fifo_num_entries(const struct sbi_platform *p
 {
 	if (plat && sbi_platform_ops(plat)->get_tlb_num_entries)
 		return sbi_platform_ops(plat)->get_tlb_num_entries();
-	return sbi_scratch_last_hartindex() + 1;
+	return SBI_PLATFORM_DEFAULT_TLB_FIFO_ENTRIES(
+					sbi_scratch_last_hartindex() + 1);
 }
 
 /**
@@ -447,6 +483,20 @@ static inline void sbi_platform_final_exit(const struct sbi_platform *plat)
 		sbi_platform_ops(plat)->final_exit();
 }
 
+/**
+ * Apply platform state of a domain, such as cache partitioning, when
+ * the current HART boots into it or switches to it
+ *
+ * @param plat pointer to struct sbi_platform
+ * @param dom pointer to the domain the current HART now runs
+ */
+static inline void sbi_platform_domain_enter(const struct sbi_platform *plat,
+					     const struct sbi_domain *dom)
+{
+	if (plat && sbi_platform_ops(plat)->domain_enter)
+		sbi_platform_ops(plat)->domain_enter(dom);
+}
+
 /**
  * Check CPU extension in MISA
  *
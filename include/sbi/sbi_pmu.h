@@ -26,6 +26,91 @@ struct sbi_scratch;
 #define SBI_PMU_FIXED_CTR_MASK 0x07
 #define SBI_PMU_CY_IR_MASK	0x05
 
+/**
+ * OpenSBI specific firmware events. These are allocated from the
+ * firmware event codes which the SBI specification leaves to the
+ * SBI implementation.
+ */
+enum sbi_pmu_fw_opensbi_event_code_id {
+	SBI_PMU_FW_OPENSBI_BASE		= 256,
+	/* Cycles spent in the C trap handler of OpenSBI */
+	SBI_PMU_FW_MMODE_CYCLES		= SBI_PMU_FW_OPENSBI_BASE,
+	/* Counter CSR accesses emulated on illegal instruction traps */
+	SBI_PMU_FW_EMUL_CSR_CYCLE,
+	SBI_PMU_FW_EMUL_CSR_TIME,
+	SBI_PMU_FW_EMUL_CSR_INSTRET,
+	SBI_PMU_FW_EMUL_CSR_HPMCOUNTER,
+	/* Any other CSR access emulated on illegal instruction traps */
+	SBI_PMU_FW_EMUL_CSR_OTHER,
+	SBI_PMU_FW_DOMAIN_SWITCH,
+	SBI_PMU_FW_SSE_INJECT,
+	/* Remote TLB requests which found the target fifo full */
+	SBI_PMU_FW_TLB_FIFO_FULL,
+	/* Page faults redirected while hardware A/D updating was off */
+	SBI_PMU_FW_ADUE_OFF_PAGE_FAULT,
+	SBI_PMU_FW_OPENSBI_MAX,
+};
+
+/** Size and alignment of the PMU snapshot shared memory */
+#define SBI_PMU_SNAPSHOT_SIZE		4096
+#define SBI_PMU_SNAPSHOT_INVALID_ADDR	(-1UL)
+
+/** Alignment of the PMU event info shared memory */
+#define SBI_PMU_EVENT_INFO_ALIGN	16
+
+/** Event is supported by the PMU (sbi_pmu_event_info.output) */
+#define SBI_PMU_EVENT_INFO_SUPPORTED	(1U << 0)
+
+/** Entry of the PMU event info shared memory */
+struct sbi_pmu_event_info {
+	/** Event index to query, filled by the caller */
+	uint32_t event_idx;
+	/** Query result, filled by the SBI implementation */
+	uint32_t output;
+	/** Event data (raw event selector), filled by the caller */
+	uint64_t event_data;
+};
+
+/** Number of overflow samples in the PMU snapshot shared memory */
+#define SBI_PMU_SAMPLE_MAX		64
+
+/** Firmware counter overflow sample, OpenSBI specific */
+struct sbi_pmu_sample {
+	/** Exception PC of the trap in which the counter overflowed */
+	uint64_t pc;
+	/** Timer value at the time of the overflow */
+	uint64_t time;
+	/** Overflown counter and the event it was counting */
+	uint32_t ctr_idx;
+	uint32_t event_idx;
+};
+
+/** Layout of the PMU snapshot shared memory */
+struct sbi_pmu_snapshot {
+	/** Overflown counters relative to the counter index base */
+	uint64_t ctr_overflow_mask;
+	/** Counter values relative to the counter index base */
+	uint64_t ctr_values[64];
+	/**
+	 * Timer ticks a multiplexed hardware event was started and was
+	 * counting on hardware, OpenSBI specific and only written with
+	 * CONFIG_SBI_PMU_HW_MUX
+	 */
+	uint64_t ctr_enabled[64];
+	uint64_t ctr_running[64];
+	/**
+	 * Ring of firmware counter overflow samples, OpenSBI specific.
+	 * The sample_head is only advanced by OpenSBI and the sample_tail
+	 * only by the supervisor. Samples which don't fit are only counted
+	 * in sample_lost.
+	 */
+	uint64_t sample_head;
+	uint64_t sample_tail;
+	uint64_t sample_lost;
+	struct sbi_pmu_sample samples[SBI_PMU_SAMPLE_MAX];
+	uint64_t reserved[124];
+};
+
 struct sbi_pmu_device {
 	/** Name of the PMU platform device */
 	char name[32];
@@ -87,6 +172,26 @@ struct sbi_pmu_device {
 	 */
 	void (*hw_counter_disable_irq)(uint32_t counter_index);
 
+	/**
+	 * Custom enable irq for a mask of hardware counters, bit N of
+	 * counter_mask being counter index N. Used instead of
+	 * hw_counter_enable_irq() for all counters started by one call.
+	 */
+	void (*hw_counter_enable_irq_mask)(unsigned long counter_mask);
+
+	/**
+	 * Custom disable irq for a mask of hardware counters. Used instead
+	 * of hw_counter_disable_irq() for all counters stopped by one call.
+	 */
+	void (*hw_counter_disable_irq_mask)(unsigned long counter_mask);
+
+	/**
+	 * Acknowledge a counter overflow interrupt taken in M-mode and
+	 * return the mask of hardware counters which overflowed. The
+	 * overflow state of a counter is reset when it is restarted.
+	 */
+	unsigned long (*hw_counter_ovf_ack)(void);
+
 	/**
 	 * Custom function returning the machine-specific irq-bit.
 	 */
@@ -143,14 +248,27 @@ int sbi_pmu_ctr_start(unsigned long cidx_base, unsigned long cidx_mask,
 
 int sbi_pmu_ctr_get_info(uint32_t cidx, unsigned long *ctr_info);
 
+int sbi_pmu_snapshot_set_shmem(unsigned long phys_lo, unsigned long phys_hi,
+			       unsigned long flags);
+
+int sbi_pmu_event_get_info(unsigned long phys_lo, unsigned long phys_hi,
+			   unsigned long num_events, unsigned long flags);
+
 unsigned long sbi_pmu_num_ctr(void);
 
 int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 			  unsigned long flags, unsigned long event_idx,
 			  uint64_t event_data);
 
-int sbi_pmu_ctr_incr_fw(enum sbi_pmu_fw_event_code_id fw_id);
+int sbi_pmu_ctr_add_fw(uint32_t fw_id, uint64_t count);
+
+static inline int sbi_pmu_ctr_incr_fw(uint32_t fw_id)
+{
+	return sbi_pmu_ctr_add_fw(fw_id, 1);
+}
 
 void sbi_pmu_ovf_irq();
 
+void sbi_pmu_fw_samples_flush(void);
+
 #endif
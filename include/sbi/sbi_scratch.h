@@ -44,10 +44,16 @@
 #define SBI_SCRATCH_OPTIONS_OFFSET		(13 * __SIZEOF_POINTER__)
 /** Offset of hartindex member in sbi_scratch */
 #define SBI_SCRATCH_HARTINDEX_OFFSET		(14 * __SIZEOF_POINTER__)
+/** Offset of hot_extensions member in sbi_scratch */
+#define SBI_SCRATCH_HOT_EXTENSIONS_OFFSET	(15 * __SIZEOF_POINTER__)
+/** Offset of trap_frame member in sbi_scratch */
+#define SBI_SCRATCH_TRAP_FRAME_OFFSET		(16 * __SIZEOF_POINTER__)
 /** Offset of extra space in sbi_scratch */
-#define SBI_SCRATCH_EXTRA_SPACE_OFFSET		(15 * __SIZEOF_POINTER__)
+#define SBI_SCRATCH_EXTRA_SPACE_OFFSET		(17 * __SIZEOF_POINTER__)
 /** Maximum size of sbi_scratch (4KB) */
 #define SBI_SCRATCH_SIZE			(0x1000)
+/** Size of the hot part of extra space right after struct sbi_scratch */
+#define SBI_SCRATCH_HOT_SPACE_SIZE		(8 * __SIZEOF_POINTER__)
 
 /* clang-format on */
 
@@ -87,6 +93,10 @@ struct sbi_scratch {
 	unsigned long options;
 	/** Index of the hart */
 	unsigned long hartindex;
+	/** First word of the extension bitmap of the hart */
+	unsigned long hot_extensions;
+	/** Address where traps from S/U-mode save their trap context */
+	unsigned long trap_frame;
 };
 
 /**
@@ -148,6 +158,16 @@ _Static_assert(
 		== SBI_SCRATCH_OPTIONS_OFFSET,
 	"struct sbi_scratch definition has changed, please redefine "
 	"SBI_SCRATCH_OPTIONS_OFFSET");
+_Static_assert(
+	offsetof(struct sbi_scratch, hot_extensions)
+		== SBI_SCRATCH_HOT_EXTENSIONS_OFFSET,
+	"struct sbi_scratch definition has changed, please redefine "
+	"SBI_SCRATCH_HOT_EXTENSIONS_OFFSET");
+_Static_assert(
+	offsetof(struct sbi_scratch, trap_frame)
+		== SBI_SCRATCH_TRAP_FRAME_OFFSET,
+	"struct sbi_scratch definition has changed, please redefine "
+	"SBI_SCRATCH_TRAP_FRAME_OFFSET");
 
 /** Possible options for OpenSBI library */
 enum sbi_scratch_options {
@@ -176,12 +196,60 @@ int sbi_scratch_init(struct sbi_scratch *scratch);
  */
 unsigned long sbi_scratch_alloc_offset(unsigned long size);
 
+/**
+ * Allocate from extra space in sbi_scratch with the given power of two
+ * alignment. The allocation is padded to the alignment so that it does
+ * not share an alignment granule with the next allocation.
+ *
+ * @return zero on failure and non-zero (>= SBI_SCRATCH_EXTRA_SPACE_OFFSET)
+ * on success
+ */
+unsigned long sbi_scratch_alloc_aligned_offset(unsigned long size,
+					       unsigned long align);
+
+/**
+ * Allocate from the hot part of extra space in sbi_scratch, which
+ * shares the cache line of the trap handling fields of sbi_scratch on
+ * RV64 and the one right after struct sbi_scratch on RV32. Meant for
+ * small data used on every trap or ecall. Falls back to the rest of
+ * the extra space when the hot part is full.
+ *
+ * @return zero on failure and non-zero (>= SBI_SCRATCH_EXTRA_SPACE_OFFSET)
+ * on success
+ */
+unsigned long sbi_scratch_alloc_hot_offset(unsigned long size);
+
 /** Free-up extra space in sbi_scratch */
 void sbi_scratch_free_offset(unsigned long offset);
 
 /** Amount (in bytes) of used space in in sbi_scratch */
 unsigned long sbi_scratch_used_space(void);
 
+/**
+ * Allocate from the extended per-HART area, which lives in the heap and
+ * holds CONFIG_SBI_SCRATCH_EXT_SIZE bytes for every HART. Meant for
+ * large per-HART data which would not fit in sbi_scratch. The offsets
+ * must only be used with sbi_scratch_ext_offset_ptr().
+ *
+ * @return zero on failure and non-zero on success
+ */
+unsigned long sbi_scratch_alloc_ext_offset(unsigned long size,
+					   unsigned long align);
+
+/** Amount (in bytes) of used space in the extended per-HART area */
+unsigned long sbi_scratch_ext_used_space(void);
+
+/** Allocate the extended per-HART areas from the heap */
+int sbi_scratch_ext_init(void);
+
+/** Offset in sbi_scratch of the extended per-HART area pointer */
+extern unsigned long sbi_scratch_ext_area_offset;
+
+/** Get pointer from offset in the extended per-HART area */
+#define sbi_scratch_ext_offset_ptr(scratch, offset)			\
+	(void *)(*(char **)sbi_scratch_offset_ptr((scratch),		\
+				sbi_scratch_ext_area_offset) + (offset))
+
 /** Get pointer from offset in sbi_scratch */
 #define sbi_scratch_offset_ptr(scratch, offset)	(void *)((char *)(scratch) + (offset))
 
@@ -193,6 +261,13 @@ unsigned long sbi_scratch_used_space(void);
 #define sbi_scratch_alloc_type_offset(__type)				\
 	sbi_scratch_alloc_offset(sizeof(__type))
 
+/**
+ * Allocate offset on cache lines of its own in sbi_scratch, for data
+ * written by other HARTs. Assumes cache line aligned scratch spaces.
+ */
+#define sbi_scratch_alloc_cacheline_offset(__size)			\
+	sbi_scratch_alloc_aligned_offset((__size), SBI_CACHE_LINE_SIZE)
+
 /** Read a data type from sbi_scratch at given offset */
 #define sbi_scratch_read_type(__scratch, __type, __offset)		\
 ({									\
@@ -242,6 +317,10 @@ extern struct sbi_scratch *hartindex_to_scratch_table[];
 
 /**
  * Get logical index for given HART id
+ *
+ * This is a table lookup for HART ids below SBI_HARTMASK_MAX_BITS and
+ * a binary search otherwise.
+ *
  * @param hartid physical HART id
  * @returns value between 0 to SBI_HARTMASK_MAX_BITS upon success and
  *	    SBI_HARTMASK_MAX_BITS upon failure.
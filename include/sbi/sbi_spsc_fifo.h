@@ -0,0 +1,57 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Lock-free single-producer/single-consumer bounded FIFO
+ */
+
+#ifndef __SBI_SPSC_FIFO_H__
+#define __SBI_SPSC_FIFO_H__
+
+#include <sbi/sbi_types.h>
+
+/**
+ * Bounded FIFO filled by exactly one producer and drained by exactly
+ * one consumer at a time, without any lock or atomic read-modify-write.
+ *
+ * The number of entries must be a power of two. The head and tail are
+ * free running indexes which are masked to find the slot, the head is
+ * only written by the producer and the tail only by the consumer so
+ * both are on cache lines of their own.
+ */
+struct sbi_spsc_fifo {
+	void *queue;
+	u16 entry_size;
+	u16 num_entries;
+	unsigned long head __cacheline_aligned;
+	unsigned long tail __cacheline_aligned;
+};
+
+#define SBI_SPSC_FIFO_INITIALIZER(__queue_mem, __entries, __entry_size)	\
+{	.queue = __queue_mem,						\
+	.num_entries = __entries,					\
+	.entry_size = __entry_size,					\
+	.head = 0,							\
+	.tail = 0,							\
+}
+
+#define SBI_SPSC_FIFO_DEFINE(__name, __queue_mem, __entries, __entry_size) \
+struct sbi_spsc_fifo __name =						\
+	SBI_SPSC_FIFO_INITIALIZER(__queue_mem, __entries, __entry_size)
+
+int sbi_spsc_fifo_dequeue(struct sbi_spsc_fifo *fifo, void *data);
+int sbi_spsc_fifo_enqueue(struct sbi_spsc_fifo *fifo, void *data);
+int sbi_spsc_fifo_init(struct sbi_spsc_fifo *fifo, void *queue_mem,
+		       u16 entries, u16 entry_size);
+u16 sbi_spsc_fifo_avail(struct sbi_spsc_fifo *fifo);
+
+static inline bool sbi_spsc_fifo_is_empty(struct sbi_spsc_fifo *fifo)
+{
+	return !sbi_spsc_fifo_avail(fifo);
+}
+
+static inline bool sbi_spsc_fifo_is_full(struct sbi_spsc_fifo *fifo)
+{
+	return sbi_spsc_fifo_avail(fifo) == fifo->num_entries;
+}
+
+#endif
@@ -11,6 +11,7 @@
 #include <sbi/sbi_list.h>
 #include <sbi/riscv_locks.h>
 
+struct sbi_hartmask;
 struct sbi_scratch;
 struct sbi_trap_regs;
 struct sbi_ecall_return;
@@ -68,12 +69,31 @@ int sbi_sse_set_cb_ops(uint32_t event_id, const struct sbi_sse_cb_ops *cb_ops);
  */
 int sbi_sse_inject_event(uint32_t event_id);
 
+/* Inject a local event to every hart of a mask
+ * @param event_id Event identifier (SBI_SSE_EVENT_*)
+ * @param mask Harts to inject the event to, ignored for global events
+ * @return 0 on success, error otherwise
+ *
+ * All remote harts are notified with a single IPI round and harts which
+ * still have the same injection queued are not notified again.
+ */
+int sbi_sse_inject_event_many(uint32_t event_id,
+			      const struct sbi_hartmask *mask);
+
 void sbi_sse_process_pending_events(struct sbi_trap_regs *regs);
 
 
 int sbi_sse_init(struct sbi_scratch *scratch, bool cold_boot);
 void sbi_sse_exit(struct sbi_scratch *scratch);
 
+/* Drop the events a supervisor registered on a stopped hart
+ * @param scratch Scratch space of the hart
+ *
+ * The local events of the hart and the global events whose preferred
+ * hart it is become unused again and the hart is masked.
+ */
+void sbi_sse_reset_hart(struct sbi_scratch *scratch);
+
 /* Interface called from sbi_ecall_sse.c */
 int sbi_sse_register(uint32_t event_id, unsigned long handler_entry_pc,
 		     unsigned long handler_entry_arg);
@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Shared statistics page of domains
+ */
+
+#ifndef __SBI_STATS_PAGE_H__
+#define __SBI_STATS_PAGE_H__
+
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** "OSSP" in little endian */
+#define SBI_STATS_PAGE_MAGIC		0x5053534f
+
+/* clang-format on */
+
+/**
+ * Start of the statistics page of a domain, a performance report
+ * (struct sbi_perf_report_header and its sections) follows it.
+ *
+ * Readers sample the sequence, copy what they need and retry if the
+ * sequence was odd or changed in between.
+ */
+struct sbi_stats_page_header {
+	u32 magic;
+	/** Odd while the firmware updates the page */
+	u32 sequence;
+	/** Timer ticks between two updates */
+	u64 interval;
+	/** Zero or SBI_ENOSPC if the report does not fit the page */
+	s32 error;
+	u32 reserved;
+	/** Size of the report following this header */
+	u64 report_size;
+};
+
+struct sbi_scratch;
+
+#ifdef CONFIG_SBI_STATS_PAGE
+int sbi_stats_page_init(struct sbi_scratch *scratch, bool cold_boot);
+#else
+static inline int sbi_stats_page_init(struct sbi_scratch *scratch,
+				      bool cold_boot)
+{
+	return 0;
+}
+#endif
+
+#endif
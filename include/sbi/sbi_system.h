@@ -24,6 +24,9 @@ struct sbi_system_reset_device {
 	/** Reset the system */
 	void (*system_reset)(u32 reset_type, u32 reset_reason);
 
+	/** Set if system_reset() resets all HARTs at once */
+	bool resets_all_harts;
+
 	/** List */
 	struct sbi_dlist node;
 };
@@ -10,6 +10,7 @@
 #ifndef __SBI_TIMER_H__
 #define __SBI_TIMER_H__
 
+#include <sbi/sbi_list.h>
 #include <sbi/sbi_types.h>
 
 /** Timer hardware device */
@@ -23,6 +24,9 @@ struct sbi_timer_device {
 	/** Get free-running timer value */
 	u64 (*timer_value)(void);
 
+	/** Get address of the memory mapped timer of current HART (optional) */
+	volatile u64 *(*timer_value_addr)(void);
+
 	/** Start timer event for current HART */
 	void (*timer_event_start)(u64 next_event);
 
@@ -35,6 +39,35 @@ struct sbi_timer_device {
 
 struct sbi_scratch;
 
+/** M-mode timer entry of a HART */
+struct sbi_timer_entry {
+	/** Node in the sorted list of pending entries of the HART */
+	struct sbi_dlist node;
+	/** Timer value at which the entry expires */
+	u64 deadline;
+	/** Called from the timer interrupt once the entry expired */
+	void (*callback)(struct sbi_timer_entry *entry);
+};
+
+/** Initialize a timer entry before its first use */
+static inline void sbi_timer_entry_init(struct sbi_timer_entry *entry,
+				void (*callback)(struct sbi_timer_entry *))
+{
+	SBI_INIT_LIST_HEAD(&entry->node);
+	entry->deadline = 0;
+	entry->callback = callback;
+}
+
+/** Supervisor timer state of one domain on one HART */
+struct sbi_timer_context {
+	/** Supervisor deadline (stimecmp with Sstc) */
+	u64 deadline;
+	/** Is the deadline valid */
+	bool armed;
+	/** Was the supervisor timer interrupt pending when switched out */
+	bool pending;
+};
+
 /** Generic delay loop of desired granularity */
 void sbi_timer_delay_loop(ulong units, u64 unit_freq,
 			  void (*delay_fn)(void *), void *opaque);
@@ -89,9 +122,47 @@ void sbi_timer_set_delta_upper(ulong delta_upper);
 /** Start timer event for current HART */
 void sbi_timer_event_start(u64 next_event);
 
+/** Allow or forbid the trap entry fast paths of a HART */
+void sbi_timer_fast_path_allow(struct sbi_scratch *scratch, bool allow);
+
 /** Process timer event for current HART */
 void sbi_timer_process(void);
 
+/**
+ * Queue a timer entry on the current HART
+ *
+ * The entry replaces any earlier deadline if it is already queued. The
+ * callback runs in the timer interrupt of the current HART and may
+ * queue the entry again with a later deadline.
+ *
+ * @param entry timer entry initialized with sbi_timer_entry_init()
+ * @param deadline timer value at which the entry expires
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int sbi_timer_add_entry(struct sbi_timer_entry *entry, u64 deadline);
+
+/** Remove a timer entry of the current HART if it is queued */
+void sbi_timer_del_entry(struct sbi_timer_entry *entry);
+
+/**
+ * Get the earliest pending timer event of the current HART
+ *
+ * This covers the M-mode timer entries and the supervisor deadline
+ * (stimecmp with Sstc).
+ *
+ * @return timer value of the next event or -1ULL if nothing is pending
+ */
+u64 sbi_timer_next_event(void);
+
+/**
+ * Save the supervisor timer of the current HART into @p prev and load
+ * the one of @p next. A deadline of @p next which expired in between
+ * is delivered as a pending supervisor timer interrupt.
+ */
+void sbi_timer_context_switch(struct sbi_timer_context *prev,
+			      const struct sbi_timer_context *next);
+
 /** Get current timer device */
 const struct sbi_timer_device *sbi_timer_get_device(void);
 
@@ -18,6 +18,12 @@
 
 #define SBI_TLB_FLUSH_ALL			((unsigned long)-1)
 
+/* Maximum number of descriptors of one request */
+#define SBI_TLB_DESC_MAX			32
+
+/* Maximum number of source harts of one queued request */
+#define SBI_TLB_INFO_MAX_SRC			4
+
 /* clang-format on */
 
 struct sbi_scratch;
@@ -38,8 +44,15 @@ struct sbi_tlb_info {
 	unsigned long size;
 	uint16_t asid;
 	uint16_t vmid;
-	enum sbi_tlb_type type;
-	struct sbi_hartmask smask;
+	/* One of enum sbi_tlb_type */
+	u8 type;
+	/*
+	 * HART indices of the source harts waiting for the request, kept
+	 * as a short list rather than a hartmask so that queued requests
+	 * stay small regardless of SBI_HARTMASK_MAX_BITS.
+	 */
+	u8 src_count;
+	u16 src[SBI_TLB_INFO_MAX_SRC];
 };
 
 #define SBI_TLB_INFO_INIT(__p, __start, __size, __asid, __vmid, __type, __src) \
@@ -49,13 +62,75 @@ do { \
 	(__p)->asid = (__asid); \
 	(__p)->vmid = (__vmid); \
 	(__p)->type = (__type); \
-	SBI_HARTMASK_INIT_EXCEPT(&(__p)->smask, (__src)); \
+	(__p)->src_count = 1; \
+	(__p)->src[0] = sbi_hartid_to_hartindex(__src); \
 } while (0)
 
 #define SBI_TLB_INFO_SIZE		sizeof(struct sbi_tlb_info)
 
+/** One address range of a request for a list of ranges */
+struct sbi_tlb_desc {
+	unsigned long start;
+	unsigned long size;
+	unsigned long asid;
+};
+
 int sbi_tlb_request(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo);
 
+/**
+ * Send a remote fence request for a list of address ranges
+ *
+ * The type, VMID and source hart of every range are taken from tinfo
+ * whereas start, size and ASID come from the descriptors. All ranges
+ * are sent with one IPI round and are complete when this returns.
+ */
+int sbi_tlb_request_many(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo,
+			 const struct sbi_tlb_desc *descs, u32 count);
+
+/**
+ * Perform a batch of fence requests on the calling hart only
+ *
+ * Requests for the same address space with overlapping or adjacent
+ * ranges are merged first so the batch is modified in place.
+ */
+void sbi_tlb_local_batch(struct sbi_tlb_info *batch, u32 count);
+
+/**
+ * Send a remote fence request without waiting for its completion
+ *
+ * A hart has a few completion slots so that several tokens can be in
+ * flight at once, SBI_EINVALID_STATE is returned while all of them are
+ * busy. The returned token is complete once sbi_tlb_async_completed()
+ * on the calling hart returns a value which is not below the token.
+ */
+int sbi_tlb_async_request(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo,
+			  unsigned long *token);
+
+unsigned long sbi_tlb_async_completed(void);
+
+/**
+ * Asynchronous mode of the domain running on the calling hart, which is
+ * kept in the FWFT context of the domain and switched along with it
+ */
+bool sbi_tlb_async_enabled(void);
+
+void sbi_tlb_async_enable(bool enable);
+
+#ifdef CONFIG_SBI_TLB_DEFER_SUSPENDED
+/** Do the remote fences deferred while the current hart was suspended */
+void sbi_tlb_deferred_process(struct sbi_scratch *scratch);
+#else
+static inline void sbi_tlb_deferred_process(struct sbi_scratch *scratch) { }
+#endif
+
+#ifdef CONFIG_SBI_TLB_CLUSTER_FANOUT
+/** Set the cluster of a hart used to fan out broadcast remote fences */
+void sbi_tlb_set_hart_cluster(struct sbi_scratch *scratch, u32 cluster);
+#else
+static inline void sbi_tlb_set_hart_cluster(struct sbi_scratch *scratch,
+					    u32 cluster) { }
+#endif
+
 int sbi_tlb_init(struct sbi_scratch *scratch, bool cold_boot);
 
 #endif
@@ -0,0 +1,78 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Deferred binary console output for hot paths
+ */
+
+#ifndef __SBI_TPRINTF_H__
+#define __SBI_TPRINTF_H__
+
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_types.h>
+
+/** Maximum number of arguments of sbi_tprintf() */
+#define SBI_TPRINTF_MAX_ARGS	4
+
+/** One deferred message, formatted once it is flushed */
+struct sbi_tprintf_entry {
+	const char *fmt;
+	unsigned long args[SBI_TPRINTF_MAX_ARGS];
+	u64 time;
+};
+
+#ifdef CONFIG_SBI_TPRINTF
+
+void __sbi_tprintf(const char *fmt, unsigned long a0, unsigned long a1,
+		   unsigned long a2, unsigned long a3);
+
+/** Print the deferred messages of all HARTs, the oldest first */
+void sbi_tprintf_flush(void);
+
+int sbi_tprintf_init(void);
+
+#define __SBI_TPRINTF_NARGS_(_0, _1, _2, _3, _4, __n, ...)	__n
+#define __SBI_TPRINTF_NARGS(...)					\
+	__SBI_TPRINTF_NARGS_(_0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define __SBI_TPRINTF_ARG(__a)		((unsigned long)(__a))
+#define __SBI_TPRINTF_ARGS0()		0, 0, 0, 0
+#define __SBI_TPRINTF_ARGS1(__a)	__SBI_TPRINTF_ARG(__a), 0, 0, 0
+#define __SBI_TPRINTF_ARGS2(__a, __b)					\
+	__SBI_TPRINTF_ARG(__a), __SBI_TPRINTF_ARG(__b), 0, 0
+#define __SBI_TPRINTF_ARGS3(__a, __b, __c)				\
+	__SBI_TPRINTF_ARG(__a), __SBI_TPRINTF_ARG(__b),			\
+	__SBI_TPRINTF_ARG(__c), 0
+#define __SBI_TPRINTF_ARGS4(__a, __b, __c, __d)				\
+	__SBI_TPRINTF_ARG(__a), __SBI_TPRINTF_ARG(__b),			\
+	__SBI_TPRINTF_ARG(__c), __SBI_TPRINTF_ARG(__d)
+#define __SBI_TPRINTF_ARGS_(__n)	__SBI_TPRINTF_ARGS##__n
+#define __SBI_TPRINTF_ARGS(__n)		__SBI_TPRINTF_ARGS_(__n)
+
+/**
+ * Record a message for the console without formatting it
+ *
+ * Only the format pointer, up to SBI_TPRINTF_MAX_ARGS arguments and the
+ * timer value are stored into a ring of the current HART, so the format
+ * must be a string literal and arguments must fit in an unsigned long.
+ * %s arguments must point to strings which are never freed. The ring
+ * is formatted by sbi_tprintf_flush() which the console flushes call.
+ */
+#define sbi_tprintf(__fmt, ...)						\
+do {									\
+	if (0)								\
+		sbi_printf(__fmt, ##__VA_ARGS__);			\
+	__sbi_tprintf(__fmt, __SBI_TPRINTF_ARGS(			\
+		__SBI_TPRINTF_NARGS(__VA_ARGS__))(__VA_ARGS__));	\
+} while (0)
+
+#else
+
+/* Without the rings the messages are only printed as debug prints */
+#define sbi_tprintf(__fmt, ...)		sbi_dprintf(__fmt, ##__VA_ARGS__)
+
+static inline void sbi_tprintf_flush(void) { }
+
+static inline int sbi_tprintf_init(void) { return 0; }
+
+#endif
+
+#endif
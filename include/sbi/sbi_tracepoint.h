@@ -0,0 +1,109 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Static tracepoints patched at runtime
+ */
+
+#ifndef __SBI_TRACEPOINT_H__
+#define __SBI_TRACEPOINT_H__
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** Bytes of a tracepoint name including the terminating zero */
+#define SBI_TRACEPOINT_NAME_LEN		16
+
+/** Index of SBI_EXT_OPENSBI_TRACEPOINT_CTL selecting all tracepoints */
+#define SBI_TRACEPOINT_ALL		-1UL
+
+/* clang-format on */
+
+/**
+ * One tracepoint site as emitted by sbi_tracepoint() into the
+ * .sbi_tracepoints section. The layout is shared with the assembly of
+ * sbi_tracepoint() so fields must only be added at the end.
+ */
+struct sbi_tracepoint {
+	/** Address of the patchable instruction */
+	unsigned long site;
+	const char *name;
+	unsigned long enabled;
+	unsigned long hits;
+	unsigned long last_arg;
+};
+
+/** One tracepoint as copied by SBI_EXT_OPENSBI_TRACEPOINT_READ */
+struct sbi_tracepoint_info {
+	char name[SBI_TRACEPOINT_NAME_LEN];
+	u64 site;
+	u64 enabled;
+	u64 hits;
+	u64 last_arg;
+};
+
+#ifdef CONFIG_SBI_TRACEPOINTS
+
+/**
+ * Mark a tracepoint site
+ *
+ * The site is a single 4-byte NOP until the tracepoint is enabled. It
+ * is then patched into a jal to __sbi_tracepoint_tramp which preserves
+ * all registers but t0, so a disabled site costs one NOP, a move of
+ * __arg into t1 and the loss of t0 around it. Every expansion is a
+ * tracepoint of its own, sharing __name with the other expansions of
+ * the same macro invocation (e.g. when inlined).
+ */
+#define sbi_tracepoint(__name, __arg)					\
+do {									\
+	register unsigned long __tp_arg asm("t1") =			\
+						(unsigned long)(__arg);	\
+	asm volatile(".option push\n"					\
+		     ".option norvc\n"					\
+		     ".balign 4\n"					\
+		     "1:	.4byte 0x00000013\n"			\
+		     ".option pop\n"					\
+		     ".pushsection .rodata.str1.1, \"aMS\", @progbits, 1\n"	\
+		     "2:	.asciz \"" #__name "\"\n"		\
+		     ".popsection\n"					\
+		     ".pushsection .sbi_tracepoints, \"aw\", @progbits\n"	\
+		     ".balign " RISCV_SZPTR "\n"			\
+		     RISCV_PTR " 1b, 2b, 0, 0, 0\n"			\
+		     ".popsection\n"					\
+		     : : "r"(__tp_arg) : "t0");				\
+} while (0)
+
+/** Optional hook called for every hit of an enabled tracepoint */
+typedef void (*sbi_tracepoint_probe_t)(struct sbi_tracepoint *tp,
+				       unsigned long arg);
+
+void sbi_tracepoint_set_probe(sbi_tracepoint_probe_t probe);
+
+/** Enable or disable the tracepoint at index, or all of them */
+int sbi_tracepoint_enable(unsigned long index, bool enable);
+
+int sbi_tracepoint_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			  struct sbi_ecall_return *out);
+
+#else
+
+#define sbi_tracepoint(__name, __arg)	do { } while (0)
+
+static inline int sbi_tracepoint_enable(unsigned long index, bool enable)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int sbi_tracepoint_handle(unsigned long funcid,
+					struct sbi_trap_regs *regs,
+					struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+#endif
+
+#endif
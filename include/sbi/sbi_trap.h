@@ -266,6 +266,10 @@ static inline void sbi_trap_set_context(struct sbi_scratch *scratch,
 
 struct sbi_trap_context *sbi_trap_handler(struct sbi_trap_context *tcntx);
 
+struct sbi_trap_context *sbi_trap_handler_aia(struct sbi_trap_context *tcntx);
+
+int sbi_trap_init(struct sbi_scratch *scratch, bool cold_boot);
+
 #endif
 
 #endif
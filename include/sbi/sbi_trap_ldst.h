@@ -10,9 +10,12 @@
 #ifndef __SBI_TRAP_LDST_H__
 #define __SBI_TRAP_LDST_H__
 
+#include <sbi/sbi_error.h>
 #include <sbi/sbi_types.h>
 #include <sbi/sbi_trap.h>
 
+struct sbi_scratch;
+
 union sbi_ldst_data {
 	u64 data_u64;
 	u32 data_u32;
@@ -28,6 +31,41 @@ int sbi_load_access_handler(struct sbi_trap_context *tcntx);
 
 int sbi_store_access_handler(struct sbi_trap_context *tcntx);
 
+/** Double traps taken by a HART, times are in timer ticks */
+struct sbi_double_trap_stats {
+	u64 count;
+	u64 first_time;
+	u64 last_time;
+};
+
 int sbi_double_trap_handler(struct sbi_trap_context *tcntx);
 
+/**
+ * Handle a double trap from S/VS-mode without linking the trap context.
+ * Returns false when the trap has to go through the generic path.
+ */
+bool sbi_double_trap_fast(struct sbi_trap_context *tcntx);
+
+const struct sbi_double_trap_stats *sbi_double_trap_stats(u32 hartindex);
+
+int sbi_double_trap_init(struct sbi_scratch *scratch, bool cold_boot);
+
+#ifdef CONFIG_SBI_MISALIGNED_MONITOR
+int sbi_misaligned_monitor_rate(unsigned long hartid, unsigned long *rate);
+
+int sbi_misaligned_monitor_init(struct sbi_scratch *scratch, bool cold_boot);
+#else
+static inline int sbi_misaligned_monitor_rate(unsigned long hartid,
+					      unsigned long *rate)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int sbi_misaligned_monitor_init(struct sbi_scratch *scratch,
+					      bool cold_boot)
+{
+	return 0;
+}
+#endif
+
 #endif
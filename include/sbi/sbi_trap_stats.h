@@ -0,0 +1,78 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Per-hart trap cause counters and M-mode residency accounting
+ */
+
+#ifndef __SBI_TRAP_STATS_H__
+#define __SBI_TRAP_STATS_H__
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+/** Number of exception causes counted separately */
+#define SBI_TRAP_STATS_CAUSES		32
+
+/** Number of interrupt causes counted separately */
+#define SBI_TRAP_STATS_IRQS		64
+
+/* clang-format on */
+
+struct sbi_scratch;
+
+/**
+ * Trap statistics of one HART as copied to supervisor memory by
+ * SBI_EXT_OPENSBI_TRAP_STATS. Causes beyond the arrays are counted
+ * in the last element. The cycles only cover traps which were not
+ * taken while M-mode was already handling another trap.
+ */
+struct sbi_trap_stats {
+	u64 mcycles;
+	u64 exceptions[SBI_TRAP_STATS_CAUSES];
+	u64 interrupts[SBI_TRAP_STATS_IRQS];
+};
+
+#ifdef CONFIG_SBI_TRAP_STATS
+
+static inline unsigned long sbi_trap_stats_start(void)
+{
+	return csr_read(CSR_MCYCLE);
+}
+
+void sbi_trap_stats_record(unsigned long mcause, bool nested,
+			   unsigned long start);
+
+const struct sbi_trap_stats *sbi_trap_stats_get(u32 hartindex);
+
+int sbi_trap_stats_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			  struct sbi_ecall_return *out);
+
+int sbi_trap_stats_init(struct sbi_scratch *scratch, bool cold_boot);
+
+#else
+
+static inline unsigned long sbi_trap_stats_start(void) { return 0; }
+
+static inline void sbi_trap_stats_record(unsigned long mcause, bool nested,
+					 unsigned long start) { }
+
+static inline int sbi_trap_stats_handle(unsigned long funcid,
+					struct sbi_trap_regs *regs,
+					struct sbi_ecall_return *out)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int sbi_trap_stats_init(struct sbi_scratch *scratch,
+				      bool cold_boot)
+{
+	return 0;
+}
+
+#endif
+
+#endif
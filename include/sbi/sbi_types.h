@@ -70,6 +70,13 @@ typedef uint64_t		be64_t;
 #define __noreturn		__attribute__((noreturn))
 #define __aligned(x)		__attribute__((aligned(x)))
 
+#ifdef CONFIG_SBI_CACHE_LINE_SIZE
+#define SBI_CACHE_LINE_SIZE	CONFIG_SBI_CACHE_LINE_SIZE
+#else
+#define SBI_CACHE_LINE_SIZE	64
+#endif
+#define __cacheline_aligned	__aligned(SBI_CACHE_LINE_SIZE)
+
 #ifndef __always_inline
 #define __always_inline	inline __attribute__((always_inline))
 #endif
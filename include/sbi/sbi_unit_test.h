@@ -15,6 +15,10 @@ struct sbiunit_test_case {
 	const char *name;
 	bool failed;
 	void (*test_func)(struct sbiunit_test_case *test);
+	/* Benchmark cases only: function timed once per iteration */
+	void (*bench_func)(struct sbiunit_test_case *test);
+	u32 iterations;
+	bool all_harts;
 };
 
 struct sbiunit_test_suite {
@@ -30,6 +34,25 @@ struct sbiunit_test_suite {
 		.test_func = (func)	\
 	}
 
+void sbiunit_bench_run(struct sbiunit_test_case *test);
+
+#define _SBIUNIT_BENCH_CASE(func, iters, harts)	\
+	{					\
+		.name = #func,			\
+		.failed = false,		\
+		.test_func = sbiunit_bench_run,	\
+		.bench_func = (func),		\
+		.iterations = (iters),		\
+		.all_harts = (harts)		\
+	}
+
+/* Time @func on the current HART */
+#define SBIUNIT_BENCH_CASE(func, iters)	_SBIUNIT_BENCH_CASE(func, iters, false)
+
+/* Time @func on every started HART of the domain at once */
+#define SBIUNIT_BENCH_CASE_ALL_HARTS(func, iters)	\
+	_SBIUNIT_BENCH_CASE(func, iters, true)
+
 #define SBIUNIT_END_CASE { }
 
 #define SBIUNIT_TEST_SUITE(suite_name, cases_arr)		\
@@ -67,7 +90,11 @@ struct sbiunit_test_suite {
 #define SBIUNIT_ASSERT_STREQ(test, a, b, len) SBIUNIT_ASSERT(test, !sbi_strncmp(a, b, len))
 
 void run_all_tests(void);
+
+/* Called by HARTs waiting to be started so benchmarks can use them */
+void sbiunit_hart_wait(void);
 #endif
 #else
 #define run_all_tests()
+#define sbiunit_hart_wait()
 #endif
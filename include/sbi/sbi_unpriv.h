@@ -36,6 +36,20 @@ DECLARE_UNPRIVILEGED_LOAD_FUNCTION(u64)
 DECLARE_UNPRIVILEGED_STORE_FUNCTION(u64)
 DECLARE_UNPRIVILEGED_LOAD_FUNCTION(ulong)
 
+ulong sbi_load_misaligned(ulong addr, ulong len, struct sbi_trap_info *trap);
+
+/**
+ * Copy between M-mode memory and lower privilege memory accessed with
+ * MPRV set. Up to eight aligned words are moved per MPRV window.
+ *
+ * @return number of bytes copied which is less than len only when trap
+ * describes the fault at the first byte not copied
+ */
+ulong sbi_copy_from_lower(void *dst, const void *src, ulong len,
+			  struct sbi_trap_info *trap);
+ulong sbi_copy_to_lower(void *dst, const void *src, ulong len,
+			struct sbi_trap_info *trap);
+
 ulong sbi_get_insn(ulong mepc, struct sbi_trap_info *trap);
 
 #endif
@@ -19,6 +19,31 @@ struct sbi_cpu_idle_state {
 	uint32_t wakeup_latency_us;
 };
 
+/**
+ * Make sure the device tree has room to grow by the given size
+ *
+ * The blob is only rewritten by fdt_open_into() when the free space at
+ * its end is smaller than size, so fixups may call this before every
+ * edit without moving the whole tree around each time.
+ *
+ * @param fdt: device tree blob
+ * @param size: number of bytes the caller is about to add
+ * @return zero on success and -ve on failure
+ */
+int fdt_fixup_reserve(void *fdt, int size);
+
+/**
+ * Reserve room for all fixups of a typical platform at once
+ *
+ * This routine adds up the worst case growth of fdt_cpu_fixup() and of
+ * the fixups done by fdt_fixups() so that the tree is expanded a single
+ * time before they run.
+ *
+ * @param fdt: device tree blob
+ * @return zero on success and -ve on failure
+ */
+int fdt_fixups_reserve(void *fdt);
+
 /**
  * Add CPU idle states to cpu nodes in the DT
  *
@@ -93,6 +118,18 @@ void fdt_plic_fixup(void *fdt);
  */
 int fdt_reserved_memory_fixup(void *fdt);
 
+/**
+ * Add the boot trace to the device tree
+ *
+ * This routine adds the "opensbi,boot-trace-names", "opensbi,boot-trace-cycles"
+ * and "opensbi,boot-trace-time" properties to the /chosen node when OpenSBI
+ * is built with CONFIG_SBI_BOOT_TRACE. The i-th string of the names property
+ * belongs to the i-th 64-bit cycle and timer values.
+ *
+ * @param fdt: device tree blob
+ */
+void fdt_boot_trace_fixup(void *fdt);
+
 /**
  * General device tree fix-up
  *
@@ -12,6 +12,7 @@
 
 #include <sbi/sbi_types.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_hart.h>
 
 struct fdt_match {
 	const char *compatible;
@@ -32,15 +33,53 @@ struct platform_uart_data {
 	unsigned long reg_shift;
 	unsigned long reg_io_width;
 	unsigned long reg_offset;
+	unsigned long fifo_size;
 };
 
+/**
+ * Same as fdt_getprop() but "compatible", "reg", "status" and "phandle"
+ * are found by comparing string block offsets instead of names.
+ */
+const void *fdt_getprop_cached(const void *fdt, int nodeoff,
+			       const char *name, int *lenp);
+
+/**
+ * Find the first entry of match_table which is one of the strings of a
+ * compatible property. Strings are compared by hash first and the hash
+ * of every match table entry is computed only once.
+ */
+const struct fdt_match *fdt_match_compatible(const char *prop, int len,
+					     const struct fdt_match *match_table);
+
 const struct fdt_match *fdt_match_node(const void *fdt, int nodeoff,
 				       const struct fdt_match *match_table);
 
+/**
+ * Find the first node after startoff in DT order which is compatible
+ * with any entry of match_table. The nodes are looked up in an index
+ * of all compatible strings which is built on first use.
+ */
 int fdt_find_match(const void *fdt, int startoff,
 		   const struct fdt_match *match_table,
 		   const struct fdt_match **out_match);
 
+/** Check whether fdt_find_match() can use the compatible string index */
+bool fdt_compat_index_ready(const void *fdt);
+
+/** Free the compatible string index once no more drivers are probed */
+void fdt_compat_index_free(void);
+
+/**
+ * Get the offset of the node with the given phandle, or a negative
+ * libfdt error, from a cache of all phandles which is built in heap
+ * memory on first use. Callers which run before the heap is set up
+ * must use fdt_node_offset_by_phandle() instead.
+ */
+int fdt_phandle_offset(const void *fdt, u32 phandle);
+
+/** Drop the phandle cache, it is rebuilt on the next lookup */
+void fdt_phandle_cache_free(void);
+
 int fdt_parse_phandle_with_args(const void *fdt, int nodeoff,
 				const char *prop, const char *cells_prop,
 				int index, struct fdt_phandle_args *out_args);
@@ -55,10 +94,75 @@ bool fdt_node_is_enabled(const void *fdt, int nodeoff);
 
 int fdt_parse_hart_id(const void *fdt, int cpu_offset, u32 *hartid);
 
+/** One CPU node of the FDT with a valid HART id */
+struct fdt_cpu {
+	int offset;
+	u32 hartid;
+	/* Phandle of the interrupt controller child node or 0 */
+	u32 intc_phandle;
+	bool enabled;
+	/* isa points to riscv,isa-extensions if true, else to riscv,isa */
+	bool isa_is_list;
+	int isa_len;
+	const char *isa;
+};
+
+/**
+ * Get all CPU nodes in DT order from a table which is built in heap
+ * memory by a single walk of /cpus on first use. Returns NULL if the
+ * FDT has no CPU nodes or the heap is not set up yet. The table holds
+ * node offsets and property pointers so it is rebuilt whenever the FDT
+ * moves or its structure block changes size.
+ */
+const struct fdt_cpu *fdt_cpu_table(const void *fdt, u32 *count);
+
+/** Find the CPU node of a HART id in the CPU table */
+const struct fdt_cpu *fdt_cpu_find_hartid(const void *fdt, u32 hartid);
+
+/** Get the HART id of the CPU whose interrupt controller has a phandle */
+int fdt_parse_intc_hartid(const void *fdt, u32 intc_phandle, u32 *hartid);
+
+/** Drop the CPU table, it is rebuilt on the next lookup */
+void fdt_cpu_table_free(void);
+
 int fdt_parse_max_enabled_hart_id(const void *fdt, u32 *max_hartid);
 
 int fdt_parse_timebase_frequency(const void *fdt, unsigned long *freq);
 
+int fdt_parse_tlbr_flush_limit(const void *fdt, u32 hartid,
+			       unsigned long *limit);
+
+int fdt_parse_cboz_block_size(const void *fdt, u32 hartid, u32 *size);
+
+/**
+ * Per-HART properties of the CPU DT nodes which are parsed once for all
+ * HARTs during cold boot so that warm boot and resume paths can use
+ * them without walking the FDT again.
+ */
+struct fdt_hart_desc {
+	unsigned long extensions[BITS_TO_LONGS(SBI_HART_EXT_MAX)];
+	unsigned long tlbr_flush_limit;
+	u32 cboz_block_size;
+	u32 cbom_block_size;
+#define FDT_HART_DESC_CBOZ_BLOCK_SIZE		(1U << 0)
+#define FDT_HART_DESC_TLBR_FLUSH_LIMIT		(1U << 1)
+#define FDT_HART_DESC_CBOM_BLOCK_SIZE		(1U << 2)
+	u32 flags;
+};
+
+/** Parse the CPU DT nodes of all HARTs, only the first call does work */
+int fdt_hart_desc_init(const void *fdt);
+
+/** Get the parsed description of a HART or NULL if there is none */
+const struct fdt_hart_desc *fdt_hart_desc_get(u32 hartid);
+
+/**
+ * Set the cluster of every HART from the /cpus/cpu-map node. Each child
+ * of a socket node, or of cpu-map when there are no socket nodes, is one
+ * cluster numbered in DT order.
+ */
+int fdt_cpu_map_init(const void *fdt);
+
 int fdt_parse_isa_extensions(const void *fdt, unsigned int hard_id,
 			     unsigned long *extensions);
 
@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * fdt_numa.h - Flat Device Tree NUMA helper routines
+ */
+
+#ifndef __FDT_NUMA_H__
+#define __FDT_NUMA_H__
+
+#include <sbi/sbi_types.h>
+
+#ifdef CONFIG_FDT_NUMA
+
+/**
+ * Setup NUMA node heaps from the device tree
+ *
+ * Every enabled CPU node with a numa-node-id property sets the node of
+ * its HART. Part of the first memory range of every other node is
+ * reserved for M-mode and used as the heap of that node. The node which
+ * holds the firmware keeps using the firmware heap.
+ *
+ * @param fdt device tree blob
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int fdt_numa_init(const void *fdt);
+
+#else
+
+static inline int fdt_numa_init(const void *fdt) { return 0; }
+
+#endif
+
+#endif
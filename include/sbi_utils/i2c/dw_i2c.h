@@ -15,6 +15,8 @@ int dw_i2c_init(struct i2c_adapter *, int nodeoff);
 
 struct dw_i2c_adapter {
 	unsigned long addr;
+	u32 tx_fifo_depth;
+	u32 rx_fifo_depth;
 	struct i2c_adapter adapter;
 };
 
@@ -13,6 +13,16 @@
 #include <sbi/sbi_types.h>
 #include <sbi/sbi_list.h>
 
+/** Cached value of a regmap register */
+struct regmap_cache_entry {
+	/** Register offset as passed to regmap_read() */
+	unsigned int reg;
+	/** Last value read from or written to the register */
+	unsigned int val;
+	/** Whether val holds the register value */
+	bool valid;
+};
+
 /** Representation of a regmap instance */
 struct regmap {
 	/** Uniquie ID of the regmap instance assigned by the driver */
@@ -36,6 +46,13 @@ struct regmap {
 	int (*reg_update_bits)(struct regmap *rmap, unsigned int reg,
 			       unsigned int mask, unsigned int val);
 
+	/**
+	 * Registers whose value only changes through this regmap. All
+	 * other registers are volatile and always accessed on the bus.
+	 */
+	unsigned int cache_count;
+	struct regmap_cache_entry *cache;
+
 	/** List */
 	struct sbi_dlist node;
 };
@@ -51,6 +68,23 @@ struct regmap *regmap_find(unsigned int id);
 /** Register a regmap instance */
 int regmap_add(struct regmap *rmap);
 
+/**
+ * Cache the given registers of a regmap instance
+ *
+ * Reads of a cached register are served from the cache once its value
+ * is known and writes go to the bus and the cache, so read-modify-write
+ * sequences don't read the bus. Only registers which no hardware or
+ * other agent changes may be cached.
+ *
+ * @param rmap regmap instance
+ * @param regs register offsets to cache
+ * @param count number of entries in @p regs
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int regmap_cache_init(struct regmap *rmap, const unsigned int *regs,
+		      unsigned int count);
+
 /** Un-register a regmap instance */
 void regmap_remove(struct regmap *rmap);
 
@@ -11,6 +11,9 @@
 
 #include <sbi/sbi_types.h>
 
+/** Set the TX FIFO size, zero keeps the default of 16 */
+void cadence_uart_set_fifo_size(u32 fifo_size);
+
 int cadence_uart_init(unsigned long base, u32 in_freq, u32 baudrate);
 
 #endif
@@ -12,6 +12,26 @@
 
 #include <sbi/sbi_types.h>
 
+/** Override the probed TX FIFO size, zero keeps the probed size */
+void uart8250_set_fifo_size(u32 fifo_size);
+
+/**
+ * Write the console through the TX empty interrupt of the UART
+ *
+ * The platform must have routed the interrupt of the UART to M-mode
+ * as external interrupt ext_id. S-mode must not use the UART directly
+ * afterwards since M-mode owns its interrupt enable register.
+ */
+int uart8250_enable_tx_irq(unsigned long ext_id);
+
+/**
+ * Buffer console input from the RX interrupt of the UART
+ *
+ * Same routing requirements as uart8250_enable_tx_irq(). Both may be
+ * used together with the same ext_id.
+ */
+int uart8250_enable_rx_irq(unsigned long ext_id);
+
 int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
 		  u32 reg_width, u32 reg_offset);
 
@@ -10,6 +10,7 @@
 #ifndef __TIMER_ACLINT_MTIMER_H__
 #define __TIMER_ACLINT_MTIMER_H__
 
+#include <sbi/sbi_timer.h>
 #include <sbi/sbi_types.h>
 
 #define ACLINT_MTIMER_ALIGN		0x8
@@ -38,6 +39,10 @@ struct aclint_mtimer_data {
 	/* Private details (initialized and used by ACLINT MTIMER library) */
 	struct aclint_mtimer_data *time_delta_reference;
 	unsigned long time_delta_computed;
+	long time_sync_skew;
+	unsigned long time_sync_rtt;
+	unsigned long time_drift_armed;
+	struct sbi_timer_entry time_drift_entry;
 	u64 (*time_rd)(volatile u64 *addr);
 	void (*time_wr)(bool timecmp, u64 value, volatile u64 *addr);
 };
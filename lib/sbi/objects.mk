@@ -58,9 +58,25 @@ libsbi-objs-$(CONFIG_SBI_ECALL_VENDOR) += sbi_ecall_vendor.o
 carray-sbi_ecall_exts-$(CONFIG_SBI_ECALL_DBTR) += ecall_dbtr
 libsbi-objs-$(CONFIG_SBI_ECALL_DBTR) += sbi_ecall_dbtr.o
 
+carray-sbi_ecall_exts-$(CONFIG_SBI_ECALL_OPENSBI) += ecall_opensbi
+libsbi-objs-$(CONFIG_SBI_ECALL_OPENSBI) += sbi_ecall_opensbi.o
+libsbi-objs-$(CONFIG_SBI_ECALL_PROFILE) += sbi_ecall_profile.o
+libsbi-objs-$(CONFIG_SBI_ECALL_TRACE) += sbi_ecall_trace.o
+
+carray-sbi_ecall_exts-$(CONFIG_SBI_ECALL_BATCH) += ecall_batch
+libsbi-objs-$(CONFIG_SBI_ECALL_BATCH) += sbi_ecall_batch.o
+libsbi-objs-$(CONFIG_SBI_ECALL_BATCH) += sbi_batch.o
+
 carray-sbi_ecall_exts-$(CONFIG_SBI_ECALL_SSE) += ecall_sse
 libsbi-objs-$(CONFIG_SBI_ECALL_SSE) += sbi_ecall_sse.o
 
+carray-sbi_ecall_exts-$(CONFIG_SBI_ECALL_STA) += ecall_sta
+libsbi-objs-$(CONFIG_SBI_ECALL_STA) += sbi_ecall_sta.o
+
+carray-sbi_ecall_exts-$(CONFIG_SBI_ECALL_NACL) += ecall_nacl
+libsbi-objs-$(CONFIG_SBI_ECALL_NACL) += sbi_ecall_nacl.o
+libsbi-objs-$(CONFIG_SBI_ECALL_NACL) += sbi_nacl.o
+
 libsbi-objs-y += sbi_bitmap.o
 libsbi-objs-y += sbi_bitops.o
 libsbi-objs-y += sbi_console.o
@@ -74,6 +90,8 @@ libsbi-objs-y += sbi_fwft.o
 libsbi-objs-y += sbi_hart.o
 libsbi-objs-y += sbi_heap.o
 libsbi-objs-y += sbi_math.o
+libsbi-objs-y += sbi_mpsc_fifo.o
+libsbi-objs-y += sbi_spsc_fifo.o
 libsbi-objs-y += sbi_hfence.o
 libsbi-objs-y += sbi_hsm.o
 libsbi-objs-y += sbi_illegal_insn.o
@@ -86,11 +104,24 @@ libsbi-objs-y += sbi_dbtr.o
 libsbi-objs-y += sbi_scratch.o
 libsbi-objs-y += sbi_sse.o
 libsbi-objs-y += sbi_string.o
+libsbi-objs-y += sbi_lz4.o
 libsbi-objs-y += sbi_system.o
 libsbi-objs-y += sbi_timer.o
 libsbi-objs-y += sbi_tlb.o
 libsbi-objs-y += sbi_trap.o
 libsbi-objs-y += sbi_trap_ldst.o
+libsbi-objs-$(CONFIG_SBI_TRAP_STATS) += sbi_trap_stats.o
+libsbi-objs-$(CONFIG_SBI_HEAP_STATS) += sbi_heap_stats.o
+libsbi-objs-$(CONFIG_SBI_LOCK_STAT) += sbi_lock_stat.o
+libsbi-objs-$(CONFIG_SBI_HSM_STATS) += sbi_hsm_stats.o
+libsbi-objs-$(CONFIG_SBI_DOMAIN_CHANNEL) += sbi_domain_channel.o
+libsbi-objs-$(CONFIG_SBI_BOOT_TRACE) += sbi_boot_trace.o
+libsbi-objs-$(CONFIG_SBI_PERF_REPORT) += sbi_perf_report.o
+libsbi-objs-$(CONFIG_SBI_STATS_PAGE) += sbi_stats_page.o
+libsbi-objs-$(CONFIG_SBI_TPRINTF) += sbi_tprintf.o
+libsbi-objs-$(CONFIG_SBI_TRACEPOINTS) += sbi_tracepoint.o
+libsbi-objs-$(CONFIG_SBI_TRACEPOINTS) += sbi_tracepoint_tramp.o
 libsbi-objs-y += sbi_unpriv.o
 libsbi-objs-y += sbi_expected_trap.o
 libsbi-objs-y += sbi_cppc.o
+libsbi-objs-y += sbi_cache.o
@@ -85,7 +85,25 @@ long atomic_sub_return(atomic_t *atom, long value)
 
 long atomic_cmpxchg(atomic_t *atom, long oldval, long newval)
 {
+#ifdef CONFIG_SBI_ATOMIC_ZACAS
+	/*
+	 * amocas.{w|d}.aqrl returns the old value in the register of the
+	 * compare value. It is emitted with .insn so that it does not
+	 * depend on the assembler knowing Zacas.
+	 */
+	__asm__ __volatile__(
+#if __SIZEOF_LONG__ == 4
+		"	.insn r 0x2f, 0x2, 0x17, %0, %2, %3\n"
+#elif __SIZEOF_LONG__ == 8
+		"	.insn r 0x2f, 0x3, 0x17, %0, %2, %3\n"
+#endif
+		: "+r"(oldval), "+m"(atom->counter)
+		: "r"(&atom->counter), "r"(newval)
+		: "memory");
+	return oldval;
+#else
 	return __sync_val_compare_and_swap(&atom->counter, oldval, newval);
+#endif
 }
 
 long atomic_xchg(atomic_t *atom, long newval)
@@ -94,6 +112,31 @@ long atomic_xchg(atomic_t *atom, long newval)
 	return axchg(&atom->counter, newval);
 }
 
+void atomic_wrs_wait(atomic_t *atom, long val, bool sto)
+{
+	long ret;
+
+	/* Register the reservation set which wakes up the stall below */
+#if __SIZEOF_LONG__ == 4
+	__asm__ __volatile__("	lr.w  %0, %1"
+			     : "=r"(ret)
+			     : "A"(atom->counter)
+			     : "memory");
+#elif __SIZEOF_LONG__ == 8
+	__asm__ __volatile__("	lr.d  %0, %1"
+			     : "=r"(ret)
+			     : "A"(atom->counter)
+			     : "memory");
+#endif
+	if (ret != val)
+		return;
+
+	if (sto)
+		wrs_sto();
+	else
+		wrs_nto();
+}
+
 unsigned int atomic_raw_xchg_uint(volatile unsigned int *ptr,
 				  unsigned int newval)
 {
@@ -5,8 +5,36 @@
  * Copyright (c) 2021 Christoph Müllner <cmuellner@linux.com>
  */
 
+#include <sbi/riscv_asm.h>
 #include <sbi/riscv_barrier.h>
+#include <sbi/riscv_encoding.h>
 #include <sbi/riscv_locks.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+
+/* Reader-writer lock count bits, readers are counted below the flags */
+#define RW_LOCK_WRITER		(1U << 31)
+#define RW_LOCK_WAITING		(1U << 30)
+#define RW_LOCK_READERS		(RW_LOCK_WAITING - 1)
+
+static unsigned long qspin_node_offset;
+
+#ifdef CONFIG_SBI_ATOMIC_ZACAS
+/* Compare and exchange the whole lock word with amocas.w.aqrl */
+static inline u32 spin_lock_cas(spinlock_t *lock, u32 oldval, u32 newval)
+{
+	unsigned long ret = oldval;
+
+	__asm__ __volatile__(
+		"	.insn r 0x2f, 0x2, 0x17, %0, %2, %3\n"
+		: "+r"(ret), "+m"(*lock)
+		: "r"(lock), "r"(newval)
+		: "memory");
+
+	return ret;
+}
+#endif
 
 static inline bool spin_lock_unlocked(spinlock_t lock)
 {
@@ -22,6 +50,23 @@ bool spin_lock_check(spinlock_t *lock)
 bool spin_trylock(spinlock_t *lock)
 {
 	unsigned long inc = 1u << TICKET_SHIFT;
+#ifdef CONFIG_SBI_ATOMIC_ZACAS
+	u32 l0, old;
+
+	/* A single compare and exchange instead of an LR/SC retry loop */
+	old = __atomic_load_n((u32 *)lock, __ATOMIC_RELAXED);
+	l0 = ((old >> TICKET_SHIFT) != (old & 0xffffu)) ||
+	     (spin_lock_cas(lock, old, old + inc) != old);
+#elif !defined(__riscv)
+	u32 l0, old;
+
+	/* Portable version for the host build in lib/sbi/tests/host */
+	old = __atomic_load_n((u32 *)lock, __ATOMIC_RELAXED);
+	l0 = ((old >> TICKET_SHIFT) != (old & 0xffffu)) ||
+	     !__atomic_compare_exchange_n((u32 *)lock, &old, old + inc,
+					  false, __ATOMIC_ACQUIRE,
+					  __ATOMIC_RELAXED);
+#else
 	unsigned long mask = 0xffffu << TICKET_SHIFT;
 	u32 l0, tmp1, tmp2;
 
@@ -41,16 +86,101 @@ bool spin_trylock(spinlock_t *lock)
 		: "=&r"(l0), "=&r"(tmp1), "=&r"(tmp2), "+A"(*lock)
 		: "r"(inc), "r"(mask), "I"(TICKET_SHIFT)
 		: "memory");
+#endif
+
+#ifdef CONFIG_SBI_LOCK_STAT
+	if (l0 == 0 && lock->stat)
+		lock->stat->acquired++;
+#endif
 
 	return l0 == 0;
 }
 
+#ifdef CONFIG_SBI_LOCK_STAT
+/* Must be called with the lock of the statistics held */
+static void lock_stat_update(struct sbi_lock_stat *stat,
+			     unsigned long distance, unsigned long cycles)
+{
+	stat->acquired++;
+	if (!distance)
+		return;
+	stat->contended++;
+	if (stat->max_distance < distance)
+		stat->max_distance = distance;
+	stat->spin_cycles += cycles;
+	if (stat->max_spin_cycles < cycles)
+		stat->max_spin_cycles = cycles;
+}
+
+static void spin_lock_stat(spinlock_t *lock)
+{
+	unsigned long inc = 1u << TICKET_SHIFT;
+	unsigned long start, cycles = 0;
+	u16 ticket, owner;
+	u32 l0;
+
+	__asm__ __volatile__(
+		"	amoadd.w.aqrl	%0, %2, %1\n"
+		: "=&r"(l0), "+A"(*lock)
+		: "r"(inc)
+		: "memory");
+
+	ticket = l0 >> TICKET_SHIFT;
+	owner = l0 & 0xffffu;
+	if (ticket != owner) {
+		start = csr_read(CSR_MCYCLE);
+		while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+			cpu_relax();
+		cycles = csr_read(CSR_MCYCLE) - start;
+	}
+
+	/* The statistics are protected by the lock itself */
+	lock_stat_update(lock->stat, (u16)(ticket - owner), cycles);
+}
+#endif
+
+#ifdef CONFIG_SBI_ATOMIC_ZABHA
+/* Take a ticket from the next field directly with amoadd.h.aqrl */
+static void spin_lock_zabha(spinlock_t *lock)
+{
+	unsigned long ticket, inc = 1;
+
+	__asm__ __volatile__(
+		"	.insn r 0x2f, 0x1, 0x03, %0, %2, %3\n"
+		: "=&r"(ticket), "+m"(lock->next)
+		: "r"(&lock->next), "r"(inc)
+		: "memory");
+
+	while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != (u16)ticket)
+		cpu_relax();
+}
+#endif
+
 void spin_lock(spinlock_t *lock)
 {
 	unsigned long inc = 1u << TICKET_SHIFT;
 	unsigned long mask = 0xffffu;
 	u32 l0, tmp1, tmp2;
 
+#ifdef CONFIG_SBI_LOCK_STAT
+	if (lock->stat) {
+		spin_lock_stat(lock);
+		return;
+	}
+#endif
+
+#ifdef CONFIG_SBI_ATOMIC_ZABHA
+	spin_lock_zabha(lock);
+	return;
+#endif
+
+#ifndef __riscv
+	/* Portable version for the host build in lib/sbi/tests/host */
+	l0 = __atomic_fetch_add((u32 *)lock, inc, __ATOMIC_ACQUIRE);
+	tmp1 = (l0 >> TICKET_SHIFT) & mask;
+	while ((tmp2 = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE)) != tmp1)
+		cpu_relax();
+#else
 	__asm__ __volatile__(
 		/* Atomically increment the next ticket. */
 		"	amoadd.w.aqrl	%0, %4, %3\n"
@@ -69,9 +199,134 @@ void spin_lock(spinlock_t *lock)
 		: "=&r"(l0), "=&r"(tmp1), "=&r"(tmp2), "+A"(*lock)
 		: "r"(inc), "r"(mask), "I"(TICKET_SHIFT)
 		: "memory");
+#endif
 }
 
 void spin_unlock(spinlock_t *lock)
 {
 	__smp_store_release(&lock->owner, lock->owner + 1);
 }
+
+int qspin_lock_init(void)
+{
+	qspin_node_offset = sbi_scratch_alloc_cacheline_offset(
+				sizeof(struct qspin_node) * QSPIN_NODES);
+
+	return qspin_node_offset ? 0 : SBI_ENOMEM;
+}
+
+static struct qspin_node *qspin_node_get(void)
+{
+	struct qspin_node *nodes = sbi_scratch_offset_ptr(
+				sbi_scratch_thishart_ptr(), qspin_node_offset);
+	int i;
+
+	/* Only this HART uses its nodes so no atomics are needed */
+	for (i = 0; i < QSPIN_NODES; i++) {
+		if (!nodes[i].busy) {
+			nodes[i].busy = 1;
+			return &nodes[i];
+		}
+	}
+
+	/* Nested deeper than QSPIN_NODES locks */
+	sbi_hart_hang();
+}
+
+void qspin_lock(qspinlock_t *lock)
+{
+	struct qspin_node *node = qspin_node_get(), *prev;
+#ifdef CONFIG_SBI_LOCK_STAT
+	unsigned long start = 0;
+#endif
+
+	node->next = NULL;
+	node->locked = 0;
+
+	prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+	if (prev) {
+#ifdef CONFIG_SBI_LOCK_STAT
+		start = csr_read(CSR_MCYCLE);
+#endif
+		__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+		while (!__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+			cpu_relax();
+	}
+
+	lock->owner = node;
+#ifdef CONFIG_SBI_LOCK_STAT
+	if (lock->stat)
+		lock_stat_update(lock->stat, prev ? 1 : 0,
+				 prev ? csr_read(CSR_MCYCLE) - start : 0);
+#endif
+}
+
+void qspin_unlock(qspinlock_t *lock)
+{
+	struct qspin_node *node = lock->owner, *next, *expected = node;
+
+	next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+	if (!next) {
+		/* Nobody queued behind this HART so just release the lock */
+		if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL,
+						false, __ATOMIC_RELEASE,
+						__ATOMIC_RELAXED))
+			goto done;
+
+		/* A waiter swapped the tail but did not link itself yet */
+		while (!(next = __atomic_load_n(&node->next,
+						__ATOMIC_ACQUIRE)))
+			cpu_relax();
+	}
+
+	__atomic_store_n(&next->locked, 1, __ATOMIC_RELEASE);
+done:
+	node->busy = 0;
+}
+
+void read_lock(rwlock_t *lock)
+{
+	u32 val = __atomic_load_n(&lock->count, __ATOMIC_RELAXED);
+
+	while (1) {
+		if (!(val & (RW_LOCK_WRITER | RW_LOCK_WAITING)) &&
+		    __atomic_compare_exchange_n(&lock->count, &val, val + 1,
+						true, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return;
+		cpu_relax();
+		val = __atomic_load_n(&lock->count, __ATOMIC_RELAXED);
+	}
+}
+
+void read_unlock(rwlock_t *lock)
+{
+	__atomic_fetch_sub(&lock->count, 1, __ATOMIC_RELEASE);
+}
+
+void write_lock(rwlock_t *lock)
+{
+	u32 val;
+
+	while (1) {
+		val = __atomic_load_n(&lock->count, __ATOMIC_RELAXED);
+		if (!(val & (RW_LOCK_WRITER | RW_LOCK_READERS))) {
+			/* Taking the lock also clears the waiting flag */
+			if (__atomic_compare_exchange_n(&lock->count, &val,
+							RW_LOCK_WRITER, true,
+							__ATOMIC_ACQUIRE,
+							__ATOMIC_RELAXED))
+				return;
+		} else if (!(val & RW_LOCK_WAITING)) {
+			/* Keep new readers out until this writer got in */
+			__atomic_fetch_or(&lock->count, RW_LOCK_WAITING,
+					  __ATOMIC_RELAXED);
+		}
+		cpu_relax();
+	}
+}
+
+void write_unlock(rwlock_t *lock)
+{
+	__atomic_fetch_and(&lock->count, ~RW_LOCK_WRITER, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,234 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Shared memory ring for batched SBI calls
+ */
+
+#include <sbi/riscv_barrier.h>
+#include <sbi/sbi_batch.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_tlb.h>
+#include <sbi/sbi_trap.h>
+
+struct batch_shmem {
+	unsigned long phys;
+	unsigned long num_entries;
+};
+
+static unsigned long batch_shmem_off;
+
+static struct batch_shmem *batch_thishart_shmem(void)
+{
+	if (!batch_shmem_off)
+		return NULL;
+
+	return sbi_scratch_thishart_offset_ptr(batch_shmem_off);
+}
+
+int sbi_batch_setup_shmem(const struct sbi_domain *dom, unsigned long smode,
+			  unsigned long shmem_phys_lo,
+			  unsigned long shmem_phys_hi,
+			  unsigned long num_entries)
+{
+	struct batch_shmem *shmem = batch_thishart_shmem();
+
+	if (!shmem)
+		return SBI_ERR_FAILED;
+
+	/* call is to disable shared memory */
+	if (shmem_phys_lo == SBI_BATCH_SHMEM_INVALID_ADDR &&
+	    shmem_phys_hi == SBI_BATCH_SHMEM_INVALID_ADDR) {
+		shmem->num_entries = 0;
+		shmem->phys = 0;
+		return SBI_SUCCESS;
+	}
+
+	if (shmem->num_entries)
+		return SBI_ERR_ALREADY_AVAILABLE;
+
+	if ((shmem_phys_lo & SBI_BATCH_SHMEM_ALIGN_MASK) || !num_entries ||
+	    SBI_BATCH_MAX_ENTRIES < num_entries ||
+	    (num_entries & (num_entries - 1)))
+		return SBI_ERR_INVALID_PARAM;
+
+	/* Same upper physical address restriction as the DBTR shmem */
+	if (shmem_phys_hi)
+		return SBI_EINVALID_ADDR;
+
+	if (dom && !sbi_domain_check_addr_range(dom, shmem_phys_lo,
+				SBI_BATCH_RING_SIZE(num_entries), smode,
+				SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_ERR_INVALID_ADDRESS;
+
+	shmem->phys = shmem_phys_lo;
+	shmem->num_entries = num_entries;
+
+	return SBI_SUCCESS;
+}
+
+/* Only calls which neither return to another context nor use the trap
+ * frame beyond the argument registers can be batched. */
+static bool batch_extid_allowed(unsigned long extid)
+{
+	switch (extid) {
+	case SBI_EXT_TIME:
+	case SBI_EXT_IPI:
+	case SBI_EXT_RFENCE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void batch_entry_process(struct sbi_trap_regs *regs,
+				struct sbi_batch_entry *ent)
+{
+	int ret;
+	struct sbi_trap_regs call_regs;
+	struct sbi_ecall_extension *ext;
+	struct sbi_ecall_return out = {0};
+
+	ext = sbi_ecall_find_extension(ent->extid);
+	if (!ext || !ext->handle || !batch_extid_allowed(ent->extid)) {
+		ent->error = SBI_ERR_NOT_SUPPORTED;
+		ent->value = 0;
+		return;
+	}
+
+	sbi_memcpy(&call_regs, regs, sizeof(call_regs));
+	call_regs.a0 = ent->args[0];
+	call_regs.a1 = ent->args[1];
+	call_regs.a2 = ent->args[2];
+	call_regs.a3 = ent->args[3];
+	call_regs.a4 = ent->args[4];
+	call_regs.a5 = ent->args[5];
+	call_regs.a6 = ent->funcid;
+	call_regs.a7 = ent->extid;
+
+	ret = ext->handle(ent->extid, ent->funcid, &call_regs, &out);
+	if (ret < SBI_LAST_ERR || SBI_SUCCESS < ret)
+		ret = SBI_ERR_FAILED;
+
+	ent->error = ret;
+	ent->value = out.value;
+}
+
+int sbi_batch_submit(struct sbi_trap_regs *regs, unsigned long *out_count)
+{
+	unsigned long head, tail, count = 0;
+	struct sbi_batch_ring *ring;
+	struct sbi_batch_entry ent, *slot;
+	struct batch_shmem *shmem = batch_thishart_shmem();
+
+	if (!shmem || !shmem->num_entries)
+		return SBI_ERR_NO_SHMEM;
+
+	ring = (struct sbi_batch_ring *)shmem->phys;
+
+	sbi_hart_map_saddr(shmem->phys, sizeof(*ring));
+	head = ring->head;
+	tail = ring->tail;
+	sbi_hart_unmap_saddr();
+
+	/* Pairs with the supervisor filling entries before moving tail */
+	smp_rmb();
+
+	if (shmem->num_entries < tail - head)
+		return SBI_ERR_INVALID_PARAM;
+
+	for (; head != tail; head++, count++) {
+		slot = &ring->entries[head & (shmem->num_entries - 1)];
+
+		/*
+		 * The entry is copied out so that the call itself runs
+		 * without supervisor memory being mapped.
+		 */
+		sbi_hart_map_saddr((unsigned long)slot, sizeof(*slot));
+		sbi_memcpy(&ent, slot, sizeof(ent));
+		sbi_hart_unmap_saddr();
+
+		batch_entry_process(regs, &ent);
+
+		sbi_hart_map_saddr((unsigned long)slot, sizeof(*slot));
+		slot->error = ent.error;
+		slot->value = ent.value;
+		sbi_hart_unmap_saddr();
+	}
+
+	/* Completions are visible before the entries are handed back */
+	smp_wmb();
+
+	sbi_hart_map_saddr(shmem->phys, sizeof(*ring));
+	ring->head = head;
+	sbi_hart_unmap_saddr();
+
+	*out_count = count;
+
+	return SBI_SUCCESS;
+}
+
+/*
+ * Flush a list of {start, size, asid} descriptors in S-mode memory on
+ * the target harts with a single remote fence request.
+ */
+int sbi_batch_sfence_vma_asid_list(const struct sbi_domain *dom,
+				   unsigned long smode, unsigned long hmask,
+				   unsigned long hbase,
+				   unsigned long list_phys_lo,
+				   unsigned long list_phys_hi,
+				   unsigned long count)
+{
+	struct sbi_tlb_info tinfo;
+	struct sbi_tlb_desc descs[SBI_TLB_DESC_MAX];
+	unsigned long size = count * sizeof(descs[0]);
+
+	if (!count || SBI_TLB_DESC_MAX < count ||
+	    (list_phys_lo & SBI_BATCH_SHMEM_ALIGN_MASK))
+		return SBI_ERR_INVALID_PARAM;
+
+	if (list_phys_hi)
+		return SBI_EINVALID_ADDR;
+
+	if (dom && !sbi_domain_check_addr_range(dom, list_phys_lo, size,
+						smode, SBI_DOMAIN_READ))
+		return SBI_ERR_INVALID_ADDRESS;
+
+	sbi_hart_map_saddr(list_phys_lo, size);
+	sbi_memcpy(descs, (void *)list_phys_lo, size);
+	sbi_hart_unmap_saddr();
+
+	SBI_TLB_INFO_INIT(&tinfo, 0, 0, 0, 0, SBI_TLB_SFENCE_VMA_ASID,
+			  current_hartid());
+
+	return sbi_tlb_request_many(hmask, hbase, &tinfo, descs, count);
+}
+
+void sbi_batch_reset_hart(struct sbi_scratch *scratch)
+{
+	struct batch_shmem *shmem;
+
+	if (!batch_shmem_off)
+		return;
+
+	shmem = sbi_scratch_offset_ptr(scratch, batch_shmem_off);
+	shmem->num_entries = 0;
+	shmem->phys = 0;
+}
+
+int sbi_batch_init(void)
+{
+	if (!batch_shmem_off) {
+		batch_shmem_off = sbi_scratch_alloc_offset(sizeof(struct batch_shmem));
+		if (!batch_shmem_off)
+			return SBI_ENOMEM;
+	}
+
+	return 0;
+}
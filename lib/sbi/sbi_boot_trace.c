@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Timestamps of the coldboot init stages and FDT driver probes
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_atomic.h>
+#include <sbi/sbi_boot_trace.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_timer.h>
+
+static struct sbi_boot_trace_entry boot_trace[CONFIG_SBI_BOOT_TRACE_ENTRIES];
+static atomic_t boot_trace_next = ATOMIC_INITIALIZER(0);
+
+void sbi_boot_trace(const char *name)
+{
+	struct sbi_boot_trace_entry *entry;
+	long index;
+
+	/* HARTs doing their local early init may trace concurrently */
+	index = atomic_add_return(&boot_trace_next, 1) - 1;
+	if (index >= CONFIG_SBI_BOOT_TRACE_ENTRIES)
+		return;
+
+	entry = &boot_trace[index];
+	entry->cycles = csr_read(CSR_MCYCLE);
+	entry->time = sbi_timer_value();
+	entry->name = name;
+}
+
+u32 sbi_boot_trace_count(void)
+{
+	long count = atomic_read(&boot_trace_next);
+
+	return (count < CONFIG_SBI_BOOT_TRACE_ENTRIES) ?
+		count : CONFIG_SBI_BOOT_TRACE_ENTRIES;
+}
+
+const struct sbi_boot_trace_entry *sbi_boot_trace_get(u32 index)
+{
+	if (index >= sbi_boot_trace_count() || !boot_trace[index].name)
+		return NULL;
+
+	return &boot_trace[index];
+}
+
+void sbi_boot_trace_print(void)
+{
+	const struct sbi_boot_trace_entry *entry;
+	unsigned long prev = 0;
+	u32 i;
+
+	for (i = 0; i < sbi_boot_trace_count(); i++) {
+		entry = sbi_boot_trace_get(i);
+		if (!entry)
+			continue;
+
+		sbi_printf("Boot Trace %-15s: %lu cycles (+%lu), time %lu\n",
+			   entry->name, entry->cycles,
+			   (prev) ? entry->cycles - prev : 0,
+			   (ulong)entry->time);
+		prev = entry->cycles;
+	}
+}
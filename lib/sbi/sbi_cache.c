@@ -0,0 +1,240 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Cache maintenance for non-coherent DMA
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_barrier.h>
+#include <sbi/sbi_cache.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_trap.h>
+
+static const struct sbi_cache_device *cache_dev = NULL;
+
+const struct sbi_cache_device *sbi_cache_get_device(void)
+{
+	return cache_dev;
+}
+
+void sbi_cache_set_device(const struct sbi_cache_device *dev)
+{
+	if (!dev || !dev->range_op || cache_dev)
+		return;
+
+	cache_dev = dev;
+}
+
+#ifdef CONFIG_SBI_CACHE_OPS
+
+/* Ranges copied from supervisor memory at once */
+#define CACHE_BATCH_CHUNK		16
+
+/* Line aligned range waiting to be merged with the following ones */
+struct cache_pending {
+	u32 op;
+	unsigned long start;
+	unsigned long end;
+	bool valid;
+};
+
+/* Zicbom instructions without requiring Zicbom support in the assembler */
+#define CBO_LOOP(__imm, __start, __end, __block)			\
+	for (; (__start) < (__end); (__start) += (__block))		\
+		asm volatile(".insn i 0x0f, 2, x0, %0, " #__imm		\
+			     : : "r"(__start) : "memory")
+
+static void cache_cmo_range(u32 op, unsigned long start, unsigned long end,
+			    unsigned long block)
+{
+	sbi_hart_map_saddr(start, end - start);
+	switch (op) {
+	case SBI_CACHE_OP_CLEAN:
+		CBO_LOOP(1, start, end, block);
+		break;
+	case SBI_CACHE_OP_INVAL:
+		CBO_LOOP(0, start, end, block);
+		break;
+	default:
+		CBO_LOOP(2, start, end, block);
+		break;
+	}
+	sbi_hart_unmap_saddr();
+}
+
+static int cache_pending_run(struct cache_pending *p, unsigned long block)
+{
+	int rc = 0;
+
+	if (!p->valid)
+		return 0;
+
+	if (cache_dev)
+		rc = cache_dev->range_op(p->op, p->start, p->end - p->start);
+	else
+		cache_cmo_range(p->op, p->start, p->end, block);
+	p->valid = false;
+
+	return rc;
+}
+
+/* Only ranges the domain may write can be discarded from the cache */
+static int cache_range_check(const struct sbi_domain *dom, ulong smode,
+			     const struct sbi_cache_range *r)
+{
+	unsigned long flags = SBI_DOMAIN_READ;
+
+	if (r->op > SBI_CACHE_OP_FLUSH || !r->size)
+		return SBI_EINVAL;
+	if ((unsigned long)r->addr != r->addr ||
+	    (unsigned long)r->size != r->size ||
+	    (unsigned long)(r->addr + r->size - 1) < r->addr)
+		return SBI_EINVALID_ADDR;
+
+	if (r->op != SBI_CACHE_OP_CLEAN)
+		flags |= SBI_DOMAIN_WRITE;
+	if (!sbi_domain_check_addr_range(dom, r->addr, r->size, smode, flags))
+		return SBI_EINVALID_ADDR;
+
+	return 0;
+}
+
+static void cache_batch_copy(struct sbi_cache_range *dst, unsigned long addr,
+			     unsigned long count)
+{
+	sbi_hart_map_saddr(addr, count * sizeof(*dst));
+	sbi_memcpy(dst, (void *)addr, count * sizeof(*dst));
+	sbi_hart_unmap_saddr();
+}
+
+/*
+ * A large batch of clean and flush ranges is cheaper as one flush of
+ * the whole cache. Batches with invalidations never take this path
+ * because flushing also writes back lines the caller wants discarded.
+ */
+static bool cache_batch_flush_all(const struct sbi_domain *dom, ulong smode,
+				  unsigned long addr, unsigned long count)
+{
+	struct sbi_cache_range chunk[CACHE_BATCH_CHUNK];
+	unsigned long i, j, n, total = 0;
+
+	if (!cache_dev || !cache_dev->flush_all ||
+	    !cache_dev->flush_all_threshold)
+		return false;
+
+	for (i = 0; i < count; i += n) {
+		n = MIN(count - i, CACHE_BATCH_CHUNK);
+		cache_batch_copy(chunk, addr + i * sizeof(*chunk), n);
+		for (j = 0; j < n; j++) {
+			if (chunk[j].op == SBI_CACHE_OP_INVAL ||
+			    cache_range_check(dom, smode, &chunk[j]))
+				return false;
+			total += chunk[j].size;
+		}
+	}
+
+	if (total < cache_dev->flush_all_threshold)
+		return false;
+
+	return !cache_dev->flush_all();
+}
+
+/*
+ * Apply the ranges in order. A range is merged with the previous one
+ * if both have the same operation and touch the same or adjacent cache
+ * lines, so a scatterlist of contiguous pages costs a single pass.
+ */
+static int cache_batch(unsigned long addr_lo, unsigned long addr_hi,
+		       unsigned long count, unsigned long *done)
+{
+	ulong smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+	const struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	struct sbi_cache_range chunk[CACHE_BATCH_CHUNK];
+	struct cache_pending p = { 0 };
+	unsigned long i, j, n, start, end, block, pos = 0;
+	int rc = 0, prc;
+
+	*done = 0;
+	block = sbi_hart_cbom_block_size(sbi_scratch_thishart_ptr());
+	if (!cache_dev && !block)
+		return SBI_ENOTSUPP;
+
+	if ((addr_lo & (sizeof(u64) - 1)) || count > -1UL / sizeof(*chunk))
+		return SBI_EINVALID_ADDR;
+	rc = sbi_domain_check_smode_buffer(addr_lo, addr_hi,
+					   count * sizeof(*chunk),
+					   SBI_DOMAIN_READ);
+	if (rc)
+		return rc;
+
+	if (cache_batch_flush_all(dom, smode, addr_lo, count)) {
+		*done = count;
+		return 0;
+	}
+
+	if (!block)
+		block = 1;
+
+	for (i = 0; i < count && !rc; i += n) {
+		n = MIN(count - i, CACHE_BATCH_CHUNK);
+		cache_batch_copy(chunk, addr_lo + i * sizeof(*chunk), n);
+		for (j = 0; j < n; j++) {
+			rc = cache_range_check(dom, smode, &chunk[j]);
+			if (rc)
+				break;
+
+			start = chunk[j].addr & ~(block - 1);
+			end = ROUNDUP(chunk[j].addr + chunk[j].size, block);
+			if (p.valid && p.op == chunk[j].op &&
+			    start <= p.end && p.start <= end) {
+				p.start = MIN(p.start, start);
+				p.end = MAX(p.end, end);
+				continue;
+			}
+
+			rc = cache_pending_run(&p, block);
+			if (rc)
+				break;
+			pos = i + j;
+			p.op = chunk[j].op;
+			p.start = start;
+			p.end = end;
+			p.valid = true;
+		}
+	}
+
+	/* Ranges before a bad one are still done */
+	if (!rc)
+		pos = count;
+	prc = cache_pending_run(&p, block);
+	if (!prc)
+		*done = pos;
+	else if (!rc)
+		rc = prc;
+
+	/* Order the maintenance before the caller hands buffers to DMA */
+	mb();
+
+	return rc;
+}
+
+int sbi_cache_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+		     struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_CACHE_OPS:
+		return cache_batch(regs->a0, regs->a1, regs->a2, &out->value);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+#endif
@@ -7,29 +7,121 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <sbi/riscv_barrier.h>
 #include <sbi/riscv_locks.h>
 #include <sbi/sbi_console.h>
-#include <sbi/sbi_fifo.h>
+#include <sbi/sbi_error.h>
 #include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
+#include <sbi/sbi_tprintf.h>
 
 #define CONSOLE_TBUF_MAX 256
 
 static const struct sbi_console_device *console_dev = NULL;
-static char console_tbuf[CONSOLE_TBUF_MAX];
-static u32 console_tbuf_len;
 static spinlock_t console_out_lock	       = SPIN_LOCK_INITIALIZER;
 
+struct console_ring;
+
+/**
+ * Format buffer of print(). Every HART has one of its own so messages
+ * are formatted without console_out_lock, which is only taken to write
+ * out the result. Messages longer than the buffer are written out in
+ * pieces while keeping the lock until their end.
+ */
+struct console_fmt {
+	char tbuf[CONSOLE_TBUF_MAX];
+	/** console_out_begin() was done for the current message */
+	bool out_begun;
+	struct console_ring *ring;
+};
+
+/* Used with console_out_lock held by HARTs without a buffer yet */
+static struct console_fmt console_fmt_shared;
+static unsigned long console_fmt_off;
+
 #ifdef CONFIG_CONSOLE_EARLY_BUFFER_SIZE
-#define CONSOLE_EARLY_BUFFER_SIZE	CONFIG_CONSOLE_EARLY_BUFFER_SIZE
+#define CONSOLE_EARLY_BUFFER_CONFIG	CONFIG_CONSOLE_EARLY_BUFFER_SIZE
+#else
+#define CONSOLE_EARLY_BUFFER_CONFIG	1024
+#endif
+/* The early ring needs a power of two size */
+#define __EARLY_P2(__x, __p)		(((__x) >= (__p)) ? (__p) :
+#define CONSOLE_EARLY_BUFFER_SIZE					\
+	(__EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 32768)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 16384)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 8192)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 4096)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 2048)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 1024)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 512)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 256)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 128)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 64)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 32)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 16)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 8)			\
+	 __EARLY_P2(CONSOLE_EARLY_BUFFER_CONFIG, 4) 2)))))))))))))))
+#define CONSOLE_EARLY_MASK		(CONSOLE_EARLY_BUFFER_SIZE - 1)
+
+/*
+ * Output written before a console device is set. Writers reserve their
+ * bytes by advancing console_early_head so no lock is needed, and only
+ * the latest CONSOLE_EARLY_BUFFER_SIZE bytes are kept for the replay.
+ */
+static char console_early_buffer[CONSOLE_EARLY_BUFFER_SIZE];
+static unsigned long console_early_head;
+
+#ifdef CONFIG_CONSOLE_ASYNC
+/**
+ * Output ring of a HART. The owning HART is the only producer and
+ * writes without taking a lock. Consumers hold console_out_lock and
+ * are the drain HART, or the owner when its ring is full.
+ */
+struct console_ring {
+	/** Written by the owning HART only */
+	unsigned long head;
+	/** Written by the consumers only */
+	unsigned long tail __cacheline_aligned;
+	char buf[CONFIG_CONSOLE_ASYNC_RING_SIZE] __cacheline_aligned;
+};
+
+_Static_assert(!(CONFIG_CONSOLE_ASYNC_RING_SIZE &
+		 (CONFIG_CONSOLE_ASYNC_RING_SIZE - 1)),
+	       "Console ring size must be a power of two");
+
+#define CONSOLE_RING_MASK	(CONFIG_CONSOLE_ASYNC_RING_SIZE - 1)
+
+static unsigned long console_ring_off;
+static bool console_async_stopped;
+static struct sbi_timer_entry console_drain_tick;
+
+static struct console_ring *console_ring_thishart(void)
+{
+	if (!console_ring_off || console_async_stopped)
+		return NULL;
+
+	return sbi_scratch_read_type(sbi_scratch_thishart_ptr(), void *,
+				     console_ring_off);
+}
 #else
-#define CONSOLE_EARLY_BUFFER_SIZE	256
+static inline struct console_ring *console_ring_thishart(void)
+{
+	return NULL;
+}
 #endif
-static char console_early_buffer[CONSOLE_EARLY_BUFFER_SIZE] = { 0 };
-static SBI_FIFO_DEFINE(console_early_fifo, console_early_buffer, \
-		       CONSOLE_EARLY_BUFFER_SIZE, sizeof(char));
+
+static struct console_fmt *console_fmt_thishart(void)
+{
+	if (!console_fmt_off)
+		return NULL;
+
+	return sbi_scratch_read_type(sbi_scratch_thishart_ptr(), void *,
+				     console_fmt_off);
+}
 
 bool sbi_isprintable(char c)
 {
@@ -40,21 +132,104 @@ bool sbi_isprintable(char c)
 	return false;
 }
 
+#ifdef CONFIG_CONSOLE_RX_IRQ
+_Static_assert(!(CONFIG_CONSOLE_RX_RING_SIZE &
+		 (CONFIG_CONSOLE_RX_RING_SIZE - 1)),
+	       "Console RX ring size must be a power of two");
+
+#define CONSOLE_RX_MASK		(CONFIG_CONSOLE_RX_RING_SIZE - 1)
+
+/*
+ * Characters received but not yet read. The RX interrupt handler,
+ * writers polling the device and readers of any HART serialise on
+ * console_rx_lock. Characters arriving while the ring is full are
+ * dropped so the device FIFO never stalls its interrupt.
+ */
+static char console_rx_buf[CONFIG_CONSOLE_RX_RING_SIZE];
+static unsigned long console_rx_head, console_rx_tail;
+static spinlock_t console_rx_lock = SPIN_LOCK_INITIALIZER;
+static bool console_rx_irq_on;
+
+/* Must be called with console_rx_lock held */
+static void console_rx_fill(void)
+{
+	int ch;
+
+	while ((ch = console_dev->console_getc()) >= 0) {
+		if (console_rx_head - console_rx_tail <
+		    CONFIG_CONSOLE_RX_RING_SIZE)
+			console_rx_buf[console_rx_head++ & CONSOLE_RX_MASK] = ch;
+	}
+}
+
+static unsigned long console_rx_read(char *str, unsigned long len)
+{
+	unsigned long i;
+
+	spin_lock(&console_rx_lock);
+	console_rx_fill();
+	for (i = 0; i < len && console_rx_tail != console_rx_head; i++)
+		str[i] = console_rx_buf[console_rx_tail++ & CONSOLE_RX_MASK];
+	spin_unlock(&console_rx_lock);
+
+	return i;
+}
+
+/*
+ * Long synchronous writes run with interrupts disabled so pick up
+ * input in between before the device FIFO overflows. A HART already
+ * moving input for somebody else is good enough.
+ */
+static void console_rx_poll(void)
+{
+	if (!console_rx_irq_on || !spin_trylock(&console_rx_lock))
+		return;
+
+	console_rx_fill();
+	spin_unlock(&console_rx_lock);
+}
+#else
+static inline void console_rx_poll(void) { }
+#endif
+
 int sbi_getc(void)
 {
+#ifdef CONFIG_CONSOLE_RX_IRQ
+	char ch;
+
+	if (console_rx_irq_on)
+		return console_rx_read(&ch, 1) ? (unsigned char)ch : -1;
+#endif
 	if (console_dev && console_dev->console_getc)
 		return console_dev->console_getc();
 	return -1;
 }
 
-static unsigned long nputs(const char *str, unsigned long len)
+static void console_early_puts(const char *str, unsigned long len)
+{
+	unsigned long off, chunk;
+
+	/* Only the tail of an oversized string would be kept anyway */
+	if (CONSOLE_EARLY_BUFFER_SIZE < len) {
+		str += len - CONSOLE_EARLY_BUFFER_SIZE;
+		len = CONSOLE_EARLY_BUFFER_SIZE;
+	}
+
+	off = __atomic_fetch_add(&console_early_head, len, __ATOMIC_RELAXED);
+	off &= CONSOLE_EARLY_MASK;
+	chunk = MIN(len, CONSOLE_EARLY_BUFFER_SIZE - off);
+	sbi_memcpy(&console_early_buffer[off], str, chunk);
+	sbi_memcpy(console_early_buffer, &str[chunk], len - chunk);
+}
+
+static unsigned long console_dev_nputs_sync(const char *str,
+					    unsigned long len)
 {
-	char ch;
 	unsigned long i;
 
 	if (console_dev) {
 		if (console_dev->console_puts)
-			return console_dev->console_puts(str, len);
+			len = console_dev->console_puts(str, len);
 		else if (console_dev->console_putc) {
 			for (i = 0; i < len; i++) {
 				if (str[i] == '\n')
@@ -62,14 +237,173 @@ static unsigned long nputs(const char *str, unsigned long len)
 				console_dev->console_putc(str[i]);
 			}
 		}
+		console_rx_poll();
 	} else {
-		for (i = 0; i < len; i++) {
-			ch = str[i];
-			sbi_fifo_enqueue(&console_early_fifo, &ch, true);
+		console_early_puts(str, len);
+	}
+	return len;
+}
+
+#ifdef CONFIG_CONSOLE_TX_IRQ
+_Static_assert(!(CONFIG_CONSOLE_TX_RING_SIZE &
+		 (CONFIG_CONSOLE_TX_RING_SIZE - 1)),
+	       "Console TX ring size must be a power of two");
+
+#define CONSOLE_TX_MASK		(CONFIG_CONSOLE_TX_RING_SIZE - 1)
+
+/*
+ * Characters waiting for the TX FIFO of the device. Writers and the TX
+ * interrupt handler of any HART serialise on console_tx_lock.
+ */
+static char console_tx_buf[CONFIG_CONSOLE_TX_RING_SIZE];
+static unsigned long console_tx_head, console_tx_tail;
+static spinlock_t console_tx_lock = SPIN_LOCK_INITIALIZER;
+static bool console_tx_irq_on;
+
+/* Must be called with console_tx_lock held */
+static void console_tx_fill(void)
+{
+	unsigned long len, n;
+
+	while (console_tx_head != console_tx_tail) {
+		len = CONFIG_CONSOLE_TX_RING_SIZE -
+		      (console_tx_tail & CONSOLE_TX_MASK);
+		if (len > console_tx_head - console_tx_tail)
+			len = console_tx_head - console_tx_tail;
+
+		n = console_dev->console_tx_fill(
+			&console_tx_buf[console_tx_tail & CONSOLE_TX_MASK], len);
+		console_tx_tail += n;
+		if (n < len)
+			break;
+	}
+
+	/* Only wait for the FIFO to drain if there are more characters */
+	console_dev->console_tx_irq(console_tx_head != console_tx_tail);
+}
+
+static unsigned long console_tx_write(const char *str, unsigned long len)
+{
+	unsigned long i, space;
+
+	spin_lock(&console_tx_lock);
+
+	/* A full ring makes the writer wait for the device */
+	while (!(space = CONFIG_CONSOLE_TX_RING_SIZE -
+			 (console_tx_head - console_tx_tail)))
+		console_tx_fill();
+
+	for (i = 0; i < len && i < space; i++)
+		console_tx_buf[console_tx_head++ & CONSOLE_TX_MASK] = str[i];
+	console_tx_fill();
+
+	spin_unlock(&console_tx_lock);
+
+	return i;
+}
+
+/* Write out the TX ring without waiting for interrupts */
+static void console_tx_drain(void)
+{
+	if (!console_tx_irq_on)
+		return;
+
+	spin_lock(&console_tx_lock);
+	while (console_tx_head != console_tx_tail)
+		console_tx_fill();
+	spin_unlock(&console_tx_lock);
+}
+#endif
+
+static unsigned long console_dev_nputs(const char *str, unsigned long len)
+{
+#ifdef CONFIG_CONSOLE_TX_IRQ
+	if (console_tx_irq_on)
+		return console_tx_write(str, len);
+#endif
+	return console_dev_nputs_sync(str, len);
+}
+
+#ifdef CONFIG_CONSOLE_ASYNC
+static void console_dev_nputs_all(const char *str, unsigned long len)
+{
+	unsigned long p = 0;
+
+	while (p < len)
+		p += console_dev_nputs(&str[p], len - p);
+}
+
+/* Must be called with console_out_lock held */
+static void console_ring_drain(struct console_ring *ring)
+{
+	unsigned long head, tail, len;
+
+	tail = ring->tail;
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	while (tail != head) {
+		len = CONFIG_CONSOLE_ASYNC_RING_SIZE - (tail & CONSOLE_RING_MASK);
+		if (len > head - tail)
+			len = head - tail;
+
+		console_dev_nputs_all(&ring->buf[tail & CONSOLE_RING_MASK], len);
+		tail += len;
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	}
+}
+
+/* Must be called with console_out_lock held */
+static void console_ring_drain_all(void)
+{
+	struct sbi_scratch *scratch;
+	struct console_ring *ring;
+	u32 i;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+
+		ring = sbi_scratch_read_type(scratch, void *, console_ring_off);
+		if (ring)
+			console_ring_drain(ring);
+	}
+}
+
+static unsigned long console_ring_write(struct console_ring *ring,
+					const char *str, unsigned long len)
+{
+	unsigned long head = ring->head, space, i, done = 0;
+
+	while (done < len) {
+		space = CONFIG_CONSOLE_ASYNC_RING_SIZE -
+			(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE));
+		if (!space) {
+			/* Nobody drained in time so write out our own ring */
+			spin_lock(&console_out_lock);
+			console_ring_drain(ring);
+			spin_unlock(&console_out_lock);
+			continue;
 		}
+
+		for (i = 0; i < space && done < len; i++)
+			ring->buf[head++ & CONSOLE_RING_MASK] = str[done++];
+		__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
 	}
+
 	return len;
 }
+#endif
+
+static unsigned long nputs(const char *str, unsigned long len)
+{
+#ifdef CONFIG_CONSOLE_ASYNC
+	struct console_ring *ring = console_ring_thishart();
+
+	if (ring)
+		return console_ring_write(ring, str, len);
+#endif
+	return console_dev_nputs(str, len);
+}
 
 static void nputs_all(const char *str, unsigned long len)
 {
@@ -79,6 +413,26 @@ static void nputs_all(const char *str, unsigned long len)
 		p += nputs(&str[p], len - p);
 }
 
+/*
+ * HARTs with an output ring write to it without taking the lock while
+ * the others write synchronously with console_out_lock held.
+ */
+static struct console_ring *console_out_begin(void)
+{
+	struct console_ring *ring = console_ring_thishart();
+
+	if (!ring)
+		spin_lock(&console_out_lock);
+
+	return ring;
+}
+
+static void console_out_end(struct console_ring *ring)
+{
+	if (!ring)
+		spin_unlock(&console_out_lock);
+}
+
 void sbi_putc(char ch)
 {
 	nputs_all(&ch, 1);
@@ -87,19 +441,21 @@ void sbi_putc(char ch)
 void sbi_puts(const char *str)
 {
 	unsigned long len = sbi_strlen(str);
+	struct console_ring *ring;
 
-	spin_lock(&console_out_lock);
+	ring = console_out_begin();
 	nputs_all(str, len);
-	spin_unlock(&console_out_lock);
+	console_out_end(ring);
 }
 
 unsigned long sbi_nputs(const char *str, unsigned long len)
 {
+	struct console_ring *ring;
 	unsigned long ret;
 
-	spin_lock(&console_out_lock);
+	ring = console_out_begin();
 	ret = nputs(str, len);
-	spin_unlock(&console_out_lock);
+	console_out_end(ring);
 
 	return ret;
 }
@@ -122,6 +478,10 @@ unsigned long sbi_ngets(char *str, unsigned long len)
 	int ch;
 	unsigned long i;
 
+#ifdef CONFIG_CONSOLE_RX_IRQ
+	if (console_rx_irq_on)
+		return console_rx_read(str, len);
+#endif
 	for (i = 0; i < len; i++) {
 		ch = sbi_getc();
 		if (ch < 0)
@@ -144,6 +504,16 @@ unsigned long sbi_ngets(char *str, unsigned long len)
 #define va_arg __builtin_va_arg
 typedef __builtin_va_list va_list;
 
+static void console_fmt_flush(struct console_fmt *fmt, unsigned long len)
+{
+	if (!fmt->out_begun) {
+		fmt->ring = console_out_begin();
+		fmt->out_begun = true;
+	}
+
+	nputs_all(fmt->tbuf, len);
+}
+
 static void printc(char **out, u32 *out_len, char ch, int flags)
 {
 	if (!out) {
@@ -161,8 +531,10 @@ static void printc(char **out, u32 *out_len, char ch, int flags)
 		if (out_len) {
 			--(*out_len);
 			if ((flags & USE_TBUF) && *out_len == 1) {
-				nputs_all(console_tbuf, CONSOLE_TBUF_MAX - *out_len);
-				*out = console_tbuf;
+				*out -= CONSOLE_TBUF_MAX - *out_len;
+				console_fmt_flush(container_of(*out,
+						struct console_fmt, tbuf[0]),
+						CONSOLE_TBUF_MAX - *out_len);
 				*out_len = CONSOLE_TBUF_MAX;
 			}
 		}
@@ -192,12 +564,82 @@ static int prints(char **out, u32 *out_len, const char *string, int width,
 	return pc;
 }
 
+static const char printi_dec_pairs[] =
+	"00010203040506070809101112131415161718192021222324"
+	"25262728293031323334353637383940414243444546474849"
+	"50515253545556575859606162636465666768697071727374"
+	"75767778798081828384858687888990919293949596979899";
+
+/*
+ * Write all digits of v in front of s two at a time. Divisions by a
+ * constant of native width are turned into reciprocal multiplications
+ * by the compiler.
+ */
+static char *printi_dec_ulong(char *s, unsigned long v)
+{
+	unsigned long r;
+
+	while (v >= 100) {
+		r = (v % 100) * 2;
+		v /= 100;
+		*--s = printi_dec_pairs[r + 1];
+		*--s = printi_dec_pairs[r];
+	}
+	if (v >= 10) {
+		*--s = printi_dec_pairs[v * 2 + 1];
+		*--s = printi_dec_pairs[v * 2];
+	} else {
+		*--s = v + '0';
+	}
+
+	return s;
+}
+
+static char *printi_dec(char *s, unsigned long long u)
+{
+	unsigned long long q;
+	unsigned long low;
+	char *end;
+
+	/*
+	 * Values wider than unsigned long (only on RV32) take one 64-bit
+	 * division per nine digits instead of one per digit.
+	 */
+	while (u > (unsigned long)-1UL) {
+		q = u / 1000000000U;
+		low = u - q * 1000000000U;
+		u = q;
+		end = s - 9;
+		s = printi_dec_ulong(s, low);
+		while (s > end)
+			*--s = '0';
+	}
+
+	return printi_dec_ulong(s, u);
+}
+
+/* Write all digits of u in front of s for a power of two base */
+static char *printi_pow2(char *s, unsigned long long u, int shift,
+			 char letbase)
+{
+	unsigned int t, mask = (1U << shift) - 1;
+
+	do {
+		t = u & mask;
+		u >>= shift;
+		*--s = (t < 10) ? t + '0' : t - 10 + letbase;
+	} while (u);
+
+	return s;
+}
+
 static int printi(char **out, u32 *out_len, long long i,
 		  int width, int flags, int type)
 {
 	int pc = 0;
 	char *s, sign = 0, letbase, print_buf[PRINT_BUF_LEN];
-	unsigned long long u, b, t;
+	unsigned long long u;
+	int b;
 
 	b = 10;
 	letbase = 'a';
@@ -223,17 +665,12 @@ static int printi(char **out, u32 *out_len, long long i,
 	s  = print_buf + PRINT_BUF_LEN - 1;
 	*s = '\0';
 
-	if (!u) {
-		*--s = '0';
-	} else {
-		while (u) {
-			t = u % b;
-			u = u / b;
-			if (t >= 10)
-				t += letbase - '0' - 10;
-			*--s = t + '0';
-		}
-	}
+	if (b == 16)
+		s = printi_pow2(s, u, 4, letbase);
+	else if (b == 8)
+		s = printi_pow2(s, u, 3, letbase);
+	else
+		s = printi_dec(s, u);
 
 	if (flags & PAD_ZERO) {
 		if (sign) {
@@ -267,23 +704,21 @@ static int printi(char **out, u32 *out_len, long long i,
 	return pc + prints(out, out_len, s, width, flags);
 }
 
-static int print(char **out, u32 *out_len, const char *format, va_list args)
+/* Output goes to the console through fmt if it is not NULL */
+static int print(char **out, u32 *out_len, struct console_fmt *fmt,
+		 const char *format, va_list args)
 {
 	bool flags_done;
 	int width, flags, pc = 0;
 	char type, scr[2], *tout;
-	bool use_tbuf = (!out) ? true : false;
+	bool use_tbuf = (fmt) ? true : false;
+	u32 tbuf_len;
 
-	/*
-	 * The console_tbuf is protected by console_out_lock and
-	 * print() is always called with console_out_lock held
-	 * when out == NULL.
-	 */
 	if (use_tbuf) {
-		console_tbuf_len = CONSOLE_TBUF_MAX;
-		tout = console_tbuf;
+		tbuf_len = CONSOLE_TBUF_MAX;
+		tout = fmt->tbuf;
 		out = &tout;
-		out_len = &console_tbuf_len;
+		out_len = &tbuf_len;
 	}
 
 	/* handle special case: *out_len == 1*/
@@ -400,8 +835,8 @@ literal:
 		}
 	}
 
-	if (use_tbuf && console_tbuf_len < CONSOLE_TBUF_MAX)
-		nputs_all(console_tbuf, CONSOLE_TBUF_MAX - console_tbuf_len);
+	if (use_tbuf && tbuf_len < CONSOLE_TBUF_MAX)
+		console_fmt_flush(fmt, CONSOLE_TBUF_MAX - tbuf_len);
 
 	return pc;
 }
@@ -415,7 +850,7 @@ int sbi_sprintf(char *out, const char *format, ...)
 		sbi_panic("sbi_sprintf called with NULL output string\n");
 
 	va_start(args, format);
-	retval = print(&out, NULL, format, args);
+	retval = print(&out, NULL, NULL, format, args);
 	va_end(args);
 
 	return retval;
@@ -431,22 +866,51 @@ int sbi_snprintf(char *out, u32 out_sz, const char *format, ...)
 			  "output size is not zero\n");
 
 	va_start(args, format);
-	retval = print(&out, &out_sz, format, args);
+	retval = print(&out, &out_sz, NULL, format, args);
 	va_end(args);
 
 	return retval;
 }
 
+/*
+ * Format into the buffer of this HART and write the result out, which
+ * is the only part done under console_out_lock unless the caller holds
+ * it already.
+ */
+static int console_print(bool locked, const char *format, va_list args)
+{
+	struct console_fmt *fmt = console_fmt_thishart();
+	struct console_ring *ring = NULL;
+	int retval;
+
+	if (!fmt) {
+		/* The shared buffer is only used with the lock held */
+		if (!locked)
+			ring = console_out_begin();
+		fmt = &console_fmt_shared;
+		fmt->ring = ring;
+		fmt->out_begun = true;
+	} else {
+		fmt->out_begun = locked;
+	}
+
+	retval = print(NULL, NULL, fmt, format, args);
+
+	if (fmt->out_begun && !locked)
+		console_out_end(fmt->ring);
+	fmt->out_begun = false;
+
+	return retval;
+}
+
 int sbi_printf(const char *format, ...)
 {
 	va_list args;
 	int retval;
 
-	spin_lock(&console_out_lock);
 	va_start(args, format);
-	retval = print(NULL, NULL, format, args);
+	retval = console_print(false, format, args);
 	va_end(args);
-	spin_unlock(&console_out_lock);
 
 	return retval;
 }
@@ -458,11 +922,8 @@ int sbi_dprintf(const char *format, ...)
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 
 	va_start(args, format);
-	if (scratch->options & SBI_SCRATCH_DEBUG_PRINTS) {
-		spin_lock(&console_out_lock);
-		retval = print(NULL, NULL, format, args);
-		spin_unlock(&console_out_lock);
-	}
+	if (scratch->options & SBI_SCRATCH_DEBUG_PRINTS)
+		retval = console_print(false, format, args);
 	va_end(args);
 
 	return retval;
@@ -472,9 +933,22 @@ void sbi_panic(const char *format, ...)
 {
 	va_list args;
 
+#ifdef CONFIG_CONSOLE_ASYNC
+	/* Everything buffered so far goes out before the panic message */
+	console_async_stopped = true;
+	smp_mb();
+#endif
 	spin_lock(&console_out_lock);
+#ifdef CONFIG_CONSOLE_ASYNC
+	if (console_ring_off)
+		console_ring_drain_all();
+#endif
+#ifdef CONFIG_CONSOLE_TX_IRQ
+	console_tx_drain();
+	console_tx_irq_on = false;
+#endif
 	va_start(args, format);
-	print(NULL, NULL, format, args);
+	console_print(true, format, args);
 	va_end(args);
 	spin_unlock(&console_out_lock);
 
@@ -486,21 +960,187 @@ const struct sbi_console_device *sbi_console_get_device(void)
 	return console_dev;
 }
 
+/*
+ * Replay the early output once the first console device is set. Only
+ * the boot HART runs this early so there are no concurrent writers.
+ */
+static void console_early_replay(void)
+{
+	unsigned long head, len, off, chunk;
+
+	head = __atomic_load_n(&console_early_head, __ATOMIC_ACQUIRE);
+	len = MIN(head, CONSOLE_EARLY_BUFFER_SIZE);
+	off = (head - len) & CONSOLE_EARLY_MASK;
+	chunk = MIN(len, CONSOLE_EARLY_BUFFER_SIZE - off);
+
+	nputs_all(&console_early_buffer[off], chunk);
+	if (len - chunk)
+		nputs_all(console_early_buffer, len - chunk);
+}
+
 void sbi_console_set_device(const struct sbi_console_device *dev)
 {
-	char ch;
-	bool flush_early_fifo = false;
+	bool replay_early = false;
 
 	if (!dev)
 		return;
 
 	if (!console_dev)
-		flush_early_fifo = true;
+		replay_early = true;
 
 	console_dev = dev;
 
-	if (flush_early_fifo) {
-		while (!sbi_fifo_dequeue(&console_early_fifo, &ch))
-			sbi_putc(ch);
+	if (replay_early)
+		console_early_replay();
+}
+
+void sbi_console_flush(void)
+{
+	sbi_tprintf_flush();
+
+#ifdef CONFIG_CONSOLE_ASYNC
+	if (console_ring_off) {
+		spin_lock(&console_out_lock);
+		console_ring_drain_all();
+		spin_unlock(&console_out_lock);
 	}
+#endif
+#ifdef CONFIG_CONSOLE_TX_IRQ
+	console_tx_drain();
+#endif
+}
+
+int sbi_console_tx_irq_enable(void)
+{
+#ifdef CONFIG_CONSOLE_TX_IRQ
+	if (!console_dev || !console_dev->console_tx_fill ||
+	    !console_dev->console_tx_irq)
+		return SBI_ENOTSUPP;
+
+	console_tx_irq_on = true;
+
+	return 0;
+#else
+	return SBI_ENOTSUPP;
+#endif
+}
+
+void sbi_console_tx_process(void)
+{
+#ifdef CONFIG_CONSOLE_TX_IRQ
+	if (!console_tx_irq_on)
+		return;
+
+	spin_lock(&console_tx_lock);
+	console_tx_fill();
+	spin_unlock(&console_tx_lock);
+#endif
+}
+
+int sbi_console_rx_irq_enable(void)
+{
+#ifdef CONFIG_CONSOLE_RX_IRQ
+	if (!console_dev || !console_dev->console_getc ||
+	    !console_dev->console_rx_irq)
+		return SBI_ENOTSUPP;
+
+	console_rx_irq_on = true;
+	console_dev->console_rx_irq(true);
+
+	return 0;
+#else
+	return SBI_ENOTSUPP;
+#endif
+}
+
+void sbi_console_rx_process(void)
+{
+#ifdef CONFIG_CONSOLE_RX_IRQ
+	if (!console_rx_irq_on)
+		return;
+
+	spin_lock(&console_rx_lock);
+	console_rx_fill();
+	spin_unlock(&console_rx_lock);
+#endif
+}
+
+#ifdef CONFIG_CONSOLE_ASYNC
+static void console_drain_arm(void)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+	u64 period;
+
+	if (!tdev)
+		return;
+
+	period = (u64)tdev->timer_freq * CONFIG_CONSOLE_ASYNC_PERIOD_US;
+	sbi_timer_add_entry(&console_drain_tick,
+			    sbi_timer_value() + period / 1000000);
+}
+
+static void console_drain_tick_fn(struct sbi_timer_entry *entry)
+{
+	sbi_console_flush();
+	console_drain_arm();
+}
+#endif
+
+int sbi_console_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	struct console_fmt *fmt;
+#ifdef CONFIG_CONSOLE_ASYNC
+	struct console_ring *ring;
+#endif
+
+	if (cold_boot) {
+		spin_lock_set_name(&console_out_lock, "console_out");
+#ifdef CONFIG_CONSOLE_TX_IRQ
+		spin_lock_set_name(&console_tx_lock, "console_tx");
+#endif
+#ifdef CONFIG_CONSOLE_RX_IRQ
+		spin_lock_set_name(&console_rx_lock, "console_rx");
+#endif
+	}
+
+	/* Allocated before the ring, which is used without the lock */
+	if (cold_boot) {
+		console_fmt_off = sbi_scratch_alloc_type_offset(void *);
+		if (!console_fmt_off)
+			return SBI_ENOMEM;
+	}
+
+	fmt = sbi_scratch_read_type(scratch, void *, console_fmt_off);
+	if (!fmt) {
+		fmt = sbi_zalloc(sizeof(*fmt));
+		if (!fmt)
+			return SBI_ENOMEM;
+		sbi_scratch_write_type(scratch, void *, console_fmt_off, fmt);
+	}
+
+#ifdef CONFIG_CONSOLE_ASYNC
+	if (cold_boot) {
+		console_ring_off = sbi_scratch_alloc_type_offset(void *);
+		if (!console_ring_off)
+			return SBI_ENOMEM;
+	}
+
+	ring = sbi_scratch_read_type(scratch, void *, console_ring_off);
+	if (!ring) {
+		ring = sbi_aligned_alloc(SBI_CACHE_LINE_SIZE, sizeof(*ring));
+		if (!ring)
+			return SBI_ENOMEM;
+		sbi_memset(ring, 0, sizeof(*ring));
+		sbi_scratch_write_type(scratch, void *, console_ring_off, ring);
+	}
+
+	/* The cold boot HART drains the rings of all HARTs */
+	if (cold_boot) {
+		sbi_timer_entry_init(&console_drain_tick,
+				     console_drain_tick_fn);
+		console_drain_arm();
+	}
+#endif
+
+	return 0;
 }
@@ -5,8 +5,16 @@
  *
  */
 
-#include <sbi/sbi_error.h>
+#include <sbi/riscv_asm.h>
 #include <sbi/sbi_cppc.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
+#include <sbi/sbi_trap.h>
 
 static const struct sbi_cppc_device *cppc_dev = NULL;
 
@@ -108,3 +116,182 @@ int sbi_cppc_write(unsigned long reg, uint64_t val)
 
 	return cppc_dev->cppc_write(reg, val);
 }
+
+#ifdef CONFIG_SBI_CPPC_FASTCHAN
+
+/* Per-HART state of the CPPC fast channel */
+struct cppc_fastchan {
+	/* Address of the shared memory or 0 if the firmware doesn't poll */
+	unsigned long addr;
+	u32 ack;
+	u64 desired_perf;
+	u64 min_perf;
+	u64 max_perf;
+	struct sbi_timer_entry entry;
+};
+
+static unsigned long cppc_fastchan_off;
+
+static u64 cppc_fastchan_period(void)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+
+	if (!tdev)
+		return 0;
+
+	return (u64)tdev->timer_freq * CONFIG_SBI_CPPC_FASTCHAN_POLL_US /
+	       1000000;
+}
+
+static void cppc_fastchan_write(unsigned long reg, u64 *cur, u64 val)
+{
+	/* Only requests which changed reach the device */
+	if (*cur == val)
+		return;
+
+	*cur = val;
+	sbi_cppc_write(reg, val);
+}
+
+/*
+ * Apply the requests of the fast channel if the supervisor incremented
+ * seq. A request updated while it is read here increments seq again so
+ * its final value is applied by the next poll.
+ */
+static void cppc_fastchan_poll(struct sbi_timer_entry *entry)
+{
+	struct cppc_fastchan *fc =
+		container_of(entry, struct cppc_fastchan, entry);
+	struct sbi_cppc_fastchan *shm = (void *)fc->addr;
+	u64 desired, min, max;
+	u32 seq;
+
+	if (!fc->addr)
+		return;
+
+	sbi_hart_map_saddr(fc->addr, SBI_CPPC_FASTCHAN_SIZE);
+	seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+	if (seq != fc->ack) {
+		desired = shm->desired_perf;
+		min = shm->min_perf;
+		max = shm->max_perf;
+		sbi_hart_unmap_saddr();
+
+		cppc_fastchan_write(SBI_CPPC_MIN_PERF, &fc->min_perf, min);
+		cppc_fastchan_write(SBI_CPPC_MAX_PERF, &fc->max_perf, max);
+		cppc_fastchan_write(SBI_CPPC_DESIRED_PERF, &fc->desired_perf,
+				    desired);
+		fc->ack = seq;
+
+		sbi_hart_map_saddr(fc->addr, SBI_CPPC_FASTCHAN_SIZE);
+		__atomic_store_n(&shm->ack, seq, __ATOMIC_RELEASE);
+	}
+	sbi_hart_unmap_saddr();
+
+	sbi_timer_add_entry(entry, entry->deadline + cppc_fastchan_period());
+}
+
+static int cppc_fastchan_set_shmem(unsigned long phys_lo,
+				   unsigned long phys_hi, unsigned long flags)
+{
+	struct cppc_fastchan *fc =
+		sbi_scratch_thishart_offset_ptr(cppc_fastchan_off);
+	bool disable = phys_lo == SBI_CPPC_FASTCHAN_INVALID_ADDR &&
+		       phys_hi == SBI_CPPC_FASTCHAN_INVALID_ADDR;
+	u64 period;
+
+	if (!cppc_dev || !cppc_fastchan_off)
+		return SBI_ENOTSUPP;
+	if (flags)
+		return SBI_EINVAL;
+
+	sbi_timer_del_entry(&fc->entry);
+	fc->addr = 0;
+	if (cppc_dev->cppc_fastchan_setup)
+		cppc_dev->cppc_fastchan_setup(SBI_CPPC_FASTCHAN_INVALID_ADDR);
+	if (disable)
+		return 0;
+
+	if (phys_lo & (SBI_CPPC_FASTCHAN_SIZE - 1))
+		return SBI_EINVAL;
+
+	/* M-mode can't access memory above XLEN bits of address */
+	if (phys_hi)
+		return SBI_EINVALID_ADDR;
+
+	if (!sbi_domain_check_addr_range(sbi_domain_thishart_ptr(), phys_lo,
+					 SBI_CPPC_FASTCHAN_SIZE, PRV_S,
+					 SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_EINVALID_ADDR;
+
+	sbi_hart_map_saddr(phys_lo, SBI_CPPC_FASTCHAN_SIZE);
+	sbi_memset((void *)phys_lo, 0, SBI_CPPC_FASTCHAN_SIZE);
+	sbi_hart_unmap_saddr();
+
+	/* A device which reads the channel itself needs no polling */
+	if (cppc_dev->cppc_fastchan_setup &&
+	    !cppc_dev->cppc_fastchan_setup(phys_lo))
+		return 0;
+
+	period = cppc_fastchan_period();
+	if (!period || !cppc_dev->cppc_write)
+		return SBI_ENOTSUPP;
+
+	fc->ack = 0;
+	fc->desired_perf = 0;
+	fc->min_perf = 0;
+	fc->max_perf = 0;
+	fc->addr = phys_lo;
+	sbi_timer_entry_init(&fc->entry, cppc_fastchan_poll);
+
+	return sbi_timer_add_entry(&fc->entry, sbi_timer_value() + period);
+}
+
+int sbi_cppc_fastchan_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			     struct sbi_ecall_return *out)
+{
+	if (funcid != SBI_EXT_OPENSBI_CPPC_FASTCHAN)
+		return SBI_ENOTSUPP;
+
+	return cppc_fastchan_set_shmem(regs->a0, regs->a1, regs->a2);
+}
+
+/*
+ * The timer queue of a stopped hart is reinitialized when it starts
+ * again so only the entry itself is reset here.
+ */
+void sbi_cppc_fastchan_reset_hart(struct sbi_scratch *scratch)
+{
+	struct cppc_fastchan *fc;
+
+	if (!cppc_fastchan_off)
+		return;
+
+	fc = sbi_scratch_offset_ptr(scratch, cppc_fastchan_off);
+	fc->addr = 0;
+	sbi_timer_entry_init(&fc->entry, cppc_fastchan_poll);
+}
+
+int sbi_cppc_fastchan_init(void)
+{
+	struct sbi_scratch *rscratch;
+	struct cppc_fastchan *fc;
+	u32 i;
+
+	cppc_fastchan_off = sbi_scratch_alloc_type_offset(struct cppc_fastchan);
+	if (!cppc_fastchan_off)
+		return SBI_ENOMEM;
+
+	/* Timer entries can be removed before they were ever queued */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+		fc = sbi_scratch_offset_ptr(rscratch, cppc_fastchan_off);
+		sbi_timer_entry_init(&fc->entry, cppc_fastchan_poll);
+	}
+
+	return 0;
+}
+
+#endif
@@ -16,6 +16,7 @@
 #include <sbi/sbi_trap.h>
 #include <sbi/sbi_dbtr.h>
 #include <sbi/sbi_heap.h>
+#include <sbi/sbi_string.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/riscv_asm.h>
 
@@ -85,30 +86,50 @@ static void sbi_trigger_init(struct sbi_dbtr_trigger *trig,
 	trig->index = idx;
 }
 
+/* Mask of all trigger indices of a HART */
+static inline unsigned long dbtr_all_trigs(
+	struct sbi_dbtr_hart_triggers_state *hs)
+{
+	return (hs->total_trigs < BITS_PER_LONG) ?
+		(1UL << hs->total_trigs) - 1 : -1UL;
+}
+
+/*
+ * Map the first @count entries of the shared memory for M-mode access
+ * with a single window instead of one window per entry.
+ * Must call with hs which is not disabled.
+ */
+static struct sbi_dbtr_shmem_entry *dbtr_shmem_map(
+	struct sbi_dbtr_hart_triggers_state *hs, unsigned long count)
+{
+	struct sbi_dbtr_shmem_entry *entries = hart_shmem_base(hs);
+
+	sbi_hart_map_saddr((unsigned long)entries, count * sizeof(*entries));
+	return entries;
+}
+
+/*
+ * The lowest free index is taken so that triggers installed together
+ * are programmed in index order.
+ */
 static inline struct sbi_dbtr_trigger *sbi_alloc_trigger(void)
 {
 	int i;
-	struct sbi_dbtr_trigger *f_trig = NULL;
+	struct sbi_dbtr_trigger *f_trig;
 	struct sbi_dbtr_hart_triggers_state *hart_state;
 
 	hart_state = dbtr_thishart_state_ptr();
 	if (!hart_state)
 		return NULL;
 
-	if (hart_state->available_trigs <= 0)
+	if (!hart_state->free_trigs)
 		return NULL;
 
-	for (i = 0; i < hart_state->total_trigs; i++) {
-		f_trig = INDEX_TO_TRIGGER(i);
-		if (f_trig->state & RV_DBTR_BIT_MASK(TS, MAPPED))
-			continue;
-		hart_state->available_trigs--;
-		break;
-	}
-
-	if (i == hart_state->total_trigs)
-		return NULL;
+	i = sbi_ffs(hart_state->free_trigs);
+	__clear_bit(i, &hart_state->free_trigs);
+	hart_state->available_trigs--;
 
+	f_trig = INDEX_TO_TRIGGER(i);
 	__set_bit(RV_DBTR_BIT(TS, MAPPED), &f_trig->state);
 
 	return f_trig;
@@ -130,6 +151,7 @@ static inline void sbi_free_trigger(struct sbi_dbtr_trigger *trig)
 	trig->tdata2 = 0;
 	trig->tdata3 = 0;
 
+	__set_bit(trig->index, &hart_state->free_trigs);
 	hart_state->available_trigs++;
 }
 
@@ -214,6 +236,7 @@ int sbi_dbtr_init(struct sbi_scratch *scratch, bool coldboot)
 
  _probed:
 	hart_state->available_trigs = hart_state->total_trigs;
+	hart_state->free_trigs = dbtr_all_trigs(hart_state);
 
 	return SBI_SUCCESS;
 }
@@ -521,30 +544,31 @@ int sbi_dbtr_read_trig(unsigned long smode,
 	if (sbi_dbtr_shmem_disabled(hs))
 		return SBI_ERR_NO_SHMEM;
 
-	shmem_base = hart_shmem_base(hs);
+	if (!trig_count)
+		return SBI_SUCCESS;
+
+	shmem_base = dbtr_shmem_map(hs, trig_count);
 
 	for_each_trig_entry(shmem_base, trig_count, typeof(*entry), entry) {
-		sbi_hart_map_saddr((unsigned long)entry, sizeof(*entry));
 		xmit = &entry->data;
 		trig = INDEX_TO_TRIGGER((_idx + trig_idx_base));
 		xmit->tstate = cpu_to_lle(trig->state);
 		xmit->tdata1 = cpu_to_lle(trig->tdata1);
 		xmit->tdata2 = cpu_to_lle(trig->tdata2);
 		xmit->tdata3 = cpu_to_lle(trig->tdata3);
-		sbi_hart_unmap_saddr();
 	}
 
+	sbi_hart_unmap_saddr();
+
 	return SBI_SUCCESS;
 }
 
 int sbi_dbtr_install_trig(unsigned long smode,
 			  unsigned long trig_count, unsigned long *out)
 {
-	void *shmem_base = NULL;
-	struct sbi_dbtr_shmem_entry *entry;
-	struct sbi_dbtr_data_msg *recv;
-	struct sbi_dbtr_id_msg *xmit;
-	unsigned long ctrl;
+	struct sbi_dbtr_data_msg recv[RV_MAX_TRIGGERS];
+	struct sbi_dbtr_shmem_entry *entries;
+	unsigned long ctrl, i;
 	struct sbi_dbtr_trigger *trig;
 	struct sbi_dbtr_hart_triggers_state *hs = NULL;
 
@@ -555,52 +579,47 @@ int sbi_dbtr_install_trig(unsigned long smode,
 	if (sbi_dbtr_shmem_disabled(hs))
 		return SBI_ERR_NO_SHMEM;
 
-	shmem_base = hart_shmem_base(hs);
+	if (hs->available_trigs < trig_count) {
+		*out = hs->available_trigs;
+		return SBI_ERR_FAILED;
+	}
 
-	/* Check requested triggers configuration */
-	for_each_trig_entry(shmem_base, trig_count, typeof(*entry), entry) {
-		sbi_hart_map_saddr((unsigned long)entry, sizeof(*entry));
-		recv = (struct sbi_dbtr_data_msg *)(&entry->data);
-		ctrl = recv->tdata1;
+	if (!trig_count)
+		return SBI_SUCCESS;
 
-		if (!dbtr_trigger_supported(TDATA1_GET_TYPE(ctrl))) {
-			*out = _idx;
-			sbi_hart_unmap_saddr();
-			return SBI_ERR_FAILED;
-		}
+	entries = dbtr_shmem_map(hs, trig_count);
 
-		if (!dbtr_trigger_valid(TDATA1_GET_TYPE(ctrl), ctrl)) {
-			*out = _idx;
+	/*
+	 * Copy the requests once so that the checked configuration is
+	 * the one installed even if the supervisor changes it meanwhile.
+	 */
+	for (i = 0; i < trig_count; i++) {
+		sbi_memcpy(&recv[i], &entries[i].data, sizeof(recv[i]));
+		ctrl = lle_to_cpu(recv[i].tdata1);
+
+		if (!dbtr_trigger_supported(TDATA1_GET_TYPE(ctrl)) ||
+		    !dbtr_trigger_valid(TDATA1_GET_TYPE(ctrl), ctrl)) {
+			*out = i;
 			sbi_hart_unmap_saddr();
 			return SBI_ERR_FAILED;
 		}
-		sbi_hart_unmap_saddr();
-	}
-
-	if (hs->available_trigs < trig_count) {
-		*out = hs->available_trigs;
-		return SBI_ERR_FAILED;
 	}
 
 	/* Install triggers */
-	for_each_trig_entry(shmem_base, trig_count, typeof(*entry), entry) {
+	for (i = 0; i < trig_count; i++) {
 		/*
 		 * Since we have already checked if enough triggers are
 		 * available, trigger allocation must succeed.
 		 */
 		trig = sbi_alloc_trigger();
 
-		sbi_hart_map_saddr((unsigned long)entry, sizeof(*entry));
-
-		recv = (struct sbi_dbtr_data_msg *)(&entry->data);
-		xmit = (struct sbi_dbtr_id_msg *)(&entry->id);
-
-		dbtr_trigger_setup(trig,  recv);
+		dbtr_trigger_setup(trig, &recv[i]);
 		dbtr_trigger_enable(trig);
-		xmit->idx = cpu_to_lle(trig->index);
-		sbi_hart_unmap_saddr();
+		entries[i].id.idx = cpu_to_lle(trig->index);
 	}
 
+	sbi_hart_unmap_saddr();
+
 	return SBI_SUCCESS;
 }
 
@@ -670,13 +689,19 @@ int sbi_dbtr_update_trig(unsigned long smode,
 	if (sbi_dbtr_shmem_disabled(hs))
 		return SBI_ERR_NO_SHMEM;
 
-	shmem_base = hart_shmem_base(hs);
+	trig_mask &= dbtr_all_trigs(hs);
+	if (!trig_mask)
+		return SBI_SUCCESS;
+
+	shmem_base = dbtr_shmem_map(hs, sbi_popcount(trig_mask));
 
 	for_each_set_bit_from(idx, &trig_mask, hs->total_trigs) {
 		trig = INDEX_TO_TRIGGER(idx);
 
-		if (!(trig->state & RV_DBTR_BIT_MASK(TS, MAPPED)))
+		if (!(trig->state & RV_DBTR_BIT_MASK(TS, MAPPED))) {
+			sbi_hart_unmap_saddr();
 			return SBI_ERR_INVALID_PARAM;
+		}
 
 		entry = (shmem_base + uidx * sizeof(*entry));
 		recv = &entry->data;
@@ -686,6 +711,8 @@ int sbi_dbtr_update_trig(unsigned long smode,
 		uidx++;
 	}
 
+	sbi_hart_unmap_saddr();
+
 	return SBI_SUCCESS;
 }
 
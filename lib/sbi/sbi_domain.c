@@ -10,6 +10,7 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_hart.h>
 #include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_heap.h>
 #include <sbi/sbi_hsm.h>
@@ -38,17 +39,19 @@ struct sbi_domain root = {
 
 static unsigned long domain_hart_ptr_offset;
 
-struct sbi_domain *sbi_hartindex_to_domain(u32 hartindex)
+struct sbi_domain *sbi_scratch_to_domain(struct sbi_scratch *scratch)
 {
-	struct sbi_scratch *scratch;
-
-	scratch = sbi_hartindex_to_scratch(hartindex);
 	if (!scratch || !domain_hart_ptr_offset)
 		return NULL;
 
 	return sbi_scratch_read_type(scratch, void *, domain_hart_ptr_offset);
 }
 
+struct sbi_domain *sbi_hartindex_to_domain(u32 hartindex)
+{
+	return sbi_scratch_to_domain(sbi_hartindex_to_scratch(hartindex));
+}
+
 void sbi_update_hartindex_to_domain(u32 hartindex, struct sbi_domain *dom)
 {
 	struct sbi_scratch *scratch;
@@ -62,35 +65,36 @@ void sbi_update_hartindex_to_domain(u32 hartindex, struct sbi_domain *dom)
 
 bool sbi_domain_is_assigned_hart(const struct sbi_domain *dom, u32 hartindex)
 {
-	bool ret;
-	struct sbi_domain *tdom = (struct sbi_domain *)dom;
+	unsigned long word;
 
-	if (!dom)
+	if (!dom || SBI_HARTMASK_MAX_BITS <= hartindex)
 		return false;
 
-	spin_lock(&tdom->assigned_harts_lock);
-	ret = sbi_hartmask_test_hartindex(hartindex, &tdom->assigned_harts);
-	spin_unlock(&tdom->assigned_harts_lock);
+	word = __atomic_load_n(&dom->assigned_harts.bits[BIT_WORD(hartindex)],
+			       __ATOMIC_ACQUIRE);
 
-	return ret;
+	return (word & BIT_MASK(hartindex)) ? true : false;
 }
 
 int sbi_domain_get_assigned_hartmask(const struct sbi_domain *dom,
 				     struct sbi_hartmask *mask)
 {
-	ulong ret = 0;
-	struct sbi_domain *tdom = (struct sbi_domain *)dom;
+	u32 i;
 
 	if (!dom) {
 		sbi_hartmask_clear_all(mask);
 		return 0;
 	}
 
-	spin_lock(&tdom->assigned_harts_lock);
-	sbi_hartmask_copy(mask, &tdom->assigned_harts);
-	spin_unlock(&tdom->assigned_harts_lock);
+	/*
+	 * HARTs only ever change their own bit, so every word copied
+	 * atomically is a consistent view of the HARTs it covers.
+	 */
+	for (i = 0; i < sbi_hartmask_nr_longs(); i++)
+		mask->bits[i] = __atomic_load_n(&dom->assigned_harts.bits[i],
+						__ATOMIC_ACQUIRE);
 
-	return ret;
+	return 0;
 }
 
 void sbi_domain_memregion_init(unsigned long addr,
@@ -122,22 +126,63 @@ void sbi_domain_memregion_init(unsigned long addr,
 	}
 }
 
-bool sbi_domain_check_addr(const struct sbi_domain *dom,
-			   unsigned long addr, unsigned long mode,
-			   unsigned long access_flags)
+static unsigned long region_end(const struct sbi_domain_memregion *reg)
+{
+	return (reg->order < __riscv_xlen) ?
+		reg->base + ((1UL << reg->order) - 1) : -1UL;
+}
+
+/* Binary search the interval containing addr */
+static const struct sbi_domain_interval *find_interval(
+						const struct sbi_domain *dom,
+						unsigned long addr)
 {
-	bool rmmio, mmio = false;
+	const struct sbi_domain_interval *itv;
+	u32 lo = 0, hi = dom->interval_count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		itv = &dom->intervals[mid];
+		if (addr < itv->start)
+			hi = mid;
+		else if (itv->end < addr)
+			lo = mid + 1;
+		else
+			return itv;
+	}
+
+	return NULL;
+}
+
+static const struct sbi_domain_memregion *find_region(
+						const struct sbi_domain *dom,
+						unsigned long addr)
+{
+	const struct sbi_domain_interval *itv;
 	struct sbi_domain_memregion *reg;
-	unsigned long rstart, rend, rflags, rwx = 0, rrwx = 0;
 
-	if (!dom)
-		return false;
+	if (dom->intervals) {
+		itv = find_interval(dom, addr);
+		return (itv) ? itv->reg : NULL;
+	}
+
+	sbi_domain_for_each_memregion(dom, reg) {
+		if (reg->base <= addr && addr <= region_end(reg))
+			return reg;
+	}
+
+	return NULL;
+}
+
+/*
+ * Use M_{R/W/X} bits because the SU-bits are at the same relative
+ * offsets. If the mode is not M, the SU bits will fall at same offsets
+ * after the shift.
+ */
+static unsigned long access_to_rwx(unsigned long access_flags)
+{
+	unsigned long rwx = 0;
 
-	/*
-	 * Use M_{R/W/X} bits because the SU-bits are at the
-	 * same relative offsets. If the mode is not M, the SU
-	 * bits will fall at same offsets after the shift.
-	 */
 	if (access_flags & SBI_DOMAIN_READ)
 		rwx |= SBI_DOMAIN_MEMREGION_M_READABLE;
 
@@ -147,26 +192,50 @@ bool sbi_domain_check_addr(const struct sbi_domain *dom,
 	if (access_flags & SBI_DOMAIN_EXECUTE)
 		rwx |= SBI_DOMAIN_MEMREGION_M_EXECUTABLE;
 
-	if (access_flags & SBI_DOMAIN_MMIO)
-		mmio = true;
+	return rwx;
+}
 
-	sbi_domain_for_each_memregion(dom, reg) {
-		rflags = reg->flags;
-		rrwx = (mode == PRV_M ?
-			(rflags & SBI_DOMAIN_MEMREGION_M_ACCESS_MASK) :
-			(rflags & SBI_DOMAIN_MEMREGION_SU_ACCESS_MASK)
-			>> SBI_DOMAIN_MEMREGION_SU_ACCESS_SHIFT);
+static bool region_allows_exact(const struct sbi_domain_memregion *reg,
+				unsigned long mode, unsigned long access_flags,
+				bool exact)
+{
+	unsigned long rwx = access_to_rwx(access_flags);
+	unsigned long rflags = reg->flags, rrwx;
+	bool rmmio, mmio = (access_flags & SBI_DOMAIN_MMIO) ? true : false;
 
-		rstart = reg->base;
-		rend = (reg->order < __riscv_xlen) ?
-			rstart + ((1UL << reg->order) - 1) : -1UL;
-		if (rstart <= addr && addr <= rend) {
-			rmmio = (rflags & SBI_DOMAIN_MEMREGION_MMIO) ? true : false;
-			if (mmio != rmmio)
-				return false;
-			return ((rrwx & rwx) == rwx) ? true : false;
-		}
-	}
+	rrwx = (mode == PRV_M ?
+		(rflags & SBI_DOMAIN_MEMREGION_M_ACCESS_MASK) :
+		(rflags & SBI_DOMAIN_MEMREGION_SU_ACCESS_MASK)
+		>> SBI_DOMAIN_MEMREGION_SU_ACCESS_SHIFT);
+
+	rmmio = (rflags & SBI_DOMAIN_MEMREGION_MMIO) ? true : false;
+	if (mmio != rmmio)
+		return false;
+
+	if (exact)
+		return (rrwx == rwx) ? true : false;
+
+	return ((rrwx & rwx) == rwx) ? true : false;
+}
+
+static bool region_allows(const struct sbi_domain_memregion *reg,
+			  unsigned long mode, unsigned long access_flags)
+{
+	return region_allows_exact(reg, mode, access_flags, false);
+}
+
+bool sbi_domain_check_addr(const struct sbi_domain *dom,
+			   unsigned long addr, unsigned long mode,
+			   unsigned long access_flags)
+{
+	const struct sbi_domain_memregion *reg;
+
+	if (!dom)
+		return false;
+
+	reg = find_region(dom, addr);
+	if (reg)
+		return region_allows(reg, mode, access_flags);
 
 	return (mode == PRV_M) ? true : false;
 }
@@ -228,24 +297,6 @@ static bool is_region_before(const struct sbi_domain_memregion *regA,
 	return false;
 }
 
-static const struct sbi_domain_memregion *find_region(
-						const struct sbi_domain *dom,
-						unsigned long addr)
-{
-	unsigned long rstart, rend;
-	struct sbi_domain_memregion *reg;
-
-	sbi_domain_for_each_memregion(dom, reg) {
-		rstart = reg->base;
-		rend = (reg->order < __riscv_xlen) ?
-			rstart + ((1UL << reg->order) - 1) : -1UL;
-		if (rstart <= addr && addr <= rend)
-			return reg;
-	}
-
-	return NULL;
-}
-
 static const struct sbi_domain_memregion *find_next_subset_region(
 				const struct sbi_domain *dom,
 				const struct sbi_domain_memregion *reg,
@@ -395,21 +446,78 @@ static int sanitize_domain(struct sbi_domain *dom)
 		return SBI_EINVAL;
 	}
 
+	/* Deadlines are rounded up to the timer slack with a mask */
+	if (dom->timer_slack & (dom->timer_slack - 1)) {
+		sbi_printf("%s: %s timer slack %u is not a power of 2\n",
+			   __func__, dom->name, dom->timer_slack);
+		return SBI_EINVAL;
+	}
+
 	return 0;
 }
 
+/*
+ * Range query over the interval index: find the first interval which
+ * can contain addr and then walk the contiguous intervals up to last.
+ */
+static bool check_intervals_range(const struct sbi_domain *dom,
+				  unsigned long addr, unsigned long last,
+				  unsigned long mode,
+				  unsigned long access_flags, bool exact)
+{
+	const struct sbi_domain_interval *itv, *itv_end;
+	u32 lo = 0, hi = dom->interval_count, mid;
+
+	/* Lower bound on the interval end address */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (dom->intervals[mid].end < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	itv_end = &dom->intervals[dom->interval_count];
+	for (itv = &dom->intervals[lo]; itv < itv_end; itv++) {
+		/* A gap means part of the range is not covered */
+		if (addr < itv->start)
+			return false;
+
+		if (!region_allows_exact(itv->reg, mode, access_flags, exact))
+			return false;
+
+		if (last <= itv->end)
+			return true;
+
+		addr = itv->end + 1;
+	}
+
+	return false;
+}
+
 bool sbi_domain_check_addr_range(const struct sbi_domain *dom,
 				 unsigned long addr, unsigned long size,
 				 unsigned long mode,
 				 unsigned long access_flags)
 {
-	unsigned long max = addr + size;
+	unsigned long last = addr + size - 1, next;
 	const struct sbi_domain_memregion *reg, *sreg;
 
 	if (!dom)
 		return false;
 
-	while (addr < max) {
+	if (!size)
+		return true;
+
+	/* Reject ranges wrapping around the address space */
+	if (last < addr)
+		return false;
+
+	if (dom->intervals)
+		return check_intervals_range(dom, addr, last, mode,
+					     access_flags, false);
+
+	while (1) {
 		reg = find_region(dom, addr);
 		if (!reg)
 			return false;
@@ -419,16 +527,75 @@ bool sbi_domain_check_addr_range(const struct sbi_domain *dom,
 
 		sreg = find_next_subset_region(dom, reg, addr);
 		if (sreg)
-			addr = sreg->base;
+			next = sreg->base;
 		else if (reg->order < __riscv_xlen)
-			addr = reg->base + (1UL << reg->order);
+			next = reg->base + (1UL << reg->order);
 		else
 			break;
+
+		if (!next || last < next)
+			break;
+		addr = next;
 	}
 
 	return true;
 }
 
+bool sbi_domain_check_addr_range_exact(const struct sbi_domain *dom,
+				       unsigned long addr, unsigned long size,
+				       unsigned long mode,
+				       unsigned long access_flags)
+{
+	unsigned long last = addr + size - 1;
+
+	/* Only answered from the interval index of finalized domains */
+	if (!dom || !dom->intervals || !size || last < addr)
+		return false;
+
+	return check_intervals_range(dom, addr, last, mode, access_flags, true);
+}
+
+int sbi_domain_check_smode_buffer(unsigned long addr_lo, unsigned long addr_hi,
+				  unsigned long size, unsigned long access_flags)
+{
+	ulong smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+
+	/*
+	 * The buffer must lie in the physical address space M-mode can
+	 * reach. On RV64 addr_lo holds the whole physical address so the
+	 * upper half must be zero. On RV32 M-mode has no MMU to reach the
+	 * 34-bit physical address space beyond 4GiB, so the upper half
+	 * must be zero and the buffer must end below 4GiB.
+	 */
+	if (addr_hi)
+		return SBI_EINVALID_ADDR;
+	if (size && addr_lo + size - 1 < addr_lo)
+		return SBI_EINVALID_ADDR;
+	if (!sbi_domain_check_addr_range(sbi_domain_thishart_ptr(), addr_lo,
+					 size, smode, access_flags))
+		return SBI_EINVALID_ADDR;
+
+	return 0;
+}
+
+int sbi_domain_copy_to_smode(unsigned long addr_lo, unsigned long addr_hi,
+			     const void *src, unsigned long size)
+{
+	int rc;
+
+	rc = sbi_domain_check_smode_buffer(addr_lo, addr_hi, size,
+					   SBI_DOMAIN_READ | SBI_DOMAIN_WRITE);
+	if (rc)
+		return rc;
+
+	sbi_hart_map_saddr(addr_lo, size);
+	sbi_memcpy((void *)addr_lo, src, size);
+	sbi_hart_unmap_saddr();
+
+	return 0;
+}
+
 void sbi_domain_dump(const struct sbi_domain *dom, const char *suffix)
 {
 	u32 i, j, k;
@@ -512,6 +679,19 @@ void sbi_domain_dump(const struct sbi_domain *dom, const char *suffix)
 
 	sbi_printf("Domain%d SysSuspend  %s: %s\n",
 		   dom->index, suffix, (dom->system_suspend_allowed) ? "yes" : "no");
+
+	if (dom->timer_slack)
+		sbi_printf("Domain%d TimerSlack  %s: %u ticks\n",
+			   dom->index, suffix, dom->timer_slack);
+
+	if (dom->stats_page)
+		sbi_printf("Domain%d StatsPage   %s: 0x%" PRILX " (size 0x%lx)\n",
+			   dom->index, suffix, dom->stats_page,
+			   dom->stats_page_size);
+
+	if (dom->cache_way_mask)
+		sbi_printf("Domain%d CacheWays   %s: 0x%08x\n",
+			   dom->index, suffix, dom->cache_way_mask);
 }
 
 void sbi_domain_dump_all(const char *suffix)
@@ -556,11 +736,13 @@ int sbi_domain_register(struct sbi_domain *dom,
 	/* Assign index to domain */
 	dom->index = domain_count++;
 
-	/* Initialize spinlock for dom->assigned_harts */
-	SPIN_LOCK_INIT(dom->assigned_harts_lock);
+	/* Initialize lock for dom->interruptible_harts */
+	RW_LOCK_INIT(dom->interruptible_harts_lock);
 
 	/* Clear assigned HARTs of domain */
 	sbi_hartmask_clear_all(&dom->assigned_harts);
+	dom->assigned_gen = 0;
+	dom->interruptible_gen = 0;
 
 	/* Assign domain to HART if HART is a possible HART */
 	sbi_hartmask_for_each_hartindex(i, assign_mask) {
@@ -568,9 +750,11 @@ int sbi_domain_register(struct sbi_domain *dom,
 			continue;
 
 		tdom = sbi_hartindex_to_domain(i);
-		if (tdom)
+		if (tdom) {
 			sbi_hartmask_clear_hartindex(i,
 					&tdom->assigned_harts);
+			tdom->assigned_gen++;
+		}
 		sbi_update_hartindex_to_domain(i, dom);
 		sbi_hartmask_set_hartindex(i, &dom->assigned_harts);
 
@@ -685,6 +869,92 @@ int sbi_domain_root_add_memrange(unsigned long addr, unsigned long size,
 	return 0;
 }
 
+/*
+ * Flatten the prioritized memory regions of a domain into a sorted
+ * table of non-overlapping intervals where each interval points to
+ * the first (i.e. highest priority) region covering it. Addresses
+ * not covered by any region have no interval.
+ */
+static int domain_build_intervals(struct sbi_domain *dom)
+{
+	struct sbi_domain_interval *itv, *tbl;
+	const struct sbi_domain_memregion *reg, *r;
+	unsigned long *pts, p, end;
+	u32 i, j, pcount = 0, count = 0;
+
+	if (!dom->regions)
+		return 0;
+
+	sbi_domain_for_each_memregion(dom, reg)
+		pcount++;
+
+	/* Boundary points: 0, each region start and end + 1 */
+	pts = sbi_malloc((2 * pcount + 1) * sizeof(*pts));
+	if (!pts)
+		return SBI_ENOMEM;
+
+	pcount = 0;
+	pts[pcount++] = 0;
+	sbi_domain_for_each_memregion(dom, reg) {
+		pts[pcount++] = reg->base;
+		end = region_end(reg);
+		if (end != -1UL)
+			pts[pcount++] = end + 1;
+	}
+
+	/* Sort and remove duplicates */
+	for (i = 1; i < pcount; i++) {
+		p = pts[i];
+		for (j = i; j > 0 && pts[j - 1] > p; j--)
+			pts[j] = pts[j - 1];
+		pts[j] = p;
+	}
+	for (i = 1, j = 1; i < pcount; i++) {
+		if (pts[i] != pts[j - 1])
+			pts[j++] = pts[i];
+	}
+	pcount = j;
+
+	tbl = sbi_zalloc(pcount * sizeof(*tbl));
+	if (!tbl) {
+		sbi_free(pts);
+		return SBI_ENOMEM;
+	}
+
+	/* Resolve each elementary segment and merge equal neighbours */
+	for (i = 0; i < pcount; i++) {
+		end = (i + 1 < pcount) ? pts[i + 1] - 1 : -1UL;
+
+		reg = NULL;
+		sbi_domain_for_each_memregion(dom, r) {
+			if (r->base <= pts[i] && pts[i] <= region_end(r)) {
+				reg = r;
+				break;
+			}
+		}
+		if (!reg)
+			continue;
+
+		itv = (count) ? &tbl[count - 1] : NULL;
+		if (itv && itv->reg == reg && itv->end + 1 == pts[i]) {
+			itv->end = end;
+			continue;
+		}
+
+		itv = &tbl[count++];
+		itv->start = pts[i];
+		itv->end = end;
+		itv->reg = reg;
+	}
+
+	sbi_free(pts);
+
+	dom->intervals = tbl;
+	dom->interval_count = count;
+
+	return 0;
+}
+
 int sbi_domain_finalize(struct sbi_scratch *scratch, u32 cold_hartid)
 {
 	int rc;
@@ -700,6 +970,17 @@ int sbi_domain_finalize(struct sbi_scratch *scratch, u32 cold_hartid)
 		return rc;
 	}
 
+	/*
+	 * Index memory regions of each domain for faster lookups. The
+	 * linear walk is kept as fallback so a failure is not fatal.
+	 */
+	sbi_domain_for_each(dom) {
+		rc = domain_build_intervals(dom);
+		if (rc)
+			sbi_printf("%s: %s interval index failed (error %d)\n",
+				   __func__, dom->name, rc);
+	}
+
 	/* Startup boot HART of domains */
 	sbi_domain_for_each(dom) {
 		/* Domain boot HART index */
@@ -718,10 +999,7 @@ int sbi_domain_finalize(struct sbi_scratch *scratch, u32 cold_hartid)
 			continue;
 
 		/* Ignore if boot HART is not part of the assigned HARTs */
-		spin_lock(&dom->assigned_harts_lock);
-		rc = sbi_hartmask_test_hartindex(dhart, &dom->assigned_harts);
-		spin_unlock(&dom->assigned_harts_lock);
-		if (!rc)
+		if (!sbi_domain_is_assigned_hart(dom, dhart))
 			continue;
 
 		/* Startup boot HART of domain */
@@ -753,6 +1031,55 @@ int sbi_domain_finalize(struct sbi_scratch *scratch, u32 cold_hartid)
 	return 0;
 }
 
+/*
+ * Cover the firmware R/W area with M-mode only regions and return the
+ * number of regions used. A single region is rounded up to a naturally
+ * aligned power-of-2 which may reserve almost twice the area, so when
+ * enabled the area is split into an aligned power-of-2 head and a tail
+ * whenever the two regions reserve less memory.
+ */
+static u32 domain_fw_rw_regions(struct sbi_scratch *scratch,
+				struct sbi_domain_memregion *regs)
+{
+	unsigned long base = scratch->fw_start + scratch->fw_rw_offset;
+	unsigned long size = scratch->fw_size - scratch->fw_rw_offset;
+	unsigned long flags = SBI_DOMAIN_MEMREGION_M_READABLE |
+			      SBI_DOMAIN_MEMREGION_M_WRITABLE;
+#ifdef CONFIG_SBI_DOMAIN_FW_RW_SPLIT
+	struct sbi_domain_memregion head, tail;
+	unsigned long head_size;
+#endif
+
+	sbi_domain_memregion_init(base, size, flags, &regs[0]);
+#ifdef CONFIG_SBI_DOMAIN_FW_RW_SPLIT
+	if (__riscv_xlen <= regs[0].order)
+		return 1;
+
+	/* Largest power-of-2 below the size which base is aligned to */
+	head_size = 1UL << (log2roundup(size) - 1);
+	while (base & (head_size - 1))
+		head_size >>= 1;
+	if (head_size == size)
+		return 1;
+
+	sbi_domain_memregion_init(base, head_size, flags, &head);
+	sbi_domain_memregion_init(base + head_size, size - head_size, flags,
+				  &tail);
+	if (__riscv_xlen <= tail.order ||
+	    tail.base < head.base ||
+	    region_end(&regs[0]) - regs[0].base <=
+	    MAX(region_end(&head), region_end(&tail)) - head.base)
+		return 1;
+
+	regs[0] = head;
+	regs[1] = tail;
+
+	return 2;
+#else
+	return 1;
+#endif
+}
+
 int sbi_domain_init(struct sbi_scratch *scratch, u32 cold_hartid)
 {
 	u32 i;
@@ -776,7 +1103,7 @@ int sbi_domain_init(struct sbi_scratch *scratch, u32 cold_hartid)
 		return SBI_EINVAL;
 	}
 
-	domain_hart_ptr_offset = sbi_scratch_alloc_type_offset(void *);
+	domain_hart_ptr_offset = sbi_scratch_alloc_hot_offset(sizeof(void *));
 	if (!domain_hart_ptr_offset)
 		return SBI_ENOMEM;
 
@@ -807,11 +1134,8 @@ int sbi_domain_init(struct sbi_scratch *scratch, u32 cold_hartid)
 				   SBI_DOMAIN_MEMREGION_M_EXECUTABLE),
 				  &root_memregs[root_memregs_count++]);
 
-	sbi_domain_memregion_init((scratch->fw_start + scratch->fw_rw_offset),
-				  (scratch->fw_size - scratch->fw_rw_offset),
-				  (SBI_DOMAIN_MEMREGION_M_READABLE |
-				   SBI_DOMAIN_MEMREGION_M_WRITABLE),
-				  &root_memregs[root_memregs_count++]);
+	root_memregs_count += domain_fw_rw_regions(scratch,
+					&root_memregs[root_memregs_count]);
 
 	root.fw_region_inited = true;
 
@@ -0,0 +1,313 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Shared memory message channels between domains
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_domain_channel.h>
+#include <sbi/sbi_domain_context.h>
+#include <sbi/sbi_domain_data.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_hartmask.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_ipi.h>
+#include <sbi/sbi_trap.h>
+
+/**
+ * Ring shared by two domains. It is offered by dom[0] and only usable
+ * once dom[1] accepted it, the ring is immutable from then on.
+ */
+struct domain_channel {
+	struct sbi_domain *dom[2];
+	unsigned long base;
+	unsigned long size;
+	bool accepted;
+};
+
+struct domain_channel_priv {
+	/** Channels of the domain, unused slots are NULL */
+	struct domain_channel *chan[SBI_DOMAIN_CHANNEL_MAX];
+};
+
+static struct sbi_domain_data channel_data = {
+	.data_size = sizeof(struct domain_channel_priv),
+};
+
+static spinlock_t channel_lock = SPIN_LOCK_INITIALIZER;
+
+static struct sbi_domain *domain_by_index(u32 index)
+{
+	struct sbi_domain *dom;
+
+	sbi_domain_for_each(dom) {
+		if (dom->index == index)
+			return dom;
+	}
+
+	return NULL;
+}
+
+/* Find the channel of dom with a peer whether accepted or not */
+static struct domain_channel *channel_lookup(struct sbi_domain *dom,
+					     const struct sbi_domain *peer)
+{
+	struct domain_channel_priv *priv = sbi_domain_data_ptr(dom,
+							       &channel_data);
+	struct domain_channel *ch;
+	int i;
+
+	if (!priv)
+		return NULL;
+
+	for (i = 0; i < SBI_DOMAIN_CHANNEL_MAX; i++) {
+		/* Slots are published after the channel is filled in */
+		ch = __atomic_load_n(&priv->chan[i], __ATOMIC_ACQUIRE);
+		if (ch && (ch->dom[0] == peer || ch->dom[1] == peer))
+			return ch;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find the channel of dom with a peer once the peer accepted it. The
+ * lock keeps a rejected offer from being freed under the lookup, an
+ * accepted channel is never freed.
+ */
+static struct domain_channel *channel_find(struct sbi_domain *dom,
+					   const struct sbi_domain *peer)
+{
+	struct domain_channel *ch;
+
+	spin_lock(&channel_lock);
+	ch = channel_lookup(dom, peer);
+	if (ch && !ch->accepted)
+		ch = NULL;
+	spin_unlock(&channel_lock);
+
+	return ch;
+}
+
+static int channel_free_slot(struct sbi_domain *dom)
+{
+	struct domain_channel_priv *priv = sbi_domain_data_ptr(dom,
+							       &channel_data);
+	int i;
+
+	if (!priv)
+		return SBI_ENOSPC;
+
+	for (i = 0; i < SBI_DOMAIN_CHANNEL_MAX; i++) {
+		if (!priv->chan[i])
+			return i;
+	}
+
+	return SBI_ENOSPC;
+}
+
+static void channel_slot_clear(struct sbi_domain *dom,
+			       const struct domain_channel *ch)
+{
+	struct domain_channel_priv *priv = sbi_domain_data_ptr(dom,
+							       &channel_data);
+	int i;
+
+	for (i = 0; priv && i < SBI_DOMAIN_CHANNEL_MAX; i++) {
+		if (priv->chan[i] == ch)
+			__atomic_store_n(&priv->chan[i], NULL,
+					 __ATOMIC_RELEASE);
+	}
+}
+
+/* Offer a new channel to the peer, it is only visible to dom for now */
+static int channel_offer(struct sbi_domain *dom, struct sbi_domain *peer,
+			 unsigned long base, unsigned long size)
+{
+	struct domain_channel_priv *priv;
+	struct domain_channel *ch;
+	int slot;
+
+	slot = channel_free_slot(dom);
+	if (slot < 0)
+		return slot;
+
+	ch = sbi_zalloc(sizeof(*ch));
+	if (!ch)
+		return SBI_ENOMEM;
+	ch->dom[0] = dom;
+	ch->dom[1] = peer;
+	ch->base = base;
+	ch->size = size;
+
+	priv = sbi_domain_data_ptr(dom, &channel_data);
+	__atomic_store_n(&priv->chan[slot], ch, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * Accept the channel offered by the peer. A mismatching ring or a lack
+ * of slots rejects the offer, which is then dropped from the peer so
+ * that it neither holds a slot nor can be accepted later.
+ */
+static int channel_accept(struct sbi_domain *dom, struct domain_channel *ch,
+			  unsigned long base, unsigned long size)
+{
+	struct domain_channel_priv *priv;
+	int slot;
+
+	slot = channel_free_slot(dom);
+	if (slot < 0 || ch->base != base || ch->size != size) {
+		channel_slot_clear(ch->dom[0], ch);
+		sbi_free(ch);
+		return slot < 0 ? slot : SBI_EINVAL;
+	}
+
+	priv = sbi_domain_data_ptr(dom, &channel_data);
+	ch->accepted = true;
+	__atomic_store_n(&priv->chan[slot], ch, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int sbi_domain_channel_setup(struct sbi_domain *dom, u32 peer_index,
+			     unsigned long base, unsigned long size,
+			     unsigned long mode)
+{
+	struct sbi_domain *peer = domain_by_index(peer_index);
+	struct domain_channel *ch;
+	int rc;
+
+	if (!dom || !peer || peer == dom || !size)
+		return SBI_EINVAL;
+
+	/* The only address checks of the ring, one for each side */
+	if (!sbi_domain_check_addr_range(dom, base, size, mode,
+					 SBI_DOMAIN_READ | SBI_DOMAIN_WRITE) ||
+	    !sbi_domain_check_addr_range(peer, base, size, peer->next_mode,
+					 SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_EINVALID_ADDR;
+
+	spin_lock(&channel_lock);
+
+	if (channel_lookup(dom, peer)) {
+		/* Offered by dom already or accepted */
+		rc = SBI_EALREADY;
+	} else {
+		ch = channel_lookup(peer, dom);
+		rc = ch ? channel_accept(dom, ch, base, size) :
+			  channel_offer(dom, peer, base, size);
+	}
+
+	spin_unlock(&channel_lock);
+	return rc;
+}
+
+int sbi_domain_channel_info(struct sbi_domain *dom, u32 peer_index,
+			    unsigned long field, unsigned long *out_val)
+{
+	struct domain_channel *ch;
+
+	ch = channel_find(dom, domain_by_index(peer_index));
+	if (!ch)
+		return SBI_EINVAL;
+
+	switch (field) {
+	case SBI_DOMAIN_CHANNEL_INFO_BASE:
+		*out_val = ch->base;
+		return 0;
+	case SBI_DOMAIN_CHANNEL_INFO_SIZE:
+		*out_val = ch->size;
+		return 0;
+	default:
+		return SBI_EINVAL;
+	}
+}
+
+/*
+ * Complete the ecall of the calling domain before switching away from
+ * it because the ecall return path only sees the context switched to.
+ */
+static int channel_switch(int (*fn)(void *arg), void *arg,
+			  struct sbi_trap_regs *regs,
+			  struct sbi_ecall_return *out)
+{
+	int rc;
+
+	regs->mepc += 4;
+	regs->a0 = SBI_SUCCESS;
+	regs->a1 = 0;
+	out->skip_regs_update = true;
+
+	rc = fn(arg);
+	if (rc) {
+		regs->mepc -= 4;
+		out->skip_regs_update = false;
+	}
+
+	return rc;
+}
+
+static int channel_enter(void *arg)
+{
+	return sbi_domain_context_enter(arg);
+}
+
+static int channel_exit(void *arg)
+{
+	return sbi_domain_context_exit();
+}
+
+int sbi_domain_channel_notify(struct sbi_domain *dom, u32 peer_index,
+			      struct sbi_trap_regs *regs,
+			      struct sbi_ecall_return *out)
+{
+	struct sbi_domain *peer = domain_by_index(peer_index);
+	struct sbi_hartmask assigned;
+
+	if (!peer || !channel_find(dom, peer))
+		return SBI_EINVAL;
+
+	/* Enter a peer which only runs on HARTs lent to it directly */
+	sbi_domain_get_assigned_hartmask(peer, &assigned);
+	if (!sbi_hartmask_weight(&assigned) &&
+	    sbi_hartmask_test_hartindex(current_hartindex(),
+					peer->possible_harts) &&
+	    !channel_switch(channel_enter, peer, regs, out))
+		return 0;
+
+	return sbi_ipi_send_smode_domain(peer);
+}
+
+int sbi_domain_channel_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			      struct sbi_ecall_return *out)
+{
+	ulong smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+	struct sbi_domain *dom = sbi_domain_thishart_ptr();
+
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_CHANNEL_SETUP:
+		return sbi_domain_channel_setup(dom, regs->a0, regs->a1,
+						regs->a2, smode);
+	case SBI_EXT_OPENSBI_CHANNEL_INFO:
+		return sbi_domain_channel_info(dom, regs->a0, regs->a1,
+					       &out->value);
+	case SBI_EXT_OPENSBI_CHANNEL_NOTIFY:
+		return sbi_domain_channel_notify(dom, regs->a0, regs, out);
+	case SBI_EXT_OPENSBI_CHANNEL_RETURN:
+		return channel_switch(channel_exit, NULL, regs, out);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+int sbi_domain_channel_init(void)
+{
+	return sbi_domain_register_data(&channel_data);
+}
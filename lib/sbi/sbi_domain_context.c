@@ -5,18 +5,40 @@
  */
 
 #include <sbi/sbi_error.h>
+#include <sbi/riscv_atomic.h>
+#include <sbi/riscv_barrier.h>
 #include <sbi/riscv_locks.h>
 #include <sbi/riscv_asm.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_fwft.h>
 #include <sbi/sbi_hsm.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
+#include <sbi/sbi_platform.h>
+#include <sbi/sbi_pmu.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
 #include <sbi/sbi_domain.h>
 #include <sbi/sbi_domain_context.h>
 #include <sbi/sbi_trap.h>
 
+#ifdef CONFIG_SBI_DOMAIN_FPV
+#define FPV_MSTATUS_BITS		(MSTATUS_FS | MSTATUS_VS)
+
+/** Floating-point and vector registers of a domain */
+struct fpv_state {
+	u64 f[32];
+	unsigned long fcsr;
+	unsigned long vstart;
+	unsigned long vl;
+	unsigned long vtype;
+	unsigned long vcsr;
+	/** 32 vector registers of VLENB bytes each */
+	u8 *v;
+};
+#endif
+
 /** Context representation for a hart within a domain */
 struct hart_context {
 	/** Trap-related states such as GPRs, mepc, and mstatus */
@@ -44,6 +66,31 @@ struct hart_context {
 	unsigned long scounteren;
 	/** Supervisor environment configuration register */
 	unsigned long senvcfg;
+	/** FWFT feature state of the domain on this hart */
+	struct sbi_fwft_context fwft;
+	/** Supervisor timer deadline of the domain on this hart */
+	struct sbi_timer_context timer;
+	/** PMP CSR values observed when the domain ran on this hart */
+	struct sbi_hart_pmp_state pmp;
+	/** Is the PMP snapshot valid */
+	bool pmp_valid;
+#ifdef CONFIG_SBI_DOMAIN_FPV
+	/** FP/V register file of the domain when not live on the hart */
+	struct fpv_state fpv;
+#endif
+
+#ifdef CONFIG_SBI_ECALL_STA
+	/** Steal-time shared memory of the domain on this hart */
+	unsigned long sta_phys;
+	/** Is sta_phys valid */
+	bool sta_enabled;
+	/** Is the domain switched out since sta_out_time */
+	bool sta_out;
+	/** Timer value when the domain was switched out */
+	u64 sta_out_time;
+	/** Timer ticks the domain spent switched out */
+	u64 sta_steal;
+#endif
 
 	/** Reference to the owning domain */
 	struct sbi_domain *dom;
@@ -85,6 +132,179 @@ static void hart_context_set(struct sbi_domain *dom, u32 hartindex,
 	hart_context_get(sbi_domain_thishart_ptr(),			\
 			 current_hartindex())
 
+#ifdef CONFIG_SBI_DOMAIN_FPV
+#ifdef __riscv_flen
+#define FREG_FOR_EACH(__f)						\
+	__f(0)  __f(1)  __f(2)  __f(3)  __f(4)  __f(5)  __f(6)  __f(7)	\
+	__f(8)  __f(9)  __f(10) __f(11) __f(12) __f(13) __f(14) __f(15)	\
+	__f(16) __f(17) __f(18) __f(19) __f(20) __f(21) __f(22) __f(23)	\
+	__f(24) __f(25) __f(26) __f(27) __f(28) __f(29) __f(30) __f(31)
+
+#define FREG_SAVE(__n)							\
+	asm volatile("fsd f" #__n ", %0" : "=m"(st->f[__n]));
+#define FREG_RESTORE(__n)						\
+	asm volatile("fld f" #__n ", %0" : : "m"(st->f[__n]));
+#endif
+
+#ifdef OPENSBI_CC_SUPPORT_VECTOR
+/* Whole register group accesses depend on neither vtype nor vl */
+#define VREG_GROUP(__op, __n, __p)					\
+	asm volatile(".option push\n"					\
+		     ".option arch, +v\n"				\
+		     #__op " v" #__n ", (%0)\n"			\
+		     ".option pop\n"					\
+		     : : "r"(__p) : "memory")
+#endif
+
+static void fpv_save(struct sbi_scratch *scratch, struct fpv_state *st)
+{
+	unsigned long mstatus = csr_read_set(CSR_MSTATUS, FPV_MSTATUS_BITS);
+#ifdef OPENSBI_CC_SUPPORT_VECTOR
+	unsigned long vlenb;
+#endif
+
+#ifdef __riscv_flen
+	if (misa_extension('D')) {
+		FREG_FOR_EACH(FREG_SAVE)
+		st->fcsr = csr_read(CSR_FCSR);
+	}
+#endif
+#ifdef OPENSBI_CC_SUPPORT_VECTOR
+	if (misa_extension('V') && st->v) {
+		vlenb = csr_read(CSR_VLENB);
+		st->vstart = csr_read(CSR_VSTART);
+		st->vl = csr_read(CSR_VL);
+		st->vtype = csr_read(CSR_VTYPE);
+		st->vcsr = csr_read(CSR_VCSR);
+		VREG_GROUP(vs8r.v, 0, st->v);
+		VREG_GROUP(vs8r.v, 8, st->v + 8 * vlenb);
+		VREG_GROUP(vs8r.v, 16, st->v + 16 * vlenb);
+		VREG_GROUP(vs8r.v, 24, st->v + 24 * vlenb);
+	}
+#endif
+
+	csr_write(CSR_MSTATUS, mstatus);
+}
+
+static void fpv_restore(struct sbi_scratch *scratch,
+			const struct fpv_state *st)
+{
+	unsigned long mstatus = csr_read_set(CSR_MSTATUS, FPV_MSTATUS_BITS);
+#ifdef OPENSBI_CC_SUPPORT_VECTOR
+	unsigned long vlenb;
+#endif
+
+#ifdef __riscv_flen
+	if (misa_extension('D')) {
+		FREG_FOR_EACH(FREG_RESTORE)
+		csr_write(CSR_FCSR, st->fcsr);
+	}
+#endif
+#ifdef OPENSBI_CC_SUPPORT_VECTOR
+	if (misa_extension('V') && st->v) {
+		vlenb = csr_read(CSR_VLENB);
+		VREG_GROUP(vl8re8.v, 0, st->v);
+		VREG_GROUP(vl8re8.v, 8, st->v + 8 * vlenb);
+		VREG_GROUP(vl8re8.v, 16, st->v + 16 * vlenb);
+		VREG_GROUP(vl8re8.v, 24, st->v + 24 * vlenb);
+		asm volatile(".option push\n"
+			     ".option arch, +v\n"
+			     "vsetvl zero, %0, %1\n"
+			     ".option pop\n"
+			     : : "r"(st->vl), "r"(st->vtype) : "memory");
+		csr_write(CSR_VCSR, st->vcsr);
+		csr_write(CSR_VSTART, st->vstart);
+	}
+#endif
+
+	csr_write(CSR_MSTATUS, mstatus);
+}
+
+static int fpv_alloc(struct fpv_state *st)
+{
+#ifdef OPENSBI_CC_SUPPORT_VECTOR
+	unsigned long mstatus, vlenb;
+
+	if (!misa_extension('V'))
+		return 0;
+
+	mstatus = csr_read_set(CSR_MSTATUS, MSTATUS_VS);
+	vlenb = csr_read(CSR_VLENB);
+	csr_write(CSR_MSTATUS, mstatus);
+
+	st->v = sbi_zalloc(32 * vlenb);
+	if (!st->v)
+		return SBI_ENOMEM;
+#endif
+
+	return 0;
+}
+
+/*
+ * Swap the FP/V register file on a domain switch. The supervisor can
+ * turn sstatus.FS/VS on and use the registers without ever trapping to
+ * M-mode, so the registers of the outgoing domain are always saved and
+ * those of the incoming domain (zeroes if it never ran) restored.
+ */
+static void fpv_switch(struct sbi_scratch *scratch, struct hart_context *ctx,
+		       struct hart_context *dom_ctx)
+{
+	fpv_save(scratch, &ctx->fpv);
+	fpv_restore(scratch, &dom_ctx->fpv);
+}
+#endif
+
+#ifdef CONFIG_SBI_ECALL_STA
+static u64 sta_ticks_to_ns(u64 ticks)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+	u64 freq = tdev ? tdev->timer_freq : 0;
+
+	if (!freq)
+		return 0;
+
+	return (ticks / freq) * 1000000000ULL +
+	       ((ticks % freq) * 1000000000ULL) / freq;
+}
+
+/* Must be called with the PMP configuration of the domain of ctx */
+static void sta_publish(struct hart_context *ctx, bool preempted)
+{
+	struct sbi_sta_shmem *sta = (struct sbi_sta_shmem *)ctx->sta_phys;
+	u64 steal = sta_ticks_to_ns(ctx->sta_steal);
+	u32 seq;
+
+	sbi_hart_map_saddr(ctx->sta_phys, sizeof(*sta));
+	seq = sta->sequence;
+	/* Readers retry while the sequence is odd */
+	sta->sequence = seq | 1;
+	smp_wmb();
+	sta->steal = steal;
+	sta->preempted = preempted;
+	smp_wmb();
+	sta->sequence = (seq | 1) + 1;
+	sbi_hart_unmap_saddr();
+}
+
+static void sta_switch_out(struct hart_context *ctx, u64 now)
+{
+	ctx->sta_out_time = now;
+	ctx->sta_out = true;
+	if (ctx->sta_enabled)
+		sta_publish(ctx, true);
+}
+
+static void sta_switch_in(struct hart_context *ctx, u64 now)
+{
+	if (ctx->sta_out) {
+		ctx->sta_steal += now - ctx->sta_out_time;
+		ctx->sta_out = false;
+	}
+	if (ctx->sta_enabled)
+		sta_publish(ctx, false);
+}
+#endif
+
 /**
  * Switches the HART context from the current domain to the target domain.
  * This includes changing domain assignments and reconfiguring PMP, as well
@@ -102,23 +322,45 @@ static void switch_to_next_domain_context(struct hart_context *ctx,
 	struct sbi_domain *target_dom = dom_ctx->dom;
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 	unsigned int pmp_count = sbi_hart_pmp_count(scratch);
+#ifdef CONFIG_SBI_ECALL_STA
+	u64 now = sbi_timer_value();
+
+	/* Still under the PMP configuration of the current domain */
+	sta_switch_out(ctx, now);
+#endif
+
+	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_DOMAIN_SWITCH);
 
 	/* Assign current hart to target domain */
-	spin_lock(&current_dom->assigned_harts_lock);
-	sbi_hartmask_clear_hartindex(hartindex, &current_dom->assigned_harts);
-	spin_unlock(&current_dom->assigned_harts_lock);
+	atomic_raw_clear_bit(hartindex, current_dom->assigned_harts.bits);
+	__atomic_add_fetch(&current_dom->assigned_gen, 1, __ATOMIC_RELEASE);
 
 	sbi_update_hartindex_to_domain(hartindex, target_dom);
 
-	spin_lock(&target_dom->assigned_harts_lock);
-	sbi_hartmask_set_hartindex(hartindex, &target_dom->assigned_harts);
-	spin_unlock(&target_dom->assigned_harts_lock);
+	atomic_raw_set_bit(hartindex, target_dom->assigned_harts.bits);
+	__atomic_add_fetch(&target_dom->assigned_gen, 1, __ATOMIC_RELEASE);
 
-	/* Reconfigure PMP settings for the new domain */
-	for (int i = 0; i < pmp_count; i++) {
-		pmp_disable(i);
+	/*
+	 * Reconfigure PMP settings for the new domain. The first switch
+	 * into a domain derives its entries from the memory regions and
+	 * snapshots the result, later switches only rewrite the PMP CSRs
+	 * which differ between the two snapshots.
+	 */
+	if (!ctx->pmp_valid)
+		ctx->pmp_valid = sbi_hart_pmp_snapshot(scratch, &ctx->pmp);
+	if (ctx->pmp_valid && dom_ctx->pmp_valid) {
+		sbi_hart_pmp_switch(scratch, &ctx->pmp, &dom_ctx->pmp);
+	} else {
+		for (int i = 0; i < pmp_count; i++) {
+			pmp_disable(i);
+		}
+		sbi_hart_pmp_configure(scratch);
+		dom_ctx->pmp_valid = sbi_hart_pmp_snapshot(scratch,
+							   &dom_ctx->pmp);
 	}
-	sbi_hart_pmp_configure(scratch);
+#ifdef CONFIG_SBI_ECALL_STA
+	sta_switch_in(dom_ctx, now);
+#endif
 
 	/* Save current CSR context and restore target domain's CSR context */
 	ctx->sstatus	= csr_swap(CSR_SSTATUS, dom_ctx->sstatus);
@@ -135,10 +377,39 @@ static void switch_to_next_domain_context(struct hart_context *ctx,
 	if (sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_12)
 		ctx->senvcfg	= csr_swap(CSR_SENVCFG, dom_ctx->senvcfg);
 
-	/* Save current trap state and restore target domain's trap state */
+	/*
+	 * Apply the FWFT features of the target domain. Only the bits
+	 * which differ are written, so switching between domains with
+	 * the same features costs no CSR access.
+	 */
+	sbi_fwft_context_switch(&ctx->fwft, &dom_ctx->fwft);
+
+	/*
+	 * The supervisor timer belongs to the domain too, a deadline which
+	 * expired while the target domain was switched out is delivered as
+	 * a pending timer interrupt once it resumes.
+	 */
+	sbi_timer_context_switch(&ctx->timer, &dom_ctx->timer);
+
+	/* Platform state of the target domain, e.g. its cache ways */
+	sbi_platform_domain_enter(sbi_platform_ptr(scratch), target_dom);
+
+	/*
+	 * Traps from S/U-mode save their state straight into the trap
+	 * context of the running domain so switching only retargets the
+	 * trap frame slot of the hart and returns through the trap context
+	 * of the target domain. The state is only copied when the current
+	 * domain trapped into the default slot, before its first switch.
+	 */
 	trap_ctx = sbi_trap_get_context(scratch);
-	sbi_memcpy(&ctx->trap_ctx, trap_ctx, sizeof(*trap_ctx));
-	sbi_memcpy(trap_ctx, &dom_ctx->trap_ctx, sizeof(*trap_ctx));
+	if (trap_ctx != &ctx->trap_ctx)
+		sbi_memcpy(&ctx->trap_ctx, trap_ctx, sizeof(*trap_ctx));
+	dom_ctx->trap_ctx.prev_context = trap_ctx->prev_context;
+	scratch->trap_frame = (unsigned long)&dom_ctx->trap_ctx;
+	sbi_trap_set_context(scratch, &dom_ctx->trap_ctx);
+#ifdef CONFIG_SBI_DOMAIN_FPV
+	fpv_switch(scratch, ctx, dom_ctx);
+#endif
 
 	/* Mark current context structure initialized because context saved */
 	ctx->initialized = true;
@@ -174,12 +445,42 @@ int sbi_domain_context_enter(struct sbi_domain *dom)
 	return 0;
 }
 
+/* Allocate the context of every domain which may run on a hart */
+static int hart_contexts_alloc(u32 hartindex)
+{
+	struct sbi_domain *dom;
+	struct hart_context *dom_ctx;
+
+	sbi_domain_for_each(dom) {
+		if (!sbi_hartmask_test_hartindex(hartindex,
+						 dom->possible_harts))
+			continue;
+
+		dom_ctx = sbi_zalloc(sizeof(struct hart_context));
+		if (!dom_ctx)
+			return SBI_ENOMEM;
+#ifdef CONFIG_SBI_DOMAIN_FPV
+		if (fpv_alloc(&dom_ctx->fpv)) {
+			sbi_free(dom_ctx);
+			return SBI_ENOMEM;
+		}
+#endif
+
+		/* Bind context and domain */
+		dom_ctx->dom = dom;
+		hart_context_set(dom, hartindex, dom_ctx);
+	}
+
+	return 0;
+}
+
 int sbi_domain_context_exit(void)
 {
 	u32 hartindex = current_hartindex();
 	struct sbi_domain *dom;
 	struct hart_context *ctx = hart_context_thishart_get();
 	struct hart_context *dom_ctx, *tmp;
+	int rc;
 
 	/*
 	 * If it's first time to call `exit` on the current hart, no
@@ -187,19 +488,9 @@ int sbi_domain_context_exit(void)
 	 * its context on the current hart if valid.
 	 */
 	if (!ctx) {
-		sbi_domain_for_each(dom) {
-			if (!sbi_hartmask_test_hartindex(hartindex,
-							 dom->possible_harts))
-				continue;
-
-			dom_ctx = sbi_zalloc(sizeof(struct hart_context));
-			if (!dom_ctx)
-				return SBI_ENOMEM;
-
-			/* Bind context and domain */
-			dom_ctx->dom = dom;
-			hart_context_set(dom, hartindex, dom_ctx);
-		}
+		rc = hart_contexts_alloc(hartindex);
+		if (rc)
+			return rc;
 
 		ctx = hart_context_thishart_get();
 	}
@@ -230,6 +521,68 @@ int sbi_domain_context_exit(void)
 	return 0;
 }
 
+#ifdef CONFIG_SBI_ECALL_STA
+int sbi_domain_context_sta_set_shmem(unsigned long smode,
+				     unsigned long shmem_phys_lo,
+				     unsigned long shmem_phys_hi,
+				     unsigned long flags)
+{
+	struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	struct hart_context *ctx = hart_context_thishart_get();
+
+	if (flags)
+		return SBI_ERR_INVALID_PARAM;
+
+	/* The context also holds the steal time of a domain not yet switched */
+	if (!ctx) {
+		if (hart_contexts_alloc(current_hartindex()))
+			return SBI_ERR_FAILED;
+		ctx = hart_context_thishart_get();
+		if (!ctx)
+			return SBI_ERR_FAILED;
+	}
+
+	/* call is to disable shared memory */
+	if (shmem_phys_lo == SBI_STA_SHMEM_INVALID_ADDR &&
+	    shmem_phys_hi == SBI_STA_SHMEM_INVALID_ADDR) {
+		ctx->sta_enabled = false;
+		ctx->sta_phys = 0;
+		return SBI_SUCCESS;
+	}
+
+	if (shmem_phys_lo & (sizeof(struct sbi_sta_shmem) - 1))
+		return SBI_ERR_INVALID_PARAM;
+
+	/* Same upper physical address restriction as the DBTR shmem */
+	if (shmem_phys_hi)
+		return SBI_ERR_INVALID_ADDRESS;
+
+	if (!sbi_domain_check_addr_range(dom, shmem_phys_lo,
+					 sizeof(struct sbi_sta_shmem), smode,
+					 SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_ERR_INVALID_ADDRESS;
+
+	ctx->sta_phys = shmem_phys_lo;
+	ctx->sta_enabled = true;
+	sta_publish(ctx, false);
+
+	return SBI_SUCCESS;
+}
+
+void sbi_domain_context_sta_reset(struct sbi_domain *dom, u32 hartindex)
+{
+	struct hart_context *ctx = hart_context_get(dom, hartindex);
+
+	if (!ctx)
+		return;
+
+	ctx->sta_enabled = false;
+	ctx->sta_phys = 0;
+	ctx->sta_out = false;
+	ctx->sta_steal = 0;
+}
+#endif
+
 int sbi_domain_context_init(void)
 {
 	return sbi_domain_register_data(&dcpriv);
@@ -10,8 +10,52 @@
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
 #include <sbi/sbi_sse.h>
+#include <sbi/sbi_timer.h>
 #include <sbi/sbi_trap.h>
+#include <sbi/sbi_trap_ldst.h>
+
+/** Offset of struct sbi_double_trap_stats in scratch space */
+static unsigned long double_trap_stats_off;
+
+static void double_trap_account(void)
+{
+	struct sbi_double_trap_stats *stats;
+	u64 now;
+
+	if (!double_trap_stats_off)
+		return;
+
+	stats = sbi_scratch_thishart_offset_ptr(double_trap_stats_off);
+	now = sbi_timer_value();
+	if (!stats->count)
+		stats->first_time = now;
+	stats->last_time = now;
+	stats->count++;
+}
+
+bool sbi_double_trap_fast(struct sbi_trap_context *tcntx)
+{
+	struct sbi_trap_regs *regs = &tcntx->regs;
+
+	double_trap_account();
+
+	if (sbi_mstatus_prev_mode(regs->mstatus) != PRV_S)
+		return false;
+
+	/* Exception was taken in VS-mode, redirect it to S-mode */
+	if (sbi_regs_from_virt(regs))
+		return !sbi_trap_redirect(regs, &tcntx->trap);
+
+	if (sbi_sse_inject_event(SBI_SSE_EVENT_LOCAL_DOUBLE_TRAP))
+		return false;
+
+	sbi_sse_process_pending_events(regs);
+
+	return true;
+}
 
 int sbi_double_trap_handler(struct sbi_trap_context *tcntx)
 {
@@ -28,3 +72,27 @@ int sbi_double_trap_handler(struct sbi_trap_context *tcntx)
 
 	return sbi_sse_inject_event(SBI_SSE_EVENT_LOCAL_DOUBLE_TRAP);
 }
+
+const struct sbi_double_trap_stats *sbi_double_trap_stats(u32 hartindex)
+{
+	struct sbi_scratch *scratch = sbi_hartindex_to_scratch(hartindex);
+
+	if (!double_trap_stats_off || !scratch)
+		return NULL;
+
+	return sbi_scratch_offset_ptr(scratch, double_trap_stats_off);
+}
+
+int sbi_double_trap_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	if (cold_boot) {
+		double_trap_stats_off = sbi_scratch_alloc_type_offset(
+						struct sbi_double_trap_stats);
+		if (!double_trap_stats_off)
+			return SBI_ENOMEM;
+	} else if (!double_trap_stats_off) {
+		return SBI_ENOMEM;
+	}
+
+	return 0;
+}
@@ -7,10 +7,17 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <sbi/riscv_locks.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_ecall.h>
 #include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_ecall_profile.h>
+#include <sbi/sbi_ecall_trace.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_tracepoint.h>
 #include <sbi/sbi_trap.h>
 
 extern struct sbi_ecall_extension *const sbi_ecall_exts[];
@@ -39,10 +46,203 @@ void sbi_ecall_set_impid(unsigned long impid)
 
 static SBI_LIST_HEAD(ecall_exts_list);
 
-struct sbi_ecall_extension *sbi_ecall_find_extension(unsigned long extid)
+/*
+ * Once all extensions are registered the list is sealed into a lookup
+ * table. Extensions covering a single ID go into a collision free hash
+ * table and the few extensions covering a range go into a sorted array.
+ * Each domain gets a view of the table as masks of the hash slots and
+ * ranges it may use, and probe results of hashed extensions are cached.
+ */
+#define ECALL_HASH_MAX_BITS	6
+#define ECALL_HASH_SLOTS	(1UL << ECALL_HASH_MAX_BITS)
+#define ECALL_RANGE_MAX		16
+
+_Static_assert(ECALL_HASH_SLOTS <= 64 && ECALL_RANGE_MAX <= 32,
+	       "Ecall table does not fit the domain view masks");
+
+struct ecall_probe_cache {
+	unsigned long value;
+	/* The value is valid if this matches ecall_probe_gen */
+	unsigned long gen;
+};
+
+/** Extensions a domain may use, indexed like the lookup table */
+struct ecall_view {
+	u64 hash_allowed;
+	u32 range_allowed;
+};
+
+/**
+ * Lookup table of the sealed extension list. A published table is only
+ * read, apart from its probe cache, so that lookups on other HARTs never
+ * see it half built. Late changes build a new table on the side.
+ */
+struct ecall_table {
+	u32 hash_mult;
+	u32 hash_bits;
+	struct sbi_ecall_extension *hash[ECALL_HASH_SLOTS];
+	struct ecall_probe_cache probe[ECALL_HASH_SLOTS];
+	u32 range_count;
+	struct sbi_ecall_extension *range[ECALL_RANGE_MAX];
+	/* Domains registered after the table was built have no view */
+	u32 view_count;
+	struct ecall_view views[];
+};
+
+/* The list is used as long as no table is published */
+static struct ecall_table *ecall_table;
+static spinlock_t ecall_table_lock = SPIN_LOCK_INITIALIZER;
+static unsigned long ecall_probe_gen = 1;
+
+static inline struct ecall_table *ecall_table_get(void)
+{
+	return __atomic_load_n(&ecall_table, __ATOMIC_ACQUIRE);
+}
+
+static inline u32 ecall_hash_index(unsigned long extid, u32 mult, u32 bits)
+{
+	return ((u32)extid * mult) >> (32 - bits);
+}
+
+static bool ecall_hash_try(struct ecall_table *tbl, u32 mult, u32 bits)
+{
+	u32 i;
+	struct sbi_ecall_extension *t;
+
+	sbi_memset(tbl->hash, 0, sizeof(tbl->hash));
+	sbi_list_for_each_entry(t, &ecall_exts_list, head) {
+		if (t->extid_start != t->extid_end)
+			continue;
+		i = ecall_hash_index(t->extid_start, mult, bits);
+		if (tbl->hash[i])
+			return false;
+		tbl->hash[i] = t;
+	}
+
+	return true;
+}
+
+static void ecall_build_views(struct ecall_table *tbl)
+{
+	struct sbi_domain *dom;
+	struct ecall_view *v;
+	u32 i;
+
+	sbi_domain_for_each(dom) {
+		v = &tbl->views[dom->index];
+		for (i = 0; i < ECALL_HASH_SLOTS; i++) {
+			if (tbl->hash[i] && (!tbl->hash[i]->domain_allowed ||
+					     tbl->hash[i]->domain_allowed(dom)))
+				v->hash_allowed |= 1ULL << i;
+		}
+		for (i = 0; i < tbl->range_count; i++) {
+			if (!tbl->range[i]->domain_allowed ||
+			    tbl->range[i]->domain_allowed(dom))
+				v->range_allowed |= 1U << i;
+		}
+	}
+}
+
+/* Build a lookup table of the current list, NULL if there is none */
+static struct ecall_table *ecall_table_build(void)
+{
+	u32 j, bits, tries, single = 0, views = 0;
+	u32 mult = 0x9e3779b1;
+	struct sbi_ecall_extension *t;
+	struct ecall_table *tbl;
+	struct sbi_domain *dom;
+
+	sbi_domain_for_each(dom)
+		views = MAX(views, dom->index + 1);
+
+	tbl = sbi_zalloc(sizeof(*tbl) + views * sizeof(tbl->views[0]));
+	if (!tbl)
+		return NULL;
+	tbl->view_count = views;
+
+	sbi_list_for_each_entry(t, &ecall_exts_list, head) {
+		if (t->extid_start == t->extid_end) {
+			single++;
+			continue;
+		}
+		if (tbl->range_count == ECALL_RANGE_MAX)
+			goto fail;
+
+		/* Insertion sort by start of range */
+		for (j = tbl->range_count;
+		     j && tbl->range[j - 1]->extid_start > t->extid_start; j--)
+			tbl->range[j] = tbl->range[j - 1];
+		tbl->range[j] = t;
+		tbl->range_count++;
+	}
+
+	/* Search for a multiplier which maps all single IDs apart */
+	for (bits = 1; bits <= ECALL_HASH_MAX_BITS; bits++) {
+		if ((1UL << bits) < single)
+			continue;
+		for (tries = 0; tries < 256; tries++, mult += 2) {
+			if (ecall_hash_try(tbl, mult, bits)) {
+				tbl->hash_mult = mult;
+				tbl->hash_bits = bits;
+				ecall_build_views(tbl);
+				return tbl;
+			}
+		}
+	}
+
+fail:
+	sbi_free(tbl);
+	return NULL;
+}
+
+/*
+ * Publish a table built on the side. The table it replaces may still be
+ * in use by a lookup on another HART and there is no point at which all
+ * of them are known to be done, so it is not freed. Late changes only
+ * happen a few times, e.g. from the unit tests.
+ */
+static void ecall_table_publish(struct ecall_table *tbl)
+{
+	__atomic_store_n(&ecall_table, tbl, __ATOMIC_RELEASE);
+}
+
+/* Hash slots are indexed first, followed by the ranges */
+static struct sbi_ecall_extension *ecall_table_find(
+				const struct ecall_table *tbl,
+				unsigned long extid, u32 *index)
+{
+	u32 lo = 0, hi = tbl->range_count, mid;
+	struct sbi_ecall_extension *t;
+
+	*index = ecall_hash_index(extid, tbl->hash_mult, tbl->hash_bits);
+	t = tbl->hash[*index];
+	if (t && t->extid_start == extid)
+		return t;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		t = tbl->range[mid];
+		if (extid < t->extid_start)
+			hi = mid;
+		else if (t->extid_end < extid)
+			lo = mid + 1;
+		else {
+			*index = ECALL_HASH_SLOTS + mid;
+			return t;
+		}
+	}
+
+	return NULL;
+}
+
+static struct sbi_ecall_extension *ecall_find(const struct ecall_table *tbl,
+					      unsigned long extid, u32 *index)
 {
 	struct sbi_ecall_extension *t, *ret = NULL;
 
+	if (tbl)
+		return ecall_table_find(tbl, extid, index);
+
 	sbi_list_for_each_entry(t, &ecall_exts_list, head) {
 		if (t->extid_start <= extid && extid <= t->extid_end) {
 			ret = t;
@@ -53,36 +253,154 @@ struct sbi_ecall_extension *sbi_ecall_find_extension(unsigned long extid)
 	return ret;
 }
 
+struct sbi_ecall_extension *sbi_ecall_find_extension(unsigned long extid)
+{
+	u32 index;
+
+	return ecall_find(ecall_table_get(), extid, &index);
+}
+
+/* Must only be called for extensions with a domain_allowed callback */
+static bool ecall_domain_allowed(const struct ecall_table *tbl,
+				 const struct sbi_domain *dom,
+				 struct sbi_ecall_extension *ext, u32 index)
+{
+	const struct ecall_view *v;
+
+	if (!tbl || tbl->view_count <= dom->index)
+		return ext->domain_allowed(dom);
+
+	v = &tbl->views[dom->index];
+	if (index < ECALL_HASH_SLOTS)
+		return v->hash_allowed & (1ULL << index);
+
+	return v->range_allowed & (1U << (index - ECALL_HASH_SLOTS));
+}
+
+/* The domain of the calling HART is used if dom is NULL */
+static struct sbi_ecall_extension *ecall_domain_find(
+				const struct ecall_table *tbl,
+				const struct sbi_domain *dom,
+				unsigned long extid, u32 *index)
+{
+	struct sbi_ecall_extension *ext = ecall_find(tbl, extid, index);
+
+	if (ext && ext->domain_allowed) {
+		if (!dom)
+			dom = sbi_domain_thishart_ptr();
+		if (!dom || !ecall_domain_allowed(tbl, dom, ext, *index))
+			return NULL;
+	}
+
+	return ext;
+}
+
+struct sbi_ecall_extension *sbi_ecall_domain_find_extension(
+				const struct sbi_domain *dom,
+				unsigned long extid)
+{
+	u32 index;
+
+	return ecall_domain_find(ecall_table_get(), dom, extid, &index);
+}
+
+void sbi_ecall_probe_invalidate(void)
+{
+	__atomic_add_fetch(&ecall_probe_gen, 1, __ATOMIC_RELEASE);
+}
+
+int sbi_ecall_domain_probe(const struct sbi_domain *dom, unsigned long extid,
+			   unsigned long *out_val)
+{
+	struct ecall_table *tbl = ecall_table_get();
+	struct sbi_ecall_extension *ext;
+	struct ecall_probe_cache *pc = NULL;
+	unsigned long gen;
+	u32 index;
+	int rc;
+
+	ext = ecall_domain_find(tbl, dom, extid, &index);
+	if (!ext) {
+		*out_val = 0;
+		return 0;
+	}
+
+	if (!ext->probe) {
+		*out_val = 1;
+		return 0;
+	}
+
+	/* Range extensions are probed per ID so they are not cached */
+	gen = __atomic_load_n(&ecall_probe_gen, __ATOMIC_ACQUIRE);
+	if (tbl && index < ECALL_HASH_SLOTS) {
+		pc = &tbl->probe[index];
+		if (__atomic_load_n(&pc->gen, __ATOMIC_ACQUIRE) == gen) {
+			*out_val = pc->value;
+			return 0;
+		}
+	}
+
+	rc = ext->probe(extid, out_val);
+	if (!rc && pc) {
+		pc->value = *out_val;
+		__atomic_store_n(&pc->gen, gen, __ATOMIC_RELEASE);
+	}
+
+	return rc;
+}
+
 int sbi_ecall_register_extension(struct sbi_ecall_extension *ext)
 {
 	struct sbi_ecall_extension *t;
+	struct ecall_table *tbl;
+	int rc = 0;
 
 	if (!ext || (ext->extid_end < ext->extid_start) || !ext->handle)
 		return SBI_EINVAL;
 
+	spin_lock(&ecall_table_lock);
+
 	sbi_list_for_each_entry(t, &ecall_exts_list, head) {
 		unsigned long start = t->extid_start;
 		unsigned long end = t->extid_end;
 		if (end < ext->extid_start || ext->extid_end < start)
 			/* no overlap */;
-		else
-			return SBI_EINVAL;
+		else {
+			rc = SBI_EINVAL;
+			goto done;
+		}
 	}
 
+	/* Lookups keep using the published table while the list changes */
 	SBI_INIT_LIST_HEAD(&ext->head);
 	sbi_list_add_tail(&ext->head, &ecall_exts_list);
 
-	return 0;
+	if (ecall_table) {
+		tbl = ecall_table_build();
+		if (!tbl) {
+			sbi_list_del_init(&ext->head);
+			rc = SBI_ENOSPC;
+			goto done;
+		}
+		ecall_table_publish(tbl);
+	}
+
+done:
+	spin_unlock(&ecall_table_lock);
+	return rc;
 }
 
 void sbi_ecall_unregister_extension(struct sbi_ecall_extension *ext)
 {
 	bool found = false;
 	struct sbi_ecall_extension *t;
+	struct ecall_table *tbl;
 
 	if (!ext)
 		return;
 
+	spin_lock(&ecall_table_lock);
+
 	sbi_list_for_each_entry(t, &ecall_exts_list, head) {
 		if (t == ext) {
 			found = true;
@@ -90,8 +408,19 @@ void sbi_ecall_unregister_extension(struct sbi_ecall_extension *ext)
 		}
 	}
 
-	if (found)
+	if (found) {
 		sbi_list_del_init(&ext->head);
+		if (ecall_table) {
+			/* The extension stays if there is no memory left */
+			tbl = ecall_table_build();
+			if (tbl)
+				ecall_table_publish(tbl);
+			else
+				sbi_list_add_tail(&ext->head, &ecall_exts_list);
+		}
+	}
+
+	spin_unlock(&ecall_table_lock);
 }
 
 int sbi_ecall_handler(struct sbi_trap_context *tcntx)
@@ -99,12 +428,16 @@ int sbi_ecall_handler(struct sbi_trap_context *tcntx)
 	int ret = 0;
 	struct sbi_trap_regs *regs = &tcntx->regs;
 	struct sbi_ecall_extension *ext;
+	u32 index;
 	unsigned long extension_id = regs->a7;
 	unsigned long func_id = regs->a6;
 	struct sbi_ecall_return out = {0};
 	bool is_0_1_spec = 0;
+	unsigned long start = sbi_ecall_profile_start();
+	struct sbi_ecall_trace_entry *trace = sbi_ecall_trace_enter(regs);
 
-	ext = sbi_ecall_find_extension(extension_id);
+	sbi_tracepoint(ecall, extension_id);
+	ext = ecall_domain_find(ecall_table_get(), NULL, extension_id, &index);
 	if (ext && ext->handle) {
 		ret = ext->handle(extension_id, func_id, regs, &out);
 		if (extension_id >= SBI_EXT_0_1_SET_TIMER &&
@@ -138,6 +471,9 @@ int sbi_ecall_handler(struct sbi_trap_context *tcntx)
 			regs->a1 = out.value;
 	}
 
+	sbi_ecall_trace_exit(trace, ret);
+	sbi_ecall_profile_record(extension_id, func_id, start);
+
 	return 0;
 }
 
@@ -157,5 +493,8 @@ int sbi_ecall_init(void)
 			return ret;
 	}
 
+	/* Keep using the list if there is no perfect hash */
+	ecall_table_publish(ecall_table_build());
+
 	return 0;
 }
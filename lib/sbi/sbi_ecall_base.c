@@ -8,6 +8,7 @@
  *   Atish Patra <atish.patra@wdc.com>
  */
 
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_ecall.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
@@ -15,23 +16,6 @@
 #include <sbi/sbi_version.h>
 #include <sbi/riscv_asm.h>
 
-static int sbi_ecall_base_probe(unsigned long extid, unsigned long *out_val)
-{
-	struct sbi_ecall_extension *ext;
-
-	ext = sbi_ecall_find_extension(extid);
-	if (!ext) {
-		*out_val = 0;
-		return 0;
-	}
-
-	if (ext->probe)
-		return ext->probe(extid, out_val);
-
-	*out_val = 1;
-	return 0;
-}
-
 static int sbi_ecall_base_handler(unsigned long extid, unsigned long funcid,
 				  struct sbi_trap_regs *regs,
 				  struct sbi_ecall_return *out)
@@ -62,7 +46,8 @@ static int sbi_ecall_base_handler(unsigned long extid, unsigned long funcid,
 		out->value = csr_read(CSR_MIMPID);
 		break;
 	case SBI_EXT_BASE_PROBE_EXT:
-		ret = sbi_ecall_base_probe(regs->a0, &out->value);
+		ret = sbi_ecall_domain_probe(sbi_domain_thishart_ptr(),
+					     regs->a0, &out->value);
 		break;
 	default:
 		ret = SBI_ENOTSUPP;
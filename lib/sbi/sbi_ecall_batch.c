@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Experimental extension for batched SBI calls
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_batch.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_trap.h>
+
+static int sbi_ecall_batch_handler(unsigned long extid, unsigned long funcid,
+				   struct sbi_trap_regs *regs,
+				   struct sbi_ecall_return *out)
+{
+	unsigned long smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+	int ret = 0;
+
+	switch (funcid) {
+	case SBI_EXT_BATCH_SETUP_SHMEM:
+		ret = sbi_batch_setup_shmem(sbi_domain_thishart_ptr(), smode,
+					    regs->a0, regs->a1, regs->a2);
+		break;
+	case SBI_EXT_BATCH_SUBMIT:
+		ret = sbi_batch_submit(regs, &out->value);
+		break;
+	case SBI_EXT_BATCH_REMOTE_SFENCE_VMA_ASID_LIST:
+		ret = sbi_batch_sfence_vma_asid_list(sbi_domain_thishart_ptr(),
+						     smode, regs->a0, regs->a1,
+						     regs->a2, regs->a3,
+						     regs->a4);
+		break;
+	default:
+		ret = SBI_ENOTSUPP;
+	};
+
+	return ret;
+}
+
+struct sbi_ecall_extension ecall_batch;
+
+static int sbi_ecall_batch_register_extensions(void)
+{
+	int ret;
+
+	ret = sbi_batch_init();
+	if (ret)
+		return ret;
+
+	return sbi_ecall_register_extension(&ecall_batch);
+}
+
+struct sbi_ecall_extension ecall_batch = {
+	.extid_start		= SBI_EXT_BATCH,
+	.extid_end		= SBI_EXT_BATCH,
+	.register_extensions	= sbi_ecall_batch_register_extensions,
+	.handle			= sbi_ecall_batch_handler,
+};
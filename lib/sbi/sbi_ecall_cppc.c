@@ -58,9 +58,15 @@ struct sbi_ecall_extension ecall_cppc;
 
 static int sbi_ecall_cppc_register_extensions(void)
 {
+	int ret;
+
 	if (!sbi_cppc_get_device())
 		return 0;
 
+	ret = sbi_cppc_fastchan_init();
+	if (ret)
+		return ret;
+
 	return sbi_ecall_register_extension(&ecall_cppc);
 }
 
@@ -28,9 +28,14 @@ static bool sbi_load_hart_mask_unpriv(ulong *pmask, ulong *hmask, ulong *hbase,
 {
 	ulong mask = 0;
 
+	/*
+	 * Share the bulk copy with the other users of S-mode memory so a
+	 * misaligned mask crossing a page is read byte by byte and faults
+	 * are reported at the first byte which could not be read.
+	 */
 	if (pmask) {
-		mask = sbi_load_ulong(pmask, uptrap);
-		if (uptrap->cause)
+		if (sbi_copy_from_lower(&mask, pmask, sizeof(mask), uptrap) !=
+		    sizeof(mask))
 			return false;
 		*hbase = 0;
 	} else {
@@ -0,0 +1,69 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Nested acceleration (NACL) extension
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_nacl.h>
+#include <sbi/sbi_trap.h>
+
+static int sbi_ecall_nacl_handler(unsigned long extid, unsigned long funcid,
+				  struct sbi_trap_regs *regs,
+				  struct sbi_ecall_return *out)
+{
+	unsigned long smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+	int ret = 0;
+
+	/* Only the hypervisor itself may touch its CSRs and fences */
+	if (sbi_regs_from_virt(regs))
+		return SBI_ENOTSUPP;
+
+	switch (funcid) {
+	case SBI_EXT_NACL_PROBE_FEATURE:
+		out->value = sbi_nacl_feature_available(regs->a0);
+		break;
+	case SBI_EXT_NACL_SET_SHMEM:
+		ret = sbi_nacl_set_shmem(sbi_domain_thishart_ptr(), smode,
+					 regs->a0, regs->a1, regs->a2);
+		break;
+	case SBI_EXT_NACL_SYNC_CSR:
+		ret = sbi_nacl_sync_csr(regs->a0);
+		break;
+	case SBI_EXT_NACL_SYNC_HFENCE:
+		ret = sbi_nacl_sync_hfence(regs->a0);
+		break;
+	default:
+		ret = SBI_ENOTSUPP;
+	};
+
+	return ret;
+}
+
+struct sbi_ecall_extension ecall_nacl;
+
+static int sbi_ecall_nacl_register_extensions(void)
+{
+	int ret;
+
+	if (!misa_extension('H'))
+		return 0;
+
+	ret = sbi_nacl_init();
+	if (ret)
+		return ret;
+
+	return sbi_ecall_register_extension(&ecall_nacl);
+}
+
+struct sbi_ecall_extension ecall_nacl = {
+	.extid_start		= SBI_EXT_NACL,
+	.extid_end		= SBI_EXT_NACL,
+	.register_extensions	= sbi_ecall_nacl_register_extensions,
+	.handle			= sbi_ecall_nacl_handler,
+};
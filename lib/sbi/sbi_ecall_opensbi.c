@@ -0,0 +1,151 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * OpenSBI firmware specific SBI extension
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_bitops.h>
+#include <sbi/sbi_cache.h>
+#include <sbi/sbi_cppc.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_domain_channel.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_ecall_profile.h>
+#include <sbi/sbi_ecall_trace.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap_stats.h>
+#include <sbi/sbi_hsm.h>
+#include <sbi/sbi_hsm_stats.h>
+#include <sbi/sbi_lock_stat.h>
+#include <sbi/sbi_perf_report.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_tracepoint.h>
+#include <sbi/sbi_trap.h>
+#include <sbi/sbi_trap_ldst.h>
+#include <sbi/sbi_trap_stats.h>
+
+#ifdef CONFIG_SBI_ECALL_HSM_START_MANY
+/*
+ * Start the HARTs of hart_mask/hart_mask_base at one start address. The
+ * opaque value of the HART at bit i is element i of the args array whose
+ * address is passed in the lower and upper XLEN bits like for the other
+ * functions of this extension.
+ */
+static int opensbi_hart_start_many(struct sbi_trap_regs *regs)
+{
+	ulong smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+	ulong hmask = regs->a0, hbase = regs->a1, addr = regs->a3;
+	ulong args[BITS_PER_LONG];
+	size_t size;
+	int rc;
+
+	if (!hmask)
+		return 0;
+
+	size = (sbi_fls(hmask) + 1) * sizeof(ulong);
+	rc = sbi_domain_check_smode_buffer(addr, regs->a4, size,
+					   SBI_DOMAIN_READ);
+	if (rc)
+		return rc;
+
+	sbi_hart_map_saddr(addr, size);
+	sbi_memcpy(args, (void *)addr, size);
+	sbi_hart_unmap_saddr();
+
+	return sbi_hsm_hart_start_many(sbi_scratch_thishart_ptr(),
+				       sbi_domain_thishart_ptr(),
+				       hmask, hbase, regs->a2, smode, args);
+}
+#else
+static int opensbi_hart_start_many(struct sbi_trap_regs *regs)
+{
+	return SBI_ENOTSUPP;
+}
+#endif
+
+/*
+ * Functions changing firmware wide state, as opposed to reading the
+ * state of the calling domain, are reserved to the root domain.
+ */
+static bool opensbi_caller_is_root(void)
+{
+	return sbi_domain_thishart_ptr() == &root;
+}
+
+static int sbi_ecall_opensbi_handler(unsigned long extid, unsigned long funcid,
+				     struct sbi_trap_regs *regs,
+				     struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_PROFILE_INFO:
+	case SBI_EXT_OPENSBI_PROFILE_READ:
+		return sbi_ecall_profile_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_TRACE_DUMP:
+		return sbi_ecall_trace_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_MISALIGNED_RATE:
+		return sbi_misaligned_monitor_rate(regs->a0, &out->value);
+	case SBI_EXT_OPENSBI_TRAP_STATS:
+		return sbi_trap_stats_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_HART_START_MANY:
+		return opensbi_hart_start_many(regs);
+	case SBI_EXT_OPENSBI_SUSPEND_STATS:
+		return sbi_hsm_stats_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_CHANNEL_SETUP:
+	case SBI_EXT_OPENSBI_CHANNEL_INFO:
+	case SBI_EXT_OPENSBI_CHANNEL_NOTIFY:
+	case SBI_EXT_OPENSBI_CHANNEL_RETURN:
+		return sbi_domain_channel_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_HEAP_STATS:
+		return sbi_heap_stats_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_LOCK_STATS:
+		if ((regs->a2 & SBI_LOCK_STAT_FLAG_RESET) &&
+		    !opensbi_caller_is_root())
+			return SBI_EDENIED;
+		return sbi_lock_stat_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_CPPC_FASTCHAN:
+		return sbi_cppc_fastchan_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_PERF_REPORT:
+		return sbi_perf_report_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_TRACEPOINT_CTL:
+		if (!opensbi_caller_is_root())
+			return SBI_EDENIED;
+		return sbi_tracepoint_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_TRACEPOINT_READ:
+		return sbi_tracepoint_handle(funcid, regs, out);
+	case SBI_EXT_OPENSBI_CACHE_OPS:
+		return sbi_cache_handle(funcid, regs, out);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+struct sbi_ecall_extension ecall_opensbi;
+
+static int sbi_ecall_opensbi_register_extensions(void)
+{
+	int ret;
+
+	ret = sbi_ecall_profile_init();
+	if (ret)
+		return ret;
+
+	ret = sbi_ecall_trace_init();
+	if (ret)
+		return ret;
+
+	return sbi_ecall_register_extension(&ecall_opensbi);
+}
+
+struct sbi_ecall_extension ecall_opensbi = {
+	.extid_start		= SBI_EXT_OPENSBI,
+	.extid_end		= SBI_EXT_OPENSBI,
+	.register_extensions	= sbi_ecall_opensbi_register_extensions,
+	.handle			= sbi_ecall_opensbi_handler,
+};
@@ -0,0 +1,198 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Per-extension and per-function ecall latency profiler
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_bitops.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_ecall_profile.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_trap.h>
+
+struct ecall_profile {
+	/** Calls which found no free slot */
+	unsigned long dropped;
+	struct sbi_ecall_profile_entry entries[SBI_ECALL_PROFILE_SLOTS];
+};
+
+static unsigned long ecall_profile_off;
+
+static struct ecall_profile *ecall_profile_ptr(struct sbi_scratch *scratch)
+{
+	if (!ecall_profile_off || !scratch)
+		return NULL;
+
+	return sbi_scratch_read_type(scratch, void *, ecall_profile_off);
+}
+
+static struct sbi_ecall_profile_entry *ecall_profile_slot(
+					struct ecall_profile *prof,
+					unsigned long extid,
+					unsigned long funcid)
+{
+	u32 i, slot;
+	struct sbi_ecall_profile_entry *e;
+
+	slot = ((u32)extid * 0x9e3779b1) ^ (u32)funcid;
+	for (i = 0; i < SBI_ECALL_PROFILE_SLOTS; i++) {
+		e = &prof->entries[(slot + i) & (SBI_ECALL_PROFILE_SLOTS - 1)];
+		if (!e->count) {
+			e->extid = extid;
+			e->funcid = funcid;
+			e->min_cycles = -1ULL;
+			return e;
+		}
+		if (e->extid == (u32)extid && e->funcid == (u32)funcid)
+			return e;
+	}
+
+	return NULL;
+}
+
+void sbi_ecall_profile_record(unsigned long extid, unsigned long funcid,
+			      unsigned long start)
+{
+	unsigned long cycles = csr_read(CSR_MCYCLE) - start;
+	struct ecall_profile *prof =
+			ecall_profile_ptr(sbi_scratch_thishart_ptr());
+	struct sbi_ecall_profile_entry *e;
+	u32 bucket;
+
+	if (!prof)
+		return;
+
+	e = ecall_profile_slot(prof, extid, funcid);
+	if (!e) {
+		prof->dropped++;
+		return;
+	}
+
+	e->count++;
+	e->total_cycles += cycles;
+	if (cycles < e->min_cycles)
+		e->min_cycles = cycles;
+	if (e->max_cycles < cycles)
+		e->max_cycles = cycles;
+
+	bucket = cycles ? sbi_fls(cycles) : 0;
+	if (SBI_ECALL_PROFILE_HIST <= bucket)
+		bucket = SBI_ECALL_PROFILE_HIST - 1;
+	e->hist[bucket]++;
+}
+
+void sbi_ecall_profile_dump(void)
+{
+	u32 i, j, k;
+	struct ecall_profile *prof;
+	struct sbi_ecall_profile_entry *e;
+
+	if (!ecall_profile_off)
+		return;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		prof = ecall_profile_ptr(sbi_hartindex_to_scratch(i));
+		if (!prof)
+			continue;
+
+		for (j = 0; j < SBI_ECALL_PROFILE_SLOTS; j++) {
+			e = &prof->entries[j];
+			if (!e->count)
+				continue;
+
+			sbi_printf("hart%u: ecall ext=0x%x fid=0x%x count=%lu "
+				   "cycles min=%lu avg=%lu max=%lu\n",
+				   sbi_hartindex_to_hartid(i), e->extid,
+				   e->funcid, (ulong)e->count,
+				   (ulong)e->min_cycles,
+				   (ulong)(e->total_cycles / e->count),
+				   (ulong)e->max_cycles);
+			sbi_printf("hart%u: ecall log2(cycles) histogram:",
+				   sbi_hartindex_to_hartid(i));
+			for (k = 0; k < SBI_ECALL_PROFILE_HIST; k++)
+				sbi_printf(" %u", e->hist[k]);
+			sbi_printf("\n");
+		}
+
+		if (prof->dropped)
+			sbi_printf("hart%u: ecall profile dropped %lu calls\n",
+				   sbi_hartindex_to_hartid(i), prof->dropped);
+	}
+}
+
+const struct sbi_ecall_profile_entry *sbi_ecall_profile_get(u32 hartindex)
+{
+	struct ecall_profile *prof =
+			ecall_profile_ptr(sbi_hartindex_to_scratch(hartindex));
+
+	return prof ? prof->entries : NULL;
+}
+
+static int ecall_profile_read(unsigned long hartid, unsigned long slot,
+			      unsigned long addr_lo, unsigned long addr_hi)
+{
+	struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	u32 hartindex = sbi_hartid_to_hartindex(hartid);
+	struct ecall_profile *prof;
+
+	if (!sbi_domain_is_assigned_hart(dom, hartindex) ||
+	    SBI_ECALL_PROFILE_SLOTS <= slot)
+		return SBI_EINVAL;
+
+	prof = ecall_profile_ptr(sbi_hartindex_to_scratch(hartindex));
+	if (!prof)
+		return SBI_EINVAL;
+
+	/* The copy may race with the HART updating its profile */
+	return sbi_domain_copy_to_smode(addr_lo, addr_hi, &prof->entries[slot],
+					sizeof(struct sbi_ecall_profile_entry));
+}
+
+int sbi_ecall_profile_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			     struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_PROFILE_INFO:
+		out->value = SBI_ECALL_PROFILE_SLOTS;
+		return 0;
+	case SBI_EXT_OPENSBI_PROFILE_READ:
+		return ecall_profile_read(regs->a0, regs->a1,
+					  regs->a2, regs->a3);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+int sbi_ecall_profile_init(void)
+{
+	u32 i;
+	struct sbi_scratch *scratch;
+	struct ecall_profile *prof;
+
+	ecall_profile_off = sbi_scratch_alloc_type_offset(void *);
+	if (!ecall_profile_off)
+		return SBI_ENOMEM;
+
+	/* HARTs without a profile are simply not profiled */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+		prof = sbi_zalloc(sizeof(*prof));
+		if (!prof)
+			break;
+		sbi_scratch_write_type(scratch, void *, ecall_profile_off, prof);
+	}
+
+	return 0;
+}
@@ -15,6 +15,18 @@
 #include <sbi/sbi_trap.h>
 #include <sbi/sbi_tlb.h>
 
+static int sbi_ecall_rfence_request(struct sbi_trap_regs *regs,
+				    struct sbi_tlb_info *tinfo,
+				    struct sbi_ecall_return *out)
+{
+	/* In asynchronous mode the completion token is returned in a1 */
+	if (sbi_tlb_async_enabled())
+		return sbi_tlb_async_request(regs->a0, regs->a1, tinfo,
+					     &out->value);
+
+	return sbi_tlb_request(regs->a0, regs->a1, tinfo);
+}
+
 static int sbi_ecall_rfence_handler(unsigned long extid, unsigned long funcid,
 				    struct sbi_trap_regs *regs,
 				    struct sbi_ecall_return *out)
@@ -33,41 +45,41 @@ static int sbi_ecall_rfence_handler(unsigned long extid, unsigned long funcid,
 	case SBI_EXT_RFENCE_REMOTE_FENCE_I:
 		SBI_TLB_INFO_INIT(&tlb_info, 0, 0, 0, 0,
 				  SBI_TLB_FENCE_I, source_hart);
-		ret = sbi_tlb_request(regs->a0, regs->a1, &tlb_info);
+		ret = sbi_ecall_rfence_request(regs, &tlb_info, out);
 		break;
 	case SBI_EXT_RFENCE_REMOTE_HFENCE_GVMA:
 		SBI_TLB_INFO_INIT(&tlb_info, regs->a2, regs->a3, 0, 0,
 				  SBI_TLB_HFENCE_GVMA, source_hart);
-		ret = sbi_tlb_request(regs->a0, regs->a1, &tlb_info);
+		ret = sbi_ecall_rfence_request(regs, &tlb_info, out);
 		break;
 	case SBI_EXT_RFENCE_REMOTE_HFENCE_GVMA_VMID:
 		SBI_TLB_INFO_INIT(&tlb_info, regs->a2, regs->a3, 0, regs->a4,
 				  SBI_TLB_HFENCE_GVMA_VMID, source_hart);
-		ret = sbi_tlb_request(regs->a0, regs->a1, &tlb_info);
+		ret = sbi_ecall_rfence_request(regs, &tlb_info, out);
 		break;
 	case SBI_EXT_RFENCE_REMOTE_HFENCE_VVMA:
 		vmid = (csr_read(CSR_HGATP) & HGATP_VMID_MASK);
 		vmid = vmid >> HGATP_VMID_SHIFT;
 		SBI_TLB_INFO_INIT(&tlb_info, regs->a2, regs->a3, 0, vmid,
 				  SBI_TLB_HFENCE_VVMA, source_hart);
-		ret = sbi_tlb_request(regs->a0, regs->a1, &tlb_info);
+		ret = sbi_ecall_rfence_request(regs, &tlb_info, out);
 		break;
 	case SBI_EXT_RFENCE_REMOTE_HFENCE_VVMA_ASID:
 		vmid = (csr_read(CSR_HGATP) & HGATP_VMID_MASK);
 		vmid = vmid >> HGATP_VMID_SHIFT;
 		SBI_TLB_INFO_INIT(&tlb_info, regs->a2, regs->a3, regs->a4,
 				  vmid, SBI_TLB_HFENCE_VVMA_ASID, source_hart);
-		ret = sbi_tlb_request(regs->a0, regs->a1, &tlb_info);
+		ret = sbi_ecall_rfence_request(regs, &tlb_info, out);
 		break;
 	case SBI_EXT_RFENCE_REMOTE_SFENCE_VMA:
 		SBI_TLB_INFO_INIT(&tlb_info, regs->a2, regs->a3, 0, 0,
 				  SBI_TLB_SFENCE_VMA, source_hart);
-		ret = sbi_tlb_request(regs->a0, regs->a1, &tlb_info);
+		ret = sbi_ecall_rfence_request(regs, &tlb_info, out);
 		break;
 	case SBI_EXT_RFENCE_REMOTE_SFENCE_VMA_ASID:
 		SBI_TLB_INFO_INIT(&tlb_info, regs->a2, regs->a3, regs->a4, 0,
 				  SBI_TLB_SFENCE_VMA_ASID, source_hart);
-		ret = sbi_tlb_request(regs->a0, regs->a1, &tlb_info);
+		ret = sbi_ecall_rfence_request(regs, &tlb_info, out);
 		break;
 	default:
 		ret = SBI_ENOTSUPP;
@@ -0,0 +1,42 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Steal-time accounting (STA) extension
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_domain_context.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_trap.h>
+
+static int sbi_ecall_sta_handler(unsigned long extid, unsigned long funcid,
+				 struct sbi_trap_regs *regs,
+				 struct sbi_ecall_return *out)
+{
+	unsigned long smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+
+	switch (funcid) {
+	case SBI_EXT_STA_STEAL_TIME_SET_SHMEM:
+		return sbi_domain_context_sta_set_shmem(smode, regs->a0,
+							regs->a1, regs->a2);
+	default:
+		return SBI_ENOTSUPP;
+	}
+}
+
+struct sbi_ecall_extension ecall_sta;
+
+static int sbi_ecall_sta_register_extensions(void)
+{
+	return sbi_ecall_register_extension(&ecall_sta);
+}
+
+struct sbi_ecall_extension ecall_sta = {
+	.extid_start		= SBI_EXT_STA,
+	.extid_end		= SBI_EXT_STA,
+	.register_extensions	= sbi_ecall_sta_register_extensions,
+	.handle			= sbi_ecall_sta_handler,
+};
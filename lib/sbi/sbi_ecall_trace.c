@@ -0,0 +1,147 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Per-hart ecall trace ring buffer
+ */
+
+#include <sbi/riscv_barrier.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_ecall_trace.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_timer.h>
+#include <sbi/sbi_trap.h>
+
+#define ECALL_TRACE_ENTRIES	CONFIG_SBI_ECALL_TRACE_ENTRIES
+
+#if ECALL_TRACE_ENTRIES & (ECALL_TRACE_ENTRIES - 1)
+#error "CONFIG_SBI_ECALL_TRACE_ENTRIES must be a power of two"
+#endif
+
+/*
+ * Only the owner HART writes its ring. The position is advanced once
+ * an entry is complete so a reader never sees the entry being written
+ * as part of the trace, although it may see an older entry of the same
+ * slot being overwritten.
+ */
+struct ecall_trace {
+	unsigned long pos;
+	struct sbi_ecall_trace_entry entries[ECALL_TRACE_ENTRIES];
+};
+
+static unsigned long ecall_trace_off;
+
+static struct ecall_trace *ecall_trace_ptr(struct sbi_scratch *scratch)
+{
+	if (!ecall_trace_off || !scratch)
+		return NULL;
+
+	return sbi_scratch_read_type(scratch, void *, ecall_trace_off);
+}
+
+struct sbi_ecall_trace_entry *sbi_ecall_trace_enter(struct sbi_trap_regs *regs)
+{
+	struct sbi_ecall_trace_entry *ent;
+	struct ecall_trace *trace = ecall_trace_ptr(sbi_scratch_thishart_ptr());
+
+	if (!trace)
+		return NULL;
+
+	ent = &trace->entries[trace->pos & (ECALL_TRACE_ENTRIES - 1)];
+	ent->extid = regs->a7;
+	ent->funcid = regs->a6;
+	ent->args[0] = regs->a0;
+	ent->args[1] = regs->a1;
+	ent->args[2] = regs->a2;
+	ent->enter_time = sbi_timer_value();
+
+	return ent;
+}
+
+void sbi_ecall_trace_exit(struct sbi_ecall_trace_entry *ent, int error)
+{
+	struct ecall_trace *trace;
+
+	if (!ent)
+		return;
+
+	ent->error = error;
+	ent->exit_time = sbi_timer_value();
+
+	trace = ecall_trace_ptr(sbi_scratch_thishart_ptr());
+	__atomic_store_n(&trace->pos, trace->pos + 1, __ATOMIC_RELEASE);
+}
+
+void sbi_ecall_trace_dump(u32 hartindex)
+{
+	unsigned long pos, first;
+	struct sbi_ecall_trace_entry *ent;
+	u32 hartid = sbi_hartindex_to_hartid(hartindex);
+	struct ecall_trace *trace =
+			ecall_trace_ptr(sbi_hartindex_to_scratch(hartindex));
+
+	if (!trace)
+		return;
+
+	pos = __atomic_load_n(&trace->pos, __ATOMIC_ACQUIRE);
+	first = (pos > ECALL_TRACE_ENTRIES) ? pos - ECALL_TRACE_ENTRIES : 0;
+
+	sbi_printf("hart%u: last %lu of %lu ecalls\n", hartid,
+		   pos - first, pos);
+	for (; first < pos; first++) {
+		ent = &trace->entries[first & (ECALL_TRACE_ENTRIES - 1)];
+		sbi_printf("hart%u: ecall %lu ext=0x%lx fid=0x%lx "
+			   "args=0x%lx,0x%lx,0x%lx error=%ld "
+			   "time=%lu+%lu\n", hartid, first, ent->extid,
+			   ent->funcid, ent->args[0], ent->args[1],
+			   ent->args[2], ent->error, (ulong)ent->enter_time,
+			   (ulong)(ent->exit_time - ent->enter_time));
+	}
+}
+
+int sbi_ecall_trace_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			   struct sbi_ecall_return *out)
+{
+	u32 hartindex;
+
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_TRACE_DUMP:
+		hartindex = sbi_hartid_to_hartindex(regs->a0);
+		if (!sbi_domain_is_assigned_hart(sbi_domain_thishart_ptr(),
+						 hartindex))
+			return SBI_EINVAL;
+		sbi_ecall_trace_dump(hartindex);
+		return 0;
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+int sbi_ecall_trace_init(void)
+{
+	u32 i;
+	struct sbi_scratch *scratch;
+	struct ecall_trace *trace;
+
+	ecall_trace_off = sbi_scratch_alloc_type_offset(void *);
+	if (!ecall_trace_off)
+		return SBI_ENOMEM;
+
+	/* HARTs without a ring are simply not traced */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+		trace = sbi_zalloc(sizeof(*trace));
+		if (!trace)
+			break;
+		sbi_scratch_write_type(scratch, void *, ecall_trace_off, trace);
+	}
+
+	return 0;
+}
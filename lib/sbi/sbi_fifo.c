@@ -10,6 +10,7 @@
 #include <sbi/riscv_locks.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_fifo.h>
+#include <sbi/sbi_hart.h>
 #include <sbi/sbi_string.h>
 
 void sbi_fifo_init(struct sbi_fifo *fifo, void *queue_mem, u16 entries,
@@ -19,8 +20,9 @@ void sbi_fifo_init(struct sbi_fifo *fifo, void *queue_mem, u16 entries,
 	fifo->num_entries = entries;
 	fifo->entry_size  = entry_size;
 	SPIN_LOCK_INIT(fifo->qlock);
+	spin_lock_set_name(&fifo->qlock, "fifo");
 	fifo->avail = fifo->tail = 0;
-	sbi_memset(fifo->queue, 0, (size_t)entries * entry_size);
+	sbi_hart_memzero(fifo->queue, (size_t)entries * entry_size);
 }
 
 /* Note: must be called with fifo->qlock held */
@@ -11,10 +11,12 @@
 #include <sbi/sbi_bitmap.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_fwft.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_tlb.h>
 #include <sbi/sbi_types.h>
 
 #include <sbi/riscv_asm.h>
@@ -34,6 +36,16 @@ static unsigned long fwft_ptr_offset;
 
 #define MIS_DELEG (1UL << CAUSE_MISALIGNED_LOAD | 1UL << CAUSE_MISALIGNED_STORE)
 
+/** menvcfg and medeleg bits which are owned by FWFT features */
+#if __riscv_xlen > 32
+#define FWFT_MENVCFG_BITS	(ENVCFG_ADUE | ENVCFG_DTE | ENVCFG_PMM | \
+				 ENVCFG_SSE | ENVCFG_LPE)
+#else
+#define FWFT_MENVCFG_BITS	(ENVCFG_ADUE | ENVCFG_DTE | \
+				 ENVCFG_SSE | ENVCFG_LPE)
+#endif
+#define FWFT_MEDELEG_BITS	MIS_DELEG
+
 struct fwft_config;
 
 struct fwft_feature {
@@ -49,6 +61,10 @@ struct fwft_config {
 };
 
 struct fwft_hart_state {
+	/** FWFT state of the HART after boot, given to new domains */
+	struct sbi_fwft_context boot;
+	/** FWFT state currently live in the HART CSRs */
+	struct sbi_fwft_context live;
 	unsigned int config_count;
 	struct fwft_config configs[];
 };
@@ -108,6 +124,43 @@ static int fwft_menvcfg_read_bit(unsigned long *value, unsigned long bit)
 	return SBI_OK;
 }
 
+static bool fwft_has_menvcfg(struct sbi_scratch *scratch)
+{
+	return sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_12;
+}
+
+static u64 fwft_menvcfg_read(void)
+{
+	u64 cfg = csr_read(CSR_MENVCFG);
+
+#if __riscv_xlen == 32
+	cfg |= ((u64)csr_read(CSR_MENVCFGH)) << 32;
+#endif
+
+	return cfg;
+}
+
+/* Capture the FWFT owned CSR bits and feature locks of the HART */
+static void fwft_capture_state(struct sbi_scratch *scratch,
+			       struct fwft_hart_state *fhs,
+			       struct sbi_fwft_context *fctx)
+{
+	int i;
+
+	fctx->menvcfg = 0;
+	if (fwft_has_menvcfg(scratch))
+		fctx->menvcfg = fwft_menvcfg_read() & FWFT_MENVCFG_BITS;
+	fctx->medeleg = csr_read(CSR_MEDELEG) & FWFT_MEDELEG_BITS;
+
+	fctx->locked = 0;
+	for (i = 0; i < fhs->config_count; i++) {
+		if (fhs->configs[i].flags & SBI_FWFT_SET_FLAG_LOCK)
+			fctx->locked |= BIT(i);
+	}
+	fctx->async_rfence = sbi_tlb_async_enabled();
+	fctx->valid = true;
+}
+
 static int fwft_misaligned_delegation_supported(struct fwft_config *conf)
 {
 	if (!misa_extension('S'))
@@ -328,6 +381,7 @@ int sbi_fwft_set(enum sbi_fwft_feature_t feature, unsigned long value,
 {
 	int ret;
 	struct fwft_config *conf;
+	struct fwft_hart_state *fhs;
 
 	ret = fwft_get_feature(feature, &conf);
 	if (ret)
@@ -345,6 +399,9 @@ int sbi_fwft_set(enum sbi_fwft_feature_t feature, unsigned long value,
 
 	conf->flags = flags;
 
+	fhs = fwft_thishart_state_ptr();
+	fwft_capture_state(sbi_scratch_thishart_ptr(), fhs, &fhs->live);
+
 	return SBI_OK;
 }
 
@@ -360,6 +417,39 @@ int sbi_fwft_get(enum sbi_fwft_feature_t feature, unsigned long *out_val)
 	return conf->feature->get(conf, out_val);
 }
 
+static int fwft_set_async_rfence(struct fwft_config *conf,
+				 unsigned long value)
+{
+	if (value != 0 && value != 1)
+		return SBI_EINVAL;
+
+	sbi_tlb_async_enable(value);
+
+	return SBI_OK;
+}
+
+static int fwft_get_async_rfence(struct fwft_config *conf,
+				 unsigned long *value)
+{
+	*value = sbi_tlb_async_enabled();
+
+	return SBI_OK;
+}
+
+static int fwft_set_async_rfence_done(struct fwft_config *conf,
+				      unsigned long value)
+{
+	return SBI_EDENIED;
+}
+
+static int fwft_get_async_rfence_done(struct fwft_config *conf,
+				      unsigned long *value)
+{
+	*value = sbi_tlb_async_completed();
+
+	return SBI_OK;
+}
+
 static const struct fwft_feature features[] =
 {
 	{
@@ -400,8 +490,66 @@ static const struct fwft_feature features[] =
 		.get = fwft_get_pmlen,
 	},
 #endif
+	{
+		.id = SBI_FWFT_OPENSBI_ASYNC_RFENCE,
+		.set = fwft_set_async_rfence,
+		.get = fwft_get_async_rfence,
+	},
+	{
+		.id = SBI_FWFT_OPENSBI_ASYNC_RFENCE_DONE,
+		.set = fwft_set_async_rfence_done,
+		.get = fwft_get_async_rfence_done,
+	},
 };
 
+void sbi_fwft_context_switch(struct sbi_fwft_context *prev,
+			     struct sbi_fwft_context *next)
+{
+	int i;
+	u64 menvcfg;
+	unsigned long medeleg;
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct fwft_hart_state *fhs = fwft_get_hart_state_ptr(scratch);
+
+	if (!fhs)
+		return;
+
+	/* A domain entered for the first time starts from the boot state */
+	if (!next->valid)
+		*next = fhs->boot;
+
+	*prev = fhs->live;
+
+	if (next->locked != prev->locked) {
+		for (i = 0; i < fhs->config_count; i++) {
+			if (next->locked & BIT(i))
+				fhs->configs[i].flags |= SBI_FWFT_SET_FLAG_LOCK;
+			else
+				fhs->configs[i].flags &= ~SBI_FWFT_SET_FLAG_LOCK;
+		}
+	}
+
+	if (next->menvcfg != prev->menvcfg && fwft_has_menvcfg(scratch)) {
+		menvcfg = fwft_menvcfg_read() & ~FWFT_MENVCFG_BITS;
+		menvcfg |= next->menvcfg;
+		csr_write(CSR_MENVCFG, menvcfg);
+#if __riscv_xlen == 32
+		if ((next->menvcfg ^ prev->menvcfg) >> 32)
+			csr_write(CSR_MENVCFGH, menvcfg >> 32);
+#endif
+	}
+
+	if (next->medeleg != prev->medeleg) {
+		medeleg = csr_read(CSR_MEDELEG) & ~FWFT_MEDELEG_BITS;
+		csr_write(CSR_MEDELEG, medeleg | next->medeleg);
+	}
+
+	if (next->async_rfence != prev->async_rfence)
+		sbi_tlb_async_enable(next->async_rfence);
+
+	fhs->live = *next;
+}
+
 int sbi_fwft_init(struct sbi_scratch *scratch, bool cold_boot)
 {
 	int i;
@@ -429,5 +577,8 @@ int sbi_fwft_init(struct sbi_scratch *scratch, bool cold_boot)
 	for (i = 0; i < array_size(features); i++)
 		fwft_clear_config_lock(features[i].id);
 
+	fwft_capture_state(scratch, fhs, &fhs->boot);
+	fhs->live = fhs->boot;
+
 	return 0;
 }
@@ -11,12 +11,14 @@
 #include <sbi/riscv_barrier.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/riscv_fp.h>
+#include <sbi/riscv_locks.h>
 #include <sbi/sbi_bitops.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_domain.h>
 #include <sbi/sbi_csr_detect.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_math.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_pmu.h>
@@ -26,10 +28,65 @@
 
 extern void __sbi_expected_trap(void);
 extern void __sbi_expected_trap_hext(void);
+extern void _trap_handler(void);
+extern void _trap_handler_aia(void);
+extern void _trap_handler_hyp(void);
+extern void _trap_handler_hyp_aia(void);
 
 void (*sbi_hart_expected_trap)(void) = &__sbi_expected_trap;
 
 static unsigned long hart_features_offset;
+static unsigned long hart_pmp_image_offset;
+static unsigned long hart_saddr_offset;
+#ifdef CONFIG_SBI_HART_PMP_MULTIPLEX
+static unsigned long hart_pmp_mux_offset;
+#endif
+
+/*
+ * Shared memory window last programmed into the Smepmp reserved entry.
+ * A persistent window stays mapped while the supervisor runs because
+ * the domain grants S/U-mode exactly the same access to all of it.
+ */
+struct hart_saddr_window {
+	bool valid;
+	bool mapped;
+	bool persistent;
+	unsigned long base;
+	unsigned long end;
+	unsigned long pmpaddr;
+	unsigned long cfg_on;
+	unsigned long cfg_off;
+};
+
+#ifdef CONFIG_SBI_HART_PMP_MULTIPLEX
+/* Run of domain intervals held by a pair of PMP entries */
+struct hart_pmp_slot {
+	unsigned long start;
+	unsigned long end;
+	/* Zero for a free slot */
+	unsigned long last_use;
+};
+
+/*
+ * PMP entries of a HART whose domain needs more entries than there
+ * are. Locked runs stay in the topmost entry pairs whereas the other
+ * entry pairs are slots handed to runs on access faults.
+ */
+struct hart_pmp_mux {
+	const struct sbi_domain *dom;
+	unsigned long pmp_addr_max;
+	unsigned int pmp_log2gran;
+	unsigned int slot_count;
+	unsigned long tick;
+	struct hart_pmp_slot slot[PMP_COUNT / 2];
+};
+#endif
+
+/* Raw PMP CSR values of a HART saved before a non-retentive suspend */
+struct hart_pmp_image {
+	bool valid;
+	struct sbi_hart_pmp_state state;
+};
 
 static void mstatus_init(struct sbi_scratch *scratch)
 {
@@ -247,6 +304,40 @@ void sbi_hart_delegation_dump(struct sbi_scratch *scratch,
 		   prefix, suffix, csr_read(CSR_MEDELEG));
 }
 
+static inline void cbo_zero(unsigned long addr)
+{
+	/* cbo.zero (addr) without requiring Zicboz support in the assembler */
+	asm volatile(".insn i 0x0f, 2, x0, %0, 4" : : "r"(addr) : "memory");
+}
+
+void *sbi_hart_memzero(void *addr, size_t size)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	unsigned long start = (unsigned long)addr, end = start + size;
+	unsigned long block = 0, bstart, bend;
+	struct sbi_hart_features *hfeatures;
+
+	if (hart_features_offset &&
+	    sbi_hart_has_extension(scratch, SBI_HART_EXT_ZICBOZ)) {
+		hfeatures = sbi_scratch_offset_ptr(scratch,
+						   hart_features_offset);
+		block = hfeatures->cboz_block_size;
+	}
+
+	/* Only worth it when at least one whole block gets zeroed */
+	if (!block || size < 2 * block)
+		return sbi_memset(addr, 0, size);
+
+	bstart = ROUNDUP(start, block);
+	bend = end & ~(block - 1);
+	sbi_memset(addr, 0, bstart - start);
+	for (; bstart < bend; bstart += block)
+		cbo_zero(bstart);
+	sbi_memset((void *)bend, 0, end - bend);
+
+	return addr;
+}
+
 unsigned int sbi_hart_mhpm_mask(struct sbi_scratch *scratch)
 {
 	struct sbi_hart_features *hfeatures =
@@ -255,6 +346,18 @@ unsigned int sbi_hart_mhpm_mask(struct sbi_scratch *scratch)
 	return hfeatures->mhpm_mask;
 }
 
+/* Zero unless the HART has Zicbom and its block size is known */
+unsigned int sbi_hart_cbom_block_size(struct sbi_scratch *scratch)
+{
+	struct sbi_hart_features *hfeatures =
+			sbi_scratch_offset_ptr(scratch, hart_features_offset);
+
+	if (!__test_bit(SBI_HART_EXT_ZICBOM, hfeatures->extensions))
+		return 0;
+
+	return hfeatures->cbom_block_size;
+}
+
 unsigned int sbi_hart_pmp_count(struct sbi_scratch *scratch)
 {
 	struct sbi_hart_features *hfeatures =
@@ -387,6 +490,12 @@ static int sbi_hart_smepmp_configure(struct sbi_scratch *scratch,
 
 	/* Disable the reserved entry */
 	pmp_disable(SBI_SMEPMP_RESV_ENTRY);
+	if (hart_saddr_offset) {
+		struct hart_saddr_window *w =
+			sbi_scratch_offset_ptr(scratch, hart_saddr_offset);
+
+		w->valid = w->mapped = false;
+	}
 
 	/* Program M-only regions when MML is not set. */
 	pmp_idx = 0;
@@ -445,6 +554,264 @@ static int sbi_hart_smepmp_configure(struct sbi_scratch *scratch,
 	return 0;
 }
 
+static unsigned int oldpmp_flags(const struct sbi_domain_memregion *reg)
+{
+	unsigned int pmp_flags = 0;
+
+	/*
+	 * If permissions are to be enforced for all modes on
+	 * this region, the lock bit should be set.
+	 */
+	if (reg->flags & SBI_DOMAIN_MEMREGION_ENF_PERMISSIONS)
+		pmp_flags |= PMP_L;
+
+	if (reg->flags & SBI_DOMAIN_MEMREGION_SU_READABLE)
+		pmp_flags |= PMP_R;
+	if (reg->flags & SBI_DOMAIN_MEMREGION_SU_WRITABLE)
+		pmp_flags |= PMP_W;
+	if (reg->flags & SBI_DOMAIN_MEMREGION_SU_EXECUTABLE)
+		pmp_flags |= PMP_X;
+
+	return pmp_flags;
+}
+
+/* Number of PMP entries used by one NAPOT entry per memory region */
+static unsigned int oldpmp_napot_count(const struct sbi_domain *dom,
+				       unsigned int pmp_log2gran,
+				       unsigned long pmp_addr_max)
+{
+	struct sbi_domain_memregion *reg;
+	unsigned int count = 0;
+
+	sbi_domain_for_each_memregion(dom, reg) {
+		if (pmp_log2gran <= reg->order &&
+		    (reg->base >> PMP_SHIFT) < pmp_addr_max)
+			count++;
+	}
+
+	return count;
+}
+
+/*
+ * Merge the intervals starting at itv which are adjacent and have the
+ * same PMP flags into one run. Returns the interval after the run.
+ */
+static const struct sbi_domain_interval *
+oldpmp_next_run(const struct sbi_domain_interval *itv,
+		const struct sbi_domain_interval *itv_end,
+		unsigned long *start, unsigned long *end, unsigned int *flags)
+{
+	*start = itv->start;
+	*end = itv->end;
+	*flags = oldpmp_flags(itv->reg);
+	for (itv++; itv < itv_end; itv++) {
+		if (*end == -1UL || itv->start != *end + 1 ||
+		    oldpmp_flags(itv->reg) != *flags)
+			break;
+		*end = itv->end;
+	}
+
+	return itv;
+}
+
+/*
+ * Encode the interval index of a domain, where adjacent intervals with
+ * the same PMP flags are merged into runs. Each run takes one NAPOT
+ * entry when it is naturally aligned, otherwise a TOR entry plus an
+ * OFF entry holding its bottom address unless the previous TOR entry
+ * already ends there. The intervals don't overlap so the order of the
+ * entries does not matter.
+ *
+ * Returns the number of PMP entries needed or a negative error when
+ * some boundary is not representable. Entries are only programmed
+ * when program is true.
+ */
+static int oldpmp_interval_encode(const struct sbi_domain *dom,
+				  unsigned int pmp_log2gran,
+				  unsigned long pmp_addr_max, bool program)
+{
+	const struct sbi_domain_interval *itv, *itv_end;
+	unsigned long start, end, size, gran_mask, top, prev_top = 0;
+	unsigned int flags, order;
+	int idx = 0;
+
+	if (!dom->intervals)
+		return SBI_ENOTSUPP;
+
+	gran_mask = (1UL << pmp_log2gran) - 1;
+	itv = dom->intervals;
+	itv_end = &dom->intervals[dom->interval_count];
+	while (itv < itv_end) {
+		itv = oldpmp_next_run(itv, itv_end, &start, &end, &flags);
+
+		if ((start & gran_mask) ||
+		    (end != -1UL && ((end + 1) & gran_mask)))
+			return SBI_EINVAL;
+
+		size = end - start + 1;
+		if (!size || !(size & (size - 1))) {
+			/* Naturally aligned runs fit a single NAPOT entry */
+			order = (size) ? sbi_fls(size) : __riscv_xlen;
+			if (start & (size - 1))
+				goto tor;
+			if ((start >> PMP_SHIFT) >= pmp_addr_max)
+				return SBI_EINVAL;
+			if (program)
+				pmp_set(idx, flags, start, order);
+			idx++;
+			prev_top = -1UL;
+			continue;
+		}
+
+tor:
+		top = (end == -1UL) ? pmp_addr_max : (end + 1) >> PMP_SHIFT;
+		if (top > pmp_addr_max)
+			return SBI_EINVAL;
+		if ((idx || start) && prev_top != (start >> PMP_SHIFT)) {
+			if (program)
+				pmp_set_raw(idx, 0, start >> PMP_SHIFT);
+			idx++;
+		}
+		if (program)
+			pmp_set_raw(idx, flags | PMP_A_TOR, top);
+		idx++;
+		prev_top = top;
+	}
+
+	return idx;
+}
+
+#ifdef CONFIG_SBI_HART_PMP_MULTIPLEX
+static struct hart_pmp_mux *oldpmp_mux_get(struct sbi_scratch *scratch)
+{
+	if (!hart_pmp_mux_offset)
+		return NULL;
+
+	return sbi_scratch_read_type(scratch, void *, hart_pmp_mux_offset);
+}
+
+static bool oldpmp_run_fits(unsigned long start, unsigned long end,
+			    unsigned int pmp_log2gran,
+			    unsigned long pmp_addr_max)
+{
+	unsigned long gran_mask = (1UL << pmp_log2gran) - 1;
+
+	if ((start & gran_mask) ||
+	    (end != -1UL && ((end + 1) & gran_mask)))
+		return false;
+	if ((start >> PMP_SHIFT) >= pmp_addr_max)
+		return false;
+
+	return end == -1UL || ((end + 1) >> PMP_SHIFT) <= pmp_addr_max;
+}
+
+/* Program a run as TOR entry n + 1 with its bottom address in entry n */
+static void oldpmp_mux_set(unsigned int n, unsigned int flags,
+			   unsigned long start, unsigned long end,
+			   unsigned long pmp_addr_max)
+{
+	unsigned long top;
+
+	top = (end == -1UL) ? pmp_addr_max : (end + 1) >> PMP_SHIFT;
+	pmp_disable(n + 1);
+	pmp_set_raw(n, 0, start >> PMP_SHIFT);
+	pmp_set_raw(n + 1, flags | PMP_A_TOR, top);
+}
+
+/*
+ * Place the locked runs of a domain into entry pairs counting down
+ * from entry pmp_count. Returns the first entry used by locked runs
+ * or a negative error when they don't fit. Entries are only programmed
+ * when program is true since locked entries can't be undone.
+ */
+static int oldpmp_mux_lock_runs(const struct sbi_domain *dom,
+				unsigned int pmp_count,
+				unsigned int pmp_log2gran,
+				unsigned long pmp_addr_max, bool program)
+{
+	const struct sbi_domain_interval *itv, *itv_end;
+	unsigned long start, end;
+	unsigned int flags;
+	int n = pmp_count & ~1U;
+
+	itv = dom->intervals;
+	itv_end = &dom->intervals[dom->interval_count];
+	while (itv < itv_end) {
+		itv = oldpmp_next_run(itv, itv_end, &start, &end, &flags);
+		if (!(flags & PMP_L))
+			continue;
+		if (n < 2 ||
+		    !oldpmp_run_fits(start, end, pmp_log2gran, pmp_addr_max))
+			return SBI_ENOSPC;
+		n -= 2;
+		if (program)
+			oldpmp_mux_set(n, flags, start, end, pmp_addr_max);
+	}
+
+	return n;
+}
+
+static int oldpmp_mux_configure(struct sbi_scratch *scratch,
+				const struct sbi_domain *dom,
+				unsigned int pmp_count,
+				unsigned int pmp_log2gran,
+				unsigned long pmp_addr_max)
+{
+	struct hart_pmp_mux *mux;
+	int i, n;
+
+	if (!hart_pmp_mux_offset || !dom->intervals)
+		return SBI_ENOTSUPP;
+
+	/* An instruction and its data need at least two slots */
+	n = oldpmp_mux_lock_runs(dom, pmp_count, pmp_log2gran,
+				 pmp_addr_max, false);
+	if (n < 4)
+		return SBI_ENOSPC;
+
+	mux = oldpmp_mux_get(scratch);
+	if (!mux) {
+		mux = sbi_zalloc(sizeof(*mux));
+		if (!mux)
+			return SBI_ENOMEM;
+		sbi_scratch_write_type(scratch, void *, hart_pmp_mux_offset,
+				       mux);
+	}
+
+	for (i = 0; i < n; i++)
+		pmp_disable(i);
+	oldpmp_mux_lock_runs(dom, pmp_count, pmp_log2gran, pmp_addr_max,
+			     true);
+
+	sbi_memset(mux, 0, sizeof(*mux));
+	mux->dom = dom;
+	mux->pmp_addr_max = pmp_addr_max;
+	mux->pmp_log2gran = pmp_log2gran;
+	mux->slot_count = n / 2;
+
+	return 0;
+}
+
+static void oldpmp_mux_reset(struct sbi_scratch *scratch)
+{
+	struct hart_pmp_mux *mux = oldpmp_mux_get(scratch);
+
+	if (mux)
+		mux->dom = NULL;
+}
+#else
+static inline int oldpmp_mux_configure(struct sbi_scratch *scratch,
+				       const struct sbi_domain *dom,
+				       unsigned int pmp_count,
+				       unsigned int pmp_log2gran,
+				       unsigned long pmp_addr_max)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline void oldpmp_mux_reset(struct sbi_scratch *scratch) { }
+#endif
+
 static int sbi_hart_oldpmp_configure(struct sbi_scratch *scratch,
 				     unsigned int pmp_count,
 				     unsigned int pmp_log2gran,
@@ -452,29 +819,43 @@ static int sbi_hart_oldpmp_configure(struct sbi_scratch *scratch,
 {
 	struct sbi_domain_memregion *reg;
 	struct sbi_domain *dom = sbi_domain_thishart_ptr();
-	unsigned int pmp_idx = 0;
+	unsigned int pmp_idx = 0, napot_count;
 	unsigned int pmp_flags;
 	unsigned long pmp_addr;
+	int tor_count;
+
+	/*
+	 * Use the interval encoding when it takes fewer entries than one
+	 * NAPOT entry per memory region, which is the case for unaligned
+	 * ranges split into many power-of-two regions.
+	 */
+	oldpmp_mux_reset(scratch);
+	napot_count = oldpmp_napot_count(dom, pmp_log2gran, pmp_addr_max);
+	tor_count = oldpmp_interval_encode(dom, pmp_log2gran, pmp_addr_max,
+					   false);
+	if (0 <= tor_count && tor_count < napot_count &&
+	    tor_count <= pmp_count) {
+		oldpmp_interval_encode(dom, pmp_log2gran, pmp_addr_max, true);
+		return 0;
+	}
+
+	if (pmp_count < napot_count &&
+	    (tor_count < 0 || pmp_count < tor_count)) {
+		if (!oldpmp_mux_configure(scratch, dom, pmp_count,
+					  pmp_log2gran, pmp_addr_max))
+			return 0;
+
+		sbi_printf("%s: domain %s needs %d PMP entries, only %d "
+			   "available\n", __func__, dom->name,
+			   (0 <= tor_count && tor_count < napot_count) ?
+			   tor_count : (int)napot_count, pmp_count);
+	}
 
 	sbi_domain_for_each_memregion(dom, reg) {
 		if (pmp_count <= pmp_idx)
 			break;
 
-		pmp_flags = 0;
-
-		/*
-		 * If permissions are to be enforced for all modes on
-		 * this region, the lock bit should be set.
-		 */
-		if (reg->flags & SBI_DOMAIN_MEMREGION_ENF_PERMISSIONS)
-			pmp_flags |= PMP_L;
-
-		if (reg->flags & SBI_DOMAIN_MEMREGION_SU_READABLE)
-			pmp_flags |= PMP_R;
-		if (reg->flags & SBI_DOMAIN_MEMREGION_SU_WRITABLE)
-			pmp_flags |= PMP_W;
-		if (reg->flags & SBI_DOMAIN_MEMREGION_SU_EXECUTABLE)
-			pmp_flags |= PMP_X;
+		pmp_flags = oldpmp_flags(reg);
 
 		pmp_addr = reg->base >> PMP_SHIFT;
 		if (pmp_log2gran <= reg->order && pmp_addr < pmp_addr_max) {
@@ -494,14 +875,29 @@ int sbi_hart_map_saddr(unsigned long addr, unsigned long size)
 {
 	/* shared R/W access for M and S/U mode */
 	unsigned int pmp_flags = (PMP_W | PMP_X);
-	unsigned long order, base = 0;
+	unsigned long order, base = 0, last = addr + size - 1UL;
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct hart_saddr_window *w;
 
 	/* If Smepmp is not supported no special mapping is required */
 	if (!sbi_hart_has_extension(scratch, SBI_HART_EXT_SMEPMP))
 		return SBI_OK;
 
-	if (is_pmp_entry_mapped(SBI_SMEPMP_RESV_ENTRY))
+	/* Reuse the last window if it covers the buffer */
+	w = sbi_scratch_offset_ptr(scratch, hart_saddr_offset);
+	if (w->valid && w->base <= addr && last <= w->end) {
+		if (!w->mapped) {
+			csr_write_num(CSR_PMPADDR0 + SBI_SMEPMP_RESV_ENTRY,
+				      w->pmpaddr);
+			csr_write(CSR_PMPCFG0, w->cfg_on);
+			w->mapped = true;
+		}
+		return SBI_OK;
+	}
+
+	/* Only a persistent window may be replaced by another one */
+	if (is_pmp_entry_mapped(SBI_SMEPMP_RESV_ENTRY) &&
+	    !(w->valid && w->mapped && w->persistent))
 		return SBI_ENOSPC;
 
 	for (order = MAX(sbi_hart_pmp_log2gran(scratch), log2roundup(size));
@@ -520,17 +916,39 @@ int sbi_hart_map_saddr(unsigned long addr, unsigned long size)
 
 	pmp_set(SBI_SMEPMP_RESV_ENTRY, pmp_flags, base, order);
 
+	/* The reserved entry lives in the first byte of PMPCFG0 */
+	w->base = base;
+	w->end = base + ((1UL << order) - 1UL);
+	w->pmpaddr = csr_read_num(CSR_PMPADDR0 + SBI_SMEPMP_RESV_ENTRY);
+	w->cfg_on = csr_read(CSR_PMPCFG0);
+	w->cfg_off = w->cfg_on & ~0xffUL;
+	w->persistent = sbi_domain_check_addr_range_exact(
+				sbi_domain_thishart_ptr(), w->base,
+				w->end - w->base + 1, PRV_S,
+				SBI_DOMAIN_READ | SBI_DOMAIN_WRITE);
+	w->valid = w->mapped = true;
+
 	return SBI_OK;
 }
 
 int sbi_hart_unmap_saddr(void)
 {
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct hart_saddr_window *w;
 
 	if (!sbi_hart_has_extension(scratch, SBI_HART_EXT_SMEPMP))
 		return SBI_OK;
 
-	return pmp_disable(SBI_SMEPMP_RESV_ENTRY);
+	w = sbi_scratch_offset_ptr(scratch, hart_saddr_offset);
+	if (!w->valid)
+		return pmp_disable(SBI_SMEPMP_RESV_ENTRY);
+
+	if (w->mapped && !w->persistent) {
+		csr_write(CSR_PMPCFG0, w->cfg_off);
+		w->mapped = false;
+	}
+
+	return SBI_OK;
 }
 
 int sbi_hart_pmp_configure(struct sbi_scratch *scratch)
@@ -578,6 +996,337 @@ int sbi_hart_pmp_configure(struct sbi_scratch *scratch)
 	return rc;
 }
 
+#if __riscv_xlen == 32
+#define PMPCFG_CSR(__i)		(CSR_PMPCFG0 + (__i))
+#else
+#define PMPCFG_CSR(__i)		(CSR_PMPCFG0 + 2 * (__i))
+#endif
+
+/* Number of pmpcfg CSRs holding the config of __n entries */
+#define PMPCFG_COUNT(__n)	\
+	(((__n) + (__riscv_xlen / 8) - 1) / (__riscv_xlen / 8))
+
+static void hart_pmp_flush(void)
+{
+	/* Same flush as sbi_hart_pmp_configure() */
+	if (misa_extension('S')) {
+		__asm__ __volatile__("sfence.vma");
+		if (misa_extension('H'))
+			__sbi_hfence_gvma_all();
+	}
+}
+
+/*
+ * Read the raw PMP CSRs of the calling HART. Returns false for HARTs
+ * without PMP or with Smepmp, where entries have to be written in a
+ * particular order relative to MSECCFG.MML so such HARTs always go
+ * through sbi_hart_pmp_configure().
+ */
+bool sbi_hart_pmp_snapshot(struct sbi_scratch *scratch,
+			   struct sbi_hart_pmp_state *state)
+{
+	unsigned int i, pmp_count = sbi_hart_pmp_count(scratch);
+
+	if (!pmp_count || !state ||
+	    sbi_hart_has_extension(scratch, SBI_HART_EXT_SMEPMP))
+		return false;
+
+#ifdef CONFIG_SBI_HART_PMP_MULTIPLEX
+	/* Multiplexed entries are only known to the slots of the HART */
+	if (oldpmp_mux_get(scratch) && oldpmp_mux_get(scratch)->dom)
+		return false;
+#endif
+
+	for (i = 0; i < pmp_count; i++)
+		state->addr[i] = csr_read_num(CSR_PMPADDR0 + i);
+	for (i = 0; i < PMPCFG_COUNT(pmp_count); i++)
+		state->cfg[i] = csr_read_num(PMPCFG_CSR(i));
+
+	return true;
+}
+
+/*
+ * Move the calling HART from one PMP snapshot to another by writing
+ * only the CSRs which differ. Entries whose address changes, and
+ * TOR entries whose bottom address changes, are turned off first so
+ * that none is briefly active with a stale address, except locked
+ * entries which can't be changed anyway.
+ */
+void sbi_hart_pmp_switch(struct sbi_scratch *scratch,
+			 const struct sbi_hart_pmp_state *cur,
+			 const struct sbi_hart_pmp_state *next)
+{
+	unsigned int i, j, n, per_cfg = __riscv_xlen / 8;
+	unsigned int pmp_count = sbi_hart_pmp_count(scratch);
+	unsigned long cfg, mask;
+	bool changed;
+
+	for (i = 0; i < PMPCFG_COUNT(pmp_count); i++) {
+		mask = 0;
+		for (j = 0; j < per_cfg; j++) {
+			n = i * per_cfg + j;
+			if (pmp_count <= n)
+				break;
+			changed = cur->addr[n] != next->addr[n];
+			if (n && !changed &&
+			    ((cur->cfg[i] >> (j * 8)) & PMP_A) == PMP_A_TOR)
+				changed = cur->addr[n - 1] != next->addr[n - 1];
+			if (changed)
+				mask |= 0xffUL << (j * 8);
+		}
+
+		cfg = cur->cfg[i] & ~mask;
+		if (cfg != cur->cfg[i])
+			csr_write_num(PMPCFG_CSR(i), cfg);
+	}
+
+	for (i = 0; i < pmp_count; i++) {
+		if (cur->addr[i] != next->addr[i])
+			csr_write_num(CSR_PMPADDR0 + i, next->addr[i]);
+	}
+
+	/* Any cfg touched above differs from the current value */
+	for (i = 0; i < PMPCFG_COUNT(pmp_count); i++) {
+		if (csr_read_num(PMPCFG_CSR(i)) != next->cfg[i])
+			csr_write_num(PMPCFG_CSR(i), next->cfg[i]);
+	}
+
+	hart_pmp_flush();
+}
+
+#ifdef CONFIG_SBI_HART_PMP_MULTIPLEX
+#define PTE_V			_UL(0x001)
+#define PTE_R			_UL(0x002)
+#define PTE_X			_UL(0x008)
+#define PTE_PPN_SHIFT		10
+#if __riscv_xlen == 64
+#define PTE_N			_UL(0x8000000000000000)
+#define PTE_PPN_MASK		_UL(0x00000FFFFFFFFFFF)
+#endif
+
+/* Find the run holding addr, as merged by oldpmp_next_run() */
+static bool oldpmp_find_run(const struct sbi_domain *dom, unsigned long addr,
+			    unsigned long *start, unsigned long *end,
+			    unsigned int *flags)
+{
+	const struct sbi_domain_interval *itv = dom->intervals;
+	u32 lo = 0, hi = dom->interval_count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (itv[mid].end < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == dom->interval_count || addr < itv[lo].start)
+		return false;
+
+	*flags = oldpmp_flags(itv[lo].reg);
+	while (lo && itv[lo - 1].end + 1 == itv[lo].start &&
+	       oldpmp_flags(itv[lo - 1].reg) == *flags)
+		lo--;
+	oldpmp_next_run(&itv[lo], &itv[dom->interval_count],
+			start, end, flags);
+
+	return true;
+}
+
+/*
+ * Make the run holding addr resident when it grants the access. Returns
+ * 1 when a slot was programmed, 0 when the run was resident already and
+ * a negative error when the domain does not allow the access.
+ */
+static int oldpmp_mux_load(struct hart_pmp_mux *mux, unsigned long addr,
+			   unsigned int access)
+{
+	unsigned long start, end;
+	unsigned int i, victim = 0, flags;
+	struct hart_pmp_slot *slot;
+
+	if (!oldpmp_find_run(mux->dom, addr, &start, &end, &flags) ||
+	    (flags & access) != access)
+		return SBI_EINVAL;
+	if (flags & PMP_L)
+		return 0;
+
+	for (i = 0; i < mux->slot_count; i++) {
+		slot = &mux->slot[i];
+		if (slot->last_use && slot->start == start) {
+			slot->last_use = ++mux->tick;
+			return 0;
+		}
+		if (slot->last_use < mux->slot[victim].last_use)
+			victim = i;
+	}
+
+	if (!oldpmp_run_fits(start, end, mux->pmp_log2gran,
+			     mux->pmp_addr_max))
+		return SBI_EINVAL;
+
+	slot = &mux->slot[victim];
+	slot->start = start;
+	slot->end = end;
+	slot->last_use = ++mux->tick;
+	oldpmp_mux_set(2 * victim, flags, start, end, mux->pmp_addr_max);
+	hart_pmp_flush();
+
+	return 1;
+}
+
+/*
+ * Walk the supervisor page tables like the HART does for an access to
+ * the virtual address va, loading the run of the first PTE or of the
+ * final physical address which is not resident.
+ */
+static int oldpmp_mux_walk(struct hart_pmp_mux *mux, unsigned long va,
+			   unsigned int access)
+{
+	unsigned long satp = csr_read(CSR_SATP);
+	unsigned long ppn, pte, pte_addr, mask;
+	int i, rc, levels, vpn_bits;
+
+#if __riscv_xlen == 32
+	if (!(satp & SATP32_MODE))
+		return oldpmp_mux_load(mux, va, access);
+	ppn = satp & SATP32_PPN;
+	levels = 2;
+	vpn_bits = 10;
+#else
+	switch ((satp & SATP64_MODE) >> 60) {
+	case SATP_MODE_OFF:
+		return oldpmp_mux_load(mux, va, access);
+	case SATP_MODE_SV39:
+		levels = 3;
+		break;
+	case SATP_MODE_SV48:
+		levels = 4;
+		break;
+	case SATP_MODE_SV57:
+		levels = 5;
+		break;
+	default:
+		return SBI_ENOTSUPP;
+	}
+	ppn = satp & SATP64_PPN;
+	vpn_bits = 9;
+#endif
+
+	for (i = levels - 1; 0 <= i; i--) {
+		/* Physical addresses above XLEN bits are never multiplexed */
+		if (ppn >> (__riscv_xlen - PAGE_SHIFT))
+			return SBI_EINVAL;
+
+		pte_addr = (ppn << PAGE_SHIFT) +
+			   ((va >> (PAGE_SHIFT + i * vpn_bits)) &
+			    ((1UL << vpn_bits) - 1)) * sizeof(unsigned long);
+		rc = oldpmp_mux_load(mux, pte_addr, PMP_R);
+		if (rc)
+			return rc;
+
+		pte = *(volatile unsigned long *)pte_addr;
+		if (!(pte & PTE_V))
+			return SBI_EINVAL;
+#if __riscv_xlen == 32
+		ppn = pte >> PTE_PPN_SHIFT;
+#else
+		ppn = (pte >> PTE_PPN_SHIFT) & PTE_PPN_MASK;
+		/* Svnapot only defines 64KiB pages */
+		if (!i && (pte & PTE_N))
+			ppn = (ppn & ~0xfUL) | ((va >> PAGE_SHIFT) & 0xfUL);
+#endif
+		if (!(pte & (PTE_R | PTE_X)))
+			continue;
+
+		if (ppn >> (__riscv_xlen - PAGE_SHIFT))
+			return SBI_EINVAL;
+		mask = (1UL << (PAGE_SHIFT + i * vpn_bits)) - 1;
+		return oldpmp_mux_load(mux, ((ppn << PAGE_SHIFT) & ~mask) |
+					    (va & mask), access);
+	}
+
+	return SBI_EINVAL;
+}
+
+/*
+ * Hand a PMP entry pair to the domain run which an S/U-mode access
+ * fault hit, evicting the least recently faulted in run when all slots
+ * are taken. Returns true when the faulting instruction can be retried.
+ */
+bool sbi_hart_pmp_fault(const struct sbi_trap_context *tcntx)
+{
+	const struct sbi_trap_regs *regs = &tcntx->regs;
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct hart_pmp_mux *mux = oldpmp_mux_get(scratch);
+	unsigned int access;
+
+	if (!mux || !mux->dom || mux->dom != sbi_domain_thishart_ptr())
+		return false;
+	if (sbi_mstatus_prev_mode(regs->mstatus) == PRV_M ||
+	    sbi_regs_from_virt(regs))
+		return false;
+
+	switch (tcntx->trap.cause) {
+	case CAUSE_FETCH_ACCESS:
+		access = PMP_X;
+		break;
+	case CAUSE_LOAD_ACCESS:
+		access = PMP_R;
+		break;
+	case CAUSE_STORE_ACCESS:
+		access = PMP_W;
+		break;
+	default:
+		return false;
+	}
+
+	return oldpmp_mux_walk(mux, tcntx->trap.tval, access) > 0;
+}
+#endif
+
+void sbi_hart_pmp_save(struct sbi_scratch *scratch)
+{
+	struct hart_pmp_image *img;
+
+	if (!hart_pmp_image_offset || !sbi_hart_pmp_count(scratch) ||
+	    sbi_hart_has_extension(scratch, SBI_HART_EXT_SMEPMP))
+		return;
+
+	img = sbi_scratch_read_type(scratch, void *, hart_pmp_image_offset);
+	if (!img) {
+		img = sbi_zalloc(sizeof(*img));
+		if (!img)
+			return;
+		sbi_scratch_write_type(scratch, void *, hart_pmp_image_offset,
+				       img);
+	}
+
+	img->valid = sbi_hart_pmp_snapshot(scratch, &img->state);
+}
+
+int sbi_hart_pmp_restore(struct sbi_scratch *scratch)
+{
+	unsigned int i, pmp_count = sbi_hart_pmp_count(scratch);
+	struct hart_pmp_image *img = NULL;
+
+	if (hart_pmp_image_offset)
+		img = sbi_scratch_read_type(scratch, void *,
+					    hart_pmp_image_offset);
+	if (!img || !img->valid)
+		return sbi_hart_pmp_configure(scratch);
+	img->valid = false;
+
+	/* Addresses first so that no entry is briefly active with a stale one */
+	for (i = 0; i < pmp_count; i++)
+		csr_write_num(CSR_PMPADDR0 + i, img->state.addr[i]);
+	for (i = 0; i < PMPCFG_COUNT(pmp_count); i++)
+		csr_write_num(PMPCFG_CSR(i), img->state.cfg[i]);
+
+	hart_pmp_flush();
+
+	return 0;
+}
+
 int sbi_hart_priv_version(struct sbi_scratch *scratch)
 {
 	struct sbi_hart_features *hfeatures =
@@ -637,17 +1386,12 @@ void sbi_hart_update_extension(struct sbi_scratch *scratch,
 			sbi_scratch_offset_ptr(scratch, hart_features_offset);
 
 	__sbi_hart_update_extension(hfeatures, ext, enable);
+	scratch->hot_extensions = hfeatures->extensions[0];
 }
 
-/**
- * Check whether a particular hart extension is available
- *
- * @param scratch pointer to the HART scratch space
- * @param ext the extension number to check
- * @returns true (available) or false (not available)
- */
-bool sbi_hart_has_extension(struct sbi_scratch *scratch,
-			    enum sbi_hart_extensions ext)
+/* Slow path of sbi_hart_has_extension() for the upper bitmap words */
+bool __sbi_hart_has_extension(struct sbi_scratch *scratch,
+			      enum sbi_hart_extensions ext)
 {
 	struct sbi_hart_features *hfeatures =
 			sbi_scratch_offset_ptr(scratch, hart_features_offset);
@@ -688,6 +1432,8 @@ const struct sbi_hart_ext_data sbi_hart_ext[] = {
 	__SBI_HART_EXT_DATA(zicfilp, SBI_HART_EXT_ZICFILP),
 	__SBI_HART_EXT_DATA(zicfiss, SBI_HART_EXT_ZICFISS),
 	__SBI_HART_EXT_DATA(ssdbltrp, SBI_HART_EXT_SSDBLTRP),
+	__SBI_HART_EXT_DATA(svinval, SBI_HART_EXT_SVINVAL),
+	__SBI_HART_EXT_DATA(zawrs, SBI_HART_EXT_ZAWRS),
 };
 
 _Static_assert(SBI_HART_EXT_MAX == array_size(sbi_hart_ext),
@@ -776,6 +1522,111 @@ static int hart_mhpm_get_allowed_bits(void)
 	return num_bits;
 }
 
+/*
+ * Svinval has no CSR so probe for it by executing SFENCE.W.INVAL which
+ * is harmless on harts implementing it and illegal on all others.
+ */
+static bool hart_svinval_allowed(struct sbi_trap_info *trap)
+{
+	register ulong tinfo asm("a3") = (ulong)trap;
+	register ulong ttmp asm("a4");
+	register ulong mtvec = sbi_hart_expected_trap_addr();
+
+	trap->cause = 0;
+	asm volatile(
+		"add %[ttmp], %[tinfo], zero\n"
+		"csrrw %[mtvec], " STR(CSR_MTVEC) ", %[mtvec]\n"
+		".word 0x18000073\n"
+		"csrw " STR(CSR_MTVEC) ", %[mtvec]"
+	    : [mtvec] "+&r"(mtvec), [tinfo] "+&r"(tinfo), [ttmp] "+&r"(ttmp)
+	    :
+	    : "memory");
+
+	return trap->cause ? false : true;
+}
+
+#ifdef CONFIG_SBI_HART_FEATURES_CACHE
+/* Maximum number of distinct HART classes remembered */
+#define HART_FEATURES_CLASS_MAX		4
+
+/** Trap based detection results shared by HARTs with the same ids */
+struct hart_features_class {
+	unsigned long mvendorid;
+	unsigned long marchid;
+	unsigned long mimpid;
+	struct sbi_hart_features features;
+};
+
+static struct hart_features_class
+	hart_features_classes[HART_FEATURES_CLASS_MAX];
+static u32 hart_features_class_count;
+static spinlock_t hart_features_class_lock = SPIN_LOCK_INITIALIZER;
+
+static struct hart_features_class *hart_features_class_find(void)
+{
+	u32 i;
+	struct hart_features_class *hc;
+	unsigned long mvendorid = csr_read(CSR_MVENDORID);
+	unsigned long marchid = csr_read(CSR_MARCHID);
+	unsigned long mimpid = csr_read(CSR_MIMPID);
+
+	for (i = 0; i < hart_features_class_count; i++) {
+		hc = &hart_features_classes[i];
+		if (hc->mvendorid == mvendorid && hc->marchid == marchid &&
+		    hc->mimpid == mimpid)
+			return hc;
+	}
+
+	return NULL;
+}
+
+/*
+ * Take the trap based detection results of an earlier HART with the
+ * same vendor, architecture and implementation ids.
+ */
+static bool hart_features_cache_lookup(struct sbi_hart_features *hfeatures)
+{
+	struct hart_features_class *hc;
+
+	spin_lock(&hart_features_class_lock);
+	hc = hart_features_class_find();
+	if (hc)
+		sbi_memcpy(hfeatures, &hc->features, sizeof(*hfeatures));
+	spin_unlock(&hart_features_class_lock);
+
+	return hc != NULL;
+}
+
+static void hart_features_cache_insert(
+				const struct sbi_hart_features *hfeatures)
+{
+	struct hart_features_class *hc;
+
+	spin_lock(&hart_features_class_lock);
+	if (!hart_features_class_find() &&
+	    hart_features_class_count < HART_FEATURES_CLASS_MAX) {
+		hc = &hart_features_classes[hart_features_class_count];
+		hc->mvendorid = csr_read(CSR_MVENDORID);
+		hc->marchid = csr_read(CSR_MARCHID);
+		hc->mimpid = csr_read(CSR_MIMPID);
+		sbi_memcpy(&hc->features, hfeatures, sizeof(*hfeatures));
+		hart_features_class_count++;
+	}
+	spin_unlock(&hart_features_class_lock);
+}
+#else
+static inline bool hart_features_cache_lookup(
+				struct sbi_hart_features *hfeatures)
+{
+	return false;
+}
+
+static inline void hart_features_cache_insert(
+				const struct sbi_hart_features *hfeatures)
+{
+}
+#endif
+
 static int hart_detect_features(struct sbi_scratch *scratch)
 {
 	struct sbi_trap_info trap = {0};
@@ -786,15 +1637,26 @@ static int hart_detect_features(struct sbi_scratch *scratch)
 	int rc;
 
 	/* If hart features already detected then do nothing */
-	if (hfeatures->detected)
+	if (hfeatures->detected) {
+		scratch->hot_extensions = hfeatures->extensions[0];
 		return 0;
+	}
 
 	/* Clear hart features */
 	sbi_memset(hfeatures->extensions, 0, sizeof(hfeatures->extensions));
 	hfeatures->pmp_count = 0;
 	hfeatures->mhpm_mask = 0;
+	hfeatures->cboz_block_size = 0;
+	hfeatures->cbom_block_size = 0;
 	hfeatures->priv_version = SBI_HART_PRIV_VER_UNKNOWN;
 
+	/*
+	 * The platform still populates the extensions of every HART below
+	 * so HARTs which only differ in their DT ISA string are covered.
+	 */
+	if (hart_features_cache_lookup(hfeatures))
+		goto __probed;
+
 #define __check_hpm_csr(__csr, __mask) 					  \
 	oldval = csr_read_allowed(__csr, &trap);			  \
 	if (!trap.cause) {						  \
@@ -938,10 +1800,23 @@ __pmp_skip:
 
 #undef __check_ext_csr
 
+	/* Detect if hart supports Svinval */
+	if (hart_svinval_allowed(&trap))
+		__sbi_hart_update_extension(hfeatures,
+					    SBI_HART_EXT_SVINVAL, true);
+
+	hart_features_cache_insert(hfeatures);
+
+__probed:
 	/* Save trap based detection of Zicntr */
-	has_zicntr = sbi_hart_has_extension(scratch, SBI_HART_EXT_ZICNTR);
+	has_zicntr = __test_bit(SBI_HART_EXT_ZICNTR, hfeatures->extensions);
 
-	/* Let platform populate extensions */
+	/*
+	 * Let platform populate extensions. The platform hook may test
+	 * extensions with sbi_hart_has_extension() so make the probed
+	 * ones visible in hot_extensions first.
+	 */
+	scratch->hot_extensions = hfeatures->extensions[0];
 	rc = sbi_platform_extensions_init(sbi_platform_thishart_ptr(),
 					  hfeatures);
 	if (rc)
@@ -958,6 +1833,7 @@ __pmp_skip:
 
 	/* Mark hart feature detection done */
 	hfeatures->detected = true;
+	scratch->hot_extensions = hfeatures->extensions[0];
 
 	/*
 	 * On platforms with Smepmp, the previous booting stage must
@@ -972,6 +1848,23 @@ __pmp_skip:
 	return 0;
 }
 
+/*
+ * Switch to the trap entry specialised for the extensions of the HART.
+ * A trap entry installed by the platform is left alone.
+ */
+static void hart_trap_handler_init(struct sbi_scratch *scratch)
+{
+	unsigned long mtvec = csr_read(CSR_MTVEC);
+
+	if (!sbi_hart_has_extension(scratch, SBI_HART_EXT_SMAIA))
+		return;
+
+	if (mtvec == (unsigned long)&_trap_handler)
+		csr_write(CSR_MTVEC, &_trap_handler_aia);
+	else if (mtvec == (unsigned long)&_trap_handler_hyp)
+		csr_write(CSR_MTVEC, &_trap_handler_hyp_aia);
+}
+
 int sbi_hart_reinit(struct sbi_scratch *scratch)
 {
 	int rc;
@@ -986,6 +1879,8 @@ int sbi_hart_reinit(struct sbi_scratch *scratch)
 	if (rc)
 		return rc;
 
+	hart_trap_handler_init(scratch);
+
 	return 0;
 }
 
@@ -1007,6 +1902,21 @@ int sbi_hart_init(struct sbi_scratch *scratch, bool cold_boot)
 					sizeof(struct sbi_hart_features));
 		if (!hart_features_offset)
 			return SBI_ENOMEM;
+
+		hart_pmp_image_offset = sbi_scratch_alloc_type_offset(void *);
+		if (!hart_pmp_image_offset)
+			return SBI_ENOMEM;
+
+		hart_saddr_offset = sbi_scratch_alloc_type_offset(
+					struct hart_saddr_window);
+		if (!hart_saddr_offset)
+			return SBI_ENOMEM;
+
+#ifdef CONFIG_SBI_HART_PMP_MULTIPLEX
+		hart_pmp_mux_offset = sbi_scratch_alloc_type_offset(void *);
+		if (!hart_pmp_mux_offset)
+			return SBI_ENOMEM;
+#endif
 	}
 
 	rc = hart_detect_features(scratch);
@@ -1018,6 +1928,9 @@ int sbi_hart_init(struct sbi_scratch *scratch, bool cold_boot)
 
 void __attribute__((noreturn)) sbi_hart_hang(void)
 {
+	/* Whatever was printed last is most likely why we hang */
+	sbi_console_flush();
+
 	while (1)
 		wfi();
 	__builtin_unreachable();
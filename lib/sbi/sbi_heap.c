@@ -8,42 +8,163 @@
  */
 
 #include <sbi/riscv_locks.h>
+#include <sbi/sbi_bitops.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
+#include <sbi/sbi_heap_stats.h>
 #include <sbi/sbi_list.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
 
 /* Minimum size and alignment of heap allocations */
 #define HEAP_ALLOC_ALIGN		64
-#define HEAP_HOUSEKEEPING_FACTOR	16
 
-struct heap_node {
+/* Free blocks are kept in one list per power of two of their units */
+#define HEAP_FREE_BINS			BITS_PER_LONG
+
+/*
+ * The heap is managed in units of HEAP_ALLOC_ALIGN bytes. Free blocks
+ * carry their own boundary tags, a header at the start and a copy of
+ * the size in the last word. Two bitmaps in the housekeeping area mark
+ * the first unit of every block and the first and last unit of every
+ * free block, so a block is split or merged with both neighbours
+ * without walking any list and without separate list nodes.
+ */
+struct heap_free_block {
 	struct sbi_dlist head;
-	unsigned long addr;
 	unsigned long size;
 };
 
-struct sbi_heap_control {
+#ifdef CONFIG_SBI_HEAP_SLAB
+/*
+ * Allocations of up to HEAP_SLAB_MAX_SIZE bytes are served from slabs
+ * of HEAP_SLAB_SIZE bytes which hold objects of one size class. Every
+ * size class has a lock and a free list of its own so small, fixed
+ * size allocations neither walk nor contend on the heap lists. Objects
+ * are naturally aligned since slabs are aligned to their size.
+ */
+#define HEAP_SLAB_SIZE			HEAP_BASE_ALIGN
+#define HEAP_SLAB_CLASSES		3
+#define HEAP_SLAB_MAX_SIZE		(HEAP_ALLOC_ALIGN << (HEAP_SLAB_CLASSES - 1))
+
+struct heap_slab_object {
+	struct heap_slab_object *next;
+};
+
+struct heap_slab_class {
+	spinlock_t lock;
+	struct heap_slab_object *free;
+	unsigned long free_count;
+} __cacheline_aligned;
+
+/*
+ * Every HART caches up to HEAP_MAG_SIZE free objects of each size
+ * class which it allocates from and frees to without any lock. A
+ * magazine is refilled from and drained to its size class half a
+ * magazine at a time.
+ */
+#ifdef CONFIG_SBI_HEAP_MAGAZINE
+#define HEAP_MAG_SIZE			CONFIG_SBI_HEAP_MAGAZINE_SIZE
+#else
+#define HEAP_MAG_SIZE			2
+#endif
+
+struct heap_magazine {
+	unsigned long count;
+	struct heap_slab_object *obj[HEAP_MAG_SIZE];
+};
+#endif
+
+#ifdef CONFIG_SBI_HEAP_STATS
+struct heap_stats {
 	spinlock_t lock;
+	unsigned long peak_used;
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long failed;
+	unsigned long failed_max_size;
+#ifdef CONFIG_SBI_HEAP_STATS_SITES
+	unsigned long nr_sites;
+	struct {
+		unsigned long addr;
+		unsigned long allocs;
+		unsigned long bytes;
+	} sites[SBI_HEAP_STATS_SITES];
+#endif
+};
+#endif
+
+struct sbi_heap_control {
+	qspinlock_t lock;
 	unsigned long base;
 	unsigned long size;
 	unsigned long hkbase;
 	unsigned long hksize;
-	struct sbi_dlist free_node_list;
-	struct sbi_dlist free_space_list;
-	struct sbi_dlist used_space_list;
+	unsigned long data_base;
+	unsigned long units;
+	unsigned long *start_map;
+	unsigned long *free_map;
+	unsigned long free_size;
+	struct sbi_dlist free_bins[HEAP_FREE_BINS];
+#ifdef CONFIG_SBI_HEAP_STATS
+	struct heap_stats stats;
+#endif
+#ifdef CONFIG_SBI_HEAP_SLAB
+	/* Size class plus one of every slab sized chunk, zero if not a slab */
+	u8 *slab_map;
+	struct heap_slab_class slab[HEAP_SLAB_CLASSES];
+#ifdef CONFIG_SBI_HEAP_MAGAZINE
+	/* Scratch offset of the per-HART magazine array pointer */
+	unsigned long mag_offset;
+#endif
+#endif
 };
 
 struct sbi_heap_control global_hpctrl;
 
+static inline unsigned long heap_unit(struct sbi_heap_control *hpctrl,
+				      unsigned long addr)
+{
+	return (addr - hpctrl->data_base) / HEAP_ALLOC_ALIGN;
+}
+
+static void heap_free_insert(struct sbi_heap_control *hpctrl,
+			     unsigned long addr, unsigned long size)
+{
+	struct heap_free_block *b = (struct heap_free_block *)addr;
+	unsigned long unit = heap_unit(hpctrl, addr);
+
+	b->size = size;
+	*(unsigned long *)(addr + size - sizeof(unsigned long)) = size;
+	__set_bit(unit, hpctrl->start_map);
+	__set_bit(unit, hpctrl->free_map);
+	__set_bit(unit + size / HEAP_ALLOC_ALIGN - 1, hpctrl->free_map);
+	sbi_list_add(&b->head,
+		     &hpctrl->free_bins[sbi_fls(size / HEAP_ALLOC_ALIGN)]);
+	hpctrl->free_size += size;
+}
+
+/* Note: the start bit of the block is left to the caller */
+static void heap_free_remove(struct sbi_heap_control *hpctrl,
+			     struct heap_free_block *b)
+{
+	unsigned long unit = heap_unit(hpctrl, (unsigned long)b);
+
+	__clear_bit(unit, hpctrl->free_map);
+	__clear_bit(unit + b->size / HEAP_ALLOC_ALIGN - 1, hpctrl->free_map);
+	sbi_list_del(&b->head);
+	hpctrl->free_size -= b->size;
+}
+
 static void *alloc_with_align(struct sbi_heap_control *hpctrl,
 			      size_t align, size_t size)
 {
 	void *ret = NULL;
-	struct heap_node *n, *np, *rem;
-	unsigned long lowest_aligned;
-	size_t pad;
+	struct heap_free_block *b, *np;
+	unsigned long lowest_aligned, bsize;
+	size_t pad = 0;
+	int bin;
 
 	if (!size)
 		return NULL;
@@ -51,80 +172,434 @@ static void *alloc_with_align(struct sbi_heap_control *hpctrl,
 	size += align - 1;
 	size &= ~((unsigned long)align - 1);
 
-	spin_lock(&hpctrl->lock);
+	qspin_lock(&hpctrl->lock);
 
+	/* First fit starting with the bin which may hold the size */
 	np = NULL;
-	sbi_list_for_each_entry(n, &hpctrl->free_space_list, head) {
-		lowest_aligned = ROUNDUP(n->addr, align);
-		pad = lowest_aligned - n->addr;
-
-		if (size + pad <= n->size) {
-			np = n;
-			break;
+	for (bin = sbi_fls(size / HEAP_ALLOC_ALIGN);
+	     bin < HEAP_FREE_BINS && !np; bin++) {
+		sbi_list_for_each_entry(b, &hpctrl->free_bins[bin], head) {
+			lowest_aligned = ROUNDUP((unsigned long)b, align);
+			pad = lowest_aligned - (unsigned long)b;
+
+			if (size + pad <= b->size) {
+				np = b;
+				break;
+			}
 		}
 	}
 	if (!np)
 		goto out;
 
-	if (pad) {
-		if (sbi_list_empty(&hpctrl->free_node_list)) {
+	bsize = np->size;
+	heap_free_remove(hpctrl, np);
+	if (pad)
+		heap_free_insert(hpctrl, (unsigned long)np, pad);
+	if (size + pad < bsize)
+		heap_free_insert(hpctrl, lowest_aligned + size,
+				 bsize - (size + pad));
+
+	__set_bit(heap_unit(hpctrl, lowest_aligned), hpctrl->start_map);
+	ret = (void *)lowest_aligned;
+
+out:
+	qspin_unlock(&hpctrl->lock);
+
+	return ret;
+}
+
+#ifdef CONFIG_SBI_HEAP_SLAB
+static int heap_slab_class(size_t size)
+{
+	int cls = 0;
+
+	while ((HEAP_ALLOC_ALIGN << cls) < size)
+		cls++;
+
+	return cls;
+}
+
+/* Take up to count free objects of a size class */
+static unsigned long heap_slab_get(struct sbi_heap_control *hpctrl, int cls,
+				   struct heap_slab_object **objs,
+				   unsigned long count)
+{
+	struct heap_slab_class *sc = &hpctrl->slab[cls];
+	unsigned long obj_size = HEAP_ALLOC_ALIGN << cls;
+	struct heap_slab_object *obj;
+	unsigned long i, ret = 0;
+	char *slab;
+
+	spin_lock(&sc->lock);
+
+	if (!sc->free) {
+		slab = alloc_with_align(hpctrl, HEAP_SLAB_SIZE, HEAP_SLAB_SIZE);
+		if (!slab)
 			goto out;
+
+		hpctrl->slab_map[((unsigned long)slab - hpctrl->base) /
+				 HEAP_SLAB_SIZE] = cls + 1;
+		for (i = HEAP_SLAB_SIZE; i; i -= obj_size) {
+			obj = (struct heap_slab_object *)&slab[i - obj_size];
+			obj->next = sc->free;
+			sc->free = obj;
 		}
+		sc->free_count += HEAP_SLAB_SIZE / obj_size;
+	}
+
+	while (ret < count && sc->free) {
+		objs[ret++] = sc->free;
+		sc->free = sc->free->next;
+	}
+	sc->free_count -= ret;
+
+out:
+	spin_unlock(&sc->lock);
+
+	return ret;
+}
+
+/* Give count free objects back to their size class */
+static void heap_slab_put(struct sbi_heap_control *hpctrl, int cls,
+			  struct heap_slab_object **objs, unsigned long count)
+{
+	struct heap_slab_class *sc = &hpctrl->slab[cls];
+	unsigned long i;
+
+	spin_lock(&sc->lock);
+	for (i = 0; i < count; i++) {
+		objs[i]->next = sc->free;
+		sc->free = objs[i];
+	}
+	sc->free_count += count;
+	spin_unlock(&sc->lock);
+}
+
+#ifdef CONFIG_SBI_HEAP_MAGAZINE
+static struct heap_magazine *heap_mag_thishart(struct sbi_heap_control *hpctrl,
+					       int cls)
+{
+	struct sbi_scratch *scratch;
+	struct heap_magazine *mags;
+
+	if (!hpctrl->mag_offset)
+		return NULL;
+
+	/* Magazines are allocated on first use by each HART */
+	scratch = sbi_scratch_thishart_ptr();
+	mags = sbi_scratch_read_type(scratch, struct heap_magazine *,
+				     hpctrl->mag_offset);
+	if (!mags) {
+		mags = alloc_with_align(hpctrl, HEAP_ALLOC_ALIGN,
+					sizeof(*mags) * HEAP_SLAB_CLASSES);
+		if (!mags)
+			return NULL;
+		sbi_memset(mags, 0, sizeof(*mags) * HEAP_SLAB_CLASSES);
+		sbi_scratch_write_type(scratch, struct heap_magazine *,
+				       hpctrl->mag_offset, mags);
+	}
+
+	return &mags[cls];
+}
+
+static unsigned long heap_mag_free_space(struct sbi_heap_control *hpctrl)
+{
+	struct heap_magazine *mags;
+	unsigned long ret = 0;
+	u32 i;
+	int cls;
+
+	if (!hpctrl->mag_offset)
+		return 0;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		mags = sbi_scratch_read_type(sbi_hartindex_to_scratch(i),
+					     struct heap_magazine *,
+					     hpctrl->mag_offset);
+		if (!mags)
+			continue;
+		for (cls = 0; cls < HEAP_SLAB_CLASSES; cls++)
+			ret += __atomic_load_n(&mags[cls].count,
+					       __ATOMIC_RELAXED) *
+			       (HEAP_ALLOC_ALIGN << cls);
+	}
+
+	return ret;
+}
+#else
+static inline struct heap_magazine *heap_mag_thishart(
+				struct sbi_heap_control *hpctrl, int cls)
+{
+	return NULL;
+}
+
+static inline unsigned long heap_mag_free_space(struct sbi_heap_control *hpctrl)
+{
+	return 0;
+}
+#endif
+
+static void *heap_slab_alloc(struct sbi_heap_control *hpctrl, size_t size)
+{
+	int cls = heap_slab_class(size);
+	struct heap_slab_object *obj;
+	struct heap_magazine *mag;
+
+	if (!hpctrl->slab_map)
+		return NULL;
+
+	mag = heap_mag_thishart(hpctrl, cls);
+	if (!mag)
+		return heap_slab_get(hpctrl, cls, &obj, 1) ? obj : NULL;
+
+	if (!mag->count)
+		mag->count = heap_slab_get(hpctrl, cls, mag->obj,
+					   HEAP_MAG_SIZE / 2);
+	if (!mag->count)
+		return NULL;
+
+	return mag->obj[--mag->count];
+}
+
+static bool heap_slab_free(struct sbi_heap_control *hpctrl, void *ptr)
+{
+	unsigned long addr = (unsigned long)ptr;
+	struct heap_slab_object *obj = ptr;
+	struct heap_magazine *mag;
+	u8 cls;
+
+	if (!hpctrl->slab_map || addr < hpctrl->base ||
+	    (hpctrl->base + hpctrl->size) <= addr)
+		return false;
+
+	/*
+	 * Chunks only become slabs while not allocated otherwise and are
+	 * never given back so the map entry of a live pointer is stable.
+	 */
+	cls = hpctrl->slab_map[(addr - hpctrl->base) / HEAP_SLAB_SIZE];
+	if (!cls)
+		return false;
+	cls--;
+
+	mag = heap_mag_thishart(hpctrl, cls);
+	if (!mag) {
+		heap_slab_put(hpctrl, cls, &obj, 1);
+		return true;
+	}
+
+	if (mag->count == HEAP_MAG_SIZE) {
+		heap_slab_put(hpctrl, cls, &mag->obj[HEAP_MAG_SIZE / 2],
+			      HEAP_MAG_SIZE / 2);
+		mag->count = HEAP_MAG_SIZE / 2;
+	}
+	mag->obj[mag->count++] = obj;
+
+	return true;
+}
+
+static unsigned long heap_slab_free_space(struct sbi_heap_control *hpctrl)
+{
+	unsigned long ret = 0;
+	int cls;
+
+	for (cls = 0; cls < HEAP_SLAB_CLASSES; cls++)
+		ret += __atomic_load_n(&hpctrl->slab[cls].free_count,
+				       __ATOMIC_RELAXED) *
+		       (HEAP_ALLOC_ALIGN << cls);
+
+	return ret + heap_mag_free_space(hpctrl);
+}
+
+static void heap_slab_init(struct sbi_heap_control *hpctrl)
+{
+	unsigned long map_size = hpctrl->size / HEAP_SLAB_SIZE;
+	int cls;
+
+	for (cls = 0; cls < HEAP_SLAB_CLASSES; cls++) {
+		SPIN_LOCK_INIT(hpctrl->slab[cls].lock);
+		hpctrl->slab[cls].free = NULL;
+		hpctrl->slab[cls].free_count = 0;
+	}
+
+	/* Without a map all allocations simply go to the heap lists */
+	hpctrl->slab_map = alloc_with_align(hpctrl, HEAP_ALLOC_ALIGN, map_size);
+	if (hpctrl->slab_map)
+		sbi_memset(hpctrl->slab_map, 0, map_size);
+#ifdef CONFIG_SBI_HEAP_MAGAZINE
+	hpctrl->mag_offset = 0;
+#endif
+}
+#else
+static inline void *heap_slab_alloc(struct sbi_heap_control *hpctrl,
+				    size_t size)
+{
+	return NULL;
+}
+
+static inline bool heap_slab_free(struct sbi_heap_control *hpctrl, void *ptr)
+{
+	return false;
+}
+
+static inline unsigned long heap_slab_free_space(struct sbi_heap_control *hpctrl)
+{
+	return 0;
+}
+
+static inline void heap_slab_init(struct sbi_heap_control *hpctrl)
+{
+}
+
+#define HEAP_SLAB_MAX_SIZE		0
+#endif
+
+#ifdef CONFIG_SBI_HEAP_STATS
+static void heap_stats_alloc(struct sbi_heap_control *hpctrl, void *ret,
+			     size_t size, unsigned long site)
+{
+	struct heap_stats *st = &hpctrl->stats;
+	unsigned long used;
+#ifdef CONFIG_SBI_HEAP_STATS_SITES
+	unsigned long i;
+#endif
+
+	if (!size)
+		return;
 
-		n = sbi_list_first_entry(&hpctrl->free_node_list,
-					 struct heap_node, head);
-		sbi_list_del(&n->head);
-
-		if ((size + pad < np->size) &&
-		    !sbi_list_empty(&hpctrl->free_node_list)) {
-			rem = sbi_list_first_entry(&hpctrl->free_node_list,
-						   struct heap_node, head);
-			sbi_list_del(&rem->head);
-			rem->addr = np->addr + (size + pad);
-			rem->size = np->size - (size + pad);
-			sbi_list_add_tail(&rem->head,
-					  &hpctrl->free_space_list);
-		} else if (size + pad != np->size) {
-			/* Can't allocate, return n */
-			sbi_list_add(&n->head, &hpctrl->free_node_list);
-			ret = NULL;
+	spin_lock(&st->lock);
+
+	if (!ret) {
+		st->failed++;
+		if (st->failed_max_size < size)
+			st->failed_max_size = size;
+		goto out;
+	}
+
+	st->allocs++;
+	used = hpctrl->size - hpctrl->hksize -
+	       __atomic_load_n(&hpctrl->free_size, __ATOMIC_RELAXED);
+	if (st->peak_used < used)
+		st->peak_used = used;
+
+#ifdef CONFIG_SBI_HEAP_STATS_SITES
+	for (i = 0; i < st->nr_sites; i++) {
+		if (st->sites[i].addr == site)
+			break;
+	}
+	if (i == st->nr_sites) {
+		if (i == SBI_HEAP_STATS_SITES)
 			goto out;
-		}
+		st->sites[i].addr = site;
+		st->nr_sites++;
+	}
+	st->sites[i].allocs++;
+	st->sites[i].bytes += size;
+#endif
+
+out:
+	spin_unlock(&st->lock);
+}
+
+static void heap_stats_free(struct sbi_heap_control *hpctrl)
+{
+	spin_lock(&hpctrl->stats.lock);
+	hpctrl->stats.frees++;
+	spin_unlock(&hpctrl->stats.lock);
+}
 
-		n->addr = lowest_aligned;
-		n->size = size;
-		sbi_list_add_tail(&n->head, &hpctrl->used_space_list);
-
-		np->size = pad;
-		ret = (void *)n->addr;
-	} else {
-		if ((size < np->size) &&
-		    !sbi_list_empty(&hpctrl->free_node_list)) {
-			n = sbi_list_first_entry(&hpctrl->free_node_list,
-						 struct heap_node, head);
-			sbi_list_del(&n->head);
-			n->addr = np->addr;
-			n->size = size;
-			np->addr += size;
-			np->size -= size;
-			sbi_list_add_tail(&n->head, &hpctrl->used_space_list);
-			ret = (void *)n->addr;
-		} else if (size == np->size) {
-			sbi_list_del(&np->head);
-			sbi_list_add_tail(&np->head, &hpctrl->used_space_list);
-			ret = (void *)np->addr;
+static void heap_stats_init(struct sbi_heap_control *hpctrl)
+{
+	sbi_memset(&hpctrl->stats, 0, sizeof(hpctrl->stats));
+	SPIN_LOCK_INIT(hpctrl->stats.lock);
+}
+
+static unsigned long heap_largest_free(struct sbi_heap_control *hpctrl)
+{
+	struct heap_free_block *b;
+	unsigned long ret = 0;
+	int bin;
+
+	/* Only the highest non-empty bin can hold the largest block */
+	qspin_lock(&hpctrl->lock);
+	for (bin = HEAP_FREE_BINS - 1; bin >= 0 && !ret; bin--) {
+		sbi_list_for_each_entry(b, &hpctrl->free_bins[bin], head) {
+			if (ret < b->size)
+				ret = b->size;
 		}
 	}
+	qspin_unlock(&hpctrl->lock);
 
-out:
-	spin_unlock(&hpctrl->lock);
+	return ret;
+}
+
+void sbi_heap_stats_from(struct sbi_heap_control *hpctrl,
+			 struct sbi_heap_stats *stats)
+{
+	struct heap_stats *st = &hpctrl->stats;
+#ifdef CONFIG_SBI_HEAP_STATS_SITES
+	unsigned long i;
+#endif
+
+	sbi_memset(stats, 0, sizeof(*stats));
+	stats->total = hpctrl->size;
+	stats->reserved = sbi_heap_reserved_space_from(hpctrl);
+	stats->free = sbi_heap_free_space_from(hpctrl);
+	stats->used = stats->total - stats->reserved - stats->free;
+	stats->largest_free = heap_largest_free(hpctrl);
+
+	spin_lock(&st->lock);
+	stats->peak_used = st->peak_used;
+	stats->allocs = st->allocs;
+	stats->frees = st->frees;
+	stats->failed = st->failed;
+	stats->failed_max_size = st->failed_max_size;
+#ifdef CONFIG_SBI_HEAP_STATS_SITES
+	stats->nr_sites = st->nr_sites;
+	for (i = 0; i < st->nr_sites; i++) {
+		stats->sites[i].addr = st->sites[i].addr;
+		stats->sites[i].allocs = st->sites[i].allocs;
+		stats->sites[i].bytes = st->sites[i].bytes;
+	}
+#endif
+	spin_unlock(&st->lock);
+}
+#else
+static inline void heap_stats_alloc(struct sbi_heap_control *hpctrl,
+				    void *ret, size_t size, unsigned long site)
+{
+}
+
+static inline void heap_stats_free(struct sbi_heap_control *hpctrl)
+{
+}
+
+static inline void heap_stats_init(struct sbi_heap_control *hpctrl)
+{
+}
+#endif
+
+/* Address the public allocation function was called from */
+#define HEAP_CALLER	((unsigned long)__builtin_return_address(0))
+
+static void *heap_alloc(struct sbi_heap_control *hpctrl, size_t align,
+			size_t size, unsigned long site)
+{
+	void *ret = NULL;
+
+	/* Slab objects are aligned to their size which is at least size */
+	if (size && size <= HEAP_SLAB_MAX_SIZE)
+		ret = heap_slab_alloc(hpctrl, size);
+	if (!ret)
+		ret = alloc_with_align(hpctrl, align, size);
+
+	heap_stats_alloc(hpctrl, ret, size, site);
 
 	return ret;
 }
 
 void *sbi_malloc_from(struct sbi_heap_control *hpctrl, size_t size)
 {
-	return alloc_with_align(hpctrl, HEAP_ALLOC_ALIGN, size);
+	return heap_alloc(hpctrl, HEAP_ALLOC_ALIGN, size, HEAP_CALLER);
 }
 
 void *sbi_aligned_alloc_from(struct sbi_heap_control *hpctrl,
@@ -141,82 +616,83 @@ void *sbi_aligned_alloc_from(struct sbi_heap_control *hpctrl,
 	if (size % alignment != 0)
 		return NULL;
 
-	return alloc_with_align(hpctrl, alignment, size);
+	return heap_alloc(hpctrl, alignment, size, HEAP_CALLER);
 }
 
 void *sbi_zalloc_from(struct sbi_heap_control *hpctrl, size_t size)
 {
-	void *ret = sbi_malloc_from(hpctrl, size);
+	void *ret = heap_alloc(hpctrl, HEAP_ALLOC_ALIGN, size, HEAP_CALLER);
 
 	if (ret)
-		sbi_memset(ret, 0, size);
+		sbi_hart_memzero(ret, size);
 	return ret;
 }
 
 void sbi_free_from(struct sbi_heap_control *hpctrl, void *ptr)
 {
-	struct heap_node *n, *np;
+	unsigned long addr = (unsigned long)ptr, unit, next, size;
+	struct heap_free_block *b;
 
 	if (!ptr)
 		return;
 
-	spin_lock(&hpctrl->lock);
+	heap_stats_free(hpctrl);
+	if (heap_slab_free(hpctrl, ptr))
+		return;
 
-	np = NULL;
-	sbi_list_for_each_entry(n, &hpctrl->used_space_list, head) {
-		if ((n->addr <= (unsigned long)ptr) &&
-		    ((unsigned long)ptr < (n->addr + n->size))) {
-			np = n;
-			break;
-		}
-	}
-	if (!np) {
-		spin_unlock(&hpctrl->lock);
+	if (addr < hpctrl->data_base || (hpctrl->base + hpctrl->size) <= addr ||
+	    (addr & (HEAP_ALLOC_ALIGN - 1)))
+		return;
+
+	qspin_lock(&hpctrl->lock);
+
+	unit = heap_unit(hpctrl, addr);
+	if (!__test_bit(unit, hpctrl->start_map) ||
+	    __test_bit(unit, hpctrl->free_map)) {
+		qspin_unlock(&hpctrl->lock);
 		return;
 	}
 
-	sbi_list_del(&np->head);
+	next = find_next_bit(hpctrl->start_map, hpctrl->units, unit + 1);
+	size = (next - unit) * HEAP_ALLOC_ALIGN;
 
-	sbi_list_for_each_entry(n, &hpctrl->free_space_list, head) {
-		if ((np->addr + np->size) == n->addr) {
-			n->addr = np->addr;
-			n->size += np->size;
-			sbi_list_add_tail(&np->head, &hpctrl->free_node_list);
-			np = NULL;
-			break;
-		} else if (np->addr == (n->addr + n->size)) {
-			n->size += np->size;
-			sbi_list_add_tail(&np->head, &hpctrl->free_node_list);
-			np = NULL;
-			break;
-		} else if ((n->addr + n->size) < np->addr) {
-			sbi_list_add(&np->head, &n->head);
-			np = NULL;
-			break;
-		}
+	/* Merge with the next block if it is free */
+	if (next < hpctrl->units && __test_bit(next, hpctrl->free_map)) {
+		b = (struct heap_free_block *)(addr + size);
+		size += b->size;
+		heap_free_remove(hpctrl, b);
+		__clear_bit(next, hpctrl->start_map);
+	}
+
+	/* The last unit of the previous block is tagged if it is free */
+	if (unit && __test_bit(unit - 1, hpctrl->free_map)) {
+		b = (struct heap_free_block *)(addr -
+				*(unsigned long *)(addr - sizeof(unsigned long)));
+		size += b->size;
+		heap_free_remove(hpctrl, b);
+		__clear_bit(unit, hpctrl->start_map);
+		addr = (unsigned long)b;
 	}
-	if (np)
-		sbi_list_add_tail(&np->head, &hpctrl->free_space_list);
 
-	spin_unlock(&hpctrl->lock);
+	heap_free_insert(hpctrl, addr, size);
+
+	qspin_unlock(&hpctrl->lock);
 }
 
 unsigned long sbi_heap_free_space_from(struct sbi_heap_control *hpctrl)
 {
-	struct heap_node *n;
-	unsigned long ret = 0;
+	unsigned long ret;
 
-	spin_lock(&hpctrl->lock);
-	sbi_list_for_each_entry(n, &hpctrl->free_space_list, head)
-		ret += n->size;
-	spin_unlock(&hpctrl->lock);
+	qspin_lock(&hpctrl->lock);
+	ret = hpctrl->free_size;
+	qspin_unlock(&hpctrl->lock);
 
-	return ret;
+	return ret + heap_slab_free_space(hpctrl);
 }
 
 unsigned long sbi_heap_used_space_from(struct sbi_heap_control *hpctrl)
 {
-	return hpctrl->size - hpctrl->hksize - sbi_heap_free_space();
+	return hpctrl->size - hpctrl->hksize - sbi_heap_free_space_from(hpctrl);
 }
 
 unsigned long sbi_heap_reserved_space_from(struct sbi_heap_control *hpctrl)
@@ -227,41 +703,47 @@ unsigned long sbi_heap_reserved_space_from(struct sbi_heap_control *hpctrl)
 int sbi_heap_init_new(struct sbi_heap_control *hpctrl, unsigned long base,
 		       unsigned long size)
 {
-	unsigned long i;
-	struct heap_node *n;
+	unsigned long map_longs = BITS_TO_LONGS(size / HEAP_ALLOC_ALIGN);
+	int i;
 
 	/* Initialize heap control */
-	SPIN_LOCK_INIT(hpctrl->lock);
+	QSPIN_LOCK_INIT(hpctrl->lock);
 	hpctrl->base = base;
 	hpctrl->size = size;
 	hpctrl->hkbase = hpctrl->base;
-	hpctrl->hksize = hpctrl->size / HEAP_HOUSEKEEPING_FACTOR;
-	hpctrl->hksize &= ~((unsigned long)HEAP_BASE_ALIGN - 1);
-	SBI_INIT_LIST_HEAD(&hpctrl->free_node_list);
-	SBI_INIT_LIST_HEAD(&hpctrl->free_space_list);
-	SBI_INIT_LIST_HEAD(&hpctrl->used_space_list);
-
-	/* Prepare free node list */
-	for (i = 0; i < (hpctrl->hksize / sizeof(*n)); i++) {
-		n = (struct heap_node *)(hpctrl->hkbase + (sizeof(*n) * i));
-		SBI_INIT_LIST_HEAD(&n->head);
-		n->addr = n->size = 0;
-		sbi_list_add_tail(&n->head, &hpctrl->free_node_list);
-	}
+	hpctrl->hksize = ROUNDUP(2 * map_longs * sizeof(unsigned long),
+				 HEAP_ALLOC_ALIGN);
+	if (hpctrl->size <= hpctrl->hksize)
+		return SBI_EINVAL;
+	hpctrl->data_base = hpctrl->hkbase + hpctrl->hksize;
+	hpctrl->units = (hpctrl->size - hpctrl->hksize) / HEAP_ALLOC_ALIGN;
+	hpctrl->free_size = 0;
+	for (i = 0; i < HEAP_FREE_BINS; i++)
+		SBI_INIT_LIST_HEAD(&hpctrl->free_bins[i]);
+
+	/* Prepare block maps */
+	hpctrl->start_map = (unsigned long *)hpctrl->hkbase;
+	hpctrl->free_map = hpctrl->start_map + map_longs;
+	sbi_memset(hpctrl->start_map, 0,
+		   2 * map_longs * sizeof(unsigned long));
+
+	/* Whole heap is one free block */
+	heap_free_insert(hpctrl, hpctrl->data_base,
+			 hpctrl->units * HEAP_ALLOC_ALIGN);
 
-	/* Prepare free space list */
-	n = sbi_list_first_entry(&hpctrl->free_node_list,
-				 struct heap_node, head);
-	sbi_list_del(&n->head);
-	n->addr = hpctrl->hkbase + hpctrl->hksize;
-	n->size = hpctrl->size - hpctrl->hksize;
-	sbi_list_add_tail(&n->head, &hpctrl->free_space_list);
+	heap_slab_init(hpctrl);
+	heap_stats_init(hpctrl);
 
 	return 0;
 }
 
 int sbi_heap_init(struct sbi_scratch *scratch)
 {
+	int rc;
+#ifdef CONFIG_SBI_HEAP_SLAB
+	int cls;
+#endif
+
 	/* Sanity checks on heap offset and size */
 	if (!scratch->fw_heap_size ||
 	    (scratch->fw_heap_size & (HEAP_BASE_ALIGN - 1)) ||
@@ -270,9 +752,25 @@ int sbi_heap_init(struct sbi_scratch *scratch)
 	    (scratch->fw_heap_offset & (HEAP_BASE_ALIGN - 1)))
 		return SBI_EINVAL;
 
-	return sbi_heap_init_new(&global_hpctrl,
-				  scratch->fw_start + scratch->fw_heap_offset,
-				  scratch->fw_heap_size);
+	rc = sbi_heap_init_new(&global_hpctrl,
+			       scratch->fw_start + scratch->fw_heap_offset,
+			       scratch->fw_heap_size);
+	if (rc)
+		return rc;
+
+	qspin_lock_set_name(&global_hpctrl.lock, "heap");
+#ifdef CONFIG_SBI_HEAP_SLAB
+	for (cls = 0; cls < HEAP_SLAB_CLASSES; cls++)
+		spin_lock_set_name(&global_hpctrl.slab[cls].lock, "heap_slab");
+#endif
+
+#ifdef CONFIG_SBI_HEAP_MAGAZINE
+	/* Without an offset the global heap works without magazines */
+	global_hpctrl.mag_offset =
+		sbi_scratch_alloc_type_offset(struct heap_magazine *);
+#endif
+
+	return 0;
 }
 
 int sbi_heap_alloc_new(struct sbi_heap_control **hpctrl)
@@ -280,3 +778,112 @@ int sbi_heap_alloc_new(struct sbi_heap_control **hpctrl)
 	*hpctrl = sbi_calloc(1, sizeof(struct sbi_heap_control));
 	return 0;
 }
+
+#ifdef CONFIG_SBI_HEAP_NUMA
+
+static struct sbi_heap_control *node_hpctrl[SBI_HEAP_NUMA_NODES_MAX];
+
+/* Scratch offset of the NUMA node plus one of the HART, zero if unknown */
+static unsigned long heap_node_off;
+
+int sbi_heap_node_add(u32 node, unsigned long base, unsigned long size)
+{
+	struct sbi_heap_control *hpctrl;
+	int rc;
+
+	if (node >= SBI_HEAP_NUMA_NODES_MAX ||
+	    (base & (HEAP_BASE_ALIGN - 1)) || (size & (HEAP_BASE_ALIGN - 1)))
+		return SBI_EINVAL;
+	if (node_hpctrl[node])
+		return SBI_EALREADY;
+
+	rc = sbi_heap_alloc_new(&hpctrl);
+	if (rc)
+		return rc;
+	if (!hpctrl)
+		return SBI_ENOMEM;
+
+	rc = sbi_heap_init_new(hpctrl, base, size);
+	if (rc) {
+		sbi_free(hpctrl);
+		return rc;
+	}
+	qspin_lock_set_name(&hpctrl->lock, "heap_node");
+
+	node_hpctrl[node] = hpctrl;
+	return 0;
+}
+
+void sbi_heap_set_hart_node(struct sbi_scratch *scratch, u32 node)
+{
+	if (!heap_node_off) {
+		heap_node_off = sbi_scratch_alloc_type_offset(u32);
+		if (!heap_node_off)
+			return;
+	}
+
+	sbi_scratch_write_type(scratch, u32, heap_node_off, node + 1);
+}
+
+static struct sbi_heap_control *heap_local_hpctrl(void)
+{
+	u32 node;
+
+	if (!heap_node_off)
+		return NULL;
+
+	node = sbi_scratch_read_type(sbi_scratch_thishart_ptr(), u32,
+				     heap_node_off);
+	if (!node || node > SBI_HEAP_NUMA_NODES_MAX)
+		return NULL;
+
+	return node_hpctrl[node - 1];
+}
+
+void *sbi_malloc_local(size_t size)
+{
+	struct sbi_heap_control *hpctrl = heap_local_hpctrl();
+	void *ret;
+
+	if (hpctrl) {
+		ret = sbi_malloc_from(hpctrl, size);
+		if (ret)
+			return ret;
+	}
+
+	/* Remote memory is still better than failing */
+	return sbi_malloc(size);
+}
+
+void *sbi_aligned_alloc_local(size_t alignment, size_t size)
+{
+	struct sbi_heap_control *hpctrl = heap_local_hpctrl();
+	void *ret;
+
+	if (hpctrl) {
+		ret = sbi_aligned_alloc_from(hpctrl, alignment, size);
+		if (ret)
+			return ret;
+	}
+
+	return sbi_aligned_alloc(alignment, size);
+}
+
+void sbi_free_local(void *ptr)
+{
+	struct sbi_heap_control *hpctrl;
+	int i;
+
+	for (i = 0; i < SBI_HEAP_NUMA_NODES_MAX; i++) {
+		hpctrl = node_hpctrl[i];
+		if (hpctrl && hpctrl->base <= (unsigned long)ptr &&
+		    (unsigned long)ptr < (hpctrl->base + hpctrl->size)) {
+			sbi_free_from(hpctrl, ptr);
+			return;
+		}
+	}
+
+	sbi_free(ptr);
+}
+
+#endif
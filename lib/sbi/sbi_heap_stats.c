@@ -0,0 +1,68 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Heap usage and allocation statistics
+ */
+
+#include <sbi/riscv_encoding.h>
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_heap_stats.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_trap.h>
+
+/* Too large for the stack so snapshots are taken into one buffer */
+static struct sbi_heap_stats heap_stats;
+static spinlock_t heap_stats_lock = SPIN_LOCK_INITIALIZER;
+
+void sbi_heap_stats_print(void)
+{
+	struct sbi_heap_stats *stats = &heap_stats;
+	u64 i;
+
+	spin_lock(&heap_stats_lock);
+	sbi_heap_stats_from(&global_hpctrl, stats);
+
+	sbi_printf("Firmware Heap Usage       : "
+		   "%d KB (peak), %d KB (largest free), %lu (failed)\n",
+		   (u32)(stats->peak_used / 1024),
+		   (u32)(stats->largest_free / 1024), (ulong)stats->failed);
+	for (i = 0; i < stats->nr_sites; i++)
+		sbi_printf("Firmware Heap Call Site   : "
+			   "0x%lx %lu (allocs), %lu B\n",
+			   (ulong)stats->sites[i].addr,
+			   (ulong)stats->sites[i].allocs,
+			   (ulong)stats->sites[i].bytes);
+	spin_unlock(&heap_stats_lock);
+}
+
+static int heap_stats_read(unsigned long addr_lo, unsigned long addr_hi)
+{
+	int rc;
+
+	spin_lock(&heap_stats_lock);
+	sbi_heap_stats_from(&global_hpctrl, &heap_stats);
+	rc = sbi_domain_copy_to_smode(addr_lo, addr_hi, &heap_stats,
+				      sizeof(heap_stats));
+	spin_unlock(&heap_stats_lock);
+
+	return rc;
+}
+
+int sbi_heap_stats_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			  struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_HEAP_STATS:
+		return heap_stats_read(regs->a0, regs->a1);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
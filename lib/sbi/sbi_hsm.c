@@ -19,11 +19,14 @@
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_hsm.h>
+#include <sbi/sbi_hsm_stats.h>
 #include <sbi/sbi_init.h>
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_system.h>
 #include <sbi/sbi_timer.h>
+#include <sbi/sbi_tlb.h>
+#include <sbi/sbi_unit_test.h>
 #include <sbi/sbi_console.h>
 
 #define __sbi_hsm_hart_change_state(hdata, oldstate, newstate)		\
@@ -32,12 +35,43 @@
 	if (state != (oldstate))					\
 		sbi_printf("%s: ERR: The hart is in invalid state [%lu]\n", \
 			   __func__, state);				\
+	else								\
+		hsm_interruptible_update(oldstate, newstate);		\
 	state == (oldstate);						\
 })
 
+/*
+ * Set on top of SBI_HSM_STATE_STOPPED by the HART which claimed a stopped
+ * HART for starting it while it writes the start request. Other HARTs
+ * still see the target as stopped but fail to claim it too.
+ */
+#define HSM_STATE_START_CLAIMED		0x100
+#define HSM_STATE_MASK			0xff
+
 static const struct sbi_hsm_device *hsm_dev = NULL;
 static unsigned long hart_data_offset;
 
+/*
+ * Generation of the HART states which is bumped whenever a HART becomes
+ * a valid IPI target or stops being one. It starts at one because a zero
+ * generation marks the cached mask of a domain as invalid.
+ */
+static unsigned long hsm_interruptible_gen = 1;
+
+static inline bool hsm_state_interruptible(long state)
+{
+	return state == SBI_HSM_STATE_STARTED ||
+	       state == SBI_HSM_STATE_SUSPENDED ||
+	       state == SBI_HSM_STATE_RESUME_PENDING;
+}
+
+static inline void hsm_interruptible_update(long oldstate, long newstate)
+{
+	if (hsm_state_interruptible(oldstate) !=
+	    hsm_state_interruptible(newstate))
+		__atomic_add_fetch(&hsm_interruptible_gen, 1, __ATOMIC_RELEASE);
+}
+
 /** Per hart specific data to manage state transition **/
 struct sbi_hsm_data {
 	atomic_t state;
@@ -49,7 +83,10 @@ struct sbi_hsm_data {
 #if __riscv_xlen == 32
 	unsigned long saved_menvcfgh;
 #endif
-	atomic_t start_ticket;
+	/* Timer value of the start request (0 if not measured) */
+	u64 start_time;
+	/* Stopped HART is in a platform suspend state */
+	bool stop_suspended;
 };
 
 bool sbi_hsm_hart_change_state(struct sbi_scratch *scratch, long oldstate,
@@ -70,7 +107,7 @@ int __sbi_hsm_hart_get_state(u32 hartindex)
 		return SBI_EINVAL;
 
 	hdata = sbi_scratch_offset_ptr(scratch, hart_data_offset);
-	return atomic_read(&hdata->state);
+	return atomic_read(&hdata->state) & HSM_STATE_MASK;
 }
 
 int sbi_hsm_hart_get_state(const struct sbi_domain *dom, u32 hartid)
@@ -83,30 +120,22 @@ int sbi_hsm_hart_get_state(const struct sbi_domain *dom, u32 hartid)
 	return __sbi_hsm_hart_get_state(hartindex);
 }
 
-/*
- * Try to acquire the ticket for the given target hart to make sure only
- * one hart prepares the start of the target hart.
- * Returns true if the ticket has been acquired, false otherwise.
+/**
+ * Check whether remote fences for a hart can wait until it resumes
+ * @param scratch the scratch space of the hart
+ * @return true if the hart is in a non-retentive suspend
  *
- * The function has "acquire" semantics: no memory operations following it
- * in the current hart can be seen before it by other harts.
- * atomic_cmpxchg() provides the memory barriers needed for that.
+ * The hart loses its TLB contents or flushes them on resume anyway so
+ * waking it up only to flush is wasted. A stale suspend type only makes
+ * the hart flush once more on resume.
  */
-static bool hsm_start_ticket_acquire(struct sbi_hsm_data *hdata)
+bool sbi_hsm_hart_fence_deferrable(struct sbi_scratch *scratch)
 {
-	return (atomic_cmpxchg(&hdata->start_ticket, 0, 1) == 0);
-}
+	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
+							    hart_data_offset);
 
-/*
- * Release the ticket for the given target hart.
- *
- * The function has "release" semantics: no memory operations preceding it
- * in the current hart can be seen after it by other harts.
- */
-static void hsm_start_ticket_release(struct sbi_hsm_data *hdata)
-{
-	RISCV_FENCE(rw, w);
-	atomic_write(&hdata->start_ticket, 0);
+	return atomic_read(&hdata->state) == SBI_HSM_STATE_SUSPENDED &&
+	       (hdata->suspend_type & SBI_HSM_SUSP_NON_RET_BIT);
 }
 
 /**
@@ -118,20 +147,47 @@ static void hsm_start_ticket_release(struct sbi_hsm_data *hdata)
 int sbi_hsm_hart_interruptible_mask(const struct sbi_domain *dom,
 				    struct sbi_hartmask *mask)
 {
-	int hstate, ret;
 	u32 i;
+	unsigned long gen, agen;
+	struct sbi_domain *tdom = (struct sbi_domain *)dom;
 
-	ret = sbi_domain_get_assigned_hartmask(dom, mask);
-	if (ret)
-		return ret;
+	if (!dom) {
+		sbi_hartmask_clear_all(mask);
+		return 0;
+	}
 
-	sbi_hartmask_for_each_hartindex(i, mask) {
-		hstate = __sbi_hsm_hart_get_state(i);
-		if (hstate != SBI_HSM_STATE_STARTED &&
-		    hstate != SBI_HSM_STATE_SUSPENDED &&
-		    hstate != SBI_HSM_STATE_RESUME_PENDING)
-			sbi_hartmask_clear_hartindex(i, mask);
+	/*
+	 * The HART states are only walked again when some HART changed
+	 * its interruptibility or the assigned HARTs of the domain changed
+	 * since the cached mask was built.
+	 */
+	gen = __atomic_load_n(&hsm_interruptible_gen, __ATOMIC_ACQUIRE);
+	agen = __atomic_load_n(&tdom->assigned_gen, __ATOMIC_ACQUIRE);
+
+	read_lock(&tdom->interruptible_harts_lock);
+	if (tdom->interruptible_gen == gen &&
+	    tdom->interruptible_assigned_gen == agen) {
+		sbi_hartmask_copy(mask, &tdom->interruptible_harts);
+		read_unlock(&tdom->interruptible_harts_lock);
+		return 0;
 	}
+	read_unlock(&tdom->interruptible_harts_lock);
+
+	write_lock(&tdom->interruptible_harts_lock);
+	if (tdom->interruptible_gen != gen ||
+	    tdom->interruptible_assigned_gen != agen) {
+		sbi_domain_get_assigned_hartmask(tdom,
+						 &tdom->interruptible_harts);
+		sbi_hartmask_for_each_hartindex(i, &tdom->interruptible_harts) {
+			if (!hsm_state_interruptible(__sbi_hsm_hart_get_state(i)))
+				sbi_hartmask_clear_hartindex(i,
+						&tdom->interruptible_harts);
+		}
+		tdom->interruptible_gen = gen;
+		tdom->interruptible_assigned_gen = agen;
+	}
+	sbi_hartmask_copy(mask, &tdom->interruptible_harts);
+	write_unlock(&tdom->interruptible_harts_lock);
 
 	return 0;
 }
@@ -142,9 +198,14 @@ void __noreturn sbi_hsm_hart_start_finish(struct sbi_scratch *scratch,
 	unsigned long next_arg1;
 	unsigned long next_addr;
 	unsigned long next_mode;
+	u64 start_time;
 	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
 							    hart_data_offset);
 
+	/*
+	 * The start request was written before the HART became
+	 * START_PENDING and cannot change again until it is stopped.
+	 */
 	if (!__sbi_hsm_hart_change_state(hdata, SBI_HSM_STATE_START_PENDING,
 					 SBI_HSM_STATE_STARTED))
 		sbi_hart_hang();
@@ -152,34 +213,13 @@ void __noreturn sbi_hsm_hart_start_finish(struct sbi_scratch *scratch,
 	next_arg1 = scratch->next_arg1;
 	next_addr = scratch->next_addr;
 	next_mode = scratch->next_mode;
-	hsm_start_ticket_release(hdata);
+	start_time = hdata->start_time;
+	hdata->start_time = 0;
 
-	sbi_hart_switch_mode(hartid, next_arg1, next_addr, next_mode, false);
-}
+	if (start_time)
+		sbi_hsm_stats_start_done(scratch, start_time);
 
-static void sbi_hsm_hart_wait(struct sbi_scratch *scratch)
-{
-	unsigned long saved_mie;
-	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
-							    hart_data_offset);
-	/* Save MIE CSR */
-	saved_mie = csr_read(CSR_MIE);
-
-	/* Set MSIE and MEIE bits to receive IPI */
-	csr_set(CSR_MIE, MIP_MSIP | MIP_MEIP);
-
-	/* Wait for state transition requested by sbi_hsm_hart_start() */
-	while (atomic_read(&hdata->state) != SBI_HSM_STATE_START_PENDING) {
-		wfi();
-	}
-
-	/* Restore MIE CSR */
-	csr_write(CSR_MIE, saved_mie);
-
-	/*
-	 * No need to clear IPI here because the sbi_ipi_init() will
-	 * clear it for current HART.
-	 */
+	sbi_hart_switch_mode(hartid, next_arg1, next_addr, next_mode, false);
 }
 
 const struct sbi_hsm_device *sbi_hsm_get_device(void)
@@ -236,6 +276,92 @@ static void hsm_device_hart_resume(void)
 		hsm_dev->hart_resume();
 }
 
+#ifdef CONFIG_SBI_HSM_STOP_SUSPEND
+/*
+ * Put a stopped HART into the deepest platform non-retentive state of
+ * the HSM device instead of parking it in WFI. If the HART powers down,
+ * the IPI of the next HSM start brings it back through the warm boot
+ * path. Returns false if the HART has to wait in WFI.
+ */
+static bool hsm_hart_stop_suspend(struct sbi_hsm_data *hdata)
+{
+	u32 i, suspend_type;
+
+	if (!hsm_dev || !hsm_dev->hart_suspend)
+		return false;
+
+	for (i = hsm_dev->idle_state_count; i > 0; i--) {
+		suspend_type = hsm_dev->idle_states[i - 1].suspend_type;
+		if (suspend_type & SBI_HSM_SUSP_NON_RET_BIT)
+			break;
+	}
+	if (!i)
+		return false;
+
+	hdata->stop_suspended = true;
+	if (hsm_device_hart_suspend(suspend_type)) {
+		hdata->stop_suspended = false;
+		return false;
+	}
+
+	/* An interrupt was pending so the HART did not power down */
+	hdata->stop_suspended = false;
+	hsm_device_hart_resume();
+
+	return true;
+}
+#else
+static bool hsm_hart_stop_suspend(struct sbi_hsm_data *hdata)
+{
+	return false;
+}
+#endif
+
+static void sbi_hsm_hart_wait(struct sbi_scratch *scratch)
+{
+	long state;
+	unsigned long saved_mie;
+	bool zawrs = sbi_hart_has_extension(scratch, SBI_HART_EXT_ZAWRS);
+	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
+							    hart_data_offset);
+
+	/* Undo the platform suspend of a HART woken up while stopped */
+	if (hdata->stop_suspended) {
+		hdata->stop_suspended = false;
+		hsm_device_hart_resume();
+	}
+
+	/* Save MIE CSR */
+	saved_mie = csr_read(CSR_MIE);
+
+	/* Set MSIE and MEIE bits to receive IPI */
+	csr_set(CSR_MIE, MIP_MSIP | MIP_MEIP);
+
+	/* Wait for state transition requested by sbi_hsm_hart_start() */
+	while ((state = atomic_read(&hdata->state)) !=
+	       SBI_HSM_STATE_START_PENDING) {
+		sbiunit_hart_wait();
+
+		if (state == SBI_HSM_STATE_STOPPED &&
+		    hsm_hart_stop_suspend(hdata))
+			continue;
+
+		/* With Zawrs also wake up as soon as the state is written */
+		if (zawrs)
+			atomic_wrs_wait(&hdata->state, state, false);
+		else
+			wfi();
+	}
+
+	/* Restore MIE CSR */
+	csr_write(CSR_MIE, saved_mie);
+
+	/*
+	 * No need to clear IPI here because the sbi_ipi_init() will
+	 * clear it for current HART.
+	 */
+}
+
 int sbi_hsm_init(struct sbi_scratch *scratch, bool cold_boot)
 {
 	u32 i;
@@ -259,7 +385,8 @@ int sbi_hsm_init(struct sbi_scratch *scratch, bool cold_boot)
 				    (i == current_hartindex()) ?
 				    SBI_HSM_STATE_START_PENDING :
 				    SBI_HSM_STATE_STOPPED);
-			ATOMIC_INIT(&hdata->start_ticket, 0);
+			hdata->start_time = 0;
+			hdata->stop_suspended = false;
 		}
 	} else {
 		sbi_hsm_hart_wait(scratch);
@@ -268,6 +395,40 @@ int sbi_hsm_init(struct sbi_scratch *scratch, bool cold_boot)
 	return 0;
 }
 
+/**
+ * Restart the current HART in the given next stage through the warm
+ * boot path as if it had been stopped and started again through HSM
+ */
+void __noreturn sbi_hsm_hart_restart(struct sbi_scratch *scratch,
+				     ulong saddr, ulong smode, ulong arg1)
+{
+	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
+							    hart_data_offset);
+	void (*jump_warmboot)(void) = (void (*)(void))scratch->warmboot_addr;
+
+	if (!__sbi_hsm_hart_change_state(hdata, SBI_HSM_STATE_STARTED,
+					 SBI_HSM_STATE_STOP_PENDING) ||
+	    !__sbi_hsm_hart_change_state(hdata, SBI_HSM_STATE_STOP_PENDING,
+					 SBI_HSM_STATE_STOPPED |
+					 HSM_STATE_START_CLAIMED))
+		sbi_hart_hang();
+
+	/* Claimed right away so that no other HART can start this one */
+	scratch->next_arg1 = arg1;
+	scratch->next_addr = saddr;
+	scratch->next_mode = smode;
+
+	if (!__sbi_hsm_hart_change_state(hdata, SBI_HSM_STATE_STOPPED |
+					 HSM_STATE_START_CLAIMED,
+					 SBI_HSM_STATE_START_PENDING))
+		sbi_hart_hang();
+
+	jump_warmboot();
+
+	/* It should never reach here */
+	sbi_hart_hang();
+}
+
 void __noreturn sbi_hsm_exit(struct sbi_scratch *scratch)
 {
 	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
@@ -296,32 +457,38 @@ fail_exit:
 	sbi_hart_hang();
 }
 
-int sbi_hsm_hart_start(struct sbi_scratch *scratch,
-		       const struct sbi_domain *dom,
-		       u32 hartid, ulong saddr, ulong smode, ulong arg1)
+/*
+ * Move a validated target HART to START_PENDING and wake it up. When
+ * ipi_mask is given, HARTs woken up by an IPI are only added to the mask
+ * and the caller has to send the IPIs (or roll back on failure).
+ */
+static int hsm_hart_start_one(struct sbi_scratch *scratch, u32 hartindex,
+			      ulong saddr, ulong smode, ulong arg1,
+			      struct sbi_hartmask *ipi_mask)
 {
-	u32 hartindex = sbi_hartid_to_hartindex(hartid);
 	unsigned long init_count, entry_count;
 	unsigned int hstate;
 	struct sbi_scratch *rscratch;
 	struct sbi_hsm_data *hdata;
 	int rc;
 
-	/* For now, we only allow start mode to be S-mode or U-mode. */
-	if (smode != PRV_S && smode != PRV_U)
-		return SBI_EINVAL;
-	if (dom && !sbi_domain_is_assigned_hart(dom, hartindex))
-		return SBI_EINVAL;
-	if (dom && !sbi_domain_check_addr(dom, saddr, smode,
-					  SBI_DOMAIN_EXECUTE))
-		return SBI_EINVALID_ADDR;
-
 	rscratch = sbi_hartindex_to_scratch(hartindex);
 	if (!rscratch)
 		return SBI_EINVAL;
 
 	hdata = sbi_scratch_offset_ptr(rscratch, hart_data_offset);
-	if (!hsm_start_ticket_acquire(hdata))
+
+	/*
+	 * Claim the stopped target so that only this HART writes its
+	 * start request. If a hart is already started, claimed or in
+	 * transition to start or stop, another start call is considered
+	 * as invalid request.
+	 */
+	hstate = atomic_cmpxchg(&hdata->state, SBI_HSM_STATE_STOPPED,
+				SBI_HSM_STATE_STOPPED | HSM_STATE_START_CLAIMED);
+	if (hstate == SBI_HSM_STATE_STARTED)
+		return SBI_EALREADY;
+	if (hstate != SBI_HSM_STATE_STOPPED)
 		return SBI_EINVAL;
 
 	init_count = sbi_init_count(hartindex);
@@ -330,31 +497,27 @@ int sbi_hsm_hart_start(struct sbi_scratch *scratch,
 	rscratch->next_arg1 = arg1;
 	rscratch->next_addr = saddr;
 	rscratch->next_mode = smode;
+#ifdef CONFIG_SBI_HSM_STATS
+	hdata->start_time = sbi_timer_value();
+#endif
 
 	/*
 	 * atomic_cmpxchg() is an implicit barrier. It makes sure that
 	 * other harts see reading of init_count and writing to *rscratch
 	 * before hdata->state is set to SBI_HSM_STATE_START_PENDING.
 	 */
-	hstate = atomic_cmpxchg(&hdata->state, SBI_HSM_STATE_STOPPED,
-				SBI_HSM_STATE_START_PENDING);
-	if (hstate == SBI_HSM_STATE_STARTED) {
-		rc = SBI_EALREADY;
-		goto err;
-	}
-
-	/**
-	 * if a hart is already transition to start or stop, another start call
-	 * is considered as invalid request.
-	 */
-	if (hstate != SBI_HSM_STATE_STOPPED) {
-		rc = SBI_EINVAL;
-		goto err;
-	}
+	if (!__sbi_hsm_hart_change_state(hdata, SBI_HSM_STATE_STOPPED |
+					 HSM_STATE_START_CLAIMED,
+					 SBI_HSM_STATE_START_PENDING))
+		return SBI_EFAIL;
 
 	if ((hsm_device_has_hart_hotplug() && (entry_count == init_count)) ||
 	   (hsm_device_has_hart_secondary_boot() && !init_count)) {
-		rc = hsm_device_hart_start(hartid, scratch->warmboot_addr);
+		rc = hsm_device_hart_start(sbi_hartindex_to_hartid(hartindex),
+					   scratch->warmboot_addr);
+	} else if (ipi_mask) {
+		sbi_hartmask_set_hartindex(hartindex, ipi_mask);
+		rc = 0;
 	} else {
 		rc = sbi_ipi_raw_send(hartindex);
 	}
@@ -363,13 +526,96 @@ int sbi_hsm_hart_start(struct sbi_scratch *scratch,
 		return 0;
 
 	/* If it fails to start, change hart state back to stop */
+	hdata->start_time = 0;
 	__sbi_hsm_hart_change_state(hdata, SBI_HSM_STATE_START_PENDING,
 				    SBI_HSM_STATE_STOPPED);
-err:
-	hsm_start_ticket_release(hdata);
 	return rc;
 }
 
+int sbi_hsm_hart_start(struct sbi_scratch *scratch,
+		       const struct sbi_domain *dom,
+		       u32 hartid, ulong saddr, ulong smode, ulong arg1)
+{
+	u32 hartindex = sbi_hartid_to_hartindex(hartid);
+
+	/* For now, we only allow start mode to be S-mode or U-mode. */
+	if (smode != PRV_S && smode != PRV_U)
+		return SBI_EINVAL;
+	if (dom && !sbi_domain_is_assigned_hart(dom, hartindex))
+		return SBI_EINVAL;
+	if (dom && !sbi_domain_check_addr(dom, saddr, smode,
+					  SBI_DOMAIN_EXECUTE))
+		return SBI_EINVALID_ADDR;
+
+	return hsm_hart_start_one(scratch, hartindex, saddr, smode, arg1,
+				  NULL);
+}
+
+int sbi_hsm_hart_start_many(struct sbi_scratch *scratch,
+			    const struct sbi_domain *dom,
+			    ulong hmask, ulong hbase, ulong saddr, ulong smode,
+			    const ulong *args)
+{
+	struct sbi_hartmask ipi_mask;
+	struct sbi_scratch *rscratch;
+	struct sbi_hsm_data *hdata;
+	bool send_ipi = false;
+	int rc, ret = 0;
+	u32 i, hartindex;
+
+	if (smode != PRV_S && smode != PRV_U)
+		return SBI_EINVAL;
+	if (dom && !sbi_domain_check_addr(dom, saddr, smode,
+					  SBI_DOMAIN_EXECUTE))
+		return SBI_EINVALID_ADDR;
+
+	/* Validate all targets before changing the state of any */
+	for (i = 0; i < BITS_PER_LONG; i++) {
+		if (!(hmask & (1UL << i)))
+			continue;
+		hartindex = sbi_hartid_to_hartindex(hbase + i);
+		if (!sbi_hartindex_valid(hartindex) ||
+		    (dom && !sbi_domain_is_assigned_hart(dom, hartindex)))
+			return SBI_EINVAL;
+	}
+
+	/*
+	 * Targets which cannot be started are skipped and the last error
+	 * is returned so the caller has to check the state of those.
+	 */
+	sbi_hartmask_clear_all(&ipi_mask);
+	for (i = 0; i < BITS_PER_LONG; i++) {
+		if (!(hmask & (1UL << i)))
+			continue;
+		hartindex = sbi_hartid_to_hartindex(hbase + i);
+		rc = hsm_hart_start_one(scratch, hartindex, saddr, smode,
+					args[i], &ipi_mask);
+		if (rc)
+			ret = rc;
+		else if (sbi_hartmask_test_hartindex(hartindex, &ipi_mask))
+			send_ipi = true;
+	}
+
+	/* Wake up all remaining targets with one multicast IPI */
+	if (send_ipi) {
+		rc = sbi_ipi_raw_send_mask(&ipi_mask);
+		if (rc) {
+			sbi_hartmask_for_each_hartindex(hartindex, &ipi_mask) {
+				rscratch = sbi_hartindex_to_scratch(hartindex);
+				hdata = sbi_scratch_offset_ptr(rscratch,
+							hart_data_offset);
+				hdata->start_time = 0;
+				__sbi_hsm_hart_change_state(hdata,
+						SBI_HSM_STATE_START_PENDING,
+						SBI_HSM_STATE_STOPPED);
+			}
+			ret = rc;
+		}
+	}
+
+	return ret;
+}
+
 int sbi_hsm_hart_stop(struct sbi_scratch *scratch, bool exitnow)
 {
 	const struct sbi_domain *dom = sbi_domain_thishart_ptr();
@@ -397,6 +643,56 @@ static int __sbi_hsm_suspend_default(struct sbi_scratch *scratch)
 	return 0;
 }
 
+#ifdef CONFIG_SBI_HSM_IDLE_GOVERNOR
+/*
+ * Pick the deepest platform retentive state for a default retentive
+ * suspend which pays off before the next timer event. The cost of a
+ * state is its minimum residency plus the larger of its declared and
+ * its measured exit latency.
+ */
+static u32 hsm_idle_governor(struct sbi_scratch *scratch, u32 suspend_type)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+	const struct sbi_hsm_idle_state *st;
+	u64 now, next, idle, exit, cost;
+	u32 i, ret = suspend_type;
+
+	if (suspend_type != SBI_HSM_SUSPEND_RET_DEFAULT || !hsm_dev ||
+	    !hsm_dev->hart_suspend || !hsm_dev->idle_state_count ||
+	    !tdev || !tdev->timer_freq)
+		return suspend_type;
+
+	/* Without a timer event only an interrupt ends the idle period */
+	next = sbi_timer_next_event();
+	now = sbi_timer_value();
+	idle = (next == -1ULL) ? -1ULL : ((next > now) ? next - now : 0);
+
+	for (i = 0; i < hsm_dev->idle_state_count; i++) {
+		st = &hsm_dev->idle_states[i];
+		if ((st->suspend_type & SBI_HSM_SUSP_NON_RET_BIT) ||
+		    st->local_timer_stop)
+			continue;
+
+		exit = (u64)st->exit_latency_us * tdev->timer_freq / 1000000;
+		if (exit < sbi_hsm_stats_exit_latency(scratch, st->suspend_type))
+			exit = sbi_hsm_stats_exit_latency(scratch,
+							  st->suspend_type);
+		cost = (u64)st->min_residency_us * tdev->timer_freq / 1000000 +
+		       exit;
+		if (idle < cost)
+			break;
+		ret = st->suspend_type;
+	}
+
+	return ret;
+}
+#else
+static u32 hsm_idle_governor(struct sbi_scratch *scratch, u32 suspend_type)
+{
+	return suspend_type;
+}
+#endif
+
 void __sbi_hsm_suspend_non_ret_save(struct sbi_scratch *scratch)
 {
 	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
@@ -425,6 +721,9 @@ void __sbi_hsm_suspend_non_ret_save(struct sbi_scratch *scratch)
 #endif
 		hdata->saved_menvcfg = csr_read(CSR_MENVCFG);
 	}
+
+	/* PMP is lost as well and replaying it is cheaper than rebuilding */
+	sbi_hart_pmp_save(scratch);
 }
 
 static void __sbi_hsm_suspend_non_ret_restore(struct sbi_scratch *scratch)
@@ -453,6 +752,10 @@ void sbi_hsm_hart_resume_start(struct sbi_scratch *scratch)
 					 SBI_HSM_STATE_RESUME_PENDING))
 		sbi_hart_hang();
 
+	sbi_tlb_deferred_process(scratch);
+
+	sbi_hsm_stats_suspend_wake(scratch);
+
 	hsm_device_hart_resume();
 }
 
@@ -473,6 +776,8 @@ void __noreturn sbi_hsm_hart_resume_finish(struct sbi_scratch *scratch,
 	 */
 	__sbi_hsm_suspend_non_ret_restore(scratch);
 
+	sbi_hsm_stats_suspend_exit(scratch);
+
 	sbi_hart_switch_mode(hartid, scratch->next_arg1,
 			     scratch->next_addr,
 			     scratch->next_mode, false);
@@ -481,6 +786,7 @@ void __noreturn sbi_hsm_hart_resume_finish(struct sbi_scratch *scratch,
 int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 			 ulong raddr, ulong rmode, ulong arg1)
 {
+	u32 requested_type;
 	int ret;
 	const struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
@@ -511,6 +817,10 @@ int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 			return SBI_EINVALID_ADDR;
 	}
 
+	/* Let the idle governor pick a deeper retentive state */
+	requested_type = suspend_type;
+	suspend_type = hsm_idle_governor(scratch, suspend_type);
+
 	/* Save the resume address and resume mode */
 	scratch->next_arg1 = arg1;
 	scratch->next_addr = raddr;
@@ -531,16 +841,21 @@ int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 	if (suspend_type & SBI_HSM_SUSP_NON_RET_BIT)
 		__sbi_hsm_suspend_non_ret_save(scratch);
 
+	sbi_hsm_stats_suspend_enter(scratch, suspend_type);
+
 	/* Try platform specific suspend */
 	ret = hsm_device_hart_suspend(suspend_type);
-	if (ret == SBI_ENOTSUPP) {
+	if (ret == SBI_ENOTSUPP || (ret && suspend_type != requested_type)) {
 		/* Try generic implementation of default suspend types */
-		if (suspend_type == SBI_HSM_SUSPEND_RET_DEFAULT ||
-		    suspend_type == SBI_HSM_SUSPEND_NON_RET_DEFAULT) {
+		if (requested_type == SBI_HSM_SUSPEND_RET_DEFAULT ||
+		    requested_type == SBI_HSM_SUSPEND_NON_RET_DEFAULT) {
 			ret = __sbi_hsm_suspend_default(scratch);
 		}
 	}
 
+	if (!ret)
+		sbi_hsm_stats_suspend_wake(scratch);
+
 	/*
 	 * The platform may have coordinated a retentive suspend, or it may
 	 * have exited early from a non-retentive suspend. Either way, the
@@ -562,5 +877,10 @@ int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 					 SBI_HSM_STATE_STARTED))
 		sbi_hart_hang();
 
+	sbi_tlb_deferred_process(scratch);
+
+	if (!ret)
+		sbi_hsm_stats_suspend_exit(scratch);
+
 	return ret;
 }
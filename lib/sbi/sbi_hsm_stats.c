@@ -0,0 +1,203 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Per-hart suspend residency and resume latency accounting
+ */
+
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_hsm_stats.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
+#include <sbi/sbi_trap.h>
+
+struct hsm_stats_data {
+	struct sbi_hsm_stats stats;
+	struct sbi_hsm_start_stats start;
+	/* Statistics of the ongoing suspend (NULL if not accounted) */
+	struct sbi_hsm_suspend_stats *cur;
+	u64 enter_time;
+	u64 wake_time;
+};
+
+static unsigned long hsm_stats_off;
+
+static struct hsm_stats_data *hsm_stats_ptr(struct sbi_scratch *scratch)
+{
+	if (!hsm_stats_off || !scratch)
+		return NULL;
+
+	return sbi_scratch_read_type(scratch, void *, hsm_stats_off);
+}
+
+void sbi_hsm_stats_suspend_enter(struct sbi_scratch *scratch,
+				 u32 suspend_type)
+{
+	struct hsm_stats_data *data = hsm_stats_ptr(scratch);
+	struct sbi_hsm_suspend_stats *st;
+	int i;
+
+	if (!data)
+		return;
+
+	data->cur = NULL;
+	for (i = 0; i < SBI_HSM_STATS_TYPES; i++) {
+		st = &data->stats.types[i];
+		if (!st->entries || st->type == suspend_type) {
+			st->type = suspend_type;
+			data->cur = st;
+			break;
+		}
+	}
+	if (!data->cur)
+		data->stats.dropped++;
+
+	/* Taken last so that the accounting is not part of the residency */
+	data->enter_time = sbi_timer_value();
+}
+
+void sbi_hsm_stats_suspend_wake(struct sbi_scratch *scratch)
+{
+	struct hsm_stats_data *data = hsm_stats_ptr(scratch);
+
+	if (data)
+		data->wake_time = sbi_timer_value();
+}
+
+void sbi_hsm_stats_suspend_exit(struct sbi_scratch *scratch)
+{
+	struct hsm_stats_data *data = hsm_stats_ptr(scratch);
+	struct sbi_hsm_suspend_stats *st;
+	u64 exit;
+
+	if (!data || !data->cur)
+		return;
+
+	st = data->cur;
+	data->cur = NULL;
+
+	exit = sbi_timer_value() - data->wake_time;
+	st->residency += data->wake_time - data->enter_time;
+	st->exit_total += exit;
+	if (!st->entries || exit < st->exit_min)
+		st->exit_min = exit;
+	if (exit > st->exit_max)
+		st->exit_max = exit;
+	st->entries++;
+}
+
+void sbi_hsm_stats_start_done(struct sbi_scratch *scratch, u64 start_time)
+{
+	struct hsm_stats_data *data = hsm_stats_ptr(scratch);
+	struct sbi_hsm_start_stats *st;
+	u64 latency;
+
+	if (!data)
+		return;
+
+	st = &data->start;
+	latency = sbi_timer_value() - start_time;
+	st->latency_total += latency;
+	if (!st->starts || latency < st->latency_min)
+		st->latency_min = latency;
+	if (latency > st->latency_max)
+		st->latency_max = latency;
+	st->latency_last = latency;
+	st->starts++;
+}
+
+u64 sbi_hsm_stats_exit_latency(struct sbi_scratch *scratch,
+			       u32 suspend_type)
+{
+	struct hsm_stats_data *data = hsm_stats_ptr(scratch);
+	struct sbi_hsm_suspend_stats *st;
+	int i;
+
+	if (!data)
+		return 0;
+
+	for (i = 0; i < SBI_HSM_STATS_TYPES; i++) {
+		st = &data->stats.types[i];
+		if (st->entries && st->type == suspend_type)
+			return st->exit_total / st->entries;
+	}
+
+	return 0;
+}
+
+const struct sbi_hsm_stats *sbi_hsm_stats_get(u32 hartindex)
+{
+	struct hsm_stats_data *data =
+			hsm_stats_ptr(sbi_hartindex_to_scratch(hartindex));
+
+	return data ? &data->stats : NULL;
+}
+
+const struct sbi_hsm_start_stats *sbi_hsm_stats_start_get(u32 hartindex)
+{
+	struct hsm_stats_data *data =
+			hsm_stats_ptr(sbi_hartindex_to_scratch(hartindex));
+
+	return data ? &data->start : NULL;
+}
+
+static int hsm_stats_read(unsigned long hartid, unsigned long addr_lo,
+			  unsigned long addr_hi)
+{
+	struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	u32 hartindex = sbi_hartid_to_hartindex(hartid);
+	struct hsm_stats_data *data;
+
+	if (!sbi_domain_is_assigned_hart(dom, hartindex))
+		return SBI_EINVAL;
+
+	data = hsm_stats_ptr(sbi_hartindex_to_scratch(hartindex));
+	if (!data)
+		return SBI_EINVAL;
+
+	/* The copy may race with the HART updating its statistics */
+	return sbi_domain_copy_to_smode(addr_lo, addr_hi, &data->stats,
+					sizeof(struct sbi_hsm_stats));
+}
+
+int sbi_hsm_stats_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			 struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_SUSPEND_STATS:
+		return hsm_stats_read(regs->a0, regs->a1, regs->a2);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+int sbi_hsm_stats_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	struct hsm_stats_data *data;
+
+	if (cold_boot) {
+		hsm_stats_off = sbi_scratch_alloc_type_offset(void *);
+		if (!hsm_stats_off)
+			return SBI_ENOMEM;
+	} else if (!hsm_stats_off) {
+		return SBI_ENOMEM;
+	}
+
+	/* Statistics are kept when a HART is stopped and started again */
+	if (hsm_stats_ptr(scratch))
+		return 0;
+
+	data = sbi_zalloc(sizeof(*data));
+	if (!data)
+		return SBI_ENOMEM;
+	sbi_scratch_write_type(scratch, void *, hsm_stats_off, data);
+
+	return 0;
+}
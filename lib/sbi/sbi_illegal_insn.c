@@ -46,6 +46,29 @@ static int misc_mem_opcode_insn(ulong insn, struct sbi_trap_regs *regs)
 	return truly_illegal_insn(insn, regs);
 }
 
+static uint32_t system_opcode_csr_event(int csr_num)
+{
+	switch (csr_num) {
+	case CSR_CYCLE:
+	case CSR_CYCLEH:
+		return SBI_PMU_FW_EMUL_CSR_CYCLE;
+	case CSR_TIME:
+	case CSR_TIMEH:
+		return SBI_PMU_FW_EMUL_CSR_TIME;
+	case CSR_INSTRET:
+	case CSR_INSTRETH:
+		return SBI_PMU_FW_EMUL_CSR_INSTRET;
+	default:
+		break;
+	}
+
+	if ((CSR_HPMCOUNTER3 <= csr_num && csr_num <= CSR_HPMCOUNTER31) ||
+	    (CSR_HPMCOUNTER3H <= csr_num && csr_num <= CSR_HPMCOUNTER31H))
+		return SBI_PMU_FW_EMUL_CSR_HPMCOUNTER;
+
+	return SBI_PMU_FW_EMUL_CSR_OTHER;
+}
+
 static int system_opcode_insn(ulong insn, struct sbi_trap_regs *regs)
 {
 	bool do_write	= false;
@@ -106,6 +129,8 @@ static int system_opcode_insn(ulong insn, struct sbi_trap_regs *regs)
 
 	SET_RD(insn, regs, csr_val);
 
+	sbi_pmu_ctr_incr_fw(system_opcode_csr_event(csr_num));
+
 	regs->mepc += 4;
 
 	return 0;
@@ -10,25 +10,33 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/riscv_atomic.h>
 #include <sbi/riscv_barrier.h>
+#include <sbi/sbi_boot_trace.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_cppc.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_domain_channel.h>
 #include <sbi/sbi_ecall.h>
 #include <sbi/sbi_fwft.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_heap.h>
+#include <sbi/sbi_heap_stats.h>
 #include <sbi/sbi_hsm.h>
+#include <sbi/sbi_hsm_stats.h>
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_irqchip.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_dbtr.h>
 #include <sbi/sbi_sse.h>
+#include <sbi/sbi_stats_page.h>
 #include <sbi/sbi_system.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_timer.h>
+#include <sbi/sbi_tprintf.h>
+#include <sbi/sbi_trap_stats.h>
 #include <sbi/sbi_tlb.h>
+#include <sbi/sbi_trap_ldst.h>
 #include <sbi/sbi_version.h>
 #include <sbi/sbi_unit_test.h>
 
@@ -131,15 +139,24 @@ static void sbi_boot_print_general(struct sbi_scratch *scratch)
 		   (u32)(sbi_heap_reserved_space() / 1024),
 		   (u32)(sbi_heap_used_space() / 1024),
 		   (u32)(sbi_heap_free_space() / 1024));
+	sbi_heap_stats_print();
 	sbi_printf("Firmware Scratch Size     : "
 		   "%d B (total), %d B (used), %d B (free)\n",
 		   SBI_SCRATCH_SIZE,
 		   (u32)sbi_scratch_used_space(),
 		   (u32)(SBI_SCRATCH_SIZE - sbi_scratch_used_space()));
+	if (CONFIG_SBI_SCRATCH_EXT_SIZE)
+		sbi_printf("Firmware Scratch Ext Size : "
+			   "%d B (total), %d B (used)\n",
+			   CONFIG_SBI_SCRATCH_EXT_SIZE,
+			   (u32)sbi_scratch_ext_used_space());
 
 	/* SBI details */
 	sbi_printf("Runtime SBI Version       : %d.%d\n",
 		   sbi_ecall_version_major(), sbi_ecall_version_minor());
+
+	/* Boot stage timestamps */
+	sbi_boot_trace_print();
 	sbi_printf("\n");
 }
 
@@ -192,7 +209,14 @@ static void sbi_boot_print_hart(struct sbi_scratch *scratch, u32 hartid)
 }
 
 static unsigned long coldboot_done;
+static unsigned long coldboot_hart_done;
 
+/*
+ * Note: The coldboot HART releases the other HARTs right after HSM init
+ * which is long before any IPI device is registered, so the waits below
+ * have to poll. The long wait for being started by the supervisor is in
+ * sbi_hsm_hart_wait() which sleeps in WFI and is woken up by an IPI.
+ */
 static void wait_for_coldboot(struct sbi_scratch *scratch)
 {
 	/* Wait for coldboot to finish */
@@ -206,6 +230,13 @@ static void wake_coldboot_harts(struct sbi_scratch *scratch)
 	__smp_store_release(&coldboot_done, 1);
 }
 
+static void wait_for_coldboot_hart_init(void)
+{
+	/* Wait for the FDT and the domains to be final */
+	while (!__smp_load_acquire(&coldboot_hart_done))
+		cpu_relax();
+}
+
 static unsigned long entry_count_offset;
 static unsigned long init_count_offset;
 
@@ -215,21 +246,37 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 	unsigned long *count;
 	const struct sbi_platform *plat = sbi_platform_ptr(scratch);
 
+	sbi_boot_trace("entry");
+
 	/* Note: This has to be first thing in coldboot init sequence */
 	rc = sbi_scratch_init(scratch);
 	if (rc)
 		sbi_hart_hang();
 
+	sbi_boot_trace("scratch");
+
 	/* Note: This has to be second thing in coldboot init sequence */
 	rc = sbi_heap_init(scratch);
 	if (rc)
 		sbi_hart_hang();
 
+	sbi_boot_trace("heap");
+
+	rc = sbi_scratch_ext_init();
+	if (rc)
+		sbi_hart_hang();
+
 	/* Note: This has to be the third thing in coldboot init sequence */
 	rc = sbi_domain_init(scratch, hartid);
 	if (rc)
 		sbi_hart_hang();
 
+	sbi_boot_trace("domain init");
+
+	rc = sbi_domain_channel_init();
+	if (rc)
+		sbi_hart_hang();
+
 	entry_count_offset = sbi_scratch_alloc_offset(__SIZEOF_POINTER__);
 	if (!entry_count_offset)
 		sbi_hart_hang();
@@ -257,10 +304,18 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 	if (rc)
 		sbi_hart_hang();
 
+	sbi_boot_trace("platform early");
+
 	rc = sbi_hart_init(scratch, true);
 	if (rc)
 		sbi_hart_hang();
 
+	rc = sbi_trap_init(scratch, true);
+	if (rc)
+		sbi_hart_hang();
+
+	sbi_boot_trace("hart");
+
 	rc = sbi_sse_init(scratch, true);
 	if (rc) {
 		sbi_printf("%s: sse init failed (error %d)\n", __func__, rc);
@@ -278,6 +333,8 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 	if (rc)
 		sbi_hart_hang();
 
+	sbi_boot_trace("sse/pmu/dbtr");
+
 	sbi_boot_print_banner(scratch);
 
 	rc = sbi_irqchip_init(scratch, true);
@@ -287,30 +344,82 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 		sbi_hart_hang();
 	}
 
+	sbi_boot_trace("irqchip");
+
 	rc = sbi_ipi_init(scratch, true);
 	if (rc) {
 		sbi_printf("%s: ipi init failed (error %d)\n", __func__, rc);
 		sbi_hart_hang();
 	}
 
+	sbi_boot_trace("ipi");
+
 	rc = sbi_tlb_init(scratch, true);
 	if (rc) {
 		sbi_printf("%s: tlb init failed (error %d)\n", __func__, rc);
 		sbi_hart_hang();
 	}
 
+	sbi_boot_trace("tlb");
+
 	rc = sbi_timer_init(scratch, true);
 	if (rc) {
 		sbi_printf("%s: timer init failed (error %d)\n", __func__, rc);
 		sbi_hart_hang();
 	}
 
+	sbi_boot_trace("timer");
+
+	rc = sbi_console_init(scratch, true);
+	if (rc) {
+		sbi_printf("%s: console init failed (error %d)\n",
+			   __func__, rc);
+		sbi_hart_hang();
+	}
+
+	rc = sbi_tprintf_init();
+	if (rc) {
+		sbi_printf("%s: tprintf init failed (error %d)\n",
+			   __func__, rc);
+		sbi_hart_hang();
+	}
+
 	rc = sbi_fwft_init(scratch, true);
 	if (rc) {
 		sbi_printf("%s: fwft init failed (error %d)\n", __func__, rc);
 		sbi_hart_hang();
 	}
 
+	rc = sbi_misaligned_monitor_init(scratch, true);
+	if (rc) {
+		sbi_printf("%s: misaligned monitor init failed (error %d)\n",
+			   __func__, rc);
+		sbi_hart_hang();
+	}
+
+	rc = sbi_double_trap_init(scratch, true);
+	if (rc) {
+		sbi_printf("%s: double trap init failed (error %d)\n",
+			   __func__, rc);
+		sbi_hart_hang();
+	}
+
+	rc = sbi_trap_stats_init(scratch, true);
+	if (rc) {
+		sbi_printf("%s: trap stats init failed (error %d)\n",
+			   __func__, rc);
+		sbi_hart_hang();
+	}
+
+	rc = sbi_hsm_stats_init(scratch, true);
+	if (rc) {
+		sbi_printf("%s: hsm stats init failed (error %d)\n",
+			   __func__, rc);
+		sbi_hart_hang();
+	}
+
+	sbi_boot_trace("fwft/traps");
+
 	/*
 	 * Note: Finalize domains after HSM initialization so that we
 	 * can startup non-root domains.
@@ -324,6 +433,15 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 		sbi_hart_hang();
 	}
 
+	rc = sbi_stats_page_init(scratch, true);
+	if (rc) {
+		sbi_printf("%s: stats page init failed (error %d)\n",
+			   __func__, rc);
+		sbi_hart_hang();
+	}
+
+	sbi_boot_trace("domain finalize");
+
 	/*
 	 * Note: Platform final initialization should be after finalizing
 	 * domains so that it sees correct domain assignment and PMP
@@ -336,6 +454,18 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 		sbi_hart_hang();
 	}
 
+	sbi_platform_domain_enter(plat, sbi_domain_thishart_ptr());
+
+	/*
+	 * The remaining HARTs can now do their HART local early init in
+	 * parallel with the rest of the coldboot path. This waits for the
+	 * FDT fixups and the domains to be final because the platform early
+	 * init and extensions init hooks of these HARTs may read both.
+	 */
+	__smp_store_release(&coldboot_hart_done, 1);
+
+	sbi_boot_trace("platform final");
+
 	/*
 	 * Note: Ecall initialization should be after platform final
 	 * initialization so that all available platform devices are
@@ -347,6 +477,8 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 		sbi_hart_hang();
 	}
 
+	sbi_boot_trace("ecall");
+
 	sbi_boot_print_general(scratch);
 
 	sbi_boot_print_domains(scratch);
@@ -366,6 +498,7 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 		sbi_hart_hang();
 	}
 
+
 	count = sbi_scratch_offset_ptr(scratch, init_count_offset);
 	(*count)++;
 
@@ -385,10 +518,14 @@ static void __noreturn init_warm_startup(struct sbi_scratch *scratch,
 	count = sbi_scratch_offset_ptr(scratch, entry_count_offset);
 	(*count)++;
 
-	/* Note: This has to be first thing in warmboot init sequence */
-	rc = sbi_hsm_init(scratch, false);
-	if (rc)
-		sbi_hart_hang();
+	/*
+	 * Do the HART local early init and feature detection before
+	 * waiting to be started so that it overlaps with the end of the
+	 * coldboot path and with the startup of other HARTs. Start requests
+	 * made meanwhile, such as those of sbi_domain_finalize(), stay
+	 * pending until the HSM wait below.
+	 */
+	wait_for_coldboot_hart_init();
 
 	rc = sbi_platform_early_init(plat, false);
 	if (rc)
@@ -398,6 +535,15 @@ static void __noreturn init_warm_startup(struct sbi_scratch *scratch,
 	if (rc)
 		sbi_hart_hang();
 
+	rc = sbi_trap_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
+	/* Note: This has to be first thing after HART local early init */
+	rc = sbi_hsm_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
 	rc = sbi_sse_init(scratch, false);
 	if (rc)
 		sbi_hart_hang();
@@ -426,14 +572,40 @@ static void __noreturn init_warm_startup(struct sbi_scratch *scratch,
 	if (rc)
 		sbi_hart_hang();
 
+	rc = sbi_console_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
 	rc = sbi_fwft_init(scratch, false);
 	if (rc)
 		sbi_hart_hang();
 
+	rc = sbi_misaligned_monitor_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
+	rc = sbi_double_trap_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
+	rc = sbi_trap_stats_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
+	rc = sbi_hsm_stats_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
+	rc = sbi_stats_page_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
 	rc = sbi_platform_final_init(plat, false);
 	if (rc)
 		sbi_hart_hang();
 
+	sbi_platform_domain_enter(plat, sbi_domain_thishart_ptr());
+
 	/*
 	 * Configure PMP at last because if SMEPMP is detected,
 	 * M-mode access to the S/U space will be rescinded.
@@ -459,7 +631,7 @@ static void __noreturn init_warm_resume(struct sbi_scratch *scratch,
 	if (rc)
 		sbi_hart_hang();
 
-	rc = sbi_hart_pmp_configure(scratch);
+	rc = sbi_hart_pmp_restore(scratch);
 	if (rc)
 		sbi_hart_hang();
 
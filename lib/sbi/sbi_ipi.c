@@ -15,16 +15,27 @@
 #include <sbi/sbi_domain.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_hsm.h>
 #include <sbi/sbi_init.h>
 #include <sbi/sbi_ipi.h>
+#include <sbi/sbi_mpsc_fifo.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
 #include <sbi/sbi_tlb.h>
 
+#if defined(CONFIG_SBI_IPI_TREE_FANOUT) && CONFIG_SBI_IPI_TREE_FANOUT > 1
+#define SBI_IPI_FANOUT		CONFIG_SBI_IPI_TREE_FANOUT
+#endif
+
 struct sbi_ipi_data {
 	unsigned long ipi_type;
+#ifdef SBI_IPI_FANOUT
+	/** HARTs to which this HART forwards the interrupt */
+	struct sbi_hartmask fwd_mask;
+#endif
 };
 
 _Static_assert(
@@ -32,12 +43,19 @@ _Static_assert(
 	"type of sbi_ipi_data.ipi_type has changed, please redefine SBI_IPI_EVENT_MAX"
 	);
 
+/* Maximum number of rounds of events taken by one sbi_ipi_process() */
+#define IPI_PROCESS_ROUNDS_MAX	4
+
 static unsigned long ipi_data_off;
 static const struct sbi_ipi_device *ipi_dev = NULL;
 static const struct sbi_ipi_event_ops *ipi_ops_array[SBI_IPI_EVENT_MAX];
 
+/*
+ * Send an IPI event to a remote HART. The interrupt is not triggered
+ * here but the remote HART is added to the doorbell mask if needed.
+ */
 static int sbi_ipi_send(struct sbi_scratch *scratch, u32 remote_hartindex,
-			u32 event, void *data)
+			u32 event, void *data, struct sbi_hartmask *doorbell)
 {
 	int ret = 0;
 	struct sbi_scratch *remote_scratch = NULL;
@@ -72,15 +90,15 @@ static int sbi_ipi_send(struct sbi_scratch *scratch, u32 remote_hartindex,
 
 	/*
 	 * Set IPI type on remote hart's scratch area and
-	 * trigger the interrupt.
+	 * mark the interrupt to be triggered.
 	 *
 	 * Multiple harts may be trying to send IPI to the
-	 * remote hart so call sbi_ipi_raw_send() only when
+	 * remote hart so trigger the interrupt only when
 	 * the ipi_type was previously zero.
 	 */
 	if (!__atomic_fetch_or(&ipi_data->ipi_type,
 				BIT(event), __ATOMIC_RELAXED))
-		ret = sbi_ipi_raw_send(remote_hartindex);
+		sbi_hartmask_set_hartindex(remote_hartindex, doorbell);
 
 	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_IPI_SENT);
 
@@ -102,58 +120,200 @@ static int sbi_ipi_sync(struct sbi_scratch *scratch, u32 event)
 	return 0;
 }
 
-/**
- * As this this function only handlers scalar values of hart mask, it must be
- * set to all online harts if the intention is to send IPIs to all the harts.
- * If hmask is zero, no IPIs will be sent.
- */
-int sbi_ipi_send_many(ulong hmask, ulong hbase, u32 event, void *data)
+#ifdef SBI_IPI_FANOUT
+static u32 ipi_fwd_event = SBI_IPI_EVENT_MAX;
+
+/* Make a group leader forward the interrupt to sub_mask */
+static void sbi_ipi_forward(u32 leader, struct sbi_hartmask *sub_mask)
 {
-	int rc = 0;
-	bool retry_needed;
-	ulong i;
-	struct sbi_hartmask target_mask;
-	struct sbi_domain *dom = sbi_domain_thishart_ptr();
-	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	int i;
+	bool forward = false;
+	struct sbi_scratch *remote_scratch = sbi_hartindex_to_scratch(leader);
+	struct sbi_ipi_data *ipi_data =
+			sbi_scratch_offset_ptr(remote_scratch, ipi_data_off);
+
+	for (i = 0; i < sbi_hartmask_nr_longs(); i++) {
+		if (!sub_mask->bits[i])
+			continue;
+		__atomic_fetch_or(&ipi_data->fwd_mask.bits[i],
+				  sub_mask->bits[i], __ATOMIC_RELAXED);
+		forward = true;
+	}
 
-	/* Find the target harts */
-	rc = sbi_hsm_hart_interruptible_mask(dom, &target_mask);
-	if (rc)
-		return rc;
+	/* Pairs with the exchange of ipi_type in sbi_ipi_process() */
+	if (forward)
+		__atomic_fetch_or(&ipi_data->ipi_type, BIT(ipi_fwd_event),
+				  __ATOMIC_RELEASE);
+}
 
-	if (hbase != -1UL) {
-		struct sbi_hartmask tmp_mask = { 0 };
+/* Number of consecutive HART indices which share a cluster */
+static u32 ipi_cluster_size = 1;
 
-		for (i = hbase; hmask; i++, hmask >>= 1) {
-			if (hmask & 1UL)
-				sbi_hartmask_set_hartid(i, &tmp_mask);
+/*
+ * Split the HARTs to be interrupted into SBI_IPI_FANOUT groups and only
+ * interrupt the first HART of every group which then interrupts the
+ * rest of its group the same way. This bounds the interrupt latency to
+ * O(log N) hops instead of N serial interrupts from the source HART.
+ *
+ * Groups are made of whole clusters as long as the HARTs span several
+ * clusters so that the last hops stay within a cluster.
+ */
+static int sbi_ipi_fanout(struct sbi_hartmask *mask)
+{
+	int i;
+	u32 count, chunk, csize, unit, last, n = 0, leader = 0;
+	struct sbi_hartmask sub_mask, leader_mask;
+
+	count = sbi_hartmask_weight(mask);
+	if (!count)
+		return 0;
+
+	/* Count the clusters with a HART to interrupt */
+	csize = ipi_cluster_size;
+	count = 0;
+	last = -1U;
+	sbi_hartmask_for_each_hartindex(i, mask) {
+		if (i / csize != last) {
+			last = i / csize;
+			count++;
 		}
+	}
+	if (count == 1) {
+		csize = 1;
+		count = sbi_hartmask_weight(mask);
+	}
 
-		sbi_hartmask_and(&target_mask, &target_mask, &tmp_mask);
+	sbi_hartmask_clear_all(&leader_mask);
+	sbi_hartmask_clear_all(&sub_mask);
+
+	chunk = (count + SBI_IPI_FANOUT - 1) / SBI_IPI_FANOUT;
+	last = -1U;
+	sbi_hartmask_for_each_hartindex(i, mask) {
+		unit = i / csize;
+		if (unit != last) {
+			last = unit;
+			if (!(n % chunk)) {
+				if (n)
+					sbi_ipi_forward(leader, &sub_mask);
+				leader = i;
+				sbi_hartmask_set_hartindex(leader, &leader_mask);
+				sbi_hartmask_clear_all(&sub_mask);
+			}
+			n++;
+		}
+		if (i != leader)
+			sbi_hartmask_set_hartindex(i, &sub_mask);
 	}
+	sbi_ipi_forward(leader, &sub_mask);
+
+	return sbi_ipi_raw_send_mask(&leader_mask);
+}
+
+static void sbi_ipi_process_fwd(struct sbi_scratch *scratch)
+{
+	int i;
+	struct sbi_hartmask mask;
+	struct sbi_ipi_data *ipi_data =
+			sbi_scratch_offset_ptr(scratch, ipi_data_off);
+
+	for (i = 0; i < sbi_hartmask_nr_longs(); i++)
+		mask.bits[i] = atomic_raw_xchg_ulong(&ipi_data->fwd_mask.bits[i],
+						     0);
+
+	sbi_ipi_fanout(&mask);
+}
+
+static struct sbi_ipi_event_ops ipi_fwd_ops = {
+	.name = "IPI_FWD",
+	.process = sbi_ipi_process_fwd,
+};
+#endif
+
+/* Trigger the interrupt of every HART in the doorbell mask */
+static int sbi_ipi_doorbell(struct sbi_hartmask *mask)
+{
+	int rc;
+
+#ifdef SBI_IPI_FANOUT
+	rc = sbi_ipi_fanout(mask);
+#else
+	rc = sbi_ipi_raw_send_mask(mask);
+#endif
+	sbi_hartmask_clear_all(mask);
+
+	return rc;
+}
+
+/* Send an IPI event to every HART in target_mask which is consumed */
+static int sbi_ipi_send_targets(struct sbi_scratch *scratch,
+				struct sbi_hartmask *target_mask,
+				u32 event, void *data)
+{
+	int rc = 0, drc;
+	bool retry_needed;
+	ulong i;
+	struct sbi_hartmask doorbell_mask;
 
 	/* Send IPIs */
+	sbi_hartmask_clear_all(&doorbell_mask);
 	do {
 		retry_needed = false;
-		sbi_hartmask_for_each_hartindex(i, &target_mask) {
-			rc = sbi_ipi_send(scratch, i, event, data);
+		sbi_hartmask_for_each_hartindex(i, target_mask) {
+			rc = sbi_ipi_send(scratch, i, event, data,
+					  &doorbell_mask);
 			if (rc < 0)
 				goto done;
 			if (rc == SBI_IPI_UPDATE_RETRY)
 				retry_needed = true;
 			else
-				sbi_hartmask_clear_hartindex(i, &target_mask);
+				sbi_hartmask_clear_hartindex(i, target_mask);
 			rc = 0;
 		}
+
+		/* Don't hold back the HARTs already updated while retrying */
+		rc = sbi_ipi_doorbell(&doorbell_mask);
+		if (rc)
+			goto done;
 	} while (retry_needed);
 
 done:
+	drc = sbi_ipi_doorbell(&doorbell_mask);
+	if (!rc)
+		rc = drc;
+
 	/* Sync IPIs */
 	sbi_ipi_sync(scratch, event);
 
 	return rc;
 }
 
+/**
+ * As this this function only handlers scalar values of hart mask, it must be
+ * set to all online harts if the intention is to send IPIs to all the harts.
+ * If hmask is zero, no IPIs will be sent.
+ */
+int sbi_ipi_send_many(ulong hmask, ulong hbase, u32 event, void *data)
+{
+	int rc;
+	struct sbi_hartmask target_mask;
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct sbi_domain *dom = sbi_scratch_to_domain(scratch);
+
+	/* Find the target harts */
+	rc = sbi_hsm_hart_interruptible_mask(dom, &target_mask);
+	if (rc)
+		return rc;
+
+	if (hbase != -1UL) {
+		struct sbi_hartmask tmp_mask = { 0 };
+
+		sbi_hartmask_set_hmask(hmask, hbase, &tmp_mask);
+		sbi_hartmask_and(&target_mask, &target_mask, &tmp_mask);
+	}
+
+	return sbi_ipi_send_targets(scratch, &target_mask, event, data);
+}
+
 int sbi_ipi_event_create(const struct sbi_ipi_event_ops *ops)
 {
 	int i, ret = SBI_ENOSPC;
@@ -197,22 +357,43 @@ int sbi_ipi_send_smode(ulong hmask, ulong hbase)
 	return sbi_ipi_send_many(hmask, hbase, ipi_smode_event, NULL);
 }
 
+/* Send an S-mode IPI to the interruptible HARTs of another domain */
+int sbi_ipi_send_smode_domain(const struct sbi_domain *dom)
+{
+	int rc;
+	struct sbi_hartmask target_mask;
+
+	rc = sbi_hsm_hart_interruptible_mask(dom, &target_mask);
+	if (rc)
+		return rc;
+
+	return sbi_ipi_send_targets(sbi_scratch_thishart_ptr(), &target_mask,
+				    ipi_smode_event, NULL);
+}
+
 void sbi_ipi_clear_smode(void)
 {
 	csr_clear(CSR_MIP, MIP_SSIP);
 }
 
+/* Number of HARTs sent a halt IPI which did not take it yet */
+static atomic_t ipi_halt_pending = ATOMIC_INITIALIZER(0);
+
 static int sbi_ipi_update_halt(struct sbi_scratch *scratch,
 			       struct sbi_scratch *remote_scratch,
 			       u32 remote_hartindex, void *data)
 {
 	/* Never send a halt IPI to the local hart. */
-	return scratch == remote_scratch ?
-		SBI_IPI_UPDATE_BREAK : SBI_IPI_UPDATE_SUCCESS;
+	if (scratch == remote_scratch)
+		return SBI_IPI_UPDATE_BREAK;
+
+	atomic_add_return(&ipi_halt_pending, 1);
+	return SBI_IPI_UPDATE_SUCCESS;
 }
 
 static void sbi_ipi_process_halt(struct sbi_scratch *scratch)
 {
+	atomic_sub_return(&ipi_halt_pending, 1);
 	sbi_hsm_hart_stop(scratch, true);
 }
 
@@ -229,29 +410,242 @@ int sbi_ipi_send_halt(ulong hmask, ulong hbase)
 	return sbi_ipi_send_many(hmask, hbase, ipi_halt_event, NULL);
 }
 
+static bool ipi_halt_done(void *arg)
+{
+	struct sbi_ipi_data *ipi_data = arg;
+
+	/* HARTs on their way to the halt may be waiting on this HART */
+	if (__atomic_load_n(&ipi_data->ipi_type, __ATOMIC_RELAXED))
+		sbi_ipi_process();
+
+	return atomic_read(&ipi_halt_pending) <= 0;
+}
+
+int sbi_ipi_send_halt_wait(ulong hmask, ulong hbase, ulong timeout_ms)
+{
+	int rc;
+	struct sbi_ipi_data *ipi_data =
+			sbi_scratch_thishart_offset_ptr(ipi_data_off);
+
+	rc = sbi_ipi_send_halt(hmask, hbase);
+	if (rc)
+		return rc;
+
+	if (!timeout_ms || !sbi_timer_get_device())
+		return 0;
+
+	return sbi_timer_waitms_until(ipi_halt_done, ipi_data, timeout_ms) ?
+	       0 : SBI_ETIMEDOUT;
+}
+
+#define IPI_CALL_FIFO_NUM_ENTRIES	8
+
+/** Remote function call queued on the target HART */
+struct ipi_call {
+	void (*fn)(void *arg);
+	void *arg;
+	/** Completion counter of the caller or NULL if nobody waits */
+	atomic_t *pending;
+};
+
+struct ipi_call_queue {
+	struct sbi_mpsc_fifo fifo;
+	void *mem;
+};
+
+static unsigned long ipi_call_off;
+
+static void ipi_call_run(struct ipi_call *call)
+{
+	call->fn(call->arg);
+
+	/* Pairs with the atomic_read() in sbi_ipi_call_many() */
+	if (call->pending)
+		atomic_sub_return(call->pending, 1);
+}
+
+/* Run every call queued on this HART in one go */
+static void ipi_call_process(struct sbi_scratch *scratch)
+{
+	struct ipi_call call;
+	struct ipi_call_queue *q = sbi_scratch_offset_ptr(scratch, ipi_call_off);
+
+	while (!sbi_mpsc_fifo_dequeue(&q->fifo, &call))
+		ipi_call_run(&call);
+}
+
+static int ipi_call_update(struct sbi_scratch *scratch,
+			   struct sbi_scratch *remote_scratch,
+			   u32 remote_hartindex, void *data)
+{
+	struct ipi_call *call = data;
+	struct ipi_call_queue *q;
+
+	if (scratch == remote_scratch) {
+		ipi_call_run(call);
+		return SBI_IPI_UPDATE_BREAK;
+	}
+
+	/*
+	 * The completion counter is raised before the call becomes
+	 * visible so that the remote HART can never drop it below zero.
+	 */
+	if (call->pending)
+		atomic_add_return(call->pending, 1);
+
+	q = sbi_scratch_offset_ptr(remote_scratch, ipi_call_off);
+	if (sbi_mpsc_fifo_enqueue(&q->fifo, call) < 0) {
+		if (call->pending)
+			atomic_sub_return(call->pending, 1);
+
+		/*
+		 * Drain the queue of this HART while the remote queue is full
+		 * since the remote HART may be waiting on this HART as well.
+		 */
+		ipi_call_process(scratch);
+		return SBI_IPI_UPDATE_RETRY;
+	}
+
+	/* Publish the call before the event bit of the remote HART */
+	smp_wmb();
+
+	return SBI_IPI_UPDATE_SUCCESS;
+}
+
+static struct sbi_ipi_event_ops ipi_call_ops = {
+	.name = "IPI_CALL",
+	.update = ipi_call_update,
+	.process = ipi_call_process,
+};
+
+/**
+ * Send an IPI event to every interruptible HART of the current domain
+ * which is set in mask. All the targets share a single doorbell round.
+ */
+int sbi_ipi_send_mask(const struct sbi_hartmask *mask, u32 event, void *data)
+{
+	int rc;
+	struct sbi_hartmask target_mask;
+
+	if (!mask)
+		return SBI_EINVAL;
+
+	rc = sbi_hsm_hart_interruptible_mask(sbi_domain_thishart_ptr(),
+					     &target_mask);
+	if (rc)
+		return rc;
+	sbi_hartmask_and(&target_mask, &target_mask, mask);
+
+	return sbi_ipi_send_targets(sbi_scratch_thishart_ptr(), &target_mask,
+				    event, data);
+}
+
+static u32 ipi_call_event = SBI_IPI_EVENT_MAX;
+
+/**
+ * Run fn(arg) on every interruptible HART of the current domain which is
+ * set in mask, including the current HART if it is part of the mask.
+ *
+ * Calls to the same HART are queued and run back to back from a single
+ * IPI. With wait set, this function only returns once all the calls
+ * have finished. Without it, arg must stay valid until then and fn must
+ * not rely on the caller. The callbacks run in M-mode with interrupts
+ * disabled so they must be short and must not wait on other HARTs.
+ */
+int sbi_ipi_call_many(const struct sbi_hartmask *mask,
+		      void (*fn)(void *arg), void *arg, bool wait)
+{
+	int rc;
+	atomic_t pending = ATOMIC_INITIALIZER(0);
+	struct ipi_call call = {
+		.fn = fn,
+		.arg = arg,
+		.pending = wait ? &pending : NULL,
+	};
+	long val;
+	bool zawrs;
+	struct sbi_hartmask target_mask;
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct sbi_ipi_data *ipi_data =
+			sbi_scratch_offset_ptr(scratch, ipi_data_off);
+
+	if (!mask || !fn)
+		return SBI_EINVAL;
+
+	rc = sbi_hsm_hart_interruptible_mask(sbi_domain_thishart_ptr(),
+					     &target_mask);
+	if (rc)
+		return rc;
+	sbi_hartmask_and(&target_mask, &target_mask, mask);
+
+	rc = sbi_ipi_send_targets(scratch, &target_mask, ipi_call_event, &call);
+
+	/*
+	 * Keep serving IPIs while waiting because the HARTs which owe the
+	 * completion may be waiting on this HART for something else.
+	 */
+	zawrs = sbi_hart_has_extension(scratch, SBI_HART_EXT_ZAWRS);
+	while ((val = atomic_read(&pending))) {
+		if (__atomic_load_n(&ipi_data->ipi_type, __ATOMIC_RELAXED))
+			sbi_ipi_process();
+		else if (zawrs)
+			atomic_wrs_wait(&pending, val, true);
+		else
+			cpu_relax();
+	}
+
+	return rc;
+}
+
 void sbi_ipi_process(void)
 {
 	unsigned long ipi_type;
-	unsigned int ipi_event;
+	unsigned int ipi_event, rounds = 0;
 	const struct sbi_ipi_event_ops *ipi_ops;
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 	struct sbi_ipi_data *ipi_data =
 			sbi_scratch_offset_ptr(scratch, ipi_data_off);
 
 	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_IPI_RECVD);
-	sbi_ipi_raw_clear();
 
-	ipi_type = atomic_raw_xchg_ulong(&ipi_data->ipi_type, 0);
-	ipi_event = 0;
-	while (ipi_type) {
-		if (ipi_type & 1UL) {
-			ipi_ops = ipi_ops_array[ipi_event];
-			if (ipi_ops)
-				ipi_ops->process(scratch);
+	/*
+	 * Events posted while the previous round was processed are taken
+	 * in the same pass instead of trapping again for each of them.
+	 * The pass ends early for other pending M-mode interrupts so that
+	 * an event which yields to them is not picked up again right away
+	 * and after a few rounds so that a storm cannot starve the caller.
+	 */
+	do {
+		sbi_ipi_raw_clear();
+
+		ipi_type = atomic_raw_xchg_ulong(&ipi_data->ipi_type, 0);
+		ipi_event = 0;
+		while (ipi_type) {
+			if (ipi_type & 1UL) {
+				ipi_ops = ipi_ops_array[ipi_event];
+				if (ipi_ops)
+					ipi_ops->process(scratch);
+			}
+			ipi_type = ipi_type >> 1;
+			ipi_event++;
 		}
-		ipi_type = ipi_type >> 1;
-		ipi_event++;
-	}
+	} while (++rounds < IPI_PROCESS_ROUNDS_MAX &&
+		 __atomic_load_n(&ipi_data->ipi_type, __ATOMIC_RELAXED) &&
+		 !(csr_read(CSR_MIP) & csr_read(CSR_MIE) &
+		   (MIP_MTIP | MIP_MEIP)));
+}
+
+void sbi_ipi_event_repost(u32 event)
+{
+	struct sbi_ipi_data *ipi_data =
+			sbi_scratch_thishart_offset_ptr(ipi_data_off);
+
+	if (SBI_IPI_EVENT_MAX <= event || !ipi_ops_array[event])
+		return;
+
+	if (!__atomic_fetch_or(&ipi_data->ipi_type, BIT(event),
+			       __ATOMIC_RELAXED))
+		sbi_ipi_raw_send(current_hartindex());
 }
 
 int sbi_ipi_raw_send(u32 hartindex)
@@ -274,6 +668,26 @@ int sbi_ipi_raw_send(u32 hartindex)
 	return 0;
 }
 
+int sbi_ipi_raw_send_mask(const struct sbi_hartmask *mask)
+{
+	u32 i;
+
+	if (!ipi_dev || (!ipi_dev->ipi_send && !ipi_dev->ipi_send_mask))
+		return SBI_EINVAL;
+
+	/* Same ordering as sbi_ipi_raw_send() */
+	wmb();
+
+	if (ipi_dev->ipi_send_mask) {
+		ipi_dev->ipi_send_mask(mask);
+		return 0;
+	}
+
+	sbi_hartmask_for_each_hartindex(i, mask)
+		ipi_dev->ipi_send(i);
+	return 0;
+}
+
 void sbi_ipi_raw_clear(void)
 {
 	if (ipi_dev && ipi_dev->ipi_clear)
@@ -304,15 +718,31 @@ void sbi_ipi_set_device(const struct sbi_ipi_device *dev)
 	ipi_dev = dev;
 }
 
+void sbi_ipi_set_cluster_size(u32 harts)
+{
+#ifdef SBI_IPI_FANOUT
+	if (harts)
+		ipi_cluster_size = harts;
+#endif
+}
+
 int sbi_ipi_init(struct sbi_scratch *scratch, bool cold_boot)
 {
 	int ret;
 	struct sbi_ipi_data *ipi_data;
+	struct ipi_call_queue *q;
 
 	if (cold_boot) {
-		ipi_data_off = sbi_scratch_alloc_offset(sizeof(*ipi_data));
+		ipi_data_off = sbi_scratch_alloc_cacheline_offset(sizeof(*ipi_data));
 		if (!ipi_data_off)
 			return SBI_ENOMEM;
+#ifdef SBI_IPI_FANOUT
+		/* Forwarding is the first event processed by a HART */
+		ret = sbi_ipi_event_create(&ipi_fwd_ops);
+		if (ret < 0)
+			return ret;
+		ipi_fwd_event = ret;
+#endif
 		ret = sbi_ipi_event_create(&ipi_smode_ops);
 		if (ret < 0)
 			return ret;
@@ -321,21 +751,44 @@ int sbi_ipi_init(struct sbi_scratch *scratch, bool cold_boot)
 		if (ret < 0)
 			return ret;
 		ipi_halt_event = ret;
+		ipi_call_off = sbi_scratch_alloc_cacheline_offset(sizeof(*q));
+		if (!ipi_call_off)
+			return SBI_ENOMEM;
+		ret = sbi_ipi_event_create(&ipi_call_ops);
+		if (ret < 0)
+			return ret;
+		ipi_call_event = ret;
 
 		/* Initialize platform IPI support */
 		ret = sbi_platform_ipi_init(sbi_platform_ptr(scratch));
 		if (ret)
 			return ret;
 	} else {
-		if (!ipi_data_off)
+		if (!ipi_data_off || !ipi_call_off)
 			return SBI_ENOMEM;
 		if (SBI_IPI_EVENT_MAX <= ipi_smode_event ||
-		    SBI_IPI_EVENT_MAX <= ipi_halt_event)
+		    SBI_IPI_EVENT_MAX <= ipi_halt_event ||
+		    SBI_IPI_EVENT_MAX <= ipi_call_event)
 			return SBI_ENOSPC;
 	}
 
+	q = sbi_scratch_offset_ptr(scratch, ipi_call_off);
+	if (!q->mem) {
+		q->mem = sbi_malloc(SBI_MPSC_FIFO_MEM_SIZE(
+				IPI_CALL_FIFO_NUM_ENTRIES, sizeof(struct ipi_call)));
+		if (!q->mem)
+			return SBI_ENOMEM;
+	}
+	ret = sbi_mpsc_fifo_init(&q->fifo, q->mem, IPI_CALL_FIFO_NUM_ENTRIES,
+				 sizeof(struct ipi_call));
+	if (ret)
+		return ret;
+
 	ipi_data = sbi_scratch_offset_ptr(scratch, ipi_data_off);
 	ipi_data->ipi_type = 0x00;
+#ifdef SBI_IPI_FANOUT
+	sbi_hartmask_clear_all(&ipi_data->fwd_mask);
+#endif
 
 	/* Clear any pending IPIs for the current hart */
 	sbi_ipi_raw_clear();
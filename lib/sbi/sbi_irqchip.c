@@ -7,9 +7,14 @@
  *   Anup Patel <apatel@ventanamicro.com>
  */
 
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_ipi.h>
 #include <sbi/sbi_irqchip.h>
 #include <sbi/sbi_list.h>
 #include <sbi/sbi_platform.h>
+#include <sbi/sbi_pmu.h>
+#include <sbi/sbi_timer.h>
 
 static SBI_LIST_HEAD(irqchip_list);
 
@@ -25,6 +30,106 @@ int sbi_irqchip_process(void)
 	return ext_irqfn();
 }
 
+static int timer_irqfn(void)
+{
+	sbi_timer_process();
+	return 0;
+}
+
+static int ipi_irqfn(void)
+{
+	sbi_ipi_process();
+	return 0;
+}
+
+static int pmu_ovf_irqfn(void)
+{
+	sbi_pmu_ovf_irq();
+	return 0;
+}
+
+/*
+ * Handlers of the local interrupts. These are only set up by the cold
+ * boot HART before the interrupts get enabled so the trap handler can
+ * read them without any locking.
+ */
+static int (*local_irqfn[SBI_IRQCHIP_LOCAL_IRQS])(void) = {
+	[IRQ_M_SOFT]	= ipi_irqfn,
+	[IRQ_M_TIMER]	= timer_irqfn,
+	[IRQ_M_EXT]	= sbi_irqchip_process,
+	[IRQ_PMU_OVF]	= pmu_ovf_irqfn,
+};
+
+struct irqchip_ext_handler {
+	int (*handler)(unsigned long id, void *priv);
+	void *priv;
+};
+
+/*
+ * Handlers of external interrupt IDs. The ID space is large but only a
+ * few IDs ever get an M-mode handler, so every ID maps to a handler
+ * slot number, zero meaning none, which keeps dispatch a two load
+ * lookup without a table entry per ID.
+ */
+static u8 ext_handler_slot[SBI_IRQCHIP_EXT_IDS];
+static struct irqchip_ext_handler ext_handlers[SBI_IRQCHIP_EXT_HANDLERS];
+static u32 ext_handler_count;
+
+int sbi_irqchip_local_process(unsigned long irq)
+{
+	if (SBI_IRQCHIP_LOCAL_IRQS <= irq || !local_irqfn[irq])
+		return SBI_ENOENT;
+
+	return local_irqfn[irq]();
+}
+
+int sbi_irqchip_set_local_handler(unsigned long irq, int (*handler)(void))
+{
+	if (SBI_IRQCHIP_LOCAL_IRQS <= irq || !handler)
+		return SBI_EINVAL;
+	if (local_irqfn[irq])
+		return SBI_EALREADY;
+
+	local_irqfn[irq] = handler;
+	return 0;
+}
+
+int sbi_irqchip_ext_process(unsigned long id)
+{
+	struct irqchip_ext_handler *h;
+	u8 slot;
+
+	if (SBI_IRQCHIP_EXT_IDS <= id)
+		return SBI_ENOENT;
+
+	slot = ext_handler_slot[id];
+	if (!slot)
+		return SBI_ENOENT;
+
+	h = &ext_handlers[slot - 1];
+	return h->handler(id, h->priv);
+}
+
+int sbi_irqchip_set_ext_handler(unsigned long id,
+				int (*handler)(unsigned long id, void *priv),
+				void *priv)
+{
+	struct irqchip_ext_handler *h;
+
+	if (SBI_IRQCHIP_EXT_IDS <= id || !handler)
+		return SBI_EINVAL;
+	if (ext_handler_slot[id])
+		return SBI_EALREADY;
+	if (ext_handler_count == SBI_IRQCHIP_EXT_HANDLERS)
+		return SBI_ENOSPC;
+
+	h = &ext_handlers[ext_handler_count++];
+	h->priv = priv;
+	h->handler = handler;
+	ext_handler_slot[id] = ext_handler_count;
+	return 0;
+}
+
 void sbi_irqchip_add_device(struct sbi_irqchip_device *dev)
 {
 	sbi_list_add_tail(&dev->node, &irqchip_list);
@@ -0,0 +1,153 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Spinlock contention statistics
+ */
+
+#include <sbi/riscv_encoding.h>
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_lock_stat.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_trap.h>
+
+static struct sbi_lock_stat lock_stat_table[SBI_LOCK_STAT_MAX];
+static u32 lock_stat_count;
+
+/* Neither of these locks is named so they are never tracked */
+static spinlock_t lock_stat_table_lock = SPIN_LOCK_INITIALIZER;
+static spinlock_t lock_stats_lock = SPIN_LOCK_INITIALIZER;
+
+/* Too large for the stack so snapshots are taken into one buffer */
+static struct sbi_lock_stats lock_stats;
+
+struct sbi_lock_stat *sbi_lock_stat_alloc(const char *name)
+{
+	struct sbi_lock_stat *stat = NULL;
+
+	spin_lock(&lock_stat_table_lock);
+	if (lock_stat_count < SBI_LOCK_STAT_MAX) {
+		stat = &lock_stat_table[lock_stat_count];
+		stat->name = name;
+		__atomic_store_n(&lock_stat_count, lock_stat_count + 1,
+				 __ATOMIC_RELEASE);
+	}
+	spin_unlock(&lock_stat_table_lock);
+
+	return stat;
+}
+
+/* Locks beyond the table are simply not tracked */
+void spin_lock_set_name(spinlock_t *lock, const char *name)
+{
+	lock->stat = sbi_lock_stat_alloc(name);
+}
+
+void qspin_lock_set_name(qspinlock_t *lock, const char *name)
+{
+	lock->stat = sbi_lock_stat_alloc(name);
+}
+
+static void lock_stats_snapshot(struct sbi_lock_stats *stats, bool reset)
+{
+	u32 i, count = __atomic_load_n(&lock_stat_count, __ATOMIC_ACQUIRE);
+	struct sbi_lock_stat_entry *e;
+	struct sbi_lock_stat *stat;
+
+	sbi_memset(stats, 0, sizeof(*stats));
+	stats->nr_locks = count;
+	for (i = 0; i < count; i++) {
+		stat = &lock_stat_table[i];
+		e = &stats->locks[i];
+		sbi_strncpy(e->name, stat->name, sizeof(e->name) - 1);
+		e->acquired = stat->acquired;
+		e->contended = stat->contended;
+		e->max_distance = stat->max_distance;
+		e->spin_cycles = stat->spin_cycles;
+		e->max_spin_cycles = stat->max_spin_cycles;
+		if (reset) {
+			stat->acquired = 0;
+			stat->contended = 0;
+			stat->max_distance = 0;
+			stat->spin_cycles = 0;
+			stat->max_spin_cycles = 0;
+		}
+	}
+}
+
+static void lock_stats_print(struct sbi_lock_stats *stats)
+{
+	struct sbi_lock_stat_entry *e;
+	u64 i;
+
+	for (i = 0; i < stats->nr_locks; i++) {
+		e = &stats->locks[i];
+		sbi_printf("Firmware Lock %-12s: %lu (acquired), "
+			   "%lu (contended), %lu (max waiters), "
+			   "%lu (spin cycles), %lu (max spin cycles)\n",
+			   e->name, (ulong)e->acquired, (ulong)e->contended,
+			   (ulong)e->max_distance, (ulong)e->spin_cycles,
+			   (ulong)e->max_spin_cycles);
+	}
+}
+
+void sbi_lock_stat_print(void)
+{
+	spin_lock(&lock_stats_lock);
+	lock_stats_snapshot(&lock_stats, false);
+	lock_stats_print(&lock_stats);
+	spin_unlock(&lock_stats_lock);
+}
+
+void sbi_lock_stat_snapshot(struct sbi_lock_stats *stats)
+{
+	spin_lock(&lock_stats_lock);
+	lock_stats_snapshot(stats, false);
+	spin_unlock(&lock_stats_lock);
+}
+
+static int lock_stats_read(unsigned long addr_lo, unsigned long addr_hi,
+			   unsigned long flags)
+{
+	bool copy = addr_lo || addr_hi;
+	int rc;
+
+	if (flags & ~(SBI_LOCK_STAT_FLAG_PRINT | SBI_LOCK_STAT_FLAG_RESET))
+		return SBI_EINVAL;
+
+	/* Check the buffer before the statistics are reset */
+	if (copy) {
+		rc = sbi_domain_check_smode_buffer(addr_lo, addr_hi,
+					sizeof(lock_stats),
+					SBI_DOMAIN_READ | SBI_DOMAIN_WRITE);
+		if (rc)
+			return rc;
+	}
+
+	spin_lock(&lock_stats_lock);
+	lock_stats_snapshot(&lock_stats, flags & SBI_LOCK_STAT_FLAG_RESET);
+	if (flags & SBI_LOCK_STAT_FLAG_PRINT)
+		lock_stats_print(&lock_stats);
+	rc = copy ? sbi_domain_copy_to_smode(addr_lo, addr_hi, &lock_stats,
+					     sizeof(lock_stats)) : 0;
+	spin_unlock(&lock_stats_lock);
+
+	return rc;
+}
+
+int sbi_lock_stat_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			 struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_LOCK_STATS:
+		return lock_stats_read(regs->a0, regs->a1, regs->a2);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
@@ -0,0 +1,170 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * LZ4 frame decompression
+ */
+
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_lz4.h>
+#include <sbi/sbi_string.h>
+
+#define LZ4_FRAME_MAGIC			0x184D2204U
+
+#define LZ4_FLG_VERSION_MASK		0xc0
+#define LZ4_FLG_VERSION			0x40
+#define LZ4_FLG_BLOCK_CHECKSUM		(1U << 4)
+#define LZ4_FLG_CONTENT_SIZE		(1U << 3)
+#define LZ4_FLG_CONTENT_CHECKSUM	(1U << 2)
+#define LZ4_FLG_DICT_ID			(1U << 0)
+
+#define LZ4_BLOCK_UNCOMPRESSED		(1U << 31)
+
+#define LZ4_MIN_MATCH			4
+
+static u32 lz4_read_le32(const u8 *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24);
+}
+
+/* Read the extension bytes of a literal or match length */
+static int lz4_read_len(const u8 **ip, const u8 *iend, unsigned long *len)
+{
+	u8 b;
+
+	do {
+		if (*ip >= iend)
+			return SBI_EINVAL;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+/*
+ * Decompress one block at op. Matches may reach back into the earlier
+ * blocks of the frame which were decompressed right before op.
+ */
+static int lz4_block(u8 *ostart, u8 **opp, u8 *oend,
+		     const u8 *ip, const u8 *iend)
+{
+	unsigned long lit, mlen, offset;
+	u8 *op = *opp;
+	const u8 *match;
+	u8 token;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		lit = token >> 4;
+		if (lit == 15 && lz4_read_len(&ip, iend, &lit))
+			return SBI_EINVAL;
+		if (lit > iend - ip || lit > oend - op)
+			return SBI_EINVAL;
+		sbi_memcpy(op, ip, lit);
+		ip += lit;
+		op += lit;
+
+		/* The last sequence of a block only has literals */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return SBI_EINVAL;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (!offset || offset > op - ostart)
+			return SBI_EINVAL;
+
+		mlen = token & 0xf;
+		if (mlen == 15 && lz4_read_len(&ip, iend, &mlen))
+			return SBI_EINVAL;
+		mlen += LZ4_MIN_MATCH;
+		if (mlen > oend - op)
+			return SBI_EINVAL;
+
+		/* Overlapping matches repeat the last offset bytes */
+		match = op - offset;
+		if (offset >= mlen) {
+			sbi_memcpy(op, match, mlen);
+			op += mlen;
+		} else {
+			while (mlen--)
+				*op++ = *match++;
+		}
+	}
+
+	*opp = op;
+	return 0;
+}
+
+long sbi_lz4_decompress(void *dst, unsigned long dst_size,
+			const void *src, unsigned long src_size)
+{
+	const u8 *ip = src, *iend = ip + src_size;
+	u8 *op = dst, *oend;
+	u64 content_size = 0;
+	u32 bsize;
+	u8 flg;
+	int rc;
+
+	/* Magic, FLG, BD and header checksum */
+	if (src_size < 7 || lz4_read_le32(ip) != LZ4_FRAME_MAGIC)
+		return SBI_EINVAL;
+	flg = ip[4];
+	ip += 6;
+
+	if ((flg & LZ4_FLG_VERSION_MASK) != LZ4_FLG_VERSION ||
+	    (flg & LZ4_FLG_DICT_ID))
+		return SBI_ENOTSUPP;
+
+	if (flg & LZ4_FLG_CONTENT_SIZE) {
+		if (iend - ip < 9)
+			return SBI_EINVAL;
+		content_size = lz4_read_le32(ip) |
+			       ((u64)lz4_read_le32(ip + 4) << 32);
+		if (content_size > dst_size)
+			return SBI_ENOSPC;
+		dst_size = content_size;
+		ip += 8;
+	}
+	oend = op + dst_size;
+
+	/* Skip the header checksum */
+	ip++;
+
+	while (1) {
+		if (iend - ip < 4)
+			return SBI_EINVAL;
+		bsize = lz4_read_le32(ip);
+		ip += 4;
+		if (!bsize)
+			break;
+
+		if ((bsize & ~LZ4_BLOCK_UNCOMPRESSED) > iend - ip)
+			return SBI_EINVAL;
+
+		if (bsize & LZ4_BLOCK_UNCOMPRESSED) {
+			bsize &= ~LZ4_BLOCK_UNCOMPRESSED;
+			if (bsize > oend - op)
+				return SBI_ENOSPC;
+			sbi_memcpy(op, ip, bsize);
+			op += bsize;
+		} else {
+			rc = lz4_block(dst, &op, oend, ip, ip + bsize);
+			if (rc)
+				return rc;
+		}
+		ip += bsize;
+
+		if (flg & LZ4_FLG_BLOCK_CHECKSUM)
+			ip += 4;
+	}
+
+	if ((flg & LZ4_FLG_CONTENT_CHECKSUM) && iend - ip < 4)
+		return SBI_EINVAL;
+	if ((flg & LZ4_FLG_CONTENT_SIZE) && op != oend)
+		return SBI_EINVAL;
+
+	return op - (u8 *)dst;
+}
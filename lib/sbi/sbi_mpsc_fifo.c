@@ -0,0 +1,180 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Lock-free multi-producer/single-consumer bounded FIFO
+ */
+
+#include <sbi/riscv_barrier.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_mpsc_fifo.h>
+#include <sbi/sbi_string.h>
+
+/*
+ * Each slot sequence word holds (position << 2) | state where the
+ * position is the FIFO position the slot currently belongs to.
+ */
+#define MPSC_SEQ_FREE		0x0UL
+#define MPSC_SEQ_READY		0x1UL
+#define MPSC_SEQ_BUSY		0x2UL
+#define MPSC_SEQ(__pos, __state)	(((__pos) << 2) | (__state))
+
+static inline void *mpsc_fifo_entry(struct sbi_mpsc_fifo *fifo,
+				    unsigned long slot)
+{
+	return (char *)fifo->queue + slot * fifo->entry_size;
+}
+
+/*
+ * Note: entries must be a power of two so that the slot index stays
+ * consistent when the free running positions wrap around.
+ */
+int sbi_mpsc_fifo_init(struct sbi_mpsc_fifo *fifo, void *mem, u16 entries,
+		       u16 entry_size)
+{
+	unsigned long i;
+
+	if (!fifo || !mem || !entries || (entries & (entries - 1)))
+		return SBI_EINVAL;
+
+	fifo->seq	  = mem;
+	fifo->queue	  = (char *)mem + entries * sizeof(unsigned long);
+	fifo->num_entries = entries;
+	fifo->entry_size  = entry_size;
+	fifo->head	  = 0;
+	fifo->tail	  = 0;
+
+	sbi_hart_memzero(fifo->queue, (size_t)entries * entry_size);
+	for (i = 0; i < entries; i++)
+		fifo->seq[i] = MPSC_SEQ(i, MPSC_SEQ_FREE);
+	smp_wmb();
+
+	return 0;
+}
+
+int sbi_mpsc_fifo_is_empty(struct sbi_mpsc_fifo *fifo)
+{
+	unsigned long head, tail;
+
+	if (!fifo)
+		return SBI_EINVAL;
+
+	tail = __atomic_load_n(&fifo->tail, __ATOMIC_RELAXED);
+	head = __atomic_load_n(&fifo->head, __ATOMIC_RELAXED);
+
+	return ((long)(head - tail) <= 0) ? true : false;
+}
+
+/**
+ * Provide a helper function to do inplace update to the fifo.
+ *
+ * Only entries which are published and not yet taken by the consumer
+ * are passed to the callback. The entry is owned by the caller for the
+ * duration of the callback so the consumer will wait for the callback
+ * to finish before dequeuing it.
+ */
+int sbi_mpsc_fifo_inplace_update(struct sbi_mpsc_fifo *fifo, void *in,
+				 int (*fptr)(void *in, void *data))
+{
+	unsigned long pos, head, slot, seq;
+	int ret = SBI_FIFO_UNCHANGED;
+
+	if (!fifo || !in)
+		return ret;
+
+	pos = __atomic_load_n(&fifo->tail, __ATOMIC_RELAXED);
+	head = __atomic_load_n(&fifo->head, __ATOMIC_ACQUIRE);
+
+	for (; (long)(head - pos) > 0; pos++) {
+		slot = pos & (fifo->num_entries - 1);
+		seq = MPSC_SEQ(pos, MPSC_SEQ_READY);
+		if (!__atomic_compare_exchange_n(&fifo->seq[slot], &seq,
+						 MPSC_SEQ(pos, MPSC_SEQ_BUSY),
+						 false, __ATOMIC_ACQUIRE,
+						 __ATOMIC_RELAXED))
+			continue;
+
+		ret = fptr(in, mpsc_fifo_entry(fifo, slot));
+
+		__atomic_store_n(&fifo->seq[slot],
+				 MPSC_SEQ(pos, MPSC_SEQ_READY),
+				 __ATOMIC_RELEASE);
+
+		if (ret == SBI_FIFO_SKIP || ret == SBI_FIFO_UPDATED)
+			break;
+	}
+
+	return ret;
+}
+
+int sbi_mpsc_fifo_enqueue(struct sbi_mpsc_fifo *fifo, void *data)
+{
+	unsigned long pos, slot, seq;
+	long diff;
+
+	if (!fifo || !data)
+		return SBI_EINVAL;
+
+	pos = __atomic_load_n(&fifo->head, __ATOMIC_RELAXED);
+	while (1) {
+		slot = pos & (fifo->num_entries - 1);
+		seq = __atomic_load_n(&fifo->seq[slot], __ATOMIC_ACQUIRE);
+		diff = (long)(seq - MPSC_SEQ(pos, MPSC_SEQ_FREE));
+		if (!diff) {
+			/* Slot is free for this position so try to claim it */
+			if (__atomic_compare_exchange_n(&fifo->head, &pos,
+							pos + 1, true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* Slot still holds an entry from the previous lap */
+			return SBI_ENOSPC;
+		} else {
+			/* Some other producer claimed this position */
+			pos = __atomic_load_n(&fifo->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	sbi_memcpy(mpsc_fifo_entry(fifo, slot), data, fifo->entry_size);
+	__atomic_store_n(&fifo->seq[slot], MPSC_SEQ(pos, MPSC_SEQ_READY),
+			 __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* Note: must only be called by the single consumer of the fifo */
+int sbi_mpsc_fifo_dequeue(struct sbi_mpsc_fifo *fifo, void *data)
+{
+	unsigned long pos, slot, seq;
+
+	if (!fifo || !data)
+		return SBI_EINVAL;
+
+	pos = fifo->tail;
+	slot = pos & (fifo->num_entries - 1);
+	while (1) {
+		seq = MPSC_SEQ(pos, MPSC_SEQ_READY);
+		if (__atomic_compare_exchange_n(&fifo->seq[slot], &seq,
+						MPSC_SEQ(pos, MPSC_SEQ_BUSY),
+						false, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			break;
+
+		/* Entry is briefly owned by an in-place update */
+		if (seq == MPSC_SEQ(pos, MPSC_SEQ_BUSY))
+			continue;
+
+		/* Nothing published at this position yet */
+		return SBI_ENOENT;
+	}
+
+	sbi_memcpy(data, mpsc_fifo_entry(fifo, slot), fifo->entry_size);
+
+	__atomic_store_n(&fifo->tail, pos + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&fifo->seq[slot],
+			 MPSC_SEQ(pos + fifo->num_entries, MPSC_SEQ_FREE),
+			 __ATOMIC_RELEASE);
+
+	return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Nested acceleration (NACL) shared memory
+ *
+ * OpenSBI runs below the hypervisor on real hardware so the hypervisor
+ * CSRs and HFENCEs of the shared memory are those of the hart itself.
+ * A CSR sync writes the dirty CSRs and reads all of them back, an HFENCE
+ * sync performs the pending entries as one local batch of sbi_tlb. SRET
+ * synchronization and CSR autoswap need the SBI implementation to run
+ * the guest of the caller and are not available.
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_bitops.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_nacl.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_tlb.h>
+
+/* Number of HFENCE entries performed as one batch */
+#define NACL_HFENCE_BATCH	16
+
+struct nacl_shmem {
+	bool enabled;
+	unsigned long phys;
+};
+
+static unsigned long nacl_shmem_off;
+
+/* The hypervisor CSRs which can be synchronized through the CSR space */
+#if __riscv_xlen == 32
+#define NACL_CSRS_XLEN				\
+	NACL_CSR(CSR_HTIMEDELTAH)		\
+	NACL_CSR(CSR_HENVCFGH)
+#else
+#define NACL_CSRS_XLEN
+#endif
+
+#define NACL_CSRS				\
+	NACL_CSR(CSR_HSTATUS)			\
+	NACL_CSR(CSR_HEDELEG)			\
+	NACL_CSR(CSR_HIDELEG)			\
+	NACL_CSR(CSR_HIE)			\
+	NACL_CSR(CSR_HCOUNTEREN)		\
+	NACL_CSR(CSR_HTIMEDELTA)		\
+	NACL_CSR(CSR_HENVCFG)			\
+	NACL_CSR(CSR_HTVAL)			\
+	NACL_CSR(CSR_HVIP)			\
+	NACL_CSR(CSR_HTINST)			\
+	NACL_CSR(CSR_HGATP)			\
+	NACL_CSR(CSR_VSSTATUS)			\
+	NACL_CSR(CSR_VSIE)			\
+	NACL_CSR(CSR_VSTVEC)			\
+	NACL_CSR(CSR_VSSCRATCH)			\
+	NACL_CSR(CSR_VSEPC)			\
+	NACL_CSR(CSR_VSCAUSE)			\
+	NACL_CSR(CSR_VSTVAL)			\
+	NACL_CSR(CSR_VSIP)			\
+	NACL_CSR(CSR_VSATP)			\
+	NACL_CSRS_XLEN
+
+static const u16 nacl_csrs[] = {
+#define NACL_CSR(__csr)	__csr,
+	NACL_CSRS
+#undef NACL_CSR
+};
+
+static bool nacl_csr_valid(unsigned long csr_num)
+{
+	switch (csr_num) {
+#define NACL_CSR(__csr)	case __csr:
+	NACL_CSRS
+#undef NACL_CSR
+		return true;
+	default:
+		return false;
+	}
+}
+
+static unsigned long nacl_csr_read(unsigned long csr_num)
+{
+	switch (csr_num) {
+#define NACL_CSR(__csr)	case __csr: return csr_read(__csr);
+	NACL_CSRS
+#undef NACL_CSR
+	default:
+		return 0;
+	}
+}
+
+static void nacl_csr_write(unsigned long csr_num, unsigned long val)
+{
+	switch (csr_num) {
+#define NACL_CSR(__csr)	case __csr: csr_write(__csr, val); break;
+	NACL_CSRS
+#undef NACL_CSR
+	default:
+		break;
+	}
+}
+
+static struct nacl_shmem *nacl_thishart_shmem(void)
+{
+	if (!nacl_shmem_off)
+		return NULL;
+
+	return sbi_scratch_thishart_offset_ptr(nacl_shmem_off);
+}
+
+bool sbi_nacl_feature_available(unsigned long feature_id)
+{
+	switch (feature_id) {
+	case SBI_NACL_FEAT_SYNC_CSR:
+	case SBI_NACL_FEAT_SYNC_HFENCE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Must be called with the dirty bitmap and CSR space mapped */
+static void nacl_csr_sync_one(unsigned long base, unsigned long csr_num)
+{
+	unsigned long *dbitmap = (void *)(base + SBI_NACL_SHMEM_DBITMAP_OFFSET);
+	unsigned long *csrs = (void *)(base + SBI_NACL_SHMEM_CSR_OFFSET);
+	unsigned long idx = SBI_NACL_SHMEM_CSR_INDEX(csr_num);
+	unsigned long bit = BIT_MASK(idx);
+
+	if (dbitmap[BIT_WORD(idx)] & bit) {
+		nacl_csr_write(csr_num, csrs[idx]);
+		dbitmap[BIT_WORD(idx)] &= ~bit;
+	}
+	csrs[idx] = nacl_csr_read(csr_num);
+}
+
+static void nacl_csr_sync(unsigned long base, unsigned long csr_num)
+{
+	u32 i;
+
+	sbi_hart_map_saddr(base + SBI_NACL_SHMEM_DBITMAP_OFFSET,
+			   SBI_NACL_SHMEM_DBITMAP_SIZE + SBI_NACL_SHMEM_CSR_SIZE);
+	if (csr_num != -1UL) {
+		nacl_csr_sync_one(base, csr_num);
+	} else {
+		for (i = 0; i < array_size(nacl_csrs); i++)
+			nacl_csr_sync_one(base, nacl_csrs[i]);
+	}
+	sbi_hart_unmap_saddr();
+}
+
+int sbi_nacl_set_shmem(const struct sbi_domain *dom, unsigned long smode,
+		       unsigned long shmem_phys_lo,
+		       unsigned long shmem_phys_hi, unsigned long flags)
+{
+	struct nacl_shmem *shmem = nacl_thishart_shmem();
+
+	if (!shmem)
+		return SBI_ERR_FAILED;
+
+	if (flags)
+		return SBI_ERR_INVALID_PARAM;
+
+	/* call is to disable shared memory */
+	if (shmem_phys_lo == SBI_NACL_SHMEM_INVALID_ADDR &&
+	    shmem_phys_hi == SBI_NACL_SHMEM_INVALID_ADDR) {
+		shmem->enabled = false;
+		shmem->phys = 0;
+		return SBI_SUCCESS;
+	}
+
+	if (shmem_phys_lo & SBI_NACL_SHMEM_ALIGN_MASK)
+		return SBI_ERR_INVALID_PARAM;
+
+	/* Same upper physical address restriction as the DBTR shmem */
+	if (shmem_phys_hi)
+		return SBI_EINVALID_ADDR;
+
+	if (dom && !sbi_domain_check_addr_range(dom, shmem_phys_lo,
+				SBI_NACL_SHMEM_SIZE, smode,
+				SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_ERR_INVALID_ADDRESS;
+
+	shmem->phys = shmem_phys_lo;
+	shmem->enabled = true;
+
+	/* Start from the current CSR values with nothing dirty */
+	sbi_hart_map_saddr(shmem->phys + SBI_NACL_SHMEM_DBITMAP_OFFSET,
+			   SBI_NACL_SHMEM_DBITMAP_SIZE);
+	sbi_memset((void *)(shmem->phys + SBI_NACL_SHMEM_DBITMAP_OFFSET), 0,
+		   SBI_NACL_SHMEM_DBITMAP_SIZE);
+	sbi_hart_unmap_saddr();
+	nacl_csr_sync(shmem->phys, -1UL);
+
+	return SBI_SUCCESS;
+}
+
+int sbi_nacl_sync_csr(unsigned long csr_num)
+{
+	struct nacl_shmem *shmem = nacl_thishart_shmem();
+
+	if (!shmem || !shmem->enabled)
+		return SBI_ERR_NO_SHMEM;
+
+	if (csr_num != -1UL && !nacl_csr_valid(csr_num))
+		return SBI_ERR_INVALID_PARAM;
+
+	nacl_csr_sync(shmem->phys, csr_num);
+
+	return SBI_SUCCESS;
+}
+
+/* Turn an HFENCE entry into a fence request, false if it is malformed */
+static bool nacl_hfence_decode(const unsigned long *ent,
+			       struct sbi_tlb_info *tinfo)
+{
+	unsigned long config = ent[0], pnum = ent[1], pcount = ent[3];
+	unsigned long type, order, vmid, asid, start, size;
+
+	type = (config >> SBI_NACL_HFENCE_CONFIG_TYPE_SHIFT) &
+	       SBI_NACL_HFENCE_CONFIG_TYPE_MASK;
+	order = ((config >> SBI_NACL_HFENCE_CONFIG_ORDER_SHIFT) &
+		 SBI_NACL_HFENCE_CONFIG_ORDER_MASK) + SBI_NACL_HFENCE_ORDER_BASE;
+	vmid = (config >> SBI_NACL_HFENCE_CONFIG_VMID_SHIFT) &
+	       (BIT(SBI_NACL_HFENCE_CONFIG_VMID_BITS) - 1);
+	asid = config & (BIT(SBI_NACL_HFENCE_CONFIG_ASID_BITS) - 1);
+
+	/* Ranges which do not fit in an address are flushed fully */
+	if (order < __riscv_xlen && pnum <= (-1UL >> order) &&
+	    pcount <= (-1UL >> order)) {
+		start = pnum << order;
+		size = pcount << order;
+	} else {
+		start = 0;
+		size = SBI_TLB_FLUSH_ALL;
+	}
+
+	switch (type) {
+	case SBI_NACL_HFENCE_TYPE_GVMA_ALL:
+	case SBI_NACL_HFENCE_TYPE_GVMA_VMID_ALL:
+	case SBI_NACL_HFENCE_TYPE_VVMA_ALL:
+	case SBI_NACL_HFENCE_TYPE_VVMA_ASID_ALL:
+		start = 0;
+		size = SBI_TLB_FLUSH_ALL;
+		break;
+	}
+
+	switch (type) {
+	case SBI_NACL_HFENCE_TYPE_GVMA:
+	case SBI_NACL_HFENCE_TYPE_GVMA_ALL:
+		type = SBI_TLB_HFENCE_GVMA;
+		break;
+	case SBI_NACL_HFENCE_TYPE_GVMA_VMID:
+	case SBI_NACL_HFENCE_TYPE_GVMA_VMID_ALL:
+		type = SBI_TLB_HFENCE_GVMA_VMID;
+		break;
+	case SBI_NACL_HFENCE_TYPE_VVMA:
+	case SBI_NACL_HFENCE_TYPE_VVMA_ALL:
+		type = SBI_TLB_HFENCE_VVMA;
+		break;
+	case SBI_NACL_HFENCE_TYPE_VVMA_ASID:
+	case SBI_NACL_HFENCE_TYPE_VVMA_ASID_ALL:
+		type = SBI_TLB_HFENCE_VVMA_ASID;
+		break;
+	default:
+		return false;
+	}
+
+	SBI_TLB_INFO_INIT(tinfo, start, size, asid, vmid, type,
+			  current_hartid());
+	return true;
+}
+
+int sbi_nacl_sync_hfence(unsigned long entry_index)
+{
+	struct nacl_shmem *shmem = nacl_thishart_shmem();
+	struct sbi_tlb_info batch[NACL_HFENCE_BATCH];
+	u32 slots[NACL_HFENCE_BATCH];
+	unsigned long *ent, first, last, i;
+	u32 j, count;
+
+	if (!shmem || !shmem->enabled)
+		return SBI_ERR_NO_SHMEM;
+
+	if (entry_index == -1UL) {
+		first = 0;
+		last = SBI_NACL_SHMEM_HFENCE_ENTRY_MAX - 1;
+	} else if (entry_index < SBI_NACL_SHMEM_HFENCE_ENTRY_MAX) {
+		first = last = entry_index;
+	} else {
+		return SBI_ERR_INVALID_PARAM;
+	}
+
+	for (i = first; i <= last; ) {
+		/*
+		 * Entries are copied out and their pending bits cleared
+		 * only once the fences are done, so the supervisor never
+		 * reuses an entry which is still in flight.
+		 */
+		count = 0;
+		sbi_hart_map_saddr(shmem->phys + SBI_NACL_SHMEM_HFENCE_OFFSET,
+				   SBI_NACL_SHMEM_HFENCE_SIZE);
+		for (; i <= last && count < NACL_HFENCE_BATCH; i++) {
+			ent = (void *)(shmem->phys +
+				       SBI_NACL_SHMEM_HFENCE_OFFSET +
+				       i * SBI_NACL_SHMEM_HFENCE_ENTRY_SZ);
+			if (!(ent[0] & SBI_NACL_HFENCE_CONFIG_PEND))
+				continue;
+
+			if (nacl_hfence_decode(ent, &batch[count]))
+				slots[count++] = i;
+			else
+				ent[0] &= ~SBI_NACL_HFENCE_CONFIG_PEND;
+		}
+		sbi_hart_unmap_saddr();
+
+		if (!count)
+			continue;
+
+		sbi_tlb_local_batch(batch, count);
+
+		sbi_hart_map_saddr(shmem->phys + SBI_NACL_SHMEM_HFENCE_OFFSET,
+				   SBI_NACL_SHMEM_HFENCE_SIZE);
+		for (j = 0; j < count; j++) {
+			ent = (void *)(shmem->phys +
+				       SBI_NACL_SHMEM_HFENCE_OFFSET +
+				       slots[j] * SBI_NACL_SHMEM_HFENCE_ENTRY_SZ);
+			ent[0] &= ~SBI_NACL_HFENCE_CONFIG_PEND;
+		}
+		sbi_hart_unmap_saddr();
+	}
+
+	return SBI_SUCCESS;
+}
+
+void sbi_nacl_reset_hart(struct sbi_scratch *scratch)
+{
+	struct nacl_shmem *shmem;
+
+	if (!nacl_shmem_off)
+		return;
+
+	shmem = sbi_scratch_offset_ptr(scratch, nacl_shmem_off);
+	shmem->enabled = false;
+	shmem->phys = 0;
+}
+
+int sbi_nacl_init(void)
+{
+	if (!nacl_shmem_off) {
+		nacl_shmem_off = sbi_scratch_alloc_offset(sizeof(struct nacl_shmem));
+		if (!nacl_shmem_off)
+			return SBI_ENOMEM;
+	}
+
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Combined firmware performance report
+ */
+
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_boot_trace.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_ecall_profile.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_heap_stats.h>
+#include <sbi/sbi_hsm_stats.h>
+#include <sbi/sbi_lock_stat.h>
+#include <sbi/sbi_perf_report.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
+#include <sbi/sbi_trap.h>
+#include <sbi/sbi_trap_stats.h>
+
+/*
+ * Report under construction. The report is built twice, first with a
+ * NULL buffer to size it and then straight into supervisor memory.
+ */
+struct perf_report {
+	char *buf;
+	unsigned long size;
+	u32 nr_sections;
+};
+
+/* Returns where to write the payload, or NULL while sizing the report */
+static void *perf_report_section(struct perf_report *rep, u32 type,
+				 u32 hartid, unsigned long size)
+{
+	struct sbi_perf_report_section *sec;
+	void *payload = NULL;
+
+	size = ROUNDUP(size, sizeof(u64));
+	if (rep->buf) {
+		sec = (void *)(rep->buf + rep->size);
+		sec->type = type;
+		sec->hartid = hartid;
+		sec->size = size;
+		payload = sec + 1;
+	}
+	rep->size += sizeof(*sec) + size;
+	rep->nr_sections++;
+
+	return payload;
+}
+
+/* Add a section holding a copy of the data, if there is any */
+static inline void perf_report_copy(struct perf_report *rep, u32 type,
+				    u32 hartid, const void *data,
+				    unsigned long size)
+{
+	void *p;
+
+	if (!data)
+		return;
+
+	p = perf_report_section(rep, type, hartid, size);
+	if (p)
+		sbi_memcpy(p, data, size);
+}
+
+static void perf_report_hart(struct perf_report *rep, u32 hartindex)
+{
+#ifdef CONFIG_SBI_TRAP_STATS
+	perf_report_copy(rep, SBI_PERF_REPORT_TRAP_STATS,
+			 sbi_hartindex_to_hartid(hartindex),
+			 sbi_trap_stats_get(hartindex),
+			 sizeof(struct sbi_trap_stats));
+#endif
+#ifdef CONFIG_SBI_ECALL_PROFILE
+	perf_report_copy(rep, SBI_PERF_REPORT_ECALL_PROFILE,
+			 sbi_hartindex_to_hartid(hartindex),
+			 sbi_ecall_profile_get(hartindex),
+			 SBI_ECALL_PROFILE_SLOTS *
+				sizeof(struct sbi_ecall_profile_entry));
+#endif
+#ifdef CONFIG_SBI_HSM_STATS
+	perf_report_copy(rep, SBI_PERF_REPORT_HSM_STATS,
+			 sbi_hartindex_to_hartid(hartindex),
+			 sbi_hsm_stats_get(hartindex),
+			 sizeof(struct sbi_hsm_stats));
+	perf_report_copy(rep, SBI_PERF_REPORT_HSM_START_STATS,
+			 sbi_hartindex_to_hartid(hartindex),
+			 sbi_hsm_stats_start_get(hartindex),
+			 sizeof(struct sbi_hsm_start_stats));
+#endif
+}
+
+#ifdef CONFIG_SBI_BOOT_TRACE
+static void perf_report_boot_trace(struct perf_report *rep)
+{
+	const struct sbi_boot_trace_entry *entry;
+	struct sbi_perf_report_boot_stage *stage;
+	u32 i, count = sbi_boot_trace_count();
+
+	stage = perf_report_section(rep, SBI_PERF_REPORT_BOOT_TRACE,
+				    SBI_PERF_REPORT_GLOBAL,
+				    count * sizeof(*stage));
+	for (i = 0; stage && i < count; i++, stage++) {
+		sbi_memset(stage, 0, sizeof(*stage));
+		entry = sbi_boot_trace_get(i);
+		if (!entry)
+			continue;
+		sbi_strncpy(stage->name, entry->name, sizeof(stage->name) - 1);
+		stage->time = entry->time;
+		stage->cycles = entry->cycles;
+	}
+}
+#endif
+
+#ifdef CONFIG_SBI_HEAP_STATS
+static void perf_report_heap_stats(struct perf_report *rep)
+{
+	struct sbi_heap_stats *heap;
+
+	heap = perf_report_section(rep, SBI_PERF_REPORT_HEAP_STATS,
+				   SBI_PERF_REPORT_GLOBAL, sizeof(*heap));
+	if (heap)
+		sbi_heap_stats_from(&global_hpctrl, heap);
+}
+#endif
+
+#ifdef CONFIG_SBI_LOCK_STAT
+static void perf_report_lock_stats(struct perf_report *rep)
+{
+	struct sbi_lock_stats *locks;
+
+	locks = perf_report_section(rep, SBI_PERF_REPORT_LOCK_STATS,
+				    SBI_PERF_REPORT_GLOBAL, sizeof(*locks));
+	if (locks)
+		sbi_lock_stat_snapshot(locks);
+}
+#endif
+
+static void perf_report_global(struct perf_report *rep)
+{
+#ifdef CONFIG_SBI_HEAP_STATS
+	perf_report_heap_stats(rep);
+#endif
+#ifdef CONFIG_SBI_LOCK_STAT
+	perf_report_lock_stats(rep);
+#endif
+#ifdef CONFIG_SBI_BOOT_TRACE
+	perf_report_boot_trace(rep);
+#endif
+}
+
+static void perf_report_build(struct perf_report *rep,
+			      const struct sbi_domain *dom)
+{
+	struct sbi_perf_report_header *hdr = (void *)rep->buf;
+	u32 i;
+
+	rep->size = sizeof(*hdr);
+	rep->nr_sections = 0;
+
+	/* Only the HARTs of the calling domain are reported */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		if (sbi_domain_is_assigned_hart(dom, i))
+			perf_report_hart(rep, i);
+	}
+	perf_report_global(rep);
+
+	if (hdr) {
+		hdr->magic = SBI_PERF_REPORT_MAGIC;
+		hdr->version = SBI_PERF_REPORT_VERSION;
+		hdr->size = rep->size;
+		hdr->time = sbi_timer_value();
+		hdr->nr_sections = rep->nr_sections;
+		hdr->reserved = 0;
+	}
+}
+
+unsigned long sbi_perf_report_build(const struct sbi_domain *dom, void *buf,
+				    unsigned long size)
+{
+	struct perf_report rep = { 0 };
+
+	perf_report_build(&rep, dom);
+	if (buf && rep.size <= size) {
+		rep.buf = buf;
+		perf_report_build(&rep, dom);
+	}
+
+	return rep.size;
+}
+
+/*
+ * Copy the report to supervisor memory. A zero size only returns the
+ * size the report needs, which may grow with the boot trace.
+ */
+static int perf_report_read(unsigned long addr_lo, unsigned long addr_hi,
+			    unsigned long size, unsigned long *out_size)
+{
+	struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	struct perf_report rep = { 0 };
+	int rc;
+
+	perf_report_build(&rep, dom);
+	*out_size = rep.size;
+	if (!size)
+		return 0;
+	if (size < rep.size)
+		return SBI_EINVAL;
+
+	if (addr_lo & (sizeof(u64) - 1))
+		return SBI_EINVALID_ADDR;
+	rc = sbi_domain_check_smode_buffer(addr_lo, addr_hi, rep.size,
+					   SBI_DOMAIN_READ | SBI_DOMAIN_WRITE);
+	if (rc)
+		return rc;
+
+	/* The report is built in place so it is not copied */
+
+	sbi_hart_map_saddr(addr_lo, rep.size);
+	rep.buf = (char *)addr_lo;
+	perf_report_build(&rep, dom);
+	sbi_hart_unmap_saddr();
+
+	return 0;
+}
+
+int sbi_perf_report_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			   struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_PERF_REPORT:
+		return perf_report_read(regs->a0, regs->a1, regs->a2,
+					&out->value);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
@@ -8,8 +8,10 @@
  */
 
 #include <sbi/riscv_asm.h>
+#include <sbi/riscv_barrier.h>
 #include <sbi/sbi_bitops.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
@@ -18,6 +20,7 @@
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_sse.h>
+#include <sbi/sbi_timer.h>
 
 /** Information about hardware counters */
 struct sbi_pmu_hw_event {
@@ -36,6 +39,13 @@ struct sbi_pmu_hw_event {
 	uint64_t select_mask;
 };
 
+/* Number of SBI and OpenSBI specific firmware events */
+#define PMU_FW_EVENT_SLOTS	\
+	(SBI_PMU_FW_MAX + SBI_PMU_FW_OPENSBI_MAX - SBI_PMU_FW_OPENSBI_BASE)
+
+/* Overflow samples buffered until the outermost trap exits */
+#define PMU_FW_SAMPLE_PENDING	8
+
 /* Information about PMU counters as per SBI specification */
 union sbi_pmu_ctr_info {
 	unsigned long value;
@@ -55,6 +65,27 @@ union sbi_pmu_ctr_info {
 #error "Can't handle firmware counters beyond BITS_PER_LONG"
 #endif
 
+#ifdef CONFIG_SBI_PMU_HW_MUX
+/** Hardware event multiplexed over the pool counters */
+struct pmu_mux_event {
+	/* Configuration of the event as passed to counter config match */
+	unsigned long event_idx;
+	unsigned long flags;
+	uint64_t data;
+	/* Pool counters able to count the event */
+	unsigned long counters;
+	/* Pool counter currently counting the event or -1 */
+	int hw_ctr;
+	/* Value of the pool counter when it was last folded in */
+	uint64_t hw_base;
+	/* Timer value when the times were last updated */
+	u64 stamp;
+	/* Timer ticks while started and while counting on hardware */
+	u64 enabled;
+	u64 running;
+};
+#endif
+
 /** Per-HART state of the PMU counters */
 struct sbi_pmu_hart_state {
 	/* HART to which this state belongs */
@@ -63,8 +94,44 @@ struct sbi_pmu_hart_state {
 	uint32_t active_events[SBI_PMU_HW_CTR_MAX + SBI_PMU_FW_CTR_MAX];
 	/* Bitmap of firmware counters started */
 	unsigned long fw_counters_started;
+	/*
+	 * Firmware counter index plus one of the started counter with the
+	 * lowest index counting each firmware event, zero if none
+	 */
+	uint8_t fw_event_ctr[PMU_FW_EVENT_SLOTS];
 	/* if true, SSE is enabled */
 	bool sse_enabled;
+	/* Snapshot shared memory or SBI_PMU_SNAPSHOT_INVALID_ADDR */
+	unsigned long snapshot_addr;
+	/* Bitmap of hardware counters which overflowed since started */
+	unsigned long hw_counters_overflowed;
+	/* Cached mhpmevent values and bitmap of the valid entries */
+	uint64_t mhpmevent[SBI_PMU_HW_CTR_MAX];
+	unsigned long mhpmevent_valid;
+	/* Bitmap of firmware counters which overflowed since started */
+	unsigned long fw_counters_overflowed;
+	/* Overflow samples not yet written to the snapshot memory */
+	unsigned int fw_samples_pending;
+	unsigned int fw_samples_lost;
+	struct sbi_pmu_sample fw_samples[PMU_FW_SAMPLE_PENDING];
+	/* Last event looked up in hw_event_map and its counters */
+	unsigned long memo_event_idx;
+	uint64_t memo_data;
+	unsigned long memo_counters;
+	uint32_t memo_gen;
+#ifdef CONFIG_SBI_PMU_HW_MUX
+	/* Programmable counters reserved for multiplexed events */
+	unsigned long mux_pool;
+	/* Bitmap of firmware counters backed by multiplexed events */
+	unsigned long mux_counters;
+	/* Bitmap of multiplexed firmware counters started */
+	unsigned long mux_started;
+	/* Firmware counter which gets a pool counter first */
+	unsigned int mux_next;
+	/* Rotates the started events over the pool counters */
+	struct sbi_timer_entry mux_tick;
+	struct pmu_mux_event mux[SBI_PMU_FW_CTR_MAX];
+#endif
 	/*
 	 * Counter values for SBI firmware events and event codes
 	 * for platform firmware events. Both are mutually exclusive
@@ -93,6 +160,19 @@ static struct sbi_pmu_hw_event *hw_event_map;
 
 /* Maximum number of hardware events available */
 static uint32_t num_hw_events;
+/* Incremented whenever an entry is added to hw_event_map */
+static uint32_t hw_event_map_gen;
+
+/*
+ * Lookup index of hw_event_map built once the platform added its
+ * events. Ranged events are sorted by start index and raw events by
+ * select mask then select value.
+ */
+static struct sbi_pmu_hw_event **hw_event_ranges;
+static uint32_t num_hw_event_ranges;
+static struct sbi_pmu_hw_event **hw_event_raws;
+static uint32_t num_hw_event_raws;
+static uint32_t hw_event_index_gen = -1U;
 /* Maximum number of hardware counters available */
 static uint32_t num_hw_ctrs;
 
@@ -104,6 +184,26 @@ static uint32_t total_ctrs;
   (((x) & SBI_PMU_EVENT_IDX_TYPE_MASK) >> SBI_PMU_EVENT_IDX_TYPE_OFFSET)
 #define get_cidx_code(x) (x & SBI_PMU_EVENT_IDX_CODE_MASK)
 
+/* Check for firmware event codes which are reserved by the SBI spec */
+static inline bool pmu_fw_event_code_reserved(uint32_t code)
+{
+	return (code >= SBI_PMU_FW_MAX && code < SBI_PMU_FW_OPENSBI_BASE) ||
+	       (code >= SBI_PMU_FW_OPENSBI_MAX &&
+		code <= SBI_PMU_FW_RESERVED_MAX) ||
+	       code > SBI_PMU_FW_PLATFORM;
+}
+
+/* Index of a firmware event in fw_event_ctr[], negative if none */
+static inline int pmu_fw_event_slot(uint32_t code)
+{
+	if (code < SBI_PMU_FW_MAX)
+		return code;
+	if (code >= SBI_PMU_FW_OPENSBI_BASE && code < SBI_PMU_FW_OPENSBI_MAX)
+		return code - SBI_PMU_FW_OPENSBI_BASE + SBI_PMU_FW_MAX;
+
+	return -1;
+}
+
 /**
  * Perform a sanity check on event & counter mappings with event range overlap check
  * @param evtA Pointer to the existing hw event structure
@@ -143,15 +243,15 @@ static int pmu_event_validate(struct sbi_pmu_hart_state *phs,
 		event_idx_code_max = SBI_PMU_HW_GENERAL_MAX;
 		break;
 	case SBI_PMU_EVENT_TYPE_FW:
-		if ((event_idx_code >= SBI_PMU_FW_MAX &&
-		    event_idx_code <= SBI_PMU_FW_RESERVED_MAX) ||
-		    event_idx_code > SBI_PMU_FW_PLATFORM)
+		if (pmu_fw_event_code_reserved(event_idx_code))
 			return SBI_EINVAL;
 
 		if (SBI_PMU_FW_PLATFORM == event_idx_code &&
 		    pmu_dev && pmu_dev->fw_event_validate_encoding)
 			return pmu_dev->fw_event_validate_encoding(phs->hartid,
 							           edata);
+		else if (event_idx_code >= SBI_PMU_FW_OPENSBI_BASE)
+			event_idx_code_max = SBI_PMU_FW_OPENSBI_MAX;
 		else
 			event_idx_code_max = SBI_PMU_FW_MAX;
 		break;
@@ -204,6 +304,320 @@ static int pmu_ctr_validate(struct sbi_pmu_hart_state *phs,
 	return event_idx_type;
 }
 
+#ifdef CONFIG_SBI_PMU_HW_MUX
+static void pmu_ctr_write_hw(uint32_t cidx, uint64_t ival);
+static int pmu_ctr_stop_hw(uint32_t cidx);
+static uint64_t pmu_ctr_read_hw(uint32_t cidx);
+static int pmu_update_hw_mhpmevent(struct sbi_pmu_hart_state *phs, int ctr_idx,
+				   unsigned long flags, unsigned long eindex,
+				   uint64_t data);
+static unsigned long pmu_hw_event_counters(struct sbi_pmu_hart_state *phs,
+					   unsigned long event_idx,
+					   uint64_t data);
+
+static inline unsigned long pmu_mux_pool(struct sbi_pmu_hart_state *phs)
+{
+	return phs->mux_pool;
+}
+
+static inline bool pmu_mux_is(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	return num_hw_ctrs <= cidx && cidx < total_ctrs &&
+	       (phs->mux_counters & BIT(cidx - num_hw_ctrs));
+}
+
+/* Update the times and fold the count of a started event */
+static void pmu_mux_update(struct sbi_pmu_hart_state *phs, int i, u64 now)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct pmu_mux_event *mev = &phs->mux[i];
+	uint64_t val, mask;
+
+	if (!(phs->mux_started & BIT(i)))
+		return;
+
+	mev->enabled += now - mev->stamp;
+	if (0 <= mev->hw_ctr) {
+		mev->running += now - mev->stamp;
+		mask = (sbi_hart_mhpm_bits(scratch) < 64) ?
+		       BIT_ULL(sbi_hart_mhpm_bits(scratch)) - 1 : -1ULL;
+		val = pmu_ctr_read_hw(mev->hw_ctr);
+		phs->fw_counters_data[i] += (val - mev->hw_base) & mask;
+		mev->hw_base = val;
+	}
+	mev->stamp = now;
+}
+
+static void pmu_mux_load(struct sbi_pmu_hart_state *phs, int i, int ctr)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct pmu_mux_event *mev = &phs->mux[i];
+
+	/* The overflow interrupt of the pool counter stays disabled */
+	if (pmu_update_hw_mhpmevent(phs, ctr, mev->flags, mev->event_idx,
+				    mev->data))
+		return;
+
+	pmu_ctr_write_hw(ctr, 0);
+	mev->hw_base = 0;
+	mev->hw_ctr = ctr;
+	if (sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_11)
+		csr_clear(CSR_MCOUNTINHIBIT, BIT(ctr));
+}
+
+/* Must be called right after pmu_mux_update() */
+static void pmu_mux_unload(struct sbi_pmu_hart_state *phs, int i)
+{
+	struct pmu_mux_event *mev = &phs->mux[i];
+
+	if (mev->hw_ctr < 0)
+		return;
+
+	pmu_ctr_stop_hw(mev->hw_ctr);
+	mev->hw_ctr = -1;
+}
+
+/*
+ * Hand the free pool counters to the started events which are not
+ * counting, in round robin order starting from mux_next.
+ */
+static void pmu_mux_schedule(struct sbi_pmu_hart_state *phs)
+{
+	unsigned long free = phs->mux_pool, avail;
+	struct pmu_mux_event *mev;
+	int i, n;
+
+	for_each_set_bit(i, &phs->mux_started, SBI_PMU_FW_CTR_MAX) {
+		if (0 <= phs->mux[i].hw_ctr)
+			free &= ~BIT(phs->mux[i].hw_ctr);
+	}
+
+	for (n = 0; n < SBI_PMU_FW_CTR_MAX && free; n++) {
+		i = (phs->mux_next + n) % SBI_PMU_FW_CTR_MAX;
+		mev = &phs->mux[i];
+		avail = free & mev->counters;
+		if (!(phs->mux_started & BIT(i)) || 0 <= mev->hw_ctr || !avail)
+			continue;
+
+		pmu_mux_load(phs, i, sbi_ffs(avail));
+		if (0 <= mev->hw_ctr) {
+			free &= ~BIT(mev->hw_ctr);
+			phs->mux_next = (i + 1) % SBI_PMU_FW_CTR_MAX;
+		}
+	}
+}
+
+static void pmu_mux_arm(struct sbi_pmu_hart_state *phs)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+	u64 period;
+
+	if (!tdev || !phs->mux_started)
+		return;
+
+	period = (u64)tdev->timer_freq * CONFIG_SBI_PMU_HW_MUX_PERIOD_US;
+	sbi_timer_add_entry(&phs->mux_tick,
+			    sbi_timer_value() + period / 1000000);
+}
+
+static void pmu_mux_tick(struct sbi_timer_entry *entry)
+{
+	struct sbi_pmu_hart_state *phs =
+		container_of(entry, struct sbi_pmu_hart_state, mux_tick);
+	u64 now = sbi_timer_value();
+	bool waiting = false;
+	int i;
+
+	for_each_set_bit(i, &phs->mux_started, SBI_PMU_FW_CTR_MAX) {
+		pmu_mux_update(phs, i, now);
+		if (phs->mux[i].hw_ctr < 0)
+			waiting = true;
+	}
+
+	/* Only rotate when some started event has no pool counter */
+	if (waiting) {
+		for_each_set_bit(i, &phs->mux_started, SBI_PMU_FW_CTR_MAX)
+			pmu_mux_unload(phs, i);
+		pmu_mux_schedule(phs);
+	}
+
+	pmu_mux_arm(phs);
+}
+
+/* Back a free firmware counter by a hardware event the pool can count */
+static int pmu_mux_alloc(struct sbi_pmu_hart_state *phs,
+			 unsigned long cbase, unsigned long cmask,
+			 unsigned long flags, unsigned long event_idx,
+			 uint64_t data)
+{
+	unsigned long counters;
+	struct pmu_mux_event *mev;
+	int i, cidx;
+
+	counters = pmu_hw_event_counters(phs, event_idx, data) &
+		   phs->mux_pool;
+	if (!counters)
+		return SBI_ENOTSUPP;
+
+	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
+		cidx = i + cbase;
+		if (cidx < num_hw_ctrs || total_ctrs <= cidx ||
+		    phs->active_events[cidx] != SBI_PMU_EVENT_IDX_INVALID)
+			continue;
+
+		mev = &phs->mux[cidx - num_hw_ctrs];
+		sbi_memset(mev, 0, sizeof(*mev));
+		mev->event_idx = event_idx;
+		mev->flags = flags;
+		mev->data = data;
+		mev->counters = counters;
+		mev->hw_ctr = -1;
+		phs->fw_counters_data[cidx - num_hw_ctrs] = 0;
+		phs->mux_counters |= BIT(cidx - num_hw_ctrs);
+
+		return cidx;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+static void pmu_mux_free(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	if (pmu_mux_is(phs, cidx))
+		phs->mux_counters &= ~BIT(cidx - num_hw_ctrs);
+}
+
+static int pmu_mux_start(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			 uint64_t ival, bool ival_update)
+{
+	int i = cidx - num_hw_ctrs;
+	bool idle = !phs->mux_started;
+
+	if (phs->mux_started & BIT(i))
+		return SBI_EALREADY_STARTED;
+
+	if (ival_update)
+		phs->fw_counters_data[i] = ival;
+	phs->mux[i].stamp = sbi_timer_value();
+	phs->mux_started |= BIT(i);
+	pmu_mux_schedule(phs);
+	if (idle)
+		pmu_mux_arm(phs);
+
+	return 0;
+}
+
+static int pmu_mux_stop(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	int i = cidx - num_hw_ctrs;
+
+	if (!(phs->mux_started & BIT(i)))
+		return SBI_EALREADY_STOPPED;
+
+	pmu_mux_update(phs, i, sbi_timer_value());
+	pmu_mux_unload(phs, i);
+	phs->mux_started &= ~BIT(i);
+	if (phs->mux_started)
+		pmu_mux_schedule(phs);
+	else
+		sbi_timer_del_entry(&phs->mux_tick);
+
+	return 0;
+}
+
+static uint64_t pmu_mux_read(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	pmu_mux_update(phs, cidx - num_hw_ctrs, sbi_timer_value());
+
+	return phs->fw_counters_data[cidx - num_hw_ctrs];
+}
+
+static void pmu_mux_snapshot(struct sbi_pmu_hart_state *phs,
+			     struct sbi_pmu_snapshot *snap, int i,
+			     uint32_t cidx)
+{
+	if (!pmu_mux_is(phs, cidx))
+		return;
+
+	snap->ctr_enabled[i] = phs->mux[cidx - num_hw_ctrs].enabled;
+	snap->ctr_running[i] = phs->mux[cidx - num_hw_ctrs].running;
+}
+
+/* Reserve the topmost programmable counters of the HART as the pool */
+static void pmu_mux_init(struct sbi_scratch *scratch,
+			 struct sbi_pmu_hart_state *phs)
+{
+	unsigned long mask = sbi_hart_mhpm_mask(scratch) &
+			     ~SBI_PMU_FIXED_CTR_MASK;
+	int i, n = CONFIG_SBI_PMU_HW_MUX_COUNTERS;
+
+	sbi_timer_entry_init(&phs->mux_tick, pmu_mux_tick);
+	phs->mux_pool = 0;
+	for (i = SBI_PMU_HW_CTR_MAX - 1; 0 < n && 0 <= i; i--) {
+		if (mask & BIT(i)) {
+			phs->mux_pool |= BIT(i);
+			n--;
+		}
+	}
+}
+
+static void pmu_mux_reset(struct sbi_pmu_hart_state *phs)
+{
+	if (phs->mux_started)
+		sbi_timer_del_entry(&phs->mux_tick);
+	phs->mux_counters = 0;
+	phs->mux_started = 0;
+	phs->mux_next = 0;
+}
+#else
+static inline unsigned long pmu_mux_pool(struct sbi_pmu_hart_state *phs)
+{
+	return 0;
+}
+
+static inline bool pmu_mux_is(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	return false;
+}
+
+static inline int pmu_mux_alloc(struct sbi_pmu_hart_state *phs,
+				unsigned long cbase, unsigned long cmask,
+				unsigned long flags, unsigned long event_idx,
+				uint64_t data)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline void pmu_mux_free(struct sbi_pmu_hart_state *phs,
+				uint32_t cidx) { }
+
+static inline int pmu_mux_start(struct sbi_pmu_hart_state *phs,
+				uint32_t cidx, uint64_t ival, bool ival_update)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int pmu_mux_stop(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline uint64_t pmu_mux_read(struct sbi_pmu_hart_state *phs,
+				    uint32_t cidx)
+{
+	return 0;
+}
+
+static inline void pmu_mux_snapshot(struct sbi_pmu_hart_state *phs,
+				    struct sbi_pmu_snapshot *snap, int i,
+				    uint32_t cidx) { }
+
+static inline void pmu_mux_init(struct sbi_scratch *scratch,
+				struct sbi_pmu_hart_state *phs) { }
+
+static inline void pmu_mux_reset(struct sbi_pmu_hart_state *phs) { }
+#endif
+
 int sbi_pmu_ctr_fw_read(uint32_t cidx, uint64_t *cval)
 {
 	int event_idx_type;
@@ -214,12 +628,14 @@ int sbi_pmu_ctr_fw_read(uint32_t cidx, uint64_t *cval)
 		return SBI_EINVAL;
 
 	event_idx_type = pmu_ctr_validate(phs, cidx, &event_code);
+	if (event_idx_type >= 0 && pmu_mux_is(phs, cidx)) {
+		*cval = pmu_mux_read(phs, cidx);
+		return 0;
+	}
 	if (event_idx_type != SBI_PMU_EVENT_TYPE_FW)
 		return SBI_EINVAL;
 
-	if ((event_code >= SBI_PMU_FW_MAX &&
-	    event_code <= SBI_PMU_FW_RESERVED_MAX) ||
-	    event_code > SBI_PMU_FW_PLATFORM)
+	if (pmu_fw_event_code_reserved(event_code))
 		return SBI_EINVAL;
 
 	if (SBI_PMU_FW_PLATFORM == event_code) {
@@ -274,6 +690,7 @@ static int pmu_add_hw_event_map(u32 eidx_start, u32 eidx_end, u32 cmap,
 	event->counters = cmap & ctr_avail_mask;
 	event->select = select;
 	num_hw_events++;
+	hw_event_map_gen++;
 
 	return 0;
 
@@ -305,6 +722,15 @@ int sbi_pmu_add_raw_event_counter_map(uint64_t select, uint64_t select_mask, u32
 
 void sbi_pmu_ovf_irq()
 {
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct sbi_pmu_hart_state *phs = pmu_get_hart_state_ptr(scratch);
+
+	/* Remembered for the overflow bitmap of the snapshot */
+	if (phs && sbi_hart_has_extension(scratch, SBI_HART_EXT_SSCOFPMF))
+		phs->hw_counters_overflowed |= csr_read(CSR_SCOUNTOVF);
+	else if (phs && pmu_dev && pmu_dev->hw_counter_ovf_ack)
+		phs->hw_counters_overflowed |= pmu_dev->hw_counter_ovf_ack();
+
 	/*
 	 * We need to disable LCOFIP before returning to S-mode or we will loop
 	 * on LCOFIP being triggered
@@ -313,7 +739,34 @@ void sbi_pmu_ovf_irq()
 	sbi_sse_inject_event(SBI_SSE_EVENT_LOCAL_PMU);
 }
 
-static int pmu_ctr_enable_irq_hw(int ctr_idx)
+/*
+ * Write the mhpmevent CSR of a programmable counter unless the cached
+ * value shows that it already holds the value. The only bit changed by
+ * hardware is the OF bit which is set on overflow so the cache entry is
+ * dropped whenever the OF bit is cleared.
+ */
+static void pmu_write_mhpmevent(struct sbi_pmu_hart_state *phs, int ctr_idx,
+				uint64_t val)
+{
+	if ((phs->mhpmevent_valid & BIT(ctr_idx)) &&
+	    phs->mhpmevent[ctr_idx] == val)
+		return;
+
+#if __riscv_xlen == 32
+	csr_write_num(CSR_MHPMEVENT3 + ctr_idx - 3, val & 0xFFFFFFFF);
+	if (sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
+				   SBI_HART_EXT_SSCOFPMF))
+		csr_write_num(CSR_MHPMEVENT3H + ctr_idx - 3,
+			      val >> BITS_PER_LONG);
+#else
+	csr_write_num(CSR_MHPMEVENT3 + ctr_idx - 3, val);
+#endif
+
+	phs->mhpmevent[ctr_idx] = val;
+	phs->mhpmevent_valid |= BIT(ctr_idx);
+}
+
+static int pmu_ctr_enable_irq_hw(struct sbi_pmu_hart_state *phs, int ctr_idx)
 {
 	unsigned long mhpmevent_csr;
 	unsigned long mhpmevent_curr;
@@ -344,6 +797,7 @@ static int pmu_ctr_enable_irq_hw(int ctr_idx)
 	if (!(mip_val & MIP_LCOFIP)) {
 		mhpmevent_curr &= of_mask;
 		csr_write_num(mhpmevent_csr, mhpmevent_curr);
+		phs->mhpmevent_valid &= ~BIT(ctr_idx);
 	}
 
 	return 0;
@@ -360,16 +814,83 @@ static void pmu_ctr_write_hw(uint32_t cidx, uint64_t ival)
 #endif
 }
 
-static int pmu_ctr_start_hw(uint32_t cidx, uint64_t ival, bool ival_update)
+static void pmu_dev_enable_irq(unsigned long mask)
+{
+	int i;
+
+	if (!pmu_dev || !mask)
+		return;
+
+	if (pmu_dev->hw_counter_enable_irq_mask) {
+		pmu_dev->hw_counter_enable_irq_mask(mask);
+	} else if (pmu_dev->hw_counter_enable_irq) {
+		for_each_set_bit(i, &mask, BITS_PER_LONG)
+			pmu_dev->hw_counter_enable_irq(i);
+	}
+}
+
+static void pmu_dev_disable_irq(unsigned long mask)
+{
+	int i;
+
+	if (!pmu_dev || !mask)
+		return;
+
+	if (pmu_dev->hw_counter_disable_irq_mask) {
+		pmu_dev->hw_counter_disable_irq_mask(mask);
+	} else if (pmu_dev->hw_counter_disable_irq) {
+		for_each_set_bit(i, &mask, BITS_PER_LONG)
+			pmu_dev->hw_counter_disable_irq(i);
+	}
+}
+
+/*
+ * Returns the value of mcountinhibit for batching counter starts and
+ * stops, NULL if the HART has no mcountinhibit. The counters are then
+ * started or stopped at once by pmu_inhibit_commit().
+ */
+static unsigned long *pmu_inhibit_begin(unsigned long *mctr_inhbt)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+
+	if (sbi_hart_priv_version(scratch) < SBI_HART_PRIV_VER_1_11)
+		return NULL;
+
+	*mctr_inhbt = csr_read(CSR_MCOUNTINHIBIT);
+	return mctr_inhbt;
+}
+
+/*
+ * Only the bits changed since pmu_inhibit_begin() are written since
+ * multiplexed pool counters may have been started or stopped meanwhile.
+ * The overflow interrupts of the platform PMU device are updated for
+ * the same counters at once before they start or after they stop.
+ */
+static void pmu_inhibit_commit(unsigned long *mctr_inhbt, unsigned long orig)
+{
+	if (!mctr_inhbt || *mctr_inhbt == orig)
+		return;
+
+	pmu_dev_enable_irq(orig & ~*mctr_inhbt);
+	pmu_dev_disable_irq(*mctr_inhbt & ~orig);
+
+	if (orig & ~*mctr_inhbt)
+		csr_clear(CSR_MCOUNTINHIBIT, orig & ~*mctr_inhbt);
+	if (*mctr_inhbt & ~orig)
+		csr_set(CSR_MCOUNTINHIBIT, *mctr_inhbt & ~orig);
+}
+
+static int pmu_ctr_start_hw_batch(struct sbi_pmu_hart_state *phs,
+				  uint32_t cidx, uint64_t ival,
+				  bool ival_update, unsigned long *mctr_inhbt)
 {
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
-	unsigned long mctr_inhbt;
 
 	/* Make sure the counter index lies within the range and is not TM bit */
 	if (cidx >= num_hw_ctrs || cidx == 1)
 		return SBI_EINVAL;
 
-	if (sbi_hart_priv_version(scratch) < SBI_HART_PRIV_VER_1_11) {
+	if (!mctr_inhbt) {
 		if (ival_update)
 			pmu_ctr_write_hw(cidx, ival);
 		return 0;
@@ -379,24 +900,33 @@ static int pmu_ctr_start_hw(uint32_t cidx, uint64_t ival, bool ival_update)
 	 * Some of the hardware may not support mcountinhibit but perf stat
 	 * still can work if supervisor mode programs the initial value.
 	 */
-	mctr_inhbt = csr_read(CSR_MCOUNTINHIBIT);
-	if (!__test_bit(cidx, &mctr_inhbt))
+	if (!__test_bit(cidx, mctr_inhbt))
 		return SBI_EALREADY_STARTED;
 
-	__clear_bit(cidx, &mctr_inhbt);
+	__clear_bit(cidx, mctr_inhbt);
 
 	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SSCOFPMF))
-		pmu_ctr_enable_irq_hw(cidx);
+		pmu_ctr_enable_irq_hw(phs, cidx);
 	if (ival_update)
 		pmu_ctr_write_hw(cidx, ival);
-	if (pmu_dev && pmu_dev->hw_counter_enable_irq)
-		pmu_dev->hw_counter_enable_irq(cidx);
-
-	csr_write(CSR_MCOUNTINHIBIT, mctr_inhbt);
 
 	return 0;
 }
 
+static int pmu_ctr_start_hw(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			    uint64_t ival, bool ival_update)
+{
+	unsigned long mctr_inhbt = 0, orig, *inhbt;
+	int ret;
+
+	inhbt = pmu_inhibit_begin(&mctr_inhbt);
+	orig = mctr_inhbt;
+	ret = pmu_ctr_start_hw_batch(phs, cidx, ival, ival_update, inhbt);
+	pmu_inhibit_commit(inhbt, orig);
+
+	return ret;
+}
+
 int sbi_pmu_irq_bit(void)
 {
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
@@ -409,14 +939,36 @@ int sbi_pmu_irq_bit(void)
 	return 0;
 }
 
+/*
+ * Must be called whenever the started firmware counters change.
+ *
+ * The fast paths of the trap entry do not count firmware events so
+ * they are only used while no firmware counter is running.
+ */
+static void pmu_fw_counters_update(struct sbi_pmu_hart_state *phs)
+{
+	int i, slot;
+
+	sbi_memset(phs->fw_event_ctr, 0, sizeof(phs->fw_event_ctr));
+	for (i = SBI_PMU_FW_CTR_MAX - 1; i >= 0; i--) {
+		if (!(phs->fw_counters_started & BIT(i)))
+			continue;
+		slot = pmu_fw_event_slot(
+			get_cidx_code(phs->active_events[num_hw_ctrs + i]));
+		if (slot >= 0)
+			phs->fw_event_ctr[slot] = i + 1;
+	}
+
+	sbi_timer_fast_path_allow(sbi_scratch_thishart_ptr(),
+				  !phs->fw_counters_started);
+}
+
 static int pmu_ctr_start_fw(struct sbi_pmu_hart_state *phs,
 			    uint32_t cidx, uint32_t event_code,
 			    uint64_t event_data, uint64_t ival,
 			    bool ival_update)
 {
-	if ((event_code >= SBI_PMU_FW_MAX &&
-	    event_code <= SBI_PMU_FW_RESERVED_MAX) ||
-	    event_code > SBI_PMU_FW_PLATFORM)
+	if (pmu_fw_event_code_reserved(event_code))
 		return SBI_EINVAL;
 
 	if (SBI_PMU_FW_PLATFORM == event_code) {
@@ -440,6 +992,7 @@ static int pmu_ctr_start_fw(struct sbi_pmu_hart_state *phs,
 	}
 
 	phs->fw_counters_started |= BIT(cidx - num_hw_ctrs);
+	pmu_fw_counters_update(phs);
 
 	return 0;
 }
@@ -458,69 +1011,102 @@ int sbi_pmu_ctr_start(unsigned long cbase, unsigned long cmask,
 	bool bUpdate = false;
 	int i, cidx;
 	uint64_t edata;
+	struct sbi_pmu_snapshot *snap = NULL;
+	unsigned long mctr_inhbt = 0, orig, *inhbt;
 
 	if ((cbase + sbi_fls(cmask)) >= total_ctrs)
 		return ret;
 
-	if (flags & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT)
-		return SBI_ENO_SHMEM;
+	if (flags & SBI_PMU_START_FLAG_INIT_FROM_SNAPSHOT) {
+		if (phs->snapshot_addr == SBI_PMU_SNAPSHOT_INVALID_ADDR)
+			return SBI_ENO_SHMEM;
+		snap = (struct sbi_pmu_snapshot *)phs->snapshot_addr;
+		sbi_hart_map_saddr(phs->snapshot_addr, SBI_PMU_SNAPSHOT_SIZE);
+	}
 
-	if (flags & SBI_PMU_START_FLAG_SET_INIT_VALUE)
+	if (flags & (SBI_PMU_START_FLAG_SET_INIT_VALUE |
+		     SBI_PMU_START_FLAG_INIT_FROM_SNAPSHOT))
 		bUpdate = true;
 
+	inhbt = pmu_inhibit_begin(&mctr_inhbt);
+	orig = mctr_inhbt;
+
 	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
 		cidx = i + cbase;
 		event_idx_type = pmu_ctr_validate(phs, cidx, &event_code);
 		if (event_idx_type < 0)
 			/* Continue the start operation for other counters */
 			continue;
-		else if (event_idx_type == SBI_PMU_EVENT_TYPE_FW) {
+
+		if (snap && i < array_size(snap->ctr_values)) {
+			ival = snap->ctr_values[i];
+			snap->ctr_overflow_mask &= ~BIT_ULL(i);
+		}
+
+		if (pmu_mux_is(phs, cidx)) {
+			ret = pmu_mux_start(phs, cidx, ival, bUpdate);
+		} else if (event_idx_type == SBI_PMU_EVENT_TYPE_FW) {
 			edata = (event_code == SBI_PMU_FW_PLATFORM) ?
 				 phs->fw_counters_data[cidx - num_hw_ctrs]
 				 : 0x0;
 			ret = pmu_ctr_start_fw(phs, cidx, event_code, edata,
 					       ival, bUpdate);
+			phs->fw_counters_overflowed &=
+						~BIT(cidx - num_hw_ctrs);
+		}
+		else {
+			ret = pmu_ctr_start_hw_batch(phs, cidx, ival, bUpdate,
+						     inhbt);
+			phs->hw_counters_overflowed &= ~BIT(cidx);
 		}
-		else
-			ret = pmu_ctr_start_hw(cidx, ival, bUpdate);
 	}
 
+	/* Start all hardware counters at once */
+	pmu_inhibit_commit(inhbt, orig);
+
+	if (snap)
+		sbi_hart_unmap_saddr();
+
 	return ret;
 }
 
-static int pmu_ctr_stop_hw(uint32_t cidx)
+static int pmu_ctr_stop_hw_batch(uint32_t cidx, unsigned long *mctr_inhbt)
 {
-	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
-	unsigned long mctr_inhbt;
-
-	if (sbi_hart_priv_version(scratch) < SBI_HART_PRIV_VER_1_11)
+	if (!mctr_inhbt)
 		return 0;
 
-	mctr_inhbt = csr_read(CSR_MCOUNTINHIBIT);
-
 	/* Make sure the counter index lies within the range and is not TM bit */
 	if (cidx >= num_hw_ctrs || cidx == 1)
 		return SBI_EINVAL;
 
-	if (!__test_bit(cidx, &mctr_inhbt)) {
-		__set_bit(cidx, &mctr_inhbt);
-		csr_write(CSR_MCOUNTINHIBIT, mctr_inhbt);
-		if (pmu_dev && pmu_dev->hw_counter_disable_irq) {
-			pmu_dev->hw_counter_disable_irq(cidx);
-		}
+	if (!__test_bit(cidx, mctr_inhbt)) {
+		__set_bit(cidx, mctr_inhbt);
 		return 0;
 	} else
 		return SBI_EALREADY_STOPPED;
 }
 
+#ifdef CONFIG_SBI_PMU_HW_MUX
+static int pmu_ctr_stop_hw(uint32_t cidx)
+{
+	unsigned long mctr_inhbt = 0, orig, *inhbt;
+	int ret;
+
+	inhbt = pmu_inhibit_begin(&mctr_inhbt);
+	orig = mctr_inhbt;
+	ret = pmu_ctr_stop_hw_batch(cidx, inhbt);
+	pmu_inhibit_commit(inhbt, orig);
+
+	return ret;
+}
+#endif
+
 static int pmu_ctr_stop_fw(struct sbi_pmu_hart_state *phs,
 			   uint32_t cidx, uint32_t event_code)
 {
 	int ret;
 
-	if ((event_code >= SBI_PMU_FW_MAX &&
-	    event_code <= SBI_PMU_FW_RESERVED_MAX) ||
-	    event_code > SBI_PMU_FW_PLATFORM)
+	if (pmu_fw_event_code_reserved(event_code))
 		return SBI_EINVAL;
 
 	if (SBI_PMU_FW_PLATFORM == event_code &&
@@ -531,24 +1117,101 @@ static int pmu_ctr_stop_fw(struct sbi_pmu_hart_state *phs,
 	}
 
 	phs->fw_counters_started &= ~BIT(cidx - num_hw_ctrs);
+	pmu_fw_counters_update(phs);
 
 	return 0;
 }
 
-static int pmu_reset_hw_mhpmevent(int ctr_idx)
+static int pmu_reset_hw_mhpmevent(struct sbi_pmu_hart_state *phs, int ctr_idx)
 {
 	if (ctr_idx < 3 || ctr_idx >= SBI_PMU_HW_CTR_MAX)
 		return SBI_EFAIL;
+
+	pmu_write_mhpmevent(phs, ctr_idx, 0);
+
+	return 0;
+}
+
+static uint64_t pmu_ctr_read_hw(uint32_t cidx)
+{
 #if __riscv_xlen == 32
-	csr_write_num(CSR_MHPMEVENT3 + ctr_idx - 3, 0);
-	if (sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
-				   SBI_HART_EXT_SSCOFPMF))
-		csr_write_num(CSR_MHPMEVENT3H + ctr_idx - 3, 0);
+	uint32_t hi, lo;
+
+	do {
+		hi = csr_read_num(CSR_MCYCLEH + cidx);
+		lo = csr_read_num(CSR_MCYCLE + cidx);
+	} while (hi != csr_read_num(CSR_MCYCLEH + cidx));
+
+	return ((uint64_t)hi << 32) | lo;
 #else
-	csr_write_num(CSR_MHPMEVENT3 + ctr_idx - 3, 0);
+	return csr_read_num(CSR_MCYCLE + cidx);
 #endif
+}
 
-	return 0;
+/* Write the value and the overflow state of a stopped counter */
+static void pmu_snapshot_save(struct sbi_pmu_hart_state *phs,
+			      struct sbi_pmu_snapshot *snap,
+			      unsigned long overflowed, int i, uint32_t cidx)
+{
+	uint64_t val;
+
+	if (i >= array_size(snap->ctr_values))
+		return;
+
+	if (cidx < num_hw_ctrs) {
+		val = pmu_ctr_read_hw(cidx);
+		if (overflowed & BIT(cidx))
+			snap->ctr_overflow_mask |= BIT_ULL(i);
+		else
+			snap->ctr_overflow_mask &= ~BIT_ULL(i);
+	} else if (sbi_pmu_ctr_fw_read(cidx, &val)) {
+		return;
+	} else if (phs->fw_counters_overflowed & BIT(cidx - num_hw_ctrs)) {
+		snap->ctr_overflow_mask |= BIT_ULL(i);
+	} else {
+		snap->ctr_overflow_mask &= ~BIT_ULL(i);
+	}
+
+	snap->ctr_values[i] = val;
+	pmu_mux_snapshot(phs, snap, i, cidx);
+}
+
+int sbi_pmu_snapshot_set_shmem(unsigned long phys_lo, unsigned long phys_hi,
+			       unsigned long flags)
+{
+	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
+
+	if (unlikely(!phs))
+		return SBI_EINVAL;
+
+	if (flags)
+		return SBI_EINVAL;
+
+	if (phys_lo == SBI_PMU_SNAPSHOT_INVALID_ADDR &&
+	    phys_hi == SBI_PMU_SNAPSHOT_INVALID_ADDR) {
+		phs->snapshot_addr = SBI_PMU_SNAPSHOT_INVALID_ADDR;
+		return SBI_OK;
+	}
+
+	if (phys_lo & (SBI_PMU_SNAPSHOT_SIZE - 1))
+		return SBI_EINVAL;
+
+	/* M-mode can't access memory above XLEN bits of address */
+	if (phys_hi)
+		return SBI_EINVALID_ADDR;
+
+	if (!sbi_domain_check_addr_range(sbi_domain_thishart_ptr(), phys_lo,
+					 SBI_PMU_SNAPSHOT_SIZE, PRV_S,
+					 SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_EINVALID_ADDR;
+
+	sbi_hart_map_saddr(phys_lo, SBI_PMU_SNAPSHOT_SIZE);
+	sbi_memset((void *)phys_lo, 0, SBI_PMU_SNAPSHOT_SIZE);
+	sbi_hart_unmap_saddr();
+
+	phs->snapshot_addr = phys_lo;
+
+	return SBI_OK;
 }
 
 int sbi_pmu_ctr_stop(unsigned long cbase, unsigned long cmask,
@@ -563,12 +1226,26 @@ int sbi_pmu_ctr_stop(unsigned long cbase, unsigned long cmask,
 	int event_idx_type;
 	uint32_t event_code;
 	int i, cidx;
+	struct sbi_pmu_snapshot *snap = NULL;
+	unsigned long overflowed = 0, stopped = 0;
+	unsigned long mctr_inhbt = 0, orig, *inhbt;
 
 	if ((cbase + sbi_fls(cmask)) >= total_ctrs)
 		return SBI_EINVAL;
 
-	if (flag & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT)
-		return SBI_ENO_SHMEM;
+	if (flag & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT) {
+		if (phs->snapshot_addr == SBI_PMU_SNAPSHOT_INVALID_ADDR)
+			return SBI_ENO_SHMEM;
+		snap = (struct sbi_pmu_snapshot *)phs->snapshot_addr;
+		overflowed = phs->hw_counters_overflowed;
+		if (sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
+					   SBI_HART_EXT_SSCOFPMF))
+			overflowed |= csr_read(CSR_SCOUNTOVF);
+		sbi_hart_map_saddr(phs->snapshot_addr, SBI_PMU_SNAPSHOT_SIZE);
+	}
+
+	inhbt = pmu_inhibit_begin(&mctr_inhbt);
+	orig = mctr_inhbt;
 
 	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
 		cidx = i + cbase;
@@ -577,17 +1254,35 @@ int sbi_pmu_ctr_stop(unsigned long cbase, unsigned long cmask,
 			/* Continue the stop operation for other counters */
 			continue;
 
+		else if (pmu_mux_is(phs, cidx))
+			ret = pmu_mux_stop(phs, cidx);
 		else if (event_idx_type == SBI_PMU_EVENT_TYPE_FW)
 			ret = pmu_ctr_stop_fw(phs, cidx, event_code);
 		else
-			ret = pmu_ctr_stop_hw(cidx);
+			ret = pmu_ctr_stop_hw_batch(cidx, inhbt);
+		stopped |= BIT(i);
+	}
+
+	/* Stop all hardware counters at once before saving their values */
+	pmu_inhibit_commit(inhbt, orig);
+
+	for_each_set_bit(i, &stopped, BITS_PER_LONG) {
+		cidx = i + cbase;
+
+		/* Saved before a reset makes the counter invalid */
+		if (snap)
+			pmu_snapshot_save(phs, snap, overflowed, i, cidx);
 
 		if (cidx > (CSR_INSTRET - CSR_CYCLE) && flag & SBI_PMU_STOP_FLAG_RESET) {
 			phs->active_events[cidx] = SBI_PMU_EVENT_IDX_INVALID;
-			pmu_reset_hw_mhpmevent(cidx);
+			pmu_reset_hw_mhpmevent(phs, cidx);
+			pmu_mux_free(phs, cidx);
 		}
 	}
 
+	if (snap)
+		sbi_hart_unmap_saddr();
+
 	/* Clear MIP_LCOFIP to avoid spurious interrupts */
 	if (phs->sse_enabled)
 		csr_clear(CSR_MIP, MIP_LCOFIP);
@@ -607,7 +1302,7 @@ static void pmu_update_inhibit_flags(unsigned long flags, uint64_t *mhpmevent_va
 		*mhpmevent_val |= MHPMEVENT_SINH;
 }
 
-static int pmu_update_hw_mhpmevent(struct sbi_pmu_hw_event *hw_evt, int ctr_idx,
+static int pmu_update_hw_mhpmevent(struct sbi_pmu_hart_state *phs, int ctr_idx,
 				   unsigned long flags, unsigned long eindex,
 				   uint64_t data)
 {
@@ -629,8 +1324,7 @@ static int pmu_update_hw_mhpmevent(struct sbi_pmu_hw_event *hw_evt, int ctr_idx,
 		mhpmevent_val = (mhpmevent_val & ~MHPMEVENT_SSCOF_MASK) |
 				 MHPMEVENT_MINH | MHPMEVENT_OF;
 
-	if (pmu_dev && pmu_dev->hw_counter_disable_irq)
-		pmu_dev->hw_counter_disable_irq(ctr_idx);
+	pmu_dev_disable_irq(BIT(ctr_idx));
 
 	/* Update the inhibit flags based on inhibit flags received from supervisor */
 	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SSCOFPMF))
@@ -638,14 +1332,7 @@ static int pmu_update_hw_mhpmevent(struct sbi_pmu_hw_event *hw_evt, int ctr_idx,
 	if (pmu_dev && pmu_dev->hw_counter_filter_mode)
 		pmu_dev->hw_counter_filter_mode(flags, ctr_idx);
 
-#if __riscv_xlen == 32
-	csr_write_num(CSR_MHPMEVENT3 + ctr_idx - 3, mhpmevent_val & 0xFFFFFFFF);
-	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SSCOFPMF))
-		csr_write_num(CSR_MHPMEVENT3H + ctr_idx - 3,
-			      mhpmevent_val >> BITS_PER_LONG);
-#else
-	csr_write_num(CSR_MHPMEVENT3 + ctr_idx - 3, mhpmevent_val);
-#endif
+	pmu_write_mhpmevent(phs, ctr_idx, mhpmevent_val);
 
 	return 0;
 }
@@ -704,14 +1391,179 @@ static int pmu_ctr_find_fixed_hw(unsigned long evt_idx_code)
 		return SBI_EINVAL;
 }
 
+static bool pmu_hw_event_match(const struct sbi_pmu_hw_event *temp,
+			       unsigned long event_idx, uint64_t data)
+{
+	if ((temp->start_idx > event_idx && event_idx < temp->end_idx) ||
+	    (temp->start_idx < event_idx && event_idx > temp->end_idx))
+		return false;
+
+	/* For raw events, event data is used as the select value */
+	if (event_idx == SBI_PMU_EVENT_RAW_IDX) {
+		uint64_t select_mask = temp->select_mask;
+
+		/* The non-event map bits of data should match the selector */
+		if (temp->select != (data & select_mask))
+			return false;
+	}
+
+	return true;
+}
+
+static bool pmu_hw_raw_before(const struct sbi_pmu_hw_event *a,
+			      const struct sbi_pmu_hw_event *b)
+{
+	if (a->select_mask != b->select_mask)
+		return a->select_mask < b->select_mask;
+
+	return a->select < b->select;
+}
+
+static void pmu_hw_event_sort(struct sbi_pmu_hw_event **evts, uint32_t count,
+			      bool raw)
+{
+	struct sbi_pmu_hw_event *evt;
+	uint32_t i, j;
+
+	for (i = 1; i < count; i++) {
+		evt = evts[i];
+		for (j = i; j > 0; j--) {
+			if (raw ? !pmu_hw_raw_before(evt, evts[j - 1]) :
+				  evts[j - 1]->start_idx <= evt->start_idx)
+				break;
+			evts[j] = evts[j - 1];
+		}
+		evts[j] = evt;
+	}
+}
+
+static void pmu_hw_event_index_build(void)
+{
+	struct sbi_pmu_hw_event *evt;
+	uint32_t i;
+
+	sbi_free(hw_event_ranges);
+	sbi_free(hw_event_raws);
+	hw_event_ranges = hw_event_raws = NULL;
+	num_hw_event_ranges = num_hw_event_raws = 0;
+	hw_event_index_gen = -1U;
+	if (!num_hw_events)
+		return;
+
+	hw_event_ranges = sbi_calloc(sizeof(*hw_event_ranges), num_hw_events);
+	hw_event_raws = sbi_calloc(sizeof(*hw_event_raws), num_hw_events);
+	if (!hw_event_ranges || !hw_event_raws) {
+		/* Lookups keep scanning hw_event_map */
+		sbi_free(hw_event_ranges);
+		sbi_free(hw_event_raws);
+		hw_event_ranges = hw_event_raws = NULL;
+		return;
+	}
+
+	for (i = 0; i < num_hw_events; i++) {
+		evt = &hw_event_map[i];
+		if (evt->start_idx == SBI_PMU_EVENT_RAW_IDX)
+			hw_event_raws[num_hw_event_raws++] = evt;
+		else
+			hw_event_ranges[num_hw_event_ranges++] = evt;
+	}
+	pmu_hw_event_sort(hw_event_ranges, num_hw_event_ranges, false);
+	pmu_hw_event_sort(hw_event_raws, num_hw_event_raws, true);
+
+	hw_event_index_gen = hw_event_map_gen;
+}
+
+static unsigned long pmu_hw_event_index_lookup(unsigned long event_idx,
+					       uint64_t data)
+{
+	uint32_t lo, hi, mid, end, i = 0;
+	unsigned long counters = 0;
+	uint64_t mask;
+
+	if (event_idx != SBI_PMU_EVENT_RAW_IDX) {
+		/* Ranges don't overlap, find the last starting at or below */
+		lo = 0;
+		hi = num_hw_event_ranges;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (hw_event_ranges[mid]->start_idx <= event_idx)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo && event_idx <= hw_event_ranges[lo - 1]->end_idx)
+			counters = hw_event_ranges[lo - 1]->counters;
+		return counters;
+	}
+
+	/* Search the select values of every distinct select mask */
+	while (i < num_hw_event_raws) {
+		mask = hw_event_raws[i]->select_mask;
+		lo = i;
+		hi = num_hw_event_raws;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (hw_event_raws[mid]->select_mask <= mask)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		end = lo;
+
+		lo = i;
+		hi = end;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (hw_event_raws[mid]->select < (data & mask))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo < end && hw_event_raws[lo]->select == (data & mask))
+			counters |= hw_event_raws[lo]->counters;
+
+		i = end;
+	}
+
+	return counters;
+}
+
+/* Counters of all hw_event_map entries which can count the event */
+static unsigned long pmu_hw_event_counters(struct sbi_pmu_hart_state *phs,
+					   unsigned long event_idx,
+					   uint64_t data)
+{
+	unsigned long counters = 0;
+	uint32_t i;
+
+	if (phs->memo_gen == hw_event_map_gen &&
+	    phs->memo_event_idx == event_idx && phs->memo_data == data)
+		return phs->memo_counters;
+
+	if (hw_event_index_gen == hw_event_map_gen) {
+		counters = pmu_hw_event_index_lookup(event_idx, data);
+	} else {
+		for (i = 0; i < num_hw_events; i++) {
+			if (pmu_hw_event_match(&hw_event_map[i], event_idx, data))
+				counters |= hw_event_map[i].counters;
+		}
+	}
+
+	phs->memo_event_idx = event_idx;
+	phs->memo_data = data;
+	phs->memo_counters = counters;
+	phs->memo_gen = hw_event_map_gen;
+
+	return counters;
+}
+
 static int pmu_ctr_find_hw(struct sbi_pmu_hart_state *phs,
 			   unsigned long cbase, unsigned long cmask,
 			   unsigned long flags,
 			   unsigned long event_idx, uint64_t data)
 {
 	unsigned long ctr_mask;
-	int i, ret = 0, fixed_ctr, ctr_idx = SBI_ENOTSUPP;
-	struct sbi_pmu_hw_event *temp;
+	int ret = 0, fixed_ctr, ctr_idx = SBI_ENOTSUPP;
 	unsigned long mctr_inhbt = 0;
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 
@@ -729,37 +1581,23 @@ static int pmu_ctr_find_hw(struct sbi_pmu_hart_state *phs,
 
 	if (sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_11)
 		mctr_inhbt = csr_read(CSR_MCOUNTINHIBIT);
-	for (i = 0; i < num_hw_events; i++) {
-		temp = &hw_event_map[i];
-		if ((temp->start_idx > event_idx && event_idx < temp->end_idx) ||
-		    (temp->start_idx < event_idx && event_idx > temp->end_idx))
+	/* Fixed counters should not be part of the search */
+	ctr_mask = pmu_hw_event_counters(phs, event_idx, data) &
+		   (cmask << cbase) & (~SBI_PMU_FIXED_CTR_MASK) &
+		   ~pmu_mux_pool(phs);
+	for_each_set_bit_from(cbase, &ctr_mask, SBI_PMU_HW_CTR_MAX) {
+		/**
+		 * Some of the platform may not support mcountinhibit.
+		 * Checking the active_events is enough for them
+		 */
+		if (phs->active_events[cbase] != SBI_PMU_EVENT_IDX_INVALID)
 			continue;
-
-		/* For raw events, event data is used as the select value */
-		if (event_idx == SBI_PMU_EVENT_RAW_IDX) {
-			uint64_t select_mask = temp->select_mask;
-
-			/* The non-event map bits of data should match the selector */
-			if (temp->select != (data & select_mask))
-				continue;
-		}
-		/* Fixed counters should not be part of the search */
-		ctr_mask = temp->counters & (cmask << cbase) &
-			   (~SBI_PMU_FIXED_CTR_MASK);
-		for_each_set_bit_from(cbase, &ctr_mask, SBI_PMU_HW_CTR_MAX) {
-			/**
-			 * Some of the platform may not support mcountinhibit.
-			 * Checking the active_events is enough for them
-			 */
-			if (phs->active_events[cbase] != SBI_PMU_EVENT_IDX_INVALID)
-				continue;
-			/* If mcountinhibit is supported, the bit must be enabled */
-			if ((sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_11) &&
-			    !__test_bit(cbase, &mctr_inhbt))
-				continue;
-			/* We found a valid counter that is not started yet */
-			ctr_idx = cbase;
-		}
+		/* If mcountinhibit is supported, the bit must be enabled */
+		if ((sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_11) &&
+		    !__test_bit(cbase, &mctr_inhbt))
+			continue;
+		/* We found a valid counter that is not started yet */
+		ctr_idx = cbase;
 	}
 
 	if (ctr_idx == SBI_ENOTSUPP) {
@@ -772,7 +1610,7 @@ static int pmu_ctr_find_hw(struct sbi_pmu_hart_state *phs,
 		else
 			return SBI_EFAIL;
 	}
-	ret = pmu_update_hw_mhpmevent(temp, ctr_idx, flags, event_idx, data);
+	ret = pmu_update_hw_mhpmevent(phs, ctr_idx, flags, event_idx, data);
 
 	if (!ret)
 		ret = ctr_idx;
@@ -792,9 +1630,7 @@ static int pmu_ctr_find_fw(struct sbi_pmu_hart_state *phs,
 {
 	int i, cidx;
 
-	if ((event_code >= SBI_PMU_FW_MAX &&
-	    event_code <= SBI_PMU_FW_RESERVED_MAX) ||
-	    event_code > SBI_PMU_FW_PLATFORM)
+	if (pmu_fw_event_code_reserved(event_code))
 		return SBI_EINVAL;
 
 	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
@@ -817,6 +1653,63 @@ static int pmu_ctr_find_fw(struct sbi_pmu_hart_state *phs,
 	return SBI_ENOTSUPP;
 }
 
+/* Whether sbi_pmu_ctr_cfg_match() can ever find a counter for the event */
+static bool pmu_event_supported(struct sbi_pmu_hart_state *phs,
+				unsigned long event_idx, uint64_t data)
+{
+	int event_type;
+
+	event_type = pmu_event_validate(phs, event_idx, data);
+	if (event_type < 0)
+		return false;
+
+	if (event_type == SBI_PMU_EVENT_TYPE_FW)
+		return total_ctrs > num_hw_ctrs;
+
+	if (pmu_ctr_find_fixed_hw(event_idx) >= 0)
+		return true;
+
+	return (pmu_hw_event_counters(phs, event_idx, data) &
+		~SBI_PMU_FIXED_CTR_MASK) != 0;
+}
+
+int sbi_pmu_event_get_info(unsigned long phys_lo, unsigned long phys_hi,
+			   unsigned long num_events, unsigned long flags)
+{
+	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
+	struct sbi_pmu_event_info *einfo;
+	unsigned long i, size;
+
+	if (unlikely(!phs))
+		return SBI_EINVAL;
+
+	if (flags || !num_events ||
+	    num_events > (-1UL / sizeof(*einfo)) ||
+	    (phys_lo & (SBI_PMU_EVENT_INFO_ALIGN - 1)))
+		return SBI_EINVAL;
+
+	/* M-mode can't access memory above XLEN bits of address */
+	if (phys_hi)
+		return SBI_EINVALID_ADDR;
+
+	size = num_events * sizeof(*einfo);
+	if (!sbi_domain_check_addr_range(sbi_domain_thishart_ptr(), phys_lo,
+					 size, PRV_S,
+					 SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_EINVALID_ADDR;
+
+	einfo = (struct sbi_pmu_event_info *)phys_lo;
+	sbi_hart_map_saddr(phys_lo, size);
+	for (i = 0; i < num_events; i++) {
+		einfo[i].output = pmu_event_supported(phs, einfo[i].event_idx,
+						      einfo[i].event_data) ?
+				  SBI_PMU_EVENT_INFO_SUPPORTED : 0;
+	}
+	sbi_hart_unmap_saddr();
+
+	return SBI_OK;
+}
+
 int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 			  unsigned long flags, unsigned long event_idx,
 			  uint64_t event_data)
@@ -864,6 +1757,9 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 	} else {
 		ctr_idx = pmu_ctr_find_hw(phs, cidx_base, cidx_mask, flags,
 					  event_idx, event_data);
+		if (ctr_idx < 0)
+			ctr_idx = pmu_mux_alloc(phs, cidx_base, cidx_mask,
+						flags, event_idx, event_data);
 	}
 
 	if (ctr_idx < 0)
@@ -871,11 +1767,16 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 
 	phs->active_events[ctr_idx] = event_idx;
 skip_match:
-	if (event_type == SBI_PMU_EVENT_TYPE_HW) {
+	if (pmu_mux_is(phs, ctr_idx)) {
+		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
+			phs->fw_counters_data[ctr_idx - num_hw_ctrs] = 0;
+		if (flags & SBI_PMU_CFG_FLAG_AUTO_START)
+			pmu_mux_start(phs, ctr_idx, 0, false);
+	} else if (event_type == SBI_PMU_EVENT_TYPE_HW) {
 		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
 			pmu_ctr_write_hw(ctr_idx, 0);
 		if (flags & SBI_PMU_CFG_FLAG_AUTO_START)
-			pmu_ctr_start_hw(ctr_idx, 0, false);
+			pmu_ctr_start_hw(phs, ctr_idx, 0, false);
 	} else if (event_type == SBI_PMU_EVENT_TYPE_FW) {
 		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
 			phs->fw_counters_data[ctr_idx - num_hw_ctrs] = 0;
@@ -889,16 +1790,93 @@ skip_match:
 					return ret;
 			}
 			phs->fw_counters_started |= BIT(ctr_idx - num_hw_ctrs);
+			pmu_fw_counters_update(phs);
 		}
 	}
 
 	return ctr_idx;
 }
 
-int sbi_pmu_ctr_incr_fw(enum sbi_pmu_fw_event_code_id fw_id)
+/*
+ * Firmware counters overflow like the hardware counters when they wrap
+ * around so supervisor software samples by starting them with the two's
+ * complement of the sampling period.
+ */
+static void pmu_fw_ctr_overflow(struct sbi_pmu_hart_state *phs, int i)
+{
+	struct sbi_trap_context *tcntx =
+			sbi_trap_get_context(sbi_scratch_thishart_ptr());
+	struct sbi_pmu_sample *sample;
+
+	phs->fw_counters_overflowed |= BIT(i);
+
+	if (phs->fw_samples_pending == PMU_FW_SAMPLE_PENDING) {
+		phs->fw_samples_lost++;
+		return;
+	}
+
+	sample = &phs->fw_samples[phs->fw_samples_pending++];
+	sample->pc = tcntx ? tcntx->regs.mepc : 0;
+	sample->time = sbi_timer_value();
+	sample->ctr_idx = num_hw_ctrs + i;
+	sample->event_idx = phs->active_events[num_hw_ctrs + i];
+}
+
+/*
+ * Write the pending overflow samples to the snapshot memory and notify
+ * the supervisor. Called at the exit of the outermost trap since shared
+ * memory may already be mapped for M-mode where the overflow happened.
+ */
+void sbi_pmu_fw_samples_flush(void)
 {
-	u32 cidx;
-	uint64_t *fcounter = NULL;
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct sbi_pmu_hart_state *phs = pmu_get_hart_state_ptr(scratch);
+	struct sbi_pmu_snapshot *snap;
+	unsigned int i;
+	uint64_t head;
+
+	if (unlikely(!phs))
+		return;
+
+	if (likely(!phs->fw_samples_pending && !phs->fw_samples_lost))
+		return;
+
+	if (phs->snapshot_addr != SBI_PMU_SNAPSHOT_INVALID_ADDR) {
+		snap = (struct sbi_pmu_snapshot *)phs->snapshot_addr;
+		sbi_hart_map_saddr(phs->snapshot_addr, SBI_PMU_SNAPSHOT_SIZE);
+
+		head = snap->sample_head;
+		for (i = 0; i < phs->fw_samples_pending; i++) {
+			if (head - snap->sample_tail >= SBI_PMU_SAMPLE_MAX) {
+				phs->fw_samples_lost++;
+				continue;
+			}
+			sbi_memcpy(&snap->samples[head % SBI_PMU_SAMPLE_MAX],
+				   &phs->fw_samples[i], sizeof(phs->fw_samples[i]));
+			head++;
+		}
+		snap->sample_lost += phs->fw_samples_lost;
+
+		/* Samples are visible before the supervisor sees the head */
+		smp_wmb();
+		snap->sample_head = head;
+
+		sbi_hart_unmap_saddr();
+	}
+
+	phs->fw_samples_pending = 0;
+	phs->fw_samples_lost = 0;
+
+	if (phs->sse_enabled)
+		sbi_sse_inject_event(SBI_SSE_EVENT_LOCAL_PMU);
+	else if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SSCOFPMF))
+		csr_set(CSR_MIP, MIP_LCOFIP);
+}
+
+int sbi_pmu_ctr_add_fw(uint32_t fw_id, uint64_t count)
+{
+	u32 fw_idx;
+	int slot;
 	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
 
 	if (unlikely(!phs))
@@ -907,19 +1885,17 @@ int sbi_pmu_ctr_incr_fw(enum sbi_pmu_fw_event_code_id fw_id)
 	if (likely(!phs->fw_counters_started))
 		return 0;
 
-	if (unlikely(fw_id >= SBI_PMU_FW_MAX))
+	slot = pmu_fw_event_slot(fw_id);
+	if (unlikely(slot < 0))
 		return SBI_EINVAL;
 
-	for (cidx = num_hw_ctrs; cidx < total_ctrs; cidx++) {
-		if (get_cidx_code(phs->active_events[cidx]) == fw_id &&
-		    (phs->fw_counters_started & BIT(cidx - num_hw_ctrs))) {
-			fcounter = &phs->fw_counters_data[cidx - num_hw_ctrs];
-			break;
-		}
-	}
+	fw_idx = phs->fw_event_ctr[slot];
+	if (!fw_idx)
+		return 0;
 
-	if (fcounter)
-		(*fcounter)++;
+	phs->fw_counters_data[fw_idx - 1] += count;
+	if (unlikely(phs->fw_counters_data[fw_idx - 1] < count))
+		pmu_fw_ctr_overflow(phs, fw_idx - 1);
 
 	return 0;
 }
@@ -979,7 +1955,15 @@ static void pmu_reset_event_map(struct sbi_pmu_hart_state *phs)
 	for (j = 0; j < SBI_PMU_FW_CTR_MAX; j++)
 		phs->fw_counters_data[j] = 0;
 	phs->fw_counters_started = 0;
+	sbi_memset(phs->fw_event_ctr, 0, sizeof(phs->fw_event_ctr));
 	phs->sse_enabled = 0;
+	phs->snapshot_addr = SBI_PMU_SNAPSHOT_INVALID_ADDR;
+	phs->hw_counters_overflowed = 0;
+	phs->fw_counters_overflowed = 0;
+	phs->mhpmevent_valid = 0;
+	phs->fw_samples_pending = 0;
+	phs->fw_samples_lost = 0;
+	pmu_mux_reset(phs);
 }
 
 const struct sbi_pmu_device *sbi_pmu_get_device(void)
@@ -1055,7 +2039,7 @@ int sbi_pmu_init(struct sbi_scratch *scratch, bool cold_boot)
 		if (!hw_event_map)
 			return SBI_ENOMEM;
 
-		phs_ptr_offset = sbi_scratch_alloc_type_offset(void *);
+		phs_ptr_offset = sbi_scratch_alloc_hot_offset(sizeof(void *));
 		if (!phs_ptr_offset) {
 			sbi_free(hw_event_map);
 			return SBI_ENOMEM;
@@ -1079,20 +2063,29 @@ int sbi_pmu_init(struct sbi_scratch *scratch, bool cold_boot)
 			return SBI_EINVAL;
 
 		total_ctrs = num_hw_ctrs + SBI_PMU_FW_CTR_MAX;
+
+		pmu_hw_event_index_build();
 	}
 
 	sbi_sse_set_cb_ops(SBI_SSE_EVENT_LOCAL_PMU, &pmu_sse_cb_ops);
 
 	phs = pmu_get_hart_state_ptr(scratch);
 	if (!phs) {
-		phs = sbi_zalloc(sizeof(*phs));
+		/* Not sharing cache lines with the state of other harts */
+		phs = sbi_aligned_alloc_local(SBI_CACHE_LINE_SIZE,
+				ROUNDUP(sizeof(*phs), SBI_CACHE_LINE_SIZE));
 		if (!phs)
 			return SBI_ENOMEM;
+		sbi_memset(phs, 0, sizeof(*phs));
 		phs->hartid = current_hartid();
 		pmu_set_hart_state_ptr(scratch, phs);
 	}
 
 	pmu_reset_event_map(phs);
+	pmu_mux_init(scratch, phs);
+
+	/* A started hart has no snapshot shared memory until it sets one */
+	phs->snapshot_addr = SBI_PMU_SNAPSHOT_INVALID_ADDR;
 
 	/* First three counters are fixed by the priv spec and we enable it by default */
 	phs->active_events[0] = (SBI_PMU_EVENT_TYPE_HW << SBI_PMU_EVENT_IDX_TYPE_OFFSET) |
@@ -8,8 +8,10 @@
  */
 
 #include <sbi/riscv_locks.h>
+#include <sbi/sbi_error.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_hartmask.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
@@ -19,19 +21,112 @@ u32 hartindex_to_hartid_table[SBI_HARTMASK_MAX_BITS + 1] = { -1U };
 struct sbi_scratch *hartindex_to_scratch_table[SBI_HARTMASK_MAX_BITS + 1] = { 0 };
 
 static spinlock_t extra_lock = SPIN_LOCK_INITIALIZER;
-static unsigned long extra_offset = SBI_SCRATCH_EXTRA_SPACE_OFFSET;
+static unsigned long hot_offset = SBI_SCRATCH_EXTRA_SPACE_OFFSET;
+static unsigned long extra_offset = SBI_SCRATCH_EXTRA_SPACE_OFFSET +
+				    SBI_SCRATCH_HOT_SPACE_SIZE;
+
+unsigned long sbi_scratch_ext_area_offset;
+static unsigned long ext_offset = __SIZEOF_POINTER__;
+
+/*
+ * Reverse of hartindex_to_hartid_table. If all HART ids are below
+ * SBI_HARTMASK_MAX_BITS it is indexed by HART id, otherwise it holds
+ * the HART indices sorted by HART id for a binary search.
+ */
+static u32 hartid_lookup_table[SBI_HARTMASK_MAX_BITS];
+static bool hartid_lookup_direct;
+
+/* HART ids below this limit are equal to their HART index */
+static u32 hartid_identity_limit;
 
 u32 sbi_hartid_to_hartindex(u32 hartid)
 {
-	u32 i;
+	u32 lo = 0, hi = last_hartindex_having_scratch + 1, mid, i;
+
+	if (hartid_lookup_direct)
+		return (hartid < SBI_HARTMASK_MAX_BITS) ?
+			hartid_lookup_table[hartid] : -1U;
 
-	for (i = 0; i <= last_hartindex_having_scratch; i++)
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		i = hartid_lookup_table[mid];
 		if (hartindex_to_hartid_table[i] == hartid)
 			return i;
+		if (hartindex_to_hartid_table[i] < hartid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
 	return -1U;
 }
 
+void sbi_hartmask_set_hmask(ulong hmask, ulong hbase, struct sbi_hartmask *m)
+{
+	ulong *bits = sbi_hartmask_bits(m);
+	ulong high;
+	u32 off;
+
+	if (!hmask)
+		return;
+
+	/* HART ids equal to their HART index map a whole word at once */
+	if (hbase < hartid_identity_limit &&
+	    sbi_fls(hmask) < hartid_identity_limit - hbase) {
+		off = BIT_WORD_OFFSET(hbase);
+		bits[BIT_WORD(hbase)] |= hmask << off;
+		/* Only the bits shifted out spill into the next word */
+		high = off ? hmask >> (BITS_PER_LONG - off) : 0;
+		if (high && BIT_WORD(hbase) + 1 <
+			    BITS_TO_LONGS(SBI_HARTMASK_MAX_BITS))
+			bits[BIT_WORD(hbase) + 1] |= high;
+		return;
+	}
+
+	while (hmask) {
+		off = sbi_ffs(hmask);
+		hmask &= hmask - 1;
+		sbi_hartmask_set_hartid(hbase + off, m);
+	}
+}
+
+static void hartid_lookup_init(u32 hart_count)
+{
+	u32 *ids = hartindex_to_hartid_table;
+	u32 i, j, h;
+
+	hartid_lookup_direct = true;
+	for (i = 0; i < hart_count; i++) {
+		if (ids[i] >= SBI_HARTMASK_MAX_BITS)
+			hartid_lookup_direct = false;
+	}
+
+	hartid_identity_limit = 0;
+	while (hartid_identity_limit < hart_count &&
+	       ids[hartid_identity_limit] == hartid_identity_limit)
+		hartid_identity_limit++;
+
+	if (hartid_lookup_direct) {
+		for (i = 0; i < SBI_HARTMASK_MAX_BITS; i++)
+			hartid_lookup_table[i] = -1U;
+		/* The lowest HART index wins for duplicated HART ids */
+		for (i = hart_count; i > 0; i--)
+			hartid_lookup_table[ids[i - 1]] = i - 1;
+		return;
+	}
+
+	/* Stable insertion sort, done once at cold boot */
+	for (i = 0; i < hart_count; i++) {
+		h = ids[i];
+		for (j = i; j > 0; j--) {
+			if (ids[hartid_lookup_table[j - 1]] <= h)
+				break;
+			hartid_lookup_table[j] = hartid_lookup_table[j - 1];
+		}
+		hartid_lookup_table[j] = i;
+	}
+}
+
 typedef struct sbi_scratch *(*hartid2scratch)(ulong hartid, ulong hartindex);
 
 int sbi_scratch_init(struct sbi_scratch *scratch)
@@ -47,16 +142,59 @@ int sbi_scratch_init(struct sbi_scratch *scratch)
 	}
 
 	last_hartindex_having_scratch = plat->hart_count - 1;
+	hartid_lookup_init(plat->hart_count);
 
-	return 0;
+	/* Queue nodes of qspinlock_t live in the scratch space */
+	return qspin_lock_init();
 }
 
-unsigned long sbi_scratch_alloc_offset(unsigned long size)
+static void scratch_clear_offset(unsigned long offset, unsigned long size)
 {
+	struct sbi_scratch *rscratch;
 	u32 i;
-	void *ptr;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+		sbi_memset(sbi_scratch_offset_ptr(rscratch, offset), 0, size);
+	}
+}
+
+unsigned long sbi_scratch_alloc_offset(unsigned long size)
+{
+	return sbi_scratch_alloc_aligned_offset(size, __SIZEOF_POINTER__);
+}
+
+unsigned long sbi_scratch_alloc_hot_offset(unsigned long size)
+{
+	unsigned long ret = 0;
+
+	if (!size)
+		return 0;
+
+	size = ROUNDUP(size, __SIZEOF_POINTER__);
+
+	spin_lock(&extra_lock);
+	if (hot_offset + size <=
+	    SBI_SCRATCH_EXTRA_SPACE_OFFSET + SBI_SCRATCH_HOT_SPACE_SIZE) {
+		ret = hot_offset;
+		hot_offset += size;
+	}
+	spin_unlock(&extra_lock);
+
+	if (!ret)
+		return sbi_scratch_alloc_offset(size);
+
+	scratch_clear_offset(ret, size);
+
+	return ret;
+}
+
+unsigned long sbi_scratch_alloc_aligned_offset(unsigned long size,
+					       unsigned long align)
+{
 	unsigned long ret = 0;
-	struct sbi_scratch *rscratch;
 
 	/*
 	 * We have a simple brain-dead allocator which never expects
@@ -67,32 +205,28 @@ unsigned long sbi_scratch_alloc_offset(unsigned long size)
 	 * will allow us to re-claim free-ed space.
 	 */
 
-	if (!size)
+	if (!size || (align & (align - 1)))
 		return 0;
 
-	size += __SIZEOF_POINTER__ - 1;
-	size &= ~((unsigned long)__SIZEOF_POINTER__ - 1);
+	if (align < __SIZEOF_POINTER__)
+		align = __SIZEOF_POINTER__;
+
+	size += align - 1;
+	size &= ~(align - 1);
 
 	spin_lock(&extra_lock);
 
-	if (SBI_SCRATCH_SIZE < (extra_offset + size))
+	if (SBI_SCRATCH_SIZE < (ROUNDUP(extra_offset, align) + size))
 		goto done;
 
-	ret = extra_offset;
-	extra_offset += size;
+	ret = ROUNDUP(extra_offset, align);
+	extra_offset = ret + size;
 
 done:
 	spin_unlock(&extra_lock);
 
-	if (ret) {
-		for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
-			rscratch = sbi_hartindex_to_scratch(i);
-			if (!rscratch)
-				continue;
-			ptr = sbi_scratch_offset_ptr(rscratch, ret);
-			sbi_memset(ptr, 0, size);
-		}
-	}
+	if (ret)
+		scratch_clear_offset(ret, size);
 
 	return ret;
 }
@@ -114,8 +248,83 @@ unsigned long sbi_scratch_used_space(void)
 	unsigned long ret = 0;
 
 	spin_lock(&extra_lock);
-	ret = extra_offset;
+	ret = extra_offset - (SBI_SCRATCH_EXTRA_SPACE_OFFSET +
+			      SBI_SCRATCH_HOT_SPACE_SIZE - hot_offset);
+	spin_unlock(&extra_lock);
+
+	return ret;
+}
+
+unsigned long sbi_scratch_alloc_ext_offset(unsigned long size,
+					   unsigned long align)
+{
+	unsigned long ret = 0;
+
+	/* Offset zero stays unused so that it can signal failure */
+	if (!sbi_scratch_ext_area_offset || !size || (align & (align - 1)))
+		return 0;
+
+	if (align < __SIZEOF_POINTER__)
+		align = __SIZEOF_POINTER__;
+
+	size = ROUNDUP(size, align);
+
+	spin_lock(&extra_lock);
+	if (ROUNDUP(ext_offset, align) + size <= CONFIG_SBI_SCRATCH_EXT_SIZE) {
+		ret = ROUNDUP(ext_offset, align);
+		ext_offset = ret + size;
+	}
 	spin_unlock(&extra_lock);
 
+	/* The areas are zeroed once and never handed out twice */
 	return ret;
 }
+
+unsigned long sbi_scratch_ext_used_space(void)
+{
+	unsigned long ret;
+
+	if (!sbi_scratch_ext_area_offset)
+		return 0;
+
+	spin_lock(&extra_lock);
+	ret = ext_offset;
+	spin_unlock(&extra_lock);
+
+	return ret;
+}
+
+int sbi_scratch_ext_init(void)
+{
+	unsigned long stride, off;
+	struct sbi_scratch *rscratch;
+	char *area;
+	u32 i;
+
+	if (!CONFIG_SBI_SCRATCH_EXT_SIZE)
+		return 0;
+
+	/* Areas of different HARTs do not share cache lines */
+	stride = ROUNDUP(CONFIG_SBI_SCRATCH_EXT_SIZE, SBI_CACHE_LINE_SIZE);
+	area = sbi_aligned_alloc(SBI_CACHE_LINE_SIZE,
+				 stride * (sbi_scratch_last_hartindex() + 1));
+	if (!area)
+		return SBI_ENOMEM;
+	sbi_memset(area, 0, stride * (sbi_scratch_last_hartindex() + 1));
+
+	off = sbi_scratch_alloc_hot_offset(sizeof(char *));
+	if (!off) {
+		sbi_free(area);
+		return SBI_ENOMEM;
+	}
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (rscratch)
+			sbi_scratch_write_type(rscratch, char *, off,
+					       area + i * stride);
+	}
+	sbi_scratch_ext_area_offset = off;
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Lock-free single-producer/single-consumer bounded FIFO
+ */
+
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_spsc_fifo.h>
+#include <sbi/sbi_string.h>
+
+static inline void spsc_fifo_copy(void *dst, const void *src, u16 size)
+{
+	switch (size) {
+	case 1:
+		*(u8 *)dst = *(const u8 *)src;
+		break;
+	case 2:
+		*(u16 *)dst = *(const u16 *)src;
+		break;
+	case 4:
+		*(u32 *)dst = *(const u32 *)src;
+		break;
+#if __riscv_xlen > 32
+	case 8:
+		*(u64 *)dst = *(const u64 *)src;
+		break;
+#endif
+	default:
+		sbi_memcpy(dst, src, size);
+		break;
+	}
+}
+
+static inline void *spsc_fifo_entry(struct sbi_spsc_fifo *fifo,
+				    unsigned long pos)
+{
+	return (char *)fifo->queue +
+	       (pos & (fifo->num_entries - 1)) * fifo->entry_size;
+}
+
+int sbi_spsc_fifo_init(struct sbi_spsc_fifo *fifo, void *queue_mem,
+		       u16 entries, u16 entry_size)
+{
+	if (!fifo || !queue_mem || !entries || (entries & (entries - 1)))
+		return SBI_EINVAL;
+
+	fifo->queue	  = queue_mem;
+	fifo->num_entries = entries;
+	fifo->entry_size  = entry_size;
+	fifo->head	  = 0;
+	fifo->tail	  = 0;
+	sbi_hart_memzero(fifo->queue, (size_t)entries * entry_size);
+
+	return 0;
+}
+
+u16 sbi_spsc_fifo_avail(struct sbi_spsc_fifo *fifo)
+{
+	unsigned long head, tail;
+
+	if (!fifo)
+		return 0;
+
+	tail = __atomic_load_n(&fifo->tail, __ATOMIC_RELAXED);
+	head = __atomic_load_n(&fifo->head, __ATOMIC_RELAXED);
+
+	return head - tail;
+}
+
+/* Note: must only be called by the producer of the fifo */
+int sbi_spsc_fifo_enqueue(struct sbi_spsc_fifo *fifo, void *data)
+{
+	unsigned long head;
+
+	if (!fifo || !data)
+		return SBI_EINVAL;
+
+	/* Slots before the tail are not reused until the consumer is done */
+	head = fifo->head;
+	if (head - __atomic_load_n(&fifo->tail, __ATOMIC_ACQUIRE) ==
+	    fifo->num_entries)
+		return SBI_ENOSPC;
+
+	spsc_fifo_copy(spsc_fifo_entry(fifo, head), data, fifo->entry_size);
+	__atomic_store_n(&fifo->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* Note: must only be called by the consumer of the fifo */
+int sbi_spsc_fifo_dequeue(struct sbi_spsc_fifo *fifo, void *data)
+{
+	unsigned long tail;
+
+	if (!fifo)
+		return SBI_EINVAL;
+
+	tail = fifo->tail;
+	if (tail == __atomic_load_n(&fifo->head, __ATOMIC_ACQUIRE))
+		return SBI_ENOENT;
+
+	if (data)
+		spsc_fifo_copy(data, spsc_fifo_entry(fifo, tail),
+			       fifo->entry_size);
+	__atomic_store_n(&fifo->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
@@ -6,6 +6,7 @@
  */
 
 #include <sbi/riscv_asm.h>
+#include <sbi/riscv_atomic.h>
 #include <sbi/riscv_barrier.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/riscv_locks.h>
@@ -13,7 +14,6 @@
 #include <sbi/sbi_ecall.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
-#include <sbi/sbi_fifo.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
 #include <sbi/sbi_hsm.h>
@@ -24,6 +24,7 @@
 #include <sbi/sbi_sse.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
 #include <sbi/sbi_trap.h>
 
 #include <sbi/sbi_console.h>
@@ -50,6 +51,21 @@ static const uint32_t supported_events[] = {
 
 #define EVENT_COUNT array_size(supported_events)
 
+/*
+ * Open addressed map from event id to the event slot, the hash folds
+ * the group and the global/platform bits of the id into the low bits.
+ */
+#define SSE_EVENT_MAP_SIZE	16
+
+_Static_assert(EVENT_COUNT < SSE_EVENT_MAP_SIZE, "SSE event map too small");
+_Static_assert(EVENT_COUNT <= BITS_PER_LONG, "SSE pending bitmap too small");
+
+struct sse_event_map_entry {
+	uint32_t event_id;
+	/* Index in local_events or global_events plus one, zero if unused */
+	u16 slot;
+};
+
 #define sse_event_invoke_cb(_event, _cb, ...)                                 \
 	{                                                                     \
 		if (_event->cb_ops && _event->cb_ops->_cb)                    \
@@ -74,10 +90,6 @@ struct sse_interrupted_state {
 	unsigned long a7;
 };
 
-struct sse_ipi_inject_data {
-	uint32_t event_id;
-};
-
 struct sbi_sse_event_attrs {
 	unsigned long status;
 	unsigned long prio;
@@ -106,10 +118,39 @@ assert_field_offset(interrupted.flags, SBI_SSE_ATTR_INTERRUPTED_FLAGS);
 assert_field_offset(interrupted.a6, SBI_SSE_ATTR_INTERRUPTED_A6);
 assert_field_offset(interrupted.a7, SBI_SSE_ATTR_INTERRUPTED_A7);
 
+/** Delivery statistics, read through SBI_SSE_ATTR_VENDOR_* */
+struct sse_event_stats {
+	u64 inject_time;
+	u64 deliver_time;
+	unsigned long injected;
+	unsigned long delivered;
+	unsigned long completed;
+	u64 inject_lat_min;
+	u64 inject_lat_max;
+	u64 inject_lat_sum;
+	u64 handle_lat_min;
+	u64 handle_lat_max;
+	u64 handle_lat_sum;
+};
+
 struct sbi_sse_event {
 	struct sbi_sse_event_attrs attrs;
+	struct sse_event_stats stats;
+	/*
+	 * SPP/SPIE bits of mstatus and SPV/SPVP bits of hstatus of the
+	 * interrupted context. They are only converted into
+	 * attrs.interrupted.flags when S-mode accesses that attribute.
+	 */
+	unsigned long i_mstatus;
+	unsigned long i_hstatus;
+	bool i_flags_stale;
+	/* Harts a global event may be routed to, see sse_event_route() */
+	unsigned long route_mask;
+	unsigned long route_mask_base;
 	uint32_t event_id;
 	u32 hartindex;
+	/* Index in supported_events and bit in the hart pending bitmap */
+	u32 idx;
 	const struct sbi_sse_cb_ops *cb_ops;
 	struct sbi_dlist node;
 };
@@ -144,6 +185,26 @@ struct sse_hart_state {
 	 */
 	struct sbi_sse_event *local_events;
 
+	/**
+	 * Bitmap of the events targeting this hart which may be pending,
+	 * set along with the event pending status and cleared when the
+	 * enabled_event_list is processed. Nothing is pending if zero.
+	 */
+	unsigned long pending;
+
+	/**
+	 * Bitmap of the events other harts injected to this hart which are
+	 * not marked pending yet. A set bit means an IPI is already on its
+	 * way so repeated injections are coalesced into it. Written by all
+	 * harts hence on a cache line of its own.
+	 */
+	unsigned long injected __cacheline_aligned;
+
+	/**
+	 * Timer value at which each injected event was first queued.
+	 */
+	u64 inject_time[EVENT_COUNT];
+
 	/**
 	 * State to track if the hart is ready to take sse events.
 	 * One hart cannot modify this state of another hart.
@@ -170,16 +231,13 @@ struct sse_global_event {
 static unsigned int local_event_count;
 static unsigned int global_event_count;
 static struct sse_global_event *global_events;
+static struct sse_event_map_entry sse_event_map[SSE_EVENT_MAP_SIZE];
 
-static unsigned long sse_inject_fifo_off;
-static unsigned long sse_inject_fifo_mem_off;
 /* Offset of pointer to SSE HART state in scratch space */
 static unsigned long shs_ptr_off;
 
 static u32 sse_ipi_inject_event = SBI_IPI_EVENT_MAX;
 
-static int sse_ipi_inject_send(unsigned long hartid, uint32_t event_id);
-
 static unsigned long sse_event_state(struct sbi_sse_event *e)
 {
 	return e->attrs.status & SBI_SSE_ATTR_STATUS_STATE_MASK;
@@ -244,30 +302,35 @@ static void sse_event_set_state(struct sbi_sse_event *e,
 	e->attrs.status |= new_state;
 }
 
+static inline unsigned int sse_event_hash(uint32_t event_id)
+{
+	return (event_id ^ (event_id >> 13) ^ (event_id >> 16)) &
+	       (SSE_EVENT_MAP_SIZE - 1);
+}
+
 static struct sbi_sse_event *sse_event_get(uint32_t event_id)
 {
-	unsigned int i;
-	struct sbi_sse_event *e;
+	unsigned int h = sse_event_hash(event_id);
+	struct sse_event_map_entry *m;
+	struct sse_global_event *ge;
 	struct sse_hart_state *shs;
 
+	for (;; h = (h + 1) & (SSE_EVENT_MAP_SIZE - 1)) {
+		m = &sse_event_map[h];
+		if (!m->slot)
+			return NULL;
+		if (m->event_id == event_id)
+			break;
+	}
+
 	if (EVENT_IS_GLOBAL(event_id)) {
-		for (i = 0; i < global_event_count; i++) {
-			e = &global_events[i].event;
-			if (e->event_id == event_id) {
-				spin_lock(&global_events[i].lock);
-				return e;
-			}
-		}
-	} else {
-		shs = sse_thishart_state_ptr();
-		for (i = 0; i < local_event_count; i++) {
-			e = &shs->local_events[i];
-			if (e->event_id == event_id)
-				return e;
-		}
+		ge = &global_events[m->slot - 1];
+		spin_lock(&ge->lock);
+		return &ge->event;
 	}
 
-	return NULL;
+	shs = sse_thishart_state_ptr();
+	return &shs->local_events[m->slot - 1];
 }
 
 static void sse_event_put(struct sbi_sse_event *e)
@@ -343,6 +406,19 @@ static int sse_event_set_hart_id_check(struct sbi_sse_event *e,
 static int sse_event_set_attr_check(struct sbi_sse_event *e, uint32_t attr_id,
 				    unsigned long val)
 {
+	/* Statistics are read-only, only the routing mask is writable */
+	if (attr_id >= SBI_SSE_ATTR_VENDOR_BASE) {
+		if (attr_id != SBI_SSE_ATTR_VENDOR_ROUTE_HART_MASK &&
+		    attr_id != SBI_SSE_ATTR_VENDOR_ROUTE_HART_MASK_BASE)
+			return SBI_EDENIED;
+		if (!sse_event_is_global(e))
+			return SBI_EBAD_RANGE;
+		if (sse_event_state(e) >= SBI_SSE_STATE_ENABLED)
+			return SBI_EINVALID_STATE;
+
+		return SBI_OK;
+	}
+
 	switch (attr_id) {
 	case SBI_SSE_ATTR_CONFIG:
 		if (sse_event_state(e) >= SBI_SSE_STATE_ENABLED)
@@ -409,6 +485,7 @@ static void sse_event_set_attr(struct sbi_sse_event *e, uint32_t attr_id,
 		break;
 	case SBI_SSE_ATTR_INTERRUPTED_FLAGS:
 		e->attrs.interrupted.flags = val;
+		e->i_flags_stale = false;
 		break;
 	case SBI_SSE_ATTR_INTERRUPTED_A6:
 		e->attrs.interrupted.a6 = val;
@@ -416,6 +493,12 @@ static void sse_event_set_attr(struct sbi_sse_event *e, uint32_t attr_id,
 	case SBI_SSE_ATTR_INTERRUPTED_A7:
 		e->attrs.interrupted.a7 = val;
 		break;
+	case SBI_SSE_ATTR_VENDOR_ROUTE_HART_MASK:
+		e->route_mask = val;
+		break;
+	case SBI_SSE_ATTR_VENDOR_ROUTE_HART_MASK_BASE:
+		e->route_mask_base = val;
+		break;
 	}
 }
 
@@ -448,49 +531,102 @@ static int sse_event_unregister(struct sbi_sse_event *e)
 	return 0;
 }
 
-static unsigned long sse_interrupted_flags(unsigned long mstatus)
+#define SSE_I_MSTATUS_MASK	(MSTATUS_SPP | MSTATUS_SPIE)
+#define SSE_I_HSTATUS_MASK	(HSTATUS_SPV | HSTATUS_SPVP)
+
+static void sse_event_sync_flags(struct sbi_sse_event *e)
 {
-	unsigned long hstatus, flags = 0;
+	unsigned long flags = 0;
 
-	if (mstatus & (MSTATUS_SPIE))
+	if (!e->i_flags_stale)
+		return;
+
+	if (e->i_mstatus & MSTATUS_SPIE)
 		flags |= SBI_SSE_ATTR_INTERRUPTED_FLAGS_STATUS_SPIE;
-	if (mstatus & (MSTATUS_SPP))
+	if (e->i_mstatus & MSTATUS_SPP)
 		flags |= SBI_SSE_ATTR_INTERRUPTED_FLAGS_STATUS_SPP;
+	if (e->i_hstatus & HSTATUS_SPV)
+		flags |= SBI_SSE_ATTR_INTERRUPTED_FLAGS_HSTATUS_SPV;
+	if (e->i_hstatus & HSTATUS_SPVP)
+		flags |= SBI_SSE_ATTR_INTERRUPTED_FLAGS_HSTATUS_SPVP;
 
-	if (misa_extension('H')) {
-		hstatus = csr_read(CSR_HSTATUS);
-		if (hstatus & HSTATUS_SPV)
-			flags |= SBI_SSE_ATTR_INTERRUPTED_FLAGS_HSTATUS_SPV;
-		if (hstatus & HSTATUS_SPVP)
-			flags |= SBI_SSE_ATTR_INTERRUPTED_FLAGS_HSTATUS_SPVP;
-	}
+	e->attrs.interrupted.flags = flags;
+	e->i_flags_stale = false;
+}
+
+/* Pick up flags written by S-mode through SBI_SSE_ATTR_INTERRUPTED_FLAGS */
+static void sse_event_unsync_flags(struct sbi_sse_event *e)
+{
+	unsigned long flags = e->attrs.interrupted.flags;
 
-	return flags;
+	if (e->i_flags_stale)
+		return;
+
+	e->i_mstatus = 0;
+	if (flags & SBI_SSE_ATTR_INTERRUPTED_FLAGS_STATUS_SPIE)
+		e->i_mstatus |= MSTATUS_SPIE;
+	if (flags & SBI_SSE_ATTR_INTERRUPTED_FLAGS_STATUS_SPP)
+		e->i_mstatus |= MSTATUS_SPP;
+
+	e->i_hstatus = 0;
+	if (flags & SBI_SSE_ATTR_INTERRUPTED_FLAGS_HSTATUS_SPV)
+		e->i_hstatus |= HSTATUS_SPV;
+	if (flags & SBI_SSE_ATTR_INTERRUPTED_FLAGS_HSTATUS_SPVP)
+		e->i_hstatus |= HSTATUS_SPVP;
 }
 
+static void sse_stats_update(u64 lat, u64 *min, u64 *max, u64 *sum)
+{
+	if (lat < *min)
+		*min = lat;
+	if (lat > *max)
+		*max = lat;
+	*sum += lat;
+}
+
+/*
+ * Only sepc and the SPV/SPVP bits of hstatus are clobbered by the
+ * injection, the rest of the interrupted state is in the trap frame.
+ * The interrupted flags are kept as raw status bits until S-mode reads
+ * them so injecting and resuming an event which does not look at them
+ * only costs a sepc swap.
+ */
 static void sse_event_inject(struct sbi_sse_event *e,
 			     struct sbi_trap_regs *regs)
 {
 	struct sse_interrupted_state *i_ctx = &e->attrs.interrupted;
+	struct sse_event_stats *st = &e->stats;
+	unsigned long hstatus, new_hstatus;
 
-	sse_event_set_state(e, SBI_SSE_STATE_RUNNING);
+	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_SSE_INJECT);
+
+	st->deliver_time = sbi_timer_value();
+	st->delivered++;
+	sse_stats_update(st->deliver_time - st->inject_time,
+			 &st->inject_lat_min, &st->inject_lat_max,
+			 &st->inject_lat_sum);
 
-	e->attrs.status = ~BIT(SBI_SSE_ATTR_STATUS_PENDING_OFFSET);
+	e->attrs.status &= ~BIT(SBI_SSE_ATTR_STATUS_PENDING_OFFSET);
+	sse_event_set_state(e, SBI_SSE_STATE_RUNNING);
 
 	i_ctx->a6 = regs->a6;
 	i_ctx->a7 = regs->a7;
-	i_ctx->flags = sse_interrupted_flags(regs->mstatus);
-	i_ctx->sepc = csr_read(CSR_SEPC);
+	i_ctx->sepc = csr_swap(CSR_SEPC, regs->mepc);
+	e->i_mstatus = regs->mstatus & SSE_I_MSTATUS_MASK;
+	e->i_hstatus = 0;
+	e->i_flags_stale = true;
 
-	regs->mstatus &= ~(MSTATUS_SPP | SSTATUS_SPIE);
+	regs->mstatus &= ~SSE_I_MSTATUS_MASK;
 	if (regs->mstatus & MSTATUS_MPP)
 		regs->mstatus |= MSTATUS_SPP;
 	if (regs->mstatus & MSTATUS_SIE)
 		regs->mstatus |= MSTATUS_SPIE;
 
 	if (misa_extension('H')) {
-		unsigned long hstatus = csr_read(CSR_HSTATUS);
+		hstatus = csr_read(CSR_HSTATUS);
+		e->i_hstatus = hstatus & SSE_I_HSTATUS_MASK;
 
+		new_hstatus = hstatus & ~HSTATUS_SPVP;
 #if __riscv_xlen == 64
 		if (regs->mstatus & MSTATUS_MPV)
 #elif __riscv_xlen == 32
@@ -498,15 +634,13 @@ static void sse_event_inject(struct sbi_sse_event *e,
 #else
 #error "Unexpected __riscv_xlen"
 #endif
-			hstatus |= HSTATUS_SPV;
+			new_hstatus |= HSTATUS_SPV;
+		if (new_hstatus & HSTATUS_SPV && regs->mstatus & SSTATUS_SPP)
+			new_hstatus |= HSTATUS_SPVP;
 
-		hstatus &= ~HSTATUS_SPVP;
-		if (hstatus & HSTATUS_SPV && regs->mstatus & SSTATUS_SPP)
-				hstatus |= HSTATUS_SPVP;
-
-		csr_write(CSR_HSTATUS, hstatus);
+		if (new_hstatus != hstatus)
+			csr_write(CSR_HSTATUS, new_hstatus);
 	}
-	csr_write(CSR_SEPC, regs->mepc);
 
 	/* Setup entry context */
 	regs->a6 = e->attrs.entry.arg;
@@ -531,15 +665,18 @@ static void sse_event_resume(struct sbi_sse_event *e,
 			     struct sbi_trap_regs *regs)
 {
 	struct sse_interrupted_state *i_ctx = &e->attrs.interrupted;
+	unsigned long hstatus, new_hstatus;
+
+	sse_event_unsync_flags(e);
 
-	regs->mepc = csr_read(CSR_SEPC);
+	regs->mepc = csr_swap(CSR_SEPC, i_ctx->sepc);
 
 	regs->mstatus &= ~MSTATUS_MPP;
 	if (regs->mstatus & MSTATUS_SPP)
 		regs->mstatus |= (PRV_S << MSTATUS_MPP_SHIFT);
 
 	if (misa_extension('H')) {
-		unsigned long hstatus = csr_read(CSR_HSTATUS);
+		hstatus = csr_read(CSR_HSTATUS);
 #if __riscv_xlen == 64
 		regs->mstatus &= ~MSTATUS_MPV;
 		if (hstatus & HSTATUS_SPV)
@@ -551,31 +688,20 @@ static void sse_event_resume(struct sbi_sse_event *e,
 #else
 #error "Unexpected __riscv_xlen"
 #endif
-		hstatus &= ~(HSTATUS_SPV | HSTATUS_SPVP);
-		if (i_ctx->flags & SBI_SSE_ATTR_INTERRUPTED_FLAGS_HSTATUS_SPV)
-			hstatus |= HSTATUS_SPV;
-
-		if (i_ctx->flags & SBI_SSE_ATTR_INTERRUPTED_FLAGS_HSTATUS_SPVP)
-			hstatus |= HSTATUS_SPVP;
-
-		csr_write(CSR_HSTATUS, hstatus);
+		new_hstatus = (hstatus & ~SSE_I_HSTATUS_MASK) | e->i_hstatus;
+		if (new_hstatus != hstatus)
+			csr_write(CSR_HSTATUS, new_hstatus);
 	}
 
 	regs->mstatus &= ~MSTATUS_SIE;
 	if (regs->mstatus & MSTATUS_SPIE)
 		regs->mstatus |= MSTATUS_SIE;
 
-	regs->mstatus &= ~MSTATUS_SPIE;
-	if (i_ctx->flags & SBI_SSE_ATTR_INTERRUPTED_FLAGS_STATUS_SPIE)
-		regs->mstatus |= MSTATUS_SPIE;
-
-	regs->mstatus &= ~MSTATUS_SPP;
-	if (i_ctx->flags & SBI_SSE_ATTR_INTERRUPTED_FLAGS_STATUS_SPP)
-		regs->mstatus |= MSTATUS_SPP;
+	regs->mstatus &= ~SSE_I_MSTATUS_MASK;
+	regs->mstatus |= e->i_mstatus;
 
 	regs->a7 = i_ctx->a7;
 	regs->a6 = i_ctx->a6;
-	csr_write(CSR_SEPC, i_ctx->sepc);
 }
 
 static bool sse_event_is_ready(struct sbi_sse_event *e)
@@ -610,13 +736,20 @@ static bool sse_event_check_inject(struct sbi_sse_event *e,
 	return false;
 }
 
-/* Return true if an event has been injected, false otherwise */
 void sbi_sse_process_pending_events(struct sbi_trap_regs *regs)
 {
-	bool ret;
+	bool done = false;
+	unsigned long pending = 0;
 	struct sbi_sse_event *e;
 	struct sse_hart_state *state = sse_thishart_state_ptr();
 
+	/*
+	 * Most traps find no pending event so skip taking the lock. An
+	 * event made pending concurrently is injected through an IPI.
+	 */
+	if (likely(!state->pending))
+		return;
+
 	/* if sse is masked on this hart, do nothing */
 	if (state->masked)
 		return;
@@ -624,22 +757,38 @@ void sbi_sse_process_pending_events(struct sbi_trap_regs *regs)
 	spin_lock(&state->enabled_event_lock);
 
 	sbi_list_for_each_entry(e, &state->enabled_event_list, node) {
-		ret = sse_event_check_inject(e, regs);
-		if (ret)
-			goto out;
+		if (!done)
+			done = sse_event_check_inject(e, regs);
+		if (sse_event_pending(e))
+			pending |= BIT(e->idx);
 	}
 
-out:
+	/* Drop the events which were injected or are no longer enabled */
+	__atomic_and_fetch(&state->pending, pending, __ATOMIC_RELAXED);
+
 	spin_unlock(&state->enabled_event_lock);
 }
 
-static int sse_event_set_pending(struct sbi_sse_event *e)
+/* Flag a pending event in the pending bitmap of its hart */
+static void sse_event_mark_pending(struct sbi_sse_event *e)
+{
+	atomic_raw_set_bit(e->idx, &sse_get_hart_state(e)->pending);
+}
+
+/* time is the timer value at which the event was injected */
+static int sse_event_set_pending(struct sbi_sse_event *e, u64 time)
 {
 	if (sse_event_state(e) != SBI_SSE_STATE_RUNNING &&
 	    sse_event_state(e) != SBI_SSE_STATE_ENABLED)
 		return SBI_EINVALID_STATE;
 
+	/* Latency runs from the first of coalesced injections */
+	e->stats.injected++;
+	if (!sse_event_pending(e))
+		e->stats.inject_time = time;
+
 	e->attrs.status |= BIT(SBI_SSE_ATTR_STATUS_PENDING_OFFSET);
+	sse_event_mark_pending(e);
 
 	return SBI_OK;
 }
@@ -647,17 +796,26 @@ static int sse_event_set_pending(struct sbi_sse_event *e)
 static void sse_ipi_inject_process(struct sbi_scratch *scratch)
 {
 	struct sbi_sse_event *e;
-	struct sse_ipi_inject_data evt;
-	struct sbi_fifo *sse_inject_fifo_r =
-		sbi_scratch_offset_ptr(scratch, sse_inject_fifo_off);
+	struct sse_hart_state *shs = sse_get_hart_state_ptr(scratch);
+	unsigned long injected;
+	unsigned int i;
 
-	/* Mark all queued events as pending */
-	while (!sbi_fifo_dequeue(sse_inject_fifo_r, &evt)) {
-		e = sse_event_get(evt.event_id);
+	/*
+	 * Injections made after the exchange set their bit again and come
+	 * with an IPI of their own.
+	 */
+	injected = __atomic_exchange_n(&shs->injected, 0, __ATOMIC_ACQUIRE);
+
+	/* Mark all injected events as pending */
+	for (i = 0; injected; i++, injected >>= 1) {
+		if (!(injected & 1UL))
+			continue;
+
+		e = sse_event_get(supported_events[i]);
 		if (!e)
 			continue;
 
-		sse_event_set_pending(e);
+		sse_event_set_pending(e, shs->inject_time[i]);
 		sse_event_put(e);
 	}
 }
@@ -667,56 +825,215 @@ static struct sbi_ipi_event_ops sse_ipi_inject_ops = {
 	.process = sse_ipi_inject_process,
 };
 
-static int sse_ipi_inject_send(unsigned long hartid, uint32_t event_id)
+/**
+ * Queue the event of index idx on a remote hart and add the hart to
+ * ipi_mask unless an IPI is already on its way to it.
+ * @return 1 if the hart needs an IPI, 0 if coalesced, error otherwise
+ */
+static int sse_ipi_inject_queue(u32 hartindex, unsigned int idx, u64 time,
+				struct sbi_hartmask *ipi_mask)
 {
-	int ret;
-	struct sbi_scratch *remote_scratch = NULL;
-	struct sse_ipi_inject_data evt = {event_id};
-	struct sbi_fifo *sse_inject_fifo_r;
+	struct sbi_scratch *remote_scratch;
+	struct sse_hart_state *shs;
 
-	remote_scratch = sbi_hartid_to_scratch(hartid);
+	remote_scratch = sbi_hartindex_to_scratch(hartindex);
 	if (!remote_scratch)
 		return SBI_EINVAL;
-	sse_inject_fifo_r =
-		sbi_scratch_offset_ptr(remote_scratch, sse_inject_fifo_off);
 
-	ret = sbi_fifo_enqueue(sse_inject_fifo_r, &evt, false);
-	if (ret)
-		return SBI_EFAIL;
+	shs = sse_get_hart_state_ptr(remote_scratch);
+	if (!shs)
+		return SBI_EINVAL;
 
-	ret = sbi_ipi_send_many(1, hartid, sse_ipi_inject_event, NULL);
-	if (ret)
-		return SBI_EFAIL;
+	/*
+	 * Only the first injection of a queued event records its time.
+	 * This races with the consumer so the time is a best effort.
+	 */
+	if (!(__atomic_load_n(&shs->injected, __ATOMIC_RELAXED) & BIT(idx)))
+		__atomic_store_n(&shs->inject_time[idx], time,
+				 __ATOMIC_RELAXED);
 
-	return SBI_OK;
+	if (atomic_raw_set_bit(idx, &shs->injected))
+		return 0;
+
+	sbi_hartmask_set_hartindex(hartindex, ipi_mask);
+
+	return 1;
 }
 
-static int sse_inject_event(uint32_t event_id, unsigned long hartid)
+static bool sse_route_hart_in_mask(struct sbi_sse_event *e, u32 hartindex)
 {
-	int ret;
+	unsigned long hartid = sbi_hartindex_to_hartid(hartindex);
+
+	if (e->route_mask_base == -1UL)
+		return true;
+	if (hartid < e->route_mask_base ||
+	    BITS_PER_LONG <= hartid - e->route_mask_base)
+		return false;
+
+	return !!(e->route_mask & BIT(hartid - e->route_mask_base));
+}
+
+/*
+ * A started hart runs S-mode code and takes the event on its next trap
+ * while a suspended hart would have to be woken up first.
+ */
+static bool sse_route_hart_ready(const struct sbi_domain *dom, u32 hartindex)
+{
+	struct sbi_scratch *scratch = sbi_hartindex_to_scratch(hartindex);
+	struct sse_hart_state *shs;
+
+	if (!scratch || !sbi_domain_is_assigned_hart(dom, hartindex))
+		return false;
+	if (sbi_hsm_hart_get_state(dom, sbi_hartindex_to_hartid(hartindex)) !=
+	    SBI_HSM_STATE_STARTED)
+		return false;
+
+	shs = sse_get_hart_state_ptr(scratch);
+	return shs && !__atomic_load_n(&shs->masked, __ATOMIC_RELAXED);
+}
+
+static bool sse_route_hart_ok(struct sbi_sse_event *e,
+			      const struct sbi_domain *dom, u32 hartindex)
+{
+	return sse_route_hart_in_mask(e, hartindex) &&
+	       sse_route_hart_ready(dom, hartindex);
+}
+
+/**
+ * Pick the hart an injected global event is delivered to. Without a
+ * routing mask, or while the event is running or already on its way,
+ * this is the preferred hart. Otherwise the injecting hart is tried
+ * first since it needs no IPI, then the preferred hart and then the
+ * other started and unmasked harts of the mask. The preferred hart
+ * stays the fallback when none of them is ready.
+ * Must be called under the global event lock.
+ */
+static u32 sse_event_route(struct sbi_sse_event *e)
+{
+	const struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	u32 i, hartindex = current_hartindex();
+	struct sbi_scratch *scratch;
+	struct sse_hart_state *shs;
+
+	if (!e->route_mask && !e->route_mask_base)
+		return e->hartindex;
+	if (sse_event_state(e) != SBI_SSE_STATE_ENABLED || sse_event_pending(e))
+		return e->hartindex;
+
+	scratch = sbi_hartindex_to_scratch(e->hartindex);
+	shs = scratch ? sse_get_hart_state_ptr(scratch) : NULL;
+	if (!shs || (__atomic_load_n(&shs->injected, __ATOMIC_RELAXED) &
+		     BIT(e->idx)))
+		return e->hartindex;
+
+	if (sse_route_hart_ok(e, dom, hartindex))
+		return hartindex;
+	if (sse_route_hart_ok(e, dom, e->hartindex))
+		return e->hartindex;
+
+	sbi_hartmask_for_each_hartindex(i, &dom->assigned_harts) {
+		if (sse_route_hart_ok(e, dom, i))
+			return i;
+	}
+
+	return e->hartindex;
+}
+
+/* Move an enabled global event to the list of another hart */
+static void sse_event_retarget(struct sbi_sse_event *e, u32 hartindex)
+{
+	sse_enabled_event_lock(e);
+	sse_event_remove_from_list(e);
+	sse_enabled_event_unlock(e);
+
+	e->hartindex = hartindex;
+	e->attrs.hartid = sbi_hartindex_to_hartid(hartindex);
+	sse_event_invoke_cb(e, set_hartid_cb, e->attrs.hartid);
+
+	sse_enabled_event_lock(e);
+	sse_event_add_to_list(e);
+	sse_enabled_event_unlock(e);
+}
+
+static int sse_inject_event_mask(uint32_t event_id,
+				 const struct sbi_hartmask *mask)
+{
+	int ret, rc = SBI_OK;
+	u32 i, hartindex = current_hartindex();
+	struct sbi_hartmask ipi_mask;
 	struct sbi_sse_event *e;
+	bool notify = false;
+	u64 now = sbi_timer_value();
 
 	e = sse_event_get(event_id);
 	if (!e)
 		return SBI_EINVAL;
 
+	/* In case of global event, the provided harts are ignored */
+	if (sse_event_is_global(e)) {
+		i = sse_event_route(e);
+		if (i != e->hartindex)
+			sse_event_retarget(e, i);
 
-	/* In case of global event, provided hart_id is ignored */
-	if (sse_event_is_global(e))
-		hartid = e->attrs.hartid;
+		if (e->hartindex == hartindex) {
+			ret = sse_event_set_pending(e, now);
+			sse_event_put(e);
+			return ret;
+		}
 
-	/* Event is for another hart, send it through IPI */
-	if (hartid != current_hartid()) {
+		sbi_hartmask_clear_all(&ipi_mask);
+		ret = sse_ipi_inject_queue(e->hartindex, e->idx, now,
+					   &ipi_mask);
 		sse_event_put(e);
-		return sse_ipi_inject_send(hartid, event_id);
+		if (ret <= 0)
+			return ret;
+
+		ret = sbi_ipi_send_mask(&ipi_mask, sse_ipi_inject_event, NULL);
+		return ret ? SBI_EFAIL : SBI_OK;
+	}
+
+	/* Local events are never locked so e stays usable until the end */
+	sbi_hartmask_clear_all(&ipi_mask);
+	sbi_hartmask_for_each_hartindex(i, mask) {
+		if (i == hartindex)
+			continue;
+
+		ret = sse_ipi_inject_queue(i, e->idx, now, &ipi_mask);
+		if (ret < 0)
+			rc = ret;
+		else if (ret)
+			notify = true;
+	}
+
+	/* One IPI round for all the harts which were not already notified */
+	if (notify) {
+		ret = sbi_ipi_send_mask(&ipi_mask, sse_ipi_inject_event, NULL);
+		if (ret)
+			rc = SBI_EFAIL;
 	}
 
-	ret = sse_event_set_pending(e);
+	if (sbi_hartmask_test_hartindex(hartindex, mask)) {
+		ret = sse_event_set_pending(e, now);
+		if (ret)
+			rc = ret;
+	}
 	sse_event_put(e);
-	if (ret)
-		return ret;
 
-	return SBI_OK;
+	return rc;
+}
+
+static int sse_inject_event(uint32_t event_id, unsigned long hartid)
+{
+	struct sbi_hartmask mask;
+	u32 hartindex = sbi_hartid_to_hartindex(hartid);
+
+	if (!sbi_hartindex_valid(hartindex))
+		return SBI_EINVAL;
+
+	sbi_hartmask_clear_all(&mask);
+	sbi_hartmask_set_hartindex(hartindex, &mask);
+
+	return sse_inject_event_mask(event_id, &mask);
 }
 
 /**
@@ -729,6 +1046,8 @@ static int sse_event_enable(struct sbi_sse_event *e)
 
 	sse_event_set_state(e, SBI_SSE_STATE_ENABLED);
 	sse_event_add_to_list(e);
+	if (sse_event_pending(e))
+		sse_event_mark_pending(e);
 
 	sse_event_invoke_cb(e, enable_cb);
 
@@ -749,6 +1068,11 @@ static int sse_event_complete(struct sbi_sse_event *e,
 	if (e->attrs.hartid != current_hartid())
 		return SBI_EINVAL;
 
+	e->stats.completed++;
+	sse_stats_update(sbi_timer_value() - e->stats.deliver_time,
+			 &e->stats.handle_lat_min, &e->stats.handle_lat_max,
+			 &e->stats.handle_lat_sum);
+
 	sse_event_set_state(e, SBI_SSE_STATE_ENABLED);
 	if (e->attrs.config & SBI_SSE_ATTR_CONFIG_ONESHOT)
 		sse_event_disable(e);
@@ -863,6 +1187,15 @@ int sbi_sse_inject_event(uint32_t event_id)
 	return sse_inject_event(event_id, current_hartid());
 }
 
+int sbi_sse_inject_event_many(uint32_t event_id,
+			      const struct sbi_hartmask *mask)
+{
+	if (!mask)
+		return SBI_EINVAL;
+
+	return sse_inject_event_mask(event_id, mask);
+}
+
 int sbi_sse_set_cb_ops(uint32_t event_id, const struct sbi_sse_cb_ops *cb_ops)
 {
 	struct sbi_sse_event *e;
@@ -890,8 +1223,12 @@ int sbi_sse_attr_check(uint32_t base_attr_id, uint32_t attr_count,
 	if (attr_count == 0)
 		return SBI_ERR_INVALID_PARAM;
 
-	if (end_id >= SBI_SSE_ATTR_MAX)
+	if (base_attr_id >= SBI_SSE_ATTR_VENDOR_BASE) {
+		if (end_id >= SBI_SSE_ATTR_VENDOR_MAX)
+			return SBI_EBAD_RANGE;
+	} else if (end_id >= SBI_SSE_ATTR_MAX) {
 		return SBI_EBAD_RANGE;
+	}
 
 	if (phys_lo & (align - 1))
 		return SBI_EINVALID_ADDR;
@@ -929,6 +1266,39 @@ static void copy_attrs(unsigned long *out, const unsigned long *in,
 		out[i] = in[i];
 }
 
+static unsigned long sse_event_vendor_attr(struct sbi_sse_event *e,
+					   uint32_t attr_id)
+{
+	const struct sse_event_stats *st = &e->stats;
+
+	switch (attr_id) {
+	case SBI_SSE_ATTR_VENDOR_INJECTED:
+		return st->injected;
+	case SBI_SSE_ATTR_VENDOR_DELIVERED:
+		return st->delivered;
+	case SBI_SSE_ATTR_VENDOR_COMPLETED:
+		return st->completed;
+	case SBI_SSE_ATTR_VENDOR_INJECT_LAT_MIN:
+		return st->delivered ? st->inject_lat_min : 0;
+	case SBI_SSE_ATTR_VENDOR_INJECT_LAT_AVG:
+		return st->delivered ? st->inject_lat_sum / st->delivered : 0;
+	case SBI_SSE_ATTR_VENDOR_INJECT_LAT_MAX:
+		return st->inject_lat_max;
+	case SBI_SSE_ATTR_VENDOR_HANDLE_LAT_MIN:
+		return st->completed ? st->handle_lat_min : 0;
+	case SBI_SSE_ATTR_VENDOR_HANDLE_LAT_AVG:
+		return st->completed ? st->handle_lat_sum / st->completed : 0;
+	case SBI_SSE_ATTR_VENDOR_HANDLE_LAT_MAX:
+		return st->handle_lat_max;
+	case SBI_SSE_ATTR_VENDOR_ROUTE_HART_MASK:
+		return e->route_mask;
+	case SBI_SSE_ATTR_VENDOR_ROUTE_HART_MASK_BASE:
+		return e->route_mask_base;
+	default:
+		return 0;
+	}
+}
+
 int sbi_sse_read_attrs(uint32_t event_id, uint32_t base_attr_id,
 		       uint32_t attr_count, unsigned long output_phys_lo,
 		       unsigned long output_phys_hi)
@@ -937,6 +1307,7 @@ int sbi_sse_read_attrs(uint32_t event_id, uint32_t base_attr_id,
 	unsigned long *e_attrs;
 	struct sbi_sse_event *e;
 	unsigned long *attrs;
+	uint32_t i;
 
 	ret = sbi_sse_attr_check(base_attr_id, attr_count, output_phys_lo,
 				 output_phys_hi, SBI_DOMAIN_WRITE);
@@ -956,9 +1327,17 @@ int sbi_sse_read_attrs(uint32_t event_id, uint32_t base_attr_id,
 	 * doing multiple SBI calls a single one is done allowing to retrieve
 	 * them all at once.
 	 */
-	e_attrs = (unsigned long *)&e->attrs;
 	attrs = (unsigned long *)output_phys_lo;
-	copy_attrs(attrs, &e_attrs[base_attr_id], attr_count);
+	if (base_attr_id >= SBI_SSE_ATTR_VENDOR_BASE) {
+		for (i = 0; i < attr_count; i++)
+			attrs[i] = sse_event_vendor_attr(e, base_attr_id + i);
+	} else {
+		if (base_attr_id <= SBI_SSE_ATTR_INTERRUPTED_FLAGS &&
+		    SBI_SSE_ATTR_INTERRUPTED_FLAGS < base_attr_id + attr_count)
+			sse_event_sync_flags(e);
+		e_attrs = (unsigned long *)&e->attrs;
+		copy_attrs(attrs, &e_attrs[base_attr_id], attr_count);
+	}
 
 	sbi_hart_unmap_saddr();
 
@@ -1058,9 +1437,12 @@ int sbi_sse_unregister(uint32_t event_id)
 	return ret;
 }
 
-static void sse_event_init(struct sbi_sse_event *e, uint32_t event_id)
+static void sse_event_init(struct sbi_sse_event *e, unsigned int idx)
 {
-	e->event_id = event_id;
+	e->event_id = supported_events[idx];
+	e->idx = idx;
+	e->stats.inject_lat_min = -1ULL;
+	e->stats.handle_lat_min = -1ULL;
 	e->hartindex = current_hartindex();
 	e->attrs.hartid = current_hartid();
 	/* Declare all events as injectable */
@@ -1069,13 +1451,19 @@ static void sse_event_init(struct sbi_sse_event *e, uint32_t event_id)
 
 static void sse_event_count_init()
 {
-	unsigned int i;
+	unsigned int i, h, slot;
 
 	for (i = 0; i < EVENT_COUNT; i++) {
 		if (EVENT_IS_GLOBAL(supported_events[i]))
-			global_event_count++;
+			slot = ++global_event_count;
 		else
-			local_event_count++;
+			slot = ++local_event_count;
+
+		h = sse_event_hash(supported_events[i]);
+		while (sse_event_map[h].slot)
+			h = (h + 1) & (SSE_EVENT_MAP_SIZE - 1);
+		sse_event_map[h].event_id = supported_events[i];
+		sse_event_map[h].slot = slot;
 	}
 }
 
@@ -1093,7 +1481,7 @@ static int sse_global_init()
 			continue;
 
 		e = &global_events[ev].event;
-		sse_event_init(e, supported_events[i]);
+		sse_event_init(e, i);
 		SPIN_LOCK_INIT(global_events[ev].lock);
 
 		ev++;
@@ -1108,21 +1496,21 @@ static void sse_local_init(struct sse_hart_state *shs)
 
 	SBI_INIT_LIST_HEAD(&shs->enabled_event_list);
 	SPIN_LOCK_INIT(shs->enabled_event_lock);
+	shs->pending = 0;
+	shs->injected = 0;
 
 	for (i = 0; i < EVENT_COUNT; i++) {
 		if (EVENT_IS_GLOBAL(supported_events[i]))
 			continue;
 
-		sse_event_init(&shs->local_events[ev++], supported_events[i]);
+		sse_event_init(&shs->local_events[ev++], i);
 	}
 }
 
 int sbi_sse_init(struct sbi_scratch *scratch, bool cold_boot)
 {
 	int ret;
-	void *sse_inject_mem;
 	struct sse_hart_state *shs;
-	struct sbi_fifo *sse_inject_q;
 
 	if (cold_boot) {
 		sse_event_count_init();
@@ -1135,21 +1523,6 @@ int sbi_sse_init(struct sbi_scratch *scratch, bool cold_boot)
 		if (!shs_ptr_off)
 			return SBI_ENOMEM;
 
-		sse_inject_fifo_off =
-			sbi_scratch_alloc_offset(sizeof(*sse_inject_q));
-		if (!sse_inject_fifo_off) {
-			sbi_scratch_free_offset(shs_ptr_off);
-			return SBI_ENOMEM;
-		}
-
-		sse_inject_fifo_mem_off = sbi_scratch_alloc_offset(
-			EVENT_COUNT * sizeof(struct sse_ipi_inject_data));
-		if (!sse_inject_fifo_mem_off) {
-			sbi_scratch_free_offset(sse_inject_fifo_off);
-			sbi_scratch_free_offset(shs_ptr_off);
-			return SBI_ENOMEM;
-		}
-
 		ret = sbi_ipi_event_create(&sse_ipi_inject_ops);
 		if (ret < 0) {
 			sbi_scratch_free_offset(shs_ptr_off);
@@ -1176,14 +1549,43 @@ int sbi_sse_init(struct sbi_scratch *scratch, bool cold_boot)
 
 	sse_local_init(shs);
 
-	sse_inject_q = sbi_scratch_offset_ptr(scratch, sse_inject_fifo_off);
-	sse_inject_mem =
-		sbi_scratch_offset_ptr(scratch, sse_inject_fifo_mem_off);
+	return 0;
+}
+
+/* Return an event to the state it had before any supervisor used it */
+static void sse_event_reset(struct sbi_sse_event *e, u32 hartindex)
+{
+	sbi_memset(&e->attrs, 0, sizeof(e->attrs));
+	e->i_mstatus = 0;
+	e->i_hstatus = 0;
+	e->i_flags_stale = false;
+	e->route_mask = 0;
+	e->route_mask_base = 0;
+	e->hartindex = hartindex;
+	e->attrs.hartid = sbi_hartindex_to_hartid(hartindex);
+	/* Declare all events as injectable */
+	e->attrs.status |= BIT(SBI_SSE_ATTR_STATUS_INJECT_OFFSET);
+}
 
-	sbi_fifo_init(sse_inject_q, sse_inject_mem, EVENT_COUNT,
-		      sizeof(struct sse_ipi_inject_data));
+void sbi_sse_reset_hart(struct sbi_scratch *scratch)
+{
+	struct sse_hart_state *shs = sse_get_hart_state_ptr(scratch);
+	u32 hartindex = scratch->hartindex;
+	unsigned int i;
 
-	return 0;
+	for (i = 0; i < global_event_count; i++) {
+		spin_lock(&global_events[i].lock);
+		if (global_events[i].event.hartindex == hartindex)
+			sse_event_reset(&global_events[i].event, hartindex);
+		spin_unlock(&global_events[i].lock);
+	}
+
+	if (!shs)
+		return;
+
+	for (i = 0; i < local_event_count; i++)
+		sse_event_reset(&shs->local_events[i], hartindex);
+	shs->masked = true;
 }
 
 void sbi_sse_exit(struct sbi_scratch *scratch)
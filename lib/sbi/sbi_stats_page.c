@@ -0,0 +1,133 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Shared statistics page of domains
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_barrier.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_perf_report.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_stats_page.h>
+#include <sbi/sbi_timer.h>
+
+/* Refresh timer entry of each HART, only armed on domain boot HARTs */
+static unsigned long stats_timer_off;
+
+/* Refresh interval in timer ticks */
+static u64 stats_interval;
+
+static void stats_page_update(const struct sbi_domain *dom)
+{
+	struct sbi_stats_page_header *hdr = (void *)dom->stats_page;
+	unsigned long avail = dom->stats_page_size - sizeof(*hdr);
+	unsigned long size;
+	u32 seq;
+
+	if (sbi_hart_map_saddr(dom->stats_page, dom->stats_page_size))
+		return;
+
+	seq = hdr->sequence;
+	/* Readers retry while the sequence is odd */
+	hdr->sequence = seq | 1;
+	smp_wmb();
+	size = sbi_perf_report_build(dom, hdr + 1, avail);
+	hdr->magic = SBI_STATS_PAGE_MAGIC;
+	hdr->interval = stats_interval;
+	hdr->error = (avail < size) ? SBI_ENOSPC : 0;
+	hdr->reserved = 0;
+	hdr->report_size = size;
+	smp_wmb();
+	hdr->sequence = (seq | 1) + 1;
+
+	sbi_hart_unmap_saddr();
+}
+
+/*
+ * Each page has a single writer, the boot HART of its domain. Returns
+ * whether the current HART owns any page.
+ */
+static bool stats_page_refresh(bool update)
+{
+	const struct sbi_domain *dom;
+	u32 hartid = current_hartid();
+	bool owner = false;
+
+	sbi_domain_for_each(dom) {
+		if (!dom->stats_page || dom->boot_hartid != hartid)
+			continue;
+		if (update)
+			stats_page_update(dom);
+		owner = true;
+	}
+
+	return owner;
+}
+
+static void stats_timer_callback(struct sbi_timer_entry *entry)
+{
+	if (stats_page_refresh(true))
+		sbi_timer_add_entry(entry, sbi_timer_value() + stats_interval);
+}
+
+/* Drop a page which is not supervisor readable memory of its domain */
+static void stats_page_validate(struct sbi_domain *dom)
+{
+	unsigned long base = dom->stats_page, size = dom->stats_page_size;
+
+	if (!base)
+		return;
+
+	if ((base & (PAGE_SIZE - 1)) || (size & (PAGE_SIZE - 1)) ||
+	    !size || (base + size - 1) < base ||
+	    !sbi_domain_check_addr_range(dom, base, size, PRV_S,
+					 SBI_DOMAIN_READ)) {
+		sbi_printf("%s: %s: invalid stats page 0x%lx (size 0x%lx)\n",
+			   __func__, dom->name, base, size);
+		dom->stats_page = 0;
+		dom->stats_page_size = 0;
+	}
+}
+
+int sbi_stats_page_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	const struct sbi_timer_device *tdev;
+	struct sbi_timer_entry *entry;
+	struct sbi_domain *dom;
+
+	if (cold_boot) {
+		sbi_domain_for_each(dom)
+			stats_page_validate(dom);
+
+		tdev = sbi_timer_get_device();
+		if (!tdev || !tdev->timer_freq)
+			return 0;
+
+		stats_timer_off =
+			sbi_scratch_alloc_type_offset(struct sbi_timer_entry);
+		if (!stats_timer_off)
+			return SBI_ENOMEM;
+
+		stats_interval = ((u64)tdev->timer_freq *
+				  CONFIG_SBI_STATS_PAGE_INTERVAL_US) / 1000000;
+		if (!stats_interval)
+			stats_interval = 1;
+	}
+
+	if (!stats_timer_off)
+		return 0;
+
+	/* The timer queue of the HART was reset by sbi_timer_init() */
+	entry = sbi_scratch_offset_ptr(scratch, stats_timer_off);
+	sbi_timer_entry_init(entry, stats_timer_callback);
+
+	/* The first update runs from the timer, once PMP is configured */
+	if (!stats_page_refresh(false))
+		return 0;
+
+	return sbi_timer_add_entry(entry, sbi_timer_value() + stats_interval);
+}
@@ -8,8 +8,9 @@
  */
 
 /*
- * Simple libc functions. These are not optimized at all and might have some
- * bugs as well. Use any optimized routines from newlib or glibc if required.
+ * Simple libc functions. Apart from the word at a time memory functions
+ * these are not optimized at all and might have some bugs as well. Use any
+ * optimized routines from newlib or glibc if required.
  */
 
 #include <sbi/sbi_string.h>
@@ -109,9 +110,52 @@ char *sbi_strrchr(const char *s, int c)
 	else
 		return (char *)last;
 }
+/*
+ * The memory functions below move a word at a time once the pointers
+ * are word aligned. M-mode cannot rely on misaligned accesses being
+ * handled so only naturally aligned words are ever accessed.
+ */
+#define WSIZE		sizeof(unsigned long)
+#define WMASK		(WSIZE - 1)
+
+/* Byte at the lowest address of a word is the least significant one */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define WSHIFT_LO(__w, __bits)	((__w) >> (__bits))
+#define WSHIFT_HI(__w, __bits)	((__w) << (__bits))
+#else
+#define WSHIFT_LO(__w, __bits)	((__w) << (__bits))
+#define WSHIFT_HI(__w, __bits)	((__w) >> (__bits))
+#endif
+
 void *sbi_memset(void *s, int c, size_t count)
 {
-	char *temp = s;
+	unsigned char *temp = s;
+	unsigned long *wtemp, pattern;
+
+	while (count > 0 && ((unsigned long)temp & WMASK)) {
+		count--;
+		*temp++ = c;
+	}
+
+	if (count >= WSIZE) {
+		pattern = (unsigned char)c;
+		pattern |= pattern << 8;
+		pattern |= pattern << 16;
+#if __SIZEOF_LONG__ == 8
+		pattern |= pattern << 32;
+#endif
+		wtemp = (unsigned long *)temp;
+		for (; count >= 4 * WSIZE; count -= 4 * WSIZE) {
+			wtemp[0] = pattern;
+			wtemp[1] = pattern;
+			wtemp[2] = pattern;
+			wtemp[3] = pattern;
+			wtemp += 4;
+		}
+		for (; count >= WSIZE; count -= WSIZE)
+			*wtemp++ = pattern;
+		temp = (unsigned char *)wtemp;
+	}
 
 	while (count > 0) {
 		count--;
@@ -123,8 +167,52 @@ void *sbi_memset(void *s, int c, size_t count)
 
 void *sbi_memcpy(void *dest, const void *src, size_t count)
 {
-	char *temp1	  = dest;
-	const char *temp2 = src;
+	unsigned char *temp1	   = dest;
+	const unsigned char *temp2 = src;
+	const unsigned long *wsrc;
+	unsigned long *wdest, lo, hi;
+	unsigned int shift;
+
+	while (count > 0 && ((unsigned long)temp1 & WMASK)) {
+		*temp1++ = *temp2++;
+		count--;
+	}
+
+	if (count >= WSIZE) {
+		wdest = (unsigned long *)temp1;
+		shift = ((unsigned long)temp2 & WMASK) * 8;
+		if (!shift) {
+			wsrc = (const unsigned long *)temp2;
+			for (; count >= 4 * WSIZE; count -= 4 * WSIZE) {
+				wdest[0] = wsrc[0];
+				wdest[1] = wsrc[1];
+				wdest[2] = wsrc[2];
+				wdest[3] = wsrc[3];
+				wdest += 4;
+				wsrc += 4;
+			}
+			for (; count >= WSIZE; count -= WSIZE)
+				*wdest++ = *wsrc++;
+		} else if (count >= 2 * WSIZE) {
+			/*
+			 * Merge pairs of aligned source words. The loop stops
+			 * while at least one word of source is left so that the
+			 * aligned load of the next word never reads past the
+			 * last source byte, the tail is copied bytewise.
+			 */
+			wsrc = (const unsigned long *)((unsigned long)temp2 &
+						       ~WMASK);
+			lo = *wsrc++;
+			for (; count >= 2 * WSIZE; count -= WSIZE) {
+				hi = *wsrc++;
+				*wdest++ = WSHIFT_LO(lo, shift) |
+					   WSHIFT_HI(hi, WSIZE * 8 - shift);
+				lo = hi;
+			}
+		}
+		temp2 += (unsigned char *)wdest - temp1;
+		temp1 = (unsigned char *)wdest;
+	}
 
 	while (count > 0) {
 		*temp1++ = *temp2++;
@@ -136,25 +224,38 @@ void *sbi_memcpy(void *dest, const void *src, size_t count)
 
 void *sbi_memmove(void *dest, const void *src, size_t count)
 {
-	char *temp1	  = (char *)dest;
-	const char *temp2 = (char *)src;
+	unsigned char *temp1	   = (unsigned char *)dest;
+	const unsigned char *temp2 = (const unsigned char *)src;
+	unsigned long *wdest;
+	const unsigned long *wsrc;
 
 	if (src == dest)
 		return dest;
 
-	if (dest < src) {
-		while (count > 0) {
-			*temp1++ = *temp2++;
-			count--;
-		}
-	} else {
-		temp1 = (char *)dest + count - 1;
-		temp2 = (char *)src + count - 1;
+	/* A forward copy never overwrites source bytes not yet read */
+	if (dest < src || temp2 + count <= temp1)
+		return sbi_memcpy(dest, src, count);
 
-		while (count > 0) {
-			*temp1-- = *temp2--;
+	temp1 += count;
+	temp2 += count;
+
+	if (!(((unsigned long)temp1 ^ (unsigned long)temp2) & WMASK)) {
+		while (count > 0 && ((unsigned long)temp1 & WMASK)) {
+			*--temp1 = *--temp2;
 			count--;
 		}
+
+		wdest = (unsigned long *)temp1;
+		wsrc = (const unsigned long *)temp2;
+		for (; count >= WSIZE; count -= WSIZE)
+			*--wdest = *--wsrc;
+		temp1 = (unsigned char *)wdest;
+		temp2 = (const unsigned char *)wsrc;
+	}
+
+	while (count > 0) {
+		*--temp1 = *--temp2;
+		count--;
 	}
 
 	return dest;
@@ -162,8 +263,27 @@ void *sbi_memmove(void *dest, const void *src, size_t count)
 
 int sbi_memcmp(const void *s1, const void *s2, size_t count)
 {
-	const char *temp1 = s1;
-	const char *temp2 = s2;
+	const unsigned char *temp1 = s1;
+	const unsigned char *temp2 = s2;
+
+	/* Skip equal words, the differing byte is found below */
+	if (!(((unsigned long)temp1 ^ (unsigned long)temp2) & WMASK)) {
+		for (; count > 0 && ((unsigned long)temp1 & WMASK) &&
+		       (*temp1 == *temp2); count--) {
+			temp1++;
+			temp2++;
+		}
+
+		if (!((unsigned long)temp1 & WMASK)) {
+			for (; count >= WSIZE; count -= WSIZE) {
+				if (*(const unsigned long *)temp1 !=
+				    *(const unsigned long *)temp2)
+					break;
+				temp1 += WSIZE;
+				temp2 += WSIZE;
+			}
+		}
+	}
 
 	for (; count > 0 && (*temp1 == *temp2); count--) {
 		temp1++;
@@ -171,7 +291,7 @@ int sbi_memcmp(const void *s1, const void *s2, size_t count)
 	}
 
 	if (count > 0)
-		return *(unsigned char *)temp1 - *(unsigned char *)temp2;
+		return *temp1 - *temp2;
 	else
 		return 0;
 }
@@ -9,11 +9,19 @@
  */
 
 #include <sbi/riscv_asm.h>
+#include <sbi/riscv_barrier.h>
+#include <sbi/sbi_batch.h>
 #include <sbi/sbi_bitops.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_cppc.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_domain_context.h>
+#include <sbi/sbi_ecall_profile.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_hsm.h>
+#include <sbi/sbi_nacl.h>
 #include <sbi/sbi_platform.h>
+#include <sbi/sbi_sse.h>
 #include <sbi/sbi_system.h>
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_init.h>
@@ -63,26 +71,103 @@ bool sbi_system_reset_supported(u32 reset_type, u32 reset_reason)
 	return !!sbi_system_reset_get_device(reset_type, reset_reason);
 }
 
+/*
+ * Halt every HART other than the current HART in parallel without
+ * letting a HART stuck in M-mode hold back the reset for longer than
+ * the halt timeout.
+ */
+static void sbi_system_reset_halt_others(void)
+{
+	if (sbi_ipi_send_halt_wait(0, -1UL,
+			CONFIG_SBI_SYSTEM_RESET_HALT_TIMEOUT_MS) == SBI_ETIMEDOUT)
+		sbi_printf("%s: not all HARTs halted in time\n", __func__);
+}
+
+#ifdef CONFIG_SBI_FAST_WARM_REBOOT
+/*
+ * Warm reboot the root domain without a hardware reset. Once all other
+ * HARTs of the domain are stopped, the boot stage of the domain is
+ * restarted on the current HART through the warm boot path reusing the
+ * platform description, domains and drivers of the cold boot. The
+ * events and shared memory registered by the old supervisor are
+ * dropped, the rest of the per-HART state is reset by the warm boot
+ * path. Returns when some HART could not be halted in time.
+ */
+static void sbi_system_fast_reboot(struct sbi_domain *dom,
+				   struct sbi_scratch *scratch)
+{
+	u32 i;
+	struct sbi_hartmask mask;
+	struct sbi_scratch *rscratch;
+
+	if (dom != &root ||
+	    sbi_ipi_send_halt_wait(0, -1UL,
+			CONFIG_SBI_SYSTEM_RESET_HALT_TIMEOUT_MS))
+		return;
+
+	/* Halted HARTs must be startable again by the next stage */
+	sbi_domain_get_assigned_hartmask(dom, &mask);
+	sbi_hartmask_for_each_hartindex(i, &mask) {
+		while (__sbi_hsm_hart_get_state(i) ==
+		       SBI_HSM_STATE_STOP_PENDING)
+			cpu_relax();
+	}
+
+	sbi_hartmask_for_each_hartindex(i, &mask) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+		sbi_sse_reset_hart(rscratch);
+		sbi_nacl_reset_hart(rscratch);
+		sbi_batch_reset_hart(rscratch);
+		sbi_cppc_fastchan_reset_hart(rscratch);
+		sbi_domain_context_sta_reset(dom, i);
+	}
+
+	sbi_console_flush();
+
+	sbi_hsm_hart_restart(scratch, dom->next_addr, dom->next_mode,
+			     dom->next_arg1);
+}
+#else
+static inline void sbi_system_fast_reboot(struct sbi_domain *dom,
+					  struct sbi_scratch *scratch)
+{
+}
+#endif
+
 void __noreturn sbi_system_reset(u32 reset_type, u32 reset_reason)
 {
 	struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	const struct sbi_system_reset_device *dev = NULL;
+
+	sbi_ecall_profile_dump();
 
-	/* Send HALT IPI to every hart other than the current hart */
-	sbi_ipi_send_halt(0, -1UL);
+	if (reset_type == SBI_SRST_RESET_TYPE_WARM_REBOOT &&
+	    dom->system_reset_allowed)
+		sbi_system_fast_reboot(dom, scratch);
+
+	/* Platform specific reset if domain allowed system reset */
+	if (dom->system_reset_allowed)
+		dev = sbi_system_reset_get_device(reset_type, reset_reason);
+
+	/* A device resetting all HARTs at once does not need them halted */
+	if (!dev || !dev->resets_all_harts)
+		sbi_system_reset_halt_others();
 
 	/* Stop current HART */
 	sbi_hsm_hart_stop(scratch, false);
 
-	/* Platform specific reset if domain allowed system reset */
-	if (dom->system_reset_allowed) {
-		const struct sbi_system_reset_device *dev =
-			sbi_system_reset_get_device(reset_type, reset_reason);
-		if (dev)
-			dev->system_reset(reset_type, reset_reason);
-	}
+	/* Don't lose buffered console output across the reset */
+	sbi_console_flush();
+
+	if (dev)
+		dev->system_reset(reset_type, reset_reason);
 
 	/* If platform specific reset did not work then do sbi_exit() */
+	if (dev && dev->resets_all_harts)
+		sbi_ipi_send_halt(0, -1UL);
 	sbi_exit(scratch);
 }
 
@@ -143,6 +228,7 @@ int sbi_system_suspend(u32 sleep_type, ulong resume_addr, ulong opaque)
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 	void (*jump_warmboot)(void) = (void (*)(void))scratch->warmboot_addr;
 	unsigned int hartindex = current_hartindex();
+	struct sbi_hartmask assigned;
 	unsigned long prev_mode;
 	unsigned long i;
 	int ret;
@@ -162,16 +248,13 @@ int sbi_system_suspend(u32 sleep_type, ulong resume_addr, ulong opaque)
 	if (prev_mode != PRV_S && prev_mode != PRV_U)
 		return SBI_EFAIL;
 
-	spin_lock(&dom->assigned_harts_lock);
-	sbi_hartmask_for_each_hartindex(i, &dom->assigned_harts) {
+	sbi_domain_get_assigned_hartmask(dom, &assigned);
+	sbi_hartmask_for_each_hartindex(i, &assigned) {
 		if (i == hartindex)
 			continue;
-		if (__sbi_hsm_hart_get_state(i) != SBI_HSM_STATE_STOPPED) {
-			spin_unlock(&dom->assigned_harts_lock);
+		if (__sbi_hsm_hart_get_state(i) != SBI_HSM_STATE_STOPPED)
 			return SBI_ERR_DENIED;
-		}
 	}
-	spin_unlock(&dom->assigned_harts_lock);
 
 	if (!sbi_domain_check_addr(dom, resume_addr, prev_mode,
 				   SBI_DOMAIN_EXECUTE))
@@ -11,6 +11,7 @@
 #include <sbi/riscv_barrier.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_platform.h>
@@ -19,9 +20,93 @@
 #include <sbi/sbi_timer.h>
 
 static unsigned long time_delta_off;
+
+/*
+ * Per-HART timer queue. The entries are sorted by deadline, and the
+ * supervisor deadline is tracked separately when it shares the M-mode
+ * timer compare register (no Sstc). The last value written to the
+ * compare register is cached so that re-arming with the same deadline
+ * skips the device write. Only the owner HART accesses its queue and
+ * always with interrupts disabled.
+ */
+struct timer_queue {
+	struct sbi_dlist entries;
+	u64 s_deadline;
+	bool s_armed;
+	bool cmp_valid;
+	u64 cmp;
+};
+
+static unsigned long timer_queue_off;
+
+/*
+ * Scratch offset of the flag which lets the trap entry of a HART handle
+ * SBI set_timer calls without entering C (see fw_base.S).
+ */
+unsigned long sbi_timer_fast_off;
+
+/*
+ * Per-HART state of the rdtime trap entry fast path (see fw_base.S).
+ * The time_addr member is only set while the fast path is allowed and
+ * the save members are used by the trap entry to spill registers.
+ */
+struct sbi_timer_rdtime_fast {
+	volatile u64 *time_addr;
+	volatile u64 *hart_time_addr;
+	unsigned long save_t1;
+	unsigned long save_t2;
+};
+
+unsigned long sbi_timer_rdtime_off;
 static u64 (*get_time_val)(void);
 static const struct sbi_timer_device *timer_dev = NULL;
 
+/*
+ * Fixed-point reciprocals of the timer frequency for the common delay
+ * units, so that converting a delay into ticks is a multiply and a shift
+ * instead of a 64-bit division (a libquad call on RV32).
+ */
+struct timer_unit_mult {
+	u64 unit_freq;
+	u32 mult_hi;
+	u32 mult_lo;
+};
+
+static struct timer_unit_mult timer_unit_mults[] = {
+	{ .unit_freq = 1000 },
+	{ .unit_freq = 1000000 },
+};
+
+static void timer_unit_mults_init(unsigned long freq)
+{
+	struct timer_unit_mult *m;
+	int i;
+
+	for (i = 0; i < array_size(timer_unit_mults); i++) {
+		m = &timer_unit_mults[i];
+		m->mult_hi = freq / m->unit_freq;
+		m->mult_lo = ((u64)(freq % m->unit_freq) << 32) / m->unit_freq;
+	}
+}
+
+static u64 timer_units_to_ticks(u64 units, u64 unit_freq)
+{
+	const struct timer_unit_mult *m;
+	int i;
+
+	if (units <= (u32)-1) {
+		for (i = 0; i < array_size(timer_unit_mults); i++) {
+			m = &timer_unit_mults[i];
+			if (m->unit_freq != unit_freq)
+				continue;
+			return units * m->mult_hi +
+			       ((units * m->mult_lo) >> 32);
+		}
+	}
+
+	return ((u64)timer_dev->timer_freq * units) / unit_freq;
+}
+
 #if __riscv_xlen == 32
 static u64 get_ticks(void)
 {
@@ -49,6 +134,44 @@ static void nop_delay_fn(void *opaque)
 	cpu_relax();
 }
 
+#ifdef CONFIG_SBI_TIMER_WFI_DELAY
+static void wfi_delay_expired(struct sbi_timer_entry *entry)
+{
+}
+
+/*
+ * Sleep until the timer reaches the given value. WFI also wakes up for
+ * interrupts which are enabled in MIE while MSTATUS.MIE is clear, so the
+ * expired entry never has to be taken as a trap. Leaving the compare
+ * register armed after removing the entry is harmless.
+ */
+static bool timer_wfi_delay(u64 start_val, u64 delta)
+{
+	struct sbi_timer_entry entry;
+	unsigned long min_delta;
+
+	min_delta = (timer_dev->timer_freq / 1000000) *
+		    CONFIG_SBI_TIMER_WFI_DELAY_MIN_US;
+	if (delta < min_delta)
+		return false;
+
+	sbi_timer_entry_init(&entry, wfi_delay_expired);
+	if (sbi_timer_add_entry(&entry, start_val + delta))
+		return false;
+
+	while ((get_time_val() - start_val) < delta)
+		wfi();
+
+	sbi_timer_del_entry(&entry);
+	return true;
+}
+#else
+static bool timer_wfi_delay(u64 start_val, u64 delta)
+{
+	return false;
+}
+#endif
+
 void sbi_timer_delay_loop(ulong units, u64 unit_freq,
 			  void (*delay_fn)(void *), void *opaque)
 {
@@ -64,12 +187,14 @@ void sbi_timer_delay_loop(ulong units, u64 unit_freq,
 	start_val = get_time_val();
 
 	/* Compute desired timer value delta */
-	delta = ((u64)timer_dev->timer_freq * (u64)units);
-	delta = delta / unit_freq;
+	delta = timer_units_to_ticks(units, unit_freq);
 
 	/* Use NOP delay function if delay function not available */
-	if (!delay_fn)
+	if (!delay_fn) {
+		if (timer_wfi_delay(start_val, delta))
+			return;
 		delay_fn = nop_delay_fn;
+	}
 
 	/* Busy loop until desired timer value delta reached */
 	while ((get_time_val() - start_val) < delta)
@@ -80,9 +205,7 @@ bool sbi_timer_waitms_until(bool (*predicate)(void *), void *arg,
 			    uint64_t timeout_ms)
 {
 	uint64_t start_time = sbi_timer_value();
-	uint64_t ticks =
-		(sbi_timer_get_device()->timer_freq / 1000) *
-		timeout_ms;
+	uint64_t ticks = timer_units_to_ticks(timeout_ms, 1000);
 	while(!predicate(arg))
 		if (sbi_timer_value() - start_time  >= ticks)
 			return false;
@@ -130,38 +253,285 @@ void sbi_timer_set_delta_upper(ulong delta_upper)
 }
 #endif
 
+static struct timer_queue *timer_thishart_queue(void)
+{
+	return sbi_scratch_thishart_offset_ptr(timer_queue_off);
+}
+
+/*
+ * Program the M-mode timer compare register with the earliest of the
+ * queued entries and the supervisor deadline. Returns false if there
+ * is nothing to wait for.
+ */
+static bool timer_queue_program(struct timer_queue *tq)
+{
+	struct sbi_timer_entry *first;
+	u64 next = -1ULL;
+	bool armed = false;
+
+	if (!sbi_list_empty(&tq->entries)) {
+		first = sbi_list_first_entry(&tq->entries,
+					     struct sbi_timer_entry, node);
+		next = first->deadline;
+		armed = true;
+	}
+
+	if (tq->s_armed && (!armed || tq->s_deadline < next)) {
+		next = tq->s_deadline;
+		armed = true;
+	}
+
+	if (armed && timer_dev && timer_dev->timer_event_start &&
+	    (!tq->cmp_valid || tq->cmp != next)) {
+		timer_dev->timer_event_start(next);
+		tq->cmp = next;
+		tq->cmp_valid = true;
+	}
+
+	return armed;
+}
+
 void sbi_timer_event_start(u64 next_event)
 {
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+
 	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_SET_TIMER);
 
 	/**
 	 * Update the stimecmp directly if available. This allows
 	 * the older software to leverage sstc extension on newer hardware.
 	 */
-	if (sbi_hart_has_extension(sbi_scratch_thishart_ptr(), SBI_HART_EXT_SSTC)) {
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SSTC)) {
+		/* The supervisor may also write stimecmp so compare with it */
 #if __riscv_xlen == 32
-		csr_write(CSR_STIMECMP, next_event & 0xFFFFFFFF);
-		csr_write(CSR_STIMECMPH, next_event >> 32);
+		if (csr_read(CSR_STIMECMP) != (next_event & 0xFFFFFFFF) ||
+		    csr_read(CSR_STIMECMPH) != (next_event >> 32)) {
+			csr_write(CSR_STIMECMP, next_event & 0xFFFFFFFF);
+			csr_write(CSR_STIMECMPH, next_event >> 32);
+		}
 #else
-		csr_write(CSR_STIMECMP, next_event);
+		if (csr_read(CSR_STIMECMP) != next_event)
+			csr_write(CSR_STIMECMP, next_event);
 #endif
 	} else if (timer_dev && timer_dev->timer_event_start) {
-		timer_dev->timer_event_start(next_event);
+		struct timer_queue *tq = sbi_scratch_offset_ptr(scratch,
+							timer_queue_off);
+		u64 slack = sbi_scratch_to_domain(scratch)->timer_slack;
+
+		/*
+		 * Round the deadline up to the domain timer slack, a power
+		 * of 2, so that nearby deadlines of all HARTs fire on the
+		 * same tick.
+		 */
+		if (slack && next_event <= (-1ULL - slack))
+			next_event = (next_event + slack - 1) & ~(slack - 1);
+
+		tq->s_deadline = next_event;
+		tq->s_armed = true;
+		timer_queue_program(tq);
 		csr_clear(CSR_MIP, MIP_STIP);
 	}
 	csr_set(CSR_MIE, MIP_MTIP);
 }
 
+static void timer_queue_insert(struct timer_queue *tq,
+			       struct sbi_timer_entry *entry)
+{
+	struct sbi_timer_entry *pos;
+
+	/* Entries with the same deadline expire in the order of insertion */
+	sbi_list_for_each_entry(pos, &tq->entries, node) {
+		if (entry->deadline < pos->deadline) {
+			sbi_list_add_tail(&entry->node, &pos->node);
+			return;
+		}
+	}
+
+	sbi_list_add_tail(&entry->node, &tq->entries);
+}
+
+int sbi_timer_add_entry(struct sbi_timer_entry *entry, u64 deadline)
+{
+	struct timer_queue *tq;
+
+	if (!entry || !entry->callback)
+		return SBI_EINVAL;
+	if (!timer_queue_off || !timer_dev || !timer_dev->timer_event_start)
+		return SBI_ENODEV;
+
+	tq = timer_thishart_queue();
+	sbi_list_del_init(&entry->node);
+	entry->deadline = deadline;
+	timer_queue_insert(tq, entry);
+
+	timer_queue_program(tq);
+	csr_set(CSR_MIE, MIP_MTIP);
+
+	return 0;
+}
+
+void sbi_timer_del_entry(struct sbi_timer_entry *entry)
+{
+	if (!entry || !timer_queue_off)
+		return;
+
+	/* The compare register is left alone, an early interrupt is harmless */
+	sbi_list_del_init(&entry->node);
+}
+
+u64 sbi_timer_next_event(void)
+{
+	struct sbi_timer_entry *first;
+	struct timer_queue *tq;
+	u64 next = -1ULL, s_next;
+
+	if (!timer_queue_off)
+		return next;
+
+	tq = timer_thishart_queue();
+	if (!sbi_list_empty(&tq->entries)) {
+		first = sbi_list_first_entry(&tq->entries,
+					     struct sbi_timer_entry, node);
+		next = first->deadline;
+	}
+
+	if (sbi_hart_has_extension(sbi_scratch_thishart_ptr(), SBI_HART_EXT_SSTC)) {
+#if __riscv_xlen == 32
+		s_next = ((u64)csr_read(CSR_STIMECMPH) << 32) |
+			 csr_read(CSR_STIMECMP);
+#else
+		s_next = csr_read(CSR_STIMECMP);
+#endif
+	} else {
+		s_next = (tq->s_armed) ? tq->s_deadline : -1ULL;
+	}
+
+	return (s_next < next) ? s_next : next;
+}
+
+void sbi_timer_context_switch(struct sbi_timer_context *prev,
+			      const struct sbi_timer_context *next)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct timer_queue *tq;
+	u64 deadline;
+
+	/*
+	 * With Sstc the interrupt follows stimecmp so an expired deadline
+	 * becomes pending as soon as it is written back. A context which
+	 * never armed its timer gets one which never fires.
+	 */
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SSTC)) {
+		deadline = (next->armed) ? next->deadline : -1ULL;
+#if __riscv_xlen == 32
+		prev->deadline = ((u64)csr_read(CSR_STIMECMPH) << 32) |
+				 csr_read(CSR_STIMECMP);
+		csr_write(CSR_STIMECMP, -1UL);
+		csr_write(CSR_STIMECMPH, deadline >> 32);
+		csr_write(CSR_STIMECMP, deadline & 0xFFFFFFFF);
+#else
+		prev->deadline = csr_swap(CSR_STIMECMP, deadline);
+#endif
+		prev->armed = true;
+		prev->pending = false;
+		return;
+	}
+
+	if (!timer_queue_off)
+		return;
+
+	/* Otherwise the supervisor deadline shares the M-mode timer queue */
+	tq = sbi_scratch_offset_ptr(scratch, timer_queue_off);
+	prev->deadline = tq->s_deadline;
+	prev->armed = tq->s_armed;
+	prev->pending = !!(csr_read_clear(CSR_MIP, MIP_STIP) & MIP_STIP);
+
+	tq->s_deadline = next->deadline;
+	tq->s_armed = next->armed;
+	if (next->pending ||
+	    (next->armed && next->deadline <= sbi_timer_value())) {
+		tq->s_armed = false;
+		csr_set(CSR_MIP, MIP_STIP);
+	}
+
+	/* A stale compare value only causes a spurious M-mode interrupt */
+	if (timer_queue_program(tq))
+		csr_set(CSR_MIE, MIP_MTIP);
+}
+
+void sbi_timer_fast_path_allow(struct sbi_scratch *scratch, bool allow)
+{
+	struct sbi_timer_rdtime_fast *rdtime;
+	unsigned long fast;
+
+	/* The fast paths count no PMU events */
+	if (sbi_timer_rdtime_off) {
+		rdtime = sbi_scratch_offset_ptr(scratch, sbi_timer_rdtime_off);
+		rdtime->time_addr = allow ? rdtime->hart_time_addr : NULL;
+	}
+
+	if (!sbi_timer_fast_off)
+		return;
+
+	/* The set_timer fast path only writes stimecmp */
+	fast = allow && sbi_hart_has_extension(scratch, SBI_HART_EXT_SSTC);
+	sbi_scratch_write_type(scratch, unsigned long, sbi_timer_fast_off, fast);
+}
+
+/*
+ * The rdtime fast path reads the memory mapped timer of the HART and
+ * checks the counter enable CSRs so it needs S-mode and privileged
+ * spec v1.10 or higher.
+ */
+static void timer_rdtime_fast_init(struct sbi_scratch *scratch)
+{
+	struct sbi_timer_rdtime_fast *rdtime;
+
+	if (!sbi_timer_rdtime_off)
+		return;
+
+	rdtime = sbi_scratch_offset_ptr(scratch, sbi_timer_rdtime_off);
+	rdtime->hart_time_addr = NULL;
+
+	if (!timer_dev || !timer_dev->timer_value_addr ||
+	    !misa_extension('S') ||
+	    sbi_hart_priv_version(scratch) < SBI_HART_PRIV_VER_1_10)
+		return;
+
+	rdtime->hart_time_addr = timer_dev->timer_value_addr();
+}
+
 void sbi_timer_process(void)
 {
+	struct timer_queue *tq = timer_thishart_queue();
+	struct sbi_timer_entry *entry;
+	u64 now = sbi_timer_value();
+
 	csr_clear(CSR_MIE, MIP_MTIP);
+
+	/* Run all expired entries of this HART in one go */
+	while (!sbi_list_empty(&tq->entries)) {
+		entry = sbi_list_first_entry(&tq->entries,
+					     struct sbi_timer_entry, node);
+		if (now < entry->deadline)
+			break;
+		sbi_list_del_init(&entry->node);
+		entry->callback(entry);
+	}
+
 	/*
 	 * If sstc extension is available, supervisor can receive the timer
-	 * directly without M-mode come in between. This function should
-	 * only invoked if M-mode programs the timer for its own purpose.
+	 * directly without M-mode come in between. Otherwise forward the
+	 * interrupt once the supervisor deadline expired.
 	 */
-	if (!sbi_hart_has_extension(sbi_scratch_thishart_ptr(), SBI_HART_EXT_SSTC))
+	if (!sbi_hart_has_extension(sbi_scratch_thishart_ptr(), SBI_HART_EXT_SSTC) &&
+	    tq->s_armed && tq->s_deadline <= now) {
+		tq->s_armed = false;
 		csr_set(CSR_MIP, MIP_STIP);
+	}
+
+	if (timer_queue_program(tq))
+		csr_set(CSR_MIE, MIP_MTIP);
 }
 
 const struct sbi_timer_device *sbi_timer_get_device(void)
@@ -175,12 +545,14 @@ void sbi_timer_set_device(const struct sbi_timer_device *dev)
 		return;
 
 	timer_dev = dev;
+	timer_unit_mults_init(timer_dev->timer_freq);
 	if (!get_time_val && timer_dev->timer_value)
 		get_time_val = timer_dev->timer_value;
 }
 
 int sbi_timer_init(struct sbi_scratch *scratch, bool cold_boot)
 {
+	struct timer_queue *tq;
 	u64 *time_delta;
 	const struct sbi_platform *plat = sbi_platform_ptr(scratch);
 	int ret;
@@ -190,6 +562,24 @@ int sbi_timer_init(struct sbi_scratch *scratch, bool cold_boot)
 		if (!time_delta_off)
 			return SBI_ENOMEM;
 
+		timer_queue_off = sbi_scratch_alloc_offset(sizeof(*tq));
+		if (!timer_queue_off)
+			return SBI_ENOMEM;
+
+#ifdef CONFIG_SBI_ECALL_FAST_SET_TIMER
+		sbi_timer_fast_off =
+			sbi_scratch_alloc_type_offset(unsigned long);
+		if (!sbi_timer_fast_off)
+			return SBI_ENOMEM;
+#endif
+
+#ifdef CONFIG_SBI_FAST_RDTIME
+		sbi_timer_rdtime_off = sbi_scratch_alloc_offset(
+					sizeof(struct sbi_timer_rdtime_fast));
+		if (!sbi_timer_rdtime_off)
+			return SBI_ENOMEM;
+#endif
+
 		if (sbi_hart_has_extension(scratch, SBI_HART_EXT_ZICNTR))
 			get_time_val = get_ticks;
 
@@ -197,26 +587,47 @@ int sbi_timer_init(struct sbi_scratch *scratch, bool cold_boot)
 		if (ret)
 			return ret;
 	} else {
-		if (!time_delta_off)
+		if (!time_delta_off || !timer_queue_off)
 			return SBI_ENOMEM;
 	}
 
 	time_delta = sbi_scratch_offset_ptr(scratch, time_delta_off);
 	*time_delta = 0;
 
+	tq = sbi_scratch_offset_ptr(scratch, timer_queue_off);
+	SBI_INIT_LIST_HEAD(&tq->entries);
+	tq->s_armed = false;
+	tq->cmp_valid = false;
+
 	if (timer_dev && timer_dev->warm_init) {
 		ret = timer_dev->warm_init();
 		if (ret)
 			return ret;
 	}
 
+	timer_rdtime_fast_init(scratch);
+	sbi_timer_fast_path_allow(scratch, true);
+
 	return 0;
 }
 
 void sbi_timer_exit(struct sbi_scratch *scratch)
 {
+	struct timer_queue *tq = sbi_scratch_offset_ptr(scratch,
+							timer_queue_off);
+	struct sbi_timer_entry *entry;
+
+	/* Pending entries are dropped when the HART stops */
+	while (!sbi_list_empty(&tq->entries)) {
+		entry = sbi_list_first_entry(&tq->entries,
+					     struct sbi_timer_entry, node);
+		sbi_list_del_init(&entry->node);
+	}
+	tq->s_armed = false;
+
 	if (timer_dev && timer_dev->timer_event_stop)
 		timer_dev->timer_event_stop();
+	tq->cmp_valid = false;
 
 	csr_clear(CSR_MIP, MIP_STIP);
 	csr_clear(CSR_MIE, MIP_MTIP);
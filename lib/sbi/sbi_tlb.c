@@ -11,29 +11,182 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/riscv_atomic.h>
 #include <sbi/riscv_barrier.h>
+#include <sbi/sbi_bitops.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_fifo.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
+#include <sbi/sbi_hsm.h>
 #include <sbi/sbi_ipi.h>
+#include <sbi/sbi_math.h>
+#include <sbi/sbi_mpsc_fifo.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_tlb.h>
+#include <sbi/sbi_tprintf.h>
 #include <sbi/sbi_hfence.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_pmu.h>
 
+/*
+ * Requests targeting at least this many harts are sent in broadcast
+ * mode where the descriptor is published once by the source hart and
+ * every target only gets a small reference queued.
+ */
+#define TLB_BCAST_MIN_TARGETS		8
+
+/** Remote fence descriptor shared by all targets of a broadcast */
+struct tlb_bcast {
+	struct sbi_tlb_info tinfo;
+	unsigned long gen;
+	atomic_t pending;
+#ifdef CONFIG_SBI_TLB_CLUSTER_FANOUT
+	/* Target harts of a broadcast which is fanned out per cluster */
+	bool grouped;
+	struct sbi_hartmask targets;
+#endif
+};
+
+/** Reference to a broadcast descriptor queued on a target hart */
+struct tlb_bcast_ref {
+	struct tlb_bcast *bcast;
+	unsigned long gen;
+	/* The target forwards the reference to the targets of its cluster */
+	bool forward;
+};
+
+/** Remote fence request passed to the IPI update callback */
+struct tlb_request {
+	struct sbi_tlb_info *tinfo;
+	struct tlb_bcast *bcast;
+	/* Ranges of a request for a list of ranges */
+	const struct sbi_tlb_desc *descs;
+	u32 count;
+#ifdef CONFIG_SBI_TLB_CLUSTER_FANOUT
+	/* Clusters which already have a hart forwarding the broadcast */
+	unsigned long clusters_done;
+	/* Sent by a hart forwarding a broadcast for its source hart */
+	bool forward;
+#endif
+};
+
+/* Number of asynchronous requests a hart can have in flight */
+#define TLB_ASYNC_SLOTS			4
+
+/*
+ * Source entries of a request carry the completion counter of the
+ * source hart above its HART index. Counter zero is shared by the
+ * synchronous requests and the overflow state, which signals completion
+ * once per source hart, and counter i + 1 belongs to asynchronous slot i.
+ */
+#define TLB_SRC_SLOT_SHIFT		12
+#define TLB_SRC_INDEX(__src)		((__src) & (BIT(TLB_SRC_SLOT_SHIFT) - 1))
+#define TLB_SRC_SLOT(__src)		((__src) >> TLB_SRC_SLOT_SHIFT)
+
+_Static_assert(SBI_HARTMASK_MAX_BITS <= BIT(TLB_SRC_SLOT_SHIFT) &&
+	       TLB_ASYNC_SLOTS < BIT(16 - TLB_SRC_SLOT_SHIFT),
+	       "TLB source entries can not hold the completion counter");
+
+/** Per-hart state of asynchronous remote fence requests */
+struct tlb_async {
+	bool enabled;
+	/* Counter of the request being sent, zero when synchronous */
+	u8 slot;
+	/* Forwarding a broadcast whose source hart waits for completion */
+	bool forwarding;
+	/* Token of the latest request */
+	unsigned long issued;
+	struct {
+		/* Token in flight in the slot, zero when the slot is free */
+		unsigned long token;
+		/* The request also waits for the broadcast descriptor */
+		bool bcast;
+	} slots[TLB_ASYNC_SLOTS];
+};
+
+/**
+ * Sticky overflow state of a hart which records the request types to
+ * be flushed entirely and the source harts waiting for completion
+ * when the fifo of the hart was full. The deferred types are recorded
+ * without any source hart waiting while the hart is suspended and are
+ * flushed when it resumes.
+ */
+struct tlb_overflow {
+	unsigned long types;
+	unsigned long deferred;
+	struct sbi_hartmask smask;
+};
+
+/*
+ * Request types which can be collapsed into a flush of everything of
+ * the type. There is no way to flush the VS-stage of all VMIDs at once
+ * so the HFENCE.VVMA types are never collapsed.
+ */
+#define TLB_OVERFLOW_TYPES		(BIT(SBI_TLB_FENCE_I) |		\
+					 BIT(SBI_TLB_SFENCE_VMA) |		\
+					 BIT(SBI_TLB_SFENCE_VMA_ASID) |	\
+					 BIT(SBI_TLB_HFENCE_GVMA_VMID) |	\
+					 BIT(SBI_TLB_HFENCE_GVMA))
+
+/* Maximum number of fifo entries drained and merged at a time */
+#define TLB_BATCH_MAX			8
+
+/* Maximum number of broadcast references drained along with them */
+#define TLB_BCAST_BATCH_MAX		4
+
+/* Type of a drained entry whose range was folded into another entry */
+#define TLB_TYPE_MERGED			SBI_TLB_TYPE_MAX
+
+/* Every hart has a fifo of these so keep them within four words on RV64 */
+_Static_assert(sizeof(struct sbi_tlb_info) <= 2 * sizeof(unsigned long) + 16,
+	       "struct sbi_tlb_info grew");
+
 static unsigned long tlb_sync_off;
 static unsigned long tlb_fifo_off;
 static unsigned long tlb_fifo_mem_off;
+static unsigned long tlb_bcast_off;
+static unsigned long tlb_bcast_fifo_off;
+static unsigned long tlb_bcast_fifo_mem_off;
+static unsigned long tlb_async_off;
+static unsigned long tlb_overflow_off;
+static unsigned long tlb_flush_limit_off;
+#ifdef CONFIG_SBI_TLB_CLUSTER_FANOUT
+/* Scratch offset of the cluster plus one of the hart, zero if unknown */
+static unsigned long tlb_cluster_off;
+#endif
+static u32 tlb_event = SBI_IPI_EVENT_MAX;
+/* Largest range flush limit of all harts */
 static unsigned long tlb_range_flush_limit;
 
+/*
+ * Check whether the drain of the fifos should make way for another IPI
+ * or an external interrupt. The M-mode timer does not count since its
+ * deadline stays in the compare register and it is taken right after
+ * the drain anyway. IPIs are no longer taken once the hart is on its
+ * way out so the drain is never cut short then.
+ */
+static bool tlb_process_should_yield(void)
+{
+	unsigned long mie = csr_read(CSR_MIE);
+
+	if (!(mie & MIP_MSIP))
+		return false;
+
+	return csr_read(CSR_MIP) & mie & (MIP_MSIP | MIP_MEIP);
+}
+
 static void tlb_flush_all(void)
 {
 	__asm__ __volatile("sfence.vma");
 }
 
+static inline bool tlb_range_is_flush_all(struct sbi_tlb_info *tinfo)
+{
+	return (tinfo->start == 0 && tinfo->size == 0) ||
+	       (tinfo->size == SBI_TLB_FLUSH_ALL);
+}
+
 static void sbi_tlb_local_hfence_vvma(struct sbi_tlb_info *tinfo)
 {
 	unsigned long start = tinfo->start;
@@ -208,84 +361,589 @@ static void tlb_entry_local_process(struct sbi_tlb_info *data)
 	};
 }
 
-static void tlb_entry_process(struct sbi_tlb_info *tinfo)
+/*
+ * Issue the Svinval invalidations for a request without any ordering.
+ * The caller must surround a batch of these with SFENCE.W.INVAL and
+ * SFENCE.INVAL.IR.
+ */
+static void tlb_entry_local_inval(struct sbi_tlb_info *tinfo)
 {
-	u32 rindex;
-	struct sbi_scratch *rscratch = NULL;
-	atomic_t *rtlb_sync = NULL;
+	unsigned long start = tinfo->start;
+	unsigned long size  = tinfo->size;
+	unsigned long asid  = tinfo->asid;
+	unsigned long vmid  = tinfo->vmid;
+	bool flush_all = tlb_range_is_flush_all(tinfo);
+	unsigned long i, hgatp;
 
-	tlb_entry_local_process(tinfo);
+	switch (tinfo->type) {
+	case SBI_TLB_FENCE_I:
+		sbi_tlb_local_fence_i(tinfo);
+		break;
+	case SBI_TLB_SFENCE_VMA:
+		sbi_pmu_ctr_incr_fw(SBI_PMU_FW_SFENCE_VMA_RCVD);
+		if (flush_all) {
+			__sbi_sinval_vma_all();
+			break;
+		}
+		for (i = 0; i < size; i += PAGE_SIZE)
+			__sbi_sinval_vma_va(start + i);
+		break;
+	case SBI_TLB_SFENCE_VMA_ASID:
+		sbi_pmu_ctr_incr_fw(SBI_PMU_FW_SFENCE_VMA_ASID_RCVD);
+		if (flush_all) {
+			__sbi_sinval_vma_asid(asid);
+			break;
+		}
+		for (i = 0; i < size; i += PAGE_SIZE)
+			__sbi_sinval_vma_asid_va(start + i, asid);
+		break;
+	case SBI_TLB_HFENCE_GVMA_VMID:
+		sbi_pmu_ctr_incr_fw(SBI_PMU_FW_HFENCE_GVMA_VMID_RCVD);
+		if (flush_all) {
+			__sbi_hinval_gvma_vmid(vmid);
+			break;
+		}
+		for (i = 0; i < size; i += PAGE_SIZE)
+			__sbi_hinval_gvma_vmid_gpa((start + i) >> 2, vmid);
+		break;
+	case SBI_TLB_HFENCE_GVMA:
+		sbi_pmu_ctr_incr_fw(SBI_PMU_FW_HFENCE_GVMA_RCVD);
+		if (flush_all) {
+			__sbi_hinval_gvma_all();
+			break;
+		}
+		for (i = 0; i < size; i += PAGE_SIZE)
+			__sbi_hinval_gvma_gpa((start + i) >> 2);
+		break;
+	case SBI_TLB_HFENCE_VVMA_ASID:
+		sbi_pmu_ctr_incr_fw(SBI_PMU_FW_HFENCE_VVMA_ASID_RCVD);
+		hgatp = csr_swap(CSR_HGATP,
+				 (vmid << HGATP_VMID_SHIFT) & HGATP_VMID_MASK);
+		if (flush_all)
+			__sbi_hinval_vvma_asid(asid);
+		else
+			for (i = 0; i < size; i += PAGE_SIZE)
+				__sbi_hinval_vvma_asid_va(start + i, asid);
+		csr_write(CSR_HGATP, hgatp);
+		break;
+	case SBI_TLB_HFENCE_VVMA:
+		sbi_pmu_ctr_incr_fw(SBI_PMU_FW_HFENCE_VVMA_RCVD);
+		hgatp = csr_swap(CSR_HGATP,
+				 (vmid << HGATP_VMID_SHIFT) & HGATP_VMID_MASK);
+		if (flush_all)
+			__sbi_hinval_vvma_all();
+		else
+			for (i = 0; i < size; i += PAGE_SIZE)
+				__sbi_hinval_vvma_va(start + i);
+		csr_write(CSR_HGATP, hgatp);
+		break;
+	default:
+		break;
+	};
+}
 
-	sbi_hartmask_for_each_hartindex(rindex, &tinfo->smask) {
-		rscratch = sbi_hartindex_to_scratch(rindex);
-		if (!rscratch)
-			continue;
+/*
+ * Perform the local part of a batch of requests. With Svinval the whole
+ * batch is ordered only once instead of once per invalidated page.
+ */
+static void tlb_entries_local_process(struct sbi_scratch *scratch,
+				      struct sbi_tlb_info *batch, u32 count)
+{
+	u32 i;
+	unsigned long limit =
+		sbi_scratch_read_type(scratch, unsigned long, tlb_flush_limit_off);
+
+	/* Ranges beyond the limit of this hart are cheaper to flush fully */
+	for (i = 0; i < count; i++) {
+		if (batch[i].size > limit) {
+			batch[i].start = 0;
+			batch[i].size  = SBI_TLB_FLUSH_ALL;
+		}
+	}
 
-		rtlb_sync = sbi_scratch_offset_ptr(rscratch, tlb_sync_off);
-		atomic_sub_return(rtlb_sync, 1);
+	if (!sbi_hart_has_extension(scratch, SBI_HART_EXT_SVINVAL)) {
+		for (i = 0; i < count; i++)
+			tlb_entry_local_process(&batch[i]);
+		return;
 	}
+
+	__sbi_sfence_w_inval();
+	for (i = 0; i < count; i++)
+		tlb_entry_local_inval(&batch[i]);
+	__sbi_sfence_inval_ir();
 }
 
-static bool tlb_process_once(struct sbi_scratch *scratch)
+/* Completion counter of a hart for synchronous requests or a slot */
+static atomic_t *tlb_sync_counter(struct sbi_scratch *scratch, u32 slot)
 {
-	struct sbi_tlb_info tinfo;
-	struct sbi_fifo *tlb_fifo =
-			sbi_scratch_offset_ptr(scratch, tlb_fifo_off);
+	atomic_t *tlb_sync = sbi_scratch_offset_ptr(scratch, tlb_sync_off);
 
-	if (!sbi_fifo_dequeue(tlb_fifo, &tinfo)) {
-		tlb_entry_process(&tinfo);
-		return true;
-	}
+	return &tlb_sync[slot];
+}
 
-	return false;
+/* Signal completion of a request to a hart waiting for it */
+static void tlb_source_complete(u32 src)
+{
+	struct sbi_scratch *rscratch =
+			sbi_hartindex_to_scratch(TLB_SRC_INDEX(src));
+
+	if (!rscratch)
+		return;
+
+	atomic_sub_return(tlb_sync_counter(rscratch, TLB_SRC_SLOT(src)), 1);
 }
 
-static void tlb_process(struct sbi_scratch *scratch)
+/* Signal completion of a request to all harts waiting for it */
+static void tlb_entry_complete(struct sbi_tlb_info *tinfo)
 {
-	while (tlb_process_once(scratch));
+	u32 i;
+
+	for (i = 0; i < tinfo->src_count; i++)
+		tlb_source_complete(tinfo->src[i]);
 }
 
-static void tlb_sync(struct sbi_scratch *scratch)
+/* Check whether a hart is one of the source harts of a request */
+static bool tlb_entry_has_source(struct sbi_tlb_info *tinfo, u32 hartindex)
 {
-	atomic_t *tlb_sync =
-			sbi_scratch_offset_ptr(scratch, tlb_sync_off);
+	u32 i;
 
-	while (atomic_read(tlb_sync) > 0) {
-		/*
-		 * While we are waiting for remote hart to set the sync,
-		 * consume fifo requests to avoid deadlock.
-		 */
-		tlb_process_once(scratch);
-	}
+	for (i = 0; i < tinfo->src_count; i++)
+		if (tinfo->src[i] == hartindex)
+			return true;
 
-	return;
+	return false;
+}
+
+/* Check whether two requests invalidate the same address space */
+static bool tlb_same_context(struct sbi_tlb_info *curr,
+			     struct sbi_tlb_info *next)
+{
+	if (curr->type != next->type)
+		return false;
+
+	switch (curr->type) {
+	case SBI_TLB_FENCE_I:
+	case SBI_TLB_SFENCE_VMA:
+	case SBI_TLB_HFENCE_GVMA:
+		return true;
+	case SBI_TLB_SFENCE_VMA_ASID:
+		return curr->asid == next->asid;
+	case SBI_TLB_HFENCE_GVMA_VMID:
+	case SBI_TLB_HFENCE_VVMA:
+		return curr->vmid == next->vmid;
+	case SBI_TLB_HFENCE_VVMA_ASID:
+		return curr->asid == next->asid && curr->vmid == next->vmid;
+	default:
+		return false;
+	};
 }
 
+/*
+ * Merge the range of next into curr when the two ranges overlap or are
+ * adjacent. A merged range larger than tlb_range_flush_limit is turned
+ * into a flush of the whole address space of the request.
+ */
 static inline int tlb_range_check(struct sbi_tlb_info *curr,
 					struct sbi_tlb_info *next)
 {
 	unsigned long curr_end;
 	unsigned long next_end;
-	int ret = SBI_FIFO_UNCHANGED;
 
 	if (!curr || !next)
-		return ret;
+		return SBI_FIFO_UNCHANGED;
+
+	if (tlb_range_is_flush_all(curr))
+		return SBI_FIFO_SKIP;
+
+	if (tlb_range_is_flush_all(next)) {
+		curr->start = 0;
+		curr->size  = SBI_TLB_FLUSH_ALL;
+		return SBI_FIFO_UPDATED;
+	}
 
 	next_end = next->start + next->size;
 	curr_end = curr->start + curr->size;
-	if (next->start <= curr->start && next_end > curr_end) {
+	if (next->start > curr_end || curr->start > next_end)
+		return SBI_FIFO_UNCHANGED;
+
+	if (next->start >= curr->start && next_end <= curr_end)
+		return SBI_FIFO_SKIP;
+
+	if (next->start < curr->start)
 		curr->start = next->start;
-		curr->size  = next->size;
-		sbi_hartmask_or(&curr->smask, &curr->smask, &next->smask);
-		ret = SBI_FIFO_UPDATED;
-	} else if (next->start >= curr->start && next_end <= curr_end) {
-		sbi_hartmask_or(&curr->smask, &curr->smask, &next->smask);
-		ret = SBI_FIFO_SKIP;
+	if (next_end < curr_end)
+		next_end = curr_end;
+	curr->size = next_end - curr->start;
+
+	if (curr->size > tlb_range_flush_limit) {
+		curr->start = 0;
+		curr->size  = SBI_TLB_FLUSH_ALL;
+	}
+
+	return SBI_FIFO_UPDATED;
+}
+
+#ifdef CONFIG_SBI_TLB_CLUSTER_FANOUT
+void sbi_tlb_set_hart_cluster(struct sbi_scratch *scratch, u32 cluster)
+{
+	if (cluster >= BITS_PER_LONG)
+		return;
+
+	if (!tlb_cluster_off) {
+		tlb_cluster_off = sbi_scratch_alloc_type_offset(u32);
+		if (!tlb_cluster_off)
+			return;
+	}
+
+	sbi_scratch_write_type(scratch, u32, tlb_cluster_off, cluster + 1);
+}
+
+static u32 tlb_hart_cluster(struct sbi_scratch *scratch)
+{
+	if (!tlb_cluster_off)
+		return 0;
+
+	return sbi_scratch_read_type(scratch, u32, tlb_cluster_off);
+}
+
+/*
+ * Queue a broadcast on the other targets in the cluster of this hart on
+ * behalf of its source hart. The forwarded targets are accounted to the
+ * source hart and the reference of this hart is completed only after
+ * forwarding so the source hart keeps waiting for all of them.
+ */
+static void tlb_bcast_forward(struct sbi_scratch *scratch,
+			      struct tlb_bcast *bcast,
+			      struct sbi_tlb_info *tinfo)
+{
+	u32 i, cluster = tlb_hart_cluster(scratch);
+	struct sbi_scratch *rscratch;
+	struct sbi_hartmask mask;
+	struct tlb_request req;
+	struct tlb_async *async =
+			sbi_scratch_offset_ptr(scratch, tlb_async_off);
+
+	sbi_hartmask_clear_all(&mask);
+	sbi_hartmask_for_each_hartindex(i, &bcast->targets) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (rscratch && rscratch != scratch &&
+		    tlb_hart_cluster(rscratch) == cluster)
+			sbi_hartmask_set_hartindex(i, &mask);
+	}
+
+	req.tinfo = tinfo;
+	req.bcast = bcast;
+	req.descs = NULL;
+	req.count = 0;
+	req.clusters_done = 0;
+	req.forward = true;
+
+	async->forwarding = true;
+	sbi_ipi_send_mask(&mask, tlb_event, &req);
+	async->forwarding = false;
+}
+
+/*
+ * Pick the first target of every other cluster to forward a broadcast
+ * to the rest of its cluster. Targets in the cluster of the sending
+ * hart or without a known cluster are sent to directly.
+ */
+static bool tlb_bcast_cluster_skip(struct sbi_scratch *scratch,
+				   struct sbi_scratch *remote_scratch,
+				   struct tlb_request *req, bool *forward)
+{
+	u32 cluster;
+
+	*forward = false;
+	if (!req->bcast || !req->bcast->grouped)
+		return false;
+
+	cluster = tlb_hart_cluster(remote_scratch);
+	if (!cluster || cluster == tlb_hart_cluster(scratch))
+		return false;
+
+	if (req->clusters_done & BIT(cluster - 1))
+		return true;
+
+	*forward = true;
+	return false;
+}
+
+static void tlb_bcast_cluster_done(struct sbi_scratch *remote_scratch,
+				   struct tlb_request *req)
+{
+	req->clusters_done |= BIT(tlb_hart_cluster(remote_scratch) - 1);
+}
+
+/* Fan out large broadcasts per cluster for the types which never retry */
+static void tlb_bcast_group(struct tlb_bcast *bcast, ulong hmask, ulong hbase)
+{
+	bcast->grouped = tlb_cluster_off &&
+			 (BIT(bcast->tinfo.type) & TLB_OVERFLOW_TYPES);
+	if (!bcast->grouped)
+		return;
+
+	if (hbase == -1UL) {
+		sbi_hartmask_set_all(&bcast->targets);
+		return;
 	}
 
+	sbi_hartmask_clear_all(&bcast->targets);
+	sbi_hartmask_set_hmask(hmask, hbase, &bcast->targets);
+}
+#else
+static inline void tlb_bcast_forward(struct sbi_scratch *scratch,
+				     struct tlb_bcast *bcast,
+				     struct sbi_tlb_info *tinfo)
+{
+}
+
+static inline bool tlb_bcast_cluster_skip(struct sbi_scratch *scratch,
+					  struct sbi_scratch *remote_scratch,
+					  struct tlb_request *req, bool *forward)
+{
+	*forward = false;
+	return false;
+}
+
+static inline void tlb_bcast_cluster_done(struct sbi_scratch *remote_scratch,
+					  struct tlb_request *req)
+{
+}
+
+static inline void tlb_bcast_group(struct tlb_bcast *bcast, ulong hmask,
+				   ulong hbase)
+{
+}
+#endif
+
+/*
+ * Take up to TLB_BCAST_BATCH_MAX broadcast references of this hart and
+ * append a copy of their descriptors to the batch. The copies have no
+ * source harts since a broadcast is completed through its pending count
+ * which is returned in bcasts once the batch has been flushed.
+ */
+static u32 tlb_bcast_drain(struct sbi_scratch *scratch,
+			   struct sbi_tlb_info *batch,
+			   struct tlb_bcast **bcasts)
+{
+	u32 count = 0;
+	struct tlb_bcast_ref ref;
+	struct sbi_mpsc_fifo *bcast_fifo =
+			sbi_scratch_offset_ptr(scratch, tlb_bcast_fifo_off);
+
+	while (count < TLB_BCAST_BATCH_MAX &&
+	       !sbi_mpsc_fifo_dequeue(bcast_fifo, &ref)) {
+		/*
+		 * The source hart does not reuse its descriptor before all
+		 * targets are done. On a generation mismatch the pending
+		 * count belongs to another request and neither flushing nor
+		 * completing this reference would be correct.
+		 */
+		if (ref.gen != __atomic_load_n(&ref.bcast->gen, __ATOMIC_ACQUIRE))
+			sbi_panic("%s: stale broadcast reference (gen %lu)\n",
+				  __func__, ref.gen);
+
+		sbi_memcpy(&batch[count], &ref.bcast->tinfo, sizeof(*batch));
+		if (ref.forward)
+			tlb_bcast_forward(scratch, ref.bcast, &batch[count]);
+		batch[count].src_count = 0;
+		bcasts[count++] = ref.bcast;
+	}
+
+	return count;
+}
+
+/*
+ * Fold the range of every drained entry into an earlier entry of the
+ * batch for the same address space. Folded entries keep their source
+ * hartmask so that completion is still signalled for them but their
+ * own flush is turned into a no-op.
+ */
+static void tlb_batch_merge(struct sbi_tlb_info *batch, u32 count)
+{
+	u32 i, j;
+
+	for (i = 1; i < count; i++) {
+		for (j = 0; j < i; j++) {
+			if (!tlb_same_context(&batch[j], &batch[i]))
+				continue;
+			if (tlb_range_check(&batch[j], &batch[i]) !=
+			    SBI_FIFO_UNCHANGED) {
+				batch[i].type = TLB_TYPE_MERGED;
+				break;
+			}
+		}
+	}
+}
+
+/* Flush everything of each request type set in the types mask */
+static void tlb_types_flush(unsigned long types)
+{
+	if (types & BIT(SBI_TLB_FENCE_I))
+		__asm__ __volatile("fence.i");
+	if (types & (BIT(SBI_TLB_SFENCE_VMA) | BIT(SBI_TLB_SFENCE_VMA_ASID)))
+		tlb_flush_all();
+	if (types & (BIT(SBI_TLB_HFENCE_GVMA) | BIT(SBI_TLB_HFENCE_GVMA_VMID)))
+		__sbi_hfence_gvma_all();
+}
+
+/* Request types whose every entry is covered by the flush of a type */
+static unsigned long tlb_types_flushed(unsigned long types)
+{
+	unsigned long ret = types & BIT(SBI_TLB_FENCE_I);
+
+	if (types & (BIT(SBI_TLB_SFENCE_VMA) | BIT(SBI_TLB_SFENCE_VMA_ASID)))
+		ret |= BIT(SBI_TLB_SFENCE_VMA) | BIT(SBI_TLB_SFENCE_VMA_ASID);
+	if (types & (BIT(SBI_TLB_HFENCE_GVMA) | BIT(SBI_TLB_HFENCE_GVMA_VMID)))
+		ret |= BIT(SBI_TLB_HFENCE_GVMA) | BIT(SBI_TLB_HFENCE_GVMA_VMID);
+
 	return ret;
 }
 
+/*
+ * Take the requests which overflowed the fifo of this hart. They are
+ * collapsed into one flush of everything per recorded type. The source
+ * harts are taken before the types so that every completed source hart
+ * had its type recorded before the flush.
+ */
+static bool tlb_overflow_take(struct sbi_scratch *scratch,
+			      struct sbi_hartmask *smask, unsigned long *types)
+{
+	u32 i;
+	bool pending = false;
+	struct tlb_overflow *ovf =
+			sbi_scratch_offset_ptr(scratch, tlb_overflow_off);
+
+	sbi_hartmask_clear_all(smask);
+	*types = 0;
+	for (i = 0; i < sbi_hartmask_nr_longs(); i++)
+		if (__atomic_load_n(&ovf->smask.bits[i], __ATOMIC_RELAXED))
+			pending = true;
+	if (!pending && !__atomic_load_n(&ovf->types, __ATOMIC_RELAXED))
+		return false;
+
+	for (i = 0; i < sbi_hartmask_nr_longs(); i++)
+		smask->bits[i] = atomic_raw_xchg_ulong(&ovf->smask.bits[i], 0);
+	smp_mb();
+	*types = atomic_raw_xchg_ulong(&ovf->types, 0);
+
+	return true;
+}
+
+/*
+ * Drain the overflowed requests, the fifo and the broadcast fifo of this
+ * hart together. The drained entries are merged with each other and with
+ * the overflow flushes, the local part of all of them is done with one
+ * fence sequence and only then the source harts are signalled.
+ */
+static bool tlb_process_once(struct sbi_scratch *scratch)
+{
+	u32 i, count = 0, nbcast;
+	unsigned long types, flushed;
+	bool overflow;
+	struct sbi_hartmask smask;
+	struct tlb_bcast *bcasts[TLB_BCAST_BATCH_MAX];
+	struct sbi_tlb_info batch[TLB_BATCH_MAX + TLB_BCAST_BATCH_MAX];
+	struct sbi_mpsc_fifo *tlb_fifo =
+			sbi_scratch_offset_ptr(scratch, tlb_fifo_off);
+
+	overflow = tlb_overflow_take(scratch, &smask, &types);
+
+	while (count < TLB_BATCH_MAX &&
+	       !sbi_mpsc_fifo_dequeue(tlb_fifo, &batch[count]))
+		count++;
+	nbcast = tlb_bcast_drain(scratch, &batch[count], bcasts);
+	count += nbcast;
+
+	if (!count && !overflow)
+		return false;
+
+	tlb_batch_merge(batch, count);
+	flushed = tlb_types_flushed(types);
+	for (i = 0; i < count; i++)
+		if (batch[i].type < TLB_TYPE_MERGED &&
+		    (flushed & BIT(batch[i].type)))
+			batch[i].type = TLB_TYPE_MERGED;
+
+	if (count)
+		tlb_entries_local_process(scratch, batch, count);
+	tlb_types_flush(types);
+
+	for (i = 0; i < count; i++)
+		tlb_entry_complete(&batch[i]);
+	for (i = 0; i < nbcast; i++)
+		atomic_sub_return(&bcasts[i]->pending, 1);
+	sbi_hartmask_for_each_hartindex(i, &smask)
+		tlb_source_complete(i);
+
+	return true;
+}
+
+/*
+ * Drain the requests of this hart one batch at a time. When another
+ * IPI or external interrupt is waiting, the TLB event is posted again
+ * to this hart and the drain continues once that interrupt has been
+ * handled.
+ */
+static void tlb_process(struct sbi_scratch *scratch)
+{
+	while (tlb_process_once(scratch)) {
+		if (tlb_process_should_yield()) {
+			sbi_ipi_event_repost(tlb_event);
+			break;
+		}
+	}
+}
+
+/* Check whether all requests sent by a hart have been processed */
+static bool tlb_sync_done(struct sbi_scratch *scratch)
+{
+	atomic_t *tlb_sync = tlb_sync_counter(scratch, 0);
+	struct tlb_bcast *bcast =
+			sbi_scratch_offset_ptr(scratch, tlb_bcast_off);
+
+	return atomic_read(tlb_sync) <= 0 && atomic_read(&bcast->pending) <= 0;
+}
+
+static void tlb_sync(struct sbi_scratch *scratch)
+{
+	long val;
+	bool zawrs = sbi_hart_has_extension(scratch, SBI_HART_EXT_ZAWRS);
+	atomic_t *tlb_sync = tlb_sync_counter(scratch, 0);
+	struct tlb_bcast *bcast =
+			sbi_scratch_offset_ptr(scratch, tlb_bcast_off);
+	struct tlb_async *async =
+			sbi_scratch_offset_ptr(scratch, tlb_async_off);
+
+	/* Asynchronous requests are completed through their token */
+	if (async->slot || async->forwarding)
+		return;
+
+	while (!tlb_sync_done(scratch)) {
+		/*
+		 * While we are waiting for remote hart to set the sync,
+		 * consume fifo requests to avoid deadlock.
+		 */
+		if (tlb_process_once(scratch) || !zawrs)
+			continue;
+
+		/*
+		 * Nothing to consume so stall until a counter changes. New
+		 * requests for this hart come with an IPI which also ends
+		 * the stall and the short timeout covers the rest.
+		 */
+		val = atomic_read(tlb_sync);
+		if (val > 0)
+			atomic_wrs_wait(tlb_sync, val, true);
+		else
+			atomic_wrs_wait(&bcast->pending,
+					atomic_read(&bcast->pending), true);
+	}
+
+	return;
+}
+
 /**
  * Call back to decide if an inplace fifo update is required or next entry can
  * can be skipped. Here are the different cases that are being handled.
@@ -294,8 +952,16 @@ static inline int tlb_range_check(struct sbi_tlb_info *curr,
  *	if next flush request range lies within one of the existing entry, skip
  *	the next entry.
  * Case2:
- *	if flush request range in current fifo entry lies within next flush
- *	request, update the current entry.
+ *	if next flush request range overlaps with or is adjacent to the range
+ *	in current fifo entry for the same ASID/VMID, extend the current entry
+ *	to cover both ranges.
+ * Case3:
+ *	if the current fifo entry already carries a request of the source
+ *	hart for the same completion counter, leave it alone because the
+ *	entry signals completion only once per source entry.
+ * Case4:
+ *	if the current fifo entry already carries as many source harts as
+ *	it can hold, leave it alone as well.
  *
  * Note:
  *	We can not issue a fifo reset anymore if a complete vma flush is requested.
@@ -316,58 +982,257 @@ static int tlb_update_cb(void *in, void *data)
 	curr = (struct sbi_tlb_info *)data;
 	next = (struct sbi_tlb_info *)in;
 
-	if (next->type == SBI_TLB_SFENCE_VMA_ASID &&
-	    curr->type == SBI_TLB_SFENCE_VMA_ASID) {
-		if (next->asid == curr->asid)
-			ret = tlb_range_check(curr, next);
-	} else if (next->type == SBI_TLB_SFENCE_VMA &&
-		   curr->type == SBI_TLB_SFENCE_VMA) {
+	if (tlb_entry_has_source(curr, next->src[0]) ||
+	    curr->src_count + next->src_count > SBI_TLB_INFO_MAX_SRC)
+		return ret;
+
+	if (tlb_same_context(curr, next))
 		ret = tlb_range_check(curr, next);
+
+	if (ret != SBI_FIFO_UNCHANGED) {
+		sbi_memcpy(&curr->src[curr->src_count], next->src,
+			   next->src_count * sizeof(next->src[0]));
+		curr->src_count += next->src_count;
 	}
 
 	return ret;
 }
 
+#ifdef CONFIG_SBI_TLB_DEFER_SUSPENDED
+/*
+ * Record a request for a suspended remote hart as a flush of everything
+ * of its type to be done when the hart resumes instead of waking it up.
+ * The type is published before the state of the remote hart is checked
+ * again whereas the resuming hart changes its state before it takes the
+ * types so either the resuming hart sees the type or this hart sees the
+ * hart resumed and falls back to an IPI.
+ */
+static bool tlb_defer_update(struct sbi_scratch *remote_scratch,
+			     struct sbi_tlb_info *tinfo)
+{
+	struct tlb_overflow *ovf_r =
+			sbi_scratch_offset_ptr(remote_scratch, tlb_overflow_off);
+
+	if (!(BIT(tinfo->type) & TLB_OVERFLOW_TYPES) ||
+	    !sbi_hsm_hart_fence_deferrable(remote_scratch))
+		return false;
+
+	atomic_raw_set_bit(tinfo->type, &ovf_r->deferred);
+	smp_mb();
+
+	return sbi_hsm_hart_fence_deferrable(remote_scratch);
+}
+
+void sbi_tlb_deferred_process(struct sbi_scratch *scratch)
+{
+	struct tlb_overflow *ovf =
+			sbi_scratch_offset_ptr(scratch, tlb_overflow_off);
+
+	if (__atomic_load_n(&ovf->deferred, __ATOMIC_RELAXED))
+		tlb_types_flush(atomic_raw_xchg_ulong(&ovf->deferred, 0));
+}
+#else
+static inline bool tlb_defer_update(struct sbi_scratch *remote_scratch,
+				    struct sbi_tlb_info *tinfo)
+{
+	return false;
+}
+#endif
+
+static int tlb_bcast_update(struct sbi_scratch *remote_scratch,
+			    struct tlb_bcast *bcast, bool forward)
+{
+	struct tlb_bcast_ref ref;
+	struct sbi_mpsc_fifo *bcast_fifo_r =
+			sbi_scratch_offset_ptr(remote_scratch, tlb_bcast_fifo_off);
+
+	ref.bcast = bcast;
+	ref.gen = bcast->gen;
+	ref.forward = forward;
+
+	atomic_add_return(&bcast->pending, 1);
+	if (sbi_mpsc_fifo_enqueue(bcast_fifo_r, &ref)) {
+		atomic_sub_return(&bcast->pending, 1);
+		return SBI_ENOSPC;
+	}
+
+	return 0;
+}
+
+/*
+ * Record a request which does not fit into the fifo of the remote hart
+ * as a sticky flush of everything of its type. The tlb_sync counter is
+ * only incremented when this hart is not already waiting for the remote
+ * overflow state since the remote hart signals completion once per
+ * source hart.
+ */
+static bool tlb_overflow_update(struct sbi_scratch *scratch,
+				struct sbi_scratch *remote_scratch,
+				struct sbi_tlb_info *tinfo)
+{
+	int hartindex = TLB_SRC_INDEX(tinfo->src[0]);
+	atomic_t *tlb_sync = tlb_sync_counter(scratch, 0);
+	struct tlb_overflow *ovf_r =
+			sbi_scratch_offset_ptr(remote_scratch, tlb_overflow_off);
+
+	if (!(BIT(tinfo->type) & TLB_OVERFLOW_TYPES))
+		return false;
+
+	atomic_raw_set_bit(tinfo->type, &ovf_r->types);
+	smp_mb();
+	if (sbi_hartmask_test_hartindex(hartindex, &ovf_r->smask))
+		return true;
+
+	atomic_add_return(tlb_sync, 1);
+	smp_wmb();
+	atomic_raw_set_bit(hartindex, ovf_r->smask.bits);
+
+	return true;
+}
+
+static void tlb_desc_to_info(struct sbi_tlb_info *tinfo,
+			     const struct sbi_tlb_info *tmpl,
+			     const struct sbi_tlb_desc *desc)
+{
+	sbi_memcpy(tinfo, tmpl, sizeof(*tinfo));
+	tinfo->start = desc->start;
+	tinfo->size  = desc->size;
+	tinfo->asid  = desc->asid;
+	if (tinfo->size > tlb_range_flush_limit) {
+		tinfo->start = 0;
+		tinfo->size  = SBI_TLB_FLUSH_ALL;
+	}
+}
+
+/*
+ * Queue every range of a request for a list of ranges on the remote
+ * hart. Only types which can overflow are accepted for such requests so
+ * a full fifo never makes the update retry and queue a range twice.
+ */
+static int tlb_update_many(struct sbi_scratch *scratch,
+			   struct sbi_scratch *remote_scratch,
+			   u32 remote_hartindex, struct tlb_request *req)
+{
+	u32 i, count = 0;
+	bool local = sbi_hartindex_to_hartid(remote_hartindex) ==
+		     current_hartid();
+	atomic_t *tlb_sync = tlb_sync_counter(scratch,
+					TLB_SRC_SLOT(req->tinfo->src[0]));
+	struct sbi_mpsc_fifo *tlb_fifo_r =
+			sbi_scratch_offset_ptr(remote_scratch, tlb_fifo_off);
+	struct sbi_tlb_info batch[TLB_BATCH_MAX], tinfo;
+
+	if (!local && tlb_defer_update(remote_scratch, req->tinfo))
+		return SBI_IPI_UPDATE_BREAK;
+
+	for (i = 0; i < req->count; i++) {
+		if (local) {
+			tlb_desc_to_info(&batch[count++], req->tinfo,
+					 &req->descs[i]);
+			if (count == TLB_BATCH_MAX || i == req->count - 1) {
+				tlb_entries_local_process(scratch, batch, count);
+				count = 0;
+			}
+			continue;
+		}
+
+		tlb_desc_to_info(&tinfo, req->tinfo, &req->descs[i]);
+
+		/* A merged range signals completion along with its entry */
+		if (sbi_mpsc_fifo_inplace_update(tlb_fifo_r, &tinfo,
+						 tlb_update_cb) ==
+		    SBI_FIFO_UNCHANGED &&
+		    sbi_mpsc_fifo_enqueue(tlb_fifo_r, &tinfo) < 0) {
+			sbi_pmu_ctr_incr_fw(SBI_PMU_FW_TLB_FIFO_FULL);
+			tlb_overflow_update(scratch, remote_scratch, &tinfo);
+			continue;
+		}
+
+		atomic_add_return(tlb_sync, 1);
+	}
+
+	return local ? SBI_IPI_UPDATE_BREAK : SBI_IPI_UPDATE_SUCCESS;
+}
+
 static int tlb_update(struct sbi_scratch *scratch,
 			  struct sbi_scratch *remote_scratch,
 			  u32 remote_hartindex, void *data)
 {
 	int ret;
 	atomic_t *tlb_sync;
-	struct sbi_fifo *tlb_fifo_r;
-	struct sbi_tlb_info *tinfo = data;
+	struct sbi_mpsc_fifo *tlb_fifo_r;
+	struct tlb_request *req = data;
+	struct sbi_tlb_info *tinfo = req->tinfo;
+	struct sbi_tlb_info local;
 	u32 curr_hartid = current_hartid();
+	bool forward;
+
+	if (req->descs)
+		return tlb_update_many(scratch, remote_scratch,
+				       remote_hartindex, req);
 
 	/*
 	 * If the request is to queue a tlb flush entry for itself
 	 * then just do a local flush and return;
 	 */
 	if (sbi_hartindex_to_hartid(remote_hartindex) == curr_hartid) {
-		tlb_entry_local_process(tinfo);
+		sbi_memcpy(&local, tinfo, sizeof(local));
+		tlb_entries_local_process(scratch, &local, 1);
+		return SBI_IPI_UPDATE_BREAK;
+	}
+
+	/* Suspended harts flush when they resume */
+	if (tlb_defer_update(remote_scratch, tinfo))
+		return SBI_IPI_UPDATE_BREAK;
+
+	/* Other clusters get the broadcast from one of their harts */
+	if (tlb_bcast_cluster_skip(scratch, remote_scratch, req, &forward))
 		return SBI_IPI_UPDATE_BREAK;
+
+	/*
+	 * Broadcast requests fall back to a private copy of the request
+	 * when the reference queue of the remote hart is full. A private
+	 * copy is not forwarded so the next target of the cluster is
+	 * picked to forward instead.
+	 */
+	if (req->bcast &&
+	    !tlb_bcast_update(remote_scratch, req->bcast, forward)) {
+		if (forward)
+			tlb_bcast_cluster_done(remote_scratch, req);
+		return SBI_IPI_UPDATE_SUCCESS;
 	}
 
+#ifdef CONFIG_SBI_TLB_CLUSTER_FANOUT
+	/* Forwarded requests are accounted to the source hart */
+	if (req->forward)
+		scratch = sbi_hartindex_to_scratch(TLB_SRC_INDEX(tinfo->src[0]));
+#endif
+
 	tlb_fifo_r = sbi_scratch_offset_ptr(remote_scratch, tlb_fifo_off);
 
-	ret = sbi_fifo_inplace_update(tlb_fifo_r, data, tlb_update_cb);
+	ret = sbi_mpsc_fifo_inplace_update(tlb_fifo_r, tinfo, tlb_update_cb);
 
 	if (ret == SBI_FIFO_UNCHANGED &&
-	    sbi_fifo_enqueue(tlb_fifo_r, data, false) < 0) {
+	    sbi_mpsc_fifo_enqueue(tlb_fifo_r, tinfo) < 0) {
+		sbi_pmu_ctr_incr_fw(SBI_PMU_FW_TLB_FIFO_FULL);
+
+		/* Overflow into a flush of everything of the request type */
+		if (tlb_overflow_update(scratch, remote_scratch, tinfo))
+			return SBI_IPI_UPDATE_SUCCESS;
+
 		/**
-		 * For now, Busy loop until there is space in the fifo.
-		 * There may be case where target hart is also
-		 * enqueue in source hart's fifo. Both hart may busy
-		 * loop leading to a deadlock.
-		 * TODO: Introduce a wait/wakeup event mechanism to handle
-		 * this properly.
+		 * Requests which can not be collapsed busy loop until
+		 * there is space in the fifo. Consume the fifo of this
+		 * hart meanwhile since the target hart may also be
+		 * enqueueing into it.
 		 */
 		tlb_process_once(scratch);
-		sbi_dprintf("hart%d: hart%d tlb fifo full\n", curr_hartid,
+		sbi_tprintf("hart%d: hart%d tlb fifo full\n", curr_hartid,
 			    sbi_hartindex_to_hartid(remote_hartindex));
 		return SBI_IPI_UPDATE_RETRY;
 	}
 
-	tlb_sync = sbi_scratch_offset_ptr(scratch, tlb_sync_off);
+	tlb_sync = tlb_sync_counter(scratch, TLB_SRC_SLOT(tinfo->src[0]));
 	atomic_add_return(tlb_sync, 1);
 
 	return SBI_IPI_UPDATE_SUCCESS;
@@ -380,7 +1245,6 @@ static struct sbi_ipi_event_ops tlb_ops = {
 	.process = tlb_process,
 };
 
-static u32 tlb_event = SBI_IPI_EVENT_MAX;
 
 static const u32 tlb_type_to_pmu_fw_event[SBI_TLB_TYPE_MAX] = {
 	[SBI_TLB_FENCE_I] = SBI_PMU_FW_FENCE_I_SENT,
@@ -392,9 +1256,20 @@ static const u32 tlb_type_to_pmu_fw_event[SBI_TLB_TYPE_MAX] = {
 	[SBI_TLB_HFENCE_VVMA] = SBI_PMU_FW_HFENCE_VVMA_SENT,
 };
 
-int sbi_tlb_request(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo)
+static bool tlb_bcast_wanted(ulong hmask, ulong hbase)
 {
-	if (tinfo->type < 0 || tinfo->type >= SBI_TLB_TYPE_MAX)
+	if (hbase == -1UL)
+		return sbi_scratch_last_hartindex() + 1 >= TLB_BCAST_MIN_TARGETS;
+
+	return sbi_popcount(hmask) >= TLB_BCAST_MIN_TARGETS;
+}
+
+static int tlb_request(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo)
+{
+	struct tlb_request req;
+	struct tlb_bcast *bcast;
+
+	if (tinfo->type >= SBI_TLB_TYPE_MAX)
 		return SBI_EINVAL;
 
 	/*
@@ -409,7 +1284,250 @@ int sbi_tlb_request(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo)
 
 	sbi_pmu_ctr_incr_fw(tlb_type_to_pmu_fw_event[tinfo->type]);
 
-	return sbi_ipi_send_many(hmask, hbase, tlb_event, tinfo);
+	req.tinfo = tinfo;
+	req.bcast = NULL;
+	req.descs = NULL;
+	req.count = 0;
+#ifdef CONFIG_SBI_TLB_CLUSTER_FANOUT
+	req.clusters_done = 0;
+	req.forward = false;
+#endif
+	bcast = sbi_scratch_thishart_offset_ptr(tlb_bcast_off);
+	/*
+	 * The descriptor can only be rewritten once the previous broadcast
+	 * of this hart has completed. This is always the case after a
+	 * synchronous request whereas an asynchronous broadcast which is
+	 * still in flight makes this request fall back to unicast mode.
+	 */
+	if (tlb_bcast_wanted(hmask, hbase) &&
+	    atomic_read(&bcast->pending) <= 0) {
+		req.bcast = bcast;
+		sbi_memcpy(&bcast->tinfo, tinfo, sizeof(*tinfo));
+		tlb_bcast_group(bcast, hmask, hbase);
+		__atomic_store_n(&bcast->gen, bcast->gen + 1,
+				 __ATOMIC_RELEASE);
+	}
+
+	return sbi_ipi_send_many(hmask, hbase, tlb_event, &req);
+}
+
+int sbi_tlb_request(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo)
+{
+	return tlb_request(hmask, hbase, tinfo);
+}
+
+int sbi_tlb_request_many(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo,
+			 const struct sbi_tlb_desc *descs, u32 count)
+{
+	u32 i;
+	struct tlb_request req;
+
+	if (tinfo->type >= SBI_TLB_TYPE_MAX ||
+	    !(BIT(tinfo->type) & TLB_OVERFLOW_TYPES))
+		return SBI_EINVAL;
+	if (!descs || SBI_TLB_DESC_MAX < count)
+		return SBI_EINVAL;
+	if (!count)
+		return 0;
+
+	for (i = 0; i < count; i++)
+		sbi_pmu_ctr_incr_fw(tlb_type_to_pmu_fw_event[tinfo->type]);
+
+	/*
+	 * Ranges are queued to the targets one by one so the broadcast
+	 * descriptor which holds a single range is not used.
+	 */
+	req.tinfo = tinfo;
+	req.bcast = NULL;
+	req.descs = descs;
+	req.count = count;
+#ifdef CONFIG_SBI_TLB_CLUSTER_FANOUT
+	req.clusters_done = 0;
+	req.forward = false;
+#endif
+
+	return sbi_ipi_send_many(hmask, hbase, tlb_event, &req);
+}
+
+void sbi_tlb_local_batch(struct sbi_tlb_info *batch, u32 count)
+{
+	if (!count)
+		return;
+
+	tlb_batch_merge(batch, count);
+	tlb_entries_local_process(sbi_scratch_thishart_ptr(), batch, count);
+}
+
+/*
+ * Check whether the request of an asynchronous slot is complete. The
+ * broadcast descriptor is checked first because harts forwarding it
+ * add to the slot counter before they complete their reference. The
+ * shared counter covers the overflow state of the remote harts.
+ */
+static bool tlb_async_slot_done(struct sbi_scratch *scratch,
+				struct tlb_async *async, u32 i)
+{
+	struct tlb_bcast *bcast =
+			sbi_scratch_offset_ptr(scratch, tlb_bcast_off);
+
+	if (async->slots[i].bcast && atomic_read(&bcast->pending) > 0)
+		return false;
+
+	return atomic_read(tlb_sync_counter(scratch, 0)) <= 0 &&
+	       atomic_read(tlb_sync_counter(scratch, i + 1)) <= 0;
+}
+
+/* Free the slots of completed requests, returns the oldest token left */
+static unsigned long tlb_async_reclaim(struct sbi_scratch *scratch,
+				       struct tlb_async *async)
+{
+	unsigned long token, oldest = 0;
+	u32 i;
+
+	for (i = 0; i < TLB_ASYNC_SLOTS; i++) {
+		token = async->slots[i].token;
+		if (!token)
+			continue;
+		if (tlb_async_slot_done(scratch, async, i))
+			async->slots[i].token = 0;
+		else if (!oldest || token < oldest)
+			oldest = token;
+	}
+
+	return oldest;
+}
+
+int sbi_tlb_async_request(ulong hmask, ulong hbase, struct sbi_tlb_info *tinfo,
+			  unsigned long *token)
+{
+	int ret;
+	u32 i;
+	unsigned long gen;
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct tlb_async *async = sbi_scratch_offset_ptr(scratch, tlb_async_off);
+	struct tlb_bcast *bcast = sbi_scratch_offset_ptr(scratch, tlb_bcast_off);
+
+	tlb_async_reclaim(scratch, async);
+	for (i = 0; i < TLB_ASYNC_SLOTS; i++) {
+		if (!async->slots[i].token)
+			break;
+	}
+	if (i == TLB_ASYNC_SLOTS)
+		return SBI_EINVALID_STATE;
+
+	/* Completion of every target is accounted to the slot */
+	tinfo->src[0] |= (i + 1) << TLB_SRC_SLOT_SHIFT;
+	gen = bcast->gen;
+
+	async->slot = i + 1;
+	ret = tlb_request(hmask, hbase, tinfo);
+	async->slot = 0;
+
+	/*
+	 * Part of a failed request may still be queued on some targets so
+	 * the slot is taken in any case to keep completion conservative.
+	 */
+	async->slots[i].bcast = bcast->gen != gen;
+	async->slots[i].token = ++async->issued;
+	if (ret)
+		return ret;
+
+	*token = async->issued;
+	return 0;
+}
+
+unsigned long sbi_tlb_async_completed(void)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct tlb_async *async = sbi_scratch_offset_ptr(scratch, tlb_async_off);
+	unsigned long oldest = tlb_async_reclaim(scratch, async);
+
+	/* Tokens are completed in any order, report the longest done prefix */
+	return oldest ? oldest - 1 : async->issued;
+}
+
+bool sbi_tlb_async_enabled(void)
+{
+	struct tlb_async *async = sbi_scratch_thishart_offset_ptr(tlb_async_off);
+
+	return async->enabled;
+}
+
+void sbi_tlb_async_enable(bool enable)
+{
+	struct tlb_async *async = sbi_scratch_thishart_offset_ptr(tlb_async_off);
+
+	async->enabled = enable;
+}
+
+#ifdef CONFIG_SBI_TLB_FLUSH_LIMIT_CALIBRATE
+/* Number of flushes timed for each kind of flush */
+#define TLB_CALIBRATE_ROUNDS		64
+/* Largest range flush limit picked by the calibration in pages */
+#define TLB_CALIBRATE_MAX_PAGES		512
+
+/*
+ * Find the number of pages which can be flushed one by one in the time
+ * of a full flush. Returns 0 when the cycle counter is not usable.
+ */
+static unsigned long tlb_range_flush_calibrate(void)
+{
+	unsigned long i, start, page_cycles, all_cycles, pages;
+	unsigned long va = (unsigned long)&tlb_range_flush_limit & ~(PAGE_SIZE - 1);
+
+	start = csr_read(CSR_MCYCLE);
+	for (i = 0; i < TLB_CALIBRATE_ROUNDS; i++)
+		__asm__ __volatile__("sfence.vma %0"
+				     :
+				     : "r"(va + i * PAGE_SIZE)
+				     : "memory");
+	page_cycles = csr_read(CSR_MCYCLE) - start;
+
+	start = csr_read(CSR_MCYCLE);
+	for (i = 0; i < TLB_CALIBRATE_ROUNDS; i++)
+		tlb_flush_all();
+	all_cycles = csr_read(CSR_MCYCLE) - start;
+
+	if (!page_cycles || !all_cycles)
+		return 0;
+
+	pages = all_cycles / ((page_cycles + TLB_CALIBRATE_ROUNDS - 1) /
+			      TLB_CALIBRATE_ROUNDS);
+	if (!pages)
+		pages = 1;
+	if (pages > TLB_CALIBRATE_MAX_PAGES)
+		pages = TLB_CALIBRATE_MAX_PAGES;
+
+	return pages * PAGE_SIZE;
+}
+#else
+static inline unsigned long tlb_range_flush_calibrate(void)
+{
+	return 0;
+}
+#endif
+
+static void tlb_range_flush_limit_init(struct sbi_scratch *scratch)
+{
+	const struct sbi_platform *plat = sbi_platform_ptr(scratch);
+	unsigned long limit, old;
+
+	limit = sbi_platform_hart_tlbr_flush_limit(plat, current_hartid());
+	if (!limit)
+		limit = tlb_range_flush_calibrate();
+	if (!limit)
+		limit = sbi_platform_tlbr_flush_limit(plat);
+
+	sbi_scratch_write_type(scratch, unsigned long, tlb_flush_limit_off,
+			       limit);
+
+	/* Requests are only escalated by the sender beyond every hart limit */
+	old = __atomic_load_n(&tlb_range_flush_limit, __ATOMIC_RELAXED);
+	while (old < limit &&
+	       !__atomic_compare_exchange_n(&tlb_range_flush_limit, &old,
+					    limit, false, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		;
 }
 
 int sbi_tlb_init(struct sbi_scratch *scratch, bool cold_boot)
@@ -417,57 +1535,128 @@ int sbi_tlb_init(struct sbi_scratch *scratch, bool cold_boot)
 	int ret;
 	void *tlb_mem;
 	atomic_t *tlb_sync;
-	struct sbi_fifo *tlb_q;
+	struct tlb_bcast *bcast;
+	struct tlb_async *async;
+	struct tlb_overflow *ovf;
+	struct sbi_mpsc_fifo *tlb_q, *bcast_q;
 	const struct sbi_platform *plat = sbi_platform_ptr(scratch);
+	u32 i, tlb_entries;
 
 	if (cold_boot) {
-		tlb_sync_off = sbi_scratch_alloc_offset(sizeof(*tlb_sync));
+		ret = SBI_ENOMEM;
+		tlb_sync_off = sbi_scratch_alloc_cacheline_offset(
+				sizeof(*tlb_sync) * (1 + TLB_ASYNC_SLOTS));
 		if (!tlb_sync_off)
-			return SBI_ENOMEM;
-		tlb_fifo_off = sbi_scratch_alloc_offset(sizeof(*tlb_q));
-		if (!tlb_fifo_off) {
-			sbi_scratch_free_offset(tlb_sync_off);
-			return SBI_ENOMEM;
-		}
+			return ret;
+		tlb_fifo_off = sbi_scratch_alloc_cacheline_offset(sizeof(*tlb_q));
+		if (!tlb_fifo_off)
+			goto fail_free_sync;
 		tlb_fifo_mem_off = sbi_scratch_alloc_offset(sizeof(tlb_mem));
-		if (!tlb_fifo_mem_off) {
-			sbi_scratch_free_offset(tlb_fifo_off);
-			sbi_scratch_free_offset(tlb_sync_off);
-			return SBI_ENOMEM;
-		}
+		if (!tlb_fifo_mem_off)
+			goto fail_free_fifo;
+		tlb_bcast_off = sbi_scratch_alloc_cacheline_offset(sizeof(*bcast));
+		if (!tlb_bcast_off)
+			goto fail_free_fifo_mem;
+		tlb_bcast_fifo_off =
+			sbi_scratch_alloc_cacheline_offset(sizeof(*bcast_q));
+		if (!tlb_bcast_fifo_off)
+			goto fail_free_bcast;
+		tlb_bcast_fifo_mem_off = sbi_scratch_alloc_offset(sizeof(tlb_mem));
+		if (!tlb_bcast_fifo_mem_off)
+			goto fail_free_bcast_fifo;
+		tlb_async_off = sbi_scratch_alloc_offset(sizeof(*async));
+		if (!tlb_async_off)
+			goto fail_free_bcast_fifo_mem;
+		tlb_overflow_off = sbi_scratch_alloc_offset(sizeof(*ovf));
+		if (!tlb_overflow_off)
+			goto fail_free_async;
+		tlb_flush_limit_off = sbi_scratch_alloc_type_offset(unsigned long);
+		if (!tlb_flush_limit_off)
+			goto fail_free_overflow;
 		ret = sbi_ipi_event_create(&tlb_ops);
-		if (ret < 0) {
-			sbi_scratch_free_offset(tlb_fifo_mem_off);
-			sbi_scratch_free_offset(tlb_fifo_off);
-			sbi_scratch_free_offset(tlb_sync_off);
-			return ret;
-		}
+		if (ret < 0)
+			goto fail_free_flush_limit;
 		tlb_event = ret;
 		tlb_range_flush_limit = sbi_platform_tlbr_flush_limit(plat);
 	} else {
 		if (!tlb_sync_off ||
 		    !tlb_fifo_off ||
-		    !tlb_fifo_mem_off)
+		    !tlb_fifo_mem_off ||
+		    !tlb_bcast_off ||
+		    !tlb_bcast_fifo_off ||
+		    !tlb_bcast_fifo_mem_off ||
+		    !tlb_async_off ||
+		    !tlb_overflow_off ||
+		    !tlb_flush_limit_off)
 			return SBI_ENOMEM;
 		if (SBI_IPI_EVENT_MAX <= tlb_event)
 			return SBI_ENOSPC;
 	}
 
+	tlb_range_flush_limit_init(scratch);
+
+	/* The lock-free fifo needs a power of two number of entries */
+	tlb_entries = 1UL << log2roundup(sbi_platform_tlb_fifo_num_entries(plat));
+
 	tlb_sync = sbi_scratch_offset_ptr(scratch, tlb_sync_off);
 	tlb_q = sbi_scratch_offset_ptr(scratch, tlb_fifo_off);
 	tlb_mem = sbi_scratch_read_type(scratch, void *, tlb_fifo_mem_off);
 	if (!tlb_mem) {
-		tlb_mem = sbi_malloc(
-				sbi_platform_tlb_fifo_num_entries(plat) * SBI_TLB_INFO_SIZE);
+		tlb_mem = sbi_malloc_local(
+			SBI_MPSC_FIFO_MEM_SIZE(tlb_entries, SBI_TLB_INFO_SIZE));
 		if (!tlb_mem)
 			return SBI_ENOMEM;
 		sbi_scratch_write_type(scratch, void *, tlb_fifo_mem_off, tlb_mem);
 	}
 
-	ATOMIC_INIT(tlb_sync, 0);
+	for (i = 0; i < 1 + TLB_ASYNC_SLOTS; i++)
+		ATOMIC_INIT(&tlb_sync[i], 0);
 
-	sbi_fifo_init(tlb_q, tlb_mem,
-		      sbi_platform_tlb_fifo_num_entries(plat), SBI_TLB_INFO_SIZE);
+	ret = sbi_mpsc_fifo_init(tlb_q, tlb_mem, tlb_entries,
+				 SBI_TLB_INFO_SIZE);
+	if (ret)
+		return ret;
 
-	return 0;
+	bcast = sbi_scratch_offset_ptr(scratch, tlb_bcast_off);
+	bcast_q = sbi_scratch_offset_ptr(scratch, tlb_bcast_fifo_off);
+	tlb_mem = sbi_scratch_read_type(scratch, void *, tlb_bcast_fifo_mem_off);
+	if (!tlb_mem) {
+		tlb_mem = sbi_malloc_local(SBI_MPSC_FIFO_MEM_SIZE(tlb_entries,
+					sizeof(struct tlb_bcast_ref)));
+		if (!tlb_mem)
+			return SBI_ENOMEM;
+		sbi_scratch_write_type(scratch, void *,
+				       tlb_bcast_fifo_mem_off, tlb_mem);
+	}
+
+	ATOMIC_INIT(&bcast->pending, 0);
+
+	async = sbi_scratch_offset_ptr(scratch, tlb_async_off);
+	sbi_memset(async, 0, sizeof(*async));
+
+	ovf = sbi_scratch_offset_ptr(scratch, tlb_overflow_off);
+	sbi_memset(ovf, 0, sizeof(*ovf));
+
+	return sbi_mpsc_fifo_init(bcast_q, tlb_mem, tlb_entries,
+				  sizeof(struct tlb_bcast_ref));
+
+fail_free_flush_limit:
+	sbi_scratch_free_offset(tlb_flush_limit_off);
+fail_free_overflow:
+	sbi_scratch_free_offset(tlb_overflow_off);
+fail_free_async:
+	sbi_scratch_free_offset(tlb_async_off);
+fail_free_bcast_fifo_mem:
+	sbi_scratch_free_offset(tlb_bcast_fifo_mem_off);
+fail_free_bcast_fifo:
+	sbi_scratch_free_offset(tlb_bcast_fifo_off);
+fail_free_bcast:
+	sbi_scratch_free_offset(tlb_bcast_off);
+fail_free_fifo_mem:
+	sbi_scratch_free_offset(tlb_fifo_mem_off);
+fail_free_fifo:
+	sbi_scratch_free_offset(tlb_fifo_off);
+fail_free_sync:
+	sbi_scratch_free_offset(tlb_sync_off);
+	return ret;
 }
@@ -0,0 +1,141 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Deferred binary console output for hot paths
+ */
+
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
+#include <sbi/sbi_tprintf.h>
+
+#define TPRINTF_ENTRIES		CONFIG_SBI_TPRINTF_ENTRIES
+
+#if TPRINTF_ENTRIES & (TPRINTF_ENTRIES - 1)
+#error "CONFIG_SBI_TPRINTF_ENTRIES must be a power of two"
+#endif
+
+/*
+ * Only the owner HART writes its ring and advances pos once an entry
+ * is complete. The flush position is owned by whoever holds
+ * tprintf_flush_lock. An entry the owner overwrote while it was being
+ * copied is detected from pos and counted as lost.
+ */
+struct tprintf_ring {
+	unsigned long pos;
+	unsigned long flushed;
+	struct sbi_tprintf_entry entries[TPRINTF_ENTRIES];
+};
+
+static unsigned long tprintf_off;
+static spinlock_t tprintf_flush_lock = SPIN_LOCK_INITIALIZER;
+
+static struct tprintf_ring *tprintf_ring_ptr(struct sbi_scratch *scratch)
+{
+	if (!tprintf_off || !scratch)
+		return NULL;
+
+	return sbi_scratch_read_type(scratch, void *, tprintf_off);
+}
+
+void __sbi_tprintf(const char *fmt, unsigned long a0, unsigned long a1,
+		   unsigned long a2, unsigned long a3)
+{
+	struct sbi_tprintf_entry *ent;
+	struct tprintf_ring *ring = tprintf_ring_ptr(sbi_scratch_thishart_ptr());
+
+	if (!ring)
+		return;
+
+	ent = &ring->entries[ring->pos & (TPRINTF_ENTRIES - 1)];
+	ent->fmt = fmt;
+	ent->args[0] = a0;
+	ent->args[1] = a1;
+	ent->args[2] = a2;
+	ent->args[3] = a3;
+	ent->time = sbi_timer_value();
+
+	__atomic_store_n(&ring->pos, ring->pos + 1, __ATOMIC_RELEASE);
+}
+
+static void tprintf_ring_flush(u32 hartindex, struct tprintf_ring *ring)
+{
+	struct sbi_tprintf_entry ent;
+	unsigned long pos, lost = 0;
+
+	pos = __atomic_load_n(&ring->pos, __ATOMIC_ACQUIRE);
+	if (pos - ring->flushed > TPRINTF_ENTRIES) {
+		lost = pos - ring->flushed - TPRINTF_ENTRIES;
+		ring->flushed = pos - TPRINTF_ENTRIES;
+	}
+
+	for (; ring->flushed != pos; ring->flushed++) {
+		sbi_memcpy(&ent, &ring->entries[ring->flushed &
+						(TPRINTF_ENTRIES - 1)],
+			   sizeof(ent));
+
+		/* The owner may have reused the slot while it was copied */
+		if (__atomic_load_n(&ring->pos, __ATOMIC_ACQUIRE) -
+		    ring->flushed > TPRINTF_ENTRIES) {
+			lost++;
+			continue;
+		}
+
+		sbi_printf("[%lu] ", (ulong)ent.time);
+		sbi_printf(ent.fmt, ent.args[0], ent.args[1], ent.args[2],
+			   ent.args[3]);
+	}
+
+	if (lost)
+		sbi_printf("hart%u: %lu deferred messages lost\n",
+			   sbi_hartindex_to_hartid(hartindex), lost);
+}
+
+void sbi_tprintf_flush(void)
+{
+	struct tprintf_ring *ring;
+	u32 i;
+
+	if (!tprintf_off)
+		return;
+
+	/* Somebody else is flushing already */
+	if (!spin_trylock(&tprintf_flush_lock))
+		return;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		ring = tprintf_ring_ptr(sbi_hartindex_to_scratch(i));
+		if (ring)
+			tprintf_ring_flush(i, ring);
+	}
+
+	spin_unlock(&tprintf_flush_lock);
+}
+
+int sbi_tprintf_init(void)
+{
+	u32 i;
+	struct sbi_scratch *scratch;
+	struct tprintf_ring *ring;
+
+	tprintf_off = sbi_scratch_alloc_type_offset(void *);
+	if (!tprintf_off)
+		return SBI_ENOMEM;
+
+	/* HARTs without a ring drop their messages */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+		ring = sbi_zalloc(sizeof(*ring));
+		if (!ring)
+			break;
+		sbi_scratch_write_type(scratch, void *, tprintf_off, ring);
+	}
+
+	return 0;
+}
@@ -0,0 +1,180 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Static tracepoints patched at runtime
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_barrier.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_tlb.h>
+#include <sbi/sbi_tracepoint.h>
+#include <sbi/sbi_trap.h>
+
+/* clang-format off */
+
+#define TRACEPOINT_NOP		0x00000013	/* addi zero, zero, 0 */
+#define TRACEPOINT_JAL_T0	0x000002ef	/* jal t0, 0 */
+#define TRACEPOINT_JAL_RANGE	(1L << 20)
+
+/* clang-format on */
+
+extern struct sbi_tracepoint __sbi_tracepoints_start[];
+extern struct sbi_tracepoint __sbi_tracepoints_end[];
+extern char __sbi_tracepoint_tramp[];
+
+void sbi_tracepoint_hit(unsigned long site, unsigned long arg);
+
+static sbi_tracepoint_probe_t tracepoint_probe;
+static spinlock_t tracepoint_lock = SPIN_LOCK_INITIALIZER;
+
+static unsigned long tracepoint_count(void)
+{
+	return __sbi_tracepoints_end - __sbi_tracepoints_start;
+}
+
+/* Called by __sbi_tracepoint_tramp for every hit of an enabled site */
+void sbi_tracepoint_hit(unsigned long site, unsigned long arg)
+{
+	struct sbi_tracepoint *tp;
+	sbi_tracepoint_probe_t probe;
+
+	for (tp = __sbi_tracepoints_start; tp < __sbi_tracepoints_end; tp++) {
+		if (tp->site != site)
+			continue;
+
+		__atomic_fetch_add(&tp->hits, 1, __ATOMIC_RELAXED);
+		tp->last_arg = arg;
+		probe = __atomic_load_n(&tracepoint_probe, __ATOMIC_ACQUIRE);
+		if (probe)
+			probe(tp, arg);
+		break;
+	}
+}
+
+void sbi_tracepoint_set_probe(sbi_tracepoint_probe_t probe)
+{
+	__atomic_store_n(&tracepoint_probe, probe, __ATOMIC_RELEASE);
+}
+
+static u32 tracepoint_insn(struct sbi_tracepoint *tp, bool enable)
+{
+	long off = (long)__sbi_tracepoint_tramp - (long)tp->site;
+	u32 imm = off;
+
+	if (!enable)
+		return TRACEPOINT_NOP;
+	if (off < -TRACEPOINT_JAL_RANGE || TRACEPOINT_JAL_RANGE <= off)
+		return 0;
+
+	return TRACEPOINT_JAL_T0 | (((imm >> 20) & 0x1) << 31) |
+	       (((imm >> 1) & 0x3ff) << 21) | (((imm >> 11) & 0x1) << 20) |
+	       (((imm >> 12) & 0xff) << 12);
+}
+
+/*
+ * The firmware text is not writable by M-mode once Smepmp enforces
+ * the M-mode only PMP regions.
+ */
+static bool tracepoint_text_writable(void)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+
+	return !sbi_hart_has_extension(scratch, SBI_HART_EXT_SMEPMP) ||
+	       !(csr_read(CSR_MSECCFG) & MSECCFG_MML);
+}
+
+/* Must be called with tracepoint_lock held */
+static int tracepoint_patch(struct sbi_tracepoint *tp, bool enable)
+{
+	u32 insn = tracepoint_insn(tp, enable);
+
+	if (!insn)
+		return SBI_EBAD_RANGE;
+	if (tp->enabled == enable)
+		return 0;
+
+	/* Sites are aligned so other HARTs fetch either instruction */
+	__atomic_store_n((u32 *)tp->site, insn, __ATOMIC_RELAXED);
+	tp->enabled = enable;
+
+	return 0;
+}
+
+int sbi_tracepoint_enable(unsigned long index, bool enable)
+{
+	unsigned long i, count = tracepoint_count();
+	struct sbi_tlb_info tinfo;
+	int rc = 0;
+
+	if (index != SBI_TRACEPOINT_ALL && count <= index)
+		return SBI_EINVAL;
+	if (!tracepoint_text_writable())
+		return SBI_EDENIED;
+
+	spin_lock(&tracepoint_lock);
+	for (i = 0; i < count && !rc; i++) {
+		if (index == SBI_TRACEPOINT_ALL || index == i)
+			rc = tracepoint_patch(&__sbi_tracepoints_start[i],
+					      enable);
+	}
+	spin_unlock(&tracepoint_lock);
+
+	/*
+	 * HARTs which miss the FENCE.I keep running the old instruction
+	 * until their instruction cache drops it, which is harmless.
+	 */
+	RISCV_FENCE_I;
+	SBI_TLB_INFO_INIT(&tinfo, 0, 0, 0, 0, SBI_TLB_FENCE_I,
+			  current_hartid());
+	sbi_tlb_request(0, -1UL, &tinfo);
+
+	return rc;
+}
+
+static int tracepoint_read(unsigned long index, unsigned long addr_lo,
+			   unsigned long addr_hi)
+{
+	struct sbi_tracepoint_info info;
+	struct sbi_tracepoint *tp;
+
+	if (tracepoint_count() <= index)
+		return SBI_EINVAL;
+
+	tp = &__sbi_tracepoints_start[index];
+	sbi_memset(&info, 0, sizeof(info));
+	sbi_strncpy(info.name, tp->name, sizeof(info.name) - 1);
+	info.site = tp->site;
+	info.enabled = tp->enabled;
+	info.hits = __atomic_load_n(&tp->hits, __ATOMIC_RELAXED);
+	info.last_arg = tp->last_arg;
+
+	return sbi_domain_copy_to_smode(addr_lo, addr_hi, &info, sizeof(info));
+}
+
+int sbi_tracepoint_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			  struct sbi_ecall_return *out)
+{
+	int rc;
+
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_TRACEPOINT_CTL:
+		rc = sbi_tracepoint_enable(regs->a0, regs->a1);
+		if (!rc)
+			out->value = tracepoint_count();
+		return rc;
+	case SBI_EXT_OPENSBI_TRACEPOINT_READ:
+		return tracepoint_read(regs->a0, regs->a1, regs->a2);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
@@ -11,17 +11,21 @@
 #include <sbi/riscv_encoding.h>
 #include <sbi/sbi_bitops.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_trace.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_illegal_insn.h>
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_irqchip.h>
 #include <sbi/sbi_trap_ldst.h>
+#include <sbi/sbi_trap_stats.h>
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_sse.h>
 #include <sbi/sbi_timer.h>
+#include <sbi/sbi_tracepoint.h>
 #include <sbi/sbi_trap.h>
 
 static void sbi_trap_error_one(const struct sbi_trap_context *tcntx,
@@ -88,9 +92,174 @@ static void __noreturn sbi_trap_error(const char *msg, int rc,
 	for (tc = tcntx; tc; tc = tc->prev_context)
 		sbi_trap_error_one(tc, __func__, hartid, --depth);
 
+	sbi_ecall_trace_dump(current_hartindex());
+
 	sbi_hart_hang();
 }
 
+/* HART features consulted by every trap redirect */
+#define TRAP_REDIRECT_H			BIT(0)
+#define TRAP_REDIRECT_ZICFILP		BIT(1)
+#define TRAP_REDIRECT_SVADU		BIT(2)
+
+/* Scratch offset of the redirect profile of a HART */
+static unsigned long trap_redirect_off;
+
+static unsigned long trap_redirect_profile(struct sbi_scratch *scratch)
+{
+	unsigned long profile = 0;
+
+	if (misa_extension('H'))
+		profile |= TRAP_REDIRECT_H;
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_ZICFILP))
+		profile |= TRAP_REDIRECT_ZICFILP;
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SVADU))
+		profile |= TRAP_REDIRECT_SVADU;
+
+	return profile;
+}
+
+/*
+ * Account a page fault redirected while hardware A/D updating is off on
+ * a HART implementing Svadu. Such a fault may only be there to let the
+ * supervisor set the A/D bits, which enabling ADUE through FWFT avoids.
+ */
+static void sbi_trap_count_adue_fault(const struct sbi_trap_info *trap,
+				      bool prev_virt, unsigned long profile)
+{
+	u64 envcfg;
+	struct sbi_domain *dom;
+
+	if (trap->cause != CAUSE_FETCH_PAGE_FAULT &&
+	    trap->cause != CAUSE_LOAD_PAGE_FAULT &&
+	    trap->cause != CAUSE_STORE_PAGE_FAULT)
+		return;
+
+	if (!(profile & TRAP_REDIRECT_SVADU))
+		return;
+
+	/* VS-stage A/D updating is controlled by henvcfg instead */
+#if __riscv_xlen == 32
+	envcfg = (u64)(prev_virt ? csr_read(CSR_HENVCFGH) :
+				   csr_read(CSR_MENVCFGH)) << 32;
+#else
+	envcfg = prev_virt ? csr_read(CSR_HENVCFG) : csr_read(CSR_MENVCFG);
+#endif
+	if (envcfg & ENVCFG_ADUE)
+		return;
+
+	dom = sbi_domain_thishart_ptr();
+	if (dom)
+		__atomic_add_fetch(&dom->adue_off_page_faults, 1,
+				   __ATOMIC_RELAXED);
+	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_ADUE_OFF_PAGE_FAULT);
+}
+
+/* Enter the (H)S-mode trap handler, MPV must already be clear */
+static inline void trap_redirect_to_s(struct sbi_trap_regs *regs,
+				      const struct sbi_trap_info *trap,
+				      ulong prev_mode, bool elp)
+{
+	/* Update S-mode exception info */
+	csr_write(CSR_STVAL, trap->tval);
+	csr_write(CSR_SEPC, regs->mepc);
+	csr_write(CSR_SCAUSE, trap->cause);
+
+	/* Set MEPC to S-mode exception vector base */
+	regs->mepc = csr_read(CSR_STVEC);
+
+	/* Set MPP to S-mode */
+	regs->mstatus &= ~MSTATUS_MPP;
+	regs->mstatus |= (PRV_S << MSTATUS_MPP_SHIFT);
+
+	/* Set SPP for S-mode */
+	regs->mstatus &= ~MSTATUS_SPP;
+	if (prev_mode == PRV_S)
+		regs->mstatus |= (1UL << MSTATUS_SPP_SHIFT);
+
+	/* Set SPIE for S-mode */
+	regs->mstatus &= ~MSTATUS_SPIE;
+	if (regs->mstatus & MSTATUS_SIE)
+		regs->mstatus |= (1UL << MSTATUS_SPIE_SHIFT);
+
+	/* Clear SIE for S-mode */
+	regs->mstatus &= ~MSTATUS_SIE;
+
+	/* If elp was set, set it back in mstatus */
+	if (elp)
+		regs->mstatus |= MSTATUS_SPELP;
+}
+
+/* Redirect a trap taken from VS/VU-mode to VS-mode or HS-mode */
+static void trap_redirect_from_virt(struct sbi_trap_regs *regs,
+				    const struct sbi_trap_info *trap,
+				    ulong prev_mode, bool elp)
+{
+	ulong hstatus, vsstatus;
+
+	/* Redirect to VS-mode if delegated in hedeleg, which HS-mode owns */
+	if ((trap->cause >= __riscv_xlen) ||
+	    !(csr_read(CSR_HEDELEG) & BIT(trap->cause))) {
+		/* Clear MSTATUS MPV bits */
+#if __riscv_xlen == 32
+		regs->mstatusH &= ~MSTATUSH_MPV;
+#else
+		regs->mstatus &= ~MSTATUS_MPV;
+#endif
+
+		hstatus = csr_read(CSR_HSTATUS);
+		/* hstatus.SPVP is only updated if coming from VS/VU-mode */
+		hstatus &= ~HSTATUS_SPVP;
+		hstatus |= (prev_mode == PRV_S) ? HSTATUS_SPVP : 0;
+		hstatus |= HSTATUS_SPV;
+		hstatus &= ~HSTATUS_GVA;
+		hstatus |= (trap->gva) ? HSTATUS_GVA : 0;
+		csr_write(CSR_HSTATUS, hstatus);
+		csr_write(CSR_HTVAL, trap->tval2);
+		csr_write(CSR_HTINST, trap->tinst);
+
+		trap_redirect_to_s(regs, trap, prev_mode, elp);
+		return;
+	}
+
+	/* MSTATUS MPV stays set */
+
+	/* Update VS-mode exception info */
+	csr_write(CSR_VSTVAL, trap->tval);
+	csr_write(CSR_VSEPC, regs->mepc);
+	csr_write(CSR_VSCAUSE, trap->cause);
+
+	/* Set MEPC to VS-mode exception vector base */
+	regs->mepc = csr_read(CSR_VSTVEC);
+
+	/* Set MPP to VS-mode */
+	regs->mstatus &= ~MSTATUS_MPP;
+	regs->mstatus |= (PRV_S << MSTATUS_MPP_SHIFT);
+
+	/* Get VS-mode SSTATUS CSR */
+	vsstatus = csr_read(CSR_VSSTATUS);
+
+	/* If elp was set, set it back in vsstatus */
+	if (elp)
+		vsstatus |= MSTATUS_SPELP;
+
+	/* Set SPP for VS-mode */
+	vsstatus &= ~SSTATUS_SPP;
+	if (prev_mode == PRV_S)
+		vsstatus |= (1UL << SSTATUS_SPP_SHIFT);
+
+	/* Set SPIE for VS-mode */
+	vsstatus &= ~SSTATUS_SPIE;
+	if (vsstatus & SSTATUS_SIE)
+		vsstatus |= (1UL << SSTATUS_SPIE_SHIFT);
+
+	/* Clear SIE for VS-mode */
+	vsstatus &= ~SSTATUS_SIE;
+
+	/* Update VS-mode SSTATUS CSR */
+	csr_write(CSR_VSSTATUS, vsstatus);
+}
+
 /**
  * Redirect trap to lower privledge mode (S-mode or U-mode)
  *
@@ -102,19 +271,26 @@ static void __noreturn sbi_trap_error(const char *msg, int rc,
 int sbi_trap_redirect(struct sbi_trap_regs *regs,
 		      const struct sbi_trap_info *trap)
 {
-	ulong hstatus, vsstatus, prev_mode;
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	unsigned long profile;
+	ulong hstatus, prev_mode;
 	bool elp = false;
 	bool prev_virt = sbi_regs_from_virt(regs);
-	/* By default, we redirect to HS-mode */
-	bool next_virt = false;
 
 	/* Sanity check on previous mode */
 	prev_mode = sbi_mstatus_prev_mode(regs->mstatus);
 	if (prev_mode != PRV_S && prev_mode != PRV_U)
 		return SBI_ENOTSUPP;
 
+	profile = (trap_redirect_off) ?
+		  sbi_scratch_read_type(scratch, unsigned long,
+					trap_redirect_off) :
+		  trap_redirect_profile(scratch);
+
+	sbi_trap_count_adue_fault(trap, prev_virt, profile);
+
 	/* If hart support for zicfilp, clear MPELP because redirecting to VS or (H)S */
-	if (sbi_hart_has_extension(sbi_scratch_thishart_ptr(), SBI_HART_EXT_ZICFILP)) {
+	if (profile & TRAP_REDIRECT_ZICFILP) {
 #if __riscv_xlen == 32
 		elp = regs->mstatusH & MSTATUSH_MPELP;
 		regs->mstatusH &= ~MSTATUSH_MPELP;
@@ -124,158 +300,59 @@ int sbi_trap_redirect(struct sbi_trap_regs *regs,
 #endif
 	}
 
-	/* If exceptions came from VS/VU-mode, redirect to VS-mode if
-	 * delegated in hedeleg
-	 */
-	if (misa_extension('H') && prev_virt) {
-		if ((trap->cause < __riscv_xlen) &&
-		    (csr_read(CSR_HEDELEG) & BIT(trap->cause))) {
-			next_virt = true;
-		}
+	if (unlikely(prev_virt)) {
+		trap_redirect_from_virt(regs, trap, prev_mode, elp);
+		return 0;
 	}
 
-	/* Update MSTATUS MPV bits */
-#if __riscv_xlen == 32
-	regs->mstatusH &= ~MSTATUSH_MPV;
-	regs->mstatusH |= (next_virt) ? MSTATUSH_MPV : 0UL;
-#else
-	regs->mstatus &= ~MSTATUS_MPV;
-	regs->mstatus |= (next_virt) ? MSTATUS_MPV : 0UL;
-#endif
-
-	/* Update hypervisor CSRs if going to HS-mode */
-	if (misa_extension('H') && !next_virt) {
+	/*
+	 * Common case, the trap came from S/U-mode (MPV is clear) and goes
+	 * to (H)S-mode so only hstatus.SPV and hstatus.GVA change.
+	 */
+	if (profile & TRAP_REDIRECT_H) {
 		hstatus = csr_read(CSR_HSTATUS);
-		if (prev_virt) {
-			/* hstatus.SPVP is only updated if coming from VS/VU-mode */
-			hstatus &= ~HSTATUS_SPVP;
-			hstatus |= (prev_mode == PRV_S) ? HSTATUS_SPVP : 0;
-		}
-		hstatus &= ~HSTATUS_SPV;
-		hstatus |= (prev_virt) ? HSTATUS_SPV : 0;
-		hstatus &= ~HSTATUS_GVA;
+		hstatus &= ~(HSTATUS_SPV | HSTATUS_GVA);
 		hstatus |= (trap->gva) ? HSTATUS_GVA : 0;
 		csr_write(CSR_HSTATUS, hstatus);
 		csr_write(CSR_HTVAL, trap->tval2);
 		csr_write(CSR_HTINST, trap->tinst);
 	}
 
-	/* Update exception related CSRs */
-	if (next_virt) {
-		/* Update VS-mode exception info */
-		csr_write(CSR_VSTVAL, trap->tval);
-		csr_write(CSR_VSEPC, regs->mepc);
-		csr_write(CSR_VSCAUSE, trap->cause);
-
-		/* Set MEPC to VS-mode exception vector base */
-		regs->mepc = csr_read(CSR_VSTVEC);
-
-		/* Set MPP to VS-mode */
-		regs->mstatus &= ~MSTATUS_MPP;
-		regs->mstatus |= (PRV_S << MSTATUS_MPP_SHIFT);
-
-		/* Get VS-mode SSTATUS CSR */
-		vsstatus = csr_read(CSR_VSSTATUS);
-
-		/* If elp was set, set it back in vsstatus */
-		if (elp)
-			vsstatus |= MSTATUS_SPELP;
-
-		/* Set SPP for VS-mode */
-		vsstatus &= ~SSTATUS_SPP;
-		if (prev_mode == PRV_S)
-			vsstatus |= (1UL << SSTATUS_SPP_SHIFT);
-
-		/* Set SPIE for VS-mode */
-		vsstatus &= ~SSTATUS_SPIE;
-		if (vsstatus & SSTATUS_SIE)
-			vsstatus |= (1UL << SSTATUS_SPIE_SHIFT);
-
-		/* Clear SIE for VS-mode */
-		vsstatus &= ~SSTATUS_SIE;
-
-		/* Update VS-mode SSTATUS CSR */
-		csr_write(CSR_VSSTATUS, vsstatus);
-	} else {
-		/* Update S-mode exception info */
-		csr_write(CSR_STVAL, trap->tval);
-		csr_write(CSR_SEPC, regs->mepc);
-		csr_write(CSR_SCAUSE, trap->cause);
-
-		/* Set MEPC to S-mode exception vector base */
-		regs->mepc = csr_read(CSR_STVEC);
-
-		/* Set MPP to S-mode */
-		regs->mstatus &= ~MSTATUS_MPP;
-		regs->mstatus |= (PRV_S << MSTATUS_MPP_SHIFT);
-
-		/* Set SPP for S-mode */
-		regs->mstatus &= ~MSTATUS_SPP;
-		if (prev_mode == PRV_S)
-			regs->mstatus |= (1UL << MSTATUS_SPP_SHIFT);
-
-		/* Set SPIE for S-mode */
-		regs->mstatus &= ~MSTATUS_SPIE;
-		if (regs->mstatus & MSTATUS_SIE)
-			regs->mstatus |= (1UL << MSTATUS_SPIE_SHIFT);
-
-		/* Clear SIE for S-mode */
-		regs->mstatus &= ~MSTATUS_SIE;
-
-		/* If elp was set, set it back in mstatus */
-		if (elp)
-			regs->mstatus |= MSTATUS_SPELP;
-	}
+	trap_redirect_to_s(regs, trap, prev_mode, elp);
 
 	return 0;
 }
 
-static int sbi_trap_nonaia_irq(unsigned long irq)
+int sbi_trap_init(struct sbi_scratch *scratch, bool cold_boot)
 {
-	switch (irq) {
-	case IRQ_M_TIMER:
-		sbi_timer_process();
-		break;
-	case IRQ_M_SOFT:
-		sbi_ipi_process();
-		break;
-	case IRQ_PMU_OVF:
-		sbi_pmu_ovf_irq();
-		break;
-	case IRQ_M_EXT:
-		return sbi_irqchip_process();
-	default:
-		return SBI_ENOENT;
+	if (cold_boot) {
+		trap_redirect_off =
+			sbi_scratch_alloc_hot_offset(sizeof(unsigned long));
+		if (!trap_redirect_off)
+			return SBI_ENOMEM;
 	}
 
+	/* Extensions of the HART are known after sbi_hart_init() */
+	sbi_scratch_write_type(scratch, unsigned long, trap_redirect_off,
+			       trap_redirect_profile(scratch));
+
 	return 0;
 }
 
+static int sbi_trap_nonaia_irq(unsigned long irq)
+{
+	return sbi_irqchip_local_process(irq);
+}
+
 static int sbi_trap_aia_irq(void)
 {
 	int rc;
 	unsigned long mtopi;
 
 	while ((mtopi = csr_read(CSR_MTOPI))) {
-		mtopi = mtopi >> TOPI_IID_SHIFT;
-		switch (mtopi) {
-		case IRQ_M_TIMER:
-			sbi_timer_process();
-			break;
-		case IRQ_M_SOFT:
-			sbi_ipi_process();
-			break;
-		case IRQ_PMU_OVF:
-			sbi_pmu_ovf_irq();
-			break;
-		case IRQ_M_EXT:
-			rc = sbi_irqchip_process();
-			if (rc)
-				return rc;
-			break;
-		default:
-			return SBI_ENOENT;
-		}
+		rc = sbi_irqchip_local_process(mtopi >> TOPI_IID_SHIFT);
+		if (rc)
+			return rc;
 	}
 
 	return 0;
@@ -295,9 +372,17 @@ static int sbi_trap_aia_irq(void)
  * 6. Stack pointer (SP) is setup for current HART
  * 7. Interrupts are disabled in MSTATUS CSR
  *
+ * The handler is specialised at compile time on whether the HART has
+ * the Smaia extension so that interrupts are dispatched without any
+ * feature lookup. The trap entry selected by sbi_hart_reinit() calls
+ * the matching variant.
+ *
  * @param tcntx pointer to trap context
+ * @param aia true if the HART has the Smaia extension
  */
-struct sbi_trap_context *sbi_trap_handler(struct sbi_trap_context *tcntx)
+static __always_inline struct sbi_trap_context *trap_handler(
+					struct sbi_trap_context *tcntx,
+					bool aia)
 {
 	int rc = SBI_ENOTSUPP;
 	const char *msg = "trap handler failed";
@@ -305,14 +390,27 @@ struct sbi_trap_context *sbi_trap_handler(struct sbi_trap_context *tcntx)
 	const struct sbi_trap_info *trap = &tcntx->trap;
 	struct sbi_trap_regs *regs = &tcntx->regs;
 	ulong mcause = tcntx->trap.cause;
+	unsigned long start = sbi_trap_stats_start();
+	unsigned long mcycle = csr_read(CSR_MCYCLE);
+
+	sbi_tracepoint(trap, mcause);
+
+	/*
+	 * Double traps only come from S/VS-mode and are either redirected
+	 * or turned into an SSE event, so they skip the trap context chain
+	 * and the M-mode accounting unless that fails.
+	 */
+	if (mcause == CAUSE_DOUBLE_TRAP && sbi_double_trap_fast(tcntx)) {
+		sbi_trap_stats_record(mcause, false, start);
+		return tcntx;
+	}
 
 	/* Update trap context pointer */
 	tcntx->prev_context = sbi_trap_get_context(scratch);
 	sbi_trap_set_context(scratch, tcntx);
 
 	if (mcause & MCAUSE_IRQ_MASK) {
-		if (sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
-					   SBI_HART_EXT_SMAIA))
+		if (aia)
 			rc = sbi_trap_aia_irq();
 		else
 			rc = sbi_trap_nonaia_irq(mcause & ~MCAUSE_IRQ_MASK);
@@ -350,6 +448,11 @@ struct sbi_trap_context *sbi_trap_handler(struct sbi_trap_context *tcntx)
 		rc  = sbi_store_access_handler(tcntx);
 		msg = "store fault handler failed";
 		break;
+	case CAUSE_FETCH_ACCESS:
+		msg = "trap redirect failed";
+		rc  = sbi_hart_pmp_fault(tcntx) ? 0 :
+		      sbi_trap_redirect(regs, trap);
+		break;
 	case CAUSE_DOUBLE_TRAP:
 		rc  = sbi_double_trap_handler(tcntx);
 		msg = "double trap handler failed";
@@ -365,9 +468,32 @@ trap_done:
 	if (rc)
 		sbi_trap_error(msg, rc, tcntx);
 
+	/* A domain context switch changes the trap context to return with */
+	tcntx = sbi_trap_get_context(scratch);
+	regs = &tcntx->regs;
+
+	/* Nested traps are already part of the outer trap cycles */
+	if (!tcntx->prev_context) {
+		sbi_pmu_ctr_add_fw(SBI_PMU_FW_MMODE_CYCLES,
+				   csr_read(CSR_MCYCLE) - mcycle);
+		sbi_pmu_fw_samples_flush();
+	}
+
 	if (sbi_mstatus_prev_mode(regs->mstatus) != PRV_M)
 		sbi_sse_process_pending_events(regs);
 
+	sbi_trap_stats_record(mcause, tcntx->prev_context != NULL, start);
+
 	sbi_trap_set_context(scratch, tcntx->prev_context);
 	return tcntx;
 }
+
+struct sbi_trap_context *sbi_trap_handler(struct sbi_trap_context *tcntx)
+{
+	return trap_handler(tcntx, false);
+}
+
+struct sbi_trap_context *sbi_trap_handler_aia(struct sbi_trap_context *tcntx)
+{
+	return trap_handler(tcntx, true);
+}
@@ -10,7 +10,16 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/riscv_fp.h>
+#include <sbi/sbi_bitops.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_hartmask.h>
+#include <sbi/sbi_ipi.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
 #include <sbi/sbi_trap_ldst.h>
 #include <sbi/sbi_trap.h>
 #include <sbi/sbi_unpriv.h>
@@ -44,6 +53,305 @@ static ulong sbi_misaligned_tinst_fixup(ulong orig_tinst, ulong new_tinst,
 		return orig_tinst | (addr_offset << SH_RS1);
 }
 
+#ifdef OPENSBI_CC_SUPPORT_VECTOR
+
+/* Largest vector register length in bytes handled by the emulation */
+#define VLENB_MAX			256
+
+#define VREG_FOR_EACH(__f)						\
+	__f(0)  __f(1)  __f(2)  __f(3)  __f(4)  __f(5)  __f(6)  __f(7)	\
+	__f(8)  __f(9)  __f(10) __f(11) __f(12) __f(13) __f(14) __f(15)	\
+	__f(16) __f(17) __f(18) __f(19) __f(20) __f(21) __f(22) __f(23)	\
+	__f(24) __f(25) __f(26) __f(27) __f(28) __f(29) __f(30) __f(31)
+
+/* Whole register accesses depend on neither vtype nor vl */
+#define VREG_SAVE(__n)							\
+	case __n:							\
+		asm volatile(".option push\n"				\
+			     ".option arch, +v\n"			\
+			     "vs1r.v v" #__n ", (%0)\n"			\
+			     ".option pop\n"				\
+			     : : "r"(buf) : "memory");			\
+		break;
+
+#define VREG_RESTORE(__n)						\
+	case __n:							\
+		asm volatile(".option push\n"				\
+			     ".option arch, +v\n"			\
+			     "vl1re8.v v" #__n ", (%0)\n"		\
+			     ".option pop\n"				\
+			     : : "r"(buf) : "memory");			\
+		break;
+
+static void vreg_save(ulong reg, u8 *buf)
+{
+	switch (reg) {
+	VREG_FOR_EACH(VREG_SAVE)
+	}
+}
+
+static void vreg_restore(ulong reg, const u8 *buf)
+{
+	switch (reg) {
+	VREG_FOR_EACH(VREG_RESTORE)
+	}
+}
+
+/** Copy of one vector register which is written back when dirty */
+struct vreg_cache {
+	long reg;
+	bool dirty;
+	u8 buf[VLENB_MAX];
+};
+
+static void vreg_cache_flush(struct vreg_cache *vc)
+{
+	if (vc->dirty)
+		vreg_restore(vc->reg, vc->buf);
+	vc->dirty = false;
+}
+
+static u8 *vreg_cache_get(struct vreg_cache *vc, ulong reg)
+{
+	if (vc->reg != reg) {
+		vreg_cache_flush(vc);
+		vreg_save(reg, vc->buf);
+		vc->reg = reg;
+	}
+
+	return vc->buf;
+}
+
+/** Decoded vector load or store */
+struct vldst {
+	bool store;
+	bool fault_first;
+	bool masked;
+	u32 mop;
+	ulong vlenb;
+	ulong evl;
+	ulong nfields;
+	/* Data element width in bytes and registers per field */
+	ulong eew;
+	ulong regs;
+	ulong vd;
+	/* Index element width in bytes for indexed accesses */
+	ulong idx_eew;
+	ulong vs2;
+	ulong base;
+	long stride;
+};
+
+static int vldst_decode(ulong insn, struct sbi_trap_regs *regs,
+			struct vldst *v)
+{
+	ulong vtype = csr_read(CSR_VTYPE);
+	ulong width = VECTOR_WIDTH_BYTES(VECTOR_WIDTH(insn));
+	long sew_log2, lmul_log2, emul_log2;
+
+	if ((vtype & VTYPE_VILL) || VECTOR_MEW(insn))
+		return SBI_EINVAL;
+
+	sew_log2 = (vtype & VTYPE_VSEW) >> VTYPE_VSEW_SHIFT;
+	lmul_log2 = vtype & VTYPE_VLMUL;
+	if (lmul_log2 > 3)
+		lmul_log2 -= 8;
+
+	v->store = IS_VECTOR_STORE(insn);
+	v->fault_first = false;
+	v->masked = !VECTOR_VM(insn);
+	v->mop = VECTOR_MOP(insn);
+	v->vlenb = csr_read(CSR_VLENB);
+	v->evl = csr_read(CSR_VL);
+	v->nfields = VECTOR_NF(insn) + 1;
+	v->vd = (insn >> SH_RD) & 0x1f;
+	v->vs2 = (insn >> SH_RS2) & 0x1f;
+	v->base = GET_RS1(insn, regs);
+	v->stride = 0;
+	v->idx_eew = 0;
+
+	if (VLENB_MAX < v->vlenb)
+		return SBI_ENOTSUPP;
+
+	switch (v->mop) {
+	case VECTOR_MOP_UNIT_STRIDE:
+		switch (VECTOR_UMOP(insn)) {
+		case VECTOR_UMOP_UNIT_STRIDE:
+			break;
+		case VECTOR_UMOP_FAULT_FIRST:
+			if (v->store)
+				return SBI_EINVAL;
+			v->fault_first = true;
+			break;
+		case VECTOR_UMOP_WHOLE_REG:
+			/* All fields form one group of nf registers */
+			v->eew = width;
+			v->regs = v->nfields;
+			v->evl = v->regs * v->vlenb / width;
+			v->nfields = 1;
+			v->masked = false;
+			return 0;
+		case VECTOR_UMOP_MASK:
+			v->eew = 1;
+			v->regs = 1;
+			v->evl = (v->evl + 7) / 8;
+			v->masked = false;
+			return 0;
+		default:
+			return SBI_EINVAL;
+		}
+		/* fallthrough */
+	case VECTOR_MOP_STRIDED:
+		if (v->mop == VECTOR_MOP_STRIDED)
+			v->stride = GET_RS2(insn, regs);
+		v->eew = width;
+		emul_log2 = (long)sbi_fls(width) - sew_log2 + lmul_log2;
+		break;
+	default:
+		v->eew = 1UL << sew_log2;
+		v->idx_eew = width;
+		emul_log2 = lmul_log2;
+		break;
+	}
+
+	if (emul_log2 < -3 || 3 < emul_log2)
+		return SBI_EINVAL;
+	v->regs = (emul_log2 > 0) ? (1UL << emul_log2) : 1;
+
+	return 0;
+}
+
+static ulong vldst_addr(struct vldst *v, struct vreg_cache *idx,
+			ulong i, ulong f)
+{
+	ulong off;
+	u64 idx_val = 0;
+
+	switch (v->mop) {
+	case VECTOR_MOP_UNIT_STRIDE:
+		return v->base + (i * v->nfields + f) * v->eew;
+	case VECTOR_MOP_STRIDED:
+		return v->base + i * v->stride + f * v->eew;
+	default:
+		/*
+		 * Indices are zero extended and 64-bit indices are
+		 * truncated to XLEN on RV32.
+		 */
+		off = i * v->idx_eew;
+		sbi_memcpy(&idx_val,
+			   vreg_cache_get(idx, v->vs2 + off / v->vlenb) +
+			   off % v->vlenb, v->idx_eew);
+		return v->base + (ulong)idx_val + f * v->eew;
+	}
+}
+
+/*
+ * Emulate a vector load or store element by element through the lower
+ * privilege copy helpers. Consecutive unmasked elements of a contiguous
+ * access are copied in one go per vector register.
+ */
+static int sbi_trap_emulate_vector(ulong insn, struct sbi_trap_context *tcntx)
+{
+	const struct sbi_trap_info *orig_trap = &tcntx->trap;
+	struct sbi_trap_regs *regs = &tcntx->regs;
+	struct sbi_trap_info uptrap;
+	struct vreg_cache data = { .reg = -1 }, idx = { .reg = -1 };
+	struct vreg_cache mask = { .reg = -1 };
+	ulong i, f, n, off, addr, bytes, done, vstart;
+	bool contig;
+	struct vldst v;
+	u8 *ptr;
+
+	/* A transformed instruction has the rs1 field replaced */
+	if (orig_trap->tinst & 0x1) {
+		insn = sbi_get_insn(regs->mepc, &uptrap);
+		if (uptrap.cause)
+			return sbi_trap_redirect(regs, &uptrap);
+	}
+
+	if (vldst_decode(insn, regs, &v))
+		return sbi_trap_redirect(regs, orig_trap);
+
+	vstart = csr_read(CSR_VSTART);
+	/* Whole register accesses below must not be limited by vstart */
+	csr_write(CSR_VSTART, 0);
+
+	if (v.masked)
+		vreg_cache_get(&mask, 0);
+
+	contig = v.mop == VECTOR_MOP_UNIT_STRIDE && v.nfields == 1 &&
+		 !v.masked;
+
+	for (i = vstart; i < v.evl; i += n) {
+		n = 1;
+		if (v.masked && !(mask.buf[i / 8] & BIT(i % 8)))
+			continue;
+
+		for (f = 0; f < v.nfields; f++) {
+			off = i * v.eew;
+			ptr = vreg_cache_get(&data,
+					     v.vd + f * v.regs + off / v.vlenb) +
+			      off % v.vlenb;
+			addr = vldst_addr(&v, &idx, i, f);
+
+			/* Rest of the elements held by this register */
+			if (contig) {
+				n = (v.vlenb - off % v.vlenb) / v.eew;
+				if (v.evl - i < n)
+					n = v.evl - i;
+			}
+			bytes = n * v.eew;
+
+			if (v.store) {
+				done = sbi_copy_to_lower((void *)addr, ptr,
+							 bytes, &uptrap);
+			} else {
+				done = sbi_copy_from_lower(ptr, (void *)addr,
+							   bytes, &uptrap);
+				data.dirty = true;
+			}
+
+			if (done < bytes)
+				goto fault;
+		}
+	}
+
+	vreg_cache_flush(&data);
+	regs->mepc += 4;
+
+	return 0;
+
+fault:
+	vreg_cache_flush(&data);
+	i += done / v.eew;
+
+	/* Only a fault of the first element is reported by vleNff.v */
+	if (v.fault_first && i) {
+		asm volatile(".option push\n"
+			     ".option arch, +v\n"
+			     "vsetvl zero, %0, %1\n"
+			     ".option pop\n"
+			     : : "r"(i), "r"(csr_read(CSR_VTYPE)) : "memory");
+		regs->mepc += 4;
+		return 0;
+	}
+
+	csr_write(CSR_VSTART, i);
+	uptrap.tinst = sbi_misaligned_tinst_fixup(orig_trap->tinst,
+						  uptrap.tinst, 0);
+
+	return sbi_trap_redirect(regs, &uptrap);
+}
+
+#else
+
+static int sbi_trap_emulate_vector(ulong insn, struct sbi_trap_context *tcntx)
+{
+	return sbi_trap_redirect(&tcntx->regs, &tcntx->trap);
+}
+
+#endif
+
 static int sbi_trap_emulate_load(struct sbi_trap_context *tcntx,
 				 sbi_trap_ld_emulator emu)
 {
@@ -144,6 +452,9 @@ static int sbi_trap_emulate_load(struct sbi_trap_context *tcntx,
 		len = 2;
 		shift = 8 * (sizeof(ulong) - len);
 		insn = RVC_RS2S(insn) << SH_RD;
+	} else if (IS_VECTOR_LOAD(insn) &&
+		   orig_trap->cause == CAUSE_MISALIGNED_LOAD) {
+		return sbi_trap_emulate_vector(insn, tcntx);
 	} else {
 		return sbi_trap_redirect(regs, orig_trap);
 	}
@@ -248,6 +559,9 @@ static int sbi_trap_emulate_store(struct sbi_trap_context *tcntx,
 	} else if ((insn & INSN_MASK_C_SH) == INSN_MATCH_C_SH) {
 		len		= 2;
 		val.data_ulong = GET_RS2S(insn, regs);
+	} else if (IS_VECTOR_STORE(insn) &&
+		   orig_trap->cause == CAUSE_MISALIGNED_STORE) {
+		return sbi_trap_emulate_vector(insn, tcntx);
 	} else {
 		return sbi_trap_redirect(regs, orig_trap);
 	}
@@ -267,22 +581,131 @@ static int sbi_misaligned_ld_emulator(int rlen, union sbi_ldst_data *out_val,
 	const struct sbi_trap_info *orig_trap = &tcntx->trap;
 	struct sbi_trap_regs *regs = &tcntx->regs;
 	struct sbi_trap_info uptrap;
-	int i;
+	ulong val, addr = orig_trap->tval;
+	int i, len;
 
-	for (i = 0; i < rlen; i++) {
-		out_val->data_bytes[i] =
-			sbi_load_u8((void *)(orig_trap->tval + i), &uptrap);
+	/* Only RV32 double loads are wider than one aligned word pair */
+	for (i = 0; i < rlen; i += len) {
+		len = rlen - i;
+		if (len > sizeof(ulong))
+			len = sizeof(ulong);
+
+		val = sbi_load_misaligned(addr + i, len, &uptrap);
 		if (uptrap.cause) {
 			uptrap.tinst = sbi_misaligned_tinst_fixup(
-				orig_trap->tinst, uptrap.tinst, i);
+				orig_trap->tinst, uptrap.tinst,
+				uptrap.tval - addr);
 			return sbi_trap_redirect(regs, &uptrap);
 		}
+		sbi_memcpy(&out_val->data_bytes[i], &val, len);
 	}
 	return rlen;
 }
 
+#ifdef CONFIG_SBI_MISALIGNED_MONITOR
+#define MISALIGNED_DELEG	(BIT(CAUSE_MISALIGNED_LOAD) | \
+				 BIT(CAUSE_MISALIGNED_STORE))
+
+/** Per-hart misaligned trap counts over windows of about one second */
+struct misaligned_monitor {
+	u64 window_start;
+	unsigned long count;
+	/* Traps per second of the last complete window */
+	unsigned long rate;
+	bool warned;
+};
+
+static unsigned long misaligned_monitor_off;
+
+#ifdef CONFIG_SBI_MISALIGNED_AUTO_DELEG
+static void misaligned_monitor_deleg(void *arg)
+{
+	csr_set(CSR_MEDELEG, MISALIGNED_DELEG);
+}
+#endif
+
+static void misaligned_monitor_update(void)
+{
+	u64 now, elapsed;
+	struct misaligned_monitor *mon;
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+#ifdef CONFIG_SBI_MISALIGNED_AUTO_DELEG
+	struct sbi_hartmask all;
+#endif
+
+	if (!misaligned_monitor_off || !tdev || !tdev->timer_freq)
+		return;
+
+	mon = sbi_scratch_thishart_offset_ptr(misaligned_monitor_off);
+	mon->count++;
+
+	now = sbi_timer_value();
+	elapsed = now - mon->window_start;
+	if (elapsed < tdev->timer_freq)
+		return;
+
+	mon->rate = (u64)mon->count * tdev->timer_freq / elapsed;
+	mon->count = 0;
+	mon->window_start = now;
+	if (mon->rate < CONFIG_SBI_MISALIGNED_MONITOR_THRESHOLD)
+		return;
+
+	if (!mon->warned) {
+		sbi_printf("hart%u: %lu misaligned access traps per second\n",
+			   current_hartid(), mon->rate);
+		mon->warned = true;
+	}
+
+#ifdef CONFIG_SBI_MISALIGNED_AUTO_DELEG
+	/* Let the supervisor of the domain emulate them from now on */
+	if ((csr_read(CSR_MEDELEG) & MISALIGNED_DELEG) != MISALIGNED_DELEG) {
+		sbi_hartmask_set_all(&all);
+		sbi_ipi_call_many(&all, misaligned_monitor_deleg, NULL, false);
+	}
+#endif
+}
+
+int sbi_misaligned_monitor_rate(unsigned long hartid, unsigned long *rate)
+{
+	u32 hartindex = sbi_hartid_to_hartindex(hartid);
+	struct sbi_scratch *scratch = sbi_hartindex_to_scratch(hartindex);
+	struct misaligned_monitor *mon;
+
+	if (!scratch ||
+	    !sbi_domain_is_assigned_hart(sbi_domain_thishart_ptr(), hartindex))
+		return SBI_EINVAL;
+
+	mon = sbi_scratch_offset_ptr(scratch, misaligned_monitor_off);
+	*rate = __atomic_load_n(&mon->rate, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+int sbi_misaligned_monitor_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	struct misaligned_monitor *mon;
+
+	if (cold_boot) {
+		misaligned_monitor_off = sbi_scratch_alloc_offset(sizeof(*mon));
+		if (!misaligned_monitor_off)
+			return SBI_ENOMEM;
+	} else if (!misaligned_monitor_off) {
+		return SBI_ENOMEM;
+	}
+
+	mon = sbi_scratch_offset_ptr(scratch, misaligned_monitor_off);
+	sbi_memset(mon, 0, sizeof(*mon));
+	mon->window_start = sbi_timer_value();
+
+	return 0;
+}
+#else
+static inline void misaligned_monitor_update(void) { }
+#endif
+
 int sbi_misaligned_load_handler(struct sbi_trap_context *tcntx)
 {
+	misaligned_monitor_update();
 	return sbi_trap_emulate_load(tcntx, sbi_misaligned_ld_emulator);
 }
 
@@ -292,11 +715,37 @@ static int sbi_misaligned_st_emulator(int wlen, union sbi_ldst_data in_val,
 	const struct sbi_trap_info *orig_trap = &tcntx->trap;
 	struct sbi_trap_regs *regs = &tcntx->regs;
 	struct sbi_trap_info uptrap;
-	int i;
-
-	for (i = 0; i < wlen; i++) {
-		sbi_store_u8((void *)(orig_trap->tval + i),
-			     in_val.data_bytes[i], &uptrap);
+	ulong addr;
+	u64 val;
+	int i, len;
+
+	/*
+	 * Store the widest naturally aligned pieces instead of doing a
+	 * read-modify-write of the enclosing aligned words, which would
+	 * race with other harts writing the neighbouring bytes.
+	 */
+	for (i = 0; i < wlen; i += len) {
+		addr = orig_trap->tval + i;
+		for (len = sizeof(ulong); len > 1; len >>= 1)
+			if (!(addr & (len - 1)) && i + len <= wlen)
+				break;
+
+		val = 0;
+		sbi_memcpy(&val, &in_val.data_bytes[i], len);
+		switch (len) {
+		case 8:
+			sbi_store_u64((void *)addr, val, &uptrap);
+			break;
+		case 4:
+			sbi_store_u32((void *)addr, val, &uptrap);
+			break;
+		case 2:
+			sbi_store_u16((void *)addr, val, &uptrap);
+			break;
+		default:
+			sbi_store_u8((void *)addr, val, &uptrap);
+			break;
+		}
 		if (uptrap.cause) {
 			uptrap.tinst = sbi_misaligned_tinst_fixup(
 				orig_trap->tinst, uptrap.tinst, i);
@@ -308,6 +757,7 @@ static int sbi_misaligned_st_emulator(int wlen, union sbi_ldst_data in_val,
 
 int sbi_misaligned_store_handler(struct sbi_trap_context *tcntx)
 {
+	misaligned_monitor_update();
 	return sbi_trap_emulate_store(tcntx, sbi_misaligned_st_emulator);
 }
 
@@ -331,6 +781,10 @@ static int sbi_ld_access_emulator(int rlen, union sbi_ldst_data *out_val,
 
 int sbi_load_access_handler(struct sbi_trap_context *tcntx)
 {
+	/* The domain may allow the access through a multiplexed PMP entry */
+	if (sbi_hart_pmp_fault(tcntx))
+		return 0;
+
 	return sbi_trap_emulate_load(tcntx, sbi_ld_access_emulator);
 }
 
@@ -354,5 +808,9 @@ static int sbi_st_access_emulator(int wlen, union sbi_ldst_data in_val,
 
 int sbi_store_access_handler(struct sbi_trap_context *tcntx)
 {
+	/* The domain may allow the access through a multiplexed PMP entry */
+	if (sbi_hart_pmp_fault(tcntx))
+		return 0;
+
 	return sbi_trap_emulate_store(tcntx, sbi_st_access_emulator);
 }
@@ -0,0 +1,112 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Per-hart trap cause counters and M-mode residency accounting
+ */
+
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_opensbi.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_trap.h>
+#include <sbi/sbi_trap_stats.h>
+
+static unsigned long trap_stats_off;
+
+static struct sbi_trap_stats *trap_stats_ptr(struct sbi_scratch *scratch)
+{
+	if (!trap_stats_off || !scratch)
+		return NULL;
+
+	return sbi_scratch_read_type(scratch, void *, trap_stats_off);
+}
+
+void sbi_trap_stats_record(unsigned long mcause, bool nested,
+			   unsigned long start)
+{
+	struct sbi_trap_stats *stats =
+			trap_stats_ptr(sbi_scratch_thishart_ptr());
+	unsigned long code = mcause & ~MCAUSE_IRQ_MASK;
+
+	if (!stats)
+		return;
+
+	if (mcause & MCAUSE_IRQ_MASK) {
+		if (SBI_TRAP_STATS_IRQS <= code)
+			code = SBI_TRAP_STATS_IRQS - 1;
+		stats->interrupts[code]++;
+	} else {
+		if (SBI_TRAP_STATS_CAUSES <= code)
+			code = SBI_TRAP_STATS_CAUSES - 1;
+		stats->exceptions[code]++;
+	}
+
+	/* The outer trap already accounts for the cycles of nested ones */
+	if (!nested)
+		stats->mcycles += csr_read(CSR_MCYCLE) - start;
+}
+
+const struct sbi_trap_stats *sbi_trap_stats_get(u32 hartindex)
+{
+	return trap_stats_ptr(sbi_hartindex_to_scratch(hartindex));
+}
+
+static int trap_stats_read(unsigned long hartid, unsigned long addr_lo,
+			   unsigned long addr_hi)
+{
+	struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	u32 hartindex = sbi_hartid_to_hartindex(hartid);
+	struct sbi_trap_stats *stats;
+
+	if (!sbi_domain_is_assigned_hart(dom, hartindex))
+		return SBI_EINVAL;
+
+	stats = trap_stats_ptr(sbi_hartindex_to_scratch(hartindex));
+	if (!stats)
+		return SBI_EINVAL;
+
+	/* The copy may race with the HART updating its statistics */
+	return sbi_domain_copy_to_smode(addr_lo, addr_hi, stats,
+					sizeof(struct sbi_trap_stats));
+}
+
+int sbi_trap_stats_handle(unsigned long funcid, struct sbi_trap_regs *regs,
+			  struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+	case SBI_EXT_OPENSBI_TRAP_STATS:
+		return trap_stats_read(regs->a0, regs->a1, regs->a2);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+int sbi_trap_stats_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	struct sbi_trap_stats *stats;
+
+	if (cold_boot) {
+		trap_stats_off = sbi_scratch_alloc_type_offset(void *);
+		if (!trap_stats_off)
+			return SBI_ENOMEM;
+	} else if (!trap_stats_off) {
+		return SBI_ENOMEM;
+	}
+
+	/* Statistics are kept when a HART is stopped and started again */
+	if (trap_stats_ptr(scratch))
+		return 0;
+
+	stats = sbi_zalloc(sizeof(*stats));
+	if (!stats)
+		return SBI_ENOMEM;
+	sbi_scratch_write_type(scratch, void *, trap_stats_off, stats);
+
+	return 0;
+}
@@ -7,10 +7,12 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <sbi/riscv_asm.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/sbi_bitops.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
 #include <sbi/sbi_trap.h>
 #include <sbi/sbi_unpriv.h>
 
@@ -116,6 +118,240 @@ void sbi_store_u64(u64 *addr, u64 val,
 # error "Unexpected __riscv_xlen"
 #endif
 
+/**
+ * Load len bytes, at most sizeof(ulong), from a possibly misaligned
+ * address with at most two aligned accesses in one MPRV window. On a
+ * fault the trap tval is set to the first byte of the range covered by
+ * the faulting access so that the caller can compute the address offset.
+ */
+ulong sbi_load_misaligned(ulong addr, ulong len, struct sbi_trap_info *trap)
+{
+	register ulong tinfo asm("a3");
+	register ulong ttmp asm("a4") = 0;
+	register ulong mstatus = 0;
+	register ulong mtvec = sbi_hart_expected_trap_addr();
+	ulong off = addr & (sizeof(ulong) - 1);
+	ulong base = addr - off;
+	ulong two = (off + len > sizeof(ulong)) ? 1 : 0;
+	ulong lo = 0, hi = 0, second = 0;
+
+	trap->cause = 0;
+
+	/*
+	 * The expected trap handler leaves a non-zero value in a4 so the
+	 * second access is skipped once the first one faulted.
+	 */
+	asm volatile(
+	    "add %[tinfo], %[taddr], zero\n"
+	    "csrrw %[mtvec], " STR(CSR_MTVEC) ", %[mtvec]\n"
+	    "csrrs %[mstatus], " STR(CSR_MSTATUS) ", %[mprv]\n"
+	    ".option push\n"
+	    ".option norvc\n"
+	    REG_L " %[lo], 0(%[base])\n"
+	    ".option pop\n"
+	    "bne %[ttmp], zero, 2f\n"
+	    "beq %[two], zero, 2f\n"
+	    "addi %[second], zero, 1\n"
+	    ".option push\n"
+	    ".option norvc\n"
+	    REG_L " %[hi], %[size](%[base])\n"
+	    ".option pop\n"
+	    "2: csrw " STR(CSR_MSTATUS) ", %[mstatus]\n"
+	    "csrw " STR(CSR_MTVEC) ", %[mtvec]"
+	    : [mstatus] "+&r"(mstatus), [mtvec] "+&r"(mtvec),
+	      [tinfo] "+&r"(tinfo), [ttmp] "+&r"(ttmp),
+	      [lo] "+&r"(lo), [hi] "+&r"(hi), [second] "+&r"(second)
+	    : [mprv] "r"(MSTATUS_MPRV), [taddr] "r"((ulong)trap),
+	      [base] "r"(base), [two] "r"(two), [size] "i"(sizeof(ulong))
+	    : "memory");
+
+	if (trap->cause) {
+		trap->tval = second ? base + sizeof(ulong) : addr;
+		return 0;
+	}
+
+	if (!off)
+		return lo;
+
+	return (lo >> (off * 8)) | (hi << ((sizeof(ulong) - off) * 8));
+}
+
+/* Maximum number of words moved in one MPRV window */
+#define UNPRIV_COPY_WORDS	8
+
+/*
+ * Move one word between a register and lower privilege memory unless
+ * the requested number of words is reached or an earlier access of the
+ * window faulted, in which case the expected trap handler has left a
+ * non-zero value in a4.
+ */
+#define UNPRIV_COPY_LOAD(__i)						\
+	"beq %[cnt], %[num], 2f\n"					\
+	".option push\n"						\
+	".option norvc\n"						\
+	REG_L " %[w" #__i "], 0(%[addr])\n"				\
+	".option pop\n"							\
+	"bne %[ttmp], zero, 2f\n"					\
+	"addi %[cnt], %[cnt], 1\n"					\
+	"addi %[addr], %[addr], %[size]\n"
+
+#define UNPRIV_COPY_STORE(__i)						\
+	"beq %[cnt], %[num], 2f\n"					\
+	".option push\n"						\
+	".option norvc\n"						\
+	REG_S " %[w" #__i "], 0(%[addr])\n"				\
+	".option pop\n"							\
+	"bne %[ttmp], zero, 2f\n"					\
+	"addi %[cnt], %[cnt], 1\n"					\
+	"addi %[addr], %[addr], %[size]\n"
+
+/* Load up to UNPRIV_COPY_WORDS aligned words and return the number loaded */
+static ulong unpriv_load_words(const ulong *src, ulong *buf, ulong num,
+			       struct sbi_trap_info *trap)
+{
+	register ulong tinfo asm("a3");
+	register ulong ttmp asm("a4") = 0;
+	register ulong mstatus = 0;
+	register ulong mtvec = sbi_hart_expected_trap_addr();
+	ulong addr = (ulong)src, cnt = 0;
+	ulong w0 = 0, w1 = 0, w2 = 0, w3 = 0, w4 = 0, w5 = 0, w6 = 0, w7 = 0;
+
+	trap->cause = 0;
+
+	asm volatile(
+	    "add %[tinfo], %[taddr], zero\n"
+	    "csrrw %[mtvec], " STR(CSR_MTVEC) ", %[mtvec]\n"
+	    "csrrs %[mstatus], " STR(CSR_MSTATUS) ", %[mprv]\n"
+	    UNPRIV_COPY_LOAD(0)
+	    UNPRIV_COPY_LOAD(1)
+	    UNPRIV_COPY_LOAD(2)
+	    UNPRIV_COPY_LOAD(3)
+	    UNPRIV_COPY_LOAD(4)
+	    UNPRIV_COPY_LOAD(5)
+	    UNPRIV_COPY_LOAD(6)
+	    UNPRIV_COPY_LOAD(7)
+	    "2: csrw " STR(CSR_MSTATUS) ", %[mstatus]\n"
+	    "csrw " STR(CSR_MTVEC) ", %[mtvec]"
+	    : [mstatus] "+&r"(mstatus), [mtvec] "+&r"(mtvec),
+	      [tinfo] "+&r"(tinfo), [ttmp] "+&r"(ttmp),
+	      [addr] "+&r"(addr), [cnt] "+&r"(cnt),
+	      [w0] "+&r"(w0), [w1] "+&r"(w1), [w2] "+&r"(w2), [w3] "+&r"(w3),
+	      [w4] "+&r"(w4), [w5] "+&r"(w5), [w6] "+&r"(w6), [w7] "+&r"(w7)
+	    : [mprv] "r"(MSTATUS_MPRV), [taddr] "r"((ulong)trap),
+	      [num] "r"(num), [size] "i"(sizeof(ulong))
+	    : "memory");
+
+	buf[0] = w0; buf[1] = w1; buf[2] = w2; buf[3] = w3;
+	buf[4] = w4; buf[5] = w5; buf[6] = w6; buf[7] = w7;
+
+	return cnt;
+}
+
+/* Store up to UNPRIV_COPY_WORDS aligned words and return the number stored */
+static ulong unpriv_store_words(ulong *dst, const ulong *buf, ulong num,
+				struct sbi_trap_info *trap)
+{
+	register ulong tinfo asm("a3");
+	register ulong ttmp asm("a4") = 0;
+	register ulong mstatus = 0;
+	register ulong mtvec = sbi_hart_expected_trap_addr();
+	ulong addr = (ulong)dst, cnt = 0;
+	ulong w0 = buf[0], w1 = buf[1], w2 = buf[2], w3 = buf[3];
+	ulong w4 = buf[4], w5 = buf[5], w6 = buf[6], w7 = buf[7];
+
+	trap->cause = 0;
+
+	asm volatile(
+	    "add %[tinfo], %[taddr], zero\n"
+	    "csrrw %[mtvec], " STR(CSR_MTVEC) ", %[mtvec]\n"
+	    "csrrs %[mstatus], " STR(CSR_MSTATUS) ", %[mprv]\n"
+	    UNPRIV_COPY_STORE(0)
+	    UNPRIV_COPY_STORE(1)
+	    UNPRIV_COPY_STORE(2)
+	    UNPRIV_COPY_STORE(3)
+	    UNPRIV_COPY_STORE(4)
+	    UNPRIV_COPY_STORE(5)
+	    UNPRIV_COPY_STORE(6)
+	    UNPRIV_COPY_STORE(7)
+	    "2: csrw " STR(CSR_MSTATUS) ", %[mstatus]\n"
+	    "csrw " STR(CSR_MTVEC) ", %[mtvec]"
+	    : [mstatus] "+&r"(mstatus), [mtvec] "+&r"(mtvec),
+	      [tinfo] "+&r"(tinfo), [ttmp] "+&r"(ttmp),
+	      [addr] "+&r"(addr), [cnt] "+&r"(cnt)
+	    : [mprv] "r"(MSTATUS_MPRV), [taddr] "r"((ulong)trap),
+	      [num] "r"(num), [size] "i"(sizeof(ulong)),
+	      [w0] "r"(w0), [w1] "r"(w1), [w2] "r"(w2), [w3] "r"(w3),
+	      [w4] "r"(w4), [w5] "r"(w5), [w6] "r"(w6), [w7] "r"(w7)
+	    : "memory");
+
+	return cnt;
+}
+
+ulong sbi_copy_from_lower(void *dst, const void *src, ulong len,
+			  struct sbi_trap_info *trap)
+{
+	ulong num, cnt, done = 0;
+	ulong buf[UNPRIV_COPY_WORDS];
+
+	trap->cause = 0;
+
+	while (done < len) {
+		/* Copy words once the lower privilege address is aligned */
+		num = (len - done) / sizeof(ulong);
+		if (num && !(((ulong)src + done) & (sizeof(ulong) - 1))) {
+			if (num > UNPRIV_COPY_WORDS)
+				num = UNPRIV_COPY_WORDS;
+			cnt = unpriv_load_words((const void *)((ulong)src + done),
+						buf, num, trap);
+			sbi_memcpy((u8 *)dst + done, buf, cnt * sizeof(ulong));
+			done += cnt * sizeof(ulong);
+			if (!trap->cause)
+				continue;
+			/* Go over the faulting word byte by byte */
+		}
+
+		((u8 *)dst)[done] = sbi_load_u8((const u8 *)src + done, trap);
+		if (trap->cause)
+			break;
+		done++;
+	}
+
+	return done;
+}
+
+ulong sbi_copy_to_lower(void *dst, const void *src, ulong len,
+			struct sbi_trap_info *trap)
+{
+	ulong num, cnt, done = 0;
+	ulong buf[UNPRIV_COPY_WORDS];
+
+	trap->cause = 0;
+
+	while (done < len) {
+		/* Copy words once the lower privilege address is aligned */
+		num = (len - done) / sizeof(ulong);
+		if (num && !(((ulong)dst + done) & (sizeof(ulong) - 1))) {
+			if (num > UNPRIV_COPY_WORDS)
+				num = UNPRIV_COPY_WORDS;
+			sbi_memcpy(buf, (const u8 *)src + done,
+				   num * sizeof(ulong));
+			cnt = unpriv_store_words((void *)((ulong)dst + done),
+						 buf, num, trap);
+			done += cnt * sizeof(ulong);
+			if (!trap->cause)
+				continue;
+			/* Go over the faulting word byte by byte */
+		}
+
+		sbi_store_u8((u8 *)dst + done, ((const u8 *)src)[done], trap);
+		if (trap->cause)
+			break;
+		done++;
+	}
+
+	return done;
+}
+
 ulong sbi_get_insn(ulong mepc, struct sbi_trap_info *trap)
 {
 	register ulong tinfo asm("a3");
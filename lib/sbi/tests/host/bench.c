@@ -0,0 +1,178 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: single threaded microbenchmarks
+ */
+
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_bitmap.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_fifo.h>
+#include <sbi/sbi_hartmask.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_string.h>
+
+#include "host.h"
+
+#define BENCH_ITERS		1000000UL
+#define BENCH_FIFO_ENTRIES	16
+#define BENCH_HEAP_SLOTS	64
+
+struct bench {
+	const char *name;
+	/* Runs iters operations and returns how many were done */
+	unsigned long (*fn)(unsigned long iters);
+};
+
+static unsigned long bench_sink;
+
+static unsigned long bench_fifo(unsigned long iters)
+{
+	static u64 mem[BENCH_FIFO_ENTRIES];
+	struct sbi_fifo fifo;
+	unsigned long i;
+	u64 val = 0;
+
+	sbi_fifo_init(&fifo, mem, BENCH_FIFO_ENTRIES, sizeof(u64));
+	for (i = 0; i < iters; i++) {
+		sbi_fifo_enqueue(&fifo, &i, false);
+		sbi_fifo_dequeue(&fifo, &val);
+	}
+	bench_sink += val;
+
+	return 2 * iters;
+}
+
+static unsigned long bench_hartmask(unsigned long iters)
+{
+	struct sbi_hartmask a, b;
+	unsigned long i, w = 0;
+
+	sbi_hartmask_clear_all(&a);
+	sbi_hartmask_set_all(&b);
+	for (i = 0; i < iters; i++) {
+		sbi_hartmask_set_hartindex(i % SBI_HARTMASK_MAX_BITS, &a);
+		sbi_hartmask_and(&b, &b, &a);
+		w += sbi_hartmask_weight(&b);
+		sbi_hartmask_or(&b, &b, &a);
+	}
+	bench_sink += w;
+
+	return iters;
+}
+
+static unsigned long bench_bitmap_find(unsigned long iters)
+{
+	DECLARE_BITMAP(map, 1024);
+	unsigned long i, bit = 0;
+
+	bitmap_zero(map, 1024);
+	bitmap_set(map, 1000, 1);
+	for (i = 0; i < iters; i++)
+		bit += find_next_bit(map, 1024, i & 511);
+	bench_sink += bit;
+
+	return iters;
+}
+
+static unsigned long bench_heap(unsigned long iters)
+{
+	void *slots[BENCH_HEAP_SLOTS] = { 0 };
+	unsigned long i, s;
+
+	for (i = 0; i < iters; i++) {
+		s = (i * 7) % BENCH_HEAP_SLOTS;
+		if (slots[s])
+			sbi_free(slots[s]);
+		slots[s] = sbi_malloc(16 + (i % 13) * 24);
+	}
+	for (s = 0; s < BENCH_HEAP_SLOTS; s++) {
+		if (slots[s])
+			sbi_free(slots[s]);
+	}
+
+	return iters;
+}
+
+static unsigned long bench_snprintf(unsigned long iters)
+{
+	char buf[128];
+	unsigned long i;
+
+	for (i = 0; i < iters; i++)
+		bench_sink += sbi_snprintf(buf, sizeof(buf),
+					   "hart%u: %s 0x%lx %ld %llu\n",
+					   (u32)(i & 63), "event", i, -(long)i,
+					   (unsigned long long)i * 1000003ULL);
+
+	return iters;
+}
+
+static struct sbi_domain_memregion bench_regions[16];
+static struct sbi_domain bench_domain = {
+	.name = "bench",
+	.regions = bench_regions,
+};
+
+static unsigned long bench_domain_check(unsigned long iters)
+{
+	unsigned long i, ok = 0, addr;
+	int r;
+
+	/* Firmware, a few MMIO windows and all of memory at the end */
+	sbi_domain_memregion_init(0x80000000UL, 0x80000, 0,
+				  &bench_regions[0]);
+	for (r = 1; r < 14; r++)
+		sbi_domain_memregion_init(0x10000000UL + r * 0x100000UL,
+					  0x1000,
+					  SBI_DOMAIN_MEMREGION_MMIO |
+					  SBI_DOMAIN_MEMREGION_SU_READABLE |
+					  SBI_DOMAIN_MEMREGION_SU_WRITABLE,
+					  &bench_regions[r]);
+	sbi_domain_memregion_init(0, ~0UL,
+				  SBI_DOMAIN_MEMREGION_SU_READABLE |
+				  SBI_DOMAIN_MEMREGION_SU_WRITABLE |
+				  SBI_DOMAIN_MEMREGION_SU_EXECUTABLE,
+				  &bench_regions[14]);
+
+	for (i = 0; i < iters; i++) {
+		addr = 0x80000000UL + ((i * 4096) & 0xfffffff);
+		ok += sbi_domain_check_addr_range(&bench_domain, addr, 64,
+						  PRV_S, SBI_DOMAIN_READ);
+	}
+	bench_sink += ok;
+
+	return iters;
+}
+
+static const struct bench benches[] = {
+	{ "fifo_enq_deq", bench_fifo },
+	{ "hartmask_ops", bench_hartmask },
+	{ "bitmap_find", bench_bitmap_find },
+	{ "heap_malloc_free", bench_heap },
+	{ "console_snprintf", bench_snprintf },
+	{ "domain_check_range", bench_domain_check },
+};
+
+int host_bench_main(int argc, char **argv)
+{
+	unsigned long long start, ns;
+	unsigned long i, ops;
+	const char *filter = argc ? argv[0] : NULL;
+
+	sbi_printf("%-20s %12s %10s\n", "benchmark", "ops", "ns/op");
+	for (i = 0; i < array_size(benches); i++) {
+		if (filter && sbi_strncmp(benches[i].name, filter,
+					  sbi_strlen(filter)))
+			continue;
+
+		start = host_time_ns();
+		ops = benches[i].fn(BENCH_ITERS);
+		ns = host_time_ns() - start;
+		sbi_printf("%-20s %12lu %6lu.%03lu\n", benches[i].name, ops,
+			   (ulong)(ns / ops), (ulong)((ns * 1000 / ops) % 1000));
+	}
+
+	return 0;
+}
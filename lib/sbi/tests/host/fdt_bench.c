@@ -0,0 +1,551 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: boot time FDT benchmarks
+ *
+ * The device trees of the supported boards are too small to show the
+ * cost of FDT parsing during boot. This generates a synthetic tree with
+ * up to SBI_HARTMASK_MAX_BITS HARTs, thousands of device nodes, dozens
+ * of domains and chains of clock phandles, then times each FDT path of
+ * a cold boot on it. Every path runs once, as during boot, since the
+ * domains it registers cannot be unregistered.
+ */
+
+#include <libfdt.h>
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi_utils/fdt/fdt_domain.h>
+#include <sbi_utils/fdt/fdt_driver.h>
+#include <sbi_utils/fdt/fdt_fixup.h>
+#include <sbi_utils/fdt/fdt_helper.h>
+
+#include "host.h"
+
+#define FDTB_BLOB_SIZE		(8UL << 20)
+#define FDTB_DEVICES_DEFAULT	4096
+#define FDTB_DOMAINS_DEFAULT	31
+#define FDTB_DEPTH_DEFAULT	16
+#define FDTB_DEPTH_MAX		64
+#define FDTB_CLOCK_CHAINS	32
+#define FDTB_HARTS_PER_DOMAIN	8
+#define FDTB_COMPATIBLES	32
+#define FDTB_DOMAIN_MEM_BASE	0xc0000000UL
+#define FDTB_DOMAIN_MEM_ORDER	20
+#define FDTB_DEVICE_BASE	0x10000000UL
+#define FDTB_DEVICE_SIZE	0x1000
+#define FDTB_PLIC_BASE		0x0c000000UL
+
+#define FDTB_TRY(__call)			\
+	do {					\
+		int __rc = (__call);		\
+		if (__rc < 0)			\
+			return __rc;		\
+	} while (0)
+
+struct fdtb_tree {
+	u32 harts;
+	u32 devices;
+	u32 domains;
+	u32 depth;
+	u32 clocks;
+};
+
+/* Kinds of nodes with a phandle, in the order their phandles are given */
+enum fdtb_phandle {
+	FDTB_PH_CPU,
+	FDTB_PH_INTC,
+	FDTB_PH_DOMAIN,
+	FDTB_PH_MEMREGION,
+	FDTB_PH_MMIOREGION,
+	FDTB_PH_PLIC,
+	FDTB_PH_CLOCK,
+	FDTB_PH_DEVICE,
+};
+
+struct fdtb_stage {
+	const char *name;
+	int (*fn)(void *fdt, const struct fdtb_tree *t);
+};
+
+static char fdtb_blob[FDTB_BLOB_SIZE] __aligned(8);
+static fdt32_t fdtb_cells[4 * SBI_HARTMASK_MAX_BITS];
+static unsigned long fdtb_probed;
+static unsigned long fdtb_sink;
+
+static u32 fdtb_phandle(const struct fdtb_tree *t, enum fdtb_phandle kind,
+			u32 index)
+{
+	u32 count[] = { t->harts, t->harts, t->domains, t->domains,
+			t->domains, 1, t->clocks, t->devices };
+	u32 k, phandle = 1;
+
+	for (k = 0; k < kind; k++)
+		phandle += count[k];
+
+	return phandle + index;
+}
+
+/* Domain of a HART, HARTs of the first group stay in the root domain */
+static int fdtb_hart_domain(const struct fdtb_tree *t, u32 hart)
+{
+	u32 group = hart / FDTB_HARTS_PER_DOMAIN;
+
+	return (group && group <= t->domains) ? (int)group - 1 : -1;
+}
+
+static int fdtb_prop_cells(void *fdt, const char *name, const fdt32_t *cells,
+			   u32 count)
+{
+	return fdt_property(fdt, name, cells, count * sizeof(*cells));
+}
+
+static int fdtb_prop_phandle(void *fdt, const struct fdtb_tree *t,
+			     const char *name, enum fdtb_phandle kind,
+			     u32 index)
+{
+	return fdt_property_u32(fdt, name, fdtb_phandle(t, kind, index));
+}
+
+static int fdtb_prop_reg(void *fdt, unsigned long addr, unsigned long size)
+{
+	fdt32_t reg[4] = { cpu_to_fdt32((u64)addr >> 32), cpu_to_fdt32(addr),
+			   cpu_to_fdt32((u64)size >> 32), cpu_to_fdt32(size) };
+
+	return fdtb_prop_cells(fdt, "reg", reg, 4);
+}
+
+static int fdtb_gen_domains(void *fdt, const struct fdtb_tree *t)
+{
+	unsigned long base;
+	char name[32];
+	u32 d, h, first;
+
+	FDTB_TRY(fdt_begin_node(fdt, "opensbi-domains"));
+	FDTB_TRY(fdt_property_string(fdt, "compatible",
+				     "opensbi,domain,config"));
+
+	for (d = 0; d < t->domains; d++) {
+		base = FDTB_DOMAIN_MEM_BASE + (d << FDTB_DOMAIN_MEM_ORDER);
+		sbi_snprintf(name, sizeof(name), "mem%u", d);
+		FDTB_TRY(fdt_begin_node(fdt, name));
+		FDTB_TRY(fdt_property_string(fdt, "compatible",
+					     "opensbi,domain,memregion"));
+		FDTB_TRY(fdt_property_u64(fdt, "base", base));
+		FDTB_TRY(fdt_property_u32(fdt, "order",
+					  FDTB_DOMAIN_MEM_ORDER));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "phandle",
+					   FDTB_PH_MEMREGION, d));
+		FDTB_TRY(fdt_end_node(fdt));
+
+		/* Each domain owns one device, disabled for the others */
+		sbi_snprintf(name, sizeof(name), "mmio%u", d);
+		FDTB_TRY(fdt_begin_node(fdt, name));
+		FDTB_TRY(fdt_property_string(fdt, "compatible",
+					     "opensbi,domain,memregion"));
+		FDTB_TRY(fdt_property_u64(fdt, "base", FDTB_DEVICE_BASE +
+					  d * FDTB_DEVICE_SIZE));
+		FDTB_TRY(fdt_property_u32(fdt, "order", 12));
+		FDTB_TRY(fdt_property(fdt, "mmio", NULL, 0));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "devices",
+					   FDTB_PH_DEVICE, d % t->devices));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "phandle",
+					   FDTB_PH_MMIOREGION, d));
+		FDTB_TRY(fdt_end_node(fdt));
+	}
+
+	for (d = 0; d < t->domains; d++) {
+		first = (d + 1) * FDTB_HARTS_PER_DOMAIN;
+		sbi_snprintf(name, sizeof(name), "domain%u", d);
+		FDTB_TRY(fdt_begin_node(fdt, name));
+		FDTB_TRY(fdt_property_string(fdt, "compatible",
+					     "opensbi,domain,instance"));
+		for (h = 0; h < FDTB_HARTS_PER_DOMAIN; h++)
+			fdtb_cells[h] = cpu_to_fdt32(
+				fdtb_phandle(t, FDTB_PH_CPU, first + h));
+		FDTB_TRY(fdtb_prop_cells(fdt, "possible-harts", fdtb_cells,
+					 FDTB_HARTS_PER_DOMAIN));
+		fdtb_cells[0] = cpu_to_fdt32(
+			fdtb_phandle(t, FDTB_PH_MEMREGION, d));
+		fdtb_cells[1] = cpu_to_fdt32(0x3f);
+		fdtb_cells[2] = cpu_to_fdt32(
+			fdtb_phandle(t, FDTB_PH_MMIOREGION, d));
+		fdtb_cells[3] = cpu_to_fdt32(0x3f);
+		FDTB_TRY(fdtb_prop_cells(fdt, "regions", fdtb_cells, 4));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "boot-hart",
+					   FDTB_PH_CPU, first));
+		FDTB_TRY(fdt_property_u64(fdt, "next-arg1", 0));
+		FDTB_TRY(fdt_property_u64(fdt, "next-addr",
+					  FDTB_DOMAIN_MEM_BASE +
+					  (d << FDTB_DOMAIN_MEM_ORDER)));
+		FDTB_TRY(fdt_property_u32(fdt, "next-mode", 1));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "phandle",
+					   FDTB_PH_DOMAIN, d));
+		FDTB_TRY(fdt_end_node(fdt));
+	}
+
+	return fdt_end_node(fdt);
+}
+
+static int fdtb_gen_cpus(void *fdt, const struct fdtb_tree *t)
+{
+	static const char isa_exts[] = "i\0m\0a\0f\0d\0c\0zicntr\0zihpm\0"
+				       "zicbom\0zicboz\0sstc\0svpbmt\0svinval";
+	char name[32];
+	u32 h;
+	int d;
+
+	FDTB_TRY(fdt_begin_node(fdt, "cpus"));
+	FDTB_TRY(fdt_property_u32(fdt, "#address-cells", 1));
+	FDTB_TRY(fdt_property_u32(fdt, "#size-cells", 0));
+	FDTB_TRY(fdt_property_u32(fdt, "timebase-frequency", 10000000));
+
+	for (h = 0; h < t->harts; h++) {
+		sbi_snprintf(name, sizeof(name), "cpu@%x", h);
+		FDTB_TRY(fdt_begin_node(fdt, name));
+		FDTB_TRY(fdt_property_string(fdt, "device_type", "cpu"));
+		FDTB_TRY(fdt_property_u32(fdt, "reg", h));
+		FDTB_TRY(fdt_property_string(fdt, "status", "okay"));
+		FDTB_TRY(fdt_property_string(fdt, "compatible", "riscv"));
+		FDTB_TRY(fdt_property_string(fdt, "riscv,isa",
+			"rv64imafdc_zicntr_zihpm_zicbom_zicboz_sstc_svpbmt"));
+		FDTB_TRY(fdt_property(fdt, "riscv,isa-extensions", isa_exts,
+				      sizeof(isa_exts)));
+		FDTB_TRY(fdt_property_string(fdt, "mmu-type", "riscv,sv48"));
+		FDTB_TRY(fdt_property_u32(fdt, "riscv,cbom-block-size", 64));
+		FDTB_TRY(fdt_property_u32(fdt, "riscv,cboz-block-size", 64));
+		d = fdtb_hart_domain(t, h);
+		if (d >= 0)
+			FDTB_TRY(fdtb_prop_phandle(fdt, t, "opensbi-domain",
+						   FDTB_PH_DOMAIN, d));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "phandle",
+					   FDTB_PH_CPU, h));
+
+		FDTB_TRY(fdt_begin_node(fdt, "interrupt-controller"));
+		FDTB_TRY(fdt_property_string(fdt, "compatible",
+					     "riscv,cpu-intc"));
+		FDTB_TRY(fdt_property_u32(fdt, "#interrupt-cells", 1));
+		FDTB_TRY(fdt_property(fdt, "interrupt-controller", NULL, 0));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "phandle",
+					   FDTB_PH_INTC, h));
+		FDTB_TRY(fdt_end_node(fdt));
+
+		FDTB_TRY(fdt_end_node(fdt));
+	}
+
+	return fdt_end_node(fdt);
+}
+
+/* Chains of clocks, every device hangs off the end of a chain */
+static int fdtb_gen_clocks(void *fdt, const struct fdtb_tree *t)
+{
+	char name[32];
+	u32 c;
+
+	for (c = 0; c < t->clocks; c++) {
+		sbi_snprintf(name, sizeof(name), "clock-%u", c);
+		FDTB_TRY(fdt_begin_node(fdt, name));
+		FDTB_TRY(fdt_property_u32(fdt, "#clock-cells", 0));
+		if (c % t->depth) {
+			FDTB_TRY(fdt_property_string(fdt, "compatible",
+						     "fixed-factor-clock"));
+			FDTB_TRY(fdtb_prop_phandle(fdt, t, "clocks",
+						   FDTB_PH_CLOCK, c - 1));
+			FDTB_TRY(fdt_property_u32(fdt, "clock-div", 1));
+			FDTB_TRY(fdt_property_u32(fdt, "clock-mult", 1));
+		} else {
+			FDTB_TRY(fdt_property_string(fdt, "compatible",
+						     "fixed-clock"));
+			FDTB_TRY(fdt_property_u32(fdt, "clock-frequency",
+						  100000000));
+		}
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "phandle",
+					   FDTB_PH_CLOCK, c));
+		FDTB_TRY(fdt_end_node(fdt));
+	}
+
+	return 0;
+}
+
+static int fdtb_gen_soc(void *fdt, const struct fdtb_tree *t)
+{
+	unsigned long addr;
+	char name[48];
+	u32 h, i, chain;
+
+	FDTB_TRY(fdt_begin_node(fdt, "soc"));
+	FDTB_TRY(fdt_property_u32(fdt, "#address-cells", 2));
+	FDTB_TRY(fdt_property_u32(fdt, "#size-cells", 2));
+	FDTB_TRY(fdt_property_string(fdt, "compatible", "simple-bus"));
+	FDTB_TRY(fdt_property(fdt, "ranges", NULL, 0));
+
+	sbi_snprintf(name, sizeof(name), "interrupt-controller@%lx",
+		     FDTB_PLIC_BASE);
+	FDTB_TRY(fdt_begin_node(fdt, name));
+	FDTB_TRY(fdt_property_string(fdt, "compatible", "riscv,plic0"));
+	FDTB_TRY(fdtb_prop_reg(fdt, FDTB_PLIC_BASE, 0x4000000));
+	FDTB_TRY(fdt_property_u32(fdt, "#interrupt-cells", 1));
+	FDTB_TRY(fdt_property(fdt, "interrupt-controller", NULL, 0));
+	FDTB_TRY(fdt_property_u32(fdt, "riscv,ndev", 1023));
+	for (h = 0; h < t->harts; h++) {
+		fdtb_cells[4 * h + 0] = cpu_to_fdt32(
+			fdtb_phandle(t, FDTB_PH_INTC, h));
+		fdtb_cells[4 * h + 1] = cpu_to_fdt32(IRQ_M_EXT);
+		fdtb_cells[4 * h + 2] = fdtb_cells[4 * h + 0];
+		fdtb_cells[4 * h + 3] = cpu_to_fdt32(IRQ_S_EXT);
+	}
+	FDTB_TRY(fdtb_prop_cells(fdt, "interrupts-extended", fdtb_cells,
+				 4 * t->harts));
+	FDTB_TRY(fdtb_prop_phandle(fdt, t, "phandle", FDTB_PH_PLIC, 0));
+	FDTB_TRY(fdt_end_node(fdt));
+
+	FDTB_TRY(fdtb_gen_clocks(fdt, t));
+
+	for (i = 0; i < t->devices; i++) {
+		addr = FDTB_DEVICE_BASE + i * FDTB_DEVICE_SIZE;
+		sbi_snprintf(name, sizeof(name), "device@%lx", addr);
+		FDTB_TRY(fdt_begin_node(fdt, name));
+		sbi_snprintf(name, sizeof(name), "bench,dev%u",
+			     i % FDTB_COMPATIBLES);
+		FDTB_TRY(fdt_property_string(fdt, "compatible", name));
+		FDTB_TRY(fdtb_prop_reg(fdt, addr, FDTB_DEVICE_SIZE));
+		chain = i % (t->clocks / t->depth);
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "clocks", FDTB_PH_CLOCK,
+					   (chain + 1) * t->depth - 1));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "interrupt-parent",
+					   FDTB_PH_PLIC, 0));
+		FDTB_TRY(fdt_property_u32(fdt, "interrupts", 1 + i % 1023));
+		FDTB_TRY(fdtb_prop_phandle(fdt, t, "phandle",
+					   FDTB_PH_DEVICE, i));
+		FDTB_TRY(fdt_end_node(fdt));
+	}
+
+	return fdt_end_node(fdt);
+}
+
+static int fdtb_generate(void *fdt, const struct fdtb_tree *t)
+{
+	FDTB_TRY(fdt_create(fdt, FDTB_BLOB_SIZE));
+	FDTB_TRY(fdt_finish_reservemap(fdt));
+	FDTB_TRY(fdt_begin_node(fdt, ""));
+	FDTB_TRY(fdt_property_u32(fdt, "#address-cells", 2));
+	FDTB_TRY(fdt_property_u32(fdt, "#size-cells", 2));
+	FDTB_TRY(fdt_property_string(fdt, "compatible", "opensbi,host-bench"));
+	FDTB_TRY(fdt_property_string(fdt, "model", "Synthetic FDT benchmark"));
+
+	FDTB_TRY(fdt_begin_node(fdt, "chosen"));
+	FDTB_TRY(fdtb_gen_domains(fdt, t));
+	FDTB_TRY(fdt_end_node(fdt));
+
+	FDTB_TRY(fdtb_gen_cpus(fdt, t));
+
+	FDTB_TRY(fdt_begin_node(fdt, "memory@80000000"));
+	FDTB_TRY(fdt_property_string(fdt, "device_type", "memory"));
+	FDTB_TRY(fdtb_prop_reg(fdt, 0x80000000UL, 0x80000000UL));
+	FDTB_TRY(fdt_end_node(fdt));
+
+	FDTB_TRY(fdtb_gen_soc(fdt, t));
+
+	FDTB_TRY(fdt_end_node(fdt));
+	FDTB_TRY(fdt_finish(fdt));
+
+	/* Leave the rest of the buffer to the fixups like a real loader */
+	return fdt_open_into(fdt, fdt, FDTB_BLOB_SIZE);
+}
+
+/* Probing a device walks its clock chain up to the root clock */
+static int fdtb_driver_init(const void *fdt, int nodeoff,
+			    const struct fdt_match *match)
+{
+	struct fdt_phandle_args args;
+
+	while (!fdt_parse_phandle_with_args(fdt, nodeoff, "clocks",
+					    "#clock-cells", 0, &args)) {
+		nodeoff = args.node_offset;
+		fdtb_sink++;
+	}
+	fdtb_probed++;
+
+	return 0;
+}
+
+#define FDTB_DRIVER(__n)						\
+static const struct fdt_match fdtb_match##__n[] = {			\
+	{ .compatible = "bench,dev" #__n "0" },				\
+	{ .compatible = "bench,dev" #__n "1" },				\
+	{ },								\
+};									\
+static const struct fdt_driver fdtb_driver##__n = {			\
+	.match_table = fdtb_match##__n,					\
+	.init = fdtb_driver_init,					\
+}
+
+/* Drivers for bench,devN0 and bench,devN1, most devices have none */
+FDTB_DRIVER(1);
+FDTB_DRIVER(2);
+FDTB_DRIVER(3);
+
+static const struct fdt_driver *const fdtb_drivers[] = {
+	&fdtb_driver1,
+	&fdtb_driver2,
+	&fdtb_driver3,
+	NULL
+};
+
+static bool fdtb_compatible_probed(u32 index)
+{
+	u32 n = index % FDTB_COMPATIBLES;
+
+	return n == 10 || n == 11 || n == 20 || n == 21 || n == 30 || n == 31;
+}
+
+static int fdtb_isa_extensions(void *fdt, const struct fdtb_tree *t)
+{
+	unsigned long exts[BITS_TO_LONGS(SBI_HART_EXT_MAX)];
+	u32 h;
+	int rc;
+
+	for (h = 0; h < t->harts; h++) {
+		sbi_memset(exts, 0, sizeof(exts));
+		rc = fdt_parse_isa_extensions(fdt, h, exts);
+		if (rc)
+			return rc;
+		if (!__test_bit(SBI_HART_EXT_ZICBOM, exts))
+			return SBI_EFAIL;
+	}
+
+	return 0;
+}
+
+static int fdtb_domains_populate(void *fdt, const struct fdtb_tree *t)
+{
+	struct sbi_domain *dom;
+	u32 count = 0;
+	int rc;
+
+	rc = fdt_domains_populate(fdt);
+	if (rc)
+		return rc;
+
+	sbi_domain_for_each(dom)
+		count++;
+
+	return (count == t->domains + 1) ? 0 : SBI_EFAIL;
+}
+
+static int fdtb_driver_init_all(void *fdt, const struct fdtb_tree *t)
+{
+	unsigned long expected = 0;
+	u32 i;
+	int rc;
+
+	rc = fdt_driver_init_all(fdt, fdtb_drivers);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < t->devices; i++)
+		expected += fdtb_compatible_probed(i);
+
+	return (fdtb_probed == expected) ? 0 : SBI_EFAIL;
+}
+
+/* Same sequence as the cold boot final init of the generic platform */
+static int fdtb_fixups(void *fdt, const struct fdtb_tree *t)
+{
+	fdt_compat_index_free();
+	fdt_fixups_reserve(fdt);
+	fdt_cpu_fixup(fdt);
+	fdt_fixups(fdt);
+	fdt_domain_fixup(fdt);
+	fdt_phandle_cache_free();
+	fdt_cpu_table_free();
+
+	return fdt_check_header(fdt) ? SBI_EFAIL : 0;
+}
+
+/* In boot order */
+static const struct fdtb_stage fdtb_stages[] = {
+	{ "parse_isa_extensions", fdtb_isa_extensions },
+	{ "domains_populate", fdtb_domains_populate },
+	{ "driver_init_all", fdtb_driver_init_all },
+	{ "fixups", fdtb_fixups },
+};
+
+static unsigned long fdtb_parse(const char *str, unsigned long def)
+{
+	unsigned long val = 0;
+
+	if (*str < '0' || '9' < *str)
+		return def;
+	while (*str >= '0' && *str <= '9')
+		val = val * 10 + (*str++ - '0');
+
+	return val;
+}
+
+int host_fdt_main(int argc, char **argv)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct fdtb_tree t;
+	unsigned long long start, ns;
+	unsigned long i;
+	int rc;
+
+	t.harts = (0 < argc) ? fdtb_parse(argv[0], SBI_HARTMASK_MAX_BITS) :
+			       SBI_HARTMASK_MAX_BITS;
+	t.devices = (1 < argc) ? fdtb_parse(argv[1], FDTB_DEVICES_DEFAULT) :
+				 FDTB_DEVICES_DEFAULT;
+	t.domains = (2 < argc) ? fdtb_parse(argv[2], FDTB_DOMAINS_DEFAULT) :
+				 FDTB_DOMAINS_DEFAULT;
+	t.depth = (3 < argc) ? fdtb_parse(argv[3], FDTB_DEPTH_DEFAULT) :
+			       FDTB_DEPTH_DEFAULT;
+	t.harts = MIN(MAX(t.harts, 1U), (u32)SBI_HARTMASK_MAX_BITS);
+	t.devices = MAX(t.devices, 1U);
+	t.domains = MIN(t.domains, t.harts / FDTB_HARTS_PER_DOMAIN);
+	if (t.domains && t.domains == t.harts / FDTB_HARTS_PER_DOMAIN)
+		t.domains--;
+	t.depth = MIN(MAX(t.depth, 1U), (u32)FDTB_DEPTH_MAX);
+	t.clocks = FDTB_CLOCK_CHAINS * t.depth;
+
+	start = host_time_ns();
+	rc = fdtb_generate(fdtb_blob, &t);
+	ns = host_time_ns() - start;
+	if (rc) {
+		sbi_printf("fdt: generating the tree failed (%s)\n",
+			   fdt_strerror(rc));
+		return SBI_EFAIL;
+	}
+
+	sbi_printf("fdt: %u harts, %u devices, %u domains, clock depth %u, "
+		   "%lu KiB (generated in %lu us)\n",
+		   t.harts, t.devices, t.domains, t.depth,
+		   (ulong)(fdt_off_dt_strings(fdtb_blob) +
+			   fdt_size_dt_strings(fdtb_blob)) / 1024,
+		   (ulong)(ns / 1000));
+
+	rc = sbi_domain_init(scratch, current_hartid());
+	if (rc) {
+		sbi_printf("fdt: domain init failed (error %d)\n", rc);
+		return rc;
+	}
+
+	sbi_printf("%-22s %10s\n", "stage", "us");
+	for (i = 0; i < array_size(fdtb_stages); i++) {
+		start = host_time_ns();
+		rc = fdtb_stages[i].fn(fdtb_blob, &t);
+		ns = host_time_ns() - start;
+		if (rc) {
+			sbi_printf("%-22s FAIL (error %d)\n",
+				   fdtb_stages[i].name, rc);
+			return SBI_EFAIL;
+		}
+		sbi_printf("%-22s %6lu.%03lu\n", fdtb_stages[i].name,
+			   (ulong)(ns / 1000), (ulong)(ns % 1000));
+	}
+
+	return 0;
+}
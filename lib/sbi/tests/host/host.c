@@ -0,0 +1,136 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: C library side
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host.h"
+
+static __thread unsigned int this_hart_index;
+static int host_oversubscribed;
+
+struct host_hart {
+	pthread_t thread;
+	unsigned int index;
+	void (*fn)(void *arg);
+	void *arg;
+};
+
+unsigned long long host_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned int host_hart_index(void)
+{
+	return this_hart_index;
+}
+
+void host_console_write(const char *str, unsigned long len)
+{
+	fwrite(str, 1, len, stdout);
+}
+
+void host_cpu_relax(void)
+{
+	if (__atomic_load_n(&host_oversubscribed, __ATOMIC_RELAXED)) {
+		sched_yield();
+		return;
+	}
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+static void *host_hart_entry(void *data)
+{
+	struct host_hart *hart = data;
+
+	this_hart_index = hart->index;
+	hart->fn(hart->arg);
+
+	return NULL;
+}
+
+void host_run_harts(unsigned int nr_harts, void (*fn)(void *arg), void *arg)
+{
+	struct host_hart harts[HOST_HARTS_MAX];
+	unsigned int i;
+
+	if (HOST_HARTS_MAX < nr_harts)
+		nr_harts = HOST_HARTS_MAX;
+	/* Ticket lock hand-offs would otherwise wait for a time slice each */
+	host_oversubscribed = host_nr_cpus() < nr_harts;
+
+	for (i = 0; i < nr_harts; i++) {
+		harts[i].index = i;
+		harts[i].fn = fn;
+		harts[i].arg = arg;
+		if (pthread_create(&harts[i].thread, NULL, host_hart_entry,
+				   &harts[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	for (i = 0; i < nr_harts; i++)
+		pthread_join(harts[i].thread, NULL);
+	host_oversubscribed = 0;
+}
+
+unsigned int host_nr_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (n < 1) ? 1 : n;
+}
+
+void host_abort(void)
+{
+	fflush(stdout);
+	abort();
+}
+
+static void __attribute__((noreturn)) usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s bench [filter]\n", prog);
+	fprintf(stderr, "       %s stress [harts] [iterations]\n", prog);
+	fprintf(stderr, "       %s fdt [harts] [devices] [domains] [depth]\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int rc;
+
+	if (argc < 2)
+		usage(argv[0]);
+
+	host_shim_init();
+
+	if (!strcmp(argv[1], "bench"))
+		rc = host_bench_main(argc - 2, argv + 2);
+	else if (!strcmp(argv[1], "stress"))
+		rc = host_stress_main(argc - 2, argv + 2);
+	else if (!strcmp(argv[1], "fdt"))
+		rc = host_fdt_main(argc - 2, argv + 2);
+	else
+		usage(argv[0]);
+
+	fflush(stdout);
+	return rc ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: services of the host side
+ *
+ * The libsbi modules and the code using them are built without the C
+ * library headers since those clash with sbi_types.h. This header only
+ * uses plain C types so both sides can include it.
+ */
+
+#ifndef __HOST_H__
+#define __HOST_H__
+
+/** Number of emulated HARTs, one host thread each */
+#define HOST_HARTS_MAX		32
+
+/** Monotonic time in nanoseconds */
+unsigned long long host_time_ns(void);
+
+/** Emulated HART index of the calling thread */
+unsigned int host_hart_index(void);
+
+/** Write raw console output to stdout */
+void host_console_write(const char *str, unsigned long len);
+
+/** Run fn(arg) on nr_harts threads, emulated HART i on thread i */
+void host_run_harts(unsigned int nr_harts, void (*fn)(void *arg),
+		    void *arg);
+
+/**
+ * Busy-wait hint used as cpu_relax(), also yields the host CPU while
+ * more HARTs than host CPUs are running
+ */
+void host_cpu_relax(void);
+
+/** Number of host CPUs online */
+unsigned int host_nr_cpus(void);
+
+void __attribute__((noreturn)) host_abort(void);
+
+/* Implemented by the libsbi side */
+void host_shim_init(void);
+int host_bench_main(int argc, char **argv);
+int host_stress_main(int argc, char **argv);
+int host_fdt_main(int argc, char **argv);
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: fixed configuration
+ *
+ * Stands in for the Kconfig generated autoconf.h of a firmware build.
+ * Only options used by the modules built here are listed.
+ */
+
+#ifndef __HOST_CONFIG_H__
+#define __HOST_CONFIG_H__
+
+#define CONFIG_SBI_HARTMASK_MAX_BITS		256
+#define CONFIG_SBI_SCRATCH_EXT_SIZE		0
+#define CONFIG_SBI_CACHE_LINE_SIZE		64
+#define CONFIG_CONSOLE_EARLY_BUFFER_SIZE	1024
+#define CONFIG_FDT_DOMAIN			1
+
+#endif
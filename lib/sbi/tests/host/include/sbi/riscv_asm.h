@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: CSR accesses go to the host shim
+ */
+
+#ifndef __HOST_RISCV_ASM_H__
+#define __HOST_RISCV_ASM_H__
+
+#include_next <sbi/riscv_asm.h>
+
+#ifndef __ASSEMBLER__
+
+unsigned long host_csr_read(unsigned long csr);
+
+void host_csr_write(unsigned long csr, unsigned long val);
+
+unsigned long host_csr_set(unsigned long csr, unsigned long val);
+
+unsigned long host_csr_clear(unsigned long csr, unsigned long val);
+
+#undef csr_swap
+#undef csr_read
+#undef csr_read_relaxed
+#undef csr_write
+#undef csr_read_set
+#undef csr_set
+#undef csr_read_clear
+#undef csr_clear
+#undef wfi
+#undef ebreak
+
+#define csr_swap(csr, val)						\
+	({								\
+		unsigned long __v = host_csr_read(csr);			\
+		host_csr_write(csr, (unsigned long)(val));		\
+		__v;							\
+	})
+#define csr_read(csr)		host_csr_read(csr)
+#define csr_read_relaxed(csr)	host_csr_read(csr)
+#define csr_write(csr, val)	host_csr_write(csr, (unsigned long)(val))
+#define csr_read_set(csr, val)	host_csr_set(csr, (unsigned long)(val))
+#define csr_set(csr, val)	((void)host_csr_set(csr, (unsigned long)(val)))
+#define csr_read_clear(csr, val) host_csr_clear(csr, (unsigned long)(val))
+#define csr_clear(csr, val)	((void)host_csr_clear(csr, (unsigned long)(val)))
+#define wfi()			do { } while (0)
+#define ebreak()		__builtin_trap()
+
+#endif
+
+#endif
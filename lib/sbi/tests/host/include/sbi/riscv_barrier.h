@@ -0,0 +1,31 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: barriers map to compiler atomics
+ */
+
+#ifndef __HOST_RISCV_BARRIER_H__
+#define __HOST_RISCV_BARRIER_H__
+
+#include_next <sbi/riscv_barrier.h>
+
+#undef RISCV_FENCE
+#undef RISCV_FENCE_I
+#undef cpu_relax
+#undef wrs_nto
+#undef wrs_sto
+#undef __smp_store_release
+#undef __smp_load_acquire
+
+#define RISCV_FENCE(p, s)	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define RISCV_FENCE_I		__atomic_signal_fence(__ATOMIC_SEQ_CST)
+/* Spinning HARTs may have to give their host CPU to the lock holder */
+void host_cpu_relax(void);
+#define cpu_relax()		host_cpu_relax()
+#define wrs_nto()		cpu_relax()
+#define wrs_sto()		cpu_relax()
+
+#define __smp_store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define __smp_load_acquire(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+
+#endif
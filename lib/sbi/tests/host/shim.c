@@ -0,0 +1,219 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: firmware side of the shim
+ *
+ * Every host thread started by host_run_harts() is an emulated HART
+ * with a scratch space of its own. The platform has a scratch space for
+ * each of SBI_HARTMASK_MAX_BITS HARTs so that tests which only parse or
+ * configure HARTs, such as the FDT benchmark, can use more HARTs than
+ * there are threads. CSRs are per-thread variables except
+ * MHARTID, MSCRATCH and the counters which are derived from the thread
+ * and the host clock. The rest of the firmware the modules depend on
+ * is stubbed.
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_domain_context.h>
+#include <sbi/sbi_domain_data.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_hsm.h>
+#include <sbi/sbi_platform.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+
+#include "host.h"
+
+#define HOST_HEAP_SIZE		(4UL << 20)
+#define HOST_CSR_COUNT		4096
+
+static char host_scratch_mem[SBI_HARTMASK_MAX_BITS][SBI_SCRATCH_SIZE]
+	__aligned(SBI_SCRATCH_SIZE);
+/* Firmware image: one read-only page followed by the heap */
+static char host_fw_mem[PAGE_SIZE + HOST_HEAP_SIZE] __aligned(PAGE_SIZE);
+static __thread unsigned long host_csrs[HOST_CSR_COUNT];
+
+static const struct sbi_platform_operations host_platform_ops;
+
+static const struct sbi_platform host_platform = {
+	.opensbi_version = OPENSBI_VERSION,
+	.name = "host",
+	.hart_count = SBI_HARTMASK_MAX_BITS,
+	.platform_ops_addr = (unsigned long)&host_platform_ops,
+};
+
+static struct sbi_scratch *host_scratch(unsigned int index)
+{
+	return (struct sbi_scratch *)host_scratch_mem[index];
+}
+
+unsigned long host_csr_read(unsigned long csr)
+{
+	switch (csr) {
+	case CSR_MHARTID:
+		return host_hart_index();
+	case CSR_MSCRATCH:
+		return (unsigned long)host_scratch(host_hart_index());
+	case CSR_MCYCLE:
+	case CSR_CYCLE:
+	case CSR_TIME:
+		return host_time_ns();
+	default:
+		return host_csrs[csr & (HOST_CSR_COUNT - 1)];
+	}
+}
+
+void host_csr_write(unsigned long csr, unsigned long val)
+{
+	host_csrs[csr & (HOST_CSR_COUNT - 1)] = val;
+}
+
+unsigned long host_csr_set(unsigned long csr, unsigned long val)
+{
+	unsigned long old = host_csr_read(csr);
+
+	host_csr_write(csr, old | val);
+	return old;
+}
+
+unsigned long host_csr_clear(unsigned long csr, unsigned long val)
+{
+	unsigned long old = host_csr_read(csr);
+
+	host_csr_write(csr, old & ~val);
+	return old;
+}
+
+static struct sbi_scratch *host_hartid_to_scratch(ulong hartid,
+						  ulong hartindex)
+{
+	return host_scratch(hartindex);
+}
+
+static void host_console_putc(char ch)
+{
+	host_console_write(&ch, 1);
+}
+
+static unsigned long host_console_puts(const char *str, unsigned long len)
+{
+	host_console_write(str, len);
+	return len;
+}
+
+static struct sbi_console_device host_console = {
+	.name = "host",
+	.console_putc = host_console_putc,
+	.console_puts = host_console_puts,
+};
+
+void host_shim_init(void)
+{
+	struct sbi_scratch *scratch;
+	unsigned int i;
+
+	for (i = 0; i < SBI_HARTMASK_MAX_BITS; i++) {
+		scratch = host_scratch(i);
+		scratch->fw_start = (unsigned long)host_fw_mem;
+		scratch->fw_size = sizeof(host_fw_mem);
+		scratch->fw_rw_offset = PAGE_SIZE;
+		scratch->fw_heap_offset = PAGE_SIZE;
+		scratch->fw_heap_size = HOST_HEAP_SIZE;
+		scratch->platform_addr = (unsigned long)&host_platform;
+		scratch->hartid_to_scratch =
+			(unsigned long)host_hartid_to_scratch;
+		scratch->hartindex = i;
+	}
+
+	sbi_console_set_device(&host_console);
+
+	scratch = host_scratch(0);
+	if (sbi_scratch_init(scratch) || sbi_heap_init(scratch)) {
+		sbi_printf("host: shim init failed\n");
+		host_abort();
+	}
+}
+
+/* Same table as sbi_hart.c which cannot be built for the host */
+#define __SBI_HART_EXT_DATA(_name, _id) {	\
+	.name = #_name,				\
+	.id = _id,				\
+}
+
+const struct sbi_hart_ext_data sbi_hart_ext[] = {
+	__SBI_HART_EXT_DATA(smaia, SBI_HART_EXT_SMAIA),
+	__SBI_HART_EXT_DATA(smepmp, SBI_HART_EXT_SMEPMP),
+	__SBI_HART_EXT_DATA(smstateen, SBI_HART_EXT_SMSTATEEN),
+	__SBI_HART_EXT_DATA(sscofpmf, SBI_HART_EXT_SSCOFPMF),
+	__SBI_HART_EXT_DATA(sstc, SBI_HART_EXT_SSTC),
+	__SBI_HART_EXT_DATA(zicntr, SBI_HART_EXT_ZICNTR),
+	__SBI_HART_EXT_DATA(zihpm, SBI_HART_EXT_ZIHPM),
+	__SBI_HART_EXT_DATA(zkr, SBI_HART_EXT_ZKR),
+	__SBI_HART_EXT_DATA(smcntrpmf, SBI_HART_EXT_SMCNTRPMF),
+	__SBI_HART_EXT_DATA(xandespmu, SBI_HART_EXT_XANDESPMU),
+	__SBI_HART_EXT_DATA(zicboz, SBI_HART_EXT_ZICBOZ),
+	__SBI_HART_EXT_DATA(zicbom, SBI_HART_EXT_ZICBOM),
+	__SBI_HART_EXT_DATA(svpbmt, SBI_HART_EXT_SVPBMT),
+	__SBI_HART_EXT_DATA(sdtrig, SBI_HART_EXT_SDTRIG),
+	__SBI_HART_EXT_DATA(smcsrind, SBI_HART_EXT_SMCSRIND),
+	__SBI_HART_EXT_DATA(smcdeleg, SBI_HART_EXT_SMCDELEG),
+	__SBI_HART_EXT_DATA(sscsrind, SBI_HART_EXT_SSCSRIND),
+	__SBI_HART_EXT_DATA(ssccfg, SBI_HART_EXT_SSCCFG),
+	__SBI_HART_EXT_DATA(svade, SBI_HART_EXT_SVADE),
+	__SBI_HART_EXT_DATA(svadu, SBI_HART_EXT_SVADU),
+	__SBI_HART_EXT_DATA(smnpm, SBI_HART_EXT_SMNPM),
+	__SBI_HART_EXT_DATA(zicfilp, SBI_HART_EXT_ZICFILP),
+	__SBI_HART_EXT_DATA(zicfiss, SBI_HART_EXT_ZICFISS),
+	__SBI_HART_EXT_DATA(ssdbltrp, SBI_HART_EXT_SSDBLTRP),
+	__SBI_HART_EXT_DATA(svinval, SBI_HART_EXT_SVINVAL),
+	__SBI_HART_EXT_DATA(zawrs, SBI_HART_EXT_ZAWRS),
+};
+
+_Static_assert(SBI_HART_EXT_MAX == array_size(sbi_hart_ext),
+	       "sbi_hart_ext[]: wrong number of entries");
+
+void *sbi_hart_memzero(void *addr, size_t size)
+{
+	return sbi_memset(addr, 0, size);
+}
+
+void __attribute__((noreturn)) sbi_hart_hang(void)
+{
+	host_abort();
+}
+
+/* Supervisor memory is host memory so there is nothing to map */
+int sbi_hart_map_saddr(unsigned long base, unsigned long size)
+{
+	return 0;
+}
+
+int sbi_hart_unmap_saddr(void)
+{
+	return 0;
+}
+
+int sbi_hsm_hart_start(struct sbi_scratch *scratch,
+		       const struct sbi_domain *dom,
+		       u32 hartid, ulong saddr, ulong smode, ulong arg1)
+{
+	return SBI_ENOTSUPP;
+}
+
+int sbi_domain_context_init(void)
+{
+	return 0;
+}
+
+void sbi_domain_context_deinit(void)
+{
+}
+
+int sbi_domain_setup_data(struct sbi_domain *dom)
+{
+	return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Host build of libsbi modules: multi-threaded stress tests
+ *
+ * Each test runs on every emulated HART at once and checks an
+ * invariant which a broken lock or FIFO would violate: lost updates,
+ * torn reader views, lost, duplicated or reordered FIFO entries and
+ * overlapping heap allocations.
+ */
+
+#include <sbi/riscv_barrier.h>
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_fifo.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_mpsc_fifo.h>
+#include <sbi/sbi_string.h>
+
+#include "host.h"
+
+#define STRESS_ITERS_DEFAULT	200000UL
+#define STRESS_FIFO_ENTRIES	64
+#define STRESS_HEAP_SLOTS	16
+
+struct stress {
+	const char *name;
+	void (*run)(void *arg);
+	/* Returns the number of errors once all HARTs are done */
+	unsigned long (*check)(void);
+};
+
+static unsigned int stress_harts;
+static unsigned long stress_iters;
+static unsigned long stress_errors;
+
+static void stress_error(void)
+{
+	__atomic_fetch_add(&stress_errors, 1, __ATOMIC_RELAXED);
+}
+
+/* Ticket lock: no increment of the counter may get lost */
+static spinlock_t spin_test_lock = SPIN_LOCK_INITIALIZER;
+static unsigned long spin_test_count;
+
+static void stress_spin_run(void *arg)
+{
+	unsigned long i;
+
+	for (i = 0; i < stress_iters; i++) {
+		spin_lock(&spin_test_lock);
+		spin_test_count++;
+		spin_unlock(&spin_test_lock);
+	}
+}
+
+static unsigned long stress_spin_check(void)
+{
+	return spin_test_count != stress_harts * stress_iters;
+}
+
+/* Queued lock: same invariant, several nesting levels deep */
+static qspinlock_t qspin_test_lock[2] = { QSPIN_LOCK_INITIALIZER,
+					  QSPIN_LOCK_INITIALIZER };
+static unsigned long qspin_test_count[2];
+
+static void stress_qspin_run(void *arg)
+{
+	unsigned long i;
+
+	for (i = 0; i < stress_iters; i++) {
+		qspin_lock(&qspin_test_lock[0]);
+		qspin_test_count[0]++;
+		if (i & 1) {
+			qspin_lock(&qspin_test_lock[1]);
+			qspin_test_count[1]++;
+			qspin_unlock(&qspin_test_lock[1]);
+		}
+		qspin_unlock(&qspin_test_lock[0]);
+	}
+}
+
+static unsigned long stress_qspin_check(void)
+{
+	return (qspin_test_count[0] != stress_harts * stress_iters) +
+	       (qspin_test_count[1] != stress_harts * (stress_iters / 2));
+}
+
+/* Reader-writer lock: readers never see a half done update */
+static rwlock_t rw_test_lock = RW_LOCK_INITIALIZER;
+static unsigned long rw_test_a, rw_test_b;
+
+static void stress_rwlock_run(void *arg)
+{
+	unsigned long i, a, b;
+	bool writer = !(host_hart_index() & 3);
+
+	for (i = 0; i < stress_iters; i++) {
+		if (writer) {
+			write_lock(&rw_test_lock);
+			rw_test_a++;
+			rw_test_b++;
+			write_unlock(&rw_test_lock);
+		} else {
+			read_lock(&rw_test_lock);
+			a = __atomic_load_n(&rw_test_a, __ATOMIC_RELAXED);
+			b = __atomic_load_n(&rw_test_b, __ATOMIC_RELAXED);
+			read_unlock(&rw_test_lock);
+			if (a != b)
+				stress_error();
+		}
+	}
+}
+
+static unsigned long stress_rwlock_check(void)
+{
+	unsigned long writers = (stress_harts + 3) / 4;
+
+	return (rw_test_a != writers * stress_iters) + (rw_test_a != rw_test_b);
+}
+
+/*
+ * FIFO entries carry the producer in the upper half and a sequence
+ * number in the lower half so the consumer side can check ordering.
+ */
+#define STRESS_ENTRY(__hart, __seq)	(((u64)(__hart) << 32) | (__seq))
+#define STRESS_ENTRY_HART(__e)		((u32)((__e) >> 32))
+#define STRESS_ENTRY_SEQ(__e)		((u32)(__e))
+
+static unsigned long fifo_next_seq[HOST_HARTS_MAX];
+static unsigned long fifo_consumed;
+
+static void stress_fifo_consume(u64 e)
+{
+	u32 hart = STRESS_ENTRY_HART(e);
+
+	if (stress_harts <= hart || STRESS_ENTRY_SEQ(e) != fifo_next_seq[hart])
+		stress_error();
+	else
+		fifo_next_seq[hart]++;
+	fifo_consumed++;
+}
+
+/* Locked FIFO: HART 0 consumes while all the others produce */
+static u64 fifo_test_mem[STRESS_FIFO_ENTRIES];
+static struct sbi_fifo fifo_test;
+
+static void stress_fifo_run(void *arg)
+{
+	unsigned long i, total = (stress_harts - 1) * stress_iters;
+	u32 hart = host_hart_index();
+	u64 e;
+
+	if (!hart) {
+		while (fifo_consumed < total) {
+			if (!sbi_fifo_dequeue(&fifo_test, &e))
+				stress_fifo_consume(e);
+			else
+				cpu_relax();
+		}
+		return;
+	}
+
+	for (i = 0; i < stress_iters; i++) {
+		e = STRESS_ENTRY(hart, i);
+		while (sbi_fifo_enqueue(&fifo_test, &e, false) == SBI_ENOSPC)
+			cpu_relax();
+	}
+}
+
+static unsigned long stress_fifo_check(void)
+{
+	return !sbi_fifo_is_empty(&fifo_test);
+}
+
+/* Lockless MPSC FIFO: same setup as the locked FIFO */
+static char mpsc_test_mem[SBI_MPSC_FIFO_MEM_SIZE(STRESS_FIFO_ENTRIES,
+						 sizeof(u64))];
+static struct sbi_mpsc_fifo mpsc_test;
+
+static void stress_mpsc_run(void *arg)
+{
+	unsigned long i, total = (stress_harts - 1) * stress_iters;
+	u32 hart = host_hart_index();
+	u64 e;
+
+	if (!hart) {
+		while (fifo_consumed < total) {
+			if (!sbi_mpsc_fifo_dequeue(&mpsc_test, &e))
+				stress_fifo_consume(e);
+			else
+				cpu_relax();
+		}
+		return;
+	}
+
+	for (i = 0; i < stress_iters; i++) {
+		e = STRESS_ENTRY(hart, i);
+		while (sbi_mpsc_fifo_enqueue(&mpsc_test, &e) == SBI_ENOSPC)
+			cpu_relax();
+	}
+}
+
+static unsigned long stress_mpsc_check(void)
+{
+	return !sbi_mpsc_fifo_is_empty(&mpsc_test);
+}
+
+/* Heap: an allocation keeps the pattern of its owner until freed */
+static void stress_heap_run(void *arg)
+{
+	unsigned char *slots[STRESS_HEAP_SLOTS] = { 0 };
+	unsigned long sizes[STRESS_HEAP_SLOTS];
+	unsigned char pattern = 0x40 + host_hart_index();
+	unsigned long i, j, s;
+
+	for (i = 0; i < stress_iters / 4; i++) {
+		s = i % STRESS_HEAP_SLOTS;
+		if (slots[s]) {
+			for (j = 0; j < sizes[s]; j++) {
+				if (slots[s][j] != pattern) {
+					stress_error();
+					break;
+				}
+			}
+			sbi_free(slots[s]);
+		}
+
+		sizes[s] = 8 + ((i * 37) % 200);
+		slots[s] = sbi_malloc(sizes[s]);
+		if (slots[s])
+			sbi_memset(slots[s], pattern, sizes[s]);
+	}
+
+	for (s = 0; s < STRESS_HEAP_SLOTS; s++) {
+		if (slots[s])
+			sbi_free(slots[s]);
+	}
+}
+
+static unsigned long stress_heap_check(void)
+{
+	return 0;
+}
+
+static const struct stress stresses[] = {
+	{ "spinlock", stress_spin_run, stress_spin_check },
+	{ "qspinlock", stress_qspin_run, stress_qspin_check },
+	{ "rwlock", stress_rwlock_run, stress_rwlock_check },
+	{ "fifo", stress_fifo_run, stress_fifo_check },
+	{ "mpsc_fifo", stress_mpsc_run, stress_mpsc_check },
+	{ "heap", stress_heap_run, stress_heap_check },
+};
+
+static unsigned long stress_parse(const char *str)
+{
+	unsigned long val = 0;
+
+	while (*str >= '0' && *str <= '9')
+		val = val * 10 + (*str++ - '0');
+
+	return val;
+}
+
+int host_stress_main(int argc, char **argv)
+{
+	unsigned long long start;
+	unsigned long i, errors, failed = 0;
+
+	stress_harts = (0 < argc) ? stress_parse(argv[0]) : host_nr_cpus();
+	stress_iters = (1 < argc) ? stress_parse(argv[1]) :
+				    STRESS_ITERS_DEFAULT;
+	if (stress_harts < 2)
+		stress_harts = 2;
+	if (HOST_HARTS_MAX < stress_harts)
+		stress_harts = HOST_HARTS_MAX;
+	if (!stress_iters)
+		stress_iters = STRESS_ITERS_DEFAULT;
+
+	sbi_fifo_init(&fifo_test, fifo_test_mem, STRESS_FIFO_ENTRIES,
+		      sizeof(u64));
+	sbi_mpsc_fifo_init(&mpsc_test, mpsc_test_mem, STRESS_FIFO_ENTRIES,
+			   sizeof(u64));
+
+	sbi_printf("stress: %u harts, %lu iterations\n",
+		   stress_harts, stress_iters);
+	for (i = 0; i < array_size(stresses); i++) {
+		stress_errors = 0;
+		fifo_consumed = 0;
+		sbi_memset(fifo_next_seq, 0, sizeof(fifo_next_seq));
+
+		start = host_time_ns();
+		host_run_harts(stress_harts, stresses[i].run, NULL);
+		errors = stress_errors + stresses[i].check();
+		sbi_printf("%-12s %s (%lu ms)\n", stresses[i].name,
+			   errors ? "FAIL" : "ok",
+			   (ulong)((host_time_ns() - start) / 1000000));
+		failed += errors ? 1 : 0;
+	}
+
+	return failed ? SBI_EFAIL : 0;
+}
@@ -14,4 +14,15 @@ carray-sbi_unit_tests-$(CONFIG_SBIUNIT) += locks_test_suite
 libsbi-objs-$(CONFIG_SBIUNIT) += tests/riscv_locks_test.o
 
 carray-sbi_unit_tests-$(CONFIG_SBIUNIT) += math_test_suite
-libsbi-objs-$(CONFIG_SBIUNIT) += tests/sbi_math_test.o
\ No newline at end of file
+libsbi-objs-$(CONFIG_SBIUNIT) += tests/sbi_math_test.o
+carray-sbi_unit_tests-$(CONFIG_SBIUNIT) += mpsc_fifo_test_suite
+libsbi-objs-$(CONFIG_SBIUNIT) += tests/sbi_mpsc_fifo_test.o
+
+carray-sbi_unit_tests-$(CONFIG_SBIUNIT) += ecall_test_suite
+libsbi-objs-$(CONFIG_SBIUNIT) += tests/sbi_ecall_test.o
+
+carray-sbi_unit_tests-$(CONFIG_SBIUNIT) += domain_context_test_suite
+libsbi-objs-$(CONFIG_SBIUNIT) += tests/sbi_domain_context_test.o
+
+carray-sbi_unit_tests-$(CONFIG_SBIUNIT) += tlb_test_suite
+libsbi-objs-$(CONFIG_SBIUNIT) += tests/sbi_tlb_test.o
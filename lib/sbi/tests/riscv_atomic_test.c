@@ -1,6 +1,7 @@
 #include <sbi/sbi_unit_test.h>
 #include <sbi/riscv_atomic.h>
 #include <sbi/sbi_bitops.h>
+#include <sbi/sbi_scratch.h>
 
 #define ATOMIC_TEST_VAL1 239l
 #define ATOMIC_TEST_VAL2 30l
@@ -13,9 +14,27 @@
 
 static atomic_t test_atomic;
 
+/* Shared by the contention benchmarks of all HARTs */
+static atomic_t bench_atomic;
+static unsigned long bench_xchg;
+
+/* Per-HART bookkeeping of the contention benchmarks */
+struct atomic_bench_hart {
+	/* atomic_add_return() calls */
+	unsigned long adds;
+	/* Values exchanged into bench_xchg minus values taken out */
+	unsigned long xchg_delta;
+};
+
+/* Scratch offset of the per-HART bookkeeping */
+static unsigned long bench_hart_offset;
+
 static void atomic_test_suite_init(void)
 {
 	ATOMIC_INIT(&test_atomic, 0);
+	ATOMIC_INIT(&bench_atomic, 0);
+	bench_hart_offset = sbi_scratch_alloc_cacheline_offset(
+					sizeof(struct atomic_bench_hart));
 }
 
 static void atomic_rw_test(struct sbiunit_test_case *test)
@@ -123,6 +142,68 @@ static void atomic_clear_bit_test(struct sbiunit_test_case *test)
 	SBIUNIT_EXPECT_EQ(test, atomic_read(&test_atomic), 0);
 }
 
+static void atomic_wrs_wait_test(struct sbiunit_test_case *test)
+{
+	/* A value which already changed must not stall */
+	atomic_write(&test_atomic, ATOMIC_TEST_VAL1);
+	atomic_wrs_wait(&test_atomic, ATOMIC_TEST_VAL2, false);
+	atomic_wrs_wait(&test_atomic, ATOMIC_TEST_VAL2, true);
+	/* The atomic value should not be modified */
+	SBIUNIT_EXPECT_EQ(test, atomic_read(&test_atomic), ATOMIC_TEST_VAL1);
+}
+
+static void atomic_add_return_bench(struct sbiunit_test_case *test)
+{
+	struct atomic_bench_hart *h;
+
+	atomic_add_return(&bench_atomic, 1);
+	if (bench_hart_offset) {
+		h = sbi_scratch_thishart_offset_ptr(bench_hart_offset);
+		h->adds++;
+	}
+}
+
+static void atomic_raw_xchg_ulong_bench(struct sbiunit_test_case *test)
+{
+	struct atomic_bench_hart *h;
+	/* Every HART puts in its own value */
+	unsigned long val = current_hartindex() + 1;
+
+	val -= atomic_raw_xchg_ulong(&bench_xchg, val);
+	if (bench_hart_offset) {
+		h = sbi_scratch_thishart_offset_ptr(bench_hart_offset);
+		h->xchg_delta += val;
+	}
+}
+
+/*
+ * The contention benchmarks must not lose updates: bench_atomic has to
+ * match the number of additions and whatever was exchanged in but not
+ * taken out again has to be the final value of bench_xchg.
+ */
+static void atomic_bench_check(struct sbiunit_test_case *test)
+{
+	unsigned long adds = 0, xchg_delta = 0;
+	struct atomic_bench_hart *h;
+	struct sbi_scratch *scratch;
+	u32 i;
+
+	SBIUNIT_ASSERT(test, bench_hart_offset);
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+
+		h = sbi_scratch_offset_ptr(scratch, bench_hart_offset);
+		adds += h->adds;
+		xchg_delta += h->xchg_delta;
+	}
+
+	SBIUNIT_EXPECT_EQ(test, (unsigned long)atomic_read(&bench_atomic), adds);
+	SBIUNIT_EXPECT_EQ(test, bench_xchg, xchg_delta);
+}
+
 static struct sbiunit_test_case atomic_test_cases[] = {
 	SBIUNIT_TEST_CASE(atomic_rw_test),
 	SBIUNIT_TEST_CASE(add_return_test),
@@ -133,6 +214,10 @@ static struct sbiunit_test_case atomic_test_cases[] = {
 	SBIUNIT_TEST_CASE(atomic_raw_clear_bit_test),
 	SBIUNIT_TEST_CASE(atomic_set_bit_test),
 	SBIUNIT_TEST_CASE(atomic_clear_bit_test),
+	SBIUNIT_TEST_CASE(atomic_wrs_wait_test),
+	SBIUNIT_BENCH_CASE_ALL_HARTS(atomic_add_return_bench, 256),
+	SBIUNIT_BENCH_CASE_ALL_HARTS(atomic_raw_xchg_ulong_bench, 256),
+	SBIUNIT_TEST_CASE(atomic_bench_check),
 	SBIUNIT_END_CASE,
 };
 
@@ -1,5 +1,6 @@
 #include <sbi/sbi_unit_test.h>
 #include <sbi/riscv_locks.h>
+#include <sbi/sbi_scratch.h>
 
 static spinlock_t test_lock = SPIN_LOCK_INITIALIZER;
 
@@ -31,11 +32,113 @@ static void spin_trylock_success(struct sbiunit_test_case *test)
 	spin_unlock(&test_lock);
 }
 
+static spinlock_t bench_lock = SPIN_LOCK_INITIALIZER;
+static qspinlock_t bench_qlock = QSPIN_LOCK_INITIALIZER;
+
+/* Acquisitions of all HARTs, only updated with the lock held */
+static unsigned long bench_acquired;
+/* Scratch offset of the per-HART acquisitions */
+static unsigned long bench_hart_offset;
+
+static void locks_test_suite_init(void)
+{
+	bench_hart_offset =
+		sbi_scratch_alloc_cacheline_offset(sizeof(unsigned long));
+}
+
+static inline void bench_acquire(void)
+{
+	unsigned long *acquired;
+
+	bench_acquired++;
+	if (bench_hart_offset) {
+		acquired = sbi_scratch_thishart_offset_ptr(bench_hart_offset);
+		(*acquired)++;
+	}
+}
+
+/*
+ * Print the acquisitions of each HART and check that no increment done
+ * with the lock held got lost, then reset the counts for the next case.
+ */
+static void bench_report(struct sbiunit_test_case *test, const char *name)
+{
+	unsigned long *acquired, total = 0;
+	struct sbi_scratch *scratch;
+	u32 i;
+
+	SBIUNIT_ASSERT(test, bench_hart_offset);
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+
+		acquired = sbi_scratch_offset_ptr(scratch, bench_hart_offset);
+		if (*acquired)
+			sbi_printf("[SBIUnit] bench suite=locks_test_suite "
+				   "case=%s hart=%u acquired=%lu\n", name,
+				   sbi_hartindex_to_hartid(i), *acquired);
+		total += *acquired;
+		*acquired = 0;
+	}
+
+	SBIUNIT_EXPECT_EQ(test, total, bench_acquired);
+	bench_acquired = 0;
+}
+
+static void spin_lock_bench(struct sbiunit_test_case *test)
+{
+	spin_lock(&bench_lock);
+	bench_acquire();
+	spin_unlock(&bench_lock);
+}
+
+static void spin_lock_bench_fairness(struct sbiunit_test_case *test)
+{
+	bench_report(test, "spin_lock_bench");
+}
+
+static void spin_trylock_bench(struct sbiunit_test_case *test)
+{
+	if (spin_trylock(&bench_lock)) {
+		bench_acquire();
+		spin_unlock(&bench_lock);
+	}
+}
+
+static void spin_trylock_bench_fairness(struct sbiunit_test_case *test)
+{
+	bench_report(test, "spin_trylock_bench");
+}
+
+static void qspin_lock_bench(struct sbiunit_test_case *test)
+{
+	qspin_lock(&bench_qlock);
+	bench_acquire();
+	qspin_unlock(&bench_qlock);
+}
+
+static void qspin_lock_bench_fairness(struct sbiunit_test_case *test)
+{
+	bench_report(test, "qspin_lock_bench");
+}
+
 static struct sbiunit_test_case locks_test_cases[] = {
 	SBIUNIT_TEST_CASE(spin_lock_test),
 	SBIUNIT_TEST_CASE(spin_trylock_fail),
 	SBIUNIT_TEST_CASE(spin_trylock_success),
+	SBIUNIT_BENCH_CASE_ALL_HARTS(spin_lock_bench, 256),
+	SBIUNIT_TEST_CASE(spin_lock_bench_fairness),
+	SBIUNIT_BENCH_CASE_ALL_HARTS(spin_trylock_bench, 256),
+	SBIUNIT_TEST_CASE(spin_trylock_bench_fairness),
+	SBIUNIT_BENCH_CASE_ALL_HARTS(qspin_lock_bench, 256),
+	SBIUNIT_TEST_CASE(qspin_lock_bench_fairness),
 	SBIUNIT_END_CASE,
 };
 
-SBIUNIT_TEST_SUITE(locks_test_suite, locks_test_cases);
+const struct sbiunit_test_suite locks_test_suite = {
+	.name = "locks_test_suite",
+	.cases = locks_test_cases,
+	.init = locks_test_suite_init
+};
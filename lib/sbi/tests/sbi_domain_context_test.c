@@ -0,0 +1,169 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Cycle counts of the steps of a domain context switch. Entering a
+ * domain leaves M-mode so the steps are timed separately on the boot
+ * HART with the same operations switch_to_next_domain_context() does.
+ */
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_trap.h>
+#include <sbi/sbi_unit_test.h>
+
+#define BENCH_SAMPLES		32
+
+struct bench_csrs {
+	unsigned long sstatus;
+	unsigned long sie;
+	unsigned long stvec;
+	unsigned long sscratch;
+	unsigned long sepc;
+	unsigned long scause;
+	unsigned long stval;
+	unsigned long sip;
+	unsigned long satp;
+	unsigned long scounteren;
+	unsigned long senvcfg;
+};
+
+static u64 samples[BENCH_SAMPLES];
+static struct sbi_trap_context bench_ctx[2];
+static struct sbi_hart_pmp_state bench_pmp;
+
+static void bench_report(const char *name)
+{
+	u64 sum = 0, v;
+	int i, j;
+
+	for (i = 1; i < BENCH_SAMPLES; i++) {
+		v = samples[i];
+		for (j = i; j > 0 && samples[j - 1] > v; j--)
+			samples[j] = samples[j - 1];
+		samples[j] = v;
+	}
+	for (i = 0; i < BENCH_SAMPLES; i++)
+		sum += samples[i];
+
+	sbi_printf("[SBIUnit] %-16s cycles min %lu p50 %lu p90 %lu max %lu "
+		   "avg %lu\n", name, (ulong)samples[0],
+		   (ulong)samples[BENCH_SAMPLES / 2],
+		   (ulong)samples[(BENCH_SAMPLES * 9) / 10],
+		   (ulong)samples[BENCH_SAMPLES - 1],
+		   (ulong)(sum / BENCH_SAMPLES));
+}
+
+static void bench_csr_swap(struct sbi_scratch *scratch, struct bench_csrs *c)
+{
+	c->sstatus	= csr_swap(CSR_SSTATUS, c->sstatus);
+	c->sie		= csr_swap(CSR_SIE, c->sie);
+	c->stvec	= csr_swap(CSR_STVEC, c->stvec);
+	c->sscratch	= csr_swap(CSR_SSCRATCH, c->sscratch);
+	c->sepc		= csr_swap(CSR_SEPC, c->sepc);
+	c->scause	= csr_swap(CSR_SCAUSE, c->scause);
+	c->stval	= csr_swap(CSR_STVAL, c->stval);
+	c->sip		= csr_swap(CSR_SIP, c->sip);
+	c->satp		= csr_swap(CSR_SATP, c->satp);
+	if (sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_10)
+		c->scounteren = csr_swap(CSR_SCOUNTEREN, c->scounteren);
+	if (sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_12)
+		c->senvcfg = csr_swap(CSR_SENVCFG, c->senvcfg);
+}
+
+static void domain_context_csr_swap_test(struct sbiunit_test_case *test)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct bench_csrs c, orig;
+	unsigned long start;
+	int i;
+
+	if (!misa_extension('S'))
+		return;
+
+	/* Swap the current values in and out again so nothing changes */
+	sbi_memset(&c, 0, sizeof(c));
+	bench_csr_swap(scratch, &c);
+	bench_csr_swap(scratch, &c);
+	orig = c;
+
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		start = csr_read(CSR_MCYCLE);
+		bench_csr_swap(scratch, &c);
+		samples[i] = csr_read(CSR_MCYCLE) - start;
+		bench_csr_swap(scratch, &c);
+	}
+	bench_report("csr swap");
+
+	SBIUNIT_EXPECT_MEMEQ(test, &c, &orig, sizeof(c));
+}
+
+static void domain_context_trap_copy_test(struct sbiunit_test_case *test)
+{
+	struct sbi_trap_context *trap_ctx = &bench_ctx[0];
+	unsigned long start;
+	int i;
+
+	sbi_memset(&bench_ctx[1], 0x5a, sizeof(bench_ctx[1]));
+
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		start = csr_read(CSR_MCYCLE);
+		sbi_memcpy(trap_ctx, &bench_ctx[1], sizeof(*trap_ctx));
+		sbi_memcpy(&bench_ctx[1], trap_ctx, sizeof(*trap_ctx));
+		samples[i] = csr_read(CSR_MCYCLE) - start;
+	}
+	bench_report("trap ctx copy");
+
+	SBIUNIT_EXPECT_MEMEQ(test, &bench_ctx[0], &bench_ctx[1],
+			     sizeof(bench_ctx[0]));
+}
+
+static void domain_context_pmp_test(struct sbiunit_test_case *test)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	unsigned int pmp_count = sbi_hart_pmp_count(scratch);
+	struct sbi_hart_pmp_state after;
+	unsigned long start;
+	int i, j;
+
+	/*
+	 * Smepmp HARTs would lose M-mode access to S-mode memory and
+	 * are not timed since boot configures PMP after the tests.
+	 */
+	sbi_memset(&after, 0, sizeof(after));
+	if (!sbi_hart_pmp_snapshot(scratch, &after))
+		return;
+
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		start = csr_read(CSR_MCYCLE);
+		for (j = 0; j < pmp_count; j++)
+			pmp_disable(j);
+		sbi_hart_pmp_configure(scratch);
+		samples[i] = csr_read(CSR_MCYCLE) - start;
+	}
+	bench_report("pmp reprogram");
+
+	/* Best case of a switch where both domains use the same entries */
+	sbi_hart_pmp_snapshot(scratch, &bench_pmp);
+	for (i = 0; i < BENCH_SAMPLES; i++) {
+		start = csr_read(CSR_MCYCLE);
+		sbi_hart_pmp_snapshot(scratch, &after);
+		sbi_hart_pmp_switch(scratch, &after, &bench_pmp);
+		samples[i] = csr_read(CSR_MCYCLE) - start;
+	}
+	bench_report("pmp delta");
+
+	sbi_hart_pmp_snapshot(scratch, &after);
+	SBIUNIT_EXPECT_MEMEQ(test, &after, &bench_pmp, sizeof(after));
+}
+
+static struct sbiunit_test_case domain_context_test_cases[] = {
+	SBIUNIT_TEST_CASE(domain_context_csr_swap_test),
+	SBIUNIT_TEST_CASE(domain_context_trap_copy_test),
+	SBIUNIT_TEST_CASE(domain_context_pmp_test),
+	SBIUNIT_END_CASE,
+};
+
+SBIUNIT_TEST_SUITE(domain_context_test_suite, domain_context_test_cases);
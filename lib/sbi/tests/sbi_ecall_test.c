@@ -0,0 +1,131 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_unit_test.h>
+
+#define ECALL_TEST_EXTID	0x4f534254
+
+static int ecall_test_handle(unsigned long extid, unsigned long funcid,
+			     struct sbi_trap_regs *regs,
+			     struct sbi_ecall_return *out)
+{
+	return 0;
+}
+
+static struct sbi_ecall_extension ecall_test_ext = {
+	.extid_start	= ECALL_TEST_EXTID,
+	.extid_end	= ECALL_TEST_EXTID,
+	.handle		= ecall_test_handle,
+};
+
+static unsigned long ecall_test_probes;
+
+static int ecall_test_probe(unsigned long extid, unsigned long *out_val)
+{
+	ecall_test_probes++;
+	*out_val = 2;
+	return 0;
+}
+
+static bool ecall_test_domain_allowed(const struct sbi_domain *dom)
+{
+	return dom != &root;
+}
+
+static void find_extension_test(struct sbiunit_test_case *test)
+{
+	struct sbi_ecall_extension *ext;
+
+	/* Single ID extensions are found by their ID */
+	ext = sbi_ecall_find_extension(SBI_EXT_BASE);
+	SBIUNIT_ASSERT_NE(test, ext, NULL);
+	SBIUNIT_EXPECT_EQ(test, ext->extid_start, SBI_EXT_BASE);
+
+	/* Range extensions are found by any ID within the range */
+	ext = sbi_ecall_find_extension(SBI_EXT_0_1_SEND_IPI);
+	if (ext) {
+		SBIUNIT_EXPECT(test, ext->extid_start <= SBI_EXT_0_1_SEND_IPI);
+		SBIUNIT_EXPECT(test, SBI_EXT_0_1_SEND_IPI <= ext->extid_end);
+	}
+
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_find_extension(ECALL_TEST_EXTID),
+			  NULL);
+}
+
+static void register_extension_test(struct sbiunit_test_case *test)
+{
+	/* Extensions registered after init must be found as well */
+	SBIUNIT_ASSERT_EQ(test, sbi_ecall_register_extension(&ecall_test_ext),
+			  0);
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_find_extension(ECALL_TEST_EXTID),
+			  &ecall_test_ext);
+	SBIUNIT_EXPECT_NE(test, sbi_ecall_find_extension(SBI_EXT_BASE), NULL);
+
+	sbi_ecall_unregister_extension(&ecall_test_ext);
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_find_extension(ECALL_TEST_EXTID),
+			  NULL);
+	SBIUNIT_EXPECT_NE(test, sbi_ecall_find_extension(SBI_EXT_BASE), NULL);
+}
+
+static void probe_cache_test(struct sbiunit_test_case *test)
+{
+	unsigned long val = 0;
+
+	ecall_test_ext.probe = ecall_test_probe;
+	ecall_test_probes = 0;
+	SBIUNIT_ASSERT_EQ(test, sbi_ecall_register_extension(&ecall_test_ext),
+			  0);
+
+	/* A probe result is reused until it is invalidated */
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_domain_probe(&root, ECALL_TEST_EXTID,
+						       &val), 0);
+	SBIUNIT_EXPECT_EQ(test, val, 2);
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_domain_probe(&root, ECALL_TEST_EXTID,
+						       &val), 0);
+	SBIUNIT_EXPECT_EQ(test, val, 2);
+	SBIUNIT_EXPECT_EQ(test, ecall_test_probes, 1);
+
+	sbi_ecall_probe_invalidate();
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_domain_probe(&root, ECALL_TEST_EXTID,
+						       &val), 0);
+	SBIUNIT_EXPECT_EQ(test, ecall_test_probes, 2);
+
+	sbi_ecall_unregister_extension(&ecall_test_ext);
+	ecall_test_ext.probe = NULL;
+}
+
+static void domain_policy_test(struct sbiunit_test_case *test)
+{
+	unsigned long val = 1;
+
+	ecall_test_ext.domain_allowed = ecall_test_domain_allowed;
+	SBIUNIT_ASSERT_EQ(test, sbi_ecall_register_extension(&ecall_test_ext),
+			  0);
+
+	/* Hidden from the root domain but still registered */
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_domain_find_extension(&root,
+						ECALL_TEST_EXTID), NULL);
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_domain_probe(&root, ECALL_TEST_EXTID,
+						       &val), 0);
+	SBIUNIT_EXPECT_EQ(test, val, 0);
+	SBIUNIT_EXPECT_EQ(test, sbi_ecall_find_extension(ECALL_TEST_EXTID),
+			  &ecall_test_ext);
+	SBIUNIT_EXPECT_NE(test, sbi_ecall_domain_find_extension(&root,
+						SBI_EXT_BASE), NULL);
+
+	sbi_ecall_unregister_extension(&ecall_test_ext);
+	ecall_test_ext.domain_allowed = NULL;
+}
+
+static struct sbiunit_test_case ecall_test_cases[] = {
+	SBIUNIT_TEST_CASE(find_extension_test),
+	SBIUNIT_TEST_CASE(register_extension_test),
+	SBIUNIT_TEST_CASE(probe_cache_test),
+	SBIUNIT_TEST_CASE(domain_policy_test),
+	SBIUNIT_END_CASE,
+};
+
+SBIUNIT_TEST_SUITE(ecall_test_suite, ecall_test_cases);
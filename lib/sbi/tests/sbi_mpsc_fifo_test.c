@@ -0,0 +1,112 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_mpsc_fifo.h>
+#include <sbi/sbi_unit_test.h>
+
+#define MPSC_TEST_ENTRIES 4
+
+static unsigned long test_mem[SBI_MPSC_FIFO_MEM_SIZE(MPSC_TEST_ENTRIES,
+			sizeof(unsigned long)) / sizeof(unsigned long)];
+static struct sbi_mpsc_fifo test_fifo;
+
+static void mpsc_fifo_test_suite_init(void)
+{
+	sbi_mpsc_fifo_init(&test_fifo, test_mem, MPSC_TEST_ENTRIES,
+			   sizeof(unsigned long));
+}
+
+static void mpsc_fifo_init_test(struct sbiunit_test_case *test)
+{
+	unsigned long mem[SBI_MPSC_FIFO_MEM_SIZE(MPSC_TEST_ENTRIES,
+			sizeof(unsigned long)) / sizeof(unsigned long)];
+	struct sbi_mpsc_fifo fifo;
+
+	/* Entry count must be a power of two */
+	SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_init(&fifo, mem, 3,
+						   sizeof(unsigned long)),
+			  SBI_EINVAL);
+	SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_init(&fifo, mem, 0,
+						   sizeof(unsigned long)),
+			  SBI_EINVAL);
+	SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_init(&fifo, mem,
+						   MPSC_TEST_ENTRIES,
+						   sizeof(unsigned long)), 0);
+}
+
+static void mpsc_fifo_order_test(struct sbiunit_test_case *test)
+{
+	unsigned long i, lap, val;
+
+	/* Go around the ring a few times to cover position wrapping */
+	for (lap = 0; lap < 3; lap++) {
+		SBIUNIT_EXPECT(test, sbi_mpsc_fifo_is_empty(&test_fifo));
+		for (i = 0; i < MPSC_TEST_ENTRIES; i++) {
+			val = lap * MPSC_TEST_ENTRIES + i;
+			SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_enqueue(&test_fifo,
+								      &val), 0);
+		}
+
+		/* No space left until the consumer catches up */
+		SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_enqueue(&test_fifo, &val),
+				  SBI_ENOSPC);
+
+		for (i = 0; i < MPSC_TEST_ENTRIES; i++) {
+			SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_dequeue(&test_fifo,
+								      &val), 0);
+			SBIUNIT_EXPECT_EQ(test, val, lap * MPSC_TEST_ENTRIES + i);
+		}
+		SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_dequeue(&test_fifo, &val),
+				  SBI_ENOENT);
+	}
+}
+
+static int mpsc_fifo_test_update_cb(void *in, void *data)
+{
+	unsigned long *curr = data;
+	unsigned long *next = in;
+
+	if (*curr != *next)
+		return SBI_FIFO_UNCHANGED;
+
+	*curr += 100;
+	return SBI_FIFO_UPDATED;
+}
+
+static void mpsc_fifo_inplace_update_test(struct sbiunit_test_case *test)
+{
+	unsigned long val, in = 2;
+
+	for (val = 1; val <= 3; val++)
+		sbi_mpsc_fifo_enqueue(&test_fifo, &val);
+
+	SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_inplace_update(&test_fifo, &in,
+					mpsc_fifo_test_update_cb),
+			  SBI_FIFO_UPDATED);
+	in = 7;
+	SBIUNIT_EXPECT_EQ(test, sbi_mpsc_fifo_inplace_update(&test_fifo, &in,
+					mpsc_fifo_test_update_cb),
+			  SBI_FIFO_UNCHANGED);
+
+	sbi_mpsc_fifo_dequeue(&test_fifo, &val);
+	SBIUNIT_EXPECT_EQ(test, val, 1);
+	sbi_mpsc_fifo_dequeue(&test_fifo, &val);
+	SBIUNIT_EXPECT_EQ(test, val, 102);
+	sbi_mpsc_fifo_dequeue(&test_fifo, &val);
+	SBIUNIT_EXPECT_EQ(test, val, 3);
+	SBIUNIT_EXPECT(test, sbi_mpsc_fifo_is_empty(&test_fifo));
+}
+
+static struct sbiunit_test_case mpsc_fifo_test_cases[] = {
+	SBIUNIT_TEST_CASE(mpsc_fifo_init_test),
+	SBIUNIT_TEST_CASE(mpsc_fifo_order_test),
+	SBIUNIT_TEST_CASE(mpsc_fifo_inplace_update_test),
+	SBIUNIT_END_CASE,
+};
+
+struct sbiunit_test_suite mpsc_fifo_test_suite = {
+	.name = "mpsc_fifo_test_suite",
+	.init = mpsc_fifo_test_suite_init,
+	.cases = mpsc_fifo_test_cases,
+};
@@ -0,0 +1,56 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Cycle counts of remote SFENCE.VMA requests. The other HARTs wait for
+ * the coldboot HART in WFI with interrupts disabled while the tests run
+ * so the requests target the boot HART which takes the same request
+ * path and flushes locally.
+ */
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_tlb.h>
+#include <sbi/sbi_unit_test.h>
+
+#define BENCH_SAMPLES		32
+
+static void bench_sfence_vma(struct sbiunit_test_case *test,
+			     unsigned long size)
+{
+	struct sbi_tlb_info tinfo;
+
+	if (!misa_extension('S'))
+		return;
+
+	SBI_TLB_INFO_INIT(&tinfo, 0, size, 0, 0, SBI_TLB_SFENCE_VMA,
+			  current_hartid());
+	SBIUNIT_EXPECT_EQ(test, sbi_tlb_request(1UL, current_hartid(), &tinfo),
+			  0);
+}
+
+#define TLB_RANGE_BENCH(__pages)					\
+static void tlb_sfence_vma_##__pages##_pages(struct sbiunit_test_case *test) \
+{									\
+	bench_sfence_vma(test, (__pages) * PAGE_SIZE);			\
+}
+
+TLB_RANGE_BENCH(1)
+TLB_RANGE_BENCH(16)
+TLB_RANGE_BENCH(64)
+TLB_RANGE_BENCH(256)
+
+static void tlb_sfence_vma_all(struct sbiunit_test_case *test)
+{
+	bench_sfence_vma(test, SBI_TLB_FLUSH_ALL);
+}
+
+static struct sbiunit_test_case tlb_test_cases[] = {
+	SBIUNIT_BENCH_CASE(tlb_sfence_vma_1_pages, BENCH_SAMPLES),
+	SBIUNIT_BENCH_CASE(tlb_sfence_vma_16_pages, BENCH_SAMPLES),
+	SBIUNIT_BENCH_CASE(tlb_sfence_vma_64_pages, BENCH_SAMPLES),
+	SBIUNIT_BENCH_CASE(tlb_sfence_vma_256_pages, BENCH_SAMPLES),
+	SBIUNIT_BENCH_CASE(tlb_sfence_vma_all, BENCH_SAMPLES),
+	SBIUNIT_END_CASE,
+};
+
+SBIUNIT_TEST_SUITE(tlb_test_suite, tlb_test_cases);
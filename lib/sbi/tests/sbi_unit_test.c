@@ -3,22 +3,213 @@
  *
  * Author: Ivan Orlov <ivan.orlov0322@gmail.com>
  */
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_atomic.h>
+#include <sbi/riscv_barrier.h>
 #include <sbi/sbi_unit_test.h>
 #include <sbi/sbi_types.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_hartmask.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_hsm.h>
+#include <sbi/sbi_ipi.h>
+#include <sbi/sbi_timer.h>
 
 #define ANSI_COLOR_GREEN "\x1b[32m"
 #define ANSI_COLOR_RED "\x1b[31m"
 #define ANSI_COLOR_RESET "\x1b[0m"
 
+/* Untimed runs of a benchmark before its timed runs */
+#define BENCH_WARMUP_MIN	4
+/* Runs of an empty function to find the timing overhead */
+#define BENCH_CALIBRATE		16
+
 extern struct sbiunit_test_suite *const sbi_unit_tests[];
 
+static struct sbiunit_test_suite *current_suite;
+
+struct bench_run {
+	struct sbiunit_test_case *test;
+	u32 harts;
+	atomic_t ready;
+	atomic_t done;
+	/* Timer value when the last HART joined the timed runs */
+	u64 time_start;
+	/* Parked HARTs which still have to join, cleared as they do */
+	struct sbi_hartmask parked;
+};
+
+/* HARTs waiting in sbi_hsm_hart_wait() to be started by the supervisor */
+static struct sbi_hartmask bench_parked_harts;
+static struct bench_run *bench_parked_run;
+
+static void __attribute__((noinline)) bench_nop(struct sbiunit_test_case *test)
+{
+	asm volatile("" ::: "memory");
+}
+
+static unsigned long bench_sample(void (*fn)(struct sbiunit_test_case *),
+				  struct sbiunit_test_case *test)
+{
+	unsigned long start = csr_read(CSR_MCYCLE);
+
+	fn(test);
+	return csr_read(CSR_MCYCLE) - start;
+}
+
+static void bench_sort(unsigned long *samples, u32 count)
+{
+	unsigned long v;
+	u32 i, j;
+
+	for (i = 1; i < count; i++) {
+		v = samples[i];
+		for (j = i; j > 0 && samples[j - 1] > v; j--)
+			samples[j] = samples[j - 1];
+		samples[j] = v;
+	}
+}
+
+static void bench_hart(void *arg)
+{
+	struct bench_run *run = arg;
+	struct sbiunit_test_case *test = run->test;
+	unsigned long *samples, overhead = -1UL, v;
+	u32 i, count = test->iterations;
+	u64 time_start, time;
+
+	samples = sbi_malloc(count * sizeof(*samples));
+	if (!samples) {
+		test->failed = true;
+		SBIUNIT_INFO(test, "Failed to allocate samples!\n");
+	}
+
+	for (i = 0; i < BENCH_CALIBRATE; i++) {
+		v = bench_sample(bench_nop, test);
+		if (v < overhead)
+			overhead = v;
+	}
+
+	for (i = 0; samples && i < count / 8 + BENCH_WARMUP_MIN; i++)
+		test->bench_func(test);
+
+	/* Start the timed runs of all HARTs together */
+	if (atomic_add_return(&run->ready, 1) == run->harts)
+		run->time_start = sbi_timer_value();
+	while (atomic_read(&run->ready) < run->harts)
+		cpu_relax();
+
+	if (samples) {
+		time_start = sbi_timer_value();
+		for (i = 0; i < count; i++) {
+			v = bench_sample(test->bench_func, test);
+			samples[i] = (v > overhead) ? v - overhead : 0;
+		}
+		time = sbi_timer_value() - time_start;
+
+		bench_sort(samples, count);
+		sbi_printf("[SBIUnit] bench suite=%s case=%s hart=%u harts=%u "
+			   "iters=%u min=%lu p50=%lu p99=%lu max=%lu "
+			   "overhead=%lu time=%lu\n", current_suite->name,
+			   test->name, current_hartid(), run->harts, count,
+			   samples[0], samples[count / 2],
+			   samples[(count * 99) / 100], samples[count - 1],
+			   overhead, (unsigned long)time);
+		sbi_free(samples);
+	}
+
+	atomic_add_return(&run->done, 1);
+}
+
+void sbiunit_hart_wait(void)
+{
+	struct bench_run *run;
+	u32 hartindex = current_hartindex();
+
+	if (!sbi_hartmask_test_hartindex(hartindex, &bench_parked_harts))
+		atomic_raw_set_bit(hartindex, bench_parked_harts.bits);
+
+	run = __smp_load_acquire(&bench_parked_run);
+	if (!run || !atomic_raw_clear_bit(hartindex, run->parked.bits))
+		return;
+
+	sbi_ipi_raw_clear();
+	bench_hart(run);
+}
+
+void sbiunit_bench_run(struct sbiunit_test_case *test)
+{
+	/* Static so that a parked HART never looks at a stale stack frame */
+	static struct bench_run run;
+	struct sbi_hartmask mask, parked;
+	u32 i;
+
+	if (!test->iterations || !test->bench_func)
+		return;
+
+	run.test = test;
+	run.harts = 1;
+	ATOMIC_INIT(&run.ready, 0);
+	ATOMIC_INIT(&run.done, 0);
+
+	sbi_hartmask_clear_all(&mask);
+	sbi_hartmask_clear_all(&parked);
+	if (test->all_harts) {
+		if (sbi_hsm_hart_interruptible_mask(sbi_domain_thishart_ptr(),
+						    &mask))
+			SBIUNIT_PANIC(test, "Failed to get the started HARTs!\n");
+		sbi_hartmask_clear_hartindex(current_hartindex(), &mask);
+		run.harts += sbi_hartmask_weight(&mask);
+
+		/*
+		 * During boot the other HARTs are not started yet but wait
+		 * in sbi_hsm_hart_wait(), so recruit them from there.
+		 */
+		sbi_hartmask_for_each_hartindex(i, &bench_parked_harts) {
+			if (i == current_hartindex() ||
+			    sbi_hartmask_test_hartindex(i, &mask) ||
+			    __sbi_hsm_hart_get_state(i) != SBI_HSM_STATE_STOPPED)
+				continue;
+			sbi_hartmask_set_hartindex(i, &parked);
+		}
+		run.harts += sbi_hartmask_weight(&parked);
+	}
+
+	/* The other HARTs run the benchmark from their IPI handler */
+	if (sbi_hartmask_weight(&mask) &&
+	    sbi_ipi_call_many(&mask, bench_hart, &run, false))
+		SBIUNIT_PANIC(test, "Failed to start the benchmark on all HARTs!\n");
+
+	if (sbi_hartmask_weight(&parked)) {
+		smp_wmb();
+		sbi_hartmask_copy(&run.parked, &parked);
+		__smp_store_release(&bench_parked_run, &run);
+		sbi_ipi_raw_send_mask(&parked);
+	}
+
+	bench_hart(&run);
+	while (atomic_read(&run.done) < run.harts)
+		cpu_relax();
+
+	__smp_store_release(&bench_parked_run, NULL);
+
+	/* Throughput of all HARTs together is harts * iters / time */
+	if (test->all_harts)
+		sbi_printf("[SBIUnit] bench suite=%s case=%s total harts=%u "
+			   "iters=%u time=%lu\n", current_suite->name,
+			   test->name, run.harts, test->iterations,
+			   (unsigned long)(sbi_timer_value() - run.time_start));
+}
+
 static void run_test_suite(struct sbiunit_test_suite *suite)
 {
 	struct sbiunit_test_case *s_case;
 	u32 count_pass = 0, count_fail = 0;
 
 	sbi_printf("## Running test suite: %s\n", suite->name);
+	current_suite = suite;
 
 	if (suite->init)
 		suite->init();
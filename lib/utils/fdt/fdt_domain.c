@@ -15,7 +15,9 @@
 #include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_heap.h>
 #include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
 #include <sbi_utils/fdt/fdt_domain.h>
+#include <sbi_utils/fdt/fdt_fixup.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 
 int fdt_iterate_each_domain(void *fdt, void *opaque,
@@ -78,7 +80,7 @@ int fdt_iterate_each_memregion(void *fdt, int domain_offset, void *opaque,
 
 	rcount = (u32)len / (sizeof(u32) * 2);
 	for (i = 0; i < rcount; i++) {
-		region_offset = fdt_node_offset_by_phandle(fdt,
+		region_offset = fdt_phandle_offset(fdt,
 						fdt32_to_cpu(regions[2 * i]));
 		if (region_offset < 0)
 			return region_offset;
@@ -124,26 +126,17 @@ static int __fixup_find_domain_offset(void *fdt, int doff, void *p)
 				 SBI_DOMAIN_MEMREGION_WRITEABLE | \
 				 SBI_DOMAIN_MEMREGION_EXECUTABLE)
 
-static int __fixup_count_disable_devices(void *fdt, int doff, int roff,
-					 u32 perm, void *p)
-{
-	int len;
-	u32 *dcount = p;
-
-	if (perm & DISABLE_DEVICES_MASK)
-		return 0;
-
-	len = 0;
-	if (fdt_getprop(fdt, roff, "devices", &len))
-		*dcount += len / sizeof(u32);
-
-	return 0;
-}
+struct __fixup_disable_devices_info {
+	u32 count;
+	u32 max;
+	int *offsets;
+};
 
-static int __fixup_disable_devices(void *fdt, int doff, int roff,
-				   u32 raccess, void *p)
+static int __fixup_collect_disable_devices(void *fdt, int doff, int roff,
+					   u32 raccess, void *p)
 {
-	int i, len, coff;
+	struct __fixup_disable_devices_info *info = p;
+	int i, len, coff, *offsets;
 	const u32 *devices;
 
 	if (raccess & DISABLE_DEVICES_MASK)
@@ -156,23 +149,56 @@ static int __fixup_disable_devices(void *fdt, int doff, int roff,
 	len = len / sizeof(u32);
 
 	for (i = 0; i < len; i++) {
-		coff = fdt_node_offset_by_phandle(fdt,
-					fdt32_to_cpu(devices[i]));
+		coff = fdt_phandle_offset(fdt, fdt32_to_cpu(devices[i]));
 		if (coff < 0)
 			return coff;
 
-		fdt_setprop_string(fdt, coff, "status", "disabled");
+		if (info->count == info->max) {
+			info->max = info->max ? 2 * info->max : 16;
+			offsets = sbi_malloc(info->max * sizeof(*offsets));
+			if (!offsets)
+				return SBI_ENOMEM;
+			if (info->offsets) {
+				sbi_memcpy(offsets, info->offsets,
+					   info->count * sizeof(*offsets));
+				sbi_free(info->offsets);
+			}
+			info->offsets = offsets;
+		}
+		info->offsets[info->count++] = coff;
 	}
 
 	return 0;
 }
 
+/* Sort in descending order and drop duplicates, returns the new count */
+static u32 __fixup_sort_disable_devices(int *offsets, u32 count)
+{
+	u32 i, j, n = 0;
+	int off;
+
+	for (i = 1; i < count; i++) {
+		off = offsets[i];
+		for (j = i; j > 0 && offsets[j - 1] < off; j--)
+			offsets[j] = offsets[j - 1];
+		offsets[j] = off;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!n || offsets[n - 1] != offsets[i])
+			offsets[n++] = offsets[i];
+	}
+
+	return n;
+}
+
 void fdt_domain_fixup(void *fdt)
 {
-	u32 i, dcount;
+	u32 i;
 	int err, poffset, doffset;
 	struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	struct __fixup_find_domain_offset_info fdo;
+	struct __fixup_disable_devices_info info = { 0 };
 
 	/* Remove the domain assignment DT property from CPU DT nodes */
 	poffset = fdt_path_offset(fdt, "/cpus");
@@ -201,29 +227,31 @@ void fdt_domain_fixup(void *fdt)
 	if (doffset < 0)
 		goto skip_device_disable;
 
-	/* Count current domain device DT nodes to be disabled */
-	dcount = 0;
-	fdt_iterate_each_memregion(fdt, doffset, &dcount,
-				   __fixup_count_disable_devices);
-	if (!dcount)
-		goto skip_device_disable;
+	/*
+	 * Resolve all device DT nodes to be disabled before editing the
+	 * tree, every edit would otherwise invalidate the phandle cache.
+	 */
+	fdt_iterate_each_memregion(fdt, doffset, &info,
+				   __fixup_collect_disable_devices);
+	info.count = __fixup_sort_disable_devices(info.offsets, info.count);
 
-	/* Expand FDT based on device DT nodes to be disabled */
-	err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + dcount * 32);
+	/* Expand FDT once for all device DT nodes to be disabled */
+	err = info.count ? fdt_fixup_reserve(fdt, info.count * 32) : 0;
 	if (err < 0)
-		return;
+		goto free_devices;
 
-	/* Again find current domain DT node */
-	doffset = -1;
-	fdo.name = dom->name;
-	fdo.doffset = &doffset;
-	fdt_iterate_each_domain(fdt, &fdo, __fixup_find_domain_offset);
-	if (doffset < 0)
-		goto skip_device_disable;
+	/*
+	 * Disable device DT nodes for current domain from the end of the
+	 * tree so growing one status property does not move the others.
+	 */
+	for (i = 0; i < info.count; i++)
+		fdt_setprop_string(fdt, info.offsets[i], "status", "disabled");
 
-	/* Disable device DT nodes for current domain */
-	fdt_iterate_each_memregion(fdt, doffset, NULL,
-				   __fixup_disable_devices);
+free_devices:
+	if (info.offsets)
+		sbi_free(info.offsets);
+	if (err)
+		return;
 skip_device_disable:
 
 	/* Remove the OpenSBI domain config DT node */
@@ -302,6 +330,34 @@ static int __fdt_parse_region(const void *fdt, int domain_offset,
 	return 0;
 }
 
+/*
+ * Parse a statistics page given as <addr-high addr-low size>. The page
+ * is validated against the memory regions of the domain once domains
+ * are finalized.
+ */
+static void fdt_parse_stats_page(const void *fdt, int nodeoff,
+				 const char *prop, struct sbi_domain *dom)
+{
+	const u32 *val;
+	u64 addr;
+	int len;
+
+	dom->stats_page = 0;
+	dom->stats_page_size = 0;
+
+	val = fdt_getprop(fdt, nodeoff, prop, &len);
+	if (!val || len < 12)
+		return;
+
+	addr = fdt32_to_cpu(val[0]);
+	addr = (addr << 32) | fdt32_to_cpu(val[1]);
+	if ((unsigned long)addr != addr)
+		return;
+
+	dom->stats_page = addr;
+	dom->stats_page_size = fdt32_to_cpu(val[2]);
+}
+
 static int __fdt_parse_domain(const void *fdt, int domain_offset, void *opaque)
 {
 	u32 val32;
@@ -347,7 +403,7 @@ static int __fdt_parse_domain(const void *fdt, int domain_offset, void *opaque)
 	len = len / sizeof(u32);
 	if (val && len) {
 		for (i = 0; i < len; i++) {
-			cpu_offset = fdt_node_offset_by_phandle(fdt,
+			cpu_offset = fdt_phandle_offset(fdt,
 							fdt32_to_cpu(val[i]));
 			if (cpu_offset < 0) {
 				err = cpu_offset;
@@ -397,8 +453,7 @@ static int __fdt_parse_domain(const void *fdt, int domain_offset, void *opaque)
 	val32 = -1U;
 	val = fdt_getprop(fdt, domain_offset, "boot-hart", &len);
 	if (val && len >= 4) {
-		cpu_offset = fdt_node_offset_by_phandle(fdt,
-							 fdt32_to_cpu(*val));
+		cpu_offset = fdt_phandle_offset(fdt, fdt32_to_cpu(*val));
 		if (cpu_offset >= 0 && fdt_node_is_enabled(fdt, cpu_offset))
 			fdt_parse_hart_id(fdt, cpu_offset, &val32);
 	} else {
@@ -457,6 +512,23 @@ static int __fdt_parse_domain(const void *fdt, int domain_offset, void *opaque)
 	else
 		dom->system_suspend_allowed = false;
 
+	/* Read "timer-slack" DT property */
+	val = fdt_getprop(fdt, domain_offset, "timer-slack", &len);
+	if (val && len >= 4)
+		dom->timer_slack = fdt32_to_cpu(val[0]);
+	else
+		dom->timer_slack = 0;
+
+	/* Read "stats-page" DT property */
+	fdt_parse_stats_page(fdt, domain_offset, "stats-page", dom);
+
+	/* Read "cache-way-mask" DT property */
+	val = fdt_getprop(fdt, domain_offset, "cache-way-mask", &len);
+	if (val && len >= 4)
+		dom->cache_way_mask = fdt32_to_cpu(val[0]);
+	else
+		dom->cache_way_mask = 0;
+
 	/* Find /cpus DT node */
 	cpus_offset = fdt_path_offset(fdt, "/cpus");
 	if (cpus_offset < 0) {
@@ -483,7 +555,7 @@ static int __fdt_parse_domain(const void *fdt, int domain_offset, void *opaque)
 			continue;
 
 		/* However, it should be valid if specified */
-		doffset = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+		doffset = fdt_phandle_offset(fdt, fdt32_to_cpu(*val));
 		if (doffset < 0) {
 			err = doffset;
 			goto fail_free_all;
@@ -514,12 +586,26 @@ int fdt_domains_populate(const void *fdt)
 	const u32 *val;
 	int cold_domain_offset;
 	u32 hartid, cold_hartid;
-	int err, len, cpus_offset, cpu_offset;
+	int err, len, chosen_offset, cpus_offset, cpu_offset;
 
 	/* Sanity checks */
 	if (!fdt)
 		return SBI_EINVAL;
 
+	/*
+	 * The root domain has no DT node, its page and cache ways are
+	 * given in /chosen
+	 */
+	chosen_offset = fdt_path_offset(fdt, "/chosen");
+	if (chosen_offset >= 0) {
+		fdt_parse_stats_page(fdt, chosen_offset, "opensbi,stats-page",
+				     &root);
+		val = fdt_getprop(fdt, chosen_offset,
+				  "opensbi,cache-way-mask", &len);
+		if (val && len >= 4)
+			root.cache_way_mask = fdt32_to_cpu(val[0]);
+	}
+
 	/* Find /cpus DT node */
 	cpus_offset = fdt_path_offset(fdt, "/cpus");
 	if (cpus_offset < 0)
@@ -541,7 +627,7 @@ int fdt_domains_populate(const void *fdt)
 
 		val = fdt_getprop(fdt, cpu_offset, "opensbi-domain", &len);
 		if (val && len >= 4)
-			cold_domain_offset = fdt_node_offset_by_phandle(fdt,
+			cold_domain_offset = fdt_phandle_offset(fdt,
 							   fdt32_to_cpu(*val));
 
 		break;
@@ -5,6 +5,7 @@
  */
 
 #include <libfdt.h>
+#include <sbi/sbi_boot_trace.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_error.h>
 #include <sbi_utils/fdt/fdt_driver.h>
@@ -26,35 +27,54 @@ int fdt_driver_init_by_offset(const void *fdt, int nodeoff,
 		return SBI_ENODEV;
 
 	while ((driver = *drivers++)) {
-		for (match = driver->match_table; match->compatible; match++) {
-			if (!fdt_stringlist_contains(prop, len, match->compatible))
-				continue;
-
-			rc = driver->init(fdt, nodeoff, match);
-			if (rc < 0) {
-				const char *name;
+		match = fdt_match_compatible(prop, len, driver->match_table);
+		if (!match)
+			continue;
 
-				name = fdt_get_name(fdt, nodeoff, NULL);
-				sbi_printf("%s: %s (%s) init failed: %d\n",
-					   __func__, name, match->compatible, rc);
-			}
+		rc = driver->init(fdt, nodeoff, match);
+		sbi_boot_trace(match->compatible);
+		if (rc < 0) {
+			const char *name;
 
-			return rc;
+			name = fdt_get_name(fdt, nodeoff, NULL);
+			sbi_printf("%s: %s (%s) init failed: %d\n",
+				   __func__, name, match->compatible, rc);
 		}
+
+		return rc;
 	}
 
 	return SBI_ENODEV;
 }
 
+/* Next node in DT order which any of the drivers is compatible with */
+static int fdt_driver_next_node(const void *fdt, int nodeoff,
+				const struct fdt_driver *const *drivers)
+{
+	const struct fdt_driver *driver;
+	int next = SBI_ENODEV, off;
+
+	if (!fdt_compat_index_ready(fdt))
+		return fdt_next_node(fdt, nodeoff, NULL);
+
+	while ((driver = *drivers++)) {
+		off = fdt_find_match(fdt, nodeoff, driver->match_table, NULL);
+		if (off >= 0 && (next < 0 || off < next))
+			next = off;
+	}
+
+	return next;
+}
+
 static int fdt_driver_init_scan(const void *fdt,
 				const struct fdt_driver *const *drivers,
 				bool one)
 {
 	int nodeoff, rc;
 
-	for (nodeoff = fdt_next_node(fdt, -1, NULL);
+	for (nodeoff = fdt_driver_next_node(fdt, -1, drivers);
 	     nodeoff >= 0;
-	     nodeoff = fdt_next_node(fdt, nodeoff, NULL)) {
+	     nodeoff = fdt_driver_next_node(fdt, nodeoff, drivers)) {
 		rc = fdt_driver_init_by_offset(fdt, nodeoff, drivers);
 		if (rc == SBI_ENODEV)
 			continue;
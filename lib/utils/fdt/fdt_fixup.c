@@ -9,6 +9,7 @@
  */
 
 #include <libfdt.h>
+#include <sbi/sbi_boot_trace.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_domain.h>
 #include <sbi/sbi_math.h>
@@ -20,12 +21,94 @@
 #include <sbi_utils/fdt/fdt_pmu.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 
+/* Room for a "status" = "disabled" property and its name string */
+#define FDT_FIXUP_DISABLE_SIZE	(sizeof(struct fdt_property) + 12)
+#define FDT_FIXUP_STRING_SIZE	8
+
+/* Each PMP memory region entry occupies 64 bytes, 16 of them need 1024 */
+#define FDT_FIXUP_RESV_MEM_SIZE	1024
+
+int fdt_fixup_reserve(void *fdt, int size)
+{
+	int used;
+
+	/*
+	 * Once the blocks are in the order fdt_open_into() leaves them
+	 * the free space is at the end of the blob, so the blob is only
+	 * rewritten when it has to grow.
+	 */
+	if (fdt_version(fdt) >= 17 &&
+	    fdt_off_mem_rsvmap(fdt) < fdt_off_dt_struct(fdt) &&
+	    fdt_off_dt_struct(fdt) + fdt_size_dt_struct(fdt) <=
+	    fdt_off_dt_strings(fdt)) {
+		used = fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt);
+		if (fdt_totalsize(fdt) >= used + size)
+			return 0;
+	}
+
+	return fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + size);
+}
+
+static int fdt_fixup_cpu_size(void *fdt)
+{
+	int cpus_offset, cpu_offset, size = FDT_FIXUP_STRING_SIZE;
+
+	cpus_offset = fdt_path_offset(fdt, "/cpus");
+	if (cpus_offset < 0)
+		return 0;
+
+	fdt_for_each_subnode(cpu_offset, fdt, cpus_offset)
+		size += FDT_FIXUP_DISABLE_SIZE;
+
+	return size;
+}
+
+static int fdt_fixup_node_size(void *fdt, const char *compatible)
+{
+	int noff = 0, size = 0;
+
+	while ((noff = fdt_node_offset_by_compatible(fdt, noff,
+						     compatible)) >= 0)
+		size += FDT_FIXUP_DISABLE_SIZE;
+
+	return size ? size + FDT_FIXUP_STRING_SIZE : 0;
+}
+
+static int fdt_boot_trace_size(void)
+{
+	const struct sbi_boot_trace_entry *entry;
+	u32 i, count;
+	int size;
+
+	count = sbi_boot_trace_count();
+	if (!count)
+		return 0;
+
+	size = 128;
+	for (i = 0; i < count; i++) {
+		entry = sbi_boot_trace_get(i);
+		if (entry)
+			size += sbi_strlen(entry->name) + 1 + 2 * sizeof(u64);
+	}
+
+	return size;
+}
+
+int fdt_fixups_reserve(void *fdt)
+{
+	return fdt_fixup_reserve(fdt, fdt_fixup_cpu_size(fdt) +
+				 fdt_fixup_node_size(fdt, "riscv,aplic") +
+				 fdt_fixup_node_size(fdt, "riscv,imsics") +
+				 FDT_FIXUP_RESV_MEM_SIZE +
+				 fdt_boot_trace_size());
+}
+
 int fdt_add_cpu_idle_states(void *fdt, const struct sbi_cpu_idle_state *state)
 {
 	int cpu_node, cpus_node, err, idle_states_node;
 	uint32_t count, phandle;
 
-	err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + 1024);
+	err = fdt_fixup_reserve(fdt, 1024);
 	if (err < 0)
 		return err;
 
@@ -108,24 +191,25 @@ int fdt_add_cpu_idle_states(void *fdt, const struct sbi_cpu_idle_state *state)
 void fdt_cpu_fixup(void *fdt)
 {
 	struct sbi_domain *dom = sbi_domain_thishart_ptr();
-	int err, cpu_offset, cpus_offset, len;
+	const struct fdt_cpu *cpus;
+	int err, cpu_offset, len;
 	const char *mmu_type;
-	u32 hartid, hartindex;
+	u32 i, count, hartindex;
 
-	err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + 32);
+	err = fdt_fixup_reserve(fdt, fdt_fixup_cpu_size(fdt));
 	if (err < 0)
 		return;
 
-	cpus_offset = fdt_path_offset(fdt, "/cpus");
-	if (cpus_offset < 0)
+	cpus = fdt_cpu_table(fdt, &count);
+	if (!cpus)
 		return;
 
-	fdt_for_each_subnode(cpu_offset, fdt, cpus_offset) {
-		err = fdt_parse_hart_id(fdt, cpu_offset, &hartid);
-		if (err)
-			continue;
-
-		if (!fdt_node_is_enabled(fdt, cpu_offset))
+	/*
+	 * Walk backwards so growing the status of a node does not move
+	 * the offsets of the nodes which are still to be fixed up.
+	 */
+	for (i = count; i > 0; i--) {
+		if (!cpus[i - 1].enabled)
 			continue;
 
 		/*
@@ -134,7 +218,8 @@ void fdt_cpu_fixup(void *fdt)
 		 * 2. MMU is not available for the HART
 		 */
 
-		hartindex = sbi_hartid_to_hartindex(hartid);
+		cpu_offset = cpus[i - 1].offset;
+		hartindex = sbi_hartid_to_hartindex(cpus[i - 1].hartid);
 		mmu_type = fdt_getprop(fdt, cpu_offset, "mmu-type", &len);
 		if (!sbi_domain_is_assigned_hart(dom, hartindex) ||
 		    !mmu_type || !len)
@@ -155,7 +240,8 @@ static void fdt_domain_based_fixup_one(void *fdt, int nodeoff)
 
 	if (!sbi_domain_check_addr(dom, reg_addr, dom->next_mode,
 				    SBI_DOMAIN_READ | SBI_DOMAIN_WRITE)) {
-		rc = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + 32);
+		rc = fdt_fixup_reserve(fdt, FDT_FIXUP_DISABLE_SIZE +
+				       FDT_FIXUP_STRING_SIZE);
 		if (rc < 0)
 			return;
 		fdt_setprop_string(fdt, nodeoff, "status", "disabled");
@@ -211,7 +297,8 @@ void fdt_plic_fixup(void *fdt)
 
 static int fdt_resv_memory_update_node(void *fdt, unsigned long addr,
 				       unsigned long size, int index,
-				       int parent)
+				       int parent, const char *prefix,
+				       bool no_map)
 {
 	int na = fdt_address_cells(fdt, 0);
 	int ns = fdt_size_cells(fdt, 0);
@@ -229,11 +316,11 @@ static int fdt_resv_memory_update_node(void *fdt, unsigned long addr,
 
 	if (na > 1 && addr_high)
 		sbi_snprintf(name, sizeof(name),
-			     "mmode_resv%d@%x,%x", index,
+			     "%s%d@%x,%x", prefix, index,
 			     addr_high, addr_low);
 	else
 		sbi_snprintf(name, sizeof(name),
-			     "mmode_resv%d@%x", index,
+			     "%s%d@%x", prefix, index,
 			     addr_low);
 
 	subnode = fdt_add_subnode(fdt, parent, name);
@@ -245,9 +332,11 @@ static int fdt_resv_memory_update_node(void *fdt, unsigned long addr,
 	 * mapping of the region as part of its standard
 	 * mapping of system memory.
 	 */
-	err = fdt_setprop_empty(fdt, subnode, "no-map");
-	if (err < 0)
-		return err;
+	if (no_map) {
+		err = fdt_setprop_empty(fdt, subnode, "no-map");
+		if (err < 0)
+			return err;
+	}
 
 	/* encode the <reg> property value */
 	val = reg;
@@ -263,7 +352,7 @@ static int fdt_resv_memory_update_node(void *fdt, unsigned long addr,
 	if (err < 0)
 		return err;
 
-	return 0;
+	return subnode;
 }
 
 /**
@@ -286,20 +375,14 @@ int fdt_reserved_memory_fixup(void *fdt)
 	struct sbi_domain_memregion *reg;
 	struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	unsigned long filtered_base[PMP_COUNT] = { 0 };
-	unsigned char filtered_order[PMP_COUNT] = { 0 };
-	unsigned long addr, size;
-	int err, parent, i, j;
+	unsigned long filtered_end[PMP_COUNT] = { 0 };
+	unsigned long base, end;
+	int err, parent, i, j, k;
 	int na = fdt_address_cells(fdt, 0);
 	int ns = fdt_size_cells(fdt, 0);
 
-	/*
-	 * Expand the device tree to accommodate new node
-	 * by the following estimated size:
-	 *
-	 * Each PMP memory region entry occupies 64 bytes.
-	 * With 16 PMP memory regions we need 64 * 16 = 1024 bytes.
-	 */
-	err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + 1024);
+	/* Expand the device tree to accommodate the new nodes */
+	err = fdt_fixup_reserve(fdt, FDT_FIXUP_RESV_MEM_SIZE);
 	if (err < 0)
 		return err;
 
@@ -359,33 +442,106 @@ int fdt_reserved_memory_fixup(void *fdt)
 			return SBI_ENOSPC;
 		}
 
-		bool overlap = false;
-		addr = reg->base;
-		for (j = 0; j < i; j++) {
-			if (addr == filtered_base[j]
-			    && filtered_order[j] < reg->order) {
-				overlap = true;
-				filtered_order[j] = reg->order;
-				break;
-			}
+		/* Keep the regions sorted by base, ends are inclusive */
+		base = reg->base;
+		end = (reg->order < __riscv_xlen) ?
+		      base + BIT(reg->order) - 1 : -1UL;
+		for (j = i; j > 0 && base < filtered_base[j - 1]; j--) {
+			filtered_base[j] = filtered_base[j - 1];
+			filtered_end[j] = filtered_end[j - 1];
 		}
+		filtered_base[j] = base;
+		filtered_end[j] = end;
+		i++;
+	}
 
-		if (!overlap) {
-			filtered_base[i] = reg->base;
-			filtered_order[i] = reg->order;
-			i++;
+	/*
+	 * Regions of one firmware area are often split into adjacent
+	 * NAPOT pieces or overlap each other. All of them end up as the
+	 * same no-map node so merge them to create fewer nodes, which
+	 * also means fewer reservations for the OS to process.
+	 */
+	for (j = 0, k = 0; j < i; j++) {
+		if (k && (filtered_end[k - 1] == -1UL ||
+			  filtered_base[j] <= filtered_end[k - 1] + 1)) {
+			if (filtered_end[k - 1] < filtered_end[j])
+				filtered_end[k - 1] = filtered_end[j];
+			continue;
 		}
+		filtered_base[k] = filtered_base[j];
+		filtered_end[k] = filtered_end[j];
+		k++;
 	}
 
-	for (j = 0; j < i; j++) {
-		addr = filtered_base[j];
-		size = 1UL << filtered_order[j];
-		fdt_resv_memory_update_node(fdt, addr, size, j, parent);
+	for (j = 0; j < k; j++)
+		fdt_resv_memory_update_node(fdt, filtered_base[j],
+					    filtered_end[j] - filtered_base[j] + 1,
+					    j, parent, "mmode_resv", true);
+
+	/*
+	 * The statistics page was validated against the domain regions,
+	 * keep it out of the page allocator of the OS but mappable.
+	 */
+	if (dom->stats_page) {
+		err = fdt_resv_memory_update_node(fdt, dom->stats_page,
+						  dom->stats_page_size, 0,
+						  parent, "opensbi_stats",
+						  false);
+		if (err < 0)
+			return err;
+
+		err = fdt_setprop_string(fdt, err, "compatible",
+					 "opensbi,stats-page");
+		if (err < 0)
+			return err;
 	}
 
 	return 0;
 }
 
+void fdt_boot_trace_fixup(void *fdt)
+{
+	const struct sbi_boot_trace_entry *entry;
+	int chosen_offset, err;
+	u32 i, count;
+
+	count = sbi_boot_trace_count();
+	if (!count)
+		return;
+
+	err = fdt_fixup_reserve(fdt, fdt_boot_trace_size());
+	if (err < 0)
+		return;
+
+	chosen_offset = fdt_path_offset(fdt, "/chosen");
+	if (chosen_offset < 0)
+		return;
+
+	fdt_delprop(fdt, chosen_offset, "opensbi,boot-trace-names");
+	fdt_delprop(fdt, chosen_offset, "opensbi,boot-trace-cycles");
+	fdt_delprop(fdt, chosen_offset, "opensbi,boot-trace-time");
+
+	for (i = 0; i < count; i++) {
+		entry = sbi_boot_trace_get(i);
+		if (!entry)
+			continue;
+
+		err = fdt_appendprop_string(fdt, chosen_offset,
+					    "opensbi,boot-trace-names",
+					    entry->name);
+		if (!err)
+			err = fdt_appendprop_u64(fdt, chosen_offset,
+						 "opensbi,boot-trace-cycles",
+						 entry->cycles);
+		if (!err)
+			err = fdt_appendprop_u64(fdt, chosen_offset,
+						 "opensbi,boot-trace-time",
+						 entry->time);
+		if (err)
+			return;
+	}
+}
+
 void fdt_config_fixup(void *fdt)
 {
 	int chosen_offset, config_offset;
@@ -403,6 +559,13 @@ void fdt_config_fixup(void *fdt)
 
 void fdt_fixups(void *fdt)
 {
+	/* Node offsets move as soon as the fixups edit the tree */
+	fdt_phandle_cache_free();
+	fdt_cpu_table_free();
+
+	/* Grow the tree once for all fixups instead of once per fixup */
+	fdt_fixups_reserve(fdt);
+
 	fdt_aplic_fixup(fdt);
 
 	fdt_imsic_fixup(fdt);
@@ -416,4 +579,6 @@ void fdt_fixups(void *fdt)
 #endif
 
 	fdt_config_fixup(fdt);
+
+	fdt_boot_trace_fixup(fdt);
 }
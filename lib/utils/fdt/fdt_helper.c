@@ -10,9 +10,12 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_hartmask.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
 #include <sbi/sbi_hart.h>
+#include <sbi/sbi_tlb.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 #include <sbi_utils/irqchip/aplic.h>
 #include <sbi_utils/irqchip/imsic.h>
@@ -33,46 +36,508 @@
 #define DEFAULT_SHAKTI_UART_FREQ		50000000
 #define DEFAULT_SHAKTI_UART_BAUD		115200
 
+/* FNV-1a hash of a string of at most len characters */
+static u32 compat_hash(const char *str, size_t len)
+{
+	u32 hash = 2166136261U;
+
+	while (len-- && *str) {
+		hash ^= (u8)*str++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/*
+ * String block offsets of frequently looked up property names. A name
+ * may be stored more than once, for example as the tail of a longer
+ * name, so every offset at which it appears is recorded and looking up
+ * the property of a node needs only integer compares of name offsets.
+ * The offsets are found again when the FDT or its string block size
+ * changes, and a name stored too often is looked up with fdt_getprop().
+ */
+#define FDT_NAME_MAX_OFFS	4
+
+static const char *const fdt_cached_names[] = {
+	"compatible", "reg", "status", "phandle",
+};
+
+#define FDT_CACHED_NAMES	array_size(fdt_cached_names)
+
+static struct {
+	const void *fdt;
+	u32 size_dt_strings;
+	int count[FDT_CACHED_NAMES];
+	int offs[FDT_CACHED_NAMES][FDT_NAME_MAX_OFFS];
+} name_cache;
+
+static bool name_cache_get(const void *fdt)
+{
+	u32 i, pos, size, len;
+	const char *strs;
+
+	if (fdt_version(fdt) < 0x10)
+		return false;
+
+	size = fdt_size_dt_strings(fdt);
+	if (name_cache.fdt == fdt && name_cache.size_dt_strings == size)
+		return true;
+
+	strs = (const char *)fdt + fdt_off_dt_strings(fdt);
+	for (i = 0; i < FDT_CACHED_NAMES; i++) {
+		name_cache.count[i] = 0;
+		len = strlen(fdt_cached_names[i]);
+		for (pos = 0; pos + len < size; pos++) {
+			if (strs[pos + len] || sbi_memcmp(&strs[pos],
+						fdt_cached_names[i], len))
+				continue;
+			if (name_cache.count[i] == FDT_NAME_MAX_OFFS) {
+				name_cache.count[i] = -1;
+				break;
+			}
+			name_cache.offs[i][name_cache.count[i]++] = pos;
+		}
+	}
+	name_cache.fdt = fdt;
+	name_cache.size_dt_strings = size;
+
+	return true;
+}
+
+const void *fdt_getprop_cached(const void *fdt, int nodeoff,
+			       const char *name, int *lenp)
+{
+	const struct fdt_property *prop;
+	int i, j, poff, nameoff;
+
+	for (i = 0; i < FDT_CACHED_NAMES; i++) {
+		if (!strcmp(name, fdt_cached_names[i]))
+			break;
+	}
+	if (i == FDT_CACHED_NAMES || !name_cache_get(fdt) ||
+	    name_cache.count[i] < 0)
+		return fdt_getprop(fdt, nodeoff, name, lenp);
+
+	fdt_for_each_property_offset(poff, fdt, nodeoff) {
+		prop = fdt_get_property_by_offset(fdt, poff, lenp);
+		if (!prop)
+			return NULL;
+		nameoff = fdt32_to_cpu(prop->nameoff);
+		for (j = 0; j < name_cache.count[i]; j++) {
+			if (nameoff == name_cache.offs[i][j])
+				return prop->data;
+		}
+	}
+
+	if (lenp)
+		*lenp = poff;
+	return NULL;
+}
+
+/*
+ * Hashes of match table strings keyed by the string address. Match
+ * tables are constant so the hash of an entry is computed once and
+ * reused for every node it is matched against afterwards.
+ */
+#define MATCH_HASH_CACHE_SIZE	256
+#define MATCH_NODE_MAX_COMPAT	8
+
+static struct {
+	const char *str;
+	u32 hash;
+} match_hash_cache[MATCH_HASH_CACHE_SIZE];
+
+static u32 match_hash(const char *str)
+{
+	unsigned long slot = ((unsigned long)str >> 3) %
+			     MATCH_HASH_CACHE_SIZE;
+	u32 hash;
+
+	/* The key is read again to see whether hash belongs to it */
+	if (__atomic_load_n(&match_hash_cache[slot].str,
+			    __ATOMIC_ACQUIRE) == str) {
+		hash = __atomic_load_n(&match_hash_cache[slot].hash,
+				       __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&match_hash_cache[slot].str,
+				    __ATOMIC_RELAXED) == str)
+			return hash;
+	}
+
+	hash = compat_hash(str, -1UL);
+	__atomic_store_n(&match_hash_cache[slot].str, NULL, __ATOMIC_RELAXED);
+	__atomic_store_n(&match_hash_cache[slot].hash, hash, __ATOMIC_RELEASE);
+	__atomic_store_n(&match_hash_cache[slot].str, str, __ATOMIC_RELEASE);
+
+	return hash;
+}
+
+const struct fdt_match *fdt_match_compatible(const char *prop, int len,
+					     const struct fdt_match *match_table)
+{
+	int offs[MATCH_NODE_MAX_COMPAT], lens[MATCH_NODE_MAX_COMPAT];
+	u32 hashes[MATCH_NODE_MAX_COMPAT], hash;
+	int i, pos, slen, count = 0;
+
+	if (!prop || len <= 0 || !match_table)
+		return NULL;
+
+	for (pos = 0; pos < len; pos += slen + 1) {
+		slen = strnlen(&prop[pos], len - pos);
+		/* An unterminated last string never matches */
+		if (slen == len - pos) {
+			pos = len;
+			break;
+		}
+		if (count == MATCH_NODE_MAX_COMPAT)
+			break;
+		hashes[count] = compat_hash(&prop[pos], slen);
+		lens[count] = slen;
+		offs[count++] = pos;
+	}
+
+	for (; match_table->compatible; match_table++) {
+		/* Nodes with unusually many strings are matched directly */
+		if (pos < len) {
+			if (fdt_stringlist_contains(prop, len,
+						    match_table->compatible))
+				return match_table;
+			continue;
+		}
+
+		hash = match_hash(match_table->compatible);
+		for (i = 0; i < count; i++) {
+			if (hashes[i] == hash &&
+			    !strncmp(&prop[offs[i]], match_table->compatible,
+				     lens[i]) &&
+			    !match_table->compatible[lens[i]])
+				return match_table;
+		}
+	}
+
+	return NULL;
+}
+
 const struct fdt_match *fdt_match_node(const void *fdt, int nodeoff,
 				       const struct fdt_match *match_table)
 {
-	int ret;
+	const char *prop;
+	int len;
 
 	if (!fdt || nodeoff < 0 || !match_table)
 		return NULL;
 
-	while (match_table->compatible) {
-		ret = fdt_node_check_compatible(fdt, nodeoff,
-						match_table->compatible);
-		if (!ret)
-			return match_table;
-		match_table++;
+	prop = fdt_getprop_cached(fdt, nodeoff, "compatible", &len);
+
+	return fdt_match_compatible(prop, len, match_table);
+}
+
+/*
+ * Index of the compatible strings of all nodes which have any. Nodes
+ * are numbered in DT order and every compatible string of a node gives
+ * one key of the string hash in the upper half and the node number in
+ * the lower half. Sorted keys give the nodes of a compatible string in
+ * DT order with a binary search instead of a walk of the whole tree.
+ * The index is rebuilt when the FDT or the size of its structure block
+ * changes, which is what moves node offsets around.
+ */
+static struct {
+	const void *fdt;
+	u32 size_dt_struct;
+	bool failed;
+	u32 nr_nodes;
+	u32 nr_keys;
+	int *nodes;
+	u64 *keys;
+} compat_index;
+
+static void fdt_keys_sort(u64 *keys, u32 count)
+{
+	u32 i, root, child, end;
+	u64 tmp;
+
+	/* Heap sort, every key is unique so stability does not matter */
+	for (i = count / 2; i-- > 0;) {
+		for (root = i; (child = 2 * root + 1) < count; root = child) {
+			if (child + 1 < count && keys[child] < keys[child + 1])
+				child++;
+			if (keys[root] >= keys[child])
+				break;
+			tmp = keys[root];
+			keys[root] = keys[child];
+			keys[child] = tmp;
+		}
 	}
 
-	return NULL;
+	for (end = count; end-- > 1;) {
+		tmp = keys[0];
+		keys[0] = keys[end];
+		keys[end] = tmp;
+		for (root = 0; (child = 2 * root + 1) < end; root = child) {
+			if (child + 1 < end && keys[child] < keys[child + 1])
+				child++;
+			if (keys[root] >= keys[child])
+				break;
+			tmp = keys[root];
+			keys[root] = keys[child];
+			keys[child] = tmp;
+		}
+	}
+}
+
+void fdt_compat_index_free(void)
+{
+	if (compat_index.nodes)
+		sbi_free(compat_index.nodes);
+	if (compat_index.keys)
+		sbi_free(compat_index.keys);
+	sbi_memset(&compat_index, 0, sizeof(compat_index));
+}
+
+static bool compat_index_get(const void *fdt)
+{
+	u32 nodes = 0, keys = 0;
+	const char *prop;
+	int nodeoff, len, pos;
+
+	if (compat_index.fdt == fdt &&
+	    compat_index.size_dt_struct == fdt_size_dt_struct(fdt))
+		return !compat_index.failed;
+
+	/* A failed build is not retried until the FDT changes */
+	fdt_compat_index_free();
+	compat_index.fdt = fdt;
+	compat_index.size_dt_struct = fdt_size_dt_struct(fdt);
+	compat_index.failed = true;
+
+	for (nodeoff = fdt_next_node(fdt, -1, NULL); nodeoff >= 0;
+	     nodeoff = fdt_next_node(fdt, nodeoff, NULL)) {
+		prop = fdt_getprop_cached(fdt, nodeoff, "compatible", &len);
+		if (!prop || len <= 0)
+			continue;
+		nodes++;
+		for (pos = 0; pos < len;
+		     pos += sbi_strnlen(&prop[pos], len - pos) + 1)
+			keys++;
+	}
+	if (!keys)
+		return false;
+
+	compat_index.nodes = sbi_malloc(nodes * sizeof(*compat_index.nodes));
+	compat_index.keys = sbi_malloc(keys * sizeof(*compat_index.keys));
+	if (!compat_index.nodes || !compat_index.keys) {
+		if (compat_index.nodes)
+			sbi_free(compat_index.nodes);
+		if (compat_index.keys)
+			sbi_free(compat_index.keys);
+		compat_index.nodes = NULL;
+		compat_index.keys = NULL;
+		return false;
+	}
+
+	for (nodeoff = fdt_next_node(fdt, -1, NULL); nodeoff >= 0;
+	     nodeoff = fdt_next_node(fdt, nodeoff, NULL)) {
+		prop = fdt_getprop_cached(fdt, nodeoff, "compatible", &len);
+		if (!prop || len <= 0)
+			continue;
+		compat_index.nodes[compat_index.nr_nodes] = nodeoff;
+		for (pos = 0; pos < len;
+		     pos += sbi_strnlen(&prop[pos], len - pos) + 1)
+			compat_index.keys[compat_index.nr_keys++] =
+				((u64)compat_hash(&prop[pos], len - pos) << 32) |
+				compat_index.nr_nodes;
+		compat_index.nr_nodes++;
+	}
+	fdt_keys_sort(compat_index.keys, compat_index.nr_keys);
+	compat_index.failed = false;
+
+	return true;
+}
+
+/* Number of the first indexed node with an offset above nodeoff */
+static u32 compat_index_node_after(int nodeoff)
+{
+	u32 lo = 0, hi = compat_index.nr_nodes, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (compat_index.nodes[mid] <= nodeoff)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Number of the first node from the given one with a compatible string */
+static u32 compat_index_find(const void *fdt, u32 from, const char *compat)
+{
+	u64 key = (u64)compat_hash(compat, -1UL) << 32, want = key | from;
+	u32 lo = 0, hi = compat_index.nr_keys, mid, node;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (compat_index.keys[mid] < want)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	/* Hash collisions are told apart by checking the node itself */
+	for (; lo < compat_index.nr_keys &&
+	       (compat_index.keys[lo] >> 32) == (key >> 32); lo++) {
+		node = (u32)compat_index.keys[lo];
+		if (!fdt_node_check_compatible(fdt, compat_index.nodes[node],
+					       compat))
+			return node;
+	}
+
+	return compat_index.nr_nodes;
+}
+
+bool fdt_compat_index_ready(const void *fdt)
+{
+	return fdt ? compat_index_get(fdt) : false;
 }
 
 int fdt_find_match(const void *fdt, int startoff,
 		   const struct fdt_match *match_table,
 		   const struct fdt_match **out_match)
 {
+	const struct fdt_match *match = NULL;
+	u32 from, node, best;
 	int nodeoff;
 
 	if (!fdt || !match_table)
 		return SBI_ENODEV;
 
-	while (match_table->compatible) {
-		nodeoff = fdt_node_offset_by_compatible(fdt, startoff,
-						match_table->compatible);
-		if (nodeoff >= 0) {
-			if (out_match)
-				*out_match = match_table;
-			return nodeoff;
+	if (compat_index_get(fdt)) {
+		from = compat_index_node_after(startoff);
+		best = compat_index.nr_nodes;
+		for (match = match_table; match->compatible; match++) {
+			node = compat_index_find(fdt, from, match->compatible);
+			if (node < best)
+				best = node;
+		}
+		if (best == compat_index.nr_nodes)
+			return SBI_ENODEV;
+		nodeoff = compat_index.nodes[best];
+		match = fdt_match_node(fdt, nodeoff, match_table);
+	} else {
+		for (nodeoff = fdt_next_node(fdt, startoff, NULL);
+		     nodeoff >= 0;
+		     nodeoff = fdt_next_node(fdt, nodeoff, NULL)) {
+			match = fdt_match_node(fdt, nodeoff, match_table);
+			if (match)
+				break;
 		}
-		match_table++;
+		if (nodeoff < 0)
+			return SBI_ENODEV;
 	}
 
-	return SBI_ENODEV;
+	if (out_match)
+		*out_match = match;
+
+	return nodeoff;
+}
+
+/*
+ * Cache of the offsets of all nodes with a phandle. Every key holds the
+ * phandle in the upper half and the node offset in the lower half so
+ * sorted keys resolve a phandle with a binary search. Like the
+ * compatible index it is rebuilt when the structure block changes size,
+ * and a cached offset is checked against the node it points at so
+ * in-place edits such as fdt_nop_node() cannot return a stale node.
+ */
+static struct {
+	const void *fdt;
+	u32 size_dt_struct;
+	bool failed;
+	u32 nr_keys;
+	u64 *keys;
+} phandle_cache;
+
+void fdt_phandle_cache_free(void)
+{
+	if (phandle_cache.keys)
+		sbi_free(phandle_cache.keys);
+	sbi_memset(&phandle_cache, 0, sizeof(phandle_cache));
+}
+
+static bool phandle_cache_get(const void *fdt)
+{
+	u32 keys = 0, phandle;
+	int nodeoff;
+
+	if (phandle_cache.fdt == fdt &&
+	    phandle_cache.size_dt_struct == fdt_size_dt_struct(fdt))
+		return !phandle_cache.failed;
+
+	/* A failed build is not retried until the FDT changes */
+	fdt_phandle_cache_free();
+	phandle_cache.fdt = fdt;
+	phandle_cache.size_dt_struct = fdt_size_dt_struct(fdt);
+	phandle_cache.failed = true;
+
+	for (nodeoff = fdt_next_node(fdt, -1, NULL); nodeoff >= 0;
+	     nodeoff = fdt_next_node(fdt, nodeoff, NULL)) {
+		phandle = fdt_get_phandle(fdt, nodeoff);
+		if (phandle && phandle != (u32)-1)
+			keys++;
+	}
+	if (!keys)
+		return false;
+
+	phandle_cache.keys = sbi_malloc(keys * sizeof(*phandle_cache.keys));
+	if (!phandle_cache.keys)
+		return false;
+
+	for (nodeoff = fdt_next_node(fdt, -1, NULL); nodeoff >= 0;
+	     nodeoff = fdt_next_node(fdt, nodeoff, NULL)) {
+		phandle = fdt_get_phandle(fdt, nodeoff);
+		if (phandle && phandle != (u32)-1)
+			phandle_cache.keys[phandle_cache.nr_keys++] =
+				((u64)phandle << 32) | (u32)nodeoff;
+	}
+	fdt_keys_sort(phandle_cache.keys, phandle_cache.nr_keys);
+	phandle_cache.failed = false;
+
+	return true;
+}
+
+int fdt_phandle_offset(const void *fdt, u32 phandle)
+{
+	u32 lo, hi, mid;
+	int nodeoff;
+
+	if (!fdt || !phandle || phandle == (u32)-1)
+		return -FDT_ERR_BADPHANDLE;
+
+	if (!phandle_cache_get(fdt))
+		return fdt_node_offset_by_phandle(fdt, phandle);
+
+	lo = 0;
+	hi = phandle_cache.nr_keys;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((phandle_cache.keys[mid] >> 32) < phandle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == phandle_cache.nr_keys ||
+	    (phandle_cache.keys[lo] >> 32) != phandle)
+		return -FDT_ERR_NOTFOUND;
+
+	nodeoff = (int)(u32)phandle_cache.keys[lo];
+	if (fdt_get_phandle(fdt, nodeoff) != phandle) {
+		/* The tree was edited in place so resolve it the slow way */
+		fdt_phandle_cache_free();
+		return fdt_node_offset_by_phandle(fdt, phandle);
+	}
+
+	return nodeoff;
 }
 
 int fdt_parse_phandle_with_args(const void *fdt, int nodeoff,
@@ -92,8 +557,7 @@ int fdt_parse_phandle_with_args(const void *fdt, int nodeoff,
 	list_end = list + (len / sizeof(*list));
 
 	while (list < list_end) {
-		pnodeoff = fdt_node_offset_by_phandle(fdt,
-						fdt32_to_cpu(*list));
+		pnodeoff = fdt_phandle_offset(fdt, fdt32_to_cpu(*list));
 		if (pnodeoff < 0)
 			return pnodeoff;
 		list++;
@@ -182,7 +646,7 @@ int fdt_get_node_addr_size(const void *fdt, int node, int index,
 	if (cell_size < 0)
 		return SBI_ENODEV;
 
-	prop_addr = fdt_getprop(fdt, node, "reg", &len);
+	prop_addr = fdt_getprop_cached(fdt, node, "reg", &len);
 	if (!prop_addr)
 		return SBI_ENODEV;
 
@@ -247,7 +711,7 @@ bool fdt_node_is_enabled(const void *fdt, int nodeoff)
 	int len;
 	const void *prop;
 
-	prop = fdt_getprop(fdt, nodeoff, "status", &len);
+	prop = fdt_getprop_cached(fdt, nodeoff, "status", &len);
 	if (!prop)
 		return true;
 
@@ -288,32 +752,219 @@ int fdt_parse_hart_id(const void *fdt, int cpu_offset, u32 *hartid)
 	return 0;
 }
 
-int fdt_parse_max_enabled_hart_id(const void *fdt, u32 *max_hartid)
+/*
+ * Table of the CPU nodes in DT order with what the boot code looks up
+ * in them, plus keys of the HART id and of the interrupt controller
+ * phandle in the upper half and the table index in the lower half for
+ * binary searches. Like the phandle cache it is rebuilt when the FDT
+ * moves or its structure block changes size.
+ */
+static struct {
+	const void *fdt;
+	u32 off_dt_struct;
+	u32 size_dt_struct;
+	bool failed;
+	u32 count;
+	struct fdt_cpu *cpus;
+	u64 *hartid_keys;
+	u64 *intc_keys;
+	u32 nr_intc_keys;
+} cpu_table;
+
+void fdt_cpu_table_free(void)
 {
-	u32 hartid;
-	int err, cpu_offset, cpus_offset;
+	if (cpu_table.cpus)
+		sbi_free(cpu_table.cpus);
+	if (cpu_table.hartid_keys)
+		sbi_free(cpu_table.hartid_keys);
+	if (cpu_table.intc_keys)
+		sbi_free(cpu_table.intc_keys);
+	sbi_memset(&cpu_table, 0, sizeof(cpu_table));
+}
 
-	if (!fdt)
-		return SBI_EINVAL;
-	if (!max_hartid)
-		return 0;
+static void fdt_cpu_parse(const void *fdt, int cpu_offset, u32 hartid,
+			  struct fdt_cpu *cpu)
+{
+	int child, len;
 
-	*max_hartid = 0;
+	cpu->offset = cpu_offset;
+	cpu->hartid = hartid;
+	cpu->enabled = fdt_node_is_enabled(fdt, cpu_offset);
+
+	cpu->intc_phandle = 0;
+	fdt_for_each_subnode(child, fdt, cpu_offset) {
+		if (fdt_getprop(fdt, child, "interrupt-controller", NULL)) {
+			cpu->intc_phandle = fdt_get_phandle(fdt, child);
+			break;
+		}
+	}
+
+	cpu->isa_is_list = true;
+	cpu->isa = fdt_getprop(fdt, cpu_offset, "riscv,isa-extensions", &len);
+	if (!cpu->isa || len <= 0) {
+		cpu->isa_is_list = false;
+		cpu->isa = fdt_getprop(fdt, cpu_offset, "riscv,isa", &len);
+	}
+	cpu->isa_len = (cpu->isa && len > 0) ? len : 0;
+	if (!cpu->isa_len)
+		cpu->isa = NULL;
+}
+
+static bool cpu_table_get(const void *fdt)
+{
+	int cpus_offset, cpu_offset;
+	struct fdt_cpu *cpu;
+	u32 i, count = 0;
+
+	if (cpu_table.fdt == fdt &&
+	    cpu_table.off_dt_struct == fdt_off_dt_struct(fdt) &&
+	    cpu_table.size_dt_struct == fdt_size_dt_struct(fdt))
+		return !cpu_table.failed;
+
+	/* A tree without CPU nodes is not walked again until it changes */
+	fdt_cpu_table_free();
+	cpu_table.fdt = fdt;
+	cpu_table.off_dt_struct = fdt_off_dt_struct(fdt);
+	cpu_table.size_dt_struct = fdt_size_dt_struct(fdt);
+	cpu_table.failed = true;
 
 	cpus_offset = fdt_path_offset(fdt, "/cpus");
 	if (cpus_offset < 0)
-		return cpus_offset;
+		return false;
 
 	fdt_for_each_subnode(cpu_offset, fdt, cpus_offset) {
-		err = fdt_parse_hart_id(fdt, cpu_offset, &hartid);
-		if (err)
-			continue;
+		if (!fdt_parse_hart_id(fdt, cpu_offset, NULL))
+			count++;
+	}
+	if (!count)
+		return false;
+
+	cpu_table.cpus = sbi_malloc(count * sizeof(*cpu_table.cpus));
+	cpu_table.hartid_keys = sbi_malloc(count *
+					   sizeof(*cpu_table.hartid_keys));
+	cpu_table.intc_keys = sbi_malloc(count * sizeof(*cpu_table.intc_keys));
+	if (!cpu_table.cpus || !cpu_table.hartid_keys ||
+	    !cpu_table.intc_keys) {
+		/* Retried on the next lookup, e.g. once the heap is set up */
+		fdt_cpu_table_free();
+		return false;
+	}
 
-		if (!fdt_node_is_enabled(fdt, cpu_offset))
+	fdt_for_each_subnode(cpu_offset, fdt, cpus_offset) {
+		cpu = &cpu_table.cpus[cpu_table.count];
+		if (fdt_parse_hart_id(fdt, cpu_offset, &cpu->hartid))
 			continue;
 
-		if (hartid > *max_hartid)
-			*max_hartid = hartid;
+		fdt_cpu_parse(fdt, cpu_offset, cpu->hartid, cpu);
+		cpu_table.count++;
+	}
+
+	for (i = 0; i < cpu_table.count; i++) {
+		cpu = &cpu_table.cpus[i];
+		cpu_table.hartid_keys[i] = ((u64)cpu->hartid << 32) | i;
+		if (cpu->intc_phandle && cpu->intc_phandle != (u32)-1)
+			cpu_table.intc_keys[cpu_table.nr_intc_keys++] =
+				((u64)cpu->intc_phandle << 32) | i;
+	}
+	fdt_keys_sort(cpu_table.hartid_keys, cpu_table.count);
+	fdt_keys_sort(cpu_table.intc_keys, cpu_table.nr_intc_keys);
+	cpu_table.failed = false;
+
+	return true;
+}
+
+const struct fdt_cpu *fdt_cpu_table(const void *fdt, u32 *count)
+{
+	if (!fdt || !cpu_table_get(fdt)) {
+		if (count)
+			*count = 0;
+		return NULL;
+	}
+
+	if (count)
+		*count = cpu_table.count;
+	return cpu_table.cpus;
+}
+
+static const struct fdt_cpu *cpu_table_search(const u64 *keys, u32 nr_keys,
+					      u32 key)
+{
+	u32 lo = 0, hi = nr_keys, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((keys[mid] >> 32) < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == nr_keys || (keys[lo] >> 32) != key)
+		return NULL;
+
+	return &cpu_table.cpus[(u32)keys[lo]];
+}
+
+const struct fdt_cpu *fdt_cpu_find_hartid(const void *fdt, u32 hartid)
+{
+	if (!fdt || !cpu_table_get(fdt))
+		return NULL;
+
+	return cpu_table_search(cpu_table.hartid_keys, cpu_table.count,
+				hartid);
+}
+
+/*
+ * Returns SBI_ENOENT if no node has the phandle and SBI_EINVAL if it is
+ * not the interrupt controller of a CPU.
+ */
+int fdt_parse_intc_hartid(const void *fdt, u32 intc_phandle, u32 *hartid)
+{
+	const struct fdt_cpu *cpu;
+	int cpu_intc_offset, cpu_offset;
+
+	if (!fdt || !hartid)
+		return SBI_EINVAL;
+
+	if (cpu_table_get(fdt)) {
+		cpu = cpu_table_search(cpu_table.intc_keys,
+				       cpu_table.nr_intc_keys, intc_phandle);
+		if (!cpu)
+			return (fdt_phandle_offset(fdt, intc_phandle) < 0) ?
+				SBI_ENOENT : SBI_EINVAL;
+		*hartid = cpu->hartid;
+		return 0;
+	}
+
+	cpu_intc_offset = fdt_phandle_offset(fdt, intc_phandle);
+	if (cpu_intc_offset < 0)
+		return SBI_ENOENT;
+
+	cpu_offset = fdt_parent_offset(fdt, cpu_intc_offset);
+	if (cpu_offset < 0)
+		return SBI_ENOENT;
+
+	return fdt_parse_hart_id(fdt, cpu_offset, hartid);
+}
+
+int fdt_parse_max_enabled_hart_id(const void *fdt, u32 *max_hartid)
+{
+	const struct fdt_cpu *cpus;
+	u32 i, count;
+
+	if (!fdt)
+		return SBI_EINVAL;
+	if (!max_hartid)
+		return 0;
+
+	*max_hartid = 0;
+
+	cpus = fdt_cpu_table(fdt, &count);
+	if (!cpus)
+		return SBI_ENOENT;
+
+	for (i = 0; i < count; i++) {
+		if (cpus[i].enabled && cpus[i].hartid > *max_hartid)
+			*max_hartid = cpus[i].hartid;
 	}
 
 	return 0;
@@ -340,14 +991,120 @@ int fdt_parse_timebase_frequency(const void *fdt, unsigned long *freq)
 	return 0;
 }
 
+int fdt_parse_tlbr_flush_limit(const void *fdt, u32 hartid,
+			       unsigned long *limit)
+{
+	const struct fdt_cpu *cpu;
+	const fdt32_t *val;
+	int len;
+
+	if (!fdt || !limit)
+		return SBI_EINVAL;
+
+	cpu = fdt_cpu_find_hartid(fdt, hartid);
+	if (!cpu)
+		return SBI_ENOENT;
+
+	val = fdt_getprop(fdt, cpu->offset, "opensbi,tlb-range-flush-limit",
+			  &len);
+	if (len > 0 && val) {
+		*limit = fdt32_to_cpu(*val);
+		return 0;
+	}
+
+	return SBI_ENOENT;
+}
+
+int fdt_parse_cboz_block_size(const void *fdt, u32 hartid, u32 *size)
+{
+	const struct fdt_cpu *cpu;
+	const fdt32_t *val;
+	int len;
+
+	if (!fdt || !size)
+		return SBI_EINVAL;
+
+	cpu = fdt_cpu_find_hartid(fdt, hartid);
+	if (!cpu)
+		return SBI_ENOENT;
+
+	val = fdt_getprop(fdt, cpu->offset, "riscv,cboz-block-size", &len);
+	if (len > 0 && val) {
+		*size = fdt32_to_cpu(*val);
+		return 0;
+	}
+
+	return SBI_ENOENT;
+}
+
 #define RISCV_ISA_EXT_NAME_LEN_MAX	32
 
-static unsigned long fdt_isa_bitmap_offset;
+/* Distinct ISA properties remembered while parsing all HARTs */
+#define FDT_ISA_CACHE_ENTRIES		8
+
+struct fdt_isa_cache_entry {
+	const char *prop;
+	int len;
+	bool is_list;
+	unsigned long *exts;
+};
+
+static unsigned long fdt_hart_desc_offset;
+
+/* Indices of sbi_hart_ext[] sorted by extension name */
+static u8 isa_ext_order[SBI_HART_EXT_MAX];
+static bool isa_ext_order_ready;
+
+static int isa_ext_name_cmp(const char *name, const char *str, size_t len)
+{
+	int rc = strncmp(name, str, len);
+
+	return rc ? rc : (unsigned char)name[len];
+}
+
+static void isa_ext_order_init(void)
+{
+	int i, j;
+	u8 tmp;
+
+	if (isa_ext_order_ready)
+		return;
+
+	for (i = 0; i < SBI_HART_EXT_MAX; i++) {
+		tmp = i;
+		for (j = i; j > 0 &&
+		     strcmp(sbi_hart_ext[isa_ext_order[j - 1]].name,
+			    sbi_hart_ext[tmp].name) > 0; j--)
+			isa_ext_order[j] = isa_ext_order[j - 1];
+		isa_ext_order[j] = tmp;
+	}
+	isa_ext_order_ready = true;
+}
+
+/* Set the bit of the extension named by the first len bytes of str */
+static void isa_ext_set(const char *str, size_t len, unsigned long *extensions)
+{
+	int lo = 0, hi = SBI_HART_EXT_MAX, mid, rc;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		rc = isa_ext_name_cmp(sbi_hart_ext[isa_ext_order[mid]].name,
+				      str, len);
+		if (!rc) {
+			__set_bit(sbi_hart_ext[isa_ext_order[mid]].id,
+				  extensions);
+			return;
+		}
+		if (rc < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+}
 
 static int fdt_parse_isa_one_hart(const char *isa, unsigned long *extensions)
 {
 	size_t i, j, isa_len;
-	char mstr[RISCV_ISA_EXT_NAME_LEN_MAX];
 
 	i = 0;
 	isa_len = strlen(isa);
@@ -384,28 +1141,14 @@ static int fdt_parse_isa_one_hart(const char *isa, unsigned long *extensions)
 		/* Skip the '_' character */
 		i++;
 
-		/* Extract the multi-letter extension name */
-		j = 0;
-		while ((i < isa_len) && (isa[i] != '_') &&
-		       (j < (sizeof(mstr) - 1)))
-			mstr[j++] = isa[i++];
-		mstr[j] = '\0';
-
-		/* Skip empty multi-letter extension name */
-		if (!j)
-			continue;
-
-#define set_multi_letter_ext(name, bit)				\
-			if (!strcmp(mstr, name)) {		\
-				__set_bit(bit, extensions);	\
-				continue;			\
-			}
+		/* Find the end of the multi-letter extension name */
+		for (j = i; j < isa_len && isa[j] != '_'; j++)
+			;
 
-		for (j = 0; j < SBI_HART_EXT_MAX; j++) {
-			set_multi_letter_ext(sbi_hart_ext[j].name,
-					     sbi_hart_ext[j].id);
-		}
-#undef set_multi_letter_ext
+		/* Skip empty and overlong multi-letter extension names */
+		if (j > i && (j - i) < RISCV_ISA_EXT_NAME_LEN_MAX)
+			isa_ext_set(&isa[i], j - i, extensions);
+		i = j;
 	}
 
 	return 0;
@@ -415,90 +1158,209 @@ static void fdt_parse_isa_extensions_one_hart(const char *isa,
 					      unsigned long *extensions,
 					      int len)
 {
-	size_t i;
+	int pos, slen;
 
-	for (i = 0; i < SBI_HART_EXT_MAX; i++) {
-		if (fdt_stringlist_contains(isa, len, sbi_hart_ext[i].name))
-			__set_bit(sbi_hart_ext[i].id, extensions);
+	for (pos = 0; pos < len; pos += slen + 1) {
+		slen = strnlen(&isa[pos], len - pos);
+		if (slen)
+			isa_ext_set(&isa[pos], slen, extensions);
 	}
 }
 
-static int fdt_parse_isa_all_harts(const void *fdt)
+static int fdt_parse_hart_desc_all(const void *fdt)
 {
-	u32 hartid;
-	const fdt32_t *val;
+	const char *val;
 	unsigned long *hart_exts;
+	struct fdt_hart_desc *desc;
 	struct sbi_scratch *scratch;
-	int err, cpu_offset, cpus_offset, len;
+	const struct fdt_cpu *cpus, *cpu;
+	struct fdt_isa_cache_entry cache[FDT_ISA_CACHE_ENTRIES], *ent;
+	int i, err, cpu_offset, len, cached = 0;
+	u32 c, count;
+	bool is_list;
 
-	if (!fdt || !fdt_isa_bitmap_offset)
+	if (!fdt || !fdt_hart_desc_offset)
 		return SBI_EINVAL;
 
-	cpus_offset = fdt_path_offset(fdt, "/cpus");
-	if (cpus_offset < 0)
-		return cpus_offset;
+	cpus = fdt_cpu_table(fdt, &count);
+	if (!cpus)
+		return SBI_ENOENT;
 
-	fdt_for_each_subnode(cpu_offset, fdt, cpus_offset) {
-		err = fdt_parse_hart_id(fdt, cpu_offset, &hartid);
-		if (err)
-			continue;
+	isa_ext_order_init();
 
-		if (!fdt_node_is_enabled(fdt, cpu_offset))
+	for (c = 0; c < count; c++) {
+		cpu = &cpus[c];
+		if (!cpu->enabled)
 			continue;
 
-		scratch = sbi_hartid_to_scratch(hartid);
+		cpu_offset = cpu->offset;
+		scratch = sbi_hartid_to_scratch(cpu->hartid);
 		if (!scratch)
 			return SBI_ENOENT;
 
-		hart_exts = sbi_scratch_offset_ptr(scratch,
-						   fdt_isa_bitmap_offset);
+		desc = sbi_scratch_offset_ptr(scratch, fdt_hart_desc_offset);
+		hart_exts = desc->extensions;
 
-		val = fdt_getprop(fdt, cpu_offset, "riscv,isa-extensions", &len);
+		val = fdt_getprop(fdt, cpu_offset, "riscv,cboz-block-size",
+				  &len);
 		if (val && len > 0) {
-			fdt_parse_isa_extensions_one_hart((const char *)val,
-							  hart_exts, len);
-			continue;
+			desc->cboz_block_size = fdt32_to_cpu(*(fdt32_t *)val);
+			desc->flags |= FDT_HART_DESC_CBOZ_BLOCK_SIZE;
+		}
+
+		val = fdt_getprop(fdt, cpu_offset, "riscv,cbom-block-size",
+				  &len);
+		if (val && len > 0) {
+			desc->cbom_block_size = fdt32_to_cpu(*(fdt32_t *)val);
+			desc->flags |= FDT_HART_DESC_CBOM_BLOCK_SIZE;
+		}
+
+		val = fdt_getprop(fdt, cpu_offset,
+				  "opensbi,tlb-range-flush-limit", &len);
+		if (val && len > 0) {
+			desc->tlbr_flush_limit = fdt32_to_cpu(*(fdt32_t *)val);
+			desc->flags |= FDT_HART_DESC_TLBR_FLUSH_LIMIT;
 		}
 
-		val = fdt_getprop(fdt, cpu_offset, "riscv,isa", &len);
-		if (!val || len <= 0)
+		is_list = cpu->isa_is_list;
+		val = cpu->isa;
+		len = cpu->isa_len;
+		if (!val)
 			return SBI_ENOENT;
 
-		err = fdt_parse_isa_one_hart((const char *)val, hart_exts);
-		if (err)
-			return err;
+		/*
+		 * HARTs of the same type carry identical properties so
+		 * every distinct one is parsed only once and the bitmap
+		 * of the first HART which had it is copied.
+		 */
+		for (i = 0; i < cached; i++) {
+			ent = &cache[i];
+			if (ent->is_list == is_list && ent->len == len &&
+			    !memcmp(ent->prop, val, len))
+				break;
+		}
+		if (i < cached) {
+			for (i = 0; i < BITS_TO_LONGS(SBI_HART_EXT_MAX); i++)
+				hart_exts[i] |= ent->exts[i];
+			continue;
+		}
+
+		if (is_list) {
+			fdt_parse_isa_extensions_one_hart(val, hart_exts, len);
+		} else {
+			err = fdt_parse_isa_one_hart(val, hart_exts);
+			if (err)
+				return err;
+		}
+
+		if (cached < FDT_ISA_CACHE_ENTRIES) {
+			ent = &cache[cached++];
+			ent->prop = val;
+			ent->len = len;
+			ent->is_list = is_list;
+			ent->exts = hart_exts;
+		}
 	}
 
 	return 0;
 }
 
-int fdt_parse_isa_extensions(const void *fdt, unsigned int hartid,
-			unsigned long *extensions)
+int fdt_hart_desc_init(const void *fdt)
 {
-	int rc, i;
-	unsigned long *hart_exts;
-	struct sbi_scratch *scratch;
+	if (fdt_hart_desc_offset)
+		return 0;
 
-	if (!fdt_isa_bitmap_offset) {
-		fdt_isa_bitmap_offset = sbi_scratch_alloc_offset(
-					sizeof(*hart_exts) *
-					BITS_TO_LONGS(SBI_HART_EXT_MAX));
-		if (!fdt_isa_bitmap_offset)
-			return SBI_ENOMEM;
+	fdt_hart_desc_offset = sbi_scratch_alloc_type_offset(
+						struct fdt_hart_desc);
+	if (!fdt_hart_desc_offset)
+		return SBI_ENOMEM;
 
-		rc = fdt_parse_isa_all_harts(fdt);
-		if (rc)
-			return rc;
-	}
+	return fdt_parse_hart_desc_all(fdt);
+}
+
+const struct fdt_hart_desc *fdt_hart_desc_get(u32 hartid)
+{
+	struct sbi_scratch *scratch;
+
+	if (!fdt_hart_desc_offset)
+		return NULL;
 
 	scratch = sbi_hartid_to_scratch(hartid);
 	if (!scratch)
-		return SBI_ENOENT;
+		return NULL;
+
+	return sbi_scratch_offset_ptr(scratch, fdt_hart_desc_offset);
+}
+
+static void fdt_cpu_map_cluster(const void *fdt, int offset, u32 cluster)
+{
+	struct sbi_scratch *scratch;
+	const fdt32_t *val;
+	int child, cpu_offset, len;
+	u32 hartid;
+
+	fdt_for_each_subnode(child, fdt, offset) {
+		val = fdt_getprop(fdt, child, "cpu", &len);
+		if (!val || len < sizeof(*val)) {
+			/* Nested clusters, cores and threads */
+			fdt_cpu_map_cluster(fdt, child, cluster);
+			continue;
+		}
+
+		cpu_offset = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+		if (cpu_offset < 0 ||
+		    fdt_parse_hart_id(fdt, cpu_offset, &hartid))
+			continue;
 
-	hart_exts = sbi_scratch_offset_ptr(scratch, fdt_isa_bitmap_offset);
+		scratch = sbi_hartid_to_scratch(hartid);
+		if (scratch)
+			sbi_tlb_set_hart_cluster(scratch, cluster);
+	}
+}
+
+int fdt_cpu_map_init(const void *fdt)
+{
+	int map_offset, offset, child;
+	const char *name;
+	u32 cluster = 0;
+
+	if (!fdt)
+		return SBI_EINVAL;
+
+	map_offset = fdt_path_offset(fdt, "/cpus/cpu-map");
+	if (map_offset < 0)
+		return 0;
+
+	fdt_for_each_subnode(offset, fdt, map_offset) {
+		name = fdt_get_name(fdt, offset, NULL);
+		if (!name || strncmp(name, "socket", 6)) {
+			fdt_cpu_map_cluster(fdt, offset, cluster++);
+			continue;
+		}
+
+		fdt_for_each_subnode(child, fdt, offset)
+			fdt_cpu_map_cluster(fdt, child, cluster++);
+	}
+
+	return 0;
+}
+
+int fdt_parse_isa_extensions(const void *fdt, unsigned int hartid,
+			unsigned long *extensions)
+{
+	const struct fdt_hart_desc *desc;
+	int rc, i;
+
+	rc = fdt_hart_desc_init(fdt);
+	if (rc)
+		return rc;
+
+	desc = fdt_hart_desc_get(hartid);
+	if (!desc)
+		return SBI_ENOENT;
 
 	for (i = 0; i < BITS_TO_LONGS(SBI_HART_EXT_MAX); i++)
-		extensions[i] |= hart_exts[i];
+		extensions[i] |= desc->extensions[i];
 	return 0;
 }
 
@@ -536,6 +1398,13 @@ static int fdt_parse_uart_node_common(const void *fdt, int nodeoffset,
 	else
 		uart->baud = default_baud;
 
+	/* Zero means the driver has to probe or assume its FIFO size */
+	val = (fdt32_t *)fdt_getprop(fdt, nodeoffset, "fifo-size", &len);
+	if (len > 0 && val)
+		uart->fifo_size = fdt32_to_cpu(*val);
+	else
+		uart->fifo_size = 0;
+
 	return 0;
 }
 
@@ -664,7 +1533,7 @@ int fdt_parse_aplic_node(const void *fdt, int nodeoff, struct aplic_data *aplic)
 
 	val = fdt_getprop(fdt, nodeoff, "msi-parent", &len);
 	if (val && len >= sizeof(fdt32_t)) {
-		noff = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+		noff = fdt_phandle_offset(fdt, fdt32_to_cpu(*val));
 		if (noff < 0)
 			return noff;
 
@@ -697,7 +1566,7 @@ int fdt_parse_aplic_node(const void *fdt, int nodeoff, struct aplic_data *aplic)
 		if (!val || len < sizeof(fdt32_t))
 			goto aplic_msi_parent_done;
 
-		noff = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+		noff = fdt_phandle_offset(fdt, fdt32_to_cpu(*val));
 		if (noff < 0)
 			return noff;
 
@@ -705,7 +1574,7 @@ int fdt_parse_aplic_node(const void *fdt, int nodeoff, struct aplic_data *aplic)
 		if (!val || len < sizeof(fdt32_t))
 			goto aplic_msi_parent_done;
 
-		noff = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+		noff = fdt_phandle_offset(fdt, fdt32_to_cpu(*val));
 		if (noff < 0)
 			return noff;
 
@@ -985,7 +1854,7 @@ int fdt_parse_aclint_node(const void *fdt, int nodeoffset,
 			  u32 *out_first_hartid, u32 *out_hart_count)
 {
 	const fdt32_t *val;
-	int i, rc, count, cpu_offset, cpu_intc_offset;
+	int i, rc, count;
 	u32 phandle, hwirq, hartid, first_hartid, last_hartid, hart_count;
 	u32 match_hwirq = (for_timer) ? IRQ_M_TIMER : IRQ_M_SOFT;
 
@@ -1020,15 +1889,7 @@ int fdt_parse_aclint_node(const void *fdt, int nodeoffset,
 		phandle = fdt32_to_cpu(val[2 * i]);
 		hwirq = fdt32_to_cpu(val[(2 * i) + 1]);
 
-		cpu_intc_offset = fdt_node_offset_by_phandle(fdt, phandle);
-		if (cpu_intc_offset < 0)
-			continue;
-
-		cpu_offset = fdt_parent_offset(fdt, cpu_intc_offset);
-		if (cpu_offset < 0)
-			continue;
-
-		rc = fdt_parse_hart_id(fdt, cpu_offset, &hartid);
+		rc = fdt_parse_intc_hartid(fdt, phandle, &hartid);
 		if (rc)
 			continue;
 
@@ -1079,21 +1940,10 @@ int fdt_parse_plmt_node(const void *fdt, int nodeoffset, unsigned long *plmt_bas
 
 	hcount = 0;
 	for (i = 0; i < (count / 2); i++) {
-		int cpu_offset, cpu_intc_offset;
-
 		phandle = fdt32_to_cpu(val[2 * i]);
 		hwirq = fdt32_to_cpu(val[2 * i + 1]);
 
-		cpu_intc_offset = fdt_node_offset_by_phandle(fdt, phandle);
-		if (cpu_intc_offset < 0)
-			continue;
-
-		cpu_offset = fdt_parent_offset(fdt, cpu_intc_offset);
-		if (cpu_offset < 0)
-			continue;
-
-		rc = fdt_parse_hart_id(fdt, cpu_offset, &hartid);
-
+		rc = fdt_parse_intc_hartid(fdt, phandle, &hartid);
 		if (rc)
 			continue;
 
@@ -1135,21 +1985,10 @@ int fdt_parse_plicsw_node(const void *fdt, int nodeoffset, unsigned long *plicsw
 
 	hcount = 0;
 	for (i = 0; i < (count / 2); i++) {
-		int cpu_offset, cpu_intc_offset;
-
 		phandle = fdt32_to_cpu(val[2 * i]);
 		hwirq = fdt32_to_cpu(val[2 * i + 1]);
 
-		cpu_intc_offset = fdt_node_offset_by_phandle(fdt, phandle);
-		if (cpu_intc_offset < 0)
-			continue;
-
-		cpu_offset = fdt_parent_offset(fdt, cpu_intc_offset);
-		if (cpu_offset < 0)
-			continue;
-
-		rc = fdt_parse_hart_id(fdt, cpu_offset, &hartid);
-
+		rc = fdt_parse_intc_hartid(fdt, phandle, &hartid);
 		if (rc)
 			continue;
 
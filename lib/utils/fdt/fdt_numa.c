@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * fdt_numa.c - Flat Device Tree NUMA helper routines
+ */
+
+#include <libfdt.h>
+#include <sbi/sbi_bitops.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_math.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_numa.h>
+
+static int fdt_numa_node_id(const void *fdt, int offset, u32 *node)
+{
+	const fdt32_t *val;
+	int len;
+
+	val = fdt_getprop(fdt, offset, "numa-node-id", &len);
+	if (!val || len < sizeof(*val))
+		return SBI_ENOENT;
+
+	*node = fdt32_to_cpu(*val);
+	return (*node < SBI_HEAP_NUMA_NODES_MAX) ? 0 : SBI_EINVAL;
+}
+
+static void fdt_numa_harts_init(const void *fdt)
+{
+	struct sbi_scratch *scratch;
+	int cpus_offset, cpu_offset;
+	u32 hartid, node;
+
+	cpus_offset = fdt_path_offset(fdt, "/cpus");
+	if (cpus_offset < 0)
+		return;
+
+	fdt_for_each_subnode(cpu_offset, fdt, cpus_offset) {
+		if (fdt_parse_hart_id(fdt, cpu_offset, &hartid))
+			continue;
+		if (!fdt_node_is_enabled(fdt, cpu_offset))
+			continue;
+		if (fdt_numa_node_id(fdt, cpu_offset, &node))
+			continue;
+
+		scratch = sbi_hartid_to_scratch(hartid);
+		if (scratch)
+			sbi_heap_set_hart_node(scratch, node);
+	}
+}
+
+int fdt_numa_init(const void *fdt)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	unsigned long heap_size, nodes_done = 0;
+	uint64_t addr, size, base;
+	int mem_offset, rc;
+	u32 node;
+
+	if (!fdt)
+		return SBI_EINVAL;
+
+	fdt_numa_harts_init(fdt);
+
+	/* Power of two sized and aligned so that it takes one PMP entry */
+	heap_size = 1UL << log2roundup(CONFIG_FDT_NUMA_HEAP_SIZE * 1024);
+
+	for (mem_offset = fdt_node_offset_by_prop_value(fdt, -1, "device_type",
+						"memory", sizeof("memory"));
+	     mem_offset >= 0;
+	     mem_offset = fdt_node_offset_by_prop_value(fdt, mem_offset,
+						"device_type", "memory",
+						sizeof("memory"))) {
+		if (!fdt_node_is_enabled(fdt, mem_offset))
+			continue;
+		if (fdt_numa_node_id(fdt, mem_offset, &node))
+			continue;
+		if (nodes_done & BIT(node))
+			continue;
+		if (fdt_get_node_addr_size(fdt, mem_offset, 0, &addr, &size))
+			continue;
+
+		/* The firmware heap is already local to its node */
+		if (addr <= scratch->fw_start &&
+		    scratch->fw_start - addr < size) {
+			nodes_done |= BIT(node);
+			continue;
+		}
+
+		/* M-mode can't access memory above XLEN bits of address */
+		if (size < heap_size || (addr + size - 1) > (unsigned long)-1)
+			continue;
+
+		base = (addr + size - heap_size) & ~((uint64_t)heap_size - 1);
+		if (base < addr)
+			continue;
+
+		rc = sbi_domain_root_add_memrange(base, heap_size, heap_size,
+					SBI_DOMAIN_MEMREGION_M_READABLE |
+					SBI_DOMAIN_MEMREGION_M_WRITABLE);
+		if (rc)
+			return rc;
+
+		rc = sbi_heap_node_add(node, base, heap_size);
+		if (rc)
+			return rc;
+
+		nodes_done |= BIT(node);
+	}
+
+	return 0;
+}
@@ -21,16 +21,45 @@
 struct fdt_pmu_hw_event_select_map fdt_pmu_evt_select[FDT_PMU_HW_EVENT_MAX] = {0};
 uint32_t hw_event_count;
 
-uint64_t fdt_pmu_get_select_value(uint32_t event_idx)
+/*
+ * fdt_pmu_evt_select[] is kept sorted by event index so that the lookup
+ * done every time a counter is configured is a binary search. Entries
+ * with the same event index stay in DT order and the first one wins.
+ */
+static int fdt_pmu_evt_select_add(uint32_t eidx, uint64_t select)
 {
-	int i;
-	struct fdt_pmu_hw_event_select_map *event;
+	uint32_t i;
+
+	if (hw_event_count >= FDT_PMU_HW_EVENT_MAX)
+		return SBI_ENOSPC;
 
-	for (i = 0; i < hw_event_count; i++) {
-		event = &fdt_pmu_evt_select[i];
-		if (event->eidx == event_idx)
-			return event->select;
+	for (i = hw_event_count; i > 0; i--) {
+		if (fdt_pmu_evt_select[i - 1].eidx <= eidx)
+			break;
+		fdt_pmu_evt_select[i] = fdt_pmu_evt_select[i - 1];
 	}
+	fdt_pmu_evt_select[i].eidx = eidx;
+	fdt_pmu_evt_select[i].select = select;
+	hw_event_count++;
+
+	return 0;
+}
+
+uint64_t fdt_pmu_get_select_value(uint32_t event_idx)
+{
+	uint32_t lo = 0, hi = hw_event_count, mid;
+
+	/* Find the first entry with eidx >= event_idx */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (fdt_pmu_evt_select[mid].eidx < event_idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < hw_event_count && fdt_pmu_evt_select[lo].eidx == event_idx)
+		return fdt_pmu_evt_select[lo].select;
 
 	return 0;
 }
@@ -61,7 +90,6 @@ int fdt_pmu_setup(const void *fdt)
 	int i, pmu_offset, len, result;
 	const u32 *event_val;
 	const u32 *event_ctr_map;
-	struct fdt_pmu_hw_event_select_map *event;
 	uint64_t raw_selector, select_mask;
 	u32 event_idx_start, event_idx_end, ctr_map;
 
@@ -92,12 +120,13 @@ int fdt_pmu_setup(const void *fdt)
 	if (event_val && len >= 8) {
 		len = len / (sizeof(u32) * 3);
 		for (i = 0; i < len; i++) {
-			event = &fdt_pmu_evt_select[hw_event_count];
-			event->eidx = fdt32_to_cpu(event_val[3 * i]);
-			event->select = fdt32_to_cpu(event_val[3 * i + 1]);
-			event->select = (event->select << 32) |
+			raw_selector = fdt32_to_cpu(event_val[3 * i + 1]);
+			raw_selector = (raw_selector << 32) |
 					fdt32_to_cpu(event_val[3 * i + 2]);
-			hw_event_count++;
+			result = fdt_pmu_evt_select_add(
+				fdt32_to_cpu(event_val[3 * i]), raw_selector);
+			if (result)
+				return result;
 		}
 	}
 
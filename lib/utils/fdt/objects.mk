@@ -5,6 +5,7 @@
 #
 
 libsbiutils-objs-$(CONFIG_FDT_DOMAIN) += fdt/fdt_domain.o
+libsbiutils-objs-$(CONFIG_FDT_NUMA) += fdt/fdt_numa.o
 libsbiutils-objs-$(CONFIG_FDT_PMU) += fdt/fdt_pmu.o
 libsbiutils-objs-$(CONFIG_FDT) += fdt/fdt_helper.o
 libsbiutils-objs-$(CONFIG_FDT) += fdt/fdt_driver.o
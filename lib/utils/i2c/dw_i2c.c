@@ -60,6 +60,13 @@
 #define IC_DATA_CMD_RESTART	BIT(10)
 #define IC_INT_STATUS_STOPDET	BIT(9)
 
+#define IC_COMP_PARAM_1_TX_DEPTH_SHIFT	16
+#define IC_COMP_PARAM_1_RX_DEPTH_SHIFT	8
+#define IC_COMP_PARAM_1_DEPTH_MASK	0xff
+
+/* Number of 2us polls before giving up */
+#define DW_I2C_POLL_COUNT	(10 * 1000)
+
 static inline void dw_i2c_setreg(struct dw_i2c_adapter *adap,
 				 u8 reg, u32 value)
 {
@@ -76,7 +83,6 @@ static int dw_i2c_adapter_poll(struct dw_i2c_adapter *adap,
 			       u32 mask, u32 addr,
 			       bool inverted)
 {
-	unsigned int timeout = 10; /* msec */
 	int count = 0;
 	u32 val;
 
@@ -91,11 +97,43 @@ static int dw_i2c_adapter_poll(struct dw_i2c_adapter *adap,
 		}
 		sbi_timer_udelay(2);
 		count += 1;
-		if (count == (timeout * 1000))
+		if (count == DW_I2C_POLL_COUNT)
 			return SBI_ETIMEDOUT;
 	} while (1);
 }
 
+/* Wait for room in the TX FIFO and return the number of free entries */
+static int dw_i2c_adapter_tx_room(struct dw_i2c_adapter *adap)
+{
+	int count = 0;
+	u32 level;
+
+	do {
+		level = dw_i2c_getreg(adap, DW_IC_TXFLR);
+		if (level < adap->tx_fifo_depth)
+			return adap->tx_fifo_depth - level;
+		sbi_timer_udelay(2);
+	} while (++count < DW_I2C_POLL_COUNT);
+
+	return SBI_ETIMEDOUT;
+}
+
+/* Wait for data in the RX FIFO and return the number of entries */
+static int dw_i2c_adapter_rx_level(struct dw_i2c_adapter *adap)
+{
+	int count = 0;
+	u32 level;
+
+	do {
+		level = dw_i2c_getreg(adap, DW_IC_RXFLR);
+		if (level)
+			return level;
+		sbi_timer_udelay(2);
+	} while (++count < DW_I2C_POLL_COUNT);
+
+	return SBI_ETIMEDOUT;
+}
+
 #define dw_i2c_adapter_poll_rxrdy(adap)	\
 	dw_i2c_adapter_poll(adap, DW_I2C_STATUS_RXFIFO_NOT_EMPTY, DW_IC_STATUS, 0)
 #define dw_i2c_adapter_poll_txfifo_ready(adap)	\
@@ -115,7 +153,7 @@ static int dw_i2c_adapter_read(struct i2c_adapter *ia, u8 addr,
 {
 	struct dw_i2c_adapter *adap =
 		container_of(ia, struct dw_i2c_adapter, adapter);
-	int rc;
+	int rc, count, pending, issued = 0, received = 0;
 
 	dw_i2c_write_addr(adap, addr);
 
@@ -126,21 +164,36 @@ static int dw_i2c_adapter_read(struct i2c_adapter *ia, u8 addr,
 	/* set register address */
 	dw_i2c_setreg(adap, DW_IC_DATA_CMD, reg);
 
-	/* set value */
-	while (len) {
-		if (len == 1)
-			dw_i2c_setreg(adap, DW_IC_DATA_CMD,
-				      IC_DATA_CMD_READ | IC_DATA_CMD_STOP);
-		else
-			dw_i2c_setreg(adap, DW_IC_DATA_CMD, IC_DATA_CMD_READ);
-
-		rc = dw_i2c_adapter_poll_rxrdy(adap);
-		if (rc)
+	/*
+	 * Queue as many read commands as the FIFOs take and drain the
+	 * RX FIFO a level at a time. No more reads than the RX FIFO
+	 * holds are outstanding so it can't overflow.
+	 */
+	while (received < len) {
+		pending = issued - received;
+		if (issued < len && pending < adap->rx_fifo_depth) {
+			rc = dw_i2c_adapter_tx_room(adap);
+			if (rc < 0)
+				return rc;
+
+			count = MIN(rc, len - issued);
+			count = MIN(count, adap->rx_fifo_depth - pending);
+			while (count--) {
+				issued++;
+				dw_i2c_setreg(adap, DW_IC_DATA_CMD,
+					      issued == len ?
+					      IC_DATA_CMD_READ | IC_DATA_CMD_STOP :
+					      IC_DATA_CMD_READ);
+			}
+		}
+
+		rc = dw_i2c_adapter_rx_level(adap);
+		if (rc < 0)
 			return rc;
 
-		*buffer = dw_i2c_getreg(adap, DW_IC_DATA_CMD) & 0xff;
-		buffer++;
-		len--;
+		for (count = rc; count && received < len; count--)
+			buffer[received++] =
+				dw_i2c_getreg(adap, DW_IC_DATA_CMD) & 0xff;
 	}
 
 	return 0;
@@ -151,7 +204,7 @@ static int dw_i2c_adapter_write(struct i2c_adapter *ia, u8 addr,
 {
 	struct dw_i2c_adapter *adap =
 		container_of(ia, struct dw_i2c_adapter, adapter);
-	int rc;
+	int rc, count;
 
 	dw_i2c_write_addr(adap, addr);
 
@@ -162,18 +215,22 @@ static int dw_i2c_adapter_write(struct i2c_adapter *ia, u8 addr,
 	/* set register address */
 	dw_i2c_setreg(adap, DW_IC_DATA_CMD, reg);
 
+	/* Fill whatever room the TX FIFO has at once */
 	while (len) {
-		rc = dw_i2c_adapter_poll_txfifo_ready(adap);
-		if (rc)
+		rc = dw_i2c_adapter_tx_room(adap);
+		if (rc < 0)
 			return rc;
 
-		if (len == 1)
-			dw_i2c_setreg(adap, DW_IC_DATA_CMD, *buffer | IC_DATA_CMD_STOP);
-		else
-			dw_i2c_setreg(adap, DW_IC_DATA_CMD, *buffer);
+		for (count = rc; count && len; count--) {
+			if (len == 1)
+				dw_i2c_setreg(adap, DW_IC_DATA_CMD,
+					      *buffer | IC_DATA_CMD_STOP);
+			else
+				dw_i2c_setreg(adap, DW_IC_DATA_CMD, *buffer);
 
-		buffer++;
-		len--;
+			buffer++;
+			len--;
+		}
 	}
 	rc = dw_i2c_adapter_poll_txfifo_ready(adap);
 
@@ -182,6 +239,16 @@ static int dw_i2c_adapter_write(struct i2c_adapter *ia, u8 addr,
 
 int dw_i2c_init(struct i2c_adapter *adapter, int nodeoff)
 {
+	struct dw_i2c_adapter *adap =
+		container_of(adapter, struct dw_i2c_adapter, adapter);
+	u32 param = dw_i2c_getreg(adap, DW_IC_COMP_PARAM_1);
+
+	/* The parameter register reads as zero when it is not present */
+	adap->tx_fifo_depth = ((param >> IC_COMP_PARAM_1_TX_DEPTH_SHIFT) &
+			       IC_COMP_PARAM_1_DEPTH_MASK) + 1;
+	adap->rx_fifo_depth = ((param >> IC_COMP_PARAM_1_RX_DEPTH_SHIFT) &
+			       IC_COMP_PARAM_1_DEPTH_MASK) + 1;
+
 	adapter->id = nodeoff;
 	adapter->write = dw_i2c_adapter_write;
 	adapter->read = dw_i2c_adapter_read;
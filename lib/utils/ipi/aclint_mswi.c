@@ -12,6 +12,7 @@
 #include <sbi/riscv_io.h>
 #include <sbi/sbi_domain.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_timer.h>
@@ -45,6 +46,31 @@ static void mswi_ipi_send(u32 hart_index)
 			mswi->first_hartid]);
 }
 
+static void mswi_ipi_send_mask(const struct sbi_hartmask *mask)
+{
+	u32 i, hartid;
+	u32 *msip = NULL;
+	struct sbi_scratch *scratch;
+	struct aclint_mswi_data *mswi = NULL;
+
+	sbi_hartmask_for_each_hartindex(i, mask) {
+		hartid = sbi_hartindex_to_hartid(i);
+
+		/* Only look up the MSWI again when leaving its HART range */
+		if (!mswi || hartid < mswi->first_hartid ||
+		    hartid - mswi->first_hartid >= mswi->hart_count) {
+			scratch = sbi_hartindex_to_scratch(i);
+			mswi = scratch ? mswi_get_hart_data_ptr(scratch) : NULL;
+			if (!mswi)
+				continue;
+			msip = (void *)mswi->addr;
+		}
+
+		/* Set ACLINT IPI */
+		writel_relaxed(1, &msip[hartid - mswi->first_hartid]);
+	}
+}
+
 static void mswi_ipi_clear(void)
 {
 	u32 *msip;
@@ -63,6 +89,7 @@ static void mswi_ipi_clear(void)
 static struct sbi_ipi_device aclint_mswi = {
 	.name = "aclint-mswi",
 	.ipi_send = mswi_ipi_send,
+	.ipi_send_mask = mswi_ipi_send_mask,
 	.ipi_clear = mswi_ipi_clear
 };
 
@@ -80,7 +107,7 @@ int aclint_mswi_cold_init(struct aclint_mswi_data *mswi)
 
 	/* Allocate scratch space pointer */
 	if (!mswi_ptr_offset) {
-		mswi_ptr_offset = sbi_scratch_alloc_type_offset(void *);
+		mswi_ptr_offset = sbi_scratch_alloc_hot_offset(sizeof(void *));
 		if (!mswi_ptr_offset)
 			return SBI_ENOMEM;
 	}
@@ -13,6 +13,7 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/riscv_io.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_ipi.h>
 #include <sbi_utils/ipi/andes_plicsw.h>
 
@@ -41,6 +42,33 @@ static void plicsw_ipi_send(u32 hart_index)
 	writel_relaxed(BIT(pending_bit), (void *)pending_reg);
 }
 
+static void plicsw_ipi_send_mask(const struct sbi_hartmask *mask)
+{
+	u32 i, interrupt_id, word_index, curr_index = -1U;
+	u32 pending = 0;
+
+	/* Set the pending bits of all target harts of a word at once */
+	sbi_hartmask_for_each_hartindex(i, mask) {
+		interrupt_id = sbi_hartindex_to_hartid(i) + 1;
+		if (plicsw.hart_count < interrupt_id)
+			ebreak();
+
+		word_index = interrupt_id / 32;
+		if (word_index != curr_index) {
+			if (pending)
+				writel_relaxed(pending, (void *)(plicsw.addr +
+					PLICSW_PENDING_BASE + curr_index * 4));
+			curr_index = word_index;
+			pending = 0;
+		}
+		pending |= BIT(interrupt_id % 32);
+	}
+
+	if (pending)
+		writel_relaxed(pending, (void *)(plicsw.addr +
+			       PLICSW_PENDING_BASE + curr_index * 4));
+}
+
 static void plicsw_ipi_clear(void)
 {
 	u32 target_hart = current_hartid();
@@ -62,6 +90,7 @@ static void plicsw_ipi_clear(void)
 static struct sbi_ipi_device plicsw_ipi = {
 	.name      = "andes_plicsw",
 	.ipi_send  = plicsw_ipi_send,
+	.ipi_send_mask = plicsw_ipi_send_mask,
 	.ipi_clear = plicsw_ipi_clear
 };
 
@@ -110,7 +110,6 @@
 
 #define APLIC_IDC_CLAIMI		0x1c
 
-#define APLIC_DEFAULT_PRIORITY		1
 #define APLIC_DISABLE_IDELIVERY		0
 #define APLIC_ENABLE_IDELIVERY		1
 #define APLIC_DISABLE_ITHRESHOLD	1
@@ -172,7 +171,7 @@ static struct sbi_irqchip_device aplic_device = {
 int aplic_cold_irqchip_init(struct aplic_data *aplic)
 {
 	int rc;
-	u32 i, j, tmp;
+	u32 i, j, tmp, cfg, valid_deleg = 0;
 	struct aplic_delegate_data *deleg;
 	u32 first_deleg_irq, last_deleg_irq;
 
@@ -200,18 +199,7 @@ int aplic_cold_irqchip_init(struct aplic_data *aplic)
 		writel(-1U, (void *)(aplic->addr + APLIC_CLRIE_BASE +
 				     (i / 32) * sizeof(u32)));
 
-	/* Set interrupt type and priority for all interrupts */
-	for (i = 1; i <= aplic->num_source; i++) {
-		/* Set IRQ source configuration to 0 */
-		writel(0, (void *)(aplic->addr + APLIC_SOURCECFG_BASE +
-			  (i - 1) * sizeof(u32)));
-		/* Set IRQ target hart index and priority to 1 */
-		writel(APLIC_DEFAULT_PRIORITY, (void *)(aplic->addr +
-						APLIC_TARGET_BASE +
-						(i - 1) * sizeof(u32)));
-	}
-
-	/* Configure IRQ delegation */
+	/* Check the IRQ delegations */
 	first_deleg_irq = -1U;
 	last_deleg_irq = 0;
 	for (i = 0; i < APLIC_MAX_DELEGATE; i++) {
@@ -232,10 +220,25 @@ int aplic_cold_irqchip_init(struct aplic_data *aplic)
 			first_deleg_irq = deleg->first_irq;
 		if (last_deleg_irq < deleg->last_irq)
 			last_deleg_irq = deleg->last_irq;
-		for (j = deleg->first_irq; j <= deleg->last_irq; j++)
-			writel(APLIC_SOURCECFG_D | deleg->child_index,
-				(void *)(aplic->addr + APLIC_SOURCECFG_BASE +
-				(j - 1) * sizeof(u32)));
+		valid_deleg |= BIT(i);
+	}
+
+	/*
+	 * Write the source configuration of every IRQ exactly once,
+	 * either inactive or delegated to the child domain of the last
+	 * delegation covering it. The target registers of inactive and
+	 * delegated sources are read-only zero so they are not written.
+	 */
+	for (i = 1; i <= aplic->num_source; i++) {
+		cfg = 0;
+		for (j = 0; j < APLIC_MAX_DELEGATE; j++) {
+			deleg = &aplic->delegate[j];
+			if ((valid_deleg & BIT(j)) &&
+			    deleg->first_irq <= i && i <= deleg->last_irq)
+				cfg = APLIC_SOURCECFG_D | deleg->child_index;
+		}
+		writel(cfg, (void *)(aplic->addr + APLIC_SOURCECFG_BASE +
+				     (i - 1) * sizeof(u32)));
 	}
 
 	/* Default initialization of IDC structures */
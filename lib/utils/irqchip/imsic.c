@@ -14,6 +14,8 @@
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_csr_detect.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_hartmask.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_irqchip.h>
 #include <sbi/sbi_error.h>
@@ -96,6 +98,27 @@ static unsigned long imsic_file_offset;
 #define imsic_set_hart_file(__scratch, __file)				\
 	sbi_scratch_write_type((__scratch), long, imsic_file_offset, (__file))
 
+/* MSI doorbell of the IPI of every HART indexed by HART index */
+static unsigned long *imsic_ipi_addrs;
+
+static unsigned long imsic_file_ipi_addr(struct imsic_data *imsic, int file)
+{
+	unsigned long reloff;
+	struct imsic_regs *regs;
+
+	regs = &imsic->regs[0];
+	reloff = file * (1UL << imsic->guest_index_bits) * IMSIC_MMIO_PAGE_SZ;
+	while (regs->size && (regs->size <= reloff)) {
+		reloff -= regs->size;
+		regs++;
+	}
+
+	if (regs->size && (reloff < regs->size))
+		return regs->addr + reloff + IMSIC_MMIO_PAGE_LE;
+
+	return 0;
+}
+
 int imsic_map_hartid_to_data(u32 hartid, struct imsic_data *imsic, int file)
 {
 	struct sbi_scratch *scratch;
@@ -116,6 +139,9 @@ int imsic_map_hartid_to_data(u32 hartid, struct imsic_data *imsic, int file)
 
 	imsic_set_hart_data_ptr(scratch, imsic);
 	imsic_set_hart_file(scratch, file);
+	if (imsic_ipi_addrs)
+		imsic_ipi_addrs[sbi_hartid_to_hartindex(hartid)] =
+					imsic_file_ipi_addr(imsic, file);
 	return 0;
 }
 
@@ -147,22 +173,23 @@ int imsic_get_target_file(u32 hartindex)
 	return imsic_get_hart_file(scratch);
 }
 
+static int imsic_ipi_irqfn(unsigned long id, void *priv)
+{
+	sbi_ipi_process();
+	return 0;
+}
+
 static int imsic_external_irqfn(void)
 {
 	ulong mirq;
 
+	/* Each swap claims the highest priority pending ID */
 	while ((mirq = csr_swap(CSR_MTOPEI, 0))) {
 		mirq = (mirq >> IMSIC_TOPEI_ID_SHIFT);
 
-		switch (mirq) {
-		case IMSIC_IPI_ID:
-			sbi_ipi_process();
-			break;
-		default:
+		if (sbi_irqchip_ext_process(mirq) == SBI_ENOENT)
 			sbi_printf("%s: unhandled IRQ%d\n",
 				   __func__, (u32)mirq);
-			break;
-		}
 	}
 
 	return 0;
@@ -170,42 +197,39 @@ static int imsic_external_irqfn(void)
 
 static void imsic_ipi_send(u32 hart_index)
 {
-	unsigned long reloff;
-	struct imsic_regs *regs;
-	struct imsic_data *data;
-	struct sbi_scratch *scratch;
-	int file;
+	unsigned long addr;
 
-	scratch = sbi_hartindex_to_scratch(hart_index);
-	if (!scratch)
+	if (sbi_scratch_last_hartindex() < hart_index)
 		return;
 
-	data = imsic_get_hart_data_ptr(scratch);
-	file = imsic_get_hart_file(scratch);
-	if (!data || !data->targets_mmode)
-		return;
+	/* The interrupt file address is resolved when mapping the HART */
+	addr = imsic_ipi_addrs[hart_index];
+	if (addr)
+		writel_relaxed(IMSIC_IPI_ID, (void *)addr);
+}
 
-	regs = &data->regs[0];
-	reloff = file * (1UL << data->guest_index_bits) * IMSIC_MMIO_PAGE_SZ;
-	while (regs->size && (regs->size <= reloff)) {
-		reloff -= regs->size;
-		regs++;
-	}
+static void imsic_ipi_send_mask(const struct sbi_hartmask *mask)
+{
+	unsigned long addr;
+	u32 i;
 
-	if (regs->size && (reloff < regs->size))
-		writel_relaxed(IMSIC_IPI_ID,
-			(void *)(regs->addr + reloff + IMSIC_MMIO_PAGE_LE));
+	sbi_hartmask_for_each_hartindex(i, mask) {
+		addr = imsic_ipi_addrs[i];
+		if (addr)
+			writel_relaxed(IMSIC_IPI_ID, (void *)addr);
+	}
 }
 
 static struct sbi_ipi_device imsic_ipi_device = {
 	.name		= "aia-imsic",
-	.ipi_send	= imsic_ipi_send
+	.ipi_send	= imsic_ipi_send,
+	.ipi_send_mask	= imsic_ipi_send_mask
 };
 
 static void imsic_local_eix_update(unsigned long base_id,
 				   unsigned long num_id, bool pend, bool val)
 {
-	unsigned long i, isel, ireg;
+	unsigned long isel, ireg, first, last;
 	unsigned long id = base_id, last_id = base_id + num_id;
 
 	while (id < last_id) {
@@ -213,13 +237,20 @@ static void imsic_local_eix_update(unsigned long base_id,
 		isel *= __riscv_xlen / IMSIC_EIPx_BITS;
 		isel += (pend) ? IMSIC_EIP0 : IMSIC_EIE0;
 
-		ireg = 0;
-		for (i = id & (__riscv_xlen - 1);
-		     (id < last_id) && (i < __riscv_xlen); i++) {
-			ireg |= BIT(i);
-			id++;
+		/* Bits of the range which are in this register */
+		first = id & (__riscv_xlen - 1);
+		last = __riscv_xlen - 1;
+		if (last_id - id <= last - first)
+			last = first + (last_id - id) - 1;
+		id += last - first + 1;
+
+		/* Whole registers are written without reading them back */
+		if (!first && last == __riscv_xlen - 1) {
+			imsic_csr_write(isel, val ? -1UL : 0UL);
+			continue;
 		}
 
+		ireg = (-1UL << first) & (-1UL >> (__riscv_xlen - 1 - last));
 		if (val)
 			imsic_csr_set(isel, ireg);
 		else
@@ -377,6 +408,14 @@ int imsic_cold_irqchip_init(struct imsic_data *imsic)
 			return SBI_ENOMEM;
 	}
 
+	/* Allocate the IPI address of every HART */
+	if (!imsic_ipi_addrs) {
+		imsic_ipi_addrs = sbi_calloc(sbi_scratch_last_hartindex() + 1,
+					     sizeof(*imsic_ipi_addrs));
+		if (!imsic_ipi_addrs)
+			return SBI_ENOMEM;
+	}
+
 	/* Add IMSIC regions to the root domain */
 	for (i = 0; i < IMSIC_MAX_REGS && imsic->regs[i].size; i++) {
 		rc = sbi_domain_root_add_memrange(imsic->regs[i].addr,
@@ -392,6 +431,11 @@ int imsic_cold_irqchip_init(struct imsic_data *imsic)
 	/* Register irqchip device */
 	sbi_irqchip_add_device(&imsic_device);
 
+	/* Handle the IPI ID of the IMSIC */
+	rc = sbi_irqchip_set_ext_handler(IMSIC_IPI_ID, imsic_ipi_irqfn, NULL);
+	if (rc && rc != SBI_EALREADY)
+		return rc;
+
 	/* Register IPI device */
 	sbi_ipi_set_device(&imsic_ipi_device);
 
@@ -25,6 +25,7 @@
 #define PLIC_ENABLE_STRIDE 0x80
 #define PLIC_CONTEXT_BASE 0x200000
 #define PLIC_CONTEXT_STRIDE 0x1000
+#define PLIC_CONTEXT_CLAIM 0x4
 
 #define THEAD_PLIC_CTRL_REG 0x1ffffc
 
@@ -99,6 +100,25 @@ static void plic_set_ie(const struct plic_data *plic, u32 cntxid,
 	writel(val, plic_ie);
 }
 
+static u32 plic_claim(const struct plic_data *plic, u32 cntxid)
+{
+	volatile void *plic_claim;
+
+	plic_claim = (char *)plic->addr + PLIC_CONTEXT_BASE +
+		     PLIC_CONTEXT_STRIDE * cntxid + PLIC_CONTEXT_CLAIM;
+
+	return readl(plic_claim);
+}
+
+static void plic_complete(const struct plic_data *plic, u32 cntxid, u32 id)
+{
+	volatile void *plic_claim;
+
+	plic_claim = (char *)plic->addr + PLIC_CONTEXT_BASE +
+		     PLIC_CONTEXT_STRIDE * cntxid + PLIC_CONTEXT_CLAIM;
+	writel(id, plic_claim);
+}
+
 static void plic_delegate(const struct plic_data *plic)
 {
 	/* If this is a T-HEAD PLIC, delegate access to S-mode */
@@ -125,35 +145,60 @@ static int plic_context_init(const struct plic_data *plic, int context_id,
 	return 0;
 }
 
+/*
+ * Layout of the power management data:
+ * - bitmap of the enable words with a source of non-zero priority
+ * - priority of every source, one byte each, padded to a word
+ * - threshold and the marked enable words of every S-mode context
+ *
+ * A source of priority zero never interrupts, so only the enable words
+ * holding a source of non-zero priority need to be saved and restored
+ * and the cost scales with the configured sources instead of the
+ * number of HARTs times the number of implemented sources.
+ */
+#define PLIC_PM_MAP_WORDS(__p)		(PLIC_IE_WORDS(__p) / 32 + 1)
+#define PLIC_PM_PRIO_WORDS(__p)		(((__p)->num_src + 3) / 4)
+
 void plic_suspend(void)
 {
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 	const struct plic_data *plic = plic_get_hart_data_ptr(scratch);
 	u32 ie_words = PLIC_IE_WORDS(plic);
 	u32 *data_word = plic->pm_data;
+	u32 *ie_map;
 	u8 *data_byte;
 
 	if (!data_word)
 		return;
 
+	ie_map = data_word;
+	sbi_memset(ie_map, 0, PLIC_PM_MAP_WORDS(plic) * sizeof(u32));
+	data_word += PLIC_PM_MAP_WORDS(plic);
+
+	/* Save the input priorities and mark the words they are in */
+	data_byte = (u8 *)data_word;
+	for (u32 i = 1; i <= plic->num_src; i++) {
+		*data_byte = plic_get_priority(plic, i);
+		if (*data_byte++)
+			ie_map[(i / 32) / 32] |= BIT((i / 32) % 32);
+	}
+	data_word += PLIC_PM_PRIO_WORDS(plic);
+
 	for (u32 h = 0; h <= sbi_scratch_last_hartindex(); h++) {
-		u32 context_id = plic->context_map[h][PLIC_S_CONTEXT];
+		s16 context_id = plic->context_map[h][PLIC_S_CONTEXT];
 
 		if (context_id < 0)
 			continue;
 
-		/* Save the enable bits */
-		for (u32 i = 0; i < ie_words; i++)
-			*data_word++ = plic_get_ie(plic, context_id, i);
-
 		/* Save the context threshold */
 		*data_word++ = plic_get_thresh(plic, context_id);
-	}
 
-	/* Restore the input priorities */
-	data_byte = (u8 *)data_word;
-	for (u32 i = 1; i <= plic->num_src; i++)
-		*data_byte++ = plic_get_priority(plic, i);
+		/* Save the enable bits of sources which can interrupt */
+		for (u32 i = 0; i < ie_words; i++) {
+			if (ie_map[i / 32] & BIT(i % 32))
+				*data_word++ = plic_get_ie(plic, context_id, i);
+		}
+	}
 }
 
 void plic_resume(void)
@@ -162,29 +207,36 @@ void plic_resume(void)
 	const struct plic_data *plic = plic_get_hart_data_ptr(scratch);
 	u32 ie_words = PLIC_IE_WORDS(plic);
 	u32 *data_word = plic->pm_data;
+	u32 *ie_map;
 	u8 *data_byte;
 
 	if (!data_word)
 		return;
 
+	ie_map = data_word;
+	data_word += PLIC_PM_MAP_WORDS(plic);
+
+	/* Restore the input priorities */
+	data_byte = (u8 *)data_word;
+	for (u32 i = 1; i <= plic->num_src; i++)
+		plic_set_priority(plic, i, *data_byte++);
+	data_word += PLIC_PM_PRIO_WORDS(plic);
+
 	for (u32 h = 0; h <= sbi_scratch_last_hartindex(); h++) {
-		u32 context_id = plic->context_map[h][PLIC_S_CONTEXT];
+		s16 context_id = plic->context_map[h][PLIC_S_CONTEXT];
 
 		if (context_id < 0)
 			continue;
 
-		/* Restore the enable bits */
-		for (u32 i = 0; i < ie_words; i++)
-			plic_set_ie(plic, context_id, i, *data_word++);
-
 		/* Restore the context threshold */
 		plic_set_thresh(plic, context_id, *data_word++);
-	}
 
-	/* Restore the input priorities */
-	data_byte = (u8 *)data_word;
-	for (u32 i = 1; i <= plic->num_src; i++)
-		plic_set_priority(plic, i, *data_byte++);
+		/* Restore the enable bits of sources which can interrupt */
+		for (u32 i = 0; i < ie_words; i++) {
+			if (ie_map[i / 32] & BIT(i % 32))
+				plic_set_ie(plic, context_id, i, *data_word++);
+		}
+	}
 
 	/* Restore the delegation */
 	plic_delegate(plic);
@@ -221,8 +273,33 @@ static int plic_warm_irqchip_init(struct sbi_irqchip_device *dev)
 	return 0;
 }
 
+static int plic_irq_handle(void)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	const struct plic_data *plic = plic_get_hart_data_ptr(scratch);
+	s16 m_cntx_id;
+	u32 id;
+
+	if (!plic)
+		return SBI_ENODEV;
+
+	m_cntx_id = plic->context_map[current_hartindex()][PLIC_M_CONTEXT];
+	if (m_cntx_id < 0)
+		return SBI_ENODEV;
+
+	/* Each claim returns the highest priority pending source */
+	while ((id = plic_claim(plic, m_cntx_id))) {
+		if (sbi_irqchip_ext_process(id) == SBI_ENOENT)
+			sbi_printf("%s: unhandled IRQ%d\n", __func__, id);
+		plic_complete(plic, m_cntx_id, id);
+	}
+
+	return 0;
+}
+
 static struct sbi_irqchip_device plic_device = {
 	.warm_init	= plic_warm_irqchip_init,
+	.irq_handle	= plic_irq_handle,
 };
 
 int plic_cold_irqchip_init(struct plic_data *plic)
@@ -246,17 +323,20 @@ int plic_cold_irqchip_init(struct plic_data *plic)
 				continue;
 
 			/* Allocate space for enable bits */
-			data_size += (plic->num_src / 32 + 1) * sizeof(u32);
+			data_size += PLIC_IE_WORDS(plic) * sizeof(u32);
 
 			/* Allocate space for the context threshold */
 			data_size += sizeof(u32);
 		}
 
+		/* Allocate space for the map of saved enable words */
+		data_size += PLIC_PM_MAP_WORDS(plic) * sizeof(u32);
+
 		/*
 		 * Allocate space for the input priorities. So far,
 		 * priorities on all known implementations fit in 8 bits.
 		 */
-		data_size += plic->num_src * sizeof(u8);
+		data_size += PLIC_PM_PRIO_WORDS(plic) * sizeof(u32);
 
 		plic->pm_data = sbi_malloc(data_size);
 		if (!plic->pm_data)
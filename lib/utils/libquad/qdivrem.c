@@ -73,6 +73,52 @@ shl(digit *p, int len, int sh)
 	p[i] = LHALF(p[i] << sh);
 }
 
+#ifdef __riscv_div
+/*
+ * Divide the two-word number u1:u0 by v where u1 < v, so that the
+ * quotient fits in a word, using two hardware divides of half-word
+ * quotient digits (Hacker's Delight divlu).  The remainder is stored
+ * in *r.
+ */
+static u_long
+divlu(u_long u1, u_long u0, u_long v, u_long *r)
+{
+	u_long vn1, vn0, un1, un0, un32, un21, un10, q1, q0, rhat;
+	int s = __builtin_clzl(v);
+
+	/* Normalize so that the top bit of the divisor is set. */
+	v <<= s;
+	vn1 = HHALF(v);
+	vn0 = LHALF(v);
+	un32 = (u1 << s) | (s ? u0 >> (LONG_BITS - s) : 0);
+	un10 = u0 << s;
+	un1 = HHALF(un10);
+	un0 = LHALF(un10);
+
+	q1 = un32 / vn1;
+	rhat = un32 - q1 * vn1;
+	while (q1 >= B || q1 * vn0 > LHUP(rhat) + un1) {
+		q1--;
+		rhat += vn1;
+		if (rhat >= B)
+			break;
+	}
+	un21 = LHUP(un32) + un1 - q1 * v;
+
+	q0 = un21 / vn1;
+	rhat = un21 - q0 * vn1;
+	while (q0 >= B || q0 * vn0 > LHUP(rhat) + un0) {
+		q0--;
+		rhat += vn1;
+		if (rhat >= B)
+			break;
+	}
+
+	*r = (LHUP(un21) + un0 - q0 * v) >> s;
+	return (LHUP(q1) + q0);
+}
+#endif
+
 /*
  * __qdivrem(u, v, rem) returns u/v and, optionally, sets *rem to u%v.
  *
@@ -108,6 +154,30 @@ __qdivrem(u_quad_t uq, u_quad_t vq, u_quad_t *arq)
 			*arq = uq;
 		return (0);
 	}
+#ifdef __riscv_div
+	/*
+	 * With a hardware divider, a one-word divisor takes one divide
+	 * for a one-word dividend and three otherwise, much cheaper than
+	 * Program D on half-word digits.
+	 */
+	tmp.uq = vq;
+	if (tmp.ul[H] == 0) {
+		u_long v0 = tmp.ul[L], qh, r;
+
+		tmp.uq = uq;
+		if (tmp.ul[H] == 0) {
+			r = tmp.ul[L] % v0;
+			tmp.ul[L] = tmp.ul[L] / v0;
+		} else {
+			qh = tmp.ul[H] / v0;
+			tmp.ul[L] = divlu(tmp.ul[H] % v0, tmp.ul[L], v0, &r);
+			tmp.ul[H] = qh;
+		}
+		if (arq)
+			*arq = r;
+		return (tmp.q);
+	}
+#endif
 	u = &uspace[0];
 	v = &vspace[0];
 	q = &qspace[0];
@@ -159,6 +159,33 @@ static int regmap_syscon_write_be32(struct regmap *rmap, unsigned int reg,
 	return 0;
 }
 
+#define SYSCON_MAX_CACHED_REGS	16
+
+/*
+ * Registers listed in the optional "opensbi,cached-regs" property are
+ * only changed through OpenSBI and are cached, all others are volatile.
+ */
+static int regmap_syscon_cache_init(const void *fdt, int nodeoff,
+				    struct regmap *rmap)
+{
+	unsigned int regs[SYSCON_MAX_CACHED_REGS];
+	const fdt32_t *val;
+	int i, len;
+
+	val = fdt_getprop(fdt, nodeoff, "opensbi,cached-regs", &len);
+	if (!val || len <= 0)
+		return 0;
+
+	len /= sizeof(fdt32_t);
+	if (len > SYSCON_MAX_CACHED_REGS)
+		return SBI_EINVAL;
+
+	for (i = 0; i < len; i++)
+		regs[i] = fdt32_to_cpu(val[i]);
+
+	return regmap_cache_init(rmap, regs, len);
+}
+
 static int regmap_syscon_init(const void *fdt, int nodeoff,
 			      const struct fdt_match *match)
 {
@@ -241,6 +268,10 @@ static int regmap_syscon_init(const void *fdt, int nodeoff,
 		goto fail_free_syscon;
 	}
 
+	rc = regmap_syscon_cache_init(fdt, nodeoff, &srm->rmap);
+	if (rc)
+		goto fail_free_syscon;
+
 	rc = sbi_domain_root_add_memrange(addr, size, PAGE_SIZE,
 				(SBI_DOMAIN_MEMREGION_MMIO |
 				 SBI_DOMAIN_MEMREGION_SHARED_SURW_MRW));
@@ -254,6 +285,8 @@ static int regmap_syscon_init(const void *fdt, int nodeoff,
 	return 0;
 
 fail_free_syscon:
+	if (srm->rmap.cache)
+		sbi_free(srm->rmap.cache);
 	sbi_free(srm);
 	return rc;
 }
@@ -8,15 +8,32 @@
  */
 
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
 #include <sbi_utils/regmap/regmap.h>
 
-static SBI_LIST_HEAD(regmap_list);
+#define REGMAP_HASH_BUCKETS	16
+
+/*
+ * Registered regmaps hashed by ID. The IDs are usually FDT node offsets
+ * which are spread out enough for the low bits to pick a bucket.
+ */
+static struct sbi_dlist regmap_hash[REGMAP_HASH_BUCKETS];
+
+static struct sbi_dlist *regmap_bucket(unsigned int id)
+{
+	struct sbi_dlist *head = &regmap_hash[id % REGMAP_HASH_BUCKETS];
+
+	if (!head->next)
+		SBI_INIT_LIST_HEAD(head);
+
+	return head;
+}
 
 struct regmap *regmap_find(unsigned int id)
 {
-	struct sbi_dlist *pos;
+	struct sbi_dlist *pos, *head = regmap_bucket(id);
 
-	sbi_list_for_each(pos, &(regmap_list)) {
+	sbi_list_for_each(pos, head) {
 		struct regmap *rmap = to_regmap(pos);
 
 		if (rmap->id == id)
@@ -33,7 +50,28 @@ int regmap_add(struct regmap *rmap)
 	if (regmap_find(rmap->id))
 		return SBI_EALREADY;
 
-	sbi_list_add(&(rmap->node), &(regmap_list));
+	sbi_list_add(&(rmap->node), regmap_bucket(rmap->id));
+
+	return 0;
+}
+
+int regmap_cache_init(struct regmap *rmap, const unsigned int *regs,
+		      unsigned int count)
+{
+	unsigned int i;
+
+	if (!rmap || (count && !regs))
+		return SBI_EINVAL;
+	if (!count)
+		return 0;
+
+	rmap->cache = sbi_zalloc(count * sizeof(*rmap->cache));
+	if (!rmap->cache)
+		return SBI_ENOMEM;
+
+	for (i = 0; i < count; i++)
+		rmap->cache[i].reg = regs[i];
+	rmap->cache_count = count;
 
 	return 0;
 }
@@ -66,24 +104,66 @@ static unsigned int regmap_reg_addr(struct regmap *rmap, unsigned int reg)
 	return reg;
 }
 
+static struct regmap_cache_entry *regmap_cache_find(struct regmap *rmap,
+						     unsigned int reg)
+{
+	unsigned int i;
+
+	for (i = 0; i < rmap->cache_count; i++) {
+		if (rmap->cache[i].reg == reg)
+			return &rmap->cache[i];
+	}
+
+	return NULL;
+}
+
+static void regmap_cache_set(struct regmap_cache_entry *ce, unsigned int val)
+{
+	if (!ce)
+		return;
+
+	ce->val = val;
+	ce->valid = true;
+}
+
 int regmap_read(struct regmap *rmap, unsigned int reg, unsigned int *val)
 {
+	struct regmap_cache_entry *ce;
+	int rc;
+
 	if (!rmap || !regmap_reg_valid(rmap, reg))
 		return SBI_EINVAL;
+
+	ce = regmap_cache_find(rmap, reg);
+	if (ce && ce->valid) {
+		*val = ce->val;
+		return 0;
+	}
+
 	if (!rmap->reg_read)
 		return SBI_ENOSYS;
 
-	return rmap->reg_read(rmap, regmap_reg_addr(rmap, reg), val);
+	rc = rmap->reg_read(rmap, regmap_reg_addr(rmap, reg), val);
+	if (!rc)
+		regmap_cache_set(ce, *val);
+
+	return rc;
 }
 
 int regmap_write(struct regmap *rmap, unsigned int reg, unsigned int val)
 {
+	int rc;
+
 	if (!rmap || !regmap_reg_valid(rmap, reg))
 		return SBI_EINVAL;
 	if (!rmap->reg_write)
 		return SBI_ENOSYS;
 
-	return rmap->reg_write(rmap, regmap_reg_addr(rmap, reg), val);
+	rc = rmap->reg_write(rmap, regmap_reg_addr(rmap, reg), val);
+	if (!rc)
+		regmap_cache_set(regmap_cache_find(rmap, reg), val);
+
+	return rc;
 }
 
 int regmap_update_bits(struct regmap *rmap, unsigned int reg,
@@ -91,23 +171,32 @@ int regmap_update_bits(struct regmap *rmap, unsigned int reg,
 {
 	int rc;
 	unsigned int reg_val;
+	struct regmap_cache_entry *ce;
 
 	if (!rmap || !regmap_reg_valid(rmap, reg))
 		return SBI_EINVAL;
 
+	/* A cached register is modified without reading the bus */
+	ce = regmap_cache_find(rmap, reg);
+	if (ce && ce->valid && rmap->reg_write) {
+		reg_val = (ce->val & ~mask) | (val & mask);
+		return regmap_write(rmap, reg, reg_val);
+	}
+
 	if (rmap->reg_update_bits) {
-		return rmap->reg_update_bits(rmap, regmap_reg_addr(rmap, reg),
-					     mask, val);
+		rc = rmap->reg_update_bits(rmap, regmap_reg_addr(rmap, reg),
+					   mask, val);
+		if (ce)
+			ce->valid = false;
+		return rc;
 	} else if (rmap->reg_read && rmap->reg_write) {
-		reg = regmap_reg_addr(rmap, reg);
-
-		rc = rmap->reg_read(rmap, reg, &reg_val);
+		rc = regmap_read(rmap, reg, &reg_val);
 		if (rc)
 			return rc;
 
 		reg_val &= ~mask;
 		reg_val |= val & mask;
-		return rmap->reg_write(rmap, reg, reg_val);
+		return regmap_write(rmap, reg, reg_val);
 	}
 
 	return SBI_ENOSYS;
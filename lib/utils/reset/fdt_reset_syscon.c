@@ -75,7 +75,8 @@ static void syscon_do_poweroff(u32 type, u32 reason)
 static struct sbi_system_reset_device syscon_poweroff = {
 	.name = "syscon-poweroff",
 	.system_reset_check = syscon_poweroff_check,
-	.system_reset = syscon_do_poweroff
+	.system_reset = syscon_do_poweroff,
+	.resets_all_harts = true,
 };
 
 static int syscon_reboot_check(u32 type, u32 reason)
@@ -93,7 +94,8 @@ static void syscon_do_reboot(u32 type, u32 reason)
 static struct sbi_system_reset_device syscon_reboot = {
 	.name = "syscon-reboot",
 	.system_reset_check = syscon_reboot_check,
-	.system_reset = syscon_do_reboot
+	.system_reset = syscon_do_reboot,
+	.resets_all_harts = true,
 };
 
 static int syscon_reset_init(const void *fdt, int nodeoff,
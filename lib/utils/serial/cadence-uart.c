@@ -34,13 +34,17 @@
 #define UART_BRGR_CD_CLKDIVISOR	0x00000001	/* baud_sample = sel_clk */
 
 #define	UART_CSR_REMPTY		0x00000002
+#define	UART_CSR_TEMPTY		0x00000008
 #define	UART_CSR_TFUL		0x00000010
 
+#define UART_FIFO_SIZE_DEFAULT	16
+
 /* clang-format on */
 
 static volatile void *uart_base;
 static u32 uart_in_freq;
 static u32 uart_baudrate;
+static u32 uart_fifo_size = UART_FIFO_SIZE_DEFAULT;
 
 /*
  * Find minimum divisor divides in_freq to max_target_hz;
@@ -76,6 +80,39 @@ static void cadence_uart_putc(char ch)
 	set_reg(UART_REG_RFIFO_TFIFO, ch);
 }
 
+static unsigned long cadence_uart_puts(const char *str, unsigned long len)
+{
+	unsigned long i = 0;
+	u32 room;
+
+	/* A newline needs room for two characters */
+	if (uart_fifo_size < 2) {
+		for (i = 0; i < len; i++) {
+			if (str[i] == '\n')
+				cadence_uart_putc('\r');
+			cadence_uart_putc(str[i]);
+		}
+		return len;
+	}
+
+	while (i < len) {
+		while (!(get_reg(UART_REG_CSR) & UART_CSR_TEMPTY))
+			;
+
+		for (room = uart_fifo_size; room && i < len; room--) {
+			if (str[i] == '\n') {
+				if (room < 2)
+					break;
+				set_reg(UART_REG_RFIFO_TFIFO, '\r');
+				room--;
+			}
+			set_reg(UART_REG_RFIFO_TFIFO, str[i++]);
+		}
+	}
+
+	return len;
+}
+
 static int cadence_uart_getc(void)
 {
 	u32 ret = get_reg(UART_REG_CSR);
@@ -89,9 +126,16 @@ static int cadence_uart_getc(void)
 static struct sbi_console_device cadence_console = {
 	.name = "cadence_uart",
 	.console_putc = cadence_uart_putc,
+	.console_puts = cadence_uart_puts,
 	.console_getc = cadence_uart_getc
 };
 
+void cadence_uart_set_fifo_size(u32 fifo_size)
+{
+	if (fifo_size)
+		uart_fifo_size = fifo_size;
+}
+
 int cadence_uart_init(unsigned long base, u32 in_freq, u32 baudrate)
 {
 	uart_base     = (volatile void *)base;
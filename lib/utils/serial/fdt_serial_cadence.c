@@ -20,7 +20,13 @@ static int serial_cadence_init(const void *fdt, int nodeoff,
 	if (rc)
 		return rc;
 
-	return cadence_uart_init(uart.addr, uart.freq, uart.baud);
+	rc = cadence_uart_init(uart.addr, uart.freq, uart.baud);
+	if (rc)
+		return rc;
+
+	cadence_uart_set_fifo_size(uart.fifo_size);
+
+	return 0;
 }
 
 static const struct fdt_match serial_cadence_match[] = {
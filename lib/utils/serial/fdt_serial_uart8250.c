@@ -21,9 +21,15 @@ static int serial_uart8250_init(const void *fdt, int nodeoff,
 	if (rc)
 		return rc;
 
-	return uart8250_init(uart.addr, uart.freq, uart.baud,
-			     uart.reg_shift, uart.reg_io_width,
-			     uart.reg_offset);
+	rc = uart8250_init(uart.addr, uart.freq, uart.baud,
+			   uart.reg_shift, uart.reg_io_width,
+			   uart.reg_offset);
+	if (rc)
+		return rc;
+
+	uart8250_set_fifo_size(uart.fifo_size);
+
+	return 0;
 }
 
 static const struct fdt_match serial_uart8250_match[] = {
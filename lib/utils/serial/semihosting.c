@@ -8,6 +8,7 @@
  *   Kautuk Consul <kconsul@ventanamicro.com>
  */
 
+#include <sbi/riscv_locks.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_error.h>
@@ -15,6 +16,7 @@
 
 #define SYSOPEN     0x01
 #define SYSWRITEC   0x03
+#define SYSWRITE0   0x04
 #define SYSWRITE    0x05
 #define SYSREAD     0x06
 #define SYSREADC    0x07
@@ -160,22 +162,47 @@ static long semihosting_write(long fd, const void *memp, size_t len)
 
 /* clang-format on */
 
+/* Size of the buffer console writes are staged in */
+#define SEMIHOSTING_PUTS_BUF_SIZE	256
+
+static char semihosting_puts_buf[SEMIHOSTING_PUTS_BUF_SIZE];
+static spinlock_t semihosting_puts_lock = SPIN_LOCK_INITIALIZER;
+
+/*
+ * Stage the string in a firmware buffer so that the debugger reads it
+ * from memory it can always access, with one trap per buffer.
+ */
 static unsigned long semihosting_puts(const char *str, unsigned long len)
 {
-	char ch;
-	long ret;
-	unsigned long i;
-
-	if (semihosting_outfd < 0) {
-		for (i = 0; i < len; i++) {
-			ch = str[i];
-			semihosting_trap(SYSWRITEC, &ch);
+	long ret = 0;
+	unsigned long n, done = 0;
+
+	spin_lock(&semihosting_puts_lock);
+	while (done < len) {
+		n = len - done;
+		if (n > SEMIHOSTING_PUTS_BUF_SIZE - 1)
+			n = SEMIHOSTING_PUTS_BUF_SIZE - 1;
+		sbi_memcpy(semihosting_puts_buf, &str[done], n);
+
+		if (semihosting_outfd < 0) {
+			/*
+			 * SYS_WRITE0 stops at the first NUL so one in the
+			 * string is skipped.
+			 */
+			semihosting_puts_buf[n] = '\0';
+			semihosting_trap(SYSWRITE0, semihosting_puts_buf);
+			ret = n;
+		} else {
+			ret = semihosting_write(semihosting_outfd,
+						semihosting_puts_buf, n);
+			if (ret <= 0)
+				break;
 		}
-		ret = len;
-	} else
-		ret = semihosting_write(semihosting_outfd, str, len);
+		done += ret;
+	}
+	spin_unlock(&semihosting_puts_lock);
 
-	return (ret < 0) ? 0 : ret;
+	return done;
 }
 
 static int semihosting_getc(void)
@@ -25,6 +25,10 @@
 #define UART_RXFIFO_EMPTY	0x80000000
 #define UART_RXFIFO_DATA	0x000000ff
 #define UART_TXCTRL_TXEN	0x1
+#define UART_TXCTRL_TXCNT_SHIFT	16
+#define UART_TXCTRL_TXCNT_MASK	0x7
+#define UART_IP_TXWM		0x1
+#define UART_TXFIFO_SIZE	8
 #define UART_RXCTRL_RXEN	0x1
 
 /* clang-format on */
@@ -74,6 +78,42 @@ static void sifive_uart_putc(char ch)
 	set_reg(UART_REG_TXFIFO, ch);
 }
 
+static unsigned long sifive_uart_puts(const char *str, unsigned long len)
+{
+	unsigned long i = 0;
+	u32 room, txcnt;
+
+	/* TXWM is pending while the FIFO holds fewer than txcnt entries */
+	txcnt = (get_reg(UART_REG_TXCTRL) >> UART_TXCTRL_TXCNT_SHIFT) &
+		UART_TXCTRL_TXCNT_MASK;
+	if (!txcnt) {
+		for (i = 0; i < len; i++) {
+			if (str[i] == '\n')
+				sifive_uart_putc('\r');
+			sifive_uart_putc(str[i]);
+		}
+		return len;
+	}
+
+	while (i < len) {
+		while (!(get_reg(UART_REG_IP) & UART_IP_TXWM))
+			;
+
+		for (room = UART_TXFIFO_SIZE - txcnt + 1; room && i < len;
+		     room--) {
+			if (str[i] == '\n') {
+				if (room < 2)
+					break;
+				set_reg(UART_REG_TXFIFO, '\r');
+				room--;
+			}
+			set_reg(UART_REG_TXFIFO, str[i++]);
+		}
+	}
+
+	return len;
+}
+
 static int sifive_uart_getc(void)
 {
 	u32 ret = get_reg(UART_REG_RXFIFO);
@@ -87,6 +127,7 @@ static int sifive_uart_getc(void)
 static struct sbi_console_device sifive_console = {
 	.name = "sifive_uart",
 	.console_putc = sifive_uart_putc,
+	.console_puts = sifive_uart_puts,
 	.console_getc = sifive_uart_getc
 };
 
@@ -103,8 +144,9 @@ int sifive_uart_init(unsigned long base, u32 in_freq, u32 baudrate)
 	/* Disable interrupts */
 	set_reg(UART_REG_IE, 0);
 
-	/* Enable TX */
-	set_reg(UART_REG_TXCTRL, UART_TXCTRL_TXEN);
+	/* Enable TX with the watermark pending once the FIFO is empty */
+	set_reg(UART_REG_TXCTRL, UART_TXCTRL_TXEN |
+		(1 << UART_TXCTRL_TXCNT_SHIFT));
 
 	/* Enable Rx */
 	set_reg(UART_REG_RXCTRL, UART_RXCTRL_RXEN);
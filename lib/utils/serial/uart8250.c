@@ -11,6 +11,8 @@
 #include <sbi/riscv_io.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_irqchip.h>
 #include <sbi_utils/serial/uart8250.h>
 
 /* clang-format off */
@@ -39,6 +41,12 @@
 #define UART_LSR_DR		0x01	/* Receiver data ready */
 #define UART_LSR_BRK_ERROR_BITS	0x1E	/* BI, FE, PE, OE bits */
 
+#define UART_IER_RDI		0x01	/* Enable receiver data interrupt */
+#define UART_IER_THRI		0x02	/* Enable transmit empty interrupt */
+
+#define UART_IIR_FIFO_MASK	0xC0	/* FIFOs enabled */
+#define UART_FIFO_SIZE_16550A	16
+
 /* clang-format on */
 
 static volatile char *uart8250_base;
@@ -46,6 +54,9 @@ static u32 uart8250_in_freq;
 static u32 uart8250_baudrate;
 static u32 uart8250_reg_width;
 static u32 uart8250_reg_shift;
+static u32 uart8250_fifo_size = 1;
+static u32 uart8250_ier;
+static bool uart8250_irq_on;
 
 static u32 get_reg(u32 num)
 {
@@ -79,6 +90,108 @@ static void uart8250_putc(char ch)
 	set_reg(UART_THR_OFFSET, ch);
 }
 
+static unsigned long uart8250_puts(const char *str, unsigned long len)
+{
+	unsigned long i = 0;
+	u32 room;
+
+	/* A newline needs room for two characters */
+	if (uart8250_fifo_size < 2) {
+		for (i = 0; i < len; i++) {
+			if (str[i] == '\n')
+				uart8250_putc('\r');
+			uart8250_putc(str[i]);
+		}
+		return len;
+	}
+
+	while (i < len) {
+		/* With the FIFO enabled THRE means the whole FIFO is empty */
+		while ((get_reg(UART_LSR_OFFSET) & UART_LSR_THRE) == 0)
+			;
+
+		for (room = uart8250_fifo_size; room && i < len; room--) {
+			if (str[i] == '\n') {
+				if (room < 2)
+					break;
+				set_reg(UART_THR_OFFSET, '\r');
+				room--;
+			}
+			set_reg(UART_THR_OFFSET, str[i++]);
+		}
+	}
+
+	return len;
+}
+
+static unsigned long uart8250_tx_fill(const char *str, unsigned long len)
+{
+	unsigned long i = 0;
+	u32 room;
+
+	if ((get_reg(UART_LSR_OFFSET) & UART_LSR_THRE) == 0)
+		return 0;
+
+	for (room = uart8250_fifo_size; room && i < len; room--) {
+		if (str[i] == '\n') {
+			if (room < 2)
+				break;
+			set_reg(UART_THR_OFFSET, '\r');
+			room--;
+		}
+		set_reg(UART_THR_OFFSET, str[i++]);
+	}
+
+	return i;
+}
+
+static void uart8250_set_ier(u32 mask, bool enable)
+{
+	if (enable)
+		uart8250_ier |= mask;
+	else
+		uart8250_ier &= ~mask;
+	set_reg(UART_IER_OFFSET, uart8250_ier);
+}
+
+static void uart8250_tx_irq(bool enable)
+{
+	uart8250_set_ier(UART_IER_THRI, enable);
+}
+
+static void uart8250_rx_irq(bool enable)
+{
+	uart8250_set_ier(UART_IER_RDI, enable);
+}
+
+static int uart8250_irqfn(unsigned long id, void *priv)
+{
+	/*
+	 * Reading IIR acknowledges a transmit empty interrupt while a
+	 * receive interrupt goes away once the FIFO has been read.
+	 */
+	get_reg(UART_IIR_OFFSET);
+	sbi_console_rx_process();
+	sbi_console_tx_process();
+
+	return 0;
+}
+
+static int uart8250_irq_register(unsigned long ext_id)
+{
+	int rc;
+
+	if (uart8250_irq_on)
+		return 0;
+
+	rc = sbi_irqchip_set_ext_handler(ext_id, uart8250_irqfn, NULL);
+	if (rc)
+		return rc;
+
+	uart8250_irq_on = true;
+	return 0;
+}
+
 static int uart8250_getc(void)
 {
 	if (get_reg(UART_LSR_OFFSET) & UART_LSR_DR)
@@ -89,9 +202,45 @@ static int uart8250_getc(void)
 static struct sbi_console_device uart8250_console = {
 	.name = "uart8250",
 	.console_putc = uart8250_putc,
-	.console_getc = uart8250_getc
+	.console_puts = uart8250_puts,
+	.console_getc = uart8250_getc,
+	.console_tx_fill = uart8250_tx_fill,
+	.console_tx_irq = uart8250_tx_irq,
+	.console_rx_irq = uart8250_rx_irq
 };
 
+void uart8250_set_fifo_size(u32 fifo_size)
+{
+	if (fifo_size)
+		uart8250_fifo_size = fifo_size;
+}
+
+int uart8250_enable_tx_irq(unsigned long ext_id)
+{
+	int rc;
+
+	/* A newline needs room for two characters in the FIFO */
+	if (uart8250_fifo_size < 2)
+		return SBI_ENOTSUPP;
+
+	rc = uart8250_irq_register(ext_id);
+	if (rc)
+		return rc;
+
+	return sbi_console_tx_irq_enable();
+}
+
+int uart8250_enable_rx_irq(unsigned long ext_id)
+{
+	int rc;
+
+	rc = uart8250_irq_register(ext_id);
+	if (rc)
+		return rc;
+
+	return sbi_console_rx_irq_enable();
+}
+
 int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
 		  u32 reg_width, u32 reg_offset)
 {
@@ -109,6 +258,7 @@ int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
 	}
 
 	/* Disable all interrupts */
+	uart8250_ier = 0;
 	set_reg(UART_IER_OFFSET, 0x00);
 	/* Enable DLAB */
 	set_reg(UART_LCR_OFFSET, 0x80);
@@ -124,6 +274,12 @@ int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
 	set_reg(UART_LCR_OFFSET, 0x03);
 	/* Enable FIFO */
 	set_reg(UART_FCR_OFFSET, 0x01);
+	/* Only a 16550A or later provides a working FIFO */
+	if ((get_reg(UART_IIR_OFFSET) & UART_IIR_FIFO_MASK) ==
+	    UART_IIR_FIFO_MASK)
+		uart8250_fifo_size = UART_FIFO_SIZE_16550A;
+	else
+		uart8250_fifo_size = 1;
 	/* No modem control DTR RTS */
 	set_reg(UART_MCR_OFFSET, 0x00);
 	/* Clear line status */
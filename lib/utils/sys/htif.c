@@ -46,6 +46,9 @@
 
 #define PK_SYS_write 64
 
+/* Size of the buffer console writes are staged in */
+#define HTIF_PUTS_BUF_SIZE	256
+
 volatile uint64_t tohost __attribute__((section(".htif")));
 volatile uint64_t fromhost __attribute__((section(".htif")));
 
@@ -127,7 +130,7 @@ static int set_custom_addr(bool custom_addr,
 	return 0;
 }
 
-#if __riscv_xlen == 32
+#if __riscv_xlen == 32 || defined(CONFIG_SYS_HTIF_BULK_WRITE)
 static void do_tohost_fromhost(uint64_t dev, uint64_t cmd, uint64_t data)
 {
 	spin_lock(&htif_lock);
@@ -148,7 +151,9 @@ static void do_tohost_fromhost(uint64_t dev, uint64_t cmd, uint64_t data)
 
 	spin_unlock(&htif_lock);
 }
+#endif
 
+#if __riscv_xlen == 32
 static void htif_putc(char ch)
 {
 	/* HTIF devices are not supported on RV32, so do a proxy write call */
@@ -168,6 +173,38 @@ static void htif_putc(char ch)
 }
 #endif
 
+#ifdef CONFIG_SYS_HTIF_BULK_WRITE
+static char htif_puts_buf[HTIF_PUTS_BUF_SIZE];
+static spinlock_t htif_puts_lock = SPIN_LOCK_INITIALIZER;
+
+/* One proxied write syscall per buffer of the string */
+static unsigned long htif_puts(const char *str, unsigned long len)
+{
+	volatile uint64_t magic_mem[8];
+	unsigned long n, done = 0;
+
+	spin_lock(&htif_puts_lock);
+	while (done < len) {
+		/* Newlines become CRLF like for putc console devices */
+		for (n = 0; done < len && n < HTIF_PUTS_BUF_SIZE - 1;) {
+			if (str[done] == '\n')
+				htif_puts_buf[n++] = '\r';
+			htif_puts_buf[n++] = str[done++];
+		}
+
+		magic_mem[0] = PK_SYS_write;
+		magic_mem[1] = HTIF_DEV_CONSOLE;
+		magic_mem[2] = (uint64_t)(uintptr_t)htif_puts_buf;
+		magic_mem[3] = n;
+		do_tohost_fromhost(HTIF_DEV_SYSTEM, 0,
+				   (uint64_t)(uintptr_t)magic_mem);
+	}
+	spin_unlock(&htif_puts_lock);
+
+	return len;
+}
+#endif
+
 static int htif_getc(void)
 {
 	int ch;
@@ -194,6 +231,9 @@ static int htif_getc(void)
 static struct sbi_console_device htif_console = {
 	.name = "htif",
 	.console_putc = htif_putc,
+#ifdef CONFIG_SYS_HTIF_BULK_WRITE
+	.console_puts = htif_puts,
+#endif
 	.console_getc = htif_getc
 };
 
@@ -228,7 +268,8 @@ static void htif_system_reset(u32 type, u32 reason)
 static struct sbi_system_reset_device htif_reset = {
 	.name = "htif",
 	.system_reset_check = htif_system_reset_check,
-	.system_reset = htif_system_reset
+	.system_reset = htif_system_reset,
+	.resets_all_harts = true,
 };
 
 int htif_system_reset_init(bool custom_addr,
@@ -11,6 +11,7 @@
 #include <sbi/riscv_atomic.h>
 #include <sbi/riscv_io.h>
 #include <sbi/sbi_bitops.h>
+#include <sbi/sbi_console.h>
 #include <sbi/sbi_domain.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_scratch.h>
@@ -69,6 +70,24 @@ static u64 mtimer_value(void)
 	return mt->time_rd((void *)mt->mtime_addr);
 }
 
+static volatile u64 *mtimer_value_addr(void)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct aclint_mtimer_data *mt;
+
+	mt = mtimer_get_hart_data_ptr(scratch);
+	if (!mt || !mt->mtime_size)
+		return NULL;
+
+#if __riscv_xlen != 32
+	/* Direct readers use a single 64-bit load */
+	if (!mt->has_64bit_mmio)
+		return NULL;
+#endif
+
+	return (volatile u64 *)mt->mtime_addr;
+}
+
 static void mtimer_event_stop(void)
 {
 	u32 target_hart = current_hartid();
@@ -105,34 +124,106 @@ static void mtimer_event_start(u64 next_event)
 static struct sbi_timer_device mtimer = {
 	.name = "aclint-mtimer",
 	.timer_value = mtimer_value,
+	.timer_value_addr = mtimer_value_addr,
 	.timer_event_start = mtimer_event_start,
 	.timer_event_stop = mtimer_event_stop
 };
 
+/*
+ * Measure the offset of the reference MTIME relative to our MTIME.
+ *
+ * The reference is read in between two reads of our MTIME and the
+ * sample with the shortest round trip is used because it bounds the
+ * error of assuming that the reference was read at the mid-point.
+ */
+static long mtimer_measure_skew(struct aclint_mtimer_data *mt,
+				unsigned long *rtt)
+{
+	struct aclint_mtimer_data *reference = mt->time_delta_reference;
+	u64 *mt_time_val = (void *)mt->mtime_addr;
+	u64 *ref_time_val = (void *)reference->mtime_addr;
+	u64 v1, v2, mv, best = -1ULL;
+	long skew = 0;
+	int i;
+
+	for (i = 0; i < CONFIG_TIMER_MTIMER_SYNC_SAMPLES; i++) {
+		v1 = mt->time_rd(mt_time_val);
+		mv = reference->time_rd(ref_time_val);
+		v2 = mt->time_rd(mt_time_val);
+		if (v2 - v1 < best) {
+			best = v2 - v1;
+			skew = (long)(mv - (v1 + (v2 - v1) / 2));
+		}
+	}
+
+	*rtt = best;
+	return skew;
+}
+
 void aclint_mtimer_sync(struct aclint_mtimer_data *mt)
 {
-	u64 v1, v2, mv, delta;
-	u64 *mt_time_val, *ref_time_val;
-	struct aclint_mtimer_data *reference;
+	u64 *mt_time_val;
+	unsigned long rtt;
+	long skew;
+	int i;
 
 	/* Sync-up non-shared MTIME if reference is available */
 	if (mt->has_shared_mtime || !mt->time_delta_reference)
 		return;
 
-	reference = mt->time_delta_reference;
 	mt_time_val = (void *)mt->mtime_addr;
-	ref_time_val = (void *)reference->mtime_addr;
-	if (!atomic_raw_xchg_ulong(&mt->time_delta_computed, 1)) {
-		v1 = mt->time_rd(mt_time_val);
-		mv = reference->time_rd(ref_time_val);
-		v2 = mt->time_rd(mt_time_val);
-		delta = mv - ((v1 / 2) + (v2 / 2));
-		mt->time_wr(false, mt->time_rd(mt_time_val) + delta,
+	if (atomic_raw_xchg_ulong(&mt->time_delta_computed, 1))
+		return;
+
+	/*
+	 * The read-modify-write of MTIME itself takes time so re-measure
+	 * after each adjustment and retry while the residual skew is
+	 * larger than the measurement uncertainty.
+	 */
+	for (i = 0; i < 3; i++) {
+		skew = mtimer_measure_skew(mt, &rtt);
+		if (i && (ulong)(skew < 0 ? -skew : skew) <= rtt / 2)
+			break;
+		mt->time_wr(false, mt->time_rd(mt_time_val) + skew,
 			    mt_time_val);
 	}
 
+	mt->time_sync_skew = mtimer_measure_skew(mt, &mt->time_sync_rtt);
+}
+
+#if CONFIG_TIMER_MTIMER_DRIFT_REPORT_MS
+static void mtimer_drift_report(struct sbi_timer_entry *entry)
+{
+	struct aclint_mtimer_data *mt =
+		container_of(entry, struct aclint_mtimer_data, time_drift_entry);
+	unsigned long rtt;
+	long skew;
+
+	skew = mtimer_measure_skew(mt, &rtt);
+	sbi_printf("aclint-mtimer@0x%lx: skew %ld ticks (drift %ld, rtt %lu)\n",
+		   mt->mtime_addr, skew, skew - mt->time_sync_skew, rtt);
+
+	sbi_timer_add_entry(entry, entry->deadline +
+			    (u64)mt->mtime_freq *
+			    CONFIG_TIMER_MTIMER_DRIFT_REPORT_MS / 1000);
 }
 
+static void mtimer_drift_start(struct aclint_mtimer_data *mt)
+{
+	if (mt->has_shared_mtime || !mt->time_delta_reference ||
+	    atomic_raw_xchg_ulong(&mt->time_drift_armed, 1))
+		return;
+
+	sbi_timer_entry_init(&mt->time_drift_entry, mtimer_drift_report);
+	sbi_timer_add_entry(&mt->time_drift_entry,
+			    mt->time_rd((void *)mt->mtime_addr) +
+			    (u64)mt->mtime_freq *
+			    CONFIG_TIMER_MTIMER_DRIFT_REPORT_MS / 1000);
+}
+#else
+static void mtimer_drift_start(struct aclint_mtimer_data *mt) { }
+#endif
+
 void aclint_mtimer_set_reference(struct aclint_mtimer_data *mt,
 				 struct aclint_mtimer_data *ref)
 {
@@ -162,6 +253,9 @@ static int aclint_mtimer_warm_init(void)
 	mt->time_wr(true, -1ULL,
 		    &mt_time_cmp[target_hart - mt->first_hartid]);
 
+	/* Periodically report drift against the reference MTIME */
+	mtimer_drift_start(mt);
+
 	return 0;
 }
 
@@ -186,13 +280,14 @@ int aclint_mtimer_cold_init(struct aclint_mtimer_data *mt,
 
 	/* Allocate scratch space pointer */
 	if (!mtimer_ptr_offset) {
-		mtimer_ptr_offset = sbi_scratch_alloc_type_offset(void *);
+		mtimer_ptr_offset = sbi_scratch_alloc_hot_offset(sizeof(void *));
 		if (!mtimer_ptr_offset)
 			return SBI_ENOMEM;
 	}
 
 	/* Initialize private data */
 	aclint_mtimer_set_reference(mt, reference);
+	mt->time_drift_armed = 0;
 	mt->time_rd = mtimer_time_rd32;
 	mt->time_wr = mtimer_time_wr32;
 
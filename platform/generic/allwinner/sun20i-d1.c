@@ -36,13 +36,22 @@
 static unsigned long csr_mxstatus;
 static unsigned long csr_mhcr;
 static unsigned long csr_mhint;
+static bool csr_saved;
 
 static void sun20i_d1_csr_save(void)
 {
-	/* Save custom CSRs. */
-	csr_mxstatus	= csr_read(THEAD_C9XX_CSR_MXSTATUS);
-	csr_mhcr	= csr_read(THEAD_C9XX_CSR_MHCR);
-	csr_mhint	= csr_read(THEAD_C9XX_CSR_MHINT);
+	/*
+	 * Save custom CSRs. They are only accessible from M-mode and
+	 * nothing changes them after boot other than the restore below,
+	 * which writes back the same values, so they are only read by the
+	 * first suspend.
+	 */
+	if (!csr_saved) {
+		csr_mxstatus	= csr_read(THEAD_C9XX_CSR_MXSTATUS);
+		csr_mhcr	= csr_read(THEAD_C9XX_CSR_MHCR);
+		csr_mhint	= csr_read(THEAD_C9XX_CSR_MHINT);
+		csr_saved	= true;
+	}
 
 	/* Flush and disable caches. */
 	csr_write(THEAD_C9XX_CSR_MCOR, 0x22);
@@ -132,7 +141,10 @@ static void sun20i_d1_riscv_cfg_init(void)
 
 static int sun20i_d1_hart_suspend(u32 suspend_type)
 {
-	/* Use the generic code for retentive suspend. */
+	/*
+	 * Use the generic code for retentive suspend. The CPU keeps its
+	 * power and state so the CSR, PPU and wakeup setup is skipped.
+	 */
 	if (!(suspend_type & SBI_HSM_SUSP_NON_RET_BIT))
 		return SBI_ENOTSUPP;
 
@@ -159,10 +171,22 @@ static void sun20i_d1_hart_resume(void)
 	plic_resume();
 }
 
+/* Same values as the non-retentive state given to the supervisor */
+static const struct sbi_hsm_idle_state sun20i_d1_hsm_idle_states[] = {
+	{
+		.suspend_type		= SBI_HSM_SUSPEND_NON_RET_DEFAULT,
+		.exit_latency_us	= 67,
+		.min_residency_us	= 1100,
+		.local_timer_stop	= true,
+	},
+};
+
 static const struct sbi_hsm_device sun20i_d1_ppu = {
 	.name		= "sun20i-d1-ppu",
 	.hart_suspend	= sun20i_d1_hart_suspend,
 	.hart_resume	= sun20i_d1_hart_resume,
+	.idle_states	= sun20i_d1_hsm_idle_states,
+	.idle_state_count = array_size(sun20i_d1_hsm_idle_states),
 };
 
 static int sun20i_d1_final_init(bool cold_boot, void *fdt,
@@ -177,6 +201,15 @@ static int sun20i_d1_final_init(bool cold_boot, void *fdt,
 }
 
 static const struct sbi_cpu_idle_state sun20i_d1_cpu_idle_states[] = {
+	{
+		.name			= "cpu-retentive",
+		.suspend_param		= SBI_HSM_SUSPEND_RET_DEFAULT,
+		.local_timer_stop	= false,
+		.entry_latency_us	= 1,
+		.exit_latency_us	= 1,
+		.min_residency_us	= 10,
+		.wakeup_latency_us	= 2,
+	},
 	{
 		.name			= "cpu-nonretentive",
 		.suspend_param		= SBI_HSM_SUSPEND_NON_RET_DEFAULT,
@@ -13,8 +13,11 @@
 #include <libfdt.h>
 #include <sbi/riscv_asm.h>
 #include <sbi/riscv_io.h>
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_bitops.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_scratch.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 
 static unsigned long andes_pma_read_num(unsigned int csr_num)
@@ -154,23 +157,92 @@ static void decode_pmaaddrx(int entry_id, unsigned long *start,
 	 */
 	pmaaddr = andes_pma_read_num(CSR_PMAADDR0 + entry_id);
 	k = sbi_ffz(pmaaddr);
-	*size = 1 << (k + 3);
-	*start = (pmaaddr - (1 << k) + 1) << 2;
+	*size = 1UL << (k + 3);
+	*start = (pmaaddr - (1UL << k) + 1) << 2;
 }
 
-static bool has_pma_region_overlap(unsigned long start, unsigned long size)
+/*
+ * Software copy of the PMA entries. The PMA CSRs are per-HART so every
+ * HART has its own copy which is loaded from the CSRs on first use.
+ */
+struct andes_pma_shadow {
+	bool loaded;
+	char cfg[ANDES_MAX_PMA_REGIONS];
+	unsigned long start[ANDES_MAX_PMA_REGIONS];
+	unsigned long size[ANDES_MAX_PMA_REGIONS];
+	/* Start address of the region an entry was set up for */
+	unsigned long owner[ANDES_MAX_PMA_REGIONS];
+};
+
+static unsigned long andes_pma_shadow_offset;
+static spinlock_t andes_pma_shadow_lock = SPIN_LOCK_INITIALIZER;
+
+static struct andes_pma_shadow *andes_pma_get_shadow(void)
+{
+	struct andes_pma_shadow *shadow;
+
+	if (!andes_pma_shadow_offset) {
+		spin_lock(&andes_pma_shadow_lock);
+		if (!andes_pma_shadow_offset)
+			andes_pma_shadow_offset =
+			sbi_scratch_alloc_type_offset(struct andes_pma_shadow);
+		spin_unlock(&andes_pma_shadow_lock);
+		if (!andes_pma_shadow_offset)
+			return NULL;
+	}
+
+	shadow = sbi_scratch_thishart_offset_ptr(andes_pma_shadow_offset);
+	if (shadow->loaded)
+		return shadow;
+
+	for (int i = 0; i < ANDES_MAX_PMA_REGIONS; i++) {
+		shadow->cfg[i] = get_pmaxcfg(i);
+		if (is_pma_entry_disable(shadow->cfg[i]))
+			continue;
+
+		decode_pmaaddrx(i, &shadow->start[i], &shadow->size[i]);
+		shadow->owner[i] = shadow->start[i];
+	}
+	shadow->loaded = true;
+
+	return shadow;
+}
+
+static void andes_pma_invalidate_shadow(void)
 {
-	unsigned long _start, _size, _end, end;
-	char pmaxcfg;
+	struct andes_pma_shadow *shadow;
+
+	if (!andes_pma_shadow_offset)
+		return;
+
+	shadow = sbi_scratch_thishart_offset_ptr(andes_pma_shadow_offset);
+	shadow->loaded = false;
+}
+
+/* Largest NAPOT region starting at addr which fits in size */
+static unsigned long andes_pma_napot_chunk(unsigned long addr,
+					   unsigned long size)
+{
+	unsigned long chunk = 1UL << sbi_fls(size);
+
+	if (addr && (addr & -addr) < chunk)
+		chunk = addr & -addr;
+
+	return chunk;
+}
+
+static bool has_pma_region_overlap(const struct andes_pma_shadow *shadow,
+				   unsigned long start, unsigned long size)
+{
+	unsigned long _start, _end, end;
 
 	end = start + size - 1;
 	for (int i = 0; i < ANDES_MAX_PMA_REGIONS; i++) {
-		pmaxcfg = get_pmaxcfg(i);
-		if (is_pma_entry_disable(pmaxcfg))
+		if (is_pma_entry_disable(shadow->cfg[i]))
 			continue;
 
-		decode_pmaaddrx(i, &_start, &_size);
-		_end = _start + _size - 1;
+		_start = shadow->start[i];
+		_end = _start + shadow->size[i] - 1;
 
 		if (MAX(start, _start) <= MIN(end, _end)) {
 			sbi_printf(
@@ -338,6 +410,7 @@ int andes_pma_setup_regions(void *fdt,
 		else if (pma_regions[i].dt_populate)
 			dt_populate_cnt++;
 	}
+	andes_pma_invalidate_shadow();
 
 	if (!dt_populate_cnt)
 		return 0;
@@ -366,11 +439,30 @@ bool andes_sbi_probe_pma(void)
 	return (csr_read(CSR_MMSC_CFG) & MMSC_CFG_PPMA_MASK) ? true : false;
 }
 
+static int andes_pma_free_owner(struct andes_pma_shadow *shadow,
+				unsigned long pa)
+{
+	int count = 0;
+
+	for (int i = 0; i < ANDES_MAX_PMA_REGIONS; i++) {
+		if (is_pma_entry_disable(shadow->cfg[i]) ||
+		    shadow->owner[i] != pa)
+			continue;
+
+		set_pmaxcfg(i, ANDES_PMACFG_ETYP_OFF);
+		andes_pma_write_num(CSR_PMAADDR0 + i, 0);
+		shadow->cfg[i] = ANDES_PMACFG_ETYP_OFF;
+		count++;
+	}
+
+	return count;
+}
+
 int andes_sbi_set_pma(unsigned long pa, unsigned long size, u8 flags)
 {
-	unsigned int entry_id;
-	unsigned long rc;
-	char pmaxcfg;
+	struct andes_pma_shadow *shadow;
+	unsigned int entry_id, free_cnt, need_cnt;
+	unsigned long addr, left, chunk, rc;
 	struct andes_pma_region region;
 
 	if (!andes_sbi_probe_pma()) {
@@ -379,30 +471,59 @@ int andes_sbi_set_pma(unsigned long pa, unsigned long size, u8 flags)
 		return SBI_ERR_NOT_SUPPORTED;
 	}
 
-	if (has_pma_region_overlap(pa, size))
+	if ((flags & ANDES_PMACFG_ETYP_MASK) != ANDES_PMACFG_ETYP_NAPOT ||
+	    !size || (pa | size) & (ANDES_PMA_GRANULARITY - 1) ||
+	    pa + size - 1 < pa)
+		return SBI_ERR_INVALID_PARAM;
+
+	shadow = andes_pma_get_shadow();
+	if (!shadow)
+		return SBI_ERR_FAILED;
+
+	if (has_pma_region_overlap(shadow, pa, size))
 		return SBI_ERR_INVALID_PARAM;
 
+	/* A region which is not NAPOT takes several entries */
+	need_cnt = 0;
+	for (addr = pa, left = size; left; addr += chunk, left -= chunk) {
+		chunk = andes_pma_napot_chunk(addr, left);
+		need_cnt++;
+	}
+
+	free_cnt = 0;
 	for (entry_id = 0; entry_id < ANDES_MAX_PMA_REGIONS; entry_id++) {
-		pmaxcfg = get_pmaxcfg(entry_id);
-		if (is_pma_entry_disable(pmaxcfg)) {
-			region.pa = pa;
-			region.size = size;
-			region.flags = flags;
-			break;
-		}
+		if (is_pma_entry_disable(shadow->cfg[entry_id]))
+			free_cnt++;
 	}
 
-	if (entry_id == ANDES_MAX_PMA_REGIONS) {
+	if (free_cnt < need_cnt) {
 		sbi_printf("ERROR %s(): All PMA entries have run out\n",
 			   __func__);
 		return SBI_ERR_FAILED;
 	}
 
-	rc = andes_pma_setup(&region, entry_id);
-	if (rc == SBI_EINVAL) {
-		sbi_printf("ERROR %s(): Failed to set PMAADDR%d\n",
-			   __func__, entry_id);
-		return SBI_ERR_FAILED;
+	entry_id = 0;
+	for (addr = pa, left = size; left; addr += chunk, left -= chunk) {
+		chunk = andes_pma_napot_chunk(addr, left);
+		while (!is_pma_entry_disable(shadow->cfg[entry_id]))
+			entry_id++;
+
+		region.pa = addr;
+		region.size = chunk;
+		region.flags = flags;
+		rc = andes_pma_setup(&region, entry_id);
+
+		shadow->cfg[entry_id] = flags;
+		shadow->start[entry_id] = addr;
+		shadow->size[entry_id] = chunk;
+		shadow->owner[entry_id] = pa;
+
+		if (rc == SBI_EINVAL) {
+			sbi_printf("ERROR %s(): Failed to set PMAADDR%d\n",
+				   __func__, entry_id);
+			andes_pma_free_owner(shadow, pa);
+			return SBI_ERR_FAILED;
+		}
 	}
 
 	return SBI_SUCCESS;
@@ -410,8 +531,7 @@ int andes_sbi_set_pma(unsigned long pa, unsigned long size, u8 flags)
 
 int andes_sbi_free_pma(unsigned long pa)
 {
-	unsigned long start, size;
-	char pmaxcfg;
+	struct andes_pma_shadow *shadow;
 
 	if (!andes_sbi_probe_pma()) {
 		sbi_printf("ERROR %s(): Platform does not support PPMA.\n",
@@ -419,20 +539,9 @@ int andes_sbi_free_pma(unsigned long pa)
 		return SBI_ERR_NOT_SUPPORTED;
 	}
 
-	for (int i = 0; i < ANDES_MAX_PMA_REGIONS; i++) {
-		pmaxcfg = get_pmaxcfg(i);
-		if (is_pma_entry_disable(pmaxcfg))
-			continue;
-
-		decode_pmaaddrx(i, &start, &size);
-		if (start != pa)
-			continue;
-
-		set_pmaxcfg(i, ANDES_PMACFG_ETYP_OFF);
-		andes_pma_write_num(CSR_PMAADDR0 + i, 0);
-
+	shadow = andes_pma_get_shadow();
+	if (shadow && andes_pma_free_owner(shadow, pa))
 		return SBI_SUCCESS;
-	}
 
 	sbi_printf("ERROR %s(): Failed to find the entry with PA %#lx\n",
 		   __func__, pa);
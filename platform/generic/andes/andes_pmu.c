@@ -12,23 +12,31 @@
 #include <sbi/sbi_pmu.h>
 #include <libfdt.h>
 
-static void andes_hw_counter_enable_irq(uint32_t ctr_idx)
+#define ANDES_HW_CTR_MASK	(~0UL >> (BITS_PER_LONG - SBI_PMU_HW_CTR_MAX))
+
+static void andes_hw_counter_enable_irq_mask(unsigned long ctr_mask)
 {
 	unsigned long mip_val;
 
-	if (ctr_idx >= SBI_PMU_HW_CTR_MAX)
+	ctr_mask &= ANDES_HW_CTR_MASK;
+	if (!ctr_mask)
 		return;
 
 	mip_val = csr_read(CSR_MIP);
 	if (!(mip_val & MIP_PMOVI))
-		csr_clear(CSR_MCOUNTEROVF, BIT(ctr_idx));
+		csr_clear(CSR_MCOUNTEROVF, ctr_mask);
+
+	csr_set(CSR_MCOUNTERINTEN, ctr_mask);
+}
 
-	csr_set(CSR_MCOUNTERINTEN, BIT(ctr_idx));
+static void andes_hw_counter_disable_irq_mask(unsigned long ctr_mask)
+{
+	csr_clear(CSR_MCOUNTERINTEN, ctr_mask & ANDES_HW_CTR_MASK);
 }
 
-static void andes_hw_counter_disable_irq(uint32_t ctr_idx)
+static unsigned long andes_hw_counter_ovf_ack(void)
 {
-	csr_clear(CSR_MCOUNTERINTEN, BIT(ctr_idx));
+	return csr_read(CSR_MCOUNTEROVF);
 }
 
 static void andes_hw_counter_filter_mode(unsigned long flags, int ctr_idx)
@@ -46,8 +54,9 @@ static void andes_hw_counter_filter_mode(unsigned long flags, int ctr_idx)
 
 static struct sbi_pmu_device andes_pmu = {
 	.name = "andes_pmu",
-	.hw_counter_enable_irq  = andes_hw_counter_enable_irq,
-	.hw_counter_disable_irq = andes_hw_counter_disable_irq,
+	.hw_counter_enable_irq_mask  = andes_hw_counter_enable_irq_mask,
+	.hw_counter_disable_irq_mask = andes_hw_counter_disable_irq_mask,
+	.hw_counter_ovf_ack	     = andes_hw_counter_ovf_ack,
 	/*
 	 * We set delegation of supervisor local interrupts via
 	 * 18th bit on mslideleg instead of mideleg, so leave
@@ -65,22 +65,26 @@ int andes_pma_setup_regions(void *fdt,
 bool andes_sbi_probe_pma(void);
 
 /**
- * Set a NAPOT region with given memory attributes
- * @param pa: Start address of the NAPOT region
- * @param size: Size of the NAPOT region
- * @param flags: Memory attributes set to the NAPOT region
+ * Set a region with given memory attributes
+ *
+ * A region which is not NAPOT is set up as several NAPOT entries, all of
+ * them are reset together by andes_sbi_free_pma().
+ *
+ * @param pa: Start address of the region, 4KiB aligned
+ * @param size: Size of the region, a multiple of 4KiB
+ * @param flags: Memory attributes set to the region
  *
  * @return SBI_SUCCESS on success
  * @return SBI_ERR_NOT_SUPPORTED if hardware does not support PPMA features
- * @return SBI_ERR_INVALID_PARAM if the given region is overlapped with the
- *	   region that has been set already
+ * @return SBI_ERR_INVALID_PARAM if the given region is misaligned or is
+ *	   overlapped with the region that has been set already
  * @return SBI_ERR_FAILED if available entries have run out or setup fails
  */
 int andes_sbi_set_pma(unsigned long pa, unsigned long size, u8 flags);
 
 /**
- * Reset the memory attribute of a NAPOT region
- * @param pa Start address of the NAPOT region
+ * Reset the memory attribute of a region
+ * @param pa Start address of the region
  *
  * @return SBI_SUCCESS on success
  * @return SBI_ERR_FAILED if the given region is not set before
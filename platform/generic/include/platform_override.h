@@ -15,6 +15,8 @@
 #include <sbi/sbi_types.h>
 #include <sbi/sbi_trap.h>
 
+struct sbi_domain;
+
 struct platform_override {
 	const struct fdt_match *match_table;
 	u64 (*features)(const struct fdt_match *match);
@@ -25,6 +27,8 @@ struct platform_override {
 	int (*final_init)(bool cold_boot, void *fdt, const struct fdt_match *match);
 	void (*early_exit)(const struct fdt_match *match);
 	void (*final_exit)(const struct fdt_match *match);
+	void (*domain_enter)(const struct sbi_domain *dom,
+			     const struct fdt_match *match);
 	int (*fdt_fixup)(void *fdt, const struct fdt_match *match);
 	int (*extensions_init)(const struct fdt_match *match,
 			       struct sbi_hart_features *hfeatures);
@@ -0,0 +1,40 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * SiFive L2 composable cache way partitioning
+ */
+
+#ifndef __SIFIVE_CCACHE_H__
+#define __SIFIVE_CCACHE_H__
+
+#include <sbi/sbi_types.h>
+
+/* clang-format off */
+
+#define SIFIVE_CCACHE_CONFIG		0x000
+#define SIFIVE_CCACHE_CONFIG_WAYS_SHIFT	8
+#define SIFIVE_CCACHE_CONFIG_WAYS_MASK	0xff
+#define SIFIVE_CCACHE_WAYENABLE		0x008
+#define SIFIVE_CCACHE_WAYMASK(__m)	(0x800 + (__m) * 8)
+
+/*
+ * On FU540 and FU740 the DMA and other system masters come first,
+ * followed by the data and instruction cache master of every HART
+ */
+#define SIFIVE_CCACHE_HART0_MASTER	3
+#define SIFIVE_CCACHE_HARTS_MAX		5
+
+/* clang-format on */
+
+struct sbi_domain;
+
+/**
+ * Find the cache controller and check the cache way mask of every
+ * domain against the enabled ways, called once during cold boot
+ */
+int sifive_ccache_init(const void *fdt);
+
+/** Let the current HART allocate only into the cache ways of a domain */
+void sifive_ccache_domain_enter(const struct sbi_domain *dom);
+
+#endif
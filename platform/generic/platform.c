@@ -20,6 +20,7 @@
 #include <sbi_utils/fdt/fdt_domain.h>
 #include <sbi_utils/fdt/fdt_fixup.h>
 #include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_numa.h>
 #include <sbi_utils/fdt/fdt_pmu.h>
 #include <sbi_utils/irqchip/fdt_irqchip.h>
 #include <sbi_utils/irqchip/imsic.h>
@@ -63,7 +64,8 @@ static u32 fw_platform_calculate_heap_size(u32 hart_count)
 	heap_size = SBI_PLATFORM_DEFAULT_HEAP_SIZE(hart_count);
 
 	/* For TLB fifo */
-	heap_size += SBI_TLB_INFO_SIZE * (hart_count) * (hart_count);
+	heap_size += SBI_TLB_INFO_SIZE * (hart_count) *
+		     SBI_PLATFORM_DEFAULT_TLB_FIFO_ENTRIES(hart_count);
 
 	return BIT_ALIGN(heap_size, HEAP_BASE_ALIGN);
 }
@@ -254,6 +256,20 @@ static int generic_early_init(bool cold_boot)
 			rc = fdt_serial_init(fdt);
 		if (rc)
 			return rc;
+
+		/* Warm boot and resume only use what is parsed here */
+		rc = fdt_hart_desc_init(fdt);
+		if (rc)
+			return rc;
+
+		/* Before per-HART data is allocated by the other HARTs */
+		rc = fdt_numa_init(fdt);
+		if (rc)
+			return rc;
+
+		rc = fdt_cpu_map_init(fdt);
+		if (rc)
+			return rc;
 	}
 
 	if (!generic_plat || !generic_plat->early_init)
@@ -276,9 +292,15 @@ static int generic_final_init(bool cold_boot)
 	if (!cold_boot)
 		return 0;
 
+	/* All drivers are probed so the compatible index is not needed */
+	fdt_compat_index_free();
+
+	fdt_fixups_reserve(fdt);
 	fdt_cpu_fixup(fdt);
 	fdt_fixups(fdt);
 	fdt_domain_fixup(fdt);
+	fdt_phandle_cache_free();
+	fdt_cpu_table_free();
 
 	if (generic_plat && generic_plat->fdt_fixup) {
 		rc = generic_plat->fdt_fixup(fdt, generic_plat_match);
@@ -315,8 +337,16 @@ static void generic_final_exit(void)
 		generic_plat->final_exit(generic_plat_match);
 }
 
+static void generic_domain_enter(const struct sbi_domain *dom)
+{
+	if (generic_plat && generic_plat->domain_enter)
+		generic_plat->domain_enter(dom, generic_plat_match);
+}
+
 static int generic_extensions_init(struct sbi_hart_features *hfeatures)
 {
+	const struct fdt_hart_desc *desc;
+	u32 cboz_block_size, cbom_block_size;
 	int rc;
 
 	/* Parse the ISA string from FDT and enable the listed extensions */
@@ -326,6 +356,19 @@ static int generic_extensions_init(struct sbi_hart_features *hfeatures)
 	if (rc)
 		return rc;
 
+	/* Blocks zeroed with cbo.zero must be a power of two */
+	desc = fdt_hart_desc_get(current_hartid());
+	cboz_block_size = desc ? desc->cboz_block_size : 0;
+	if (desc && (desc->flags & FDT_HART_DESC_CBOZ_BLOCK_SIZE) &&
+	    cboz_block_size && !(cboz_block_size & (cboz_block_size - 1)))
+		hfeatures->cboz_block_size = cboz_block_size;
+
+	/* Same for blocks cleaned, invalidated or flushed with Zicbom */
+	cbom_block_size = desc ? desc->cbom_block_size : 0;
+	if (desc && (desc->flags & FDT_HART_DESC_CBOM_BLOCK_SIZE) &&
+	    cbom_block_size && !(cbom_block_size & (cbom_block_size - 1)))
+		hfeatures->cbom_block_size = cbom_block_size;
+
 	if (generic_plat && generic_plat->extensions_init)
 		return generic_plat->extensions_init(generic_plat_match,
 						     hfeatures);
@@ -362,6 +405,16 @@ static u64 generic_tlbr_flush_limit(void)
 	return SBI_PLATFORM_TLB_RANGE_FLUSH_LIMIT_DEFAULT;
 }
 
+static u64 generic_hart_tlbr_flush_limit(u32 hartid)
+{
+	const struct fdt_hart_desc *desc = fdt_hart_desc_get(hartid);
+
+	if (!desc || !(desc->flags & FDT_HART_DESC_TLBR_FLUSH_LIMIT))
+		return 0;
+
+	return desc->tlbr_flush_limit;
+}
+
 static u32 generic_tlb_num_entries(void)
 {
 	if (generic_plat && generic_plat->tlb_num_entries)
@@ -415,6 +468,7 @@ const struct sbi_platform_operations platform_ops = {
 	.final_init		= generic_final_init,
 	.early_exit		= generic_early_exit,
 	.final_exit		= generic_final_exit,
+	.domain_enter		= generic_domain_enter,
 	.extensions_init	= generic_extensions_init,
 	.domains_init		= generic_domains_init,
 	.irqchip_init		= fdt_irqchip_init,
@@ -422,6 +476,7 @@ const struct sbi_platform_operations platform_ops = {
 	.pmu_init		= generic_pmu_init,
 	.pmu_xlate_to_mhpmevent = generic_pmu_xlate_to_mhpmevent,
 	.get_tlbr_flush_limit	= generic_tlbr_flush_limit,
+	.get_hart_tlbr_flush_limit = generic_hart_tlbr_flush_limit,
 	.get_tlb_num_entries	= generic_tlb_num_entries,
 	.timer_init		= fdt_timer_init,
 	.vendor_ext_check	= generic_vendor_ext_check,
@@ -8,6 +8,8 @@
  */
 
 #include <platform_override.h>
+#include <sifive/sifive_ccache.h>
+#include <sbi/sbi_console.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 #include <sbi_utils/fdt/fdt_fixup.h>
 
@@ -20,6 +22,27 @@ static u64 sifive_fu540_tlbr_flush_limit(const struct fdt_match *match)
 	return 0;
 }
 
+static int sifive_fu540_final_init(bool cold_boot, void *fdt,
+				   const struct fdt_match *match)
+{
+	int rc;
+
+	if (cold_boot) {
+		rc = sifive_ccache_init(fdt);
+		if (rc)
+			sbi_printf("%s: cache way partitioning unavailable\n",
+				   __func__);
+	}
+
+	return 0;
+}
+
+static void sifive_fu540_domain_enter(const struct sbi_domain *dom,
+				      const struct fdt_match *match)
+{
+	sifive_ccache_domain_enter(dom);
+}
+
 static const struct fdt_match sifive_fu540_match[] = {
 	{ .compatible = "sifive,fu540" },
 	{ .compatible = "sifive,fu540g" },
@@ -31,4 +54,6 @@ static const struct fdt_match sifive_fu540_match[] = {
 const struct platform_override sifive_fu540 = {
 	.match_table = sifive_fu540_match,
 	.tlbr_flush_limit = sifive_fu540_tlbr_flush_limit,
+	.final_init = sifive_fu540_final_init,
+	.domain_enter = sifive_fu540_domain_enter,
 };
@@ -10,6 +10,7 @@
  */
 
 #include <platform_override.h>
+#include <sifive/sifive_ccache.h>
 #include <libfdt.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_hart.h>
@@ -55,7 +56,7 @@ static int da9063_system_reset_check(u32 type, u32 reason)
 	return 0;
 }
 
-static inline int da9063_sanity_check(struct i2c_adapter *adap, uint32_t reg)
+static int da9063_sanity_check(struct i2c_adapter *adap, uint32_t reg)
 {
 	uint8_t val;
 	int rc = i2c_adapter_reg_write(adap, reg, DA9063_REG_PAGE_CON, 0x02);
@@ -79,22 +80,19 @@ static inline int da9063_sanity_check(struct i2c_adapter *adap, uint32_t reg)
 	if (val != PMIC_CHIP_ID_DA9063)
 		return SBI_ENODEV;
 
-	return 0;
+	/* Leave the PMIC on the page the OS expects */
+	return i2c_adapter_reg_write(adap, reg, DA9063_REG_PAGE_CON, 0x00);
 }
 
+/* Must be called with page 0 selected */
 static inline int da9063_stop_watchdog(struct i2c_adapter *adap, uint32_t reg)
 {
 	uint8_t val;
-	int rc = i2c_adapter_reg_write(adap, reg,
-					DA9063_REG_PAGE_CON, 0x00);
+	int rc = i2c_adapter_reg_read(adap, reg, DA9063_REG_CONTROL_D, &val);
 
 	if (rc)
 		return rc;
 
-	rc = i2c_adapter_reg_read(adap, reg, DA9063_REG_CONTROL_D, &val);
-	if (rc)
-		return rc;
-
 	if ((val & DA9063_CONTROL_D_TWDSCALE_MASK) == 0)
 		return 0;
 
@@ -103,33 +101,24 @@ static inline int da9063_stop_watchdog(struct i2c_adapter *adap, uint32_t reg)
 	return i2c_adapter_reg_write(adap, reg, DA9063_REG_CONTROL_D, val);
 }
 
+/* Must be called with page 0 selected */
 static inline int da9063_shutdown(struct i2c_adapter *adap, uint32_t reg)
 {
-	int rc = i2c_adapter_reg_write(adap, reg,
-					DA9063_REG_PAGE_CON, 0x00);
-
-	if (rc)
-		return rc;
-
 	return i2c_adapter_reg_write(adap, reg,
 				     DA9063_REG_CONTROL_F,
 				     DA9063_CONTROL_F_SHUTDOWN);
 }
 
+/* Must be called with page 0 selected */
 static inline int da9063_reset(struct i2c_adapter *adap, uint32_t reg)
 {
 	int rc = i2c_adapter_reg_write(adap, reg,
-					DA9063_REG_PAGE_CON, 0x00);
+				       DA9063_REG_CONTROL_F,
+				       DA9063_CONTROL_F_WAKEUP);
 
 	if (rc)
 		return rc;
 
-	rc = i2c_adapter_reg_write(adap, reg,
-				   DA9063_REG_CONTROL_F,
-				   DA9063_CONTROL_F_WAKEUP);
-	if (rc)
-		return rc;
-
 	return i2c_adapter_reg_write(adap, reg,
 				DA9063_REG_CONTROL_A,
 				DA9063_CONTROL_A_M_POWER1_EN |
@@ -141,16 +130,13 @@ static void da9063_system_reset(u32 type, u32 reason)
 {
 	struct i2c_adapter *adap = da9063.adapter;
 	uint32_t reg = da9063.reg;
-	int rc;
-
-	if (adap) {
-		/* sanity check */
-		rc = da9063_sanity_check(adap, reg);
-		if (rc) {
-			sbi_printf("%s: chip is not da9063 PMIC\n", __func__);
-			goto skip_reset;
-		}
 
+	/*
+	 * The chip was identified when the device was registered so only
+	 * the page, which the OS may have changed, is selected here.
+	 */
+	if (adap && !i2c_adapter_reg_write(adap, reg, DA9063_REG_PAGE_CON,
+					   0x00)) {
 		switch (type) {
 		case SBI_SRST_RESET_TYPE_SHUTDOWN:
 			da9063_shutdown(adap, reg);
@@ -163,7 +149,6 @@ static void da9063_system_reset(u32 type, u32 reason)
 		}
 	}
 
-skip_reset:
 	sbi_hart_hang();
 }
 
@@ -197,6 +182,12 @@ static int da9063_reset_init(const void *fdt, int nodeoff,
 	if (rc)
 		return rc;
 
+	rc = da9063_sanity_check(adapter, da9063.reg);
+	if (rc) {
+		sbi_printf("%s: chip is not da9063 PMIC\n", __func__);
+		return rc;
+	}
+
 	da9063.adapter = adapter;
 
 	sbi_system_reset_add_device(&da9063_reset_i2c);
@@ -241,11 +232,22 @@ static int sifive_fu740_final_init(bool cold_boot, void *fdt,
 		if (rc)
 			sbi_printf("%s: failed to find da9063 for reset\n",
 				   __func__);
+
+		rc = sifive_ccache_init(fdt);
+		if (rc)
+			sbi_printf("%s: cache way partitioning unavailable\n",
+				   __func__);
 	}
 
 	return 0;
 }
 
+static void sifive_fu740_domain_enter(const struct sbi_domain *dom,
+				      const struct fdt_match *match)
+{
+	sifive_ccache_domain_enter(dom);
+}
+
 static const struct fdt_match sifive_fu740_match[] = {
 	{ .compatible = "sifive,fu740" },
 	{ .compatible = "sifive,fu740-c000" },
@@ -257,4 +259,5 @@ const struct platform_override sifive_fu740 = {
 	.match_table = sifive_fu740_match,
 	.tlbr_flush_limit = sifive_fu740_tlbr_flush_limit,
 	.final_init = sifive_fu740_final_init,
+	.domain_enter = sifive_fu740_domain_enter,
 };
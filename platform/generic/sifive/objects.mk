@@ -7,3 +7,5 @@ platform-objs-$(CONFIG_PLATFORM_SIFIVE_FU540) += sifive/fu540.o
 
 carray-platform_override_modules-$(CONFIG_PLATFORM_SIFIVE_FU740) += sifive_fu740
 platform-objs-$(CONFIG_PLATFORM_SIFIVE_FU740) += sifive/fu740.o
+
+platform-objs-$(CONFIG_SIFIVE_CCACHE) += sifive/sifive_ccache.o
@@ -0,0 +1,98 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * SiFive L2 composable cache way partitioning
+ *
+ * Every master of the cache has a WayMask register selecting the ways
+ * it may evict lines from. Restricting the HARTs of each domain to a
+ * set of ways gives a latency critical domain cache capacity which the
+ * other domains cannot take away. Hits are not affected, so lines a
+ * HART already holds in other ways stay usable until they are evicted.
+ */
+
+#include <libfdt.h>
+#include <sifive/sifive_ccache.h>
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_io.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_error.h>
+#include <sbi_utils/fdt/fdt_helper.h>
+
+static void *ccache_base;
+static u32 ccache_enabled_ways;
+/* Ways last written for each HART, zero until the first domain entry */
+static u32 ccache_hart_ways[SIFIVE_CCACHE_HARTS_MAX];
+
+static const struct fdt_match sifive_ccache_match[] = {
+	{ .compatible = "sifive,fu540-c000-ccache" },
+	{ .compatible = "sifive,fu740-c000-ccache" },
+	{ .compatible = "sifive,ccache0" },
+	{ },
+};
+
+int sifive_ccache_init(const void *fdt)
+{
+	struct sbi_domain *dom;
+	u32 ways, last, mask;
+	u64 addr, size;
+	int nodeoff, rc;
+
+	nodeoff = fdt_find_match(fdt, -1, sifive_ccache_match, NULL);
+	if (nodeoff < 0)
+		return 0;
+
+	rc = fdt_get_node_addr_size(fdt, nodeoff, 0, &addr, &size);
+	if (rc)
+		return rc;
+	if ((unsigned long)addr != addr)
+		return SBI_EINVAL;
+
+	ccache_base = (void *)(unsigned long)addr;
+	ways = (readl(ccache_base + SIFIVE_CCACHE_CONFIG) >>
+		SIFIVE_CCACHE_CONFIG_WAYS_SHIFT) &
+	       SIFIVE_CCACHE_CONFIG_WAYS_MASK;
+	last = readl(ccache_base + SIFIVE_CCACHE_WAYENABLE) & 0xff;
+	if (!ways) {
+		ccache_base = NULL;
+		return SBI_ENODEV;
+	}
+	if (ways > 32)
+		ways = 32;
+	if (last >= ways)
+		last = ways - 1;
+	ccache_enabled_ways = (last == 31) ? -1U : ((2U << last) - 1);
+
+	/* Ways past WayEnable are scratchpad memory, not cache */
+	sbi_domain_for_each(dom) {
+		mask = dom->cache_way_mask & ccache_enabled_ways;
+		if (mask == dom->cache_way_mask)
+			continue;
+
+		sbi_printf("%s: domain %s cache ways 0x%x limited to 0x%x\n",
+			   __func__, dom->name, dom->cache_way_mask, mask);
+		dom->cache_way_mask = mask;
+	}
+
+	return 0;
+}
+
+void sifive_ccache_domain_enter(const struct sbi_domain *dom)
+{
+	u32 hartid = current_hartid(), master, ways;
+
+	if (!ccache_base || hartid >= SIFIVE_CCACHE_HARTS_MAX)
+		return;
+
+	ways = dom->cache_way_mask ? dom->cache_way_mask : ccache_enabled_ways;
+	if (ways == ccache_hart_ways[hartid])
+		return;
+
+	master = SIFIVE_CCACHE_HART0_MASTER + 2 * hartid;
+	writel(ways, ccache_base + SIFIVE_CCACHE_WAYMASK(master));
+	writel(ways, ccache_base + SIFIVE_CCACHE_WAYMASK(master + 1));
+
+	/* The new masks apply before the domain runs */
+	readl(ccache_base + SIFIVE_CCACHE_WAYMASK(master + 1));
+	ccache_hart_ways[hartid] = ways;
+}
@@ -11,6 +11,7 @@
 #include <thead/c9xx_pmu.h>
 #include <sbi/sbi_const.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_ipi.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
@@ -21,11 +22,30 @@
 #define SOPHGO_SG2042_TIMER_SIZE	0x10000UL
 #define SOPHGO_SG2042_TIMER_NUM		16
 
+/* Four C920 cores share a cluster, its MTIMER and its MSWI */
+#define SOPHGO_SG2042_CLUSTER_HARTS	4
+
+/*
+ * The 1024 entry jTLB of the C920 takes far longer to refill after a
+ * full flush than 64 page by page flushes take.
+ */
+#define SOPHGO_SG2042_TLB_RANGE_FLUSH_LIMIT	(64 * PAGE_SIZE)
+
+/*
+ * Queued ranges are merged and a full queue escalates to a full flush
+ * so a short queue per HART is enough and keeps 64 HARTs worth of queues
+ * small.
+ */
+#define SOPHGO_SG2042_TLB_FIFO_ENTRIES	16
+
 static int sophgo_sg2042_early_init(bool cold_boot, const void *fdt,
 				    const struct fdt_match *match)
 {
 	thead_register_tlb_flush_trap_handler();
 
+	if (cold_boot)
+		sbi_ipi_set_cluster_size(SOPHGO_SG2042_CLUSTER_HARTS);
+
 	/*
 	 * Sophgo sg2042 soc use separate 16 timers while initiating,
 	 * merge them as a single domain to avoid wasting.
@@ -51,6 +71,16 @@ static int sophgo_sg2042_extensions_init(const struct fdt_match *match,
 	return 0;
 }
 
+static u64 sophgo_sg2042_tlbr_flush_limit(const struct fdt_match *match)
+{
+	return SOPHGO_SG2042_TLB_RANGE_FLUSH_LIMIT;
+}
+
+static u32 sophgo_sg2042_tlb_num_entries(const struct fdt_match *match)
+{
+	return SOPHGO_SG2042_TLB_FIFO_ENTRIES;
+}
+
 static const struct fdt_match sophgo_sg2042_match[] = {
 	{ .compatible = "sophgo,sg2042" },
 	{ },
@@ -60,4 +90,6 @@ const struct platform_override sophgo_sg2042 = {
 	.match_table		= sophgo_sg2042_match,
 	.early_init		= sophgo_sg2042_early_init,
 	.extensions_init	= sophgo_sg2042_extensions_init,
+	.tlbr_flush_limit	= sophgo_sg2042_tlbr_flush_limit,
+	.tlb_num_entries	= sophgo_sg2042_tlb_num_entries,
 };
@@ -23,6 +23,8 @@
 struct pmic {
 	struct i2c_adapter *adapter;
 	u32 dev_addr;
+	/* Power register contents read when the PMIC was probed */
+	u8 power_reg;
 };
 
 struct jh7110 {
@@ -100,11 +102,11 @@ static int wait_pmu_pd_state(u32 mask)
 	} while (1);
 }
 
-static int shutdown_device_power_domain(void)
+/* Returns the device power domains being turned off, if any */
+static u32 shutdown_device_power_domain_start(void)
 {
 	unsigned long addr = jh7110_inst.pmu_reg_base;
 	u32 curr_mode;
-	int ret = 0;
 
 	curr_mode = readl((void *)(addr + CURR_POWER_MODE));
 	curr_mode &= DEVICE_PD_MASK;
@@ -114,30 +116,59 @@ static int shutdown_device_power_domain(void)
 		writel(SW_MODE_ENCOURAGE_ON, (void *)(addr + SW_ENCOURAGE));
 		writel(SW_MODE_ENCOURAGE_DIS_LO, (void *)(addr + SW_ENCOURAGE));
 		writel(SW_MODE_ENCOURAGE_DIS_HI, (void *)(addr + SW_ENCOURAGE));
-		ret = wait_pmu_pd_state(SYSTOP_CPU_PD_MASK);
-		if (ret)
-			sbi_printf("%s shutdown device power %x error\n",
-				   __func__, curr_mode);
 	}
+
+	return curr_mode;
+}
+
+static int shutdown_device_power_domain_wait(u32 curr_mode)
+{
+	int ret;
+
+	if (!curr_mode)
+		return 0;
+
+	ret = wait_pmu_pd_state(SYSTOP_CPU_PD_MASK);
+	if (ret)
+		sbi_printf("%s shutdown device power %x error\n",
+			   __func__, curr_mode);
 	return ret;
 }
 
+static void pmic_i2c_clk_enable(void)
+{
+	unsigned long clock_base;
+	unsigned int val;
+
+	clock_base = jh7110_inst.clk_reg_base + jh7110_inst.i2c_clk_offset;
+	val = readl((void *)clock_base);
+
+	if (!val)
+		writel(I2C_APB_CLK_ENABLE_BIT, (void *)clock_base);
+}
+
 static void pmic_ops(struct pmic *pmic, int type)
 {
 	int ret = 0;
+	u32 curr_mode;
 	u8 val;
 
-	ret = shutdown_device_power_domain();
+	/*
+	 * The I2C5 clock is in the always-on domain so it is brought
+	 * back while the PMU turns off the device power domains.
+	 */
+	curr_mode = shutdown_device_power_domain_start();
+	/* i2c clk may be disabled by kernel driver */
+	pmic_i2c_clk_enable();
+	ret = shutdown_device_power_domain_wait(curr_mode);
 	if (ret)
 		return;
 
-	ret = i2c_adapter_reg_read(pmic->adapter, pmic->dev_addr,
-				   AXP15060_POWER_REG, &val);
-	if (ret) {
-		sbi_printf("%s: cannot read pmic power register\n", __func__);
-		return;
-	}
-
+	/*
+	 * The power register was read when the PMIC was probed, which
+	 * saves a transfer on the way down.
+	 */
+	val = pmic->power_reg;
 	val |= AXP15060_POWER_OFF_BIT;
 	if (type == SBI_SRST_RESET_TYPE_SHUTDOWN)
 		val |= AXP15060_POWER_OFF_BIT;
@@ -150,26 +181,12 @@ static void pmic_ops(struct pmic *pmic, int type)
 		sbi_printf("%s: cannot write pmic power register\n", __func__);
 }
 
-static void pmic_i2c_clk_enable(void)
-{
-	unsigned long clock_base;
-	unsigned int val;
-
-	clock_base = jh7110_inst.clk_reg_base + jh7110_inst.i2c_clk_offset;
-	val = readl((void *)clock_base);
-
-	if (!val)
-		writel(I2C_APB_CLK_ENABLE_BIT, (void *)clock_base);
-}
-
 static void pm_system_reset(u32 type, u32 reason)
 {
 	if (pmic_inst.adapter) {
 		switch (type) {
 		case SBI_SRST_RESET_TYPE_SHUTDOWN:
 		case SBI_SRST_RESET_TYPE_COLD_REBOOT:
-			/* i2c clk may be disabled by kernel driver */
-			pmic_i2c_clk_enable();
 			pmic_ops(&pmic_inst, type);
 			break;
 		default:
@@ -195,6 +212,7 @@ static int pm_reset_init(const void *fdt, int nodeoff,
 	int i2c_bus;
 	struct i2c_adapter *adapter;
 	u64 addr;
+	u8 val;
 
 	rc = fdt_get_node_addr_size(fdt, nodeoff, 0, &addr, NULL);
 	if (rc)
@@ -217,6 +235,18 @@ static int pm_reset_init(const void *fdt, int nodeoff,
 	if (rc)
 		return rc;
 
+	/* Probe the PMIC and keep its power register for pmic_ops() */
+	pmic_i2c_clk_enable();
+	rc = i2c_adapter_reg_read(adapter, pmic_inst.dev_addr,
+				  AXP15060_POWER_REG, &val);
+	if (rc) {
+		sbi_printf("%s: cannot read pmic power register\n", __func__);
+		pmic_inst.adapter = NULL;
+		return rc;
+	}
+	pmic_inst.power_reg = val & ~(AXP15060_POWER_OFF_BIT |
+				      AXP15060_RESET_BIT);
+
 	sbi_system_reset_add_device(&pm_reset);
 
 	return 0;
@@ -14,17 +14,20 @@
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_pmu.h>
 
-static void thead_c9xx_pmu_ctr_enable_irq(uint32_t ctr_idx)
+#define THEAD_C9XX_HW_CTR_MASK	(~0UL >> (BITS_PER_LONG - SBI_PMU_HW_CTR_MAX))
+
+static void thead_c9xx_pmu_ctr_enable_irq_mask(unsigned long ctr_mask)
 {
-	if (ctr_idx >= SBI_PMU_HW_CTR_MAX)
+	ctr_mask &= THEAD_C9XX_HW_CTR_MASK;
+	if (!ctr_mask)
 		return;
 
 	/**
-	 * Clear out the OF bit so that next interrupt can be enabled.
+	 * Clear out the OF bits so that next interrupt can be enabled.
 	 * This should be done before starting interrupt to avoid unexcepted
 	 * overflow interrupt.
 	 */
-	csr_clear(THEAD_C9XX_CSR_MCOUNTEROF, BIT(ctr_idx));
+	csr_clear(THEAD_C9XX_CSR_MCOUNTEROF, ctr_mask);
 
 	/**
 	 * This register is described in C9xx document as the control register
@@ -32,23 +35,29 @@ static void thead_c9xx_pmu_ctr_enable_irq(uint32_t ctr_idx)
 	 * corresponding bit is not set to 1, scounterof will always read as 0
 	 * when the counter register overflows.
 	 */
-	csr_set(THEAD_C9XX_CSR_MCOUNTERWEN, BIT(ctr_idx));
+	csr_set(THEAD_C9XX_CSR_MCOUNTERWEN, ctr_mask);
 
 	/**
 	 * SSCOFPMF uses the OF bit for enabling/disabling the interrupt,
 	 * while the C9XX has designated enable bits.
 	 * So enable per-counter interrupt on C9xx here.
 	 */
-	csr_set(THEAD_C9XX_CSR_MCOUNTERINTEN, BIT(ctr_idx));
+	csr_set(THEAD_C9XX_CSR_MCOUNTERINTEN, ctr_mask);
 }
 
-static void thead_c9xx_pmu_ctr_disable_irq(uint32_t ctr_idx)
+static void thead_c9xx_pmu_ctr_disable_irq_mask(unsigned long ctr_mask)
 {
 	/**
-	 * There is no need to clear the bit of mcounterwen, it will expire
+	 * There is no need to clear the bits of mcounterwen, they will expire
 	 * after setting the csr mcountinhibit.
 	 */
-	csr_clear(THEAD_C9XX_CSR_MCOUNTERINTEN, BIT(ctr_idx));
+	csr_clear(THEAD_C9XX_CSR_MCOUNTERINTEN,
+		  ctr_mask & THEAD_C9XX_HW_CTR_MASK);
+}
+
+static unsigned long thead_c9xx_pmu_ctr_ovf_ack(void)
+{
+	return csr_read(THEAD_C9XX_CSR_MCOUNTEROF);
 }
 
 static int thead_c9xx_pmu_irq_bit(void)
@@ -58,8 +67,9 @@ static int thead_c9xx_pmu_irq_bit(void)
 
 static const struct sbi_pmu_device thead_c9xx_pmu_device = {
 	.name = "thead,c900-pmu",
-	.hw_counter_enable_irq = thead_c9xx_pmu_ctr_enable_irq,
-	.hw_counter_disable_irq = thead_c9xx_pmu_ctr_disable_irq,
+	.hw_counter_enable_irq_mask = thead_c9xx_pmu_ctr_enable_irq_mask,
+	.hw_counter_disable_irq_mask = thead_c9xx_pmu_ctr_disable_irq_mask,
+	.hw_counter_ovf_ack = thead_c9xx_pmu_ctr_ovf_ack,
 	.hw_counter_irq_bit = thead_c9xx_pmu_irq_bit,
 };
 
@@ -0,0 +1,251 @@
+#!/usr/bin/env bash
+#
+# SPDX-License-Identifier: BSD-2-Clause
+#
+# Collect the firmware benchmarks printed on the console of a platform
+# into a results file and compare them against a baseline of the same
+# platform. The console log comes either from a run command, such as
+# the "make run" QEMU command, or from a capture of real hardware.
+#
+
+function usage()
+{
+	echo "Usage:"
+	echo " $0 [options] [-- <run_command>]"
+	echo "Options:"
+	echo "     -h                   Display help or usage"
+	echo "     -p <platform>        Platform name recorded in the results"
+	echo "     -l <console_log>     Console log to parse (written when a"
+	echo "                          run command is given)"
+	echo "     -o <results_file>    Output results file"
+	echo "     -b <baseline_file>   Baseline results to compare against"
+	echo "     -t <tolerance>       Allowed slowdown in percent (default 10)"
+	echo "     -T <timeout>         Run command timeout in seconds (default 300)"
+	echo "     -u                   Update the baseline with the results"
+	exit 1;
+}
+
+# Printed by the test payload once all of its benchmarks are done
+DONE_MARKER="SBI benchmarks done"
+
+# Command line options
+PLATFORM=""
+CONSOLE_LOG=""
+RESULTS_FILE=""
+BASELINE_FILE=""
+TOLERANCE=10
+TIMEOUT=300
+UPDATE_BASELINE="n"
+
+while getopts "hp:l:o:b:t:T:u" o; do
+	case "${o}" in
+	h)
+		usage
+		;;
+	p)
+		PLATFORM=${OPTARG}
+		;;
+	l)
+		CONSOLE_LOG=${OPTARG}
+		;;
+	o)
+		RESULTS_FILE=${OPTARG}
+		;;
+	b)
+		BASELINE_FILE=${OPTARG}
+		;;
+	t)
+		TOLERANCE=${OPTARG}
+		;;
+	T)
+		TIMEOUT=${OPTARG}
+		;;
+	u)
+		UPDATE_BASELINE="y"
+		;;
+	*)
+		usage
+		;;
+	esac
+done
+shift $((OPTIND-1))
+
+if [ -z "${PLATFORM}" ]; then
+	echo "Must specify platform name"
+	usage
+fi
+
+if [ -z "${RESULTS_FILE}" ]; then
+	echo "Must specify output results file"
+	usage
+fi
+
+if [ "${UPDATE_BASELINE}" == "y" ] && [ -z "${BASELINE_FILE}" ]; then
+	echo "Must specify baseline file to update"
+	usage
+fi
+
+if [ $# -gt 0 ]; then
+	if [ -z "${CONSOLE_LOG}" ]; then
+		CONSOLE_LOG="${RESULTS_FILE}.log"
+	fi
+
+	# Run until the payload is done, the command exits or time is up
+	"$@" > "${CONSOLE_LOG}" 2>&1 < /dev/null &
+	RUN_PID=$!
+	ELAPSED=0
+	while kill -0 ${RUN_PID} 2> /dev/null; do
+		if grep -q "${DONE_MARKER}" "${CONSOLE_LOG}"; then
+			break
+		fi
+		if [ ${ELAPSED} -ge ${TIMEOUT} ]; then
+			echo "Run command timed out after ${TIMEOUT} seconds"
+			break
+		fi
+		sleep 1
+		ELAPSED=$((ELAPSED + 1))
+	done
+	kill ${RUN_PID} 2> /dev/null
+	wait ${RUN_PID} 2> /dev/null
+elif [ -z "${CONSOLE_LOG}" ]; then
+	echo "Must specify console log or run command"
+	usage
+fi
+
+if [ ! -f "${CONSOLE_LOG}" ]; then
+	echo "Console log ${CONSOLE_LOG} not found"
+	exit 1
+fi
+
+if ! grep -q "${DONE_MARKER}" "${CONSOLE_LOG}"; then
+	echo "Benchmarks did not complete, see ${CONSOLE_LOG}"
+	exit 1
+fi
+
+# One "<key> <value>" line per metric, sorted by key, where lower values
+# are better. Metrics which failed to run have the value "failed".
+{
+	echo "# opensbi-perf 1"
+	echo "# platform ${PLATFORM}"
+	sed -n 's/^\(OpenSBI v[^ ]*\).*/# firmware \1/p' "${CONSOLE_LOG}" | head -n 1
+	tr -d '\r' < "${CONSOLE_LOG}" | awk '
+	function key(s) {
+		gsub(/[^A-Za-z0-9_.,+-]/, "_", s)
+		return s
+	}
+	function field(name,    i) {
+		for (i = 1; i <= NF; i++)
+			if (index($i, name "=") == 1)
+				return substr($i, length(name) + 2)
+		return ""
+	}
+	# Boot stage profiler: "Boot Trace <stage> : <c> cycles (+<d>), ..."
+	/^Boot Trace / {
+		stage = $0
+		sub(/^Boot Trace /, "", stage)
+		sub(/ *:.*/, "", stage)
+		delta = $0
+		sub(/.*\(\+/, "", delta)
+		sub(/\).*/, "", delta)
+		print "boot/" key(stage) ".delta " delta
+		next
+	}
+	# SBIUnit benchmark cases, per HART and for all HARTs together
+	/^\[SBIUnit\] bench / {
+		name = "sbiunit/" key(field("suite")) "/" key(field("case"))
+		if (field("p50") != "") {
+			print name "/hart" field("hart") ".p50 " field("p50")
+			print name "/hart" field("hart") ".p99 " field("p99")
+		} else if ($5 == "total") {
+			print name "/total.time " field("time")
+		}
+		next
+	}
+	# Domain context switch benchmarks of the SBIUnit tests
+	/^\[SBIUnit\] .* cycles min / {
+		name = $0
+		sub(/^\[SBIUnit\] /, "", name)
+		sub(/ *cycles min .*/, "", name)
+		for (i = 1; i < NF; i++) {
+			if ($i == "p50" || $i == "p90")
+				print "domain/" key(name) "." $i " " $(i + 1)
+		}
+		next
+	}
+	# SBI latency benchmarks of the test payload
+	/^benchmark +param +harts/ {
+		payload = 1
+		next
+	}
+	payload && $0 ~ DONE {
+		payload = 0
+		next
+	}
+	payload && NF >= 4 && $3 ~ /^[0-9]+$/ {
+		name = "payload/" key($1) "/" key($2) "/" $3
+		if ($4 == "failed") {
+			print name ".avg failed"
+		} else if (NF >= 7) {
+			print name ".min " $5
+			print name ".avg " $6
+		}
+	}
+	' DONE="${DONE_MARKER}" | LC_ALL=C sort -k1,1
+} > "${RESULTS_FILE}"
+
+echo "Wrote $(grep -vc '^#' "${RESULTS_FILE}") metrics to ${RESULTS_FILE}"
+
+if [ "${UPDATE_BASELINE}" == "y" ]; then
+	cp "${RESULTS_FILE}" "${BASELINE_FILE}"
+	echo "Updated baseline ${BASELINE_FILE}"
+	exit 0
+fi
+
+if [ -z "${BASELINE_FILE}" ]; then
+	exit 0
+fi
+
+if [ ! -f "${BASELINE_FILE}" ]; then
+	echo "Baseline ${BASELINE_FILE} not found"
+	exit 1
+fi
+
+# Metrics slower than the baseline by more than the tolerance fail the
+# comparison. Metrics missing on either side are only reported.
+awk -v tol="${TOLERANCE}" '
+	/^#/ { next }
+	FNR == NR { base[$1] = $2; next }
+	{
+		seen[$1] = 1
+		if (!($1 in base)) {
+			printf "%-60s %12s %12s new\n", $1, "-", $2
+			next
+		}
+		if ($2 !~ /^[0-9]+$/) {
+			if ($2 != base[$1]) {
+				printf "%-60s %12s %12s REGRESSED\n", \
+				       $1, base[$1], $2
+				regressed++
+			}
+			next
+		}
+		if (base[$1] !~ /^[0-9]+$/) {
+			printf "%-60s %12s %12s fixed\n", $1, base[$1], $2
+			next
+		}
+		if ($2 * 100 > base[$1] * (100 + tol)) {
+			printf "%-60s %12s %12s REGRESSED\n", $1, base[$1], $2
+			regressed++
+		} else if ($2 * 100 < base[$1] * (100 - tol)) {
+			printf "%-60s %12s %12s improved\n", $1, base[$1], $2
+		}
+	}
+	END {
+		for (k in base)
+			if (!(k in seen))
+				printf "%-60s %12s %12s missing\n", k, base[k], "-"
+		printf "%d metrics regressed by more than %d%%\n", \
+		       regressed, tol
+		exit regressed ? 1 : 0
+	}
+' "${BASELINE_FILE}" "${RESULTS_FILE}"